@@ -0,0 +1,74 @@
+#!/bin/bash
+
+# ARX Compile-Time Scaling Benchmark
+# Generates modules with a growing number of methods, locals and call sites
+# and times the compiler on each. With hashed name lookups the time per
+# method should stay flat as the module grows.
+#
+# Usage: bench/compile_scaling.sh [compiler] [sizes...]
+#   compiler  Path to the arx compiler (default: ./arx)
+#   sizes     Methods per module (default: 250 500 1000 2000 4000)
+
+set -e
+
+ARX=${1:-./arx}
+shift || true
+SIZES=${*:-250 500 1000 2000 4000}
+LOCALS=8
+
+if [ ! -x "$ARX" ]; then
+    echo "Error: compiler '$ARX' not found (build it first or pass its path)"
+    exit 1
+fi
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# One Worker class with n methods, each declaring LOCALS locals, and a Main
+# that calls every method
+generate_module()
+{
+    local n=$1
+    echo "module Scaling$n;"
+    echo ""
+    echo "class App"
+    echo "  procedure Main"
+    echo "  begin"
+    echo "    Worker w;"
+    echo "    w = new Worker;"
+    for ((m = 0; m < n; m++)); do
+        echo "    writeln('m$m = ' + w.method$m());"
+    done
+    echo "  end;"
+    echo "end;"
+    echo ""
+    echo "class Worker"
+    for ((m = 0; m < n; m++)); do
+        echo "  function method$m: integer"
+        echo "  begin"
+        for ((v = 0; v < LOCALS; v++)); do
+            echo "    integer v${m}_$v;"
+            echo "    v${m}_$v = $v;"
+        done
+        echo "    return v${m}_0 + v${m}_$((LOCALS - 1));"
+        echo "  end;"
+    done
+    echo "end;"
+}
+
+echo "=== ARX Compile-Time Scaling ==="
+printf "%10s %10s %12s %14s\n" "methods" "lines" "seconds" "us/method"
+
+for n in $SIZES; do
+    source_file="$WORK/scaling_$n.arx"
+    generate_module "$n" > "$source_file"
+    lines=$(wc -l < "$source_file")
+
+    start=$(date +%s%N)
+    "$ARX" -o "$WORK/scaling_$n.arxmod" "$source_file" > /dev/null
+    end=$(date +%s%N)
+
+    elapsed=$((end - start))
+    printf "%10d %10d %12s %14d\n" "$n" "$lines" \
+        "$(awk "BEGIN { printf \"%.3f\", $elapsed / 1e9 }")" $((elapsed / 1000 / n))
+done
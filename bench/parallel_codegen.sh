@@ -0,0 +1,87 @@
+#!/bin/bash
+
+# ARX Parallel Code Generation Benchmark
+# Generates a module with many classes and times the compiler at several
+# -j settings. Every run must produce the same .arxmod as -j 1.
+#
+# Usage: bench/parallel_codegen.sh [compiler] [classes] [methods] [jobs...]
+#   compiler  Path to the arx compiler (default: ./arx)
+#   classes   Classes in the module (default: 400)
+#   methods   Methods per class (default: 20)
+#   jobs      -j values to time (default: 1 2 4 and the CPU count)
+
+set -e
+
+ARX=${1:-./arx}
+CLASSES=${2:-400}
+METHODS=${3:-20}
+shift 3 || shift $#
+JOBS=${*:-1 2 4 $(nproc)}
+
+if [ ! -x "$ARX" ]; then
+    echo "Error: compiler '$ARX' not found (build it first or pass its path)"
+    exit 1
+fi
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# App.Main plus CLASSES classes of METHODS methods, each with a loop and a
+# branch so every class carries its own labels and locals
+generate_module()
+{
+    echo "module Parallel;"
+    echo ""
+    echo "class App"
+    echo "  procedure Main"
+    echo "  begin"
+    echo "    integer x;"
+    echo "    x = 1;"
+    echo "  end;"
+    echo "end;"
+    for ((c = 0; c < CLASSES; c++)); do
+        echo ""
+        echo "class C$c"
+        for ((m = 0; m < METHODS; m++)); do
+            echo "  function f$m: integer"
+            echo "  begin"
+            echo "    integer a;"
+            echo "    integer b;"
+            echo "    a = 0;"
+            echo "    b = 0;"
+            echo "    while a < $m do"
+            echo "    begin"
+            echo "      if a > 2 then"
+            echo "      begin"
+            echo "        b = b + a;"
+            echo "      end;"
+            echo "      a = a + 1;"
+            echo "    end;"
+            echo "    return b;"
+            echo "  end;"
+        done
+        echo "end;"
+    done
+}
+
+source_file="$WORK/parallel.arx"
+generate_module > "$source_file"
+
+echo "=== ARX Parallel Code Generation ==="
+echo "$CLASSES classes x $METHODS methods, $(wc -l < "$source_file") lines, $(nproc) CPUs"
+printf "%6s %12s %10s\n" "jobs" "seconds" "output"
+
+"$ARX" -j 1 -o "$WORK/reference.arxmod" "$source_file" > /dev/null
+
+for jobs in $JOBS; do
+    start=$(date +%s%N)
+    "$ARX" -j "$jobs" -o "$WORK/j$jobs.arxmod" "$source_file" > /dev/null
+    end=$(date +%s%N)
+
+    if cmp -s "$WORK/reference.arxmod" "$WORK/j$jobs.arxmod"; then
+        output="same"
+    else
+        output="DIFFERS"
+    fi
+    printf "%6d %12s %10s\n" "$jobs" "$(awk "BEGIN { printf \"%.3f\", $(( end - start )) / 1e9 }")" "$output"
+done
@@ -0,0 +1,271 @@
+#!/bin/bash
+
+# ARX Benchmark Harness
+# Compiles and runs every program in bench/cases several times, times a
+# compile of a large generated module, and writes the results as JSON. With
+# a baseline it also compares the two and fails on regressions.
+#
+# Usage: bench/run.sh [options]
+#   -r <runs>       Runs per benchmark; the median is reported (default: 5)
+#   -o <file>       Write results to file (default: stdout)
+#   -b <file>       Compare against a baseline written by an earlier run
+#   -t <percent>    Slowdown that counts as a regression (default: 10)
+#   -c <classes>    Classes in the generated compile-time module (default: 500)
+#
+# Environment:
+#   ARX             Path to the arx compiler (default: ./arx)
+#   ARXVM           Path to the arx VM (default: ./arxvm)
+#   VM_FLAGS        Flags for every VM run (default: -threaded)
+#
+# Each benchmark is one line of the "benchmarks" array:
+#   wall_ms               Median wall-clock time of the whole process
+#   exec_ms               Median time inside the interpreter (VM benchmarks)
+#   instructions          Instructions executed
+#   instructions_per_sec  instructions / exec_ms
+#   allocations           Heap blocks allocated, and allocated_bytes their size
+#   peak_rss_kb           Largest peak resident set over the runs (null if unknown)
+
+set -e
+
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+ARX=${ARX:-./arx}
+ARXVM=${ARXVM:-./arxvm}
+VM_FLAGS=${VM_FLAGS--threaded}
+RUNS=5
+OUTPUT=
+BASELINE=
+THRESHOLD=10
+COMPILE_CLASSES=500
+
+while getopts "r:o:b:t:c:" option; do
+    case $option in
+        r) RUNS=$OPTARG ;;
+        o) OUTPUT=$OPTARG ;;
+        b) BASELINE=$OPTARG ;;
+        t) THRESHOLD=$OPTARG ;;
+        c) COMPILE_CLASSES=$OPTARG ;;
+        *) sed -n '3,27p' "$0"; exit 1 ;;
+    esac
+done
+
+for tool in "$ARX" "$ARXVM"; do
+    if [ ! -x "$tool" ]; then
+        echo "Error: '$tool' not found (build it first or set ARX/ARXVM)" >&2
+        exit 1
+    fi
+done
+if [ -n "$BASELINE" ] && [ ! -f "$BASELINE" ]; then
+    echo "Error: baseline '$BASELINE' not found" >&2
+    exit 1
+fi
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# Peak RSS of a command from GNU time, when it is installed
+GNU_TIME=
+if [ -x /usr/bin/time ] && /usr/bin/time -f %M true > /dev/null 2>&1; then
+    GNU_TIME=/usr/bin/time
+fi
+
+now_ns()
+{
+    date +%s%N
+}
+
+median()
+{
+    sort -n | awk '{ v[NR] = $1 } END { if (NR == 0) print 0; else if (NR % 2) print v[(NR + 1) / 2]; else print (v[NR / 2] + v[NR / 2 + 1]) / 2 }'
+}
+
+# Value after "<label>: " in the VM's -stats block
+stat_field()
+{
+    sed -n "s/^$1: \([0-9.]*\).*/\1/p" "$2" | tail -1
+}
+
+# App.Main plus COMPILE_CLASSES classes of ten methods each, with locals,
+# loops, branches, string building and calls between classes
+generate_compile_module()
+{
+    echo "module CompileBench;"
+    echo ""
+    echo "class App"
+    echo "  procedure Main"
+    echo "  begin"
+    echo "    C0 c;"
+    echo "    integer r;"
+    echo "    c = new C0;"
+    echo "    r = c.f0();"
+    echo "    writeln('r = ' + r);"
+    echo "  end;"
+    echo "end;"
+    for ((c = 0; c < COMPILE_CLASSES; c++)); do
+        echo ""
+        echo "class C$c"
+        echo "  integer total;"
+        for ((m = 0; m < 10; m++)); do
+            echo "  function f$m: integer"
+            echo "  begin"
+            echo "    integer a;"
+            echo "    integer b;"
+            echo "    string s;"
+            echo "    a = 0;"
+            echo "    b = $m;"
+            echo "    s = '';"
+            echo "    while a < $((m + 3)) do"
+            echo "    begin"
+            echo "      if a % 2 == 0 then"
+            echo "      begin"
+            echo "        b = b + a * $c;"
+            echo "      end;"
+            echo "      s = s + 'a' + a;"
+            echo "      a = a + 1;"
+            echo "    end;"
+            echo "    total = total + b;"
+            echo "    return b;"
+            echo "  end;"
+        done
+        echo "end;"
+    done
+}
+
+RESULTS="$WORK/results.json"
+{
+    echo "{"
+    echo "  \"vm_flags\": \"$VM_FLAGS\","
+    echo "  \"runs\": $RUNS,"
+    echo "  \"benchmarks\": ["
+} > "$RESULTS"
+first=1
+
+emit()
+{
+    if [ $first -eq 0 ]; then
+        echo "," >> "$RESULTS"
+    fi
+    first=0
+    printf "    %s" "$1" >> "$RESULTS"
+}
+
+for source_file in "$BENCH_DIR"/cases/*.arx; do
+    name=$(basename "$source_file" .arx)
+    module="$WORK/$name.arxmod"
+    if ! "$ARX" -o "$module" "$source_file" > "$WORK/compile.log" 2>&1; then
+        echo "Error: failed to compile $source_file" >&2
+        tail -5 "$WORK/compile.log" >&2
+        exit 1
+    fi
+
+    : > "$WORK/wall"
+    : > "$WORK/exec"
+    peak_rss=0
+    for ((run = 0; run < RUNS; run++)); do
+        start=$(now_ns)
+        # shellcheck disable=SC2086
+        if ! "$ARXVM" $VM_FLAGS -stats "$module" > "$WORK/run.log" 2>&1; then
+            echo "Error: $name failed" >&2
+            tail -5 "$WORK/run.log" >&2
+            exit 1
+        fi
+        end=$(now_ns)
+        echo $(( (end - start) / 1000 )) >> "$WORK/wall"
+        stat_field "Time" "$WORK/run.log" >> "$WORK/exec"
+        rss=$(stat_field "Peak RSS" "$WORK/run.log")
+        if [ "${rss:-0}" -gt "$peak_rss" ]; then
+            peak_rss=$rss
+        fi
+    done
+
+    wall_ms=$(median < "$WORK/wall" | awk '{ printf "%.3f", $1 / 1000 }')
+    exec_ms=$(median < "$WORK/exec" | awk '{ printf "%.3f", $1 }')
+    instructions=$(stat_field "Instructions" "$WORK/run.log")
+    allocations=$(sed -n 's/^Allocations: \([0-9]*\) blocks, \([0-9]*\) bytes/\1/p' "$WORK/run.log")
+    allocated_bytes=$(sed -n 's/^Allocations: \([0-9]*\) blocks, \([0-9]*\) bytes/\2/p' "$WORK/run.log")
+    rate=$(awk "BEGIN { printf \"%.0f\", ($exec_ms > 0 ? $instructions / ($exec_ms / 1000) : 0) }")
+
+    emit "{ \"name\": \"$name\", \"kind\": \"vm\", \"wall_ms\": $wall_ms, \"exec_ms\": $exec_ms, \"instructions\": $instructions, \"instructions_per_sec\": $rate, \"allocations\": $allocations, \"allocated_bytes\": $allocated_bytes, \"peak_rss_kb\": $peak_rss }"
+    echo "$name: ${wall_ms} ms wall, ${exec_ms} ms exec, $rate instructions/s" >&2
+done
+
+# Compile time of a large module
+source_file="$WORK/compile_large.arx"
+generate_compile_module > "$source_file"
+lines=$(wc -l < "$source_file")
+: > "$WORK/wall"
+peak_rss=null
+for ((run = 0; run < RUNS; run++)); do
+    start=$(now_ns)
+    if [ -n "$GNU_TIME" ]; then
+        "$GNU_TIME" -f %M -o "$WORK/rss" "$ARX" -o "$WORK/compile_large.arxmod" "$source_file" > /dev/null
+        rss=$(tail -1 "$WORK/rss")
+        if [ "$peak_rss" = null ] || [ "$rss" -gt "$peak_rss" ]; then
+            peak_rss=$rss
+        fi
+    else
+        "$ARX" -o "$WORK/compile_large.arxmod" "$source_file" > /dev/null
+    fi
+    end=$(now_ns)
+    echo $(( (end - start) / 1000 )) >> "$WORK/wall"
+done
+wall_ms=$(median < "$WORK/wall" | awk '{ printf "%.3f", $1 / 1000 }')
+lines_per_sec=$(awk "BEGIN { printf \"%.0f\", ($wall_ms > 0 ? $lines / ($wall_ms / 1000) : 0) }")
+emit "{ \"name\": \"compile_large\", \"kind\": \"compile\", \"wall_ms\": $wall_ms, \"lines\": $lines, \"lines_per_sec\": $lines_per_sec, \"peak_rss_kb\": $peak_rss }"
+echo "compile_large: ${wall_ms} ms wall, $lines lines, $lines_per_sec lines/s" >&2
+
+{
+    echo ""
+    echo "  ]"
+    echo "}"
+} >> "$RESULTS"
+
+if [ -n "$OUTPUT" ]; then
+    cp "$RESULTS" "$OUTPUT"
+else
+    cat "$RESULTS"
+fi
+
+# Benchmarks are one object per line, so the comparison reads both files
+# with awk: wall time beyond the threshold is a regression, and a change in
+# instructions executed is reported since it means the code itself changed
+if [ -n "$BASELINE" ]; then
+    echo "" >&2
+    echo "=== Comparison with $BASELINE (threshold ${THRESHOLD}%) ===" >&2
+    awk -v threshold="$THRESHOLD" '
+        function field(line, key,    pattern, value) {
+            pattern = "\"" key "\": [^,}]*"
+            if (!match(line, pattern)) return ""
+            value = substr(line, RSTART + length(key) + 4, RLENGTH - length(key) - 4)
+            gsub(/[" ]/, "", value)
+            return value
+        }
+        /"name":/ {
+            name = field($0, "name")
+            if (FNR == NR) {
+                base_wall[name] = field($0, "wall_ms")
+                base_instructions[name] = field($0, "instructions")
+                next
+            }
+            wall = field($0, "wall_ms")
+            if (!(name in base_wall)) {
+                printf "%-16s %10.3f ms  (new)\n", name, wall
+                next
+            }
+            change = base_wall[name] > 0 ? (wall - base_wall[name]) * 100 / base_wall[name] : 0
+            status = change > threshold ? "REGRESSION" : (change < -threshold ? "faster" : "ok")
+            if (status == "REGRESSION") regressions++
+            printf "%-16s %10.3f ms  baseline %10.3f ms  %+7.1f%%  %s", name, wall, base_wall[name], change, status
+            instructions = field($0, "instructions")
+            if (instructions != "" && instructions != base_instructions[name]) {
+                printf "  (instructions %s -> %s)", base_instructions[name], instructions
+            }
+            printf "\n"
+        }
+        END {
+            if (regressions > 0) {
+                printf "%d regression(s)\n", regressions
+                exit 1
+            }
+        }
+    ' "$BASELINE" "$RESULTS" >&2
+fi
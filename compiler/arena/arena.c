@@ -0,0 +1,264 @@
+/*
+ * ARX Compilation Arena Implementation
+ * Chained blocks with bump allocation and a string intern table
+ */
+
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_INTERN_MIN_CAPACITY 256
+
+static arena_t *current_arena = NULL;
+
+static size_t arena_align(size_t size)
+{
+    return (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+void arena_init(arena_t *arena, size_t block_size)
+{
+    if (arena == NULL) {
+        return;
+    }
+    memset(arena, 0, sizeof(arena_t));
+    arena->block_size = block_size > 0 ? arena_align(block_size) : ARENA_DEFAULT_BLOCK_SIZE;
+}
+
+void arena_cleanup(arena_t *arena)
+{
+    if (arena == NULL) {
+        return;
+    }
+
+    arena_block_t *block = arena->head;
+    while (block != NULL) {
+        arena_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena->intern_slots);
+
+    if (current_arena == arena) {
+        current_arena = NULL;
+    }
+    memset(arena, 0, sizeof(arena_t));
+}
+
+static arena_block_t *arena_new_block(arena_t *arena, size_t size)
+{
+    arena_block_t *block = malloc(sizeof(arena_block_t) + size);
+    if (block == NULL) {
+        return NULL;
+    }
+    block->size = size;
+    block->used = 0;
+    arena->stats.blocks++;
+    arena->stats.bytes_reserved += size;
+    return block;
+}
+
+void *arena_alloc(arena_t *arena, size_t size)
+{
+    if (arena == NULL) {
+        return NULL;
+    }
+
+    size_t aligned = arena_align(size > 0 ? size : 1);
+    arena->stats.allocations++;
+    arena->stats.bytes_requested += size;
+
+    // Oversized requests get a block of their own behind the head, so the
+    // head keeps serving small allocations
+    if (aligned > arena->block_size / 4) {
+        arena_block_t *block = arena_new_block(arena, aligned);
+        if (block == NULL) {
+            return NULL;
+        }
+        arena->stats.large_blocks++;
+        block->used = aligned;
+        if (arena->head != NULL) {
+            block->next = arena->head->next;
+            arena->head->next = block;
+        } else {
+            block->next = NULL;
+            arena->head = block;
+        }
+        arena->last = block->data;
+        arena->last_size = aligned;
+        return block->data;
+    }
+
+    if (arena->head == NULL || arena->head->size - arena->head->used < aligned) {
+        arena_block_t *block = arena_new_block(arena, arena->block_size);
+        if (block == NULL) {
+            return NULL;
+        }
+        block->next = arena->head;
+        arena->head = block;
+    }
+
+    void *ptr = arena->head->data + arena->head->used;
+    arena->head->used += aligned;
+    arena->last = ptr;
+    arena->last_size = aligned;
+    return ptr;
+}
+
+void *arena_calloc(arena_t *arena, size_t count, size_t size)
+{
+    if (size != 0 && count > SIZE_MAX / size) {
+        return NULL;
+    }
+    void *ptr = arena_alloc(arena, count * size);
+    if (ptr != NULL) {
+        memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+void *arena_grow(arena_t *arena, void *ptr, size_t old_size, size_t new_size)
+{
+    if (arena == NULL) {
+        return NULL;
+    }
+    if (ptr == NULL) {
+        return arena_alloc(arena, new_size);
+    }
+    if (new_size <= old_size) {
+        return ptr;
+    }
+
+    // The newest allocation at the end of the head block can simply extend
+    size_t aligned = arena_align(new_size);
+    arena_block_t *head = arena->head;
+    if (ptr == arena->last && head != NULL &&
+        (unsigned char *)ptr + arena->last_size == head->data + head->used &&
+        head->size - (head->used - arena->last_size) >= aligned) {
+        head->used += aligned - arena->last_size;
+        arena->stats.bytes_requested += new_size - old_size;
+        arena->last_size = aligned;
+        arena->stats.grows_in_place++;
+        return ptr;
+    }
+
+    void *moved = arena_alloc(arena, new_size);
+    if (moved == NULL) {
+        return NULL;
+    }
+    memcpy(moved, ptr, old_size);
+    arena->stats.grows_copied++;
+    return moved;
+}
+
+char *arena_strndup(arena_t *arena, const char *text, size_t len)
+{
+    char *copy = arena_alloc(arena, len + 1);
+    if (copy != NULL) {
+        memcpy(copy, text, len);
+        copy[len] = '\0';
+    }
+    return copy;
+}
+
+// FNV-1a
+static uint32_t arena_hash(const char *text, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static bool arena_intern_resize(arena_t *arena, size_t capacity)
+{
+    arena_intern_slot_t *slots = calloc(capacity, sizeof(arena_intern_slot_t));
+    if (slots == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < arena->intern_capacity; i++) {
+        arena_intern_slot_t *slot = &arena->intern_slots[i];
+        if (slot->text == NULL) {
+            continue;
+        }
+        size_t j = slot->hash & (capacity - 1);
+        while (slots[j].text != NULL) {
+            j = (j + 1) & (capacity - 1);
+        }
+        slots[j] = *slot;
+    }
+    free(arena->intern_slots);
+    arena->intern_slots = slots;
+    arena->intern_capacity = capacity;
+    return true;
+}
+
+const char *arena_intern(arena_t *arena, const char *text, size_t len)
+{
+    if (arena == NULL || text == NULL) {
+        return NULL;
+    }
+
+    // Keep the table at most half full
+    if (arena->stats.interned * 2 >= arena->intern_capacity) {
+        size_t capacity = arena->intern_capacity == 0 ? ARENA_INTERN_MIN_CAPACITY : arena->intern_capacity * 2;
+        if (!arena_intern_resize(arena, capacity)) {
+            return NULL;
+        }
+    }
+
+    uint32_t hash = arena_hash(text, len);
+    size_t i = hash & (arena->intern_capacity - 1);
+    while (arena->intern_slots[i].text != NULL) {
+        arena_intern_slot_t *slot = &arena->intern_slots[i];
+        if (slot->hash == hash && slot->len == len && memcmp(slot->text, text, len) == 0) {
+            arena->stats.intern_hits++;
+            return slot->text;
+        }
+        i = (i + 1) & (arena->intern_capacity - 1);
+    }
+
+    char *copy = arena_strndup(arena, text, len);
+    if (copy == NULL) {
+        return NULL;
+    }
+    arena->intern_slots[i].text = copy;
+    arena->intern_slots[i].len = len;
+    arena->intern_slots[i].hash = hash;
+    arena->stats.interned++;
+    return copy;
+}
+
+void arena_print_stats(const arena_t *arena)
+{
+    if (arena == NULL) {
+        return;
+    }
+
+    const arena_stats_t *stats = &arena->stats;
+    printf("=== Arena Statistics ===\n");
+    printf("Allocations:     %zu\n", stats->allocations);
+    printf("Bytes requested: %zu\n", stats->bytes_requested);
+    printf("Bytes reserved:  %zu (%zu blocks of %zu, %zu large)\n",
+           stats->bytes_reserved, stats->blocks, arena->block_size, stats->large_blocks);
+    if (stats->bytes_reserved > 0) {
+        printf("Utilization:     %.1f%%\n", 100.0 * (double)stats->bytes_requested / (double)stats->bytes_reserved);
+    }
+    printf("Grows:           %zu in place, %zu copied\n", stats->grows_in_place, stats->grows_copied);
+    printf("Interned:        %zu strings, %zu hits\n", stats->interned, stats->intern_hits);
+}
+
+arena_t *arena_current(void)
+{
+    return current_arena;
+}
+
+arena_t *arena_set_current(arena_t *arena)
+{
+    arena_t *previous = current_arena;
+    current_arena = arena;
+    return previous;
+}
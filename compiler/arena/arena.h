@@ -0,0 +1,69 @@
+/*
+ * ARX Compilation Arena
+ * Bump allocator for data that lives exactly as long as one compilation
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define ARENA_DEFAULT_BLOCK_SIZE (64 * 1024)
+#define ARENA_ALIGNMENT 8     // Widest field stored: pointers, int64_t, double
+
+// Blocks are chained newest first; allocations bump `used` in the head
+typedef struct arena_block {
+    struct arena_block *next;       // Older block
+    size_t size;                    // Bytes in data
+    size_t used;                    // Bytes handed out
+    unsigned char data[];
+} arena_block_t;
+
+// Interned string; text points into the arena
+typedef struct {
+    const char *text;
+    size_t len;
+    uint32_t hash;
+} arena_intern_slot_t;
+
+typedef struct {
+    size_t allocations;             // arena_alloc calls
+    size_t bytes_requested;         // Sum of requested sizes
+    size_t bytes_reserved;          // Sum of block sizes
+    size_t blocks;                  // Blocks allocated
+    size_t large_blocks;            // Of which hold one oversized allocation
+    size_t grows_in_place;          // arena_grow calls that extended the last allocation
+    size_t grows_copied;            // arena_grow calls that had to move
+    size_t interned;                // Distinct interned strings
+    size_t intern_hits;             // Intern calls answered from the table
+} arena_stats_t;
+
+typedef struct {
+    arena_block_t *head;            // Block being bumped
+    size_t block_size;              // Size of regular blocks
+    void *last;                     // Most recent allocation, for in-place growth
+    size_t last_size;
+    arena_intern_slot_t *intern_slots; // Open-addressed, power-of-two capacity
+    size_t intern_capacity;
+    arena_stats_t stats;
+} arena_t;
+
+void arena_init(arena_t *arena, size_t block_size);
+// Releases every block at once; nothing allocated from the arena survives
+void arena_cleanup(arena_t *arena);
+
+void *arena_alloc(arena_t *arena, size_t size);
+void *arena_calloc(arena_t *arena, size_t count, size_t size);
+// Resize ptr (old_size bytes) to new_size; the last allocation grows in place
+void *arena_grow(arena_t *arena, void *ptr, size_t old_size, size_t new_size);
+char *arena_strndup(arena_t *arena, const char *text, size_t len);
+
+// One shared, NUL-terminated, read-only copy per distinct text
+const char *arena_intern(arena_t *arena, const char *text, size_t len);
+
+void arena_print_stats(const arena_t *arena);
+
+// The arena owned by the compilation in progress. AST nodes, types and
+// symbols allocate from it and are never freed one by one.
+arena_t *arena_current(void);
+arena_t *arena_set_current(arena_t *arena);
@@ -21,16 +21,23 @@ typedef struct {
     size_t section_count;           // Number of sections
     arxmod_toc_entry_t *toc_entries; // TOC entries
     size_t toc_capacity;            // TOC capacity
+    size_t toc_reserved;            // TOC entries reserved after the header
     uint32_t module_flags;          // Module flags (library/executable)
     uint64_t entry_point;           // Entry point offset (pre-calculated by linker)
     bool debug_output;              // Debug output flag
 } arxmod_writer_t;
 
 // ARX Module Reader
+// A mapped reader (arxmod_reader_init_mapped) has no FILE: the TOC, the
+// strings and version 1 code it returns point into the read-only mapping and
+// stay valid until arxmod_reader_cleanup, so callers must not free them.
+// Version 2 code is always decoded into a malloced array.
 typedef struct {
-    FILE *file;                     // Input file
+    FILE *file;                     // Input file (NULL when mapped)
+    const uint8_t *map;             // Whole module mapped read-only (NULL when using file)
+    size_t map_size;                // Mapping length in bytes
     arxmod_header_t header;         // Module header
-    arxmod_toc_entry_t *toc;        // Table of Contents
+    arxmod_toc_entry_t *toc;        // Table of Contents (into the mapping when mapped)
     size_t toc_count;               // Number of TOC entries
     bool debug_output;              // Debug output flag
 } arxmod_reader_t;
@@ -99,11 +106,23 @@ typedef struct {
     // Each class is self-contained to avoid name conflicts
 } class_entry_t;
 
+// External reference (EXTERNS section): a class or method this module uses
+// that an imported module defines. The VM loads the defining module and
+// binds the reference the first time it is used.
+typedef struct {
+    char        module_name[64];   // Defining module (<module_name>.arxmod)
+    char        name[32];          // Class or method name
+    uint64_t    external_class_id; // Class ID in the defining module (ARXMOD_EXTERN_CLASS)
+    uint32_t    reference_type;    // ARXMOD_EXTERN_CLASS or ARXMOD_EXTERN_METHOD
+    uint32_t    flags;             // Reserved
+} external_ref_t;
+
 // Function prototypes for writer
 bool arxmod_writer_init(arxmod_writer_t *writer, const char *filename);
 bool arxmod_writer_set_flags(arxmod_writer_t *writer, uint32_t flags);
 bool arxmod_writer_set_entry_point(arxmod_writer_t *writer, uint64_t entry_point);
 bool arxmod_writer_update_header(arxmod_writer_t *writer);
+bool arxmod_writer_reserve_sections(arxmod_writer_t *writer, size_t section_count);
 bool arxmod_writer_write_header(arxmod_writer_t *writer, const char *app_name, size_t app_name_len);
 bool arxmod_writer_add_code_section(arxmod_writer_t *writer, instruction_t *instructions, size_t instruction_count);
 bool arxmod_writer_add_strings_section(arxmod_writer_t *writer, const char **strings, size_t string_count);
@@ -111,11 +130,15 @@ bool arxmod_writer_add_symbols_section(arxmod_writer_t *writer, symbol_entry_t *
 bool arxmod_writer_add_debug_section(arxmod_writer_t *writer, debug_entry_t *debug_info, size_t debug_count);
 bool arxmod_writer_add_classes_section(arxmod_writer_t *writer, class_entry_t *classes, size_t class_count, method_entry_t *methods, size_t method_count, field_entry_t *fields, size_t field_count);
 bool arxmod_writer_add_app_section(arxmod_writer_t *writer, const char *app_name, size_t app_name_len, const uint8_t *app_data, size_t app_data_size);
+bool arxmod_writer_add_externs_section(arxmod_writer_t *writer, const external_ref_t *externs, size_t extern_count);
 bool arxmod_writer_finalize(arxmod_writer_t *writer);
 void arxmod_writer_cleanup(arxmod_writer_t *writer);
 
 // Function prototypes for reader
 bool arxmod_reader_init(arxmod_reader_t *reader, const char *filename);
+bool arxmod_reader_init_mapped(arxmod_reader_t *reader, const char *filename);
+bool arxmod_reader_is_mapped(const arxmod_reader_t *reader);
+bool arxmod_reader_code_is_mapped(const arxmod_reader_t *reader);
 bool arxmod_reader_validate(arxmod_reader_t *reader);
 bool arxmod_reader_load_toc(arxmod_reader_t *reader);
 arxmod_toc_entry_t* arxmod_reader_find_section(arxmod_reader_t *reader, const char *section_name);
@@ -125,6 +148,7 @@ bool arxmod_reader_load_symbols_section(arxmod_reader_t *reader, symbol_entry_t
 bool arxmod_reader_load_debug_section(arxmod_reader_t *reader, debug_entry_t **debug_info, size_t *debug_count);
 bool arxmod_reader_load_classes_section(arxmod_reader_t *reader, class_entry_t **classes, size_t *class_count, method_entry_t **methods, size_t *method_count, field_entry_t **fields, size_t *field_count);
 bool arxmod_reader_load_app_section(arxmod_reader_t *reader, char **app_name, uint8_t **app_data, size_t *app_data_size);
+bool arxmod_reader_load_externs_section(arxmod_reader_t *reader, external_ref_t **externs, size_t *extern_count);
 void arxmod_reader_cleanup(arxmod_reader_t *reader);
 
 // Utility functions
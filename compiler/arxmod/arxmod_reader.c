@@ -8,9 +8,59 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__unix__) || defined(__APPLE__)
+#define ARXMOD_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define ARXMOD_HAVE_MMAP 0
+#endif
+
 // Global debug flag (extern from main.c)
 extern bool debug_mode;
 
+static bool arxmod_reader_is_open(const arxmod_reader_t *reader)
+{
+    return reader->file != NULL || reader->map != NULL;
+}
+
+// Bytes [offset, offset + size) of the mapping, or NULL if they run past its end
+static const uint8_t *arxmod_reader_map_range(const arxmod_reader_t *reader, uint64_t offset, uint64_t size)
+{
+    if (offset > reader->map_size || size > reader->map_size - offset) {
+        return NULL;
+    }
+    return reader->map + offset;
+}
+
+static const uint8_t *arxmod_reader_section_bytes(const arxmod_reader_t *reader, const arxmod_toc_entry_t *section)
+{
+    if (section->offset > UINT64_MAX - reader->header.data_offset) {
+        return NULL;
+    }
+    return arxmod_reader_map_range(reader, reader->header.data_offset + section->offset, section->size);
+}
+
+// Copy size bytes at file offset into buffer, from the mapping or the file
+static bool arxmod_reader_read_at(arxmod_reader_t *reader, uint64_t offset, void *buffer, size_t size)
+{
+    if (reader->map != NULL) {
+        const uint8_t *bytes = arxmod_reader_map_range(reader, offset, size);
+        if (bytes == NULL) {
+            return false;
+        }
+        memcpy(buffer, bytes, size);
+        return true;
+    }
+    
+    if (fseek(reader->file, (long)offset, SEEK_SET) != 0) {
+        return false;
+    }
+    return fread(buffer, 1, size, reader->file) == size;
+}
+
 bool arxmod_reader_init(arxmod_reader_t *reader, const char *filename)
 {
     if (reader == NULL || filename == NULL) {
@@ -22,6 +72,8 @@ bool arxmod_reader_init(arxmod_reader_t *reader, const char *filename)
         return false;
     }
     
+    reader->map = NULL;
+    reader->map_size = 0;
     reader->toc = NULL;
     reader->toc_count = 0;
     reader->debug_output = debug_mode;
@@ -33,14 +85,68 @@ bool arxmod_reader_init(arxmod_reader_t *reader, const char *filename)
     return true;
 }
 
+bool arxmod_reader_init_mapped(arxmod_reader_t *reader, const char *filename)
+{
+    if (reader == NULL || filename == NULL) {
+        return false;
+    }
+    
+#if ARXMOD_HAVE_MMAP
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+    
+    // Read-only private pages: every process running this module shares
+    // them through the page cache
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    
+    reader->file = NULL;
+    reader->map = map;
+    reader->map_size = (size_t)st.st_size;
+    reader->toc = NULL;
+    reader->toc_count = 0;
+    reader->debug_output = debug_mode;
+    
+    if (reader->debug_output) {
+        printf("ARX module reader mapped '%s' (%zu bytes)\n", filename, reader->map_size);
+    }
+    
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool arxmod_reader_is_mapped(const arxmod_reader_t *reader)
+{
+    return reader != NULL && reader->map != NULL;
+}
+
+// Whether arxmod_reader_load_code_section hands out the mapping in place
+bool arxmod_reader_code_is_mapped(const arxmod_reader_t *reader)
+{
+    return arxmod_reader_is_mapped(reader) && reader->header.version == ARXMOD_VERSION_FIXED;
+}
+
 bool arxmod_reader_validate(arxmod_reader_t *reader)
 {
-    if (reader == NULL || reader->file == NULL) {
+    if (reader == NULL || !arxmod_reader_is_open(reader)) {
         return false;
     }
     
     // Read header
-    if (fread(&reader->header, sizeof(arxmod_header_t), 1, reader->file) != 1) {
+    if (!arxmod_reader_read_at(reader, 0, &reader->header, sizeof(arxmod_header_t))) {
         return false;
     }
     
@@ -58,10 +164,10 @@ bool arxmod_reader_validate(arxmod_reader_t *reader)
     }
     
     // Validate version
-    if (reader->header.version != ARXMOD_VERSION) {
+    if (reader->header.version < ARXMOD_VERSION_FIXED || reader->header.version > ARXMOD_VERSION) {
         if (reader->debug_output) {
-            printf("Error: Unsupported version %u (expected %d)\n", 
-                   reader->header.version, ARXMOD_VERSION);
+            printf("Error: Unsupported version %u (expected %d to %d)\n", 
+                   reader->header.version, ARXMOD_VERSION_FIXED, ARXMOD_VERSION);
         }
         return false;
     }
@@ -89,18 +195,46 @@ bool arxmod_reader_validate(arxmod_reader_t *reader)
 
 bool arxmod_reader_load_toc(arxmod_reader_t *reader)
 {
-    if (reader == NULL || reader->file == NULL) {
+    if (reader == NULL || !arxmod_reader_is_open(reader)) {
         return false;
     }
     
+    // Calculate number of TOC entries
+    reader->toc_count = reader->header.toc_size / sizeof(arxmod_toc_entry_t);
+    
+    // Mapped: use the TOC in place (the entries are packed) and check every
+    // section lies inside the file, so later loads can trust the offsets
+    if (reader->map != NULL) {
+        const uint8_t *toc = arxmod_reader_map_range(reader, reader->header.toc_offset,
+                                                     reader->toc_count * sizeof(arxmod_toc_entry_t));
+        if (toc == NULL) {
+            reader->toc_count = 0;
+            return false;
+        }
+        reader->toc = (arxmod_toc_entry_t *)toc;
+        
+        for (size_t i = 0; i < reader->toc_count; i++) {
+            if (arxmod_reader_section_bytes(reader, &reader->toc[i]) == NULL) {
+                if (reader->debug_output) {
+                    printf("Error: Section %zu (%.16s) lies outside the module\n", i, reader->toc[i].section_name);
+                }
+                reader->toc = NULL;
+                reader->toc_count = 0;
+                return false;
+            }
+        }
+        
+        if (reader->debug_output) {
+            printf("TOC mapped: %zu sections\n", reader->toc_count);
+        }
+        return true;
+    }
+    
     // Seek to TOC
     if (fseek(reader->file, reader->header.toc_offset, SEEK_SET) != 0) {
         return false;
     }
     
-    // Calculate number of TOC entries
-    reader->toc_count = reader->header.toc_size / sizeof(arxmod_toc_entry_t);
-    
     // Allocate TOC
     reader->toc = malloc(reader->toc_count * sizeof(arxmod_toc_entry_t));
     if (reader->toc == NULL) {
@@ -134,7 +268,7 @@ arxmod_toc_entry_t* arxmod_reader_find_section(arxmod_reader_t *reader, const ch
     }
     
     for (size_t i = 0; i < reader->toc_count; i++) {
-        if (strcmp(reader->toc[i].section_name, section_name) == 0) {
+        if (strncmp(reader->toc[i].section_name, section_name, sizeof(reader->toc[i].section_name)) == 0) {
             return &reader->toc[i];
         }
     }
@@ -142,9 +276,115 @@ arxmod_toc_entry_t* arxmod_reader_find_section(arxmod_reader_t *reader, const ch
     return NULL;
 }
 
+// Unsigned LEB128 at data[*position]; fails on truncated or over-long input
+static bool arxmod_get_varint(const uint8_t *data, size_t size, size_t *position, uint64_t *value)
+{
+    uint64_t result = 0;
+    for (unsigned shift = 0; shift < 64 && *position < size; shift += 7) {
+        uint8_t byte = data[(*position)++];
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Expand a version 2 code section (see arxmod_writer_add_code_section)
+// into instruction_t, resolving pool tokens against the CONSTS section
+static bool arxmod_reader_decode_compact_code(arxmod_reader_t *reader, arxmod_toc_entry_t *section, instruction_t **instructions, size_t *instruction_count)
+{
+    *instructions = NULL;
+    *instruction_count = 0;
+    
+    uint64_t section_start = reader->header.data_offset + section->offset;
+    uint8_t *buffer = NULL;
+    const uint8_t *code = reader->map != NULL ? arxmod_reader_section_bytes(reader, section) : NULL;
+    if (code == NULL) {
+        buffer = malloc(section->size > 0 ? section->size : 1);
+        if (buffer == NULL || !arxmod_reader_read_at(reader, section_start, buffer, section->size)) {
+            free(buffer);
+            return false;
+        }
+        code = buffer;
+    }
+    
+    uint64_t *pool = NULL;
+    size_t pool_count = 0;
+    arxmod_toc_entry_t *consts = arxmod_reader_find_section(reader, ARXMOD_SECTION_CONSTS);
+    if (consts != NULL && consts->size >= sizeof(uint64_t)) {
+        pool_count = consts->size / sizeof(uint64_t);
+        pool = malloc(pool_count * sizeof(uint64_t));
+        if (pool == NULL || !arxmod_reader_read_at(reader, reader->header.data_offset + consts->offset,
+                                                   pool, pool_count * sizeof(uint64_t))) {
+            free(pool);
+            free(buffer);
+            return false;
+        }
+    }
+    
+    // Every instruction takes at least two bytes, which bounds the count
+    uint64_t count = 0;
+    bool ok = section->size >= sizeof(uint64_t);
+    if (ok) {
+        memcpy(&count, code, sizeof(uint64_t));
+        ok = count <= (section->size - sizeof(uint64_t)) / 2;
+    }
+    
+    instruction_t *decoded = NULL;
+    if (ok && count > 0) {
+        decoded = malloc(count * sizeof(instruction_t));
+        ok = decoded != NULL;
+    }
+    
+    size_t position = sizeof(uint64_t);
+    for (uint64_t i = 0; ok && i < count; i++) {
+        uint64_t token = 0;
+        ok = position < section->size;
+        if (!ok) {
+            break;
+        }
+        decoded[i].opcode = code[position++];
+        ok = arxmod_get_varint(code, section->size, &position, &token);
+        if (!ok) {
+            break;
+        }
+        if ((token & 1) == 0) {
+            decoded[i].opt64 = token >> 1;
+        } else if ((token >> 1) < pool_count) {
+            decoded[i].opt64 = pool[token >> 1];
+        } else {
+            ok = false;
+        }
+    }
+    ok = ok && position == section->size;
+    
+    free(pool);
+    free(buffer);
+    
+    if (!ok) {
+        if (reader->debug_output) {
+            printf("Error: Malformed compact code section (%llu bytes)\n", (unsigned long long)section->size);
+        }
+        free(decoded);
+        return false;
+    }
+    
+    *instructions = decoded;
+    *instruction_count = count;
+    
+    if (reader->debug_output) {
+        printf("Code section decoded: %zu instructions from %llu bytes, %zu pooled operands\n",
+               *instruction_count, (unsigned long long)section->size, pool_count);
+    }
+    
+    return true;
+}
+
 bool arxmod_reader_load_code_section(arxmod_reader_t *reader, instruction_t **instructions, size_t *instruction_count)
 {
-    if (reader == NULL || reader->file == NULL || instructions == NULL || instruction_count == NULL) {
+    if (reader == NULL || !arxmod_reader_is_open(reader) || instructions == NULL || instruction_count == NULL) {
         return false;
     }
     
@@ -165,8 +405,28 @@ bool arxmod_reader_load_code_section(arxmod_reader_t *reader, instruction_t **in
         }
     }
     
+    if (reader->header.version >= ARXMOD_VERSION_COMPACT) {
+        return arxmod_reader_decode_compact_code(reader, section, instructions, instruction_count);
+    }
+    
     // Calculate number of instructions
     *instruction_count = section->size / sizeof(instruction_t);
+    size_t seek_offset = reader->header.data_offset + section->offset;
+    
+    // Mapped: instruction_t is packed, so the code is used where it lies
+    if (reader->map != NULL) {
+        const uint8_t *code = arxmod_reader_section_bytes(reader, section);
+        if (code == NULL) {
+            *instruction_count = 0;
+            return false;
+        }
+        *instructions = (instruction_t *)code;
+        
+        if (reader->debug_output) {
+            printf("Code section mapped: %zu instructions at offset %zu\n", *instruction_count, seek_offset);
+        }
+        return true;
+    }
     
     // Allocate instructions
     *instructions = malloc(section->size);
@@ -175,7 +435,6 @@ bool arxmod_reader_load_code_section(arxmod_reader_t *reader, instruction_t **in
     }
     
     // Seek to section data
-    size_t seek_offset = reader->header.data_offset + section->offset;
     if (reader->debug_output) {
         printf("Seeking to offset: %zu (data_offset=%llu + section_offset=%llu)\n", 
                seek_offset, (unsigned long long)reader->header.data_offset, (unsigned long long)section->offset);
@@ -213,7 +472,7 @@ bool arxmod_reader_load_code_section(arxmod_reader_t *reader, instruction_t **in
 
 bool arxmod_reader_load_strings_section(arxmod_reader_t *reader, char ***strings, size_t *string_count)
 {
-    if (reader == NULL || reader->file == NULL || strings == NULL || string_count == NULL) {
+    if (reader == NULL || !arxmod_reader_is_open(reader) || strings == NULL || string_count == NULL) {
         return false;
     }
     
@@ -230,25 +489,36 @@ bool arxmod_reader_load_strings_section(arxmod_reader_t *reader, char ***strings
         return true;
     }
     
-    // Seek to the strings section
-    size_t seek_offset = reader->header.data_offset + section->offset;
-    if (reader->debug_output) {
-        printf("Seeking to strings section at offset: %zu (data_offset=%llu + section_offset=%llu)\n", 
-               seek_offset, (unsigned long long)reader->header.data_offset, (unsigned long long)section->offset);
-    }
-    if (fseek(reader->file, seek_offset, SEEK_SET) != 0) {
-        return false;
-    }
-    
-    // Read the string data
-    char *string_data = malloc(section->size);
-    if (string_data == NULL) {
-        return false;
-    }
-    
-    if (fread(string_data, 1, section->size, reader->file) != section->size) {
-        free(string_data);
-        return false;
+    // Mapped: the strings are used in place and only the pointer array is
+    // allocated; otherwise the section is read and each string copied
+    const char *string_data = (const char *)(reader->map != NULL ? arxmod_reader_section_bytes(reader, section) : NULL);
+    char *buffer = NULL;
+    if (reader->map != NULL) {
+        if (string_data == NULL) {
+            return false;
+        }
+    } else {
+        // Seek to the strings section
+        size_t seek_offset = reader->header.data_offset + section->offset;
+        if (reader->debug_output) {
+            printf("Seeking to strings section at offset: %zu (data_offset=%llu + section_offset=%llu)\n", 
+                   seek_offset, (unsigned long long)reader->header.data_offset, (unsigned long long)section->offset);
+        }
+        if (fseek(reader->file, seek_offset, SEEK_SET) != 0) {
+            return false;
+        }
+        
+        // Read the string data
+        buffer = malloc(section->size);
+        if (buffer == NULL) {
+            return false;
+        }
+        
+        if (fread(buffer, 1, section->size, reader->file) != section->size) {
+            free(buffer);
+            return false;
+        }
+        string_data = buffer;
     }
     
     // Count the number of strings (null-terminated strings)
@@ -260,7 +530,7 @@ bool arxmod_reader_load_strings_section(arxmod_reader_t *reader, char ***strings
     }
     
     if (count == 0) {
-        free(string_data);
+        free(buffer);
         *strings = NULL;
         *string_count = 0;
         return true;
@@ -269,7 +539,7 @@ bool arxmod_reader_load_strings_section(arxmod_reader_t *reader, char ***strings
     // Allocate array of string pointers
     char **string_array = malloc(sizeof(char*) * count);
     if (string_array == NULL) {
-        free(string_data);
+        free(buffer);
         return false;
     }
     
@@ -277,7 +547,10 @@ bool arxmod_reader_load_strings_section(arxmod_reader_t *reader, char ***strings
     size_t string_index = 0;
     size_t start = 0;
     for (size_t i = 0; i < section->size && string_index < count; i++) {
-        if (string_data[i] == '\0') {
+        if (string_data[i] == '\0' && reader->map != NULL) {
+            string_array[string_index++] = (char *)&string_data[start];
+            start = i + 1;
+        } else if (string_data[i] == '\0') {
             size_t len = i - start;
             string_array[string_index] = malloc(len + 1);
             if (string_array[string_index] != NULL) {
@@ -289,7 +562,7 @@ bool arxmod_reader_load_strings_section(arxmod_reader_t *reader, char ***strings
         }
     }
     
-    free(string_data);
+    free(buffer);
     
     *strings = string_array;
     *string_count = count;
@@ -304,7 +577,7 @@ bool arxmod_reader_load_strings_section(arxmod_reader_t *reader, char ***strings
 
 bool arxmod_reader_load_symbols_section(arxmod_reader_t *reader, symbol_entry_t **symbols, size_t *symbol_count)
 {
-    if (reader == NULL || reader->file == NULL || symbols == NULL || symbol_count == NULL) {
+    if (reader == NULL || !arxmod_reader_is_open(reader) || symbols == NULL || symbol_count == NULL) {
         return false;
     }
     
@@ -324,15 +597,9 @@ bool arxmod_reader_load_symbols_section(arxmod_reader_t *reader, symbol_entry_t
         return false;
     }
     
-    // Seek to section data
-    if (fseek(reader->file, reader->header.data_offset + section->offset, SEEK_SET) != 0) {
-        free(*symbols);
-        *symbols = NULL;
-        return false;
-    }
-    
     // Read symbols
-    if (fread(*symbols, sizeof(symbol_entry_t), *symbol_count, reader->file) != *symbol_count) {
+    if (!arxmod_reader_read_at(reader, reader->header.data_offset + section->offset,
+                               *symbols, *symbol_count * sizeof(symbol_entry_t))) {
         free(*symbols);
         *symbols = NULL;
         return false;
@@ -347,7 +614,7 @@ bool arxmod_reader_load_symbols_section(arxmod_reader_t *reader, symbol_entry_t
 
 bool arxmod_reader_load_debug_section(arxmod_reader_t *reader, debug_entry_t **debug_info, size_t *debug_count)
 {
-    if (reader == NULL || reader->file == NULL || debug_info == NULL || debug_count == NULL) {
+    if (reader == NULL || !arxmod_reader_is_open(reader) || debug_info == NULL || debug_count == NULL) {
         return false;
     }
     
@@ -367,15 +634,9 @@ bool arxmod_reader_load_debug_section(arxmod_reader_t *reader, debug_entry_t **d
         return false;
     }
     
-    // Seek to section data
-    if (fseek(reader->file, reader->header.data_offset + section->offset, SEEK_SET) != 0) {
-        free(*debug_info);
-        *debug_info = NULL;
-        return false;
-    }
-    
     // Read debug info
-    if (fread(*debug_info, sizeof(debug_entry_t), *debug_count, reader->file) != *debug_count) {
+    if (!arxmod_reader_read_at(reader, reader->header.data_offset + section->offset,
+                               *debug_info, *debug_count * sizeof(debug_entry_t))) {
         free(*debug_info);
         *debug_info = NULL;
         return false;
@@ -388,9 +649,22 @@ bool arxmod_reader_load_debug_section(arxmod_reader_t *reader, debug_entry_t **d
     return true;
 }
 
+static void arxmod_reader_free_classes(class_entry_t **classes, size_t *class_count, method_entry_t **methods, field_entry_t **fields)
+{
+    free(*classes);
+    free(*methods);
+    *classes = NULL;
+    *methods = NULL;
+    if (fields != NULL) {
+        free(*fields);
+        *fields = NULL;
+    }
+    *class_count = 0;
+}
+
 bool arxmod_reader_load_classes_section(arxmod_reader_t *reader, class_entry_t **classes, size_t *class_count, method_entry_t **methods, size_t *method_count, field_entry_t **fields, size_t *field_count)
 {
-    if (reader == NULL || reader->file == NULL || classes == NULL || class_count == NULL) {
+    if (reader == NULL || !arxmod_reader_is_open(reader) || classes == NULL || class_count == NULL) {
         return false;
     }
     
@@ -401,20 +675,26 @@ bool arxmod_reader_load_classes_section(arxmod_reader_t *reader, class_entry_t *
         return true; // No classes section is valid
     }
     
-    // Seek to section data
-    if (fseek(reader->file, reader->header.data_offset + section->offset, SEEK_SET) != 0) {
-        return false;
-    }
+    uint64_t section_start = reader->header.data_offset + section->offset;
     
     if (reader->debug_output) {
         printf("DEBUG: Loading classes section, size=%llu bytes\n", (unsigned long long)section->size);
     }
     
-    // For now, let's use the old approach but fix the class count issue
-    // TODO: Implement proper inline methods and fields storage
+    // Field tables are only read when the caller asks for them (fields and
+    // field_count non-NULL); instances are laid out from the class entries
+    bool want_fields = fields != NULL && field_count != NULL;
+    if (!want_fields) {
+        fields = NULL;
+    }
+    
+    // Each class entry is followed by its own methods and fields; the entries
+    // are not packed, so they are copied out even from a mapping (the VM keeps
+    // its own growable class tables)
     
     // First pass: read all class entries to determine counts
-    size_t remaining_size = section->size;
+    uint64_t position = section_start;
+    uint64_t remaining_size = section->size;
     *class_count = 0;
     size_t total_method_count = 0;
     size_t total_field_count = 0;
@@ -422,30 +702,29 @@ bool arxmod_reader_load_classes_section(arxmod_reader_t *reader, class_entry_t *
     // Count classes by reading them one by one
     while (remaining_size >= sizeof(class_entry_t)) {
         class_entry_t temp_class;
-        if (fread(&temp_class, sizeof(class_entry_t), 1, reader->file) != 1) {
+        if (!arxmod_reader_read_at(reader, position, &temp_class, sizeof(class_entry_t))) {
             break;
         }
         
+        // Methods and fields for this class must fit in the section
+        uint64_t skip_size = (uint64_t)temp_class.method_count * sizeof(method_entry_t) +
+                             (uint64_t)temp_class.field_count * sizeof(field_entry_t);
+        if (skip_size > remaining_size - sizeof(class_entry_t)) {
+            if (reader->debug_output) {
+                printf("DEBUG: Class '%.32s' runs past the end of the classes section\n", temp_class.class_name);
+            }
+            return false;
+        }
+        
         (*class_count)++;
         total_method_count += temp_class.method_count;
         total_field_count += temp_class.field_count;
         
-        remaining_size -= sizeof(class_entry_t);
-        
-        // Skip over inline methods and fields for this class
-        size_t methods_size = temp_class.method_count * sizeof(method_entry_t);
-        size_t fields_size = temp_class.field_count * sizeof(field_entry_t);
-        size_t skip_size = methods_size + fields_size;
-        
-        if (skip_size > 0) {
-            if (fseek(reader->file, skip_size, SEEK_CUR) != 0) {
-                break;
-            }
-            remaining_size -= skip_size;
-        }
+        position += sizeof(class_entry_t) + skip_size;
+        remaining_size -= sizeof(class_entry_t) + skip_size;
         
         if (reader->debug_output) {
-            printf("DEBUG: Read class %zu: name='%s', id=%llu, fields=%u, methods=%u\n", 
+            printf("DEBUG: Read class %zu: name='%.32s', id=%llu, fields=%u, methods=%u\n", 
                    *class_count, temp_class.class_name, (unsigned long long)temp_class.class_id, 
                    temp_class.field_count, temp_class.method_count);
         }
@@ -457,87 +736,61 @@ bool arxmod_reader_load_classes_section(arxmod_reader_t *reader, class_entry_t *
     }
     
     // Allocate memory for classes, methods, and fields
-    if (*class_count > 0) {
-        *classes = malloc(*class_count * sizeof(class_entry_t));
-        if (*classes == NULL) return false;
-    } else {
-        *classes = NULL;
+    *classes = *class_count > 0 ? malloc(*class_count * sizeof(class_entry_t)) : NULL;
+    *methods = total_method_count > 0 ? malloc(total_method_count * sizeof(method_entry_t)) : NULL;
+    if (want_fields) {
+        *fields = total_field_count > 0 ? malloc(total_field_count * sizeof(field_entry_t)) : NULL;
     }
-    
-    if (total_method_count > 0) {
-        *methods = malloc(total_method_count * sizeof(method_entry_t));
-        if (*methods == NULL) {
-            if (*classes) free(*classes);
-            return false;
-        }
-    } else {
-        *methods = NULL;
-    }
-    
-    if (total_field_count > 0) {
-        *fields = malloc(total_field_count * sizeof(field_entry_t));
-        if (*fields == NULL) {
-            if (*classes) free(*classes);
-            if (*methods) free(*methods);
-            return false;
-        }
-    } else {
-        *fields = NULL;
+    if ((*class_count > 0 && *classes == NULL) ||
+        (total_method_count > 0 && *methods == NULL) ||
+        (want_fields && total_field_count > 0 && *fields == NULL)) {
+        arxmod_reader_free_classes(classes, class_count, methods, fields);
+        return false;
     }
     
     // Set the counts
     *method_count = total_method_count;
-    *field_count = total_field_count;
-    
-    // Second pass: seek back to beginning and read all class data
-    if (fseek(reader->file, reader->header.data_offset + section->offset, SEEK_SET) != 0) {
-        if (*classes) free(*classes);
-        if (*methods) free(*methods);
-        if (*fields) free(*fields);
-        return false;
+    if (want_fields) {
+        *field_count = total_field_count;
     }
     
-    // Read the class data and inline methods/fields
+    // Second pass: read the class data and inline methods/fields
+    position = section_start;
     size_t method_index = 0;
     size_t field_index = 0;
     
     for (size_t i = 0; i < *class_count; i++) {
-        // Read class entry
-        if (fread(&(*classes)[i], sizeof(class_entry_t), 1, reader->file) != 1) {
-            if (*classes) free(*classes);
-            if (*methods) free(*methods);
-            if (*fields) free(*fields);
-            return false;
+        class_entry_t *entry = &(*classes)[i];
+        if (!arxmod_reader_read_at(reader, position, entry, sizeof(class_entry_t))) {
+            arxmod_reader_free_classes(classes, class_count, methods, fields);
+        return false;
         }
+        position += sizeof(class_entry_t);
         
-        // Read inline methods for this class
-        for (size_t j = 0; j < (*classes)[i].method_count; j++) {
-            if (fread(&(*methods)[method_index], sizeof(method_entry_t), 1, reader->file) != 1) {
-                if (*classes) free(*classes);
-                if (*methods) free(*methods);
-                if (*fields) free(*fields);
-                return false;
-            }
-            method_index++;
+        size_t methods_size = entry->method_count * sizeof(method_entry_t);
+        if (methods_size > 0 &&
+            !arxmod_reader_read_at(reader, position, &(*methods)[method_index], methods_size)) {
+            arxmod_reader_free_classes(classes, class_count, methods, fields);
+        return false;
         }
+        position += methods_size;
+        method_index += entry->method_count;
         
-        // Read inline fields for this class
-        for (size_t j = 0; j < (*classes)[i].field_count; j++) {
-            if (fread(&(*fields)[field_index], sizeof(field_entry_t), 1, reader->file) != 1) {
-                if (*classes) free(*classes);
-                if (*methods) free(*methods);
-                if (*fields) free(*fields);
-                return false;
-            }
-            field_index++;
+        size_t fields_size = entry->field_count * sizeof(field_entry_t);
+        if (want_fields && fields_size > 0 &&
+            !arxmod_reader_read_at(reader, position, &(*fields)[field_index], fields_size)) {
+            arxmod_reader_free_classes(classes, class_count, methods, fields);
+        return false;
         }
+        position += fields_size;
+        field_index += entry->field_count;
     }
     
     if (reader->debug_output) {
         printf("Read %zu classes from offset %llu:\n", 
-               *class_count, (unsigned long long)(reader->header.data_offset + section->offset));
+               *class_count, (unsigned long long)section_start);
         for (size_t i = 0; i < *class_count; i++) {
-            printf("  Class %zu: name='%s', id=%llu, fields=%u, methods=%u\n", 
+            printf("  Class %zu: name='%.32s', id=%llu, fields=%u, methods=%u\n", 
                    i, (*classes)[i].class_name, (unsigned long long)(*classes)[i].class_id, 
                    (*classes)[i].field_count, (*classes)[i].method_count);
         }
@@ -549,7 +802,7 @@ bool arxmod_reader_load_classes_section(arxmod_reader_t *reader, class_entry_t *
 
 bool arxmod_reader_load_app_section(arxmod_reader_t *reader, char **app_name, uint8_t **app_data, size_t *app_data_size)
 {
-    if (reader == NULL || reader->file == NULL || app_name == NULL || app_data == NULL || app_data_size == NULL) {
+    if (reader == NULL || !arxmod_reader_is_open(reader) || app_name == NULL || app_data == NULL || app_data_size == NULL) {
         return false;
     }
     
@@ -561,10 +814,7 @@ bool arxmod_reader_load_app_section(arxmod_reader_t *reader, char **app_name, ui
         return true; // No app section is valid
     }
     
-    // Seek to section data
-    if (fseek(reader->file, reader->header.data_offset + section->offset, SEEK_SET) != 0) {
-        return false;
-    }
+    uint64_t position = reader->header.data_offset + section->offset;
     
     // Read app name
     if (reader->header.app_name_len > 0) {
@@ -573,13 +823,14 @@ bool arxmod_reader_load_app_section(arxmod_reader_t *reader, char **app_name, ui
             return false;
         }
         
-        if (fread(*app_name, 1, reader->header.app_name_len, reader->file) != reader->header.app_name_len) {
+        if (!arxmod_reader_read_at(reader, position, *app_name, reader->header.app_name_len)) {
             free(*app_name);
             *app_name = NULL;
             return false;
         }
         
         (*app_name)[reader->header.app_name_len] = '\0';
+        position += reader->header.app_name_len;
     } else {
         *app_name = NULL;
     }
@@ -594,7 +845,7 @@ bool arxmod_reader_load_app_section(arxmod_reader_t *reader, char **app_name, ui
             return false;
         }
         
-        if (fread(*app_data, 1, *app_data_size, reader->file) != *app_data_size) {
+        if (!arxmod_reader_read_at(reader, position, *app_data, *app_data_size)) {
             free(*app_name);
             free(*app_data);
             *app_name = NULL;
@@ -613,6 +864,55 @@ bool arxmod_reader_load_app_section(arxmod_reader_t *reader, char **app_name, ui
     return true;
 }
 
+bool arxmod_reader_load_externs_section(arxmod_reader_t *reader, external_ref_t **externs, size_t *extern_count)
+{
+    if (reader == NULL || !arxmod_reader_is_open(reader) || externs == NULL || extern_count == NULL) {
+        return false;
+    }
+
+    *externs = NULL;
+    *extern_count = 0;
+
+    arxmod_toc_entry_t *section = arxmod_reader_find_section(reader, ARXMOD_SECTION_EXTERNS);
+    if (section == NULL || section->size == 0) {
+        return true; // A module without imports has no externs section
+    }
+
+    if (section->size % sizeof(external_ref_t) != 0) {
+        if (reader->debug_output) {
+            printf("Externs section size %llu is not a whole number of entries\n", (unsigned long long)section->size);
+        }
+        return false;
+    }
+
+    size_t count = (size_t)(section->size / sizeof(external_ref_t));
+    external_ref_t *entries = malloc(count * sizeof(external_ref_t));
+    if (entries == NULL) {
+        return false;
+    }
+
+    if (!arxmod_reader_read_at(reader, reader->header.data_offset + section->offset,
+                               entries, count * sizeof(external_ref_t))) {
+        free(entries);
+        return false;
+    }
+
+    // Names are used as C strings from here on
+    for (size_t i = 0; i < count; i++) {
+        entries[i].module_name[sizeof(entries[i].module_name) - 1] = '\0';
+        entries[i].name[sizeof(entries[i].name) - 1] = '\0';
+    }
+
+    *externs = entries;
+    *extern_count = count;
+
+    if (reader->debug_output) {
+        printf("Externs section loaded: %zu references\n", count);
+    }
+
+    return true;
+}
+
 void arxmod_reader_cleanup(arxmod_reader_t *reader)
 {
     if (reader != NULL) {
@@ -620,10 +920,16 @@ void arxmod_reader_cleanup(arxmod_reader_t *reader)
             fclose(reader->file);
             reader->file = NULL;
         }
-        if (reader->toc != NULL) {
+        if (reader->toc != NULL && reader->map == NULL) {
             free(reader->toc);
-            reader->toc = NULL;
         }
+        reader->toc = NULL;
+#if ARXMOD_HAVE_MMAP
+        if (reader->map != NULL) {
+            munmap((void *)reader->map, reader->map_size);
+            reader->map = NULL;
+        }
+#endif
         memset(reader, 0, sizeof(arxmod_reader_t));
     }
 }
@@ -29,6 +29,7 @@ bool arxmod_writer_init(arxmod_writer_t *writer, const char *filename)
     writer->section_count = 0;
     writer->toc_entries = NULL;
     writer->toc_capacity = 0;
+    writer->toc_reserved = ARXMOD_BASE_SECTIONS;
     writer->debug_output = debug_mode;
     
     if (writer->debug_output) {
@@ -143,6 +144,18 @@ bool arxmod_writer_update_header(arxmod_writer_t *writer)
     return true;
 }
 
+// Size the TOC space that arxmod_writer_write_header() leaves before the
+// data sections; must be called before it
+bool arxmod_writer_reserve_sections(arxmod_writer_t *writer, size_t section_count)
+{
+    if (writer == NULL || writer->data_offset != 0 || section_count > ARXMOD_MAX_SECTIONS) {
+        return false;
+    }
+    
+    writer->toc_reserved = section_count;
+    return true;
+}
+
 bool arxmod_writer_write_header(arxmod_writer_t *writer, const char *app_name, size_t app_name_len)
 {
     if (writer == NULL || writer->file == NULL) {
@@ -171,8 +184,9 @@ bool arxmod_writer_write_header(arxmod_writer_t *writer, const char *app_name, s
     writer->header_offset = 0;
     writer->toc_offset = ARXMOD_HEADER_SIZE;
     
-    // Reserve space for TOC (will be written later)
-    size_t toc_size = 6 * sizeof(arxmod_toc_entry_t); // Reserve space for 6 sections (CODE, STRINGS, SYMBOLS, DEBUG, CLASSES, APP)
+    // Reserve space for TOC (will be written later): CODE, CONSTS, STRINGS,
+    // SYMBOLS, DEBUG, CLASSES, APP and, in modules with imports, EXTERNS
+    size_t toc_size = writer->toc_reserved * sizeof(arxmod_toc_entry_t);
     uint8_t *toc_placeholder = calloc(1, toc_size);
     if (toc_placeholder == NULL) {
         return false;
@@ -192,67 +206,126 @@ bool arxmod_writer_write_header(arxmod_writer_t *writer, const char *app_name, s
     return true;
 }
 
-bool arxmod_writer_add_code_section(arxmod_writer_t *writer, instruction_t *instructions, size_t instruction_count)
+// Append a TOC entry for a section starting at the current data offset
+static arxmod_toc_entry_t *arxmod_writer_new_toc_entry(arxmod_writer_t *writer, const char *name)
 {
-    if (writer == NULL || writer->file == NULL) {
-        return false;
-    }
-    
     // Expand TOC if needed
     if (writer->section_count >= writer->toc_capacity) {
         size_t new_capacity = writer->toc_capacity == 0 ? 8 : writer->toc_capacity * 2;
         arxmod_toc_entry_t *new_toc = realloc(writer->toc_entries, new_capacity * sizeof(arxmod_toc_entry_t));
         if (new_toc == NULL) {
-            return false;
+            return NULL;
         }
         writer->toc_entries = new_toc;
         writer->toc_capacity = new_capacity;
     }
     
-    // Create TOC entry
     arxmod_toc_entry_t *toc_entry = &writer->toc_entries[writer->section_count];
     memset(toc_entry, 0, sizeof(arxmod_toc_entry_t));
-    strncpy(toc_entry->section_name, ARXMOD_SECTION_CODE, 16);
+    size_t name_length = strlen(name);
+    if (name_length > sizeof(toc_entry->section_name) - 1) {
+        name_length = sizeof(toc_entry->section_name) - 1;
+    }
+    memcpy(toc_entry->section_name, name, name_length);
     toc_entry->offset = writer->current_data_offset;
-    toc_entry->size = instruction_count * sizeof(instruction_t);
     toc_entry->flags = 0;
-    
-    if (writer->debug_output) {
-        printf("Created CODE TOC entry: name='%s', offset=%llu, size=%llu\n", 
-               toc_entry->section_name, (unsigned long long)toc_entry->offset, (unsigned long long)toc_entry->size);
-    }
-    
-    // Write section data
-    if (instruction_count > 0) {
-        // Ensure we're at the correct position in the file
+    return toc_entry;
+}
+
+// Write the data of the entry just created and commit it to the TOC
+static bool arxmod_writer_write_section(arxmod_writer_t *writer, arxmod_toc_entry_t *toc_entry, const void *data, size_t size)
+{
+    toc_entry->size = size;
+    if (size > 0) {
         long expected_position = writer->data_offset + toc_entry->offset;
         if (fseek(writer->file, expected_position, SEEK_SET) != 0) {
             return false;
         }
-        
-        if (writer->debug_output) {
-            printf("Writing %zu instructions at file position %ld\n", instruction_count, expected_position);
-            // Debug: print first few instructions
-            for (size_t i = 0; i < instruction_count && i < 3; i++) {
-                printf("  Instruction %zu: opcode=0x%02x, operand=0x%016llx\n", 
-                       i, instructions[i].opcode, (unsigned long long)instructions[i].opt64);
-            }
-        }
-        
-        if (fwrite(instructions, sizeof(instruction_t), instruction_count, writer->file) != instruction_count) {
+        if (fwrite(data, 1, size, writer->file) != size) {
             return false;
         }
     }
     
-    writer->current_data_offset += toc_entry->size;
+    writer->current_data_offset += size;
     writer->section_count++;
+    return true;
+}
+
+// Unsigned LEB128: 7 bits per byte, high bit set on all but the last
+static size_t arxmod_put_varint(uint8_t *out, uint64_t value)
+{
+    size_t length = 0;
+    while (value >= 0x80) {
+        out[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[length++] = (uint8_t)value;
+    return length;
+}
+
+// Version 2 code: instruction count (uint64), then per instruction the
+// opcode byte and one varint operand token. A token is operand << 1 for
+// operands below ARXMOD_INLINE_OPERAND_LIMIT, otherwise (index << 1) | 1
+// into the CONSTS section, an array of uint64 shared by equal operands.
+bool arxmod_writer_add_code_section(arxmod_writer_t *writer, instruction_t *instructions, size_t instruction_count)
+{
+    if (writer == NULL || writer->file == NULL || (instructions == NULL && instruction_count > 0)) {
+        return false;
+    }
     
-    if (writer->debug_output) {
-        printf("Code section added: %zu instructions (%llu bytes)\n", 
-               instruction_count, (unsigned long long)toc_entry->size);
+    // Worst case: opcode byte plus a 10-byte varint per instruction
+    uint8_t *code = malloc(sizeof(uint64_t) + instruction_count * 11);
+    uint64_t *pool = malloc((instruction_count > 0 ? instruction_count : 1) * sizeof(uint64_t));
+    if (code == NULL || pool == NULL) {
+        free(code);
+        free(pool);
+        return false;
     }
     
-    return true;
+    uint64_t count = instruction_count;
+    memcpy(code, &count, sizeof(uint64_t));
+    size_t code_size = sizeof(uint64_t);
+    size_t pool_count = 0;
+    
+    for (size_t i = 0; i < instruction_count; i++) {
+        uint64_t operand = instructions[i].opt64;
+        uint64_t token;
+        if (operand < ARXMOD_INLINE_OPERAND_LIMIT) {
+            token = operand << 1;
+        } else {
+            size_t index = 0;
+            while (index < pool_count && pool[index] != operand) {
+                index++;
+            }
+            if (index == pool_count) {
+                pool[pool_count++] = operand;
+            }
+            token = ((uint64_t)index << 1) | 1;
+        }
+        code[code_size++] = instructions[i].opcode;
+        code_size += arxmod_put_varint(&code[code_size], token);
+    }
+    
+    arxmod_toc_entry_t *toc_entry = arxmod_writer_new_toc_entry(writer, ARXMOD_SECTION_CODE);
+    bool ok = toc_entry != NULL && arxmod_writer_write_section(writer, toc_entry, code, code_size);
+    
+    if (ok && writer->debug_output) {
+        printf("Code section added: %zu instructions (%zu bytes, %zu fixed-size)\n", 
+               instruction_count, code_size, instruction_count * sizeof(instruction_t));
+    }
+    
+    if (ok && pool_count > 0) {
+        toc_entry = arxmod_writer_new_toc_entry(writer, ARXMOD_SECTION_CONSTS);
+        ok = toc_entry != NULL && arxmod_writer_write_section(writer, toc_entry, pool, pool_count * sizeof(uint64_t));
+        
+        if (ok && writer->debug_output) {
+            printf("Constant pool added: %zu operands\n", pool_count);
+        }
+    }
+    
+    free(code);
+    free(pool);
+    return ok;
 }
 
 bool arxmod_writer_add_strings_section(arxmod_writer_t *writer, const char **strings, size_t string_count)
@@ -582,12 +655,41 @@ bool arxmod_writer_add_app_section(arxmod_writer_t *writer, const char *app_name
     return true;
 }
 
+bool arxmod_writer_add_externs_section(arxmod_writer_t *writer, const external_ref_t *externs, size_t extern_count)
+{
+    if (writer == NULL || writer->file == NULL || (extern_count > 0 && externs == NULL)) {
+        return false;
+    }
+    
+    arxmod_toc_entry_t *toc_entry = arxmod_writer_new_toc_entry(writer, ARXMOD_SECTION_EXTERNS);
+    if (toc_entry == NULL ||
+        !arxmod_writer_write_section(writer, toc_entry, externs, extern_count * sizeof(external_ref_t))) {
+        return false;
+    }
+    
+    if (writer->debug_output) {
+        printf("Externs section added: %zu references (%llu bytes)\n",
+               extern_count, (unsigned long long)toc_entry->size);
+    }
+    
+    return true;
+}
+
 bool arxmod_writer_finalize(arxmod_writer_t *writer)
 {
     if (writer == NULL || writer->file == NULL) {
         return false;
     }
     
+    // The TOC must fit in the space reserved before the data sections
+    if (writer->section_count > writer->toc_reserved) {
+        if (writer->debug_output) {
+            printf("ARX module writer: %zu sections exceed the %zu reserved TOC entries\n",
+                   writer->section_count, writer->toc_reserved);
+        }
+        return false;
+    }
+    
     // Write TOC at the correct position
     fseek(writer->file, writer->toc_offset, SEEK_SET);
     if (writer->section_count > 0) {
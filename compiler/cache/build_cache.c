@@ -0,0 +1,557 @@
+/*
+ * ARX Build Cache Implementation
+ * One file per class build, keyed by a fingerprint of the class AST
+ */
+
+#include "build_cache.h"
+#include "../arxmod/arxmod.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Global debug flag (extern from main.c)
+extern bool debug_mode;
+
+#define BUILD_CACHE_NULL_STRING UINT64_MAX
+
+// Growable byte buffer for fingerprint keys and entries
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    bool failed;                    // An allocation failed; contents are incomplete
+} build_cache_buffer_t;
+
+// Bounds-checked cursor over a loaded entry
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+    bool failed;                    // Ran past the end or hit a malformed value
+} build_cache_reader_t;
+
+static void buffer_put(build_cache_buffer_t *buffer, const void *bytes, size_t length)
+{
+    if (buffer->failed) {
+        return;
+    }
+    if (buffer->size + length > buffer->capacity) {
+        size_t new_capacity = buffer->capacity == 0 ? 4096 : buffer->capacity;
+        while (new_capacity < buffer->size + length) {
+            new_capacity *= 2;
+        }
+        uint8_t *new_data = realloc(buffer->data, new_capacity);
+        if (new_data == NULL) {
+            buffer->failed = true;
+            return;
+        }
+        buffer->data = new_data;
+        buffer->capacity = new_capacity;
+    }
+    memcpy(buffer->data + buffer->size, bytes, length);
+    buffer->size += length;
+}
+
+static void buffer_put_u8(build_cache_buffer_t *buffer, uint8_t value)
+{
+    buffer_put(buffer, &value, sizeof(value));
+}
+
+static void buffer_put_u32(build_cache_buffer_t *buffer, uint32_t value)
+{
+    buffer_put(buffer, &value, sizeof(value));
+}
+
+static void buffer_put_u64(build_cache_buffer_t *buffer, uint64_t value)
+{
+    buffer_put(buffer, &value, sizeof(value));
+}
+
+static void buffer_put_string(build_cache_buffer_t *buffer, const char *text)
+{
+    if (text == NULL) {
+        buffer_put_u64(buffer, BUILD_CACHE_NULL_STRING);
+        return;
+    }
+    size_t length = strlen(text);
+    buffer_put_u64(buffer, length);
+    buffer_put(buffer, text, length);
+}
+
+static bool reader_get(build_cache_reader_t *reader, void *bytes, size_t length)
+{
+    if (reader->failed || reader->size - reader->pos < length) {
+        reader->failed = true;
+        return false;
+    }
+    memcpy(bytes, reader->data + reader->pos, length);
+    reader->pos += length;
+    return true;
+}
+
+static uint8_t reader_get_u8(build_cache_reader_t *reader)
+{
+    uint8_t value = 0;
+    reader_get(reader, &value, sizeof(value));
+    return value;
+}
+
+static uint32_t reader_get_u32(build_cache_reader_t *reader)
+{
+    uint32_t value = 0;
+    reader_get(reader, &value, sizeof(value));
+    return value;
+}
+
+static uint64_t reader_get_u64(build_cache_reader_t *reader)
+{
+    uint64_t value = 0;
+    reader_get(reader, &value, sizeof(value));
+    return value;
+}
+
+// A count of items at least min_item_size bytes each; rejects counts the
+// rest of the entry cannot hold before anything is allocated for them
+static size_t reader_get_count(build_cache_reader_t *reader, size_t min_item_size)
+{
+    uint64_t count = reader_get_u64(reader);
+    if (reader->failed || count > (reader->size - reader->pos) / min_item_size) {
+        reader->failed = true;
+        return 0;
+    }
+    return (size_t)count;
+}
+
+// Heap copy of a string, or NULL for a NULL string. Check reader->failed to
+// tell the two apart.
+static char *reader_get_string(build_cache_reader_t *reader)
+{
+    uint64_t length = reader_get_u64(reader);
+    if (reader->failed || length == BUILD_CACHE_NULL_STRING) {
+        return NULL;
+    }
+    if (length > reader->size - reader->pos) {
+        reader->failed = true;
+        return NULL;
+    }
+    char *text = malloc((size_t)length + 1);
+    if (text == NULL) {
+        reader->failed = true;
+        return NULL;
+    }
+    memcpy(text, reader->data + reader->pos, (size_t)length);
+    text[length] = '\0';
+    reader->pos += (size_t)length;
+    return text;
+}
+
+// Keys are hashed a byte at a time, so nodes are encoded compactly: type,
+// which of value and number are present, data type, those, then the children
+static void fingerprint_node(build_cache_buffer_t *key, const ast_node_t *node)
+{
+    uint8_t header[3] = { (uint8_t)node->type, (uint8_t)((node->value != NULL ? 1 : 0) | (node->number != 0 ? 2 : 0)),
+                          (uint8_t)node->data_type };
+    buffer_put(key, header, sizeof(header));
+    if (node->value != NULL) {
+        uint32_t length = (uint32_t)strlen(node->value);
+        buffer_put_u32(key, length);
+        buffer_put(key, node->value, length);
+    }
+    if (node->number != 0) {
+        buffer_put_u64(key, node->number);
+    }
+    buffer_put_u32(key, (uint32_t)node->child_count);
+    for (size_t i = 0; i < node->child_count; i++) {
+        fingerprint_node(key, node->children[i]);
+    }
+}
+
+// The class subtree in preorder. Line entries are stored as positions in
+// it rather than as line numbers: the fingerprint leaves positions out, so
+// an entry is reused after lines move and must pick up the new ones.
+static size_t build_cache_count_nodes(const ast_node_t *node)
+{
+    size_t count = 1;
+    for (size_t i = 0; i < node->child_count; i++) {
+        count += build_cache_count_nodes(node->children[i]);
+    }
+    return count;
+}
+
+static void build_cache_flatten_nodes(const ast_node_t *node, const ast_node_t **nodes, size_t *count)
+{
+    nodes[(*count)++] = node;
+    for (size_t i = 0; i < node->child_count; i++) {
+        build_cache_flatten_nodes(node->children[i], nodes, count);
+    }
+}
+
+static const ast_node_t **build_cache_class_nodes(const codegen_context_t *class_context, size_t *count)
+{
+    *count = 0;
+    if (class_context->current_class == NULL) {
+        return NULL;
+    }
+    const ast_node_t **nodes = malloc(build_cache_count_nodes(class_context->current_class) * sizeof(ast_node_t *));
+    if (nodes != NULL) {
+        build_cache_flatten_nodes(class_context->current_class, nodes, count);
+    }
+    return nodes;
+}
+
+uint64_t build_cache_fingerprint(const char *module_name, const linker_imports_t *imports, const ast_node_t *class_node, size_t *key_size)
+{
+    build_cache_buffer_t key = {0};
+    buffer_put_u32(&key, BUILD_CACHE_VERSION);
+    buffer_put_string(&key, module_name);
+    
+    // `new` of an imported class emits that module's class ID
+    size_t module_count = imports != NULL ? imports->module_count : 0;
+    buffer_put_u32(&key, (uint32_t)module_count);
+    for (size_t m = 0; m < module_count; m++) {
+        const linker_import_t *import = &imports->modules[m];
+        buffer_put_string(&key, import->module_name);
+        buffer_put_u32(&key, (uint32_t)import->class_count);
+        for (size_t i = 0; i < import->class_count; i++) {
+            const char *class_name = import->classes[i].class_name;
+            const char *end = memchr(class_name, '\0', sizeof(import->classes[i].class_name));
+            buffer_put(&key, class_name, end != NULL ? (size_t)(end - class_name) : sizeof(import->classes[i].class_name));
+            buffer_put_u8(&key, 0);
+            buffer_put_u64(&key, import->classes[i].class_id);
+        }
+    }
+    if (class_node != NULL) {
+        fingerprint_node(&key, class_node);
+    }
+
+    // An incomplete key must not match anything
+    uint64_t fingerprint = key.failed ? 0 : arxmod_calculate_hash(key.data, key.size);
+    if (key_size != NULL) {
+        *key_size = key.failed ? 0 : key.size;
+    }
+    free(key.data);
+    return fingerprint;
+}
+
+static bool build_cache_path(const char *cache_dir, uint64_t fingerprint, char *path, size_t path_size)
+{
+    int length = snprintf(path, path_size, "%s/%016llx.arxcls", cache_dir, (unsigned long long)fingerprint);
+    return length > 0 && (size_t)length < path_size;
+}
+
+static uint8_t *build_cache_read_file(const char *path, size_t *size)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    uint8_t *data = NULL;
+    long length = -1;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        length = ftell(file);
+    }
+    if (length > 0 && fseek(file, 0, SEEK_SET) == 0) {
+        data = malloc((size_t)length);
+        if (data != NULL && fread(data, 1, (size_t)length, file) != (size_t)length) {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(file);
+
+    *size = data != NULL ? (size_t)length : 0;
+    return data;
+}
+
+bool build_cache_load(const char *cache_dir, uint64_t fingerprint, size_t key_size, codegen_context_t *class_context)
+{
+    char path[4096];
+    if (cache_dir == NULL || class_context == NULL || key_size == 0 ||
+        !build_cache_path(cache_dir, fingerprint, path, sizeof(path))) {
+        return false;
+    }
+
+    size_t size = 0;
+    uint8_t *data = build_cache_read_file(path, &size);
+    if (data == NULL) {
+        return false;
+    }
+
+    build_cache_reader_t reader = { data, size, 0, false };
+    if (reader_get_u32(&reader) != BUILD_CACHE_MAGIC ||
+        reader_get_u32(&reader) != BUILD_CACHE_VERSION ||
+        reader_get_u64(&reader) != fingerprint ||
+        reader_get_u64(&reader) != key_size) {
+        free(data);
+        return false;
+    }
+
+    size_t globals = (size_t)reader_get_u64(&reader);
+    size_t label_counter = (size_t)reader_get_u64(&reader);
+
+    // Literals first, so the instructions can be rewritten as they are read
+    size_t literal_count = reader_get_count(&reader, sizeof(uint64_t));
+    uint64_t *pool_indices = calloc(literal_count > 0 ? literal_count : 1, sizeof(uint64_t));
+    if (pool_indices == NULL) {
+        free(data);
+        return false;
+    }
+    for (size_t i = 0; i < literal_count && !reader.failed; i++) {
+        char *text = reader_get_string(&reader);
+        size_t pool_index = 0;
+        if (text == NULL || !codegen_find_string_literal(class_context, text, &pool_index)) {
+            reader.failed = true;
+        }
+        pool_indices[i] = pool_index;
+        free(text);
+    }
+
+    // Instructions; VM_STRING operands index the entry's literals
+    size_t instruction_count = reader_get_count(&reader, sizeof(uint8_t) + sizeof(uint64_t));
+    for (size_t i = 0; i < instruction_count && !reader.failed; i++) {
+        uint8_t opcode = reader_get_u8(&reader);
+        uint64_t operand = reader_get_u64(&reader);
+        if ((opcode & 0x0F) == VM_STRING) {
+            if (operand >= literal_count) {
+                reader.failed = true;
+                break;
+            }
+            operand = pool_indices[operand];
+        }
+        emit_instruction(class_context, opcode, 0, operand); // level is encoded in opcode upper nibble
+    }
+    free(pool_indices);
+    if (!reader.failed && class_context->instruction_count != instruction_count) {
+        reader.failed = true;
+    }
+
+    size_t label_count = reader_get_count(&reader, 2 * sizeof(uint64_t) + sizeof(uint8_t));
+    if (!reader.failed && label_count > 0) {
+        class_context->label_table = malloc(label_count * sizeof(label_entry_t));
+        if (class_context->label_table == NULL) {
+            reader.failed = true;
+        } else {
+            class_context->label_table_capacity = label_count;
+        }
+    }
+    for (size_t i = 0; i < label_count && !reader.failed; i++) {
+        label_entry_t *label = &class_context->label_table[i];
+        label->label_id = (size_t)reader_get_u64(&reader);
+        label->instruction_index = (size_t)reader_get_u64(&reader);
+        label->defined = reader_get_u8(&reader) != 0;
+        class_context->label_table_size++;
+    }
+
+    size_t position_count = reader_get_count(&reader, 4 * sizeof(uint64_t));
+    for (size_t i = 0; i < position_count && !reader.failed; i++) {
+        char *method_name = reader_get_string(&reader);
+        char *class_name = reader_get_string(&reader);
+        size_t start = (size_t)reader_get_u64(&reader);
+        size_t end = (size_t)reader_get_u64(&reader);
+        if (reader.failed || method_name == NULL ||
+            !codegen_add_method_position(class_context, class_name, method_name, start, end)) {
+            reader.failed = true;
+        }
+        free(method_name);
+        free(class_name);
+    }
+
+    size_t call_count = reader_get_count(&reader, 3 * sizeof(uint64_t));
+    for (size_t i = 0; i < call_count && !reader.failed; i++) {
+        size_t instruction_index = (size_t)reader_get_u64(&reader);
+        char *method_name = reader_get_string(&reader);
+        uint64_t receiver_class_id = reader_get_u64(&reader);
+        if (reader.failed || method_name == NULL ||
+            !codegen_add_method_call(class_context, instruction_index, method_name, receiver_class_id)) {
+            reader.failed = true;
+        }
+        free(method_name);
+    }
+
+    size_t line_count = reader_get_count(&reader, 2 * sizeof(uint64_t));
+    if (!reader.failed && line_count > 0) {
+        size_t node_count = 0;
+        const ast_node_t **nodes = build_cache_class_nodes(class_context, &node_count);
+        if (nodes == NULL) {
+            reader.failed = true;
+        }
+        for (size_t i = 0; i < line_count && !reader.failed; i++) {
+            size_t instruction_index = (size_t)reader_get_u64(&reader);
+            uint64_t ordinal = reader_get_u64(&reader);
+            if (reader.failed || ordinal >= node_count || nodes[ordinal]->line_number == 0) {
+                reader.failed = true;
+                break;
+            }
+            codegen_add_line(class_context, instruction_index, nodes[ordinal]);
+        }
+        free(nodes);
+    }
+
+    bool loaded = !reader.failed && reader.pos == reader.size;
+    free(data);
+    if (!loaded) {
+        if (debug_mode) {
+            printf("Build cache: ignoring unreadable entry %s\n", path);
+        }
+        return false;
+    }
+
+    class_context->next_variable_address = globals;
+    class_context->label_counter = label_counter;
+
+    if (debug_mode) {
+        printf("Build cache: loaded %zu instructions for class %s from %s\n", instruction_count,
+               class_context->current_class_name ? class_context->current_class_name : "unknown", path);
+    }
+
+    return true;
+}
+
+bool build_cache_store(const char *cache_dir, uint64_t fingerprint, size_t key_size, const codegen_context_t *class_context)
+{
+    char path[4096];
+    char temp_path[4096 + 64];
+    if (cache_dir == NULL || class_context == NULL || key_size == 0 ||
+        !build_cache_path(cache_dir, fingerprint, path, sizeof(path))) {
+        return false;
+    }
+
+    const parser_context_t *parser_context = class_context->parser_context;
+    size_t pool_count = parser_context != NULL && parser_context->method_string_literals != NULL ?
+                        parser_context->method_string_count : 0;
+
+    // The pool indices a class uses shift whenever a literal is added or
+    // removed earlier in the module, so the entry keeps the literal texts
+    // and VM_STRING operands index those instead
+    uint64_t *local_literals = malloc((class_context->instruction_count > 0 ? class_context->instruction_count : 1) * sizeof(uint64_t));
+    if (local_literals == NULL) {
+        return false;
+    }
+    size_t literal_count = 0;
+    for (size_t i = 0; i < class_context->instruction_count; i++) {
+        const instruction_t *instr = &class_context->instructions[i];
+        if ((instr->opcode & 0x0F) != VM_STRING) {
+            continue;
+        }
+        if (instr->opt64 >= pool_count || parser_context->method_string_literals[instr->opt64] == NULL) {
+            free(local_literals);
+            return false;
+        }
+        size_t j = 0;
+        while (j < literal_count && local_literals[j] != instr->opt64) {
+            j++;
+        }
+        if (j == literal_count) {
+            local_literals[literal_count++] = instr->opt64;
+        }
+    }
+
+    build_cache_buffer_t entry = {0};
+    buffer_put_u32(&entry, BUILD_CACHE_MAGIC);
+    buffer_put_u32(&entry, BUILD_CACHE_VERSION);
+    buffer_put_u64(&entry, fingerprint);
+    buffer_put_u64(&entry, key_size);
+    buffer_put_u64(&entry, class_context->next_variable_address);
+    buffer_put_u64(&entry, class_context->label_counter);
+
+    buffer_put_u64(&entry, literal_count);
+    for (size_t i = 0; i < literal_count; i++) {
+        buffer_put_string(&entry, parser_context->method_string_literals[local_literals[i]]);
+    }
+
+    buffer_put_u64(&entry, class_context->instruction_count);
+    for (size_t i = 0; i < class_context->instruction_count; i++) {
+        const instruction_t *instr = &class_context->instructions[i];
+        uint64_t operand = instr->opt64;
+        if ((instr->opcode & 0x0F) == VM_STRING) {
+            size_t j = 0;
+            while (local_literals[j] != operand) {
+                j++;
+            }
+            operand = j;
+        }
+        buffer_put_u8(&entry, instr->opcode);
+        buffer_put_u64(&entry, operand);
+    }
+    free(local_literals);
+
+    buffer_put_u64(&entry, class_context->label_table_size);
+    for (size_t i = 0; i < class_context->label_table_size; i++) {
+        buffer_put_u64(&entry, class_context->label_table[i].label_id);
+        buffer_put_u64(&entry, class_context->label_table[i].instruction_index);
+        buffer_put_u8(&entry, class_context->label_table[i].defined ? 1 : 0);
+    }
+
+    buffer_put_u64(&entry, class_context->method_position_count);
+    for (size_t i = 0; i < class_context->method_position_count; i++) {
+        buffer_put_string(&entry, class_context->method_positions[i].method_name);
+        buffer_put_string(&entry, class_context->method_positions[i].class_name);
+        buffer_put_u64(&entry, class_context->method_positions[i].start_instruction);
+        buffer_put_u64(&entry, class_context->method_positions[i].end_instruction);
+    }
+
+    buffer_put_u64(&entry, class_context->method_call_count);
+    for (size_t i = 0; i < class_context->method_call_count; i++) {
+        buffer_put_u64(&entry, class_context->method_calls[i].instruction_index);
+        buffer_put_string(&entry, class_context->method_calls[i].method_name);
+        buffer_put_u64(&entry, class_context->method_calls[i].receiver_class_id);
+    }
+
+    // Lines follow statement order, so each is looked for from the last
+    // one found; loops point back at their own node and wrap around
+    size_t node_count = 0;
+    const ast_node_t **nodes = class_context->line_count > 0 ? build_cache_class_nodes(class_context, &node_count) : NULL;
+    if (class_context->line_count > 0 && nodes == NULL) {
+        free(entry.data);
+        return false;
+    }
+    buffer_put_u64(&entry, class_context->line_count);
+    for (size_t i = 0, cursor = 0; i < class_context->line_count; i++) {
+        size_t searched = 0;
+        while (searched < node_count && nodes[cursor] != class_context->lines[i].statement) {
+            cursor = cursor + 1 < node_count ? cursor + 1 : 0;
+            searched++;
+        }
+        if (searched == node_count) {
+            free(nodes);
+            free(entry.data);
+            return false;
+        }
+        buffer_put_u64(&entry, class_context->lines[i].instruction_index);
+        buffer_put_u64(&entry, cursor);
+    }
+    free(nodes);
+
+    if (entry.failed) {
+        free(entry.data);
+        return false;
+    }
+
+    // Classes are stored from several threads with -j, so the temporary
+    // name is unique per store, not just per process
+    static unsigned long store_counter = 0;
+    unsigned long store_id = __sync_fetch_and_add(&store_counter, 1);
+    snprintf(temp_path, sizeof(temp_path), "%s.%ld.%lu.tmp", path, (long)getpid(), store_id);
+    FILE *file = fopen(temp_path, "wb");
+    if (file == NULL) {
+        free(entry.data);
+        return false;
+    }
+
+    bool written = fwrite(entry.data, 1, entry.size, file) == entry.size;
+    written = fclose(file) == 0 && written;
+    free(entry.data);
+    if (!written || rename(temp_path, path) != 0) {
+        remove(temp_path);
+        return false;
+    }
+
+    if (debug_mode) {
+        printf("Build cache: saved class %s to %s\n",
+               class_context->current_class_name ? class_context->current_class_name : "unknown", path);
+    }
+
+    return true;
+}
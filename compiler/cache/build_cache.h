@@ -0,0 +1,33 @@
+/*
+ * ARX Build Cache - Per-class code generation results kept between builds
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "../codegen/codegen.h"
+
+// Bump whenever code generation changes what it emits for the same AST, so
+// entries written by an older compiler stop matching
+#define BUILD_CACHE_VERSION 5
+
+// Entries live in <cache dir>/<fingerprint>.arxcls
+#define BUILD_CACHE_MAGIC 0x534C4358   // "XCLS"
+
+// Identity of a class build: the class subtree as code generation reads it
+// (node types, data types, values, numbers, shape; not source positions) and what it
+// depends on outside the class: the module name that class IDs are derived
+// from and the classes of imported modules (may be NULL). key_size (may be
+// NULL) receives the length of the hashed key, which entries also record as
+// a guard against hash collisions.
+uint64_t build_cache_fingerprint(const char *module_name, const linker_imports_t *imports, const ast_node_t *class_node, size_t *key_size);
+
+// Fill class_context (fresh from codegen_init, current class set) from the
+// entry for fingerprint. String literals are matched by text against the
+// module's string pool. False when there is no usable entry; class_context
+// may then hold part of the entry and must be reset before generating.
+bool build_cache_load(const char *cache_dir, uint64_t fingerprint, size_t key_size, codegen_context_t *class_context);
+
+// Save a class built by generate_class(). Failing only costs a rebuild next time.
+bool build_cache_store(const char *cache_dir, uint64_t fingerprint, size_t key_size, const codegen_context_t *class_context);
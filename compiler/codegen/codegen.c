@@ -6,9 +6,11 @@
 #include "codegen.h"
 #include "../arxmod/arxmod.h"
 #include "../linker/linker.h"
+#include "../cache/build_cache.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
 // Global debug flag (extern from main.c)
 extern bool debug_mode;
@@ -25,9 +27,17 @@ bool codegen_init(codegen_context_t *context, parser_context_t *parser_context)
     context->label_counter = 0;
     context->debug_output = debug_mode;
     context->parser_context = parser_context;
+    context->jobs = 1;
+    context->build_cache_dir = NULL;
+    context->imports = NULL;
+    context->class_reused = false;
+    context->classes_rebuilt = 0;
+    context->classes_reused = 0;
     context->string_literals = NULL;
     context->string_literals_count = 0;
     context->string_literals_capacity = 0;
+    context->string_pool = NULL;
+    context->owns_string_pool = false;
     
     // Initialize label table
     context->label_table = NULL;
@@ -37,9 +47,18 @@ bool codegen_init(codegen_context_t *context, parser_context_t *parser_context)
     // Initialize variable tracking
     context->variable_names = NULL;
     context->variable_addresses = NULL;
+    context->variable_locals = NULL;
+    context->variable_types = NULL;
+    context->variable_elements = NULL;
+    context->variable_strings = NULL;
     context->variable_count = 0;
     context->variable_capacity = 0;
     context->next_variable_address = 0;
+    name_index_init(&context->variable_index);
+    context->in_method = false;
+    context->frame_size = 0;
+    context->return_type = TYPE_NONE;
+    memset(&context->escape, 0, sizeof(escape_info_t));
     
     // Initialize class context
     context->current_class = NULL;
@@ -49,6 +68,17 @@ bool codegen_init(codegen_context_t *context, parser_context_t *parser_context)
     context->method_positions = NULL;
     context->method_position_count = 0;
     context->method_position_capacity = 0;
+    name_index_init(&context->method_position_index);
+    
+    // Initialize method call site tracking
+    context->method_calls = NULL;
+    context->method_call_count = 0;
+    context->method_call_capacity = 0;
+    
+    // Initialize line table
+    context->lines = NULL;
+    context->line_count = 0;
+    context->line_capacity = 0;
     
     if (debug_mode) {
         printf("Code generator initialized\n");
@@ -58,7 +88,38 @@ bool codegen_init(codegen_context_t *context, parser_context_t *parser_context)
 }
 
 // Method position tracking functions
-bool codegen_start_method_tracking(codegen_context_t *context, const char *method_name)
+
+// Method positions are indexed by class and method name together, so
+// classes that reuse method names do not share one long chain
+static uint32_t codegen_method_position_hash(const char *class_name, const char *method_name)
+{
+    uint32_t hash = class_name != NULL ? name_index_hash(class_name) : 0;
+    return (hash * 0x9E3779B1u) ^ name_index_hash(method_name);
+}
+
+// First tracked position of method_name in class_name (NULL: outside any
+// class), or NAME_INDEX_NONE. The index chains newest first, so keep the
+// last match.
+static size_t codegen_find_method_position(codegen_context_t *context, const char *class_name, const char *method_name)
+{
+    size_t found = NAME_INDEX_NONE;
+    uint32_t hash = codegen_method_position_hash(class_name, method_name);
+    
+    for (size_t i = name_index_first(&context->method_position_index, hash); i != NAME_INDEX_NONE;
+         i = name_index_next(&context->method_position_index, i)) {
+        const char *position_class = context->method_positions[i].class_name;
+        if (strcmp(context->method_positions[i].method_name, method_name) == 0 &&
+            (class_name == NULL ? position_class == NULL :
+             (position_class != NULL && strcmp(position_class, class_name) == 0))) {
+            found = i;
+        }
+    }
+    return found;
+}
+
+// Record that method_name of class_name occupies [start, end)
+bool codegen_add_method_position(codegen_context_t *context, const char *class_name, const char *method_name,
+                                 size_t start_instruction, size_t end_instruction)
 {
     if (!context || !method_name) {
         return false;
@@ -75,12 +136,28 @@ bool codegen_start_method_tracking(codegen_context_t *context, const char *metho
         context->method_position_capacity = new_capacity;
     }
     
-    // Add new method position entry
     size_t index = context->method_position_count;
+    if (!name_index_push(&context->method_position_index, codegen_method_position_hash(class_name, method_name))) {
+        return false;
+    }
     context->method_positions[index].method_name = strdup(method_name);
-    context->method_positions[index].start_instruction = context->instruction_count;
-    context->method_positions[index].end_instruction = 0; // Will be set when method ends
+    context->method_positions[index].class_name = class_name ? strdup(class_name) : NULL;
+    context->method_positions[index].start_instruction = start_instruction;
+    context->method_positions[index].end_instruction = end_instruction;
     context->method_position_count++;
+    return true;
+}
+
+bool codegen_start_method_tracking(codegen_context_t *context, const char *method_name)
+{
+    if (!context || !method_name) {
+        return false;
+    }
+    
+    // The end is set when the method ends
+    if (!codegen_add_method_position(context, context->current_class_name, method_name, context->instruction_count, 0)) {
+        return false;
+    }
     
     if (debug_mode) {
         printf("Started tracking method '%s' at instruction %zu\n", method_name, context->instruction_count);
@@ -96,16 +173,15 @@ bool codegen_end_method_tracking(codegen_context_t *context, const char *method_
     }
     
     // Find the method position entry
-    for (size_t i = 0; i < context->method_position_count; i++) {
-        if (strcmp(context->method_positions[i].method_name, method_name) == 0) {
-            context->method_positions[i].end_instruction = context->instruction_count;
-            
-            if (debug_mode) {
-                printf("Ended tracking method '%s' at instruction %zu (started at %zu)\n", 
-                       method_name, context->instruction_count, context->method_positions[i].start_instruction);
-            }
-            return true;
+    size_t i = codegen_find_method_position(context, context->current_class_name, method_name);
+    if (i != NAME_INDEX_NONE) {
+        context->method_positions[i].end_instruction = context->instruction_count;
+        
+        if (debug_mode) {
+            printf("Ended tracking method '%s' at instruction %zu (started at %zu)\n", 
+                   method_name, context->instruction_count, context->method_positions[i].start_instruction);
         }
+        return true;
     }
     
     if (debug_mode) {
@@ -114,17 +190,16 @@ bool codegen_end_method_tracking(codegen_context_t *context, const char *method_
     return false;
 }
 
-size_t codegen_get_method_offset(codegen_context_t *context, const char *method_name)
+size_t codegen_get_method_offset(codegen_context_t *context, const char *class_name, const char *method_name)
 {
     if (!context || !method_name) {
         return 0;
     }
     
-    // Find the method position entry
-    for (size_t i = 0; i < context->method_position_count; i++) {
-        if (strcmp(context->method_positions[i].method_name, method_name) == 0) {
-            return context->method_positions[i].start_instruction;
-        }
+    // Find the method position entry; classes may share method names
+    size_t i = codegen_find_method_position(context, class_name, method_name);
+    if (i != NAME_INDEX_NONE) {
+        return context->method_positions[i].start_instruction;
     }
     
     if (debug_mode) {
@@ -133,6 +208,77 @@ size_t codegen_get_method_offset(codegen_context_t *context, const char *method_
     return 0;
 }
 
+// Record a VM_CALS instruction for the linker to patch with a method slot.
+// receiver_class_id is the receiver's class when the compiler knows it
+// exactly, else 0.
+bool codegen_add_method_call(codegen_context_t *context, size_t instruction_index, const char *method_name,
+                             uint64_t receiver_class_id)
+{
+    if (!context || !method_name) {
+        return false;
+    }
+    
+    if (context->method_call_count >= context->method_call_capacity) {
+        size_t new_capacity = context->method_call_capacity == 0 ? 16 : context->method_call_capacity * 2;
+        linker_method_call_t *new_calls = realloc(context->method_calls, new_capacity * sizeof(linker_method_call_t));
+        if (!new_calls) {
+            return false;
+        }
+        context->method_calls = new_calls;
+        context->method_call_capacity = new_capacity;
+    }
+    
+    size_t name_size = strlen(method_name) + 1;
+    char *name = malloc(name_size);
+    if (!name) {
+        return false;
+    }
+    memcpy(name, method_name, name_size);
+    context->method_calls[context->method_call_count].instruction_index = instruction_index;
+    context->method_calls[context->method_call_count].method_name = name;
+    context->method_calls[context->method_call_count].receiver_class_id = receiver_class_id;
+    context->method_call_count++;
+    return true;
+}
+
+// Record that the code from instruction_index on comes from statement.
+// Statements that emit nothing leave their entry to be replaced by the
+// next one, and a statement on the line already in effect adds nothing.
+bool codegen_add_line(codegen_context_t *context, size_t instruction_index, const ast_node_t *statement)
+{
+    if (!context || !statement || statement->line_number == 0) {
+        return false;
+    }
+    
+    if (context->line_count > 0) {
+        codegen_line_t *last = &context->lines[context->line_count - 1];
+        if (last->instruction_index == instruction_index) {
+            last->line_number = statement->line_number;
+            last->statement = statement;
+            return true;
+        }
+        if (last->line_number == statement->line_number) {
+            return true;
+        }
+    }
+    
+    if (context->line_count >= context->line_capacity) {
+        size_t new_capacity = context->line_capacity == 0 ? 64 : context->line_capacity * 2;
+        codegen_line_t *new_lines = realloc(context->lines, new_capacity * sizeof(codegen_line_t));
+        if (!new_lines) {
+            return false;
+        }
+        context->lines = new_lines;
+        context->line_capacity = new_capacity;
+    }
+    
+    context->lines[context->line_count].instruction_index = instruction_index;
+    context->lines[context->line_count].line_number = statement->line_number;
+    context->lines[context->line_count].statement = statement;
+    context->line_count++;
+    return true;
+}
+
 // Unique class ID generation function
 uint64_t codegen_generate_unique_class_id(const char *module_name, const char *class_name)
 {
@@ -165,6 +311,63 @@ uint64_t codegen_generate_unique_class_id(const char *module_name, const char *c
     return hash;
 }
 
+// The module's own class of this name
+static const ast_node_t *codegen_find_local_class(const codegen_context_t *context, const char *class_name)
+{
+    const ast_node_t *root = context->parser_context ? context->parser_context->root : NULL;
+    if (!root || !class_name) {
+        return NULL;
+    }
+    
+    for (size_t i = 0; i < root->child_count; i++) {
+        const ast_node_t *child = root->children[i];
+        if (child->type == AST_CLASS && child->value && strcmp(child->value, class_name) == 0) {
+            return child;
+        }
+    }
+    return NULL;
+}
+
+uint64_t codegen_class_id(const codegen_context_t *context, const char *class_name)
+{
+    const char *module_name = context->parser_context && context->parser_context->root ? 
+                              context->parser_context->root->value : "UnknownModule";
+    
+    // A class of this module shadows an imported one of the same name
+    if (context->imports && !codegen_find_local_class(context, class_name)) {
+        const class_entry_t *imported = linker_imports_find_class(context->imports, class_name, NULL);
+        if (imported) {
+            return imported->class_id;
+        }
+    }
+    return codegen_generate_unique_class_id(module_name, class_name);
+}
+
+// Add a CLASS reference for every imported class the module instantiates,
+// in source order, so the VM can load the module that defines it on demand
+static bool codegen_collect_class_externs(codegen_context_t *context, const ast_node_t *node)
+{
+    if (!node) {
+        return true;
+    }
+    
+    if (node->type == AST_NEW_EXPR && node->value && !codegen_find_local_class(context, node->value)) {
+        size_t module = 0;
+        const class_entry_t *imported = linker_imports_find_class(context->imports, node->value, &module);
+        if (imported && !linker_imports_add_extern(context->imports, ARXMOD_EXTERN_CLASS, module,
+                                                   node->value, imported->class_id, NULL)) {
+            return false;
+        }
+    }
+    
+    for (size_t i = 0; i < node->child_count; i++) {
+        if (!codegen_collect_class_externs(context, node->children[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
 bool codegen_generate(codegen_context_t *context, ast_node_t *ast, 
                      instruction_t **instructions, size_t *instruction_count)
 {
@@ -246,6 +449,14 @@ bool codegen_write_arxmod(codegen_context_t *context, const char *filename,
                has_entry_point ? "EXECUTABLE" : "LIBRARY", module_flags);
     }
     
+    // A module with imports also writes an EXTERNS section
+    if (context->parser_context && context->parser_context->import_count > 0 &&
+        !arxmod_writer_reserve_sections(&writer, ARXMOD_MAX_SECTIONS)) {
+        printf("Error: Failed to reserve module sections\n");
+        arxmod_writer_cleanup(&writer);
+        return false;
+    }
+    
     // Write header
     if (!arxmod_writer_write_header(&writer, "ARXProgram", 10)) {
         printf("Error: Failed to write ARX module header\n");
@@ -291,9 +502,9 @@ bool codegen_write_arxmod(codegen_context_t *context, const char *filename,
                 return false;
             }
             
-            // Patch bytecode with resolved addresses
+            // Patch method call sites with their vtable slots
             if (!linker_patch_bytecode(&linker, instructions, instruction_count, 
-                                       (const char**)context->string_literals, context->string_literals_count)) {
+                                       context->method_calls, context->method_call_count, context->imports)) {
                 printf("Error: Failed to patch bytecode\n");
                 linker_cleanup(&linker);
                 if (classes) free(classes);
@@ -303,27 +514,11 @@ bool codegen_write_arxmod(codegen_context_t *context, const char *filename,
                 return false;
             }
             
-            // Update class manifest with correct method offsets
-            if (!linker_update_class_manifest(&linker, instructions, instruction_count)) {
-                printf("Error: Failed to update class manifest\n");
-                linker_cleanup(&linker);
-                if (classes) free(classes);
-                if (methods) free(methods);
-                if (fields) free(fields);
-                arxmod_writer_cleanup(&writer);
-                return false;
-            }
-            
             // Set entry point if this is an executable module
             if (has_entry_point) {
                 // Find the Main method offset from the linker's method list
-                uint64_t main_method_offset = 0;
-                for (size_t i = 0; i < linker.method_count; i++) {
-                    if (strcmp(linker.methods[i].method_name, "Main") == 0) {
-                        main_method_offset = linker.methods[i].offset;
-                        break;
-                    }
-                }
+                const method_entry_t *main_method = linker_find_method(&linker, "Main");
+                uint64_t main_method_offset = main_method ? main_method->offset : 0;
                 
                 if (main_method_offset != 0) {
                     if (!arxmod_writer_set_entry_point(&writer, main_method_offset)) {
@@ -431,11 +626,36 @@ bool codegen_write_arxmod(codegen_context_t *context, const char *filename,
         return false;
     }
     
-    if (!arxmod_writer_add_debug_section(&writer, NULL, 0)) {
+    // Line table; statements the optimizer emptied leave entries sharing an
+    // offset, and the last of those is the one in effect
+    debug_entry_t *debug_info = NULL;
+    size_t debug_count = 0;
+    if (context->line_count > 0) {
+        debug_info = calloc(context->line_count, sizeof(debug_entry_t));
+        if (!debug_info) {
+            printf("Error: Failed to allocate debug section\n");
+            arxmod_writer_cleanup(&writer);
+            return false;
+        }
+        for (size_t i = 0; i < context->line_count; i++) {
+            const codegen_line_t *entry = &context->lines[i];
+            if (entry->instruction_index >= instruction_count ||
+                (i + 1 < context->line_count && context->lines[i + 1].instruction_index == entry->instruction_index)) {
+                continue;
+            }
+            debug_info[debug_count].line_number = entry->line_number;
+            debug_info[debug_count].instruction_offset = entry->instruction_index;
+            debug_count++;
+        }
+    }
+    
+    if (!arxmod_writer_add_debug_section(&writer, debug_info, debug_count)) {
         printf("Error: Failed to add debug section\n");
+        free(debug_info);
         arxmod_writer_cleanup(&writer);
         return false;
     }
+    free(debug_info);
     
     // Add classes section
     class_entry_t *classes = NULL;
@@ -469,6 +689,23 @@ bool codegen_write_arxmod(codegen_context_t *context, const char *filename,
         free(fields);
     }
     
+    // References into imported modules; method calls were added by the linker
+    if (context->parser_context && context->parser_context->import_count > 0) {
+        if (context->imports && !codegen_collect_class_externs(context, context->parser_context->root)) {
+            printf("Error: Failed to collect external references\n");
+            arxmod_writer_cleanup(&writer);
+            return false;
+        }
+        
+        const external_ref_t *externs = context->imports ? context->imports->externs : NULL;
+        size_t extern_count = context->imports ? context->imports->extern_count : 0;
+        if (!arxmod_writer_add_externs_section(&writer, externs, extern_count)) {
+            printf("Error: Failed to add externs section\n");
+            arxmod_writer_cleanup(&writer);
+            return false;
+        }
+    }
+    
     if (!arxmod_writer_add_app_section(&writer, "ARXProgram", 10, NULL, 0)) {
         printf("Error: Failed to add app section\n");
         arxmod_writer_cleanup(&writer);
@@ -528,6 +765,17 @@ void codegen_cleanup(codegen_context_t *context)
             free(context->variable_addresses);
             context->variable_addresses = NULL;
         }
+        if (context->variable_locals != NULL) {
+            free(context->variable_locals);
+            context->variable_locals = NULL;
+        }
+        free(context->variable_types);
+        context->variable_types = NULL;
+        free(context->variable_elements);
+        context->variable_elements = NULL;
+        free(context->variable_strings);
+        context->variable_strings = NULL;
+        name_index_cleanup(&context->variable_index);
         
         // Cleanup method position tracking
         if (context->method_positions != NULL) {
@@ -535,10 +783,32 @@ void codegen_cleanup(codegen_context_t *context)
                 if (context->method_positions[i].method_name != NULL) {
                     free(context->method_positions[i].method_name);
                 }
+                free(context->method_positions[i].class_name);
             }
             free(context->method_positions);
             context->method_positions = NULL;
         }
+        name_index_cleanup(&context->method_position_index);
+        
+        if (context->owns_string_pool && context->string_pool != NULL) {
+            name_index_cleanup(&context->string_pool->index);
+            free(context->string_pool->pool_indices);
+            free(context->string_pool);
+        }
+        
+        // Cleanup method call sites
+        if (context->method_calls != NULL) {
+            for (size_t i = 0; i < context->method_call_count; i++) {
+                free(context->method_calls[i].method_name);
+            }
+            free(context->method_calls);
+            context->method_calls = NULL;
+        }
+        
+        free(context->lines);
+        context->lines = NULL;
+        
+        escape_info_free(&context->escape);
         
         memset(context, 0, sizeof(codegen_context_t));
     }
@@ -568,6 +838,8 @@ bool detect_entry_point(ast_node_t *root)
     return false; // No App.Main found
 }
 
+static bool generate_classes_parallel(codegen_context_t *context, ast_node_t **classes, size_t count);
+
 bool generate_module(codegen_context_t *context, ast_node_t *node)
 {
     if (context == NULL || node == NULL || node->type != AST_MODULE) {
@@ -581,11 +853,41 @@ bool generate_module(codegen_context_t *context, ast_node_t *node)
     // Generate a basic program structure
     emit_literal(context, 0); // Start with a literal
     
-    // Build each class separately with its own context
+    if (!codegen_index_string_pool(context)) {
+        return false;
+    }
+    
+    // Build each class separately with its own context; with -j the
+    // classes are built concurrently and merged in the same order
+    size_t class_count = 0;
     for (size_t i = 0; i < node->child_count; i++) {
         if (node->children[i]->type == AST_CLASS) {
-            if (!build_class_separately(context, node->children[i])) {
-                return false;
+            class_count++;
+        }
+    }
+    
+    if (context->jobs > 1 && class_count > 1) {
+        ast_node_t **classes = malloc(class_count * sizeof(ast_node_t*));
+        if (classes == NULL) {
+            return false;
+        }
+        size_t n = 0;
+        for (size_t i = 0; i < node->child_count; i++) {
+            if (node->children[i]->type == AST_CLASS) {
+                classes[n++] = node->children[i];
+            }
+        }
+        bool success = generate_classes_parallel(context, classes, class_count);
+        free(classes);
+        if (!success) {
+            return false;
+        }
+    } else {
+        for (size_t i = 0; i < node->child_count; i++) {
+            if (node->children[i]->type == AST_CLASS) {
+                if (!build_class_separately(context, node->children[i])) {
+                    return false;
+                }
             }
         }
     }
@@ -596,112 +898,267 @@ bool generate_module(codegen_context_t *context, ast_node_t *node)
     return true;
 }
 
-bool build_class_separately(codegen_context_t *context, ast_node_t *class_node)
+// Fresh context for one class, sharing the module's string pool index
+static void codegen_begin_class(codegen_context_t *class_context, const codegen_context_t *context, ast_node_t *class_node)
 {
-    if (context == NULL || class_node == NULL || class_node->type != AST_CLASS) {
-        return false;
-    }
+    codegen_init(class_context, context->parser_context);
+    class_context->string_pool = context->string_pool;
+    class_context->imports = context->imports;
+    
+    // Set the current class context
+    class_context->current_class = class_node;
+    class_context->current_class_name = class_node->value;
+}
+
+// Generate one class into a fresh context of its own. The class numbers its
+// globals from 0 and its labels from 1; codegen_merge_class() moves both
+// into the module's ranges. Nothing here touches shared state, so classes
+// can be built on worker threads. With a build cache, an unchanged class is
+// loaded instead of generated and a generated one is saved.
+static bool codegen_build_class(codegen_context_t *class_context, const codegen_context_t *context, ast_node_t *class_node)
+{
+    codegen_begin_class(class_context, context, class_node);
     
     if (debug_mode) {
-        printf("Building class separately: %s\n", class_node->value ? class_node->value : "unknown");
+        printf("Created separate context for class: %s\n", class_context->current_class_name ? class_context->current_class_name : "unknown");
     }
     
-    // Create a separate codegen context for this class
-    codegen_context_t class_context;
-    codegen_init(&class_context, context->parser_context);
-    
-    // Set the current class context
-    class_context.current_class = class_node;
-    class_context.current_class_name = class_node->value;
+    if (context->build_cache_dir == NULL) {
+        return generate_class(class_context, class_node);
+    }
     
-    if (debug_mode) {
-        printf("Created separate context for class: %s\n", class_context.current_class_name ? class_context.current_class_name : "unknown");
+    // An unchanged class is loaded from the build cache instead of generated
+    const char *module_name = context->parser_context && context->parser_context->root ? 
+                              context->parser_context->root->value : "UnknownModule";
+    size_t key_size = 0;
+    uint64_t fingerprint = build_cache_fingerprint(module_name, context->imports, class_node, &key_size);
+    if (build_cache_load(context->build_cache_dir, fingerprint, key_size, class_context)) {
+        class_context->class_reused = true;
+        return true;
     }
     
-    // Generate code for this class using its own context
-    if (!generate_class(&class_context, class_node)) {
-        codegen_cleanup(&class_context);
+    // Start over from whatever part of the entry was read
+    codegen_cleanup(class_context);
+    codegen_begin_class(class_context, context, class_node);
+    if (!generate_class(class_context, class_node)) {
         return false;
     }
-    
-    // Merge the class bytecode into the main context
+    build_cache_store(context->build_cache_dir, fingerprint, key_size, class_context);
+    return true;
+}
+
+// Append a built class to the module: instructions move by the current
+// instruction count, global addresses (LOD/STO at level 1) by the globals
+// earlier classes claimed, and label IDs by the labels issued so far.
+// Classes are merged in source order, so the result does not depend on
+// which worker built what.
+static bool codegen_merge_class(codegen_context_t *context, codegen_context_t *class_context)
+{
     if (debug_mode) {
         printf("Merging %zu instructions from class %s into main context\n", 
-               class_context.instruction_count, class_context.current_class_name ? class_context.current_class_name : "unknown");
+               class_context->instruction_count, class_context->current_class_name ? class_context->current_class_name : "unknown");
     }
     
     // Store the current instruction count as the base offset for this class
     size_t class_base_offset = context->instruction_count;
+    size_t global_base = context->next_variable_address;
+    size_t label_base = context->label_counter;
     
     // Append class instructions to main context
-    for (size_t i = 0; i < class_context.instruction_count; i++) {
-        emit_instruction(context, class_context.instructions[i].opcode, 
-                        0, // level is encoded in opcode upper nibble
-                        class_context.instructions[i].opt64);
+    for (size_t i = 0; i < class_context->instruction_count; i++) {
+        const instruction_t *instr = &class_context->instructions[i];
+        uint8_t op = instr->opcode & 0x0F;
+        uint8_t level = (instr->opcode >> 4) & 0x0F;
+        uint64_t operand = instr->opt64;
+        if ((op == VM_LOD || op == VM_STO) && level == 1) {
+            operand += global_base;
+        } else if (op == VM_JMP || op == VM_JPC) {
+            operand += label_base;
+        }
+        emit_instruction(context, instr->opcode, 0, operand); // level is encoded in opcode upper nibble
+    }
+    context->next_variable_address += class_context->next_variable_address;
+    context->label_counter += class_context->label_counter;
+    
+    if (context->build_cache_dir != NULL) {
+        const char *class_name = class_context->current_class_name ? class_context->current_class_name : "unknown";
+        if (class_context->class_reused) {
+            context->classes_reused++;
+            printf("Build cache: reused  %s\n", class_name);
+        } else {
+            context->classes_rebuilt++;
+            printf("Build cache: rebuilt %s\n", class_name);
+        }
     }
     
     // Merge method positions from class context to main context
     if (debug_mode) {
         printf("Merging %zu method positions from class %s into main context\n", 
-               class_context.method_position_count, class_context.current_class_name ? class_context.current_class_name : "unknown");
+               class_context->method_position_count, class_context->current_class_name ? class_context->current_class_name : "unknown");
     }
     
-    for (size_t i = 0; i < class_context.method_position_count; i++) {
-        // Expand method positions array if needed
-        if (context->method_position_count >= context->method_position_capacity) {
-            size_t new_capacity = context->method_position_capacity == 0 ? 8 : context->method_position_capacity * 2;
-            void *new_positions = realloc(context->method_positions, new_capacity * sizeof(*context->method_positions));
-            if (!new_positions) {
-                codegen_cleanup(&class_context);
-                return false;
-            }
-            context->method_positions = new_positions;
-            context->method_position_capacity = new_capacity;
-        }
-        
+    for (size_t i = 0; i < class_context->method_position_count; i++) {
         // Add method position with adjusted offset
-        size_t index = context->method_position_count;
-        context->method_positions[index].method_name = strdup(class_context.method_positions[i].method_name);
-        context->method_positions[index].start_instruction = class_base_offset + class_context.method_positions[i].start_instruction;
-        context->method_positions[index].end_instruction = class_base_offset + class_context.method_positions[i].end_instruction;
-        context->method_position_count++;
+        if (!codegen_add_method_position(context, class_context->method_positions[i].class_name,
+                                         class_context->method_positions[i].method_name,
+                                         class_base_offset + class_context->method_positions[i].start_instruction,
+                                         class_base_offset + class_context->method_positions[i].end_instruction)) {
+            return false;
+        }
         
         if (debug_mode) {
             printf("Merged method '%s' at offset %zu (adjusted from %zu)\n", 
-                   class_context.method_positions[i].method_name, 
-                   context->method_positions[index].start_instruction,
-                   class_context.method_positions[i].start_instruction);
+                   class_context->method_positions[i].method_name, 
+                   context->method_positions[context->method_position_count - 1].start_instruction,
+                   class_context->method_positions[i].start_instruction);
+        }
+    }
+    
+    // Merge method call sites, rebased like the method positions
+    for (size_t i = 0; i < class_context->method_call_count; i++) {
+        if (!codegen_add_method_call(context, class_base_offset + class_context->method_calls[i].instruction_index,
+                                     class_context->method_calls[i].method_name,
+                                     class_context->method_calls[i].receiver_class_id)) {
+            return false;
+        }
+    }
+    
+    // Merge the line table, rebased like the method positions
+    for (size_t i = 0; i < class_context->line_count; i++) {
+        if (!codegen_add_line(context, class_base_offset + class_context->lines[i].instruction_index,
+                              class_context->lines[i].statement)) {
+            return false;
         }
     }
     
     // Merge labels from class context to main context
     if (debug_mode) {
         printf("Merging %zu labels from class %s into main context\n", 
-               class_context.label_table_size, class_context.current_class_name ? class_context.current_class_name : "unknown");
+               class_context->label_table_size, class_context->current_class_name ? class_context->current_class_name : "unknown");
     }
     
-    for (size_t i = 0; i < class_context.label_table_size; i++) {
+    for (size_t i = 0; i < class_context->label_table_size; i++) {
         // Add label to main context
         if (context->label_table_size >= context->label_table_capacity) {
             size_t new_capacity = context->label_table_capacity == 0 ? 16 : context->label_table_capacity * 2;
             label_entry_t *new_table = realloc(context->label_table, new_capacity * sizeof(label_entry_t));
             if (!new_table) {
-                codegen_cleanup(&class_context);
                 return false;
             }
             context->label_table = new_table;
             context->label_table_capacity = new_capacity;
         }
         
-        context->label_table[context->label_table_size] = class_context.label_table[i];
+        context->label_table[context->label_table_size] = class_context->label_table[i];
+        context->label_table[context->label_table_size].label_id += label_base;
         context->label_table[context->label_table_size].instruction_index += class_base_offset;
         context->label_table_size++;
     }
     
+    return true;
+}
+
+bool build_class_separately(codegen_context_t *context, ast_node_t *class_node)
+{
+    if (context == NULL || class_node == NULL || class_node->type != AST_CLASS) {
+        return false;
+    }
+    
+    if (debug_mode) {
+        printf("Building class separately: %s\n", class_node->value ? class_node->value : "unknown");
+    }
+    
+    // Create a separate codegen context for this class
+    codegen_context_t class_context;
+    bool success = codegen_build_class(&class_context, context, class_node) &&
+                   codegen_merge_class(context, &class_context);
+    
     // Clean up the class context
     codegen_cleanup(&class_context);
     
-    return true;
+    return success;
+}
+
+// Classes still to be built by the -j workers
+typedef struct {
+    const codegen_context_t *context; // Module being generated; read-only while workers run
+    ast_node_t **classes;
+    codegen_context_t *units;       // One context per class, in source order
+    bool *built;
+    size_t count;
+    size_t next;                    // Next class to hand out
+    pthread_mutex_t lock;
+} codegen_class_queue_t;
+
+static void *codegen_class_worker(void *arg)
+{
+    codegen_class_queue_t *queue = arg;
+    
+    for (;;) {
+        pthread_mutex_lock(&queue->lock);
+        size_t i = queue->next++;
+        pthread_mutex_unlock(&queue->lock);
+        if (i >= queue->count) {
+            break;
+        }
+        queue->built[i] = codegen_build_class(&queue->units[i], queue->context, queue->classes[i]);
+    }
+    
+    return NULL;
+}
+
+// Build the classes on up to context->jobs threads (the calling thread is
+// one of them), then merge them in source order. The module comes out
+// identical to a sequential build.
+static bool generate_classes_parallel(codegen_context_t *context, ast_node_t **classes, size_t count)
+{
+    codegen_class_queue_t queue;
+    queue.context = context;
+    queue.classes = classes;
+    queue.units = calloc(count, sizeof(codegen_context_t));
+    queue.built = calloc(count, sizeof(bool));
+    queue.count = count;
+    queue.next = 0;
+    
+    size_t thread_count = context->jobs < count ? context->jobs : count;
+    pthread_t *threads = calloc(thread_count, sizeof(pthread_t));
+    if (queue.units == NULL || queue.built == NULL || threads == NULL) {
+        free(queue.units);
+        free(queue.built);
+        free(threads);
+        return false;
+    }
+    pthread_mutex_init(&queue.lock, NULL);
+    
+    // Workers that fail to start just leave more classes to the others
+    size_t started = 0;
+    for (size_t t = 1; t < thread_count; t++) {
+        if (pthread_create(&threads[started], NULL, codegen_class_worker, &queue) == 0) {
+            started++;
+        }
+    }
+    codegen_class_worker(&queue);
+    for (size_t t = 0; t < started; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    pthread_mutex_destroy(&queue.lock);
+    
+    if (debug_mode) {
+        printf("Built %zu classes on %zu threads\n", count, started + 1);
+    }
+    
+    bool success = true;
+    for (size_t i = 0; i < count; i++) {
+        if (success && !(queue.built[i] && codegen_merge_class(context, &queue.units[i]))) {
+            success = false;
+        }
+        codegen_cleanup(&queue.units[i]);
+    }
+    
+    free(queue.units);
+    free(queue.built);
+    free(threads);
+    return success;
 }
 
 bool generate_class(codegen_context_t *context, ast_node_t *node)
@@ -714,16 +1171,32 @@ bool generate_class(codegen_context_t *context, ast_node_t *node)
         printf("Generating code for class: %s\n", node->value ? node->value : "unknown");
     }
     
-    // Generate code for each field and method in the class
+    // Fields live in global memory; register them before the methods so a
+    // method-local declaration cannot claim the name first
     for (size_t i = 0; i < node->child_count; i++) {
         ast_node_t *child = node->children[i];
+        size_t field_address;
         
-        if (child->type == AST_FIELD) {
+        if (child->type == AST_FIELD && child->value != NULL) {
             // Field handling - fields are accessible only within class methods
             if (debug_mode) {
-                printf("Found field: %s\n", child->value ? child->value : "unknown");
+                printf("Found field: %s\n", child->value);
+            }
+            if (!codegen_add_variable(context, child->value, NULL, &field_address)) {
+                return false;
             }
-        } else if (child->type == AST_METHOD || child->type == AST_PROCEDURE || child->type == AST_FUNCTION) {
+            codegen_set_variable_type(context, child->value, child->data_type);
+            codegen_set_variable_string(context, child->value, child->child_count > 0 &&
+                                        child->children[0]->value != NULL &&
+                                        strcmp(child->children[0]->value, "string") == 0);
+        }
+    }
+    
+    // Generate code for each method in the class
+    for (size_t i = 0; i < node->child_count; i++) {
+        ast_node_t *child = node->children[i];
+        
+        if (child->type == AST_METHOD || child->type == AST_PROCEDURE || child->type == AST_FUNCTION) {
             if (!generate_method(context, child)) {
                 return false;
             }
@@ -750,6 +1223,27 @@ bool generate_field(codegen_context_t *context, ast_node_t *node)
     return true;
 }
 
+// Free the objects of the frame variables declared so far, except the one
+// called keep (may be NULL); emitted before every return of the method
+static void emit_frame_releases_except(codegen_context_t *context, const char *keep)
+{
+    for (size_t i = 0; i < context->escape.count; i++) {
+        size_t address;
+        if (keep != NULL && strcmp(context->escape.variables[i].name, keep) == 0) {
+            continue;
+        }
+        if (codegen_frame_variable(context, context->escape.variables[i].name, &address)) {
+            emit_instruction(context, VM_LOD, 0, address);
+            emit_instruction(context, VM_OPR, 0, OPR_OBJ_RELEASE);
+        }
+    }
+}
+
+static void emit_frame_releases(codegen_context_t *context)
+{
+    emit_frame_releases_except(context, NULL);
+}
+
 bool generate_method(codegen_context_t *context, ast_node_t *node)
 {
     if (context == NULL || node == NULL) {
@@ -782,7 +1276,28 @@ bool generate_method(codegen_context_t *context, ast_node_t *node)
         printf("Generating code for method: %s\n", node->value ? node->value : "unknown");
     }
     
-    // Generate code for the method's body
+    // The method runs in its own activation record; INT reserves its
+    // locals and is patched once the body has declared them all
+    size_t first_variable = context->variable_count;
+    size_t int_index = context->instruction_count;
+    context->in_method = true;
+    context->frame_size = 0;
+    context->return_type = node->data_type;
+    codegen_add_line(context, int_index, node);
+    emit_instruction(context, VM_INT, 0, 0);
+    
+    // Objects that never leave the method are tied to its activation
+    // record: reused when their NEW runs again, freed when it returns.
+    // Without the analysis every object is an ordinary heap object.
+    if (!escape_analyze_method(node, &context->escape) && debug_mode) {
+        printf("Escape analysis of method '%s' ran out of memory\n", node->value ? node->value : "unknown");
+    }
+    if (debug_mode) {
+        printf("Method '%s': %zu frame object variables\n", node->value ? node->value : "unknown",
+               escape_frame_variable_count(&context->escape));
+    }
+    
+    // Generate code for the method's body
     for (size_t i = 0; i < node->child_count; i++) {
         if (debug_mode) {
             printf("Processing method child %zu, type: %d\n", i, node->children[i]->type);
@@ -790,6 +1305,35 @@ bool generate_method(codegen_context_t *context, ast_node_t *node)
         generate_ast_code(context, node->children[i]);
     }
     
+    emit_frame_releases(context);
+    emit_instruction(context, VM_OPR, 0, OPR_RET);
+    if (context->instructions != NULL && int_index < context->instruction_count) {
+        context->instructions[int_index].opt64 = context->frame_size;
+    }
+    
+    // Locals go out of scope; globals first seen in the body stay
+    size_t kept = first_variable;
+    name_index_truncate(&context->variable_index, first_variable);
+    for (size_t i = first_variable; i < context->variable_count; i++) {
+        if (context->variable_locals[i]) {
+            free(context->variable_names[i]);
+            continue;
+        }
+        context->variable_names[kept] = context->variable_names[i];
+        context->variable_addresses[kept] = context->variable_addresses[i];
+        context->variable_locals[kept] = false;
+        context->variable_types[kept] = context->variable_types[i];
+        context->variable_elements[kept] = context->variable_elements[i];
+        context->variable_strings[kept] = context->variable_strings[i];
+        // Cannot fail: the index already held this many entries
+        name_index_push(&context->variable_index, name_index_hash(context->variable_names[kept]));
+        kept++;
+    }
+    context->variable_count = kept;
+    context->in_method = false;
+    context->return_type = TYPE_NONE;
+    context->escape.count = 0;
+    
     // End tracking method position after generating method bytecode
     if (node->value) {
         codegen_end_method_tracking(context, node->value);
@@ -1301,10 +1845,8 @@ bool generate_new_expression(codegen_context_t *context, ast_node_t *node)
         printf("Generating NEW expression for class: %s\n", class_name);
     }
     
-    // Generate unique class ID based on module and class names
-    const char *module_name = context->parser_context && context->parser_context->root ? 
-                              context->parser_context->root->value : "UnknownModule";
-    uint64_t class_id = codegen_generate_unique_class_id(module_name, class_name);
+    // Class ID of the module's own class or of the imported one
+    uint64_t class_id = codegen_class_id(context, class_name);
     
     // Check for constructor parameters
     int param_count = 0;
@@ -1520,6 +2062,9 @@ bool generate_while_statement(codegen_context_t *context, ast_node_t *node)
         }
     }
     
+    // The back jump belongs to the loop, not to the body's last statement
+    codegen_add_line(context, context->instruction_count, node);
+    
     // Jump back to condition check
     emit_jump(context, loop_start_label);
     if (debug_mode) {
@@ -1539,6 +2084,8 @@ bool generate_while_statement(codegen_context_t *context, ast_node_t *node)
     return true;
 }
 
+static bool generate_tail_call(codegen_context_t *context, ast_node_t *value, bool convert);
+
 bool generate_return_statement(codegen_context_t *context, ast_node_t *node)
 {
     if (context == NULL || node == NULL || node->type != AST_RETURN_STMT) {
@@ -1557,6 +2104,11 @@ bool generate_return_statement(codegen_context_t *context, ast_node_t *node)
                 printf("Generating bytecode for return expression\n");
             }
             
+            // A method call is returned through a tail call when it can be
+            if (generate_tail_call(context, return_expr, false)) {
+                return true;
+            }
+            
             // Generate bytecode for the return expression
             if (!generate_expression(context, return_expr)) {
                 printf("Error: Failed to generate bytecode for return expression\n");
@@ -1566,6 +2118,7 @@ bool generate_return_statement(codegen_context_t *context, ast_node_t *node)
     }
     
     // Generate return operation
+    emit_frame_releases(context);
     emit_operation(context, OPR_RET, 0, 0);
     
     return true;
@@ -1615,10 +2168,82 @@ void emit_operation(codegen_context_t *context, opr_t operation, uint8_t level,
 }
 
 // AST-based code generation
+static primitive_type_t codegen_expression_type(const codegen_context_t *context, const ast_node_t *node);
+static void generate_expression_as(codegen_context_t *context, ast_node_t *node, primitive_type_t type);
+static void generate_method_call_in(codegen_context_t *context, ast_node_t *node, bool spawn);
+static uint64_t codegen_array_kind(primitive_type_t element);
+static void emit_array_load(codegen_context_t *context, const char *name);
+static void generate_element_assignment_ast(codegen_context_t *context, ast_node_t *node);
+static void generate_array_method(codegen_context_t *context, ast_node_t *node, const char *array, const char *method);
+static void generate_string_method(codegen_context_t *context, ast_node_t *node, const char *string, const char *method);
+
+// "return receiver.method()" in a method, emitted with its return. The call
+// becomes a tail call (VM_CALS at level 1): the callee takes over the
+// method's activation record and returns straight to its caller, so
+// recursion through such calls runs in constant space. The frame variables
+// other than the receiver are released before the call; the VM releases a
+// receiver frame object itself once it has found the method. When the
+// result is converted after the call, the return is completed normally.
+// False, with nothing emitted, when value is not a call of an object method.
+static bool generate_tail_call(codegen_context_t *context, ast_node_t *value, bool convert)
+{
+    if (!context->in_method || value == NULL || value->type != AST_METHOD_CALL || value->value == NULL) {
+        return false;
+    }
+    const char *dot = strrchr(value->value, '.');
+    if (dot == NULL) {
+        return false;
+    }
+    size_t receiver_length = (size_t)(dot - value->value);
+    char *receiver = malloc(receiver_length + 1);
+    if (receiver == NULL) {
+        return false;
+    }
+    memcpy(receiver, value->value, receiver_length);
+    receiver[receiver_length] = '\0';
+    
+    // Array and string methods evaluate arguments, which may call methods
+    // on the frame variables released here
+    if (codegen_variable_element(context, receiver) != TYPE_NONE || codegen_variable_is_string(context, receiver)) {
+        free(receiver);
+        return false;
+    }
+    
+    emit_frame_releases_except(context, receiver);
+    size_t call_count = context->method_call_count;
+    if (convert) {
+        generate_expression_as(context, value, context->return_type);
+    } else {
+        generate_expression(context, value);
+    }
+    
+    size_t last = context->instruction_count - 1;
+    if (context->instruction_count > 0 && context->method_call_count == call_count + 1 &&
+        context->method_calls[call_count].instruction_index == last &&
+        (context->instructions[last].opcode & 0x0F) == VM_CALS) {
+        context->instructions[last].opcode = (uint8_t)((1 << 4) | VM_CALS);
+    } else {
+        size_t address;
+        if (codegen_frame_variable(context, receiver, &address)) {
+            emit_instruction(context, VM_LOD, 0, address);
+            emit_instruction(context, VM_OPR, 0, OPR_OBJ_RELEASE);
+        }
+    }
+    free(receiver);
+    
+    // Reached only when the tail call had no record to take over
+    emit_instruction(context, VM_OPR, 0, OPR_RET);
+    return true;
+}
+
 void generate_ast_code(codegen_context_t *context, ast_node_t *node)
 {
     if (!node) return;
     
+    if (node->line_number != 0) {
+        codegen_add_line(context, context->instruction_count, node);
+    }
+    
     if (debug_mode) {
         printf("Generating code for AST node type: %d", node->type);
         if (node->type == AST_IF_STMT) {
@@ -1667,9 +2292,14 @@ void generate_ast_code(codegen_context_t *context, ast_node_t *node)
             break;
             
         case AST_VAR_DECL:
+        case AST_ARRAY_DECL:
             generate_variable_declaration_ast(context, node);
             break;
             
+        case AST_INDEX_ASSIGNMENT:
+            generate_element_assignment_ast(context, node);
+            break;
+            
         case AST_FOR_STMT:
             generate_for_statement(context, node);
             break;
@@ -1706,6 +2336,9 @@ void generate_ast_code(codegen_context_t *context, ast_node_t *node)
                     }
                 
                 // Output whatever the expression pushed onto the stack
+                    if (codegen_expression_type(context, node->children[0]) == TYPE_REAL) {
+                        emit_instruction(context, VM_OPR, 0, OPR_REAL_TO_STR);
+                    }
                     emit_instruction(context, VM_OPR, 0, OPR_OUTSTRING);
                     emit_instruction(context, VM_OPR, 0, OPR_WRITELN);
             }
@@ -1724,14 +2357,22 @@ void generate_ast_code(codegen_context_t *context, ast_node_t *node)
             if (debug_mode) {
                 printf("AST_RETURN_STMT: processing return statement\n");
             }
+            if (node->child_count > 0 && generate_tail_call(context, node->children[0], true)) {
+                break;
+            }
             if (node->child_count > 0) {
                 // Generate code for the return expression
-                generate_expression_ast(context, node->children[0]);
+                generate_expression_as(context, node->children[0], context->return_type);
             }
             // Emit return instruction
+            emit_frame_releases(context);
             emit_instruction(context, VM_OPR, 0, OPR_RET);
             break;
             
+        case AST_YIELD_STMT:
+            emit_instruction(context, VM_OPR, 0, OPR_TASK_YIELD);
+            break;
+            
         default:
             if (debug_mode) {
                 printf("Unhandled AST node type: %d\n", node->type);
@@ -1750,9 +2391,17 @@ void generate_variable_declaration_ast(codegen_context_t *context, ast_node_t *n
         printf("Generating variable declaration: %s\n", var_node->value);
     }
     
-    // Add variable to symbol table
+    // Add variable to symbol table; inside a method it is a local of the
+    // method's activation record
     size_t var_address;
-    if (codegen_add_variable(context, var_node->value, &var_address)) {
+    bool added = context->in_method ?
+        codegen_add_local_variable(context, var_node->value, &var_address) :
+        codegen_add_variable(context, var_node->value, NULL, &var_address);
+    if (added) {
+        bool is_array = node->type == AST_ARRAY_DECL;
+        codegen_set_variable_type(context, var_node->value, is_array ? TYPE_NONE : var_node->data_type);
+        codegen_set_variable_element(context, var_node->value, is_array ? var_node->data_type : TYPE_NONE);
+        codegen_set_variable_string(context, var_node->value, node->value != NULL && strcmp(node->value, "string") == 0);
         if (debug_mode) {
             printf("Added variable '%s' to symbol table at address %zu\n", var_node->value, var_address);
         }
@@ -1770,16 +2419,30 @@ void generate_assignment_ast(codegen_context_t *context, ast_node_t *node)
         printf("Generating assignment: %s := expression\n", var_node->value);
     }
     
-    // Generate code for the expression (this will push the result onto the stack)
-    generate_expression_ast(context, expr_node);
+    // A NEW into a frame variable hands the variable's previous object to
+    // OPR_OBJ_NEW_FRAME, which reuses it or frees it
+    size_t frame_address;
+    if (expr_node->type == AST_NEW_EXPR && expr_node->value != NULL &&
+        codegen_frame_variable(context, var_node->value, &frame_address)) {
+        emit_instruction(context, VM_LOD, 0, frame_address);
+        emit_instruction(context, VM_LIT, 0, codegen_class_id(context, expr_node->value));
+        emit_instruction(context, VM_OPR, 0, OPR_OBJ_NEW_FRAME);
+        emit_instruction(context, VM_STO, 0, frame_address);
+        return;
+    }
+    
+    // Generate code for the expression (this will push the result onto the
+    // stack) converted to the variable's declared type
+    generate_expression_as(context, expr_node, codegen_variable_type(context, var_node->value));
     
     // Store the result to the variable
+    uint8_t var_level;
     size_t var_address;
-    if (codegen_add_variable(context, var_node->value, &var_address)) {
+    if (codegen_add_variable(context, var_node->value, &var_level, &var_address)) {
         if (debug_mode) {
-            printf("Storing to variable '%s' at address %zu\n", var_node->value, var_address);
+            printf("Storing to variable '%s' at level %u address %zu\n", var_node->value, var_level, var_address);
         }
-        emit_instruction(context, VM_STO, 0, var_address);
+        emit_instruction(context, VM_STO, var_level, var_address);
     } else {
         if (debug_mode) {
             printf("Warning: Failed to add/find variable '%s' for assignment\n", var_node->value);
@@ -1824,6 +2487,36 @@ void generate_expression_ast(codegen_context_t *context, ast_node_t *node)
             generate_new_expression_ast(context, node);
             break;
             
+        case AST_SPAWN_EXPR:
+            // The parser only accepts object.method() here
+            if (node->child_count > 0) {
+                generate_method_call_in(context, node->children[0], true);
+            }
+            break;
+            
+        case AST_JOIN_EXPR:
+            if (node->child_count > 0) {
+                generate_expression_ast(context, node->children[0]);
+                emit_instruction(context, VM_OPR, 0, OPR_TASK_JOIN);
+            }
+            break;
+            
+        case AST_NEW_ARRAY:
+            if (node->child_count > 0) {
+                generate_expression_as(context, node->children[0], TYPE_INTEGER);
+                emit_instruction(context, VM_LIT, 0, codegen_array_kind(node->data_type));
+                emit_instruction(context, VM_OPR, 0, OPR_ARRAY_NEW);
+            }
+            break;
+            
+        case AST_INDEX:
+            if (node->child_count > 0) {
+                emit_array_load(context, node->value);
+                generate_expression_as(context, node->children[0], TYPE_INTEGER);
+                emit_instruction(context, VM_OPR, 0, OPR_ARRAY_LOAD);
+            }
+            break;
+            
         default:
             if (debug_mode) {
                 printf("Unhandled expression AST node type: %d\n", node->type);
@@ -1842,10 +2535,8 @@ void generate_new_expression_ast(codegen_context_t *context, ast_node_t *node)
         printf("Generating NEW expression AST for class: %s\n", class_name);
     }
     
-    // Generate unique class ID based on module and class names
-    const char *module_name = context->parser_context && context->parser_context->root ? 
-                              context->parser_context->root->value : "UnknownModule";
-    uint64_t class_id = codegen_generate_unique_class_id(module_name, class_name);
+    // Class ID of the module's own class or of the imported one
+    uint64_t class_id = codegen_class_id(context, class_name);
     
     // Emit NEW instruction
     emit_instruction(context, VM_LIT, 0, class_id);
@@ -1857,6 +2548,70 @@ void generate_new_expression_ast(codegen_context_t *context, ast_node_t *node)
     }
 }
 
+bool codegen_index_string_pool(codegen_context_t *context)
+{
+    if (context == NULL || context->string_pool != NULL || context->parser_context == NULL) {
+        return context != NULL;
+    }
+    
+    codegen_string_pool_t *pool = calloc(1, sizeof(codegen_string_pool_t));
+    if (pool == NULL) {
+        return false;
+    }
+    name_index_init(&pool->index);
+    context->string_pool = pool;
+    context->owns_string_pool = true;
+    
+    char **strings = context->parser_context->method_string_literals;
+    size_t count = strings != NULL ? context->parser_context->method_string_count : 0;
+    pool->pool_indices = malloc((count > 0 ? count : 1) * sizeof(size_t));
+    if (pool->pool_indices == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        size_t existing;
+        if (strings[i] == NULL || codegen_find_string_literal(context, strings[i], &existing)) {
+            continue;
+        }
+        pool->pool_indices[pool->index.count] = i;
+        if (!name_index_push(&pool->index, name_index_hash(strings[i]))) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+// First index of text in the module's string pool
+bool codegen_find_string_literal(const codegen_context_t *context, const char *text, size_t *index)
+{
+    if (context == NULL || text == NULL || context->parser_context == NULL ||
+        context->parser_context->method_string_literals == NULL) {
+        return false;
+    }
+    
+    char **strings = context->parser_context->method_string_literals;
+    if (context->string_pool != NULL) {
+        const codegen_string_pool_t *pool = context->string_pool;
+        for (size_t i = name_index_first(&pool->index, name_index_hash(text)); i != NAME_INDEX_NONE;
+             i = name_index_next(&pool->index, i)) {
+            if (strcmp(strings[pool->pool_indices[i]], text) == 0) {
+                *index = pool->pool_indices[i];
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    for (size_t i = 0; i < context->parser_context->method_string_count; i++) {
+        if (strings[i] != NULL && strcmp(strings[i], text) == 0) {
+            *index = i;
+            return true;
+        }
+    }
+    return false;
+}
+
 void generate_literal_ast(codegen_context_t *context, ast_node_t *node)
 {
     if (!node) return;
@@ -1865,16 +2620,7 @@ void generate_literal_ast(codegen_context_t *context, ast_node_t *node)
     if (node->value) {
         // String literal - find the correct string index in the string table
         size_t string_index = 0;
-        if (context->parser_context && context->parser_context->method_string_literals) {
-            // Find the string in the collected string literals
-            for (size_t i = 0; i < context->parser_context->method_string_count; i++) {
-                if (context->parser_context->method_string_literals[i] && 
-                    strcmp(context->parser_context->method_string_literals[i], node->value) == 0) {
-                    string_index = i;
-                    break;
-                }
-            }
-        }
+        codegen_find_string_literal(context, node->value, &string_index);
         
         if (debug_mode) {
             printf("Loading string literal '%s' at index %zu\n", node->value, string_index);
@@ -1893,9 +2639,10 @@ void generate_identifier_ast(codegen_context_t *context, ast_node_t *node)
     
     
     // Load variable value from memory
+    uint8_t var_level;
     size_t var_address;
-    if (codegen_find_variable(context, node->value, &var_address)) {
-        emit_instruction(context, VM_LOD, 0, var_address);
+    if (codegen_find_variable(context, node->value, &var_level, &var_address)) {
+        emit_instruction(context, VM_LOD, var_level, var_address);
     } else {
         if (debug_mode) {
             printf("Warning: Variable '%s' not found in symbol table\n", node->value);
@@ -1916,6 +2663,258 @@ static bool ast_contains_string_literal(ast_node_t *node)
     return false;
 }
 
+// A '+' node is string concatenation if either subtree contains a string literal
+static bool ast_is_string_concatenation(ast_node_t *node)
+{
+    return node && node->type == AST_BINARY_OP && node->child_count >= 2 &&
+           node->value && strcmp(node->value, "+") == 0 &&
+           (ast_contains_string_literal(node->children[0]) ||
+            ast_contains_string_literal(node->children[1]));
+}
+
+// IEEE double bit pattern, which is how real values travel in VM words
+static uint64_t codegen_real_bits(double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+// Element type of the array variable a call like a.length() is on, with
+// method set to the method's name; TYPE_NONE for other calls
+static primitive_type_t codegen_call_array_element(const codegen_context_t *context, const ast_node_t *node,
+                                                   const char **method)
+{
+    const char *dot = node->type == AST_METHOD_CALL && node->value ? strrchr(node->value, '.') : NULL;
+    char array[256];
+    size_t length = dot != NULL ? (size_t)(dot - node->value) : 0;
+    if (dot == NULL || length >= sizeof(array)) {
+        return TYPE_NONE;
+    }
+    memcpy(array, node->value, length);
+    array[length] = '\0';
+    *method = dot + 1;
+    return codegen_variable_element(context, array);
+}
+
+// Whether a call like s.length() is on a string variable, with method set
+// to the method's name
+static bool codegen_call_on_string(const codegen_context_t *context, const ast_node_t *node, const char **method)
+{
+    const char *dot = node->type == AST_METHOD_CALL && node->value ? strrchr(node->value, '.') : NULL;
+    char string[256];
+    size_t length = dot != NULL ? (size_t)(dot - node->value) : 0;
+    if (dot == NULL || length >= sizeof(string)) {
+        return false;
+    }
+    memcpy(string, node->value, length);
+    string[length] = '\0';
+    *method = dot + 1;
+    return codegen_variable_is_string(context, string);
+}
+
+// Whether an expression is known to give a string object: string literals,
+// concatenations, string variables and slices of them
+static bool codegen_is_string_expression(const codegen_context_t *context, const ast_node_t *node)
+{
+    const char *method;
+    if (node == NULL) {
+        return false;
+    }
+    switch (node->type) {
+        case AST_LITERAL:
+            return node->value != NULL;
+        case AST_BINARY_OP:
+            return ast_is_string_concatenation((ast_node_t *)node);
+        case AST_IDENTIFIER:
+            return codegen_variable_is_string(context, node->value);
+        case AST_METHOD_CALL:
+            return codegen_call_on_string(context, node, &method) && strcmp(method, "slice") == 0;
+        default:
+            return false;
+    }
+}
+
+// Static type of an expression as far as declarations tell. TYPE_NONE marks
+// words of unknown type (strings, objects, method results, undeclared
+// names), which every operation uses as they are.
+static primitive_type_t codegen_expression_type(const codegen_context_t *context, const ast_node_t *node)
+{
+    if (node == NULL) {
+        return TYPE_NONE;
+    }
+    
+    switch (node->type) {
+        case AST_LITERAL:
+            if (node->value) {
+                return TYPE_NONE;
+            }
+            return node->data_type == TYPE_REAL ? TYPE_REAL : TYPE_INTEGER;
+            
+        case AST_IDENTIFIER:
+            return codegen_variable_type(context, node->value);
+            
+        case AST_UNARY_OP:
+            if (node->child_count < 1 || node->value == NULL) {
+                return TYPE_NONE;
+            }
+            if (strcmp(node->value, "!") == 0) {
+                return TYPE_BOOLEAN;
+            }
+            return codegen_expression_type(context, node->children[0]);
+            
+        case AST_BINARY_OP:
+            {
+                if (node->child_count < 2 || node->value == NULL || ast_is_string_concatenation((ast_node_t *)node)) {
+                    return TYPE_NONE;
+                }
+                const char *op = node->value;
+                if (strcmp(op, "==") == 0 || strcmp(op, "!=") == 0 || strcmp(op, "<") == 0 ||
+                    strcmp(op, "<=") == 0 || strcmp(op, ">") == 0 || strcmp(op, ">=") == 0 ||
+                    strcmp(op, "&&") == 0 || strcmp(op, "||") == 0) {
+                    return TYPE_BOOLEAN;
+                }
+                if (strcmp(op, "%") != 0 && strcmp(op, "^") != 0 &&
+                    (codegen_expression_type(context, node->children[0]) == TYPE_REAL ||
+                     codegen_expression_type(context, node->children[1]) == TYPE_REAL)) {
+                    return TYPE_REAL;
+                }
+                return TYPE_INTEGER;
+            }
+            
+        case AST_INDEX:
+            return codegen_variable_element(context, node->value);
+            
+        case AST_METHOD_CALL:
+            {
+                // Built-in methods of arrays and strings; methods of objects
+                // give words of unknown type
+                const char *method;
+                if (codegen_call_on_string(context, node, &method)) {
+                    if (strcmp(method, "equals") == 0) {
+                        return TYPE_BOOLEAN;
+                    }
+                    return strcmp(method, "slice") == 0 ? TYPE_NONE : TYPE_INTEGER;
+                }
+                primitive_type_t element = codegen_call_array_element(context, node, &method);
+                if (element == TYPE_NONE) {
+                    return TYPE_NONE;
+                }
+                if (strcmp(method, "length") == 0 || strcmp(method, "find") == 0) {
+                    return TYPE_INTEGER;
+                }
+                if (strcmp(method, "equals") == 0) {
+                    return TYPE_BOOLEAN;
+                }
+                if (strcmp(method, "sum") == 0 || strcmp(method, "min") == 0 || strcmp(method, "max") == 0) {
+                    return element;
+                }
+                return TYPE_NONE;
+            }
+            
+        default:
+            return TYPE_NONE;
+    }
+}
+
+// Real form of a binary operator; false for operators that only exist on
+// integers (%, ^) or on truth values (&&, ||)
+static bool codegen_real_operation(const char *op, opr_t *operation)
+{
+    static const struct { const char *op; opr_t operation; } real_operations[] = {
+        { "+", OPR_RADD }, { "-", OPR_RSUB }, { "*", OPR_RMUL }, { "/", OPR_RDIV },
+        { "==", OPR_REQ }, { "!=", OPR_RNEQ }, { "<", OPR_RLESS }, { "<=", OPR_RLEQ },
+        { ">", OPR_RGREATER }, { ">=", OPR_RGEQ },
+    };
+    for (size_t i = 0; i < sizeof(real_operations) / sizeof(real_operations[0]); i++) {
+        if (strcmp(real_operations[i].op, op) == 0) {
+            *operation = real_operations[i].operation;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Generate an expression and convert its value to type: integers become
+// doubles where a real is expected (integer literals at compile time) and
+// reals are truncated where an integer is. TYPE_NONE on either side
+// leaves the value alone.
+static void generate_expression_as(codegen_context_t *context, ast_node_t *node, primitive_type_t type)
+{
+    primitive_type_t actual = codegen_expression_type(context, node);
+    
+    if (type == TYPE_REAL && actual != TYPE_REAL && actual != TYPE_NONE) {
+        if (node->type == AST_LITERAL && node->value == NULL) {
+            emit_instruction(context, VM_LIT, 0, codegen_real_bits((double)(int64_t)node->number));
+            return;
+        }
+        generate_expression_ast(context, node);
+        emit_instruction(context, VM_OPR, 0, OPR_INT_TO_REAL);
+        return;
+    }
+    
+    generate_expression_ast(context, node);
+    if (type != TYPE_REAL && type != TYPE_NONE && actual == TYPE_REAL) {
+        emit_instruction(context, VM_OPR, 0, OPR_REAL_TO_INT);
+    }
+}
+
+// Conversion of a concatenation operand that is not a string literal;
+// operands known to be strings are left alone
+static void emit_to_string(codegen_context_t *context, const ast_node_t *node)
+{
+    if (codegen_is_string_expression(context, node)) {
+        return;
+    }
+    bool is_real = codegen_expression_type(context, node) == TYPE_REAL;
+    emit_instruction(context, VM_OPR, 0, is_real ? OPR_REAL_TO_STR : OPR_INT_TO_STR);
+}
+
+// Generate a chain like a + b + c + ... (left-nested concatenations) into one
+// string builder so each piece is copied once instead of once per '+'.
+// Returns false if the chain is too short to benefit.
+static bool generate_string_chain_ast(codegen_context_t *context, ast_node_t *node)
+{
+    // Walk down the left spine; operands[0] is the leftmost operand
+    size_t count = 1;
+    for (ast_node_t *n = node; ast_is_string_concatenation(n); n = n->children[0]) {
+        count++;
+    }
+    if (count < 3) {
+        return false;
+    }
+    
+    ast_node_t **operands = malloc(count * sizeof(ast_node_t*));
+    if (operands == NULL) {
+        return false;
+    }
+    size_t i = count;
+    ast_node_t *n = node;
+    for (; ast_is_string_concatenation(n); n = n->children[0]) {
+        operands[--i] = n->children[1];
+    }
+    operands[0] = n;
+    
+    if (debug_mode) {
+        printf("Generating string builder chain with %zu operands\n", count);
+    }
+    
+    emit_instruction(context, VM_OPR, 0, OPR_STR_BUILDER_CREATE);
+    for (i = 0; i < count; i++) {
+        generate_expression_ast(context, operands[i]);
+        // Right-hand operands that are not string literals are converted,
+        // as a single '+' does
+        if (i > 0 && !(operands[i]->type == AST_LITERAL && operands[i]->value)) {
+            emit_to_string(context, operands[i]);
+        }
+        emit_instruction(context, VM_OPR, 0, OPR_STR_BUILDER_APPEND);
+    }
+    emit_instruction(context, VM_OPR, 0, OPR_STR_BUILDER_TO_STR);
+    
+    free(operands);
+    return true;
+}
+
 void generate_binary_op_ast(codegen_context_t *context, ast_node_t *node)
 {
     if (!node || node->child_count < 2 || !node->value) return;
@@ -1924,12 +2923,30 @@ void generate_binary_op_ast(codegen_context_t *context, ast_node_t *node)
         printf("Generating binary operation: %s\n", node->value);
     }
     
+    if (ast_is_string_concatenation(node) && generate_string_chain_ast(context, node)) {
+        return;
+    }
+    
+    // An operation with a real operand works on doubles throughout
+    opr_t real_operation;
+    if (!ast_is_string_concatenation(node) && codegen_real_operation(node->value, &real_operation) &&
+        (codegen_expression_type(context, node->children[0]) == TYPE_REAL ||
+         codegen_expression_type(context, node->children[1]) == TYPE_REAL)) {
+        generate_expression_as(context, node->children[0], TYPE_REAL);
+        generate_expression_as(context, node->children[1], TYPE_REAL);
+        emit_instruction(context, VM_OPR, 0, real_operation);
+        return;
+    }
+    
+    // % and ^ are integer operations; real operands are truncated
+    primitive_type_t operand_type = (strcmp(node->value, "%") == 0 || strcmp(node->value, "^") == 0) ?
+                                    TYPE_INTEGER : TYPE_NONE;
     
     // Generate code for left operand
-    generate_expression_ast(context, node->children[0]);
+    generate_expression_as(context, node->children[0], operand_type);
     
     // Generate code for right operand
-    generate_expression_ast(context, node->children[1]);
+    generate_expression_as(context, node->children[1], operand_type);
     
     // Generate the operation
     if (strcmp(node->value, "+") == 0) {
@@ -1941,7 +2958,7 @@ void generate_binary_op_ast(codegen_context_t *context, ast_node_t *node)
             // String concatenation
             // If right operand is not a string literal, convert it to string
             if (!(node->children[1] && node->children[1]->type == AST_LITERAL && node->children[1]->value)) {
-                emit_instruction(context, VM_OPR, 0, OPR_INT_TO_STR);
+                emit_to_string(context, node->children[1]);
             }
             emit_instruction(context, VM_OPR, 0, OPR_STR_CONCAT);
         } else {
@@ -1994,7 +3011,8 @@ void generate_unary_op_ast(codegen_context_t *context, ast_node_t *node)
     
     // Generate the operation
     if (strcmp(node->value, "-") == 0) {
-        emit_instruction(context, VM_OPR, 0, OPR_NEG);
+        bool is_real = codegen_expression_type(context, node->children[0]) == TYPE_REAL;
+        emit_instruction(context, VM_OPR, 0, is_real ? OPR_RNEG : OPR_NEG);
     } else if (strcmp(node->value, "!") == 0) {
         emit_instruction(context, VM_OPR, 0, OPR_NOT);
     } else {
@@ -2035,46 +3053,82 @@ void emit_jump_if_false(codegen_context_t *context, uint64_t address)
 }
 
 
-bool codegen_add_variable(codegen_context_t *context, const char *name, size_t *address)
+// Append a variable table entry (growing the arrays as needed)
+static bool codegen_append_variable(codegen_context_t *context, const char *name, size_t address, bool is_local)
 {
-    if (context == NULL || name == NULL || address == NULL) {
-        return false;
-    }
-    
-    // Check if variable already exists
-    size_t existing_address;
-    if (codegen_find_variable(context, name, &existing_address)) {
-        *address = existing_address;
-        return true;
-    }
-    
-    // Expand capacity if needed
     if (context->variable_count >= context->variable_capacity) {
         size_t new_capacity = context->variable_capacity == 0 ? 16 : context->variable_capacity * 2;
         char **new_names = realloc(context->variable_names, new_capacity * sizeof(char*));
-        size_t *new_addresses = realloc(context->variable_addresses, new_capacity * sizeof(size_t));
-        
-        if (new_names == NULL || new_addresses == NULL) {
+        if (new_names == NULL) {
             return false;
         }
-        
         context->variable_names = new_names;
+        size_t *new_addresses = realloc(context->variable_addresses, new_capacity * sizeof(size_t));
+        if (new_addresses == NULL) {
+            return false;
+        }
         context->variable_addresses = new_addresses;
+        bool *new_locals = realloc(context->variable_locals, new_capacity * sizeof(bool));
+        if (new_locals == NULL) {
+            return false;
+        }
+        context->variable_locals = new_locals;
+        primitive_type_t *new_types = realloc(context->variable_types, new_capacity * sizeof(primitive_type_t));
+        if (new_types == NULL) {
+            return false;
+        }
+        context->variable_types = new_types;
+        primitive_type_t *new_elements = realloc(context->variable_elements, new_capacity * sizeof(primitive_type_t));
+        if (new_elements == NULL) {
+            return false;
+        }
+        context->variable_elements = new_elements;
+        bool *new_strings = realloc(context->variable_strings, new_capacity * sizeof(bool));
+        if (new_strings == NULL) {
+            return false;
+        }
+        context->variable_strings = new_strings;
         context->variable_capacity = new_capacity;
     }
     
-    // Add the variable
     context->variable_names[context->variable_count] = malloc(strlen(name) + 1);
     if (context->variable_names[context->variable_count] == NULL) {
         return false;
     }
     strcpy(context->variable_names[context->variable_count], name);
+    if (!name_index_push(&context->variable_index, name_index_hash(name))) {
+        free(context->variable_names[context->variable_count]);
+        return false;
+    }
+    context->variable_addresses[context->variable_count] = address;
+    context->variable_locals[context->variable_count] = is_local;
+    context->variable_types[context->variable_count] = TYPE_NONE;
+    context->variable_elements[context->variable_count] = TYPE_NONE;
+    context->variable_strings[context->variable_count] = false;
+    context->variable_count++;
+    return true;
+}
+
+// Add a global (field or undeclared name) unless the name is already visible
+bool codegen_add_variable(codegen_context_t *context, const char *name, uint8_t *level, size_t *address)
+{
+    if (context == NULL || name == NULL || address == NULL) {
+        return false;
+    }
     
-    context->variable_addresses[context->variable_count] = context->next_variable_address;
-    *address = context->next_variable_address;
+    // Check if variable already exists
+    if (codegen_find_variable(context, name, level, address)) {
+        return true;
+    }
     
-    context->variable_count++;
+    if (!codegen_append_variable(context, name, context->next_variable_address, false)) {
+        return false;
+    }
+    *address = context->next_variable_address;
     context->next_variable_address++;
+    if (level != NULL) {
+        *level = context->in_method ? 1 : 0;
+    }
     
     if (context->debug_output) {
         printf("Added variable '%s' at address %zu\n", name, *address);
@@ -2083,22 +3137,147 @@ bool codegen_add_variable(codegen_context_t *context, const char *name, size_t *
     return true;
 }
 
-bool codegen_find_variable(codegen_context_t *context, const char *name, size_t *address)
+// Add a local of the current method; it lives in the method's activation
+// record and hides a global with the same name
+bool codegen_add_local_variable(codegen_context_t *context, const char *name, size_t *address)
 {
     if (context == NULL || name == NULL || address == NULL) {
         return false;
     }
     
-    for (size_t i = 0; i < context->variable_count; i++) {
+    uint8_t level;
+    if (codegen_find_variable(context, name, &level, address) && level == 0) {
+        return true;
+    }
+    
+    if (!codegen_append_variable(context, name, context->frame_size, true)) {
+        return false;
+    }
+    *address = context->frame_size;
+    context->frame_size++;
+    
+    if (context->debug_output) {
+        printf("Added local variable '%s' at frame offset %zu\n", name, *address);
+    }
+    
+    return true;
+}
+
+// Table index of the visible variable called name; the index yields the
+// newest definition first, so locals hide globals
+static bool codegen_variable_index(const codegen_context_t *context, const char *name, size_t *index)
+{
+    for (size_t i = name_index_first(&context->variable_index, name_index_hash(name)); i != NAME_INDEX_NONE;
+         i = name_index_next(&context->variable_index, i)) {
         if (context->variable_names[i] != NULL && strcmp(context->variable_names[i], name) == 0) {
-            *address = context->variable_addresses[i];
+            *index = i;
             return true;
         }
     }
-    
     return false;
 }
 
+// Level is 0 for locals of the current method and 1 for globals, which a
+// method reaches through the static link of its activation record
+bool codegen_find_variable(codegen_context_t *context, const char *name, uint8_t *level, size_t *address)
+{
+    if (context == NULL || name == NULL || address == NULL) {
+        return false;
+    }
+    
+    size_t i;
+    if (!codegen_variable_index(context, name, &i)) {
+        return false;
+    }
+    *address = context->variable_addresses[i];
+    if (level != NULL) {
+        *level = (context->in_method && !context->variable_locals[i]) ? 1 : 0;
+    }
+    return true;
+}
+
+// Frame slot of a local whose objects escape analysis tied to the method's
+// activation record
+bool codegen_frame_variable(codegen_context_t *context, const char *name, size_t *address)
+{
+    size_t i;
+    if (context == NULL || name == NULL || address == NULL || !context->in_method ||
+        !escape_is_frame_variable(&context->escape, name) || !codegen_variable_index(context, name, &i) ||
+        !context->variable_locals[i]) {
+        return false;
+    }
+    *address = context->variable_addresses[i];
+    return true;
+}
+
+// Class of this module every object in the method's local object_name was
+// created as, or 0 when it is not known at compile time
+uint64_t codegen_receiver_class(codegen_context_t *context, const char *object_name)
+{
+    size_t i;
+    if (context == NULL || object_name == NULL || !context->in_method ||
+        !codegen_variable_index(context, object_name, &i) || !context->variable_locals[i]) {
+        return 0;
+    }
+    const char *class_name = escape_created_class(&context->escape, object_name);
+    if (class_name == NULL || !codegen_find_local_class(context, class_name)) {
+        return 0;
+    }
+    return codegen_class_id(context, class_name);
+}
+
+void codegen_set_variable_type(codegen_context_t *context, const char *name, primitive_type_t type)
+{
+    size_t i;
+    if (context != NULL && name != NULL && codegen_variable_index(context, name, &i)) {
+        context->variable_types[i] = type;
+    }
+}
+
+primitive_type_t codegen_variable_type(const codegen_context_t *context, const char *name)
+{
+    size_t i;
+    if (context == NULL || name == NULL || !codegen_variable_index(context, name, &i)) {
+        return TYPE_NONE;
+    }
+    return context->variable_types[i];
+}
+
+void codegen_set_variable_element(codegen_context_t *context, const char *name, primitive_type_t type)
+{
+    size_t i;
+    if (context != NULL && name != NULL && codegen_variable_index(context, name, &i)) {
+        context->variable_elements[i] = type;
+    }
+}
+
+// Element type of an array variable; TYPE_NONE if name is not one
+primitive_type_t codegen_variable_element(const codegen_context_t *context, const char *name)
+{
+    size_t i;
+    if (context == NULL || name == NULL || !codegen_variable_index(context, name, &i)) {
+        return TYPE_NONE;
+    }
+    return context->variable_elements[i];
+}
+
+void codegen_set_variable_string(codegen_context_t *context, const char *name, bool is_string)
+{
+    size_t i;
+    if (context != NULL && name != NULL && codegen_variable_index(context, name, &i)) {
+        context->variable_strings[i] = is_string;
+    }
+}
+
+bool codegen_variable_is_string(const codegen_context_t *context, const char *name)
+{
+    size_t i;
+    if (context == NULL || name == NULL || !codegen_variable_index(context, name, &i)) {
+        return false;
+    }
+    return context->variable_strings[i];
+}
+
 void codegen_error(codegen_context_t *context, const char *message)
 {
     if (context == NULL || message == NULL) {
@@ -2198,6 +3377,29 @@ void resolve_labels(codegen_context_t *context)
         printf("Resolving %zu labels...\n", context->label_table_size);
     }
     
+    // Label IDs are dense (1..label_counter once classes are merged), so
+    // index the table by ID; the first defined entry for an ID wins
+    size_t max_label_id = 0;
+    for (size_t j = 0; j < context->label_table_size; j++) {
+        if (context->label_table[j].defined && context->label_table[j].label_id > max_label_id) {
+            max_label_id = context->label_table[j].label_id;
+        }
+    }
+    size_t *targets = malloc((max_label_id + 1) * sizeof(size_t));
+    if (targets == NULL) {
+        codegen_error(context, "Failed to allocate memory for label resolution");
+        return;
+    }
+    for (size_t id = 0; id <= max_label_id; id++) {
+        targets[id] = SIZE_MAX;
+    }
+    for (size_t j = 0; j < context->label_table_size; j++) {
+        const label_entry_t *label = &context->label_table[j];
+        if (label->defined && targets[label->label_id] == SIZE_MAX) {
+            targets[label->label_id] = label->instruction_index;
+        }
+    }
+    
     // Go through all instructions and resolve label references
     for (size_t i = 0; i < context->instruction_count; i++) {
         if (context->instructions[i].opcode == VM_JMP || context->instructions[i].opcode == VM_JPC) {
@@ -2210,16 +3412,13 @@ void resolve_labels(codegen_context_t *context)
             
             // Find the label in the label table
             bool found = false;
-            for (size_t j = 0; j < context->label_table_size; j++) {
-                if (context->label_table[j].label_id == label_id && context->label_table[j].defined) {
-                    context->instructions[i].opt64 = context->label_table[j].instruction_index;
-                    if (debug_mode) {
-                        printf("Resolved jump at instruction %zu: label %zu -> instruction %zu\n", 
-                               i, label_id, context->label_table[j].instruction_index);
-                    }
-                    found = true;
-                    break;
+            if (label_id <= max_label_id && targets[label_id] != SIZE_MAX) {
+                context->instructions[i].opt64 = targets[label_id];
+                if (debug_mode) {
+                    printf("Resolved jump at instruction %zu: label %zu -> instruction %zu\n", 
+                           i, label_id, targets[label_id]);
                 }
+                found = true;
             }
             
             if (!found && debug_mode) {
@@ -2227,9 +3426,17 @@ void resolve_labels(codegen_context_t *context)
             }
         }
     }
+    
+    free(targets);
 }
 
 void generate_method_call_ast(codegen_context_t *context, ast_node_t *node)
+{
+    generate_method_call_in(context, node, false);
+}
+
+// Method call, run by the calling task or (spawn) by a new one
+static void generate_method_call_in(codegen_context_t *context, ast_node_t *node, bool spawn)
 {
     if (!context || !node) return;
     
@@ -2257,11 +3464,36 @@ void generate_method_call_ast(codegen_context_t *context, ast_node_t *node)
                 printf("  Object name: %s, Method name: %s\n", object_name, method_name);
             }
             
+            // Methods of arrays are VM operations, not calls
+            if (codegen_variable_element(context, object_name) != TYPE_NONE) {
+                if (spawn) {
+                    codegen_error(context, "Array methods cannot run as tasks");
+                    emit_instruction(context, VM_LIT, 0, 0);
+                } else {
+                    generate_array_method(context, node, object_name, method_name);
+                }
+                free(object_name);
+                return;
+            }
+            
+            // So are methods of strings
+            if (codegen_variable_is_string(context, object_name)) {
+                if (spawn) {
+                    codegen_error(context, "String methods cannot run as tasks");
+                    emit_instruction(context, VM_LIT, 0, 0);
+                } else {
+                    generate_string_method(context, node, object_name, method_name);
+                }
+                free(object_name);
+                return;
+            }
+            
             // Step 1: Push object address onto stack
             // Look up the object variable in the symbol table
+            uint8_t object_level;
             size_t object_address;
-            if (codegen_find_variable(context, object_name, &object_address)) {
-                emit_instruction(context, VM_LOD, 0, object_address);
+            if (codegen_find_variable(context, object_name, &object_level, &object_address)) {
+                emit_instruction(context, VM_LOD, object_level, object_address);
                 if (debug_mode) {
                     printf("  Loading object '%s' from address %zu\n", object_name, object_address);
                 }
@@ -2273,17 +3505,26 @@ void generate_method_call_ast(codegen_context_t *context, ast_node_t *node)
                 emit_instruction(context, VM_LIT, 0, 0);
             }
             
-            // Step 2: Push method offset onto stack (placeholder for now, will be patched by linker)
-            // The linker will calculate the actual method offset from the class manifest
-            uint64_t method_offset_placeholder = 0xFFFF; // Placeholder offset
-            emit_instruction(context, VM_LIT, 0, method_offset_placeholder);
+            // Step 2: Call through the object's vtable; the linker replaces
+            // the placeholder slot once every class's methods are known. A
+            // spawn starts a task at the call and skips it itself.
+            if (spawn) {
+                emit_instruction(context, VM_OPR, 0, OPR_TASK_SPAWN);
+            }
+            uint64_t receiver_class_id = spawn ? 0 : codegen_receiver_class(context, object_name);
+            if (!codegen_add_method_call(context, context->instruction_count, method_name, receiver_class_id)) {
+                printf("Error: Failed to record method call '%s'\n", method_name);
+                free(object_name);
+                return;
+            }
+            emit_instruction(context, VM_CALS, 0, 0);
             
             if (debug_mode) {
-                printf("  Pushed method offset placeholder %llu for method '%s' (will be patched by linker)\n", 
-                       (unsigned long long)method_offset_placeholder, method_name);
+                printf("Generated VM_CALS for method '%s' (slot patched by linker)\n", method_name);
             }
             
             free(object_name);
+            return;
         } else {
             // No dot found, treat whole string as method name with no object
             if (debug_mode) {
@@ -2331,6 +3572,287 @@ void generate_field_access_ast(codegen_context_t *context, ast_node_t *node)
     }
 }
 
+// OPR_ARRAY_NEW kind of an element type
+static uint64_t codegen_array_kind(primitive_type_t element)
+{
+    switch (element) {
+        case TYPE_BOOLEAN: return ARRAY_OF_BOOLEAN;
+        case TYPE_CHAR: return ARRAY_OF_CHAR;
+        case TYPE_REAL: return ARRAY_OF_REAL;
+        default: return ARRAY_OF_INTEGER;
+    }
+}
+
+// Push the array held by variable name
+static void emit_array_load(codegen_context_t *context, const char *name)
+{
+    uint8_t level;
+    size_t address;
+    if (name != NULL && codegen_find_variable(context, name, &level, &address)) {
+        emit_instruction(context, VM_LOD, level, address);
+        return;
+    }
+    
+    // Keep the stack balanced; the VM rejects 0 as an array
+    codegen_error(context, "Unknown array variable");
+    emit_instruction(context, VM_LIT, 0, 0);
+}
+
+// name[index] = value
+static void generate_element_assignment_ast(codegen_context_t *context, ast_node_t *node)
+{
+    if (!node || node->child_count < 2) return;
+    
+    emit_array_load(context, node->value);
+    generate_expression_as(context, node->children[0], TYPE_INTEGER);
+    generate_expression_as(context, node->children[1], codegen_variable_element(context, node->value));
+    emit_instruction(context, VM_OPR, 0, OPR_ARRAY_STORE);
+}
+
+// Range operands of a bulk operation: from..to (to excluded) given by the
+// call's arguments first..first+1, or the whole array without them
+static void emit_array_range(codegen_context_t *context, ast_node_t *node, size_t first, const char *array)
+{
+    if (node->child_count >= first + 2) {
+        generate_expression_as(context, node->children[first], TYPE_INTEGER);
+        generate_expression_as(context, node->children[first + 1], TYPE_INTEGER);
+        return;
+    }
+    emit_literal(context, 0);
+    emit_array_load(context, array);
+    emit_instruction(context, VM_OPR, 0, OPR_ARRAY_LENGTH);
+}
+
+// Built-in methods of array variables: length(), sum(), min(), max() and
+// find(value) over the whole array or over from..to given as two more
+// arguments, slice(from, to) and equals(other)
+static void generate_array_method(codegen_context_t *context, ast_node_t *node, const char *array, const char *method)
+{
+    primitive_type_t element = codegen_variable_element(context, array);
+    
+    if (strcmp(method, "length") == 0 && node->child_count == 0) {
+        emit_array_load(context, array);
+        emit_instruction(context, VM_OPR, 0, OPR_ARRAY_LENGTH);
+    } else if ((strcmp(method, "sum") == 0 || strcmp(method, "min") == 0 || strcmp(method, "max") == 0) &&
+               (node->child_count == 0 || node->child_count == 2)) {
+        opr_t operation = method[1] == 'u' ? OPR_ARRAY_SUM : method[1] == 'i' ? OPR_ARRAY_MIN : OPR_ARRAY_MAX;
+        emit_array_load(context, array);
+        emit_array_range(context, node, 0, array);
+        emit_instruction(context, VM_OPR, 0, operation);
+    } else if (strcmp(method, "find") == 0 && (node->child_count == 1 || node->child_count == 3)) {
+        emit_array_load(context, array);
+        emit_array_range(context, node, 1, array);
+        generate_expression_as(context, node->children[0], element);
+        emit_instruction(context, VM_OPR, 0, OPR_ARRAY_FIND);
+    } else if (strcmp(method, "slice") == 0 && node->child_count == 2) {
+        emit_array_load(context, array);
+        emit_array_range(context, node, 0, array);
+        emit_instruction(context, VM_OPR, 0, OPR_ARRAY_SLICE);
+    } else if (strcmp(method, "equals") == 0 && node->child_count == 1) {
+        emit_array_load(context, array);
+        generate_expression_ast(context, node->children[0]);
+        emit_instruction(context, VM_OPR, 0, OPR_ARRAY_EQUAL);
+    } else {
+        codegen_error(context, "Unknown array method or wrong number of arguments");
+        emit_instruction(context, VM_LIT, 0, 0);
+    }
+}
+
+// Built-in methods of string variables: length(), slice(from, to),
+// find(needle) and find(needle, from), compare(other), equals(other),
+// toInt() and at(offset). Offsets count bytes from 0.
+static void generate_string_method(codegen_context_t *context, ast_node_t *node, const char *string, const char *method)
+{
+    static const struct { const char *name; size_t arguments; opr_t operation; } methods[] = {
+        { "length", 0, OPR_STR_LEN }, { "slice", 2, OPR_STR_SLICE }, { "find", 1, OPR_STR_FIND },
+        { "find", 2, OPR_STR_FIND }, { "compare", 1, OPR_STR_CMP }, { "equals", 1, OPR_STR_EQ },
+        { "toInt", 0, OPR_STR_TO_INT }, { "at", 1, OPR_STR_AT },
+    };
+    
+    for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+        if (strcmp(methods[i].name, method) != 0 || methods[i].arguments != node->child_count) {
+            continue;
+        }
+        uint8_t level;
+        size_t address;
+        if (!codegen_find_variable(context, string, &level, &address)) {
+            break;
+        }
+        emit_instruction(context, VM_LOD, level, address);
+        for (size_t j = 0; j < node->child_count; j++) {
+            // Offsets are integers; other arguments are strings
+            bool is_offset = methods[i].operation == OPR_STR_SLICE || methods[i].operation == OPR_STR_AT || j == 1;
+            generate_expression_as(context, node->children[j], is_offset ? TYPE_INTEGER : TYPE_NONE);
+        }
+        if (methods[i].operation == OPR_STR_FIND && node->child_count == 1) {
+            emit_literal(context, 0);
+        }
+        emit_instruction(context, VM_OPR, 0, methods[i].operation);
+        return;
+    }
+    codegen_error(context, "Unknown string method or wrong number of arguments");
+    emit_instruction(context, VM_LIT, 0, 0);
+}
+
+// Whether expression may be evaluated any number of times, before or after
+// the loop body, with the same result: literals, variables other than the
+// excluded ones, operators on those and array lengths
+static bool codegen_loop_invariant(const codegen_context_t *context, const ast_node_t *node,
+                                   const char *excluded, const char *also_excluded)
+{
+    if (node == NULL) {
+        return false;
+    }
+    
+    switch (node->type) {
+        case AST_LITERAL:
+            return node->value == NULL;
+            
+        case AST_IDENTIFIER:
+            return node->value != NULL && strcmp(node->value, excluded) != 0 &&
+                   (also_excluded == NULL || strcmp(node->value, also_excluded) != 0);
+            
+        case AST_UNARY_OP:
+        case AST_BINARY_OP:
+            if (node->child_count == 0 || ast_is_string_concatenation((ast_node_t *)node)) {
+                return false;
+            }
+            for (size_t i = 0; i < node->child_count; i++) {
+                if (!codegen_loop_invariant(context, node->children[i], excluded, also_excluded)) {
+                    return false;
+                }
+            }
+            return true;
+            
+        case AST_METHOD_CALL:
+            {
+                const char *method;
+                return codegen_call_array_element(context, node, &method) != TYPE_NONE &&
+                       strcmp(method, "length") == 0 && node->child_count == 0;
+            }
+            
+        default:
+            return false;
+    }
+}
+
+// Whether node reads or writes name[variable] of an array variable
+static bool codegen_is_element_at(const codegen_context_t *context, const ast_node_t *node, const char *variable)
+{
+    return node != NULL && (node->type == AST_INDEX || node->type == AST_INDEX_ASSIGNMENT) && node->child_count >= 1 &&
+           codegen_variable_element(context, node->value) != TYPE_NONE &&
+           node->children[0]->type == AST_IDENTIFIER && node->children[0]->value != NULL &&
+           strcmp(node->children[0]->value, variable) == 0;
+}
+
+// Push end + 1, the excluded end of the range a FOR loop covers
+static void emit_loop_range_end(codegen_context_t *context, ast_node_t *end_expr)
+{
+    generate_expression_ast(context, end_expr);
+    emit_literal(context, 1);
+    emit_operation(context, OPR_ADD, 0, 0);
+}
+
+// FOR loops whose whole body is one of
+//   x[i] = value         (value loop invariant)  -> ARRAY_FILL
+//   y[i] = x[i]          (same element type)     -> ARRAY_COPY
+//   s = s + x[i]         (integers)              -> ARRAY_SUM
+// with a loop invariant end run as one bulk operation over i..end. The
+// loop variable ends where the loop would leave it. Real sums stay loops,
+// as the kernels add in a different order. Returns false, having emitted
+// nothing, for any other loop.
+static bool generate_for_intrinsic(codegen_context_t *context, ast_node_t *node, uint8_t var_level, size_t var_address)
+{
+    const char *var = node->children[0]->value;
+    ast_node_t *start_expr = node->children[1];
+    ast_node_t *end_expr = node->children[2];
+    ast_node_t *body_node = node->children[3];
+    
+    if (var == NULL || body_node == NULL || body_node->type != AST_BLOCK || body_node->child_count != 1 ||
+        codegen_variable_type(context, var) == TYPE_REAL) {
+        return false;
+    }
+    
+    ast_node_t *statement = body_node->children[0];
+    opr_t operation;
+    const char *written = NULL;
+    if (statement->type == AST_INDEX_ASSIGNMENT && statement->child_count == 2 &&
+        codegen_is_element_at(context, statement, var)) {
+        ast_node_t *value = statement->children[1];
+        if (codegen_is_element_at(context, value, var) &&
+            codegen_variable_element(context, value->value) == codegen_variable_element(context, statement->value)) {
+            operation = OPR_ARRAY_COPY;
+        } else if (codegen_loop_invariant(context, value, var, NULL)) {
+            operation = OPR_ARRAY_FILL;
+        } else {
+            return false;
+        }
+    } else if (statement->type == AST_ASSIGNMENT && statement->child_count == 2 &&
+               statement->children[0]->value != NULL && statement->children[1]->type == AST_BINARY_OP &&
+               statement->children[1]->child_count == 2 && statement->children[1]->value != NULL &&
+               strcmp(statement->children[1]->value, "+") == 0) {
+        written = statement->children[0]->value;
+        ast_node_t *left = statement->children[1]->children[0];
+        ast_node_t *right = statement->children[1]->children[1];
+        ast_node_t *element = left->type == AST_IDENTIFIER ? right : left;
+        ast_node_t *total = left->type == AST_IDENTIFIER ? left : right;
+        if (total->type != AST_IDENTIFIER || total->value == NULL || strcmp(total->value, written) != 0 ||
+            strcmp(written, var) == 0 || codegen_variable_type(context, written) != TYPE_INTEGER ||
+            !codegen_is_element_at(context, element, var) ||
+            codegen_variable_element(context, element->value) != TYPE_INTEGER) {
+            return false;
+        }
+        operation = OPR_ARRAY_SUM;
+    } else {
+        return false;
+    }
+    if (!codegen_loop_invariant(context, end_expr, var, written)) {
+        return false;
+    }
+    
+    size_t skip_label = create_label(context);
+    generate_expression_ast(context, start_expr);
+    emit_store(context, var_level, var_address);
+    emit_load(context, var_level, var_address);
+    generate_expression_ast(context, end_expr);
+    emit_operation(context, OPR_LEQ, 0, 0);
+    emit_jump_if_false(context, skip_label);
+    
+    codegen_add_line(context, context->instruction_count, statement);
+    if (operation == OPR_ARRAY_SUM) {
+        uint8_t total_level;
+        size_t total_address;
+        const char *array = codegen_is_element_at(context, statement->children[1]->children[0], var) ?
+                            statement->children[1]->children[0]->value : statement->children[1]->children[1]->value;
+        codegen_find_variable(context, written, &total_level, &total_address);
+        emit_load(context, total_level, total_address);
+        emit_array_load(context, array);
+        emit_load(context, var_level, var_address);
+        emit_loop_range_end(context, end_expr);
+        emit_operation(context, OPR_ARRAY_SUM, 0, 0);
+        emit_operation(context, OPR_ADD, 0, 0);
+        emit_store(context, total_level, total_address);
+    } else {
+        emit_array_load(context, statement->value);
+        emit_load(context, var_level, var_address);
+        if (operation == OPR_ARRAY_COPY) {
+            emit_array_load(context, statement->children[1]->value);
+            emit_load(context, var_level, var_address);
+        }
+        emit_loop_range_end(context, end_expr);
+        if (operation == OPR_ARRAY_FILL) {
+            generate_expression_as(context, statement->children[1], codegen_variable_element(context, statement->value));
+        }
+        emit_operation(context, operation, 0, 0);
+    }
+    
+    codegen_add_line(context, context->instruction_count, node);
+    emit_loop_range_end(context, end_expr);
+    emit_store(context, var_level, var_address);
+    set_label(context, skip_label, context->instruction_count);
+    return true;
+}
+
 bool generate_for_statement(codegen_context_t *context, ast_node_t *node)
 {
     if (!node || node->child_count < 4) {
@@ -2360,9 +3882,13 @@ bool generate_for_statement(codegen_context_t *context, ast_node_t *node)
     }
     
     // Add loop variable to symbol table if not already present
+    uint8_t var_level = 0;
     size_t var_address;
-    if (!codegen_find_variable(context, var_node->value, &var_address)) {
-        if (!codegen_add_variable(context, var_node->value, &var_address)) {
+    if (!codegen_find_variable(context, var_node->value, &var_level, &var_address)) {
+        bool added = context->in_method ?
+            codegen_add_local_variable(context, var_node->value, &var_address) :
+            codegen_add_variable(context, var_node->value, &var_level, &var_address);
+        if (!added) {
             if (debug_mode) {
                 printf("Failed to add loop variable: %s\n", var_node->value);
             }
@@ -2370,9 +3896,14 @@ bool generate_for_statement(codegen_context_t *context, ast_node_t *node)
         }
     }
     
+    // Loops over arrays that a single VM operation can do
+    if (generate_for_intrinsic(context, node, var_level, var_address)) {
+        return true;
+    }
+    
     // Generate start expression and store in loop variable (INITIALIZATION - outside loop)
     generate_expression_ast(context, start_expr);
-    emit_store(context, 0, var_address);
+    emit_store(context, var_level, var_address);
     if (debug_mode) {
         printf("Emitted initialization code at instruction %zu\n", context->instruction_count);
     }
@@ -2384,7 +3915,7 @@ bool generate_for_statement(codegen_context_t *context, ast_node_t *node)
     }
     
     // Load loop variable and end expression for comparison
-    emit_load(context, 0, var_address);
+    emit_load(context, var_level, var_address);
     generate_expression_ast(context, end_expr);
     
     // Compare loop variable with end value (less than or equal)
@@ -2405,11 +3936,14 @@ bool generate_for_statement(codegen_context_t *context, ast_node_t *node)
         }
     }
     
+    // The step and back jump belong to the loop, not to the body's last statement
+    codegen_add_line(context, context->instruction_count, node);
+    
     // Increment loop variable (load, add 1, store)
-    emit_load(context, 0, var_address);
+    emit_load(context, var_level, var_address);
     emit_literal(context, 1);
     emit_operation(context, OPR_ADD, 0, 0);
-    emit_store(context, 0, var_address);
+    emit_store(context, var_level, var_address);
     if (debug_mode) {
         printf("Emitted increment code at instruction %zu\n", context->instruction_count);
     }
@@ -2503,6 +4037,9 @@ bool collect_classes_from_ast(codegen_context_t *context, ast_node_t *ast, class
     size_t class_index = 0;
     size_t method_index = 0;
     size_t field_index = 0;
+    uint64_t method_slot_count = 0;
+    name_index_t method_names;
+    name_index_init(&method_names);
     
     if (ast->type == AST_MODULE) {
         for (size_t i = 0; i < ast->child_count; i++) {
@@ -2544,15 +4081,33 @@ bool collect_classes_from_ast(codegen_context_t *context, ast_node_t *ast, class
                             method_entry->method_name[31] = '\0';
                         }
                         
-                        // Generate method ID
-                        method_entry->method_id = 0;
-                        for (const char *p = method_entry->method_name; *p; p++) {
-                            method_entry->method_id = method_entry->method_id * 31 + *p;
+                        // The method ID is its vtable slot: one slot per distinct
+                        // method name, so an override shares the slot it replaces
+                        uint32_t name_hash = name_index_hash(method_entry->method_name);
+                        method_entry->method_id = method_slot_count;
+                        for (size_t k = name_index_first(&method_names, name_hash); k != NAME_INDEX_NONE;
+                             k = name_index_next(&method_names, k)) {
+                            if (strcmp((*methods)[k].method_name, method_entry->method_name) == 0) {
+                                method_entry->method_id = (*methods)[k].method_id;
+                                break;
+                            }
+                        }
+                        if (method_entry->method_id == method_slot_count) {
+                            method_slot_count++;
+                        }
+                        if (!name_index_push(&method_names, name_hash)) {
+                            name_index_cleanup(&method_names);
+                            free(*classes);
+                            free(*methods);
+                            free(*fields);
+                            *classes = NULL;
+                            *methods = NULL;
+                            *fields = NULL;
+                            return false;
                         }
-                        method_entry->method_id = method_entry->method_id % 1000;
                         
                         // Set method offset using actual bytecode position
-                        method_entry->offset = codegen_get_method_offset(context, child->value);
+                        method_entry->offset = codegen_get_method_offset(context, class_node->value, child->value);
     if (debug_mode) {
                             printf("Set method '%s' offset to %zu (actual bytecode position)\n", 
                                    child->value, method_entry->offset);
@@ -2566,7 +4121,17 @@ bool collect_classes_from_ast(codegen_context_t *context, ast_node_t *ast, class
                     }
                 }
                 
+                // Parent class recorded by the parser's symbol table
                 class_entry->parent_class_id = 0;
+                if (class_node->value && context->parser_context) {
+                    symbol_t *class_symbol = symbol_lookup_global(&context->parser_context->symbol_table,
+                                                                  class_node->value, strlen(class_node->value));
+                    if (class_symbol && class_symbol->type == SYMBOL_CLASS &&
+                        class_symbol->data.class_info.parent_class != NULL) {
+                        class_entry->parent_class_id = codegen_generate_unique_class_id(
+                            module_name, class_symbol->data.class_info.parent_class);
+                    }
+                }
                 class_entry->flags = 0;
                 class_entry->reserved = 0;
     
@@ -2581,6 +4146,7 @@ bool collect_classes_from_ast(codegen_context_t *context, ast_node_t *ast, class
         }
     }
     
+    name_index_cleanup(&method_names);
     *class_count = class_count_total;
     *method_count = method_count_total;
     *field_count = field_count_total;
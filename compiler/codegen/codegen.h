@@ -10,6 +10,9 @@
 #include "../parser/parser.h"
 #include "../common/opcodes.h"
 #include "../arxmod/arxmod.h"
+#include "../linker/linker.h"
+#include "../symbols/name_index.h"
+#include "../optimizer/escape.h"
 
 // Forward declaration
 typedef struct parser_context parser_context_t;
@@ -21,6 +24,21 @@ typedef struct {
     bool defined;                  // Whether label has been defined
 } label_entry_t;
 
+// The module's string pool by text. Built once before the classes, then
+// only read, so the -j workers share it.
+typedef struct {
+    name_index_t index;            // Distinct literals by text
+    size_t *pool_indices;          // Parser string pool index of each distinct literal (its first occurrence)
+} codegen_string_pool_t;
+
+// Source line of the code from instruction_index on. The statement is
+// kept so the build cache can store lines as positions in the class AST.
+typedef struct {
+    size_t instruction_index;      // First instruction of the statement
+    uint32_t line_number;          // Its source line
+    const ast_node_t *statement;   // Node the line came from
+} codegen_line_t;
+
 // Code generator context
 typedef struct {
     instruction_t *instructions;    // Generated instructions
@@ -29,9 +47,17 @@ typedef struct {
     size_t label_counter;          // Label counter for jumps
     bool debug_output;             // Debug output flag
     parser_context_t *parser_context; // Reference to parser context
+    size_t jobs;                   // Threads for building classes (-j); 1 builds them in turn
+    const char *build_cache_dir;   // Per-class build cache (-build-cache); NULL generates every class
+    linker_imports_t *imports;     // Modules named by import declarations (borrowed); NULL when there are none
+    bool class_reused;             // This class was loaded from the build cache
+    size_t classes_rebuilt;        // Classes generated by this build
+    size_t classes_reused;         // Classes loaded from the build cache
     char **string_literals;        // String literals for ARX module
     size_t string_literals_count;  // Number of string literals
     size_t string_literals_capacity; // Capacity of string literals array
+    codegen_string_pool_t *string_pool; // Literal lookup; owned by the module's context, borrowed by class contexts
+    bool owns_string_pool;         // string_pool is freed with this context
     
     // Label table for two-pass compilation
     label_entry_t *label_table;    // Label table
@@ -41,9 +67,20 @@ typedef struct {
     // Variable tracking for Phase 2
     char **variable_names;         // Variable names
     size_t *variable_addresses;    // Variable memory addresses
+    bool *variable_locals;         // Local of the current method (activation record) or global
+    primitive_type_t *variable_types; // Declared type; TYPE_NONE for undeclared names and non-primitives
+    primitive_type_t *variable_elements; // Element type of arrays; TYPE_NONE for every other variable
+    bool *variable_strings;        // Declared string
     size_t variable_count;         // Number of variables
     size_t variable_capacity;      // Capacity of variables array
     size_t next_variable_address;  // Next available memory address
+    name_index_t variable_index;   // Variables by name
+    
+    // Activation record of the method being generated
+    bool in_method;                // Generating a method body
+    size_t frame_size;             // Locals reserved by the method's VM_INT
+    primitive_type_t return_type;  // Declared result type of the method being generated
+    escape_info_t escape;          // Object locals of the method that may live in its activation
     
     // Class context for separate class compilation
     ast_node_t *current_class;     // Current class being compiled
@@ -52,11 +89,23 @@ typedef struct {
     // Method position tracking for accurate offset calculation
     struct {
         char *method_name;         // Method name
+        char *class_name;          // Class the method belongs to (NULL outside a class)
         size_t start_instruction;  // Instruction index where method bytecode starts
         size_t end_instruction;    // Instruction index where method bytecode ends
     } *method_positions;           // Array of method positions
     size_t method_position_count;  // Number of methods tracked
     size_t method_position_capacity; // Capacity of method positions array
+    name_index_t method_position_index; // Method positions by method name
+    
+    // Method call sites whose VM_CALS slot the linker fills in
+    linker_method_call_t *method_calls; // Array of call sites
+    size_t method_call_count;      // Number of call sites
+    size_t method_call_capacity;   // Capacity of call sites array
+    
+    // Line table for the module's debug section, by instruction index
+    codegen_line_t *lines;         // Array of line entries
+    size_t line_count;             // Number of line entries
+    size_t line_capacity;          // Capacity of line entries array
 } codegen_context_t;
 
 // Function prototypes
@@ -73,12 +122,19 @@ bool generate_module(codegen_context_t *context, ast_node_t *node);
 bool build_class_separately(codegen_context_t *context, ast_node_t *class_node);
 
 // Method position tracking functions
+bool codegen_add_method_position(codegen_context_t *context, const char *class_name, const char *method_name,
+                                 size_t start_instruction, size_t end_instruction);
 bool codegen_start_method_tracking(codegen_context_t *context, const char *method_name);
 bool codegen_end_method_tracking(codegen_context_t *context, const char *method_name);
-size_t codegen_get_method_offset(codegen_context_t *context, const char *method_name);
+size_t codegen_get_method_offset(codegen_context_t *context, const char *class_name, const char *method_name);
+bool codegen_add_method_call(codegen_context_t *context, size_t instruction_index, const char *method_name,
+                             uint64_t receiver_class_id);
+bool codegen_add_line(codegen_context_t *context, size_t instruction_index, const ast_node_t *statement);
 
 // Unique class ID generation functions
 uint64_t codegen_generate_unique_class_id(const char *module_name, const char *class_name);
+// ID of a class used by this module: its own class, else an imported one
+uint64_t codegen_class_id(const codegen_context_t *context, const char *class_name);
 
 bool generate_class(codegen_context_t *context, ast_node_t *node);
 bool generate_field(codegen_context_t *context, ast_node_t *node);
@@ -110,9 +166,22 @@ void emit_call(codegen_context_t *context, uint8_t level, uint64_t address);
 void emit_jump(codegen_context_t *context, uint64_t address);
 void emit_jump_if_false(codegen_context_t *context, uint64_t address);
 
+// Parser string pool index of a literal
+bool codegen_index_string_pool(codegen_context_t *context);
+bool codegen_find_string_literal(const codegen_context_t *context, const char *text, size_t *index);
+
 // Variable management functions
-bool codegen_add_variable(codegen_context_t *context, const char *name, size_t *address);
-bool codegen_find_variable(codegen_context_t *context, const char *name, size_t *address);
+bool codegen_add_variable(codegen_context_t *context, const char *name, uint8_t *level, size_t *address);
+bool codegen_add_local_variable(codegen_context_t *context, const char *name, size_t *address);
+bool codegen_find_variable(codegen_context_t *context, const char *name, uint8_t *level, size_t *address);
+bool codegen_frame_variable(codegen_context_t *context, const char *name, size_t *address);
+uint64_t codegen_receiver_class(codegen_context_t *context, const char *object_name);
+void codegen_set_variable_type(codegen_context_t *context, const char *name, primitive_type_t type);
+primitive_type_t codegen_variable_type(const codegen_context_t *context, const char *name);
+void codegen_set_variable_element(codegen_context_t *context, const char *name, primitive_type_t type);
+primitive_type_t codegen_variable_element(const codegen_context_t *context, const char *name);
+void codegen_set_variable_string(codegen_context_t *context, const char *name, bool is_string);
+bool codegen_variable_is_string(const codegen_context_t *context, const char *name);
 
 // AST-based code generation
 void generate_ast_code(codegen_context_t *context, ast_node_t *node);
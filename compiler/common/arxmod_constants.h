@@ -10,9 +10,17 @@
 
 // ARX Module Format Constants
 #define ARXMOD_MAGIC            "ARXMOD\0\0"
-#define ARXMOD_VERSION          1
+#define ARXMOD_VERSION          2   // Version written by arxmod_writer
+#define ARXMOD_VERSION_FIXED    1   // CODE is an array of 9-byte instruction_t
+#define ARXMOD_VERSION_COMPACT  2   // CODE is varint-encoded, large operands in CONSTS
 #define ARXMOD_HEADER_SIZE      80
 #define ARXMOD_ALIGNMENT        16
+#define ARXMOD_BASE_SECTIONS    7   // TOC entries reserved after the header
+#define ARXMOD_MAX_SECTIONS     8   // Reserved instead by modules with imports (adds EXTERNS)
+
+// Compact code: operands below this are stored inline, larger ones (and
+// negative literals) go to the constant pool
+#define ARXMOD_INLINE_OPERAND_LIMIT (1ULL << 27)
 
 // ARX Module Flags
 #define ARXMOD_FLAG_LIBRARY     0x00000001  // Module is a library (no entry point)
@@ -20,11 +28,21 @@
 
 // Section Names
 #define ARXMOD_SECTION_CODE     "CODE"
+#define ARXMOD_SECTION_CONSTS   "CONSTS"
 #define ARXMOD_SECTION_STRINGS  "STRINGS"
 #define ARXMOD_SECTION_SYMBOLS  "SYMBOLS"
 #define ARXMOD_SECTION_DEBUG    "DEBUG"
 #define ARXMOD_SECTION_CLASSES  "CLASSES"
 #define ARXMOD_SECTION_APP      "APP"
+#define ARXMOD_SECTION_EXTERNS  "EXTERNS"
+
+// External references (EXTERNS section entries)
+#define ARXMOD_EXTERN_CLASS     1   // Class instantiated with new
+#define ARXMOD_EXTERN_METHOD    2   // Method called through VM_CALS
+
+// A VM_CALS operand with this bit set is an EXTERNS entry index instead of
+// a vtable slot; the VM binds it to the method's slot on the first call
+#define ARXMOD_EXTERN_CALL      (1ULL << 63)
 
 // Structure sizes for validation (defined after structures are declared)
 // These will be defined in opcodes.h after the structures are declared
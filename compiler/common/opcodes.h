@@ -32,10 +32,13 @@ typedef enum
     VM_LODX     = 8,        // load indexed v,d with offset loaded onto stack
     VM_STOX     = 9,        // store indexed v,d with offset loaded onto stack
     VM_STRING   = 10,       // load string literal as object 0,string_id
-    VM_HALT     = 11        // halt execution
+    VM_HALT     = 11,       // halt execution
+    VM_CALS     = 12        // call method in vtable slot of object on stack 0,slot
 } opcode_t;
 
-// Operations for VM_OPR (stored in immediate field)
+// Operations for VM_OPR (stored in immediate field). The plain arithmetic
+// and comparisons treat words as signed 64-bit integers; the R-prefixed ones
+// as doubles. Values carry no type tag: the compiler picks the operation.
 typedef enum
 {
     OPR_RET     = 0,        // return from procedure
@@ -69,11 +72,11 @@ typedef enum
     
     // String operations
     OPR_STR_CREATE = 28,    // Create string from literal
-    OPR_STR_SLICE = 29,     // Create string slice
+    OPR_STR_SLICE = 29,     // string from to -> slice sharing the string's bytes
     OPR_STR_CONCAT = 30,    // Concatenate strings
     OPR_STR_LEN = 31,       // Get string length
     OPR_STR_EQ = 32,        // String equality
-    OPR_STR_CMP = 33,       // String comparison
+    OPR_STR_CMP = 33,       // string string -> -1, 0 or 1 (bytewise order)
     OPR_STR_BUILDER_CREATE = 34,  // Create string builder
     OPR_STR_BUILDER_APPEND = 35,  // Append to builder
     OPR_STR_BUILDER_TO_STR = 36,  // Convert builder to string
@@ -89,9 +92,67 @@ typedef enum
     OPR_OBJ_NEW = 46,       // NEW operator
     OPR_OBJ_DOT = 47,       // Dot operator for field/method access
     OPR_SQRT = 48,          // Square root function
-    OPR_REAL_LIT = 49       // Real number literal
+    OPR_REAL_LIT = 49,      // Real number literal
+    
+    // Real (IEEE double) operations; operands are the raw 64-bit patterns
+    OPR_INT_TO_REAL = 50,   // Convert integer to real
+    OPR_REAL_TO_INT = 51,   // Convert real to integer (truncates)
+    OPR_RNEG = 52,          // negate
+    OPR_RADD = 53,          // addition
+    OPR_RSUB = 54,          // subtraction
+    OPR_RMUL = 55,          // multiplication
+    OPR_RDIV = 56,          // division (traps on 0.0)
+    OPR_REQ = 57,           // equality
+    OPR_RNEQ = 58,          // not equal
+    OPR_RLESS = 59,         // less than
+    OPR_RLEQ = 60,          // less than or equal
+    OPR_RGREATER = 61,      // greater than
+    OPR_RGEQ = 62,          // greater than or equal
+    OPR_REAL_TO_STR = 63,   // Convert real to string
+    
+    // Tasks (green threads sharing one VM)
+    OPR_TASK_SPAWN = 64,    // Start a task at the VM_CALS that follows; skip it here
+    OPR_TASK_YIELD = 65,    // Let the next ready task run
+    OPR_TASK_JOIN = 66,     // Wait for a task and take its result
+    
+    // Arrays (heap objects of 64-bit elements); ranges are from..to, to excluded
+    OPR_ARRAY_NEW = 67,     // length kind -> array
+    OPR_ARRAY_LOAD = 68,    // array index -> element
+    OPR_ARRAY_STORE = 69,   // array index value ->
+    OPR_ARRAY_LENGTH = 70,  // array -> length
+    OPR_ARRAY_FILL = 71,    // array from to value ->
+    OPR_ARRAY_COPY = 72,    // target at source from to ->
+    OPR_ARRAY_SLICE = 73,   // array from to -> new array
+    OPR_ARRAY_EQUAL = 74,   // array array -> same kind, length and elements
+    OPR_ARRAY_SUM = 75,     // array from to -> sum
+    OPR_ARRAY_MIN = 76,     // array from to -> smallest element
+    OPR_ARRAY_MAX = 77,     // array from to -> largest element
+    OPR_ARRAY_FIND = 78,    // array from to value -> first index holding value, or -1
+    
+    // More string operations; offsets count bytes
+    OPR_STR_FIND = 79,      // string needle from -> offset of the first match at or after from, or -1
+    OPR_STR_AT = 80,        // string offset -> byte
+    
+    // Objects tied to an activation record (see compiler/optimizer/escape.h)
+    OPR_OBJ_NEW_FRAME = 81, // previous class_id -> object; reuses or frees previous
+    OPR_OBJ_RELEASE = 82,   // object -> (frees it now)
+    
+    // Receiver of a method call the compiler inlined (see compiler/optimizer/inline.h)
+    OPR_OBJ_CHECK = 83      // object -> ; fails like VM_CALS unless it is an object
 } opr_t;
 
+// Highest operation the VM accepts
+#define OPR_LAST OPR_OBJ_CHECK
+
+// Element kinds of OPR_ARRAY_NEW; the values of the compiler's primitive types
+typedef enum
+{
+    ARRAY_OF_INTEGER = 1,
+    ARRAY_OF_BOOLEAN = 2,
+    ARRAY_OF_CHAR = 3,
+    ARRAY_OF_REAL = 4
+} array_kind_t;
+
 // Instruction format (packed for efficiency)
 #pragma pack(push, 1)
 typedef struct
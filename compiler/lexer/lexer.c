@@ -12,60 +12,6 @@
 // Global debug flag (extern from main.c)
 extern bool debug_mode;
 
-// Keyword table
-typedef struct {
-    const char* keyword;
-    token_t token;
-} keyword_entry_t;
-
-static const keyword_entry_t keywords[] = {
-    {"program", TOK_PROGRAM},
-    {"begin", TOK_BEGIN},
-    {"end", TOK_END},
-    {"var", TOK_VAR},
-    {"while", TOK_WHILE},
-    {"do", TOK_DO},
-    {"procedure", TOK_PROCEDURE},
-    {"call", TOK_CALL},
-    {"const", TOK_CONST},
-    {"if", TOK_IF},
-    {"then", TOK_THEN},
-    {"odd", TOK_ODD},
-    {"else", TOK_ELSE},
-    {"elseif", TOK_ELSEIF},
-    {"shr", TOK_SHR},
-    {"shl", TOK_SHL},
-    {"sar", TOK_SAR},
-    {"for", TOK_FOR},
-    {"to", TOK_TO},
-    {"downto", TOK_DOWNTO},
-    {"integer", TOK_INTEGER},
-    {"boolean", TOK_BOOLEAN},
-    {"char", TOK_CHAR},
-    {"string", TOK_STRING},
-    {"of", TOK_OF},
-    {"array", TOK_ARRAY},
-    {"writeln", TOK_WRITELN},
-    {"class", TOK_CLASS},
-    {"extends", TOK_EXTENDS},
-    {"new", TOK_NEW},
-    {"function", TOK_FUNCTION},
-    {"return", TOK_RETURN},
-    {"self", TOK_SELF},
-    {"sqrt", TOK_SQRT},
-    {"real", TOK_REAL},
-    {"app", TOK_APP},
-    {"module", TOK_MODULE},
-    {"import", TOK_IMPORT},
-    {"public", TOK_PUBLIC},
-    {"private", TOK_PRIVATE},
-    {"protected", TOK_PROTECTED},
-    {"true", TOK_TRUE},
-    {"false", TOK_FALSE},
-    {"null", TOK_NULL},
-    {NULL, TOK_NONE}
-};
-
 bool lexer_init(lexer_context_t *context, char *source, size_t source_len)
 {
     if (context == NULL || source == NULL) {
@@ -75,13 +21,13 @@ bool lexer_init(lexer_context_t *context, char *source, size_t source_len)
     context->src = source;
     context->src_len = source_len;
     context->tokstart = source;
+    context->tokoffset = 0;
     context->toklen = 0;
     context->token = TOK_NONE;
     context->state = LS_IDLE;
     context->linenum = 1;
     context->number = 0;
     context->string_quote = 0;
-    context->string_content[0] = '\0';
     context->pos = 0;
     
     if (debug_mode) {
@@ -146,6 +92,7 @@ bool lexer_next(lexer_context_t *context)
     }
     
     // Set token start
+    context->tokoffset = context->pos;
     context->tokstart = &context->src[context->pos];
     context->toklen = 0;
     
@@ -183,6 +130,51 @@ bool lexer_next(lexer_context_t *context)
         }
         context->token = TOK_NUMBER;
         
+        // A fraction (digits after the point) or an exponent makes it real
+        size_t end = context->pos;
+        bool is_real = false;
+        if (end + 1 < context->src_len && context->src[end] == '.' && is_digit(context->src[end + 1])) {
+            end++;
+            while (end < context->src_len && is_digit(context->src[end])) {
+                end++;
+            }
+            is_real = true;
+        }
+        if (end < context->src_len && (context->src[end] == 'e' || context->src[end] == 'E')) {
+            size_t digits = end + 1;
+            if (digits < context->src_len && (context->src[digits] == '+' || context->src[digits] == '-')) {
+                digits++;
+            }
+            if (digits < context->src_len && is_digit(context->src[digits])) {
+                end = digits;
+                while (end < context->src_len && is_digit(context->src[end])) {
+                    end++;
+                }
+                is_real = true;
+            }
+        }
+        
+        if (is_real) {
+            // strtod() needs a terminated copy; the source is a slice
+            char text[64];
+            size_t length = end - context->tokoffset;
+            if (length >= sizeof(text)) {
+                length = sizeof(text) - 1;
+            }
+            memcpy(text, context->tokstart, length);
+            text[length] = '\0';
+            double value = strtod(text, NULL);
+            memcpy(&context->number, &value, sizeof(value));
+            context->toklen = (int64_t)(end - context->tokoffset);
+            context->pos = end;
+            context->token = TOK_REAL_NUMBER;
+            
+            if (debug_mode) {
+                printf("Token: REAL_NUMBER (%g)\n", value);
+            }
+            return true;
+        }
+        
         if (debug_mode) {
             printf("Token: NUMBER (%llu)\n", (unsigned long long)context->number);
         }
@@ -190,22 +182,20 @@ bool lexer_next(lexer_context_t *context)
         return true;
     }
     
-    // Handle string literals
+    // Handle string literals; the token is the text between the quotes
     if (c == '"' || c == '\'') {
         context->string_quote = c;
         context->pos++; // Skip opening quote
-        context->toklen = 0;
+        context->tokoffset = context->pos;
+        context->tokstart = &context->src[context->pos];
         
-        while (context->pos < context->src_len && context->src[context->pos] != c) {
-            if (context->src[context->pos] == '\n') {
-                context->linenum++;
-            }
-            if (context->toklen < sizeof(context->string_content) - 1) {
-                context->string_content[context->toklen] = context->src[context->pos];
-                context->toklen++;
-            }
-            context->pos++;
+        const char *close = memchr(context->tokstart, c, context->src_len - context->pos);
+        size_t end = close != NULL ? (size_t)(close - context->src) : context->src_len;
+        for (const char *p = context->tokstart; (p = memchr(p, '\n', end - (size_t)(p - context->src))) != NULL; p++) {
+            context->linenum++;
         }
+        context->toklen = (int64_t)(end - context->pos);
+        context->pos = end;
         
         if (debug_mode) {
             printf("Lexer: Found closing quote at position %zu, character: '%c'\n", 
@@ -216,15 +206,10 @@ bool lexer_next(lexer_context_t *context)
             context->pos++; // Skip closing quote
         }
         
-        context->string_content[context->toklen] = '\0';
         context->token = TOK_STRING;
         
-        // Set tokstart and toklen for string literals
-        context->tokstart = context->string_content;
-        context->toklen = strlen(context->string_content);
-        
         if (debug_mode) {
-            printf("Token: STRING (\"%s\")\n", context->string_content);
+            printf("Token: STRING (\"%.*s\")\n", (int)context->toklen, context->tokstart);
         }
         
         return true;
@@ -441,11 +426,26 @@ bool lexer_next(lexer_context_t *context)
 void lexer_cleanup(lexer_context_t *context)
 {
     if (context != NULL) {
-        // Nothing to clean up for now
+        // The source buffer belongs to the caller
         memset(context, 0, sizeof(lexer_context_t));
     }
 }
 
+// NUL-terminated copy of the current token text, for callers that keep it
+char *lexer_token_text(const lexer_context_t *context)
+{
+    if (context == NULL || context->tokstart == NULL || context->toklen < 0) {
+        return NULL;
+    }
+    
+    char *text = malloc((size_t)context->toklen + 1);
+    if (text != NULL) {
+        memcpy(text, context->tokstart, (size_t)context->toklen);
+        text[context->toklen] = '\0';
+    }
+    return text;
+}
+
 const char* token_to_string(token_t token)
 {
     switch (token) {
@@ -483,6 +483,7 @@ const char* token_to_string(token_t token)
         case TOK_DOUBLEPERIOD: return "DOUBLEPERIOD";
         case TOK_LBRACE: return "LBRACE";
         case TOK_RBRACE: return "RBRACE";
+        case TOK_REAL_NUMBER: return "REAL_NUMBER";
         case TOK_PROGRAM: return "PROGRAM";
         case TOK_BEGIN: return "BEGIN";
         case TOK_END: return "END";
@@ -526,6 +527,9 @@ const char* token_to_string(token_t token)
         case TOK_TRUE: return "TRUE";
         case TOK_FALSE: return "FALSE";
         case TOK_NULL: return "NULL";
+        case TOK_SPAWN: return "SPAWN";
+        case TOK_YIELD: return "YIELD";
+        case TOK_JOIN: return "JOIN";
         default: return "UNKNOWN";
     }
 }
@@ -535,13 +539,98 @@ bool is_keyword(const char* str, size_t len)
     return keyword_to_token(str, len) != TOK_NONE;
 }
 
+// Compare against one candidate keyword of the right length
+static inline token_t keyword_match(const char *str, size_t len, const char *keyword, token_t token)
+{
+    return memcmp(str, keyword, len) == 0 ? token : TOK_NONE;
+}
+
+// Keywords are told apart by length and first character, so an identifier
+// costs at most a few byte compares
 token_t keyword_to_token(const char* str, size_t len)
 {
-    for (int i = 0; keywords[i].keyword != NULL; i++) {
-        if (strlen(keywords[i].keyword) == len && 
-            strncmp(keywords[i].keyword, str, len) == 0) {
-            return keywords[i].token;
-        }
+    token_t token = TOK_NONE;
+    
+    switch (len) {
+        case 2:
+            switch (str[0]) {
+                case 'd': return keyword_match(str, len, "do", TOK_DO);
+                case 'i': return keyword_match(str, len, "if", TOK_IF);
+                case 'o': return keyword_match(str, len, "of", TOK_OF);
+                case 't': return keyword_match(str, len, "to", TOK_TO);
+            }
+            break;
+        case 3:
+            switch (str[0]) {
+                case 'a': return keyword_match(str, len, "app", TOK_APP);
+                case 'e': return keyword_match(str, len, "end", TOK_END);
+                case 'f': return keyword_match(str, len, "for", TOK_FOR);
+                case 'n': return keyword_match(str, len, "new", TOK_NEW);
+                case 'o': return keyword_match(str, len, "odd", TOK_ODD);
+                case 'v': return keyword_match(str, len, "var", TOK_VAR);
+                case 's':
+                    if ((token = keyword_match(str, len, "shr", TOK_SHR)) != TOK_NONE) return token;
+                    if ((token = keyword_match(str, len, "shl", TOK_SHL)) != TOK_NONE) return token;
+                    return keyword_match(str, len, "sar", TOK_SAR);
+            }
+            break;
+        case 4:
+            switch (str[0]) {
+                case 'c':
+                    if ((token = keyword_match(str, len, "call", TOK_CALL)) != TOK_NONE) return token;
+                    return keyword_match(str, len, "char", TOK_CHAR);
+                case 'e': return keyword_match(str, len, "else", TOK_ELSE);
+                case 'j': return keyword_match(str, len, "join", TOK_JOIN);
+                case 'n': return keyword_match(str, len, "null", TOK_NULL);
+                case 'r': return keyword_match(str, len, "real", TOK_REAL);
+                case 's':
+                    if ((token = keyword_match(str, len, "self", TOK_SELF)) != TOK_NONE) return token;
+                    return keyword_match(str, len, "sqrt", TOK_SQRT);
+                case 't':
+                    if ((token = keyword_match(str, len, "then", TOK_THEN)) != TOK_NONE) return token;
+                    return keyword_match(str, len, "true", TOK_TRUE);
+            }
+            break;
+        case 5:
+            switch (str[0]) {
+                case 'a': return keyword_match(str, len, "array", TOK_ARRAY);
+                case 'b': return keyword_match(str, len, "begin", TOK_BEGIN);
+                case 'f': return keyword_match(str, len, "false", TOK_FALSE);
+                case 's': return keyword_match(str, len, "spawn", TOK_SPAWN);
+                case 'w': return keyword_match(str, len, "while", TOK_WHILE);
+                case 'y': return keyword_match(str, len, "yield", TOK_YIELD);
+                case 'c':
+                    if ((token = keyword_match(str, len, "const", TOK_CONST)) != TOK_NONE) return token;
+                    return keyword_match(str, len, "class", TOK_CLASS);
+            }
+            break;
+        case 6:
+            switch (str[0]) {
+                case 'd': return keyword_match(str, len, "downto", TOK_DOWNTO);
+                case 'e': return keyword_match(str, len, "elseif", TOK_ELSEIF);
+                case 'i': return keyword_match(str, len, "import", TOK_IMPORT);
+                case 'm': return keyword_match(str, len, "module", TOK_MODULE);
+                case 'p': return keyword_match(str, len, "public", TOK_PUBLIC);
+                case 'r': return keyword_match(str, len, "return", TOK_RETURN);
+                case 's': return keyword_match(str, len, "string", TOK_STRING);
+            }
+            break;
+        case 7:
+            switch (str[0]) {
+                case 'b': return keyword_match(str, len, "boolean", TOK_BOOLEAN);
+                case 'e': return keyword_match(str, len, "extends", TOK_EXTENDS);
+                case 'i': return keyword_match(str, len, "integer", TOK_INTEGER);
+                case 'w': return keyword_match(str, len, "writeln", TOK_WRITELN);
+                case 'p':
+                    if ((token = keyword_match(str, len, "program", TOK_PROGRAM)) != TOK_NONE) return token;
+                    return keyword_match(str, len, "private", TOK_PRIVATE);
+            }
+            break;
+        case 8:
+            return keyword_match(str, len, "function", TOK_FUNCTION);
+        case 9:
+            if ((token = keyword_match(str, len, "procedure", TOK_PROCEDURE)) != TOK_NONE) return token;
+            return keyword_match(str, len, "protected", TOK_PROTECTED);
     }
     return TOK_NONE;
 }
@@ -45,6 +45,7 @@ typedef enum
     TOK_DOUBLEPERIOD,
     TOK_LBRACE,             // {
     TOK_RBRACE,             // }
+    TOK_REAL_NUMBER,        // 1.5, 2.0e-3
     
     // Keywords (start at 100)
     TOK_PROGRAM = 100,
@@ -90,7 +91,10 @@ typedef enum
     TOK_PROTECTED,
     TOK_TRUE,
     TOK_FALSE,
-    TOK_NULL
+    TOK_NULL,
+    TOK_SPAWN,
+    TOK_YIELD,
+    TOK_JOIN
 } token_t;
 
 // Lexer state
@@ -104,19 +108,20 @@ typedef enum
     LS_BLOCKCOMMENT
 } lexstate_t;
 
-// Lexer context
+// Lexer context. Token text is a slice of the source buffer (tokoffset,
+// toklen); it is not NUL-terminated, so callers copy what they keep.
 typedef struct
 {
     char    *src;           // pointer to the source code
     size_t  src_len;        // length of source code
-    char    *tokstart;      // pointer to start of current token string
+    char    *tokstart;      // pointer to start of current token string (src + tokoffset)
+    size_t  tokoffset;      // offset of current token text in src
     int64_t toklen;         // length of current token
     token_t token;          // current token type
     lexstate_t state;       // analyser state
     int64_t linenum;        // current line number
-    uint64_t number;        // value of integer literal
+    uint64_t number;        // value of integer literal, bit pattern of a real one
     char string_quote;      // quote character that started current string
-    char string_content[256]; // content of current string literal
     size_t pos;             // current position in source
 } lexer_context_t;
 
@@ -124,6 +129,7 @@ typedef struct
 bool lexer_init(lexer_context_t *context, char *source, size_t source_len);
 bool lexer_next(lexer_context_t *context);
 void lexer_cleanup(lexer_context_t *context);
+char *lexer_token_text(const lexer_context_t *context);
 
 // Utility functions
 const char* token_to_string(token_t token);
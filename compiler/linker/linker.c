@@ -54,6 +54,22 @@ bool linker_init(linker_context_t *linker, class_entry_t *classes, size_t class_
     linker->base_address = 0x1000; // Start at address 0x1000
     linker->current_offset = linker->base_address;
     
+    // Index classes and methods so each lookup is a hash probe
+    name_index_init(&linker->class_index);
+    name_index_init(&linker->method_index);
+    for (size_t i = 0; i < class_count; i++) {
+        if (!name_index_push(&linker->class_index, name_index_hash_id(classes[i].class_id))) {
+            linker_cleanup(linker);
+            return false;
+        }
+    }
+    for (size_t i = 0; i < method_count; i++) {
+        if (!name_index_push(&linker->method_index, name_index_hash(methods[i].method_name))) {
+            linker_cleanup(linker);
+            return false;
+        }
+    }
+    
     printf("Linker initialized with %zu classes, %zu methods, %zu fields\n", 
            class_count, method_count, field_count);
     return true;
@@ -64,7 +80,43 @@ void linker_cleanup(linker_context_t *linker)
     if (linker) {
         // Note: We don't free the arrays here as they're owned by the caller
         // (the code generator that collected them from the AST)
+        name_index_cleanup(&linker->class_index);
+        name_index_cleanup(&linker->method_index);
+    }
+}
+
+// First class in the manifest with this ID
+static class_entry_t *linker_find_class(linker_context_t *linker, uint64_t class_id)
+{
+    class_entry_t *found = NULL;
+    uint32_t hash = name_index_hash_id(class_id);
+    
+    // Chains run newest first; the last match is the first class
+    for (size_t i = name_index_first(&linker->class_index, hash); i != NAME_INDEX_NONE;
+         i = name_index_next(&linker->class_index, i)) {
+        if (linker->classes[i].class_id == class_id) {
+            found = &linker->classes[i];
+        }
     }
+    return found;
+}
+
+// First method in the manifest with this name
+const method_entry_t *linker_find_method(linker_context_t *linker, const char *method_name)
+{
+    if (!linker || !method_name) {
+        return NULL;
+    }
+    
+    const method_entry_t *found = NULL;
+    uint32_t hash = name_index_hash(method_name);
+    for (size_t i = name_index_first(&linker->method_index, hash); i != NAME_INDEX_NONE;
+         i = name_index_next(&linker->method_index, i)) {
+        if (strcmp(linker->methods[i].method_name, method_name) == 0) {
+            found = &linker->methods[i];
+        }
+    }
+    return found;
 }
 
 bool linker_resolve_method_address(linker_context_t *linker, uint64_t class_id, const char *method_name, uint64_t *address)
@@ -74,30 +126,22 @@ bool linker_resolve_method_address(linker_context_t *linker, uint64_t class_id,
     }
     
     // Find the class
-    class_entry_t *class_entry = NULL;
-    for (size_t i = 0; i < linker->class_count; i++) {
-        if (linker->classes[i].class_id == class_id) {
-            class_entry = &linker->classes[i];
-            break;
-        }
-    }
-    
+    class_entry_t *class_entry = linker_find_class(linker, class_id);
     if (!class_entry) {
         printf("Linker: Class ID %llu not found\n", (unsigned long long)class_id);
         return false;
     }
     
     // Find the method in the method manifest
-    for (size_t i = 0; i < linker->method_count; i++) {
-        if (strcmp(linker->methods[i].method_name, method_name) == 0) {
-            // Calculate address based on class base and method offset
-            *address = linker->base_address + linker->methods[i].offset;
-            
-            printf("Linker: Resolved method '%s' for class %llu to address 0x%llx (offset 0x%llx)\n", 
-                   method_name, (unsigned long long)class_id, (unsigned long long)*address, 
-                   (unsigned long long)linker->methods[i].offset);
-            return true;
-        }
+    const method_entry_t *method = linker_find_method(linker, method_name);
+    if (method) {
+        // Calculate address based on class base and method offset
+        *address = linker->base_address + method->offset;
+        
+        printf("Linker: Resolved method '%s' for class %llu to address 0x%llx (offset 0x%llx)\n", 
+               method_name, (unsigned long long)class_id, (unsigned long long)*address, 
+               (unsigned long long)method->offset);
+        return true;
     }
     
     printf("Linker: Method '%s' not found for class %llu\n", method_name, (unsigned long long)class_id);
@@ -111,14 +155,7 @@ bool linker_calculate_class_layout(linker_context_t *linker, uint64_t class_id,
     }
     
     // Find the class
-    class_entry_t *class_entry = NULL;
-    for (size_t i = 0; i < linker->class_count; i++) {
-        if (linker->classes[i].class_id == class_id) {
-            class_entry = &linker->classes[i];
-            break;
-        }
-    }
-    
+    class_entry_t *class_entry = linker_find_class(linker, class_id);
     if (!class_entry) {
         printf("Linker: Class ID %llu not found for layout calculation\n", (unsigned long long)class_id);
         return false;
@@ -155,137 +192,228 @@ bool linker_calculate_class_layout(linker_context_t *linker, uint64_t class_id,
     return true;
 }
 
-bool linker_patch_bytecode(linker_context_t *linker, instruction_t *instructions, size_t instruction_count, const char **string_table, size_t string_count)
+bool linker_patch_bytecode(linker_context_t *linker, instruction_t *instructions, size_t instruction_count, const linker_method_call_t *calls, size_t call_count, linker_imports_t *imports)
 {
-    printf("DEBUG: linker_patch_bytecode called with instruction_count=%zu, string_count=%zu\n", instruction_count, string_count);
-    
-    if (!linker || !instructions) {
+    if (!linker || !instructions || (call_count > 0 && !calls)) {
         printf("DEBUG: linker_patch_bytecode failed - null parameters\n");
         return false;
     }
     
-    printf("Linker: Patching %zu instructions\n", instruction_count);
-    printf("Linker: String table has %zu strings\n", string_count);
+    printf("Linker: Patching %zu method calls in %zu instructions\n", call_count, instruction_count);
     
-    // Scan through instructions looking for method calls that need address resolution
+    // Each VM_CALS gets the vtable slot of the method it names. Slots are the
+    // method IDs of the manifest, shared by every class defining that name.
     size_t patched_count = 0;
-    
-    for (size_t i = 0; i < instruction_count; i++) {
-        instruction_t *inst = &instructions[i];
-        uint8_t opcode = inst->opcode;
-        uint64_t operand = inst->opt64;
-        
-        // Check if this instruction needs address resolution
-        bool needs_patching = false;
-        uint64_t new_address = 0;
-        
-        // Debug: Print instruction details
-        if (i < 20) { // Only print first 20 instructions
-            printf("Linker: Instruction %zu: opcode=%d, operand=%llu\n", i, opcode, (unsigned long long)operand);
+    for (size_t i = 0; i < call_count; i++) {
+        size_t index = calls[i].instruction_index;
+        if (index >= instruction_count || (instructions[index].opcode & 0x0F) != VM_CALS) {
+            printf("Linker: Call site %zu is not a VM_CALS instruction\n", index);
+            return false;
         }
         
-        // Skip jump instructions - they should already be resolved by resolve_labels()
-        if (opcode == VM_JMP || opcode == VM_JPC) {
-            if (i < 20) {
-                printf("Linker: Skipping jump instruction %zu (already resolved by codegen)\n", i);
-            }
+        const method_entry_t *method = linker_find_method(linker, calls[i].method_name);
+        if (method) {
+            instructions[index].opt64 = method->method_id;
+            patched_count++;
+            
+            printf("Linker: Patched call to '%s' at instruction %zu with slot %llu\n",
+                   calls[i].method_name, index, (unsigned long long)method->method_id);
             continue;
         }
         
-        if (opcode == VM_CAL && operand == 0) {
-            // Method call with placeholder address - this should be resolved by the compiler
-            // For now, we'll leave these as placeholders since the VM handles them
-            needs_patching = false;
-        } else if (opcode == VM_LIT) {
-            // Don't patch string literals - let the VM handle method resolution at runtime
-            // The VM should use the class manifest to resolve method calls
-            needs_patching = false;
-        } else if (opcode == VM_OPR) {
-            // Check for object operations that might need patching
-            if (operand == OPR_OBJ_NEW) {
-                // NEW object creation - operand should be class ID (already correct)
-                needs_patching = false;
-            } else if (operand == OPR_OBJ_CALL_METHOD) {
-                // Method call - check if the previous instruction is a placeholder offset
-                if (i > 0 && instructions[i-1].opcode == VM_LIT && instructions[i-1].opt64 == 0xFFFF) {
-                    // This is a method call with placeholder offset - we need to patch it
-                    // Use the actual method offset from the class manifest
-                    
-                    if (patched_count < linker->method_count) {
-                        // Use the actual method offset from the methods array
-                        uint64_t method_offset = linker->methods[patched_count].offset;
-                        instructions[i-1].opt64 = method_offset;
-                        
-                        printf("Linker: Patched method call at instruction %zu with actual offset %llu (method: %s)\n", 
-                               i-1, (unsigned long long)method_offset, linker->methods[patched_count].method_name);
-                    } else {
-                        printf("Linker: Warning - method call at instruction %zu exceeds method count (%zu)\n", 
-                               i-1, linker->method_count);
-                        // Keep placeholder for now
-                        instructions[i-1].opt64 = 0xFFFF;
-                    }
-                    patched_count++;
-                }
-                // Don't patch the OPR_OBJ_CALL_METHOD instruction itself
-                needs_patching = false;
-            // Field access opcodes removed - fields are accessed directly by name within class methods
-            }
+        // A method only an imported module defines is called through an
+        // external reference, which the VM binds on the first call
+        size_t module = 0;
+        size_t extern_index = 0;
+        if (!imports || !linker_imports_find_method(imports, calls[i].method_name, &module)) {
+            printf("Linker: Method '%s' called at instruction %zu is not defined by any class\n",
+                   calls[i].method_name, index);
+            return false;
         }
-        
-        if (needs_patching) {
-            // Update the instruction operand
-            inst->opt64 = new_address;
-            patched_count++;
-            
-            printf("Linker: Patched instruction %zu: opcode=%d, new_address=0x%llx\n",
-                   i, opcode, (unsigned long long)new_address);
+        if (!linker_imports_add_extern(imports, ARXMOD_EXTERN_METHOD, module, calls[i].method_name, 0, &extern_index)) {
+            return false;
         }
+        
+        instructions[index].opt64 = ARXMOD_EXTERN_CALL | extern_index;
+        patched_count++;
+        
+        printf("Linker: Patched call to '%s' at instruction %zu with external reference %zu (module %s)\n",
+               calls[i].method_name, index, extern_index, imports->modules[module].module_name);
     }
     
     printf("Linker: Patched %zu instructions\n", patched_count);
     return true;
 }
 
-bool linker_update_class_manifest(linker_context_t *linker, instruction_t *instructions, size_t instruction_count)
+void linker_imports_init(linker_imports_t *imports)
+{
+    if (imports) {
+        memset(imports, 0, sizeof(linker_imports_t));
+    }
+}
+
+void linker_imports_cleanup(linker_imports_t *imports)
+{
+    if (!imports) {
+        return;
+    }
+    
+    for (size_t i = 0; i < imports->module_count; i++) {
+        free(imports->modules[i].classes);
+        free(imports->modules[i].methods);
+        name_index_cleanup(&imports->modules[i].class_index);
+        name_index_cleanup(&imports->modules[i].method_index);
+    }
+    free(imports->modules);
+    free(imports->externs);
+    memset(imports, 0, sizeof(linker_imports_t));
+}
+
+// Read the class manifest of a compiled module. Only its CLASSES section is
+// used: the importing module needs the class IDs and method names, not the code.
+bool linker_imports_load(linker_imports_t *imports, const char *module_name, const char *path)
 {
-    if (!linker || !instructions) {
-        printf("DEBUG: linker_update_class_manifest failed - null parameters\n");
+    if (!imports || !module_name || !path) {
         return false;
     }
     
-    printf("Linker: Updating class manifest with correct method offsets\n");
+    arxmod_reader_t reader;
+    if (!arxmod_reader_init(&reader, path)) {
+        printf("Linker: Cannot open module '%s' (%s)\n", module_name, path);
+        return false;
+    }
     
-    // Scan through instructions to find method call patterns and update the manifest
-    size_t method_call_count = 0;
+    linker_import_t module;
+    memset(&module, 0, sizeof(module));
+    module.module_name = module_name;
+    bool loaded = arxmod_reader_validate(&reader) && arxmod_reader_load_toc(&reader) &&
+                  arxmod_reader_load_classes_section(&reader, &module.classes, &module.class_count,
+                                                     &module.methods, &module.method_count, NULL, NULL);
+    arxmod_reader_cleanup(&reader);
+    if (!loaded) {
+        printf("Linker: '%s' is not a valid ARX module\n", path);
+        return false;
+    }
     
-    for (size_t i = 0; i < instruction_count; i++) {
-        instruction_t *inst = &instructions[i];
-        uint8_t opcode = inst->opcode;
-        uint64_t operand = inst->opt64;
-        
-        if (opcode == VM_OPR && operand == OPR_OBJ_CALL_METHOD) {
-            // Found a method call - check if the previous instruction is a method offset
-            if (i > 0 && instructions[i-1].opcode == VM_LIT) {
-                uint64_t method_offset = instructions[i-1].opt64;
-                
-                // Update the corresponding method in the manifest
-                if (method_call_count < linker->method_count) {
-                    // Update the method offset in the manifest
-                    linker->methods[method_call_count].offset = method_offset;
-                    
-                    printf("Linker: Updated method '%s' offset to %llu in manifest\n", 
-                           linker->methods[method_call_count].method_name, 
-                           (unsigned long long)method_offset);
-                    
-                    method_call_count++;
-                } else {
-                    printf("Linker: Warning - method call %zu exceeds method count (%zu)\n", 
-                           method_call_count, linker->method_count);
-                }
+    name_index_init(&module.class_index);
+    name_index_init(&module.method_index);
+    bool indexed = true;
+    for (size_t i = 0; i < module.class_count && indexed; i++) {
+        indexed = name_index_push(&module.class_index, name_index_hash(module.classes[i].class_name));
+    }
+    for (size_t i = 0; i < module.method_count && indexed; i++) {
+        indexed = name_index_push(&module.method_index, name_index_hash(module.methods[i].method_name));
+    }
+    
+    linker_import_t *modules = indexed ?
+        realloc(imports->modules, (imports->module_count + 1) * sizeof(linker_import_t)) : NULL;
+    if (!modules) {
+        free(module.classes);
+        free(module.methods);
+        name_index_cleanup(&module.class_index);
+        name_index_cleanup(&module.method_index);
+        return false;
+    }
+    imports->modules = modules;
+    imports->modules[imports->module_count++] = module;
+    
+    printf("Linker: Imported module %s from %s: %zu classes, %zu methods\n",
+           module_name, path, module.class_count, module.method_count);
+    return true;
+}
+
+// First imported class with this name; *module receives its module's index
+const class_entry_t *linker_imports_find_class(const linker_imports_t *imports, const char *class_name, size_t *module)
+{
+    if (!imports || !class_name) {
+        return NULL;
+    }
+    
+    uint32_t hash = name_index_hash(class_name);
+    for (size_t m = 0; m < imports->module_count; m++) {
+        const linker_import_t *import = &imports->modules[m];
+        const class_entry_t *found = NULL;
+        for (size_t i = name_index_first(&import->class_index, hash); i != NAME_INDEX_NONE;
+             i = name_index_next(&import->class_index, i)) {
+            if (strncmp(import->classes[i].class_name, class_name, sizeof(import->classes[i].class_name)) == 0) {
+                found = &import->classes[i];
             }
         }
+        if (found) {
+            if (module) {
+                *module = m;
+            }
+            return found;
+        }
+    }
+    return NULL;
+}
+
+// First imported method with this name, searching modules in import order
+const method_entry_t *linker_imports_find_method(const linker_imports_t *imports, const char *method_name, size_t *module)
+{
+    if (!imports || !method_name) {
+        return NULL;
     }
     
-    printf("Linker: Updated %zu method offsets in class manifest\n", method_call_count);
+    uint32_t hash = name_index_hash(method_name);
+    for (size_t m = 0; m < imports->module_count; m++) {
+        const linker_import_t *import = &imports->modules[m];
+        const method_entry_t *found = NULL;
+        for (size_t i = name_index_first(&import->method_index, hash); i != NAME_INDEX_NONE;
+             i = name_index_next(&import->method_index, i)) {
+            if (strncmp(import->methods[i].method_name, method_name, sizeof(import->methods[i].method_name)) == 0) {
+                found = &import->methods[i];
+            }
+        }
+        if (found) {
+            if (module) {
+                *module = m;
+            }
+            return found;
+        }
+    }
+    return NULL;
+}
+
+// Index of the reference to name in module, added on first use
+bool linker_imports_add_extern(linker_imports_t *imports, uint32_t reference_type, size_t module, const char *name, uint64_t class_id, size_t *index)
+{
+    if (!imports || !name || module >= imports->module_count) {
+        return false;
+    }
+    
+    const char *module_name = imports->modules[module].module_name;
+    for (size_t i = 0; i < imports->extern_count; i++) {
+        const external_ref_t *ref = &imports->externs[i];
+        if (ref->reference_type == reference_type && strcmp(ref->name, name) == 0 &&
+            strcmp(ref->module_name, module_name) == 0) {
+            if (index) {
+                *index = i;
+            }
+            return true;
+        }
+    }
+    
+    if (imports->extern_count >= imports->extern_capacity) {
+        size_t new_capacity = imports->extern_capacity == 0 ? 8 : imports->extern_capacity * 2;
+        external_ref_t *new_externs = realloc(imports->externs, new_capacity * sizeof(external_ref_t));
+        if (!new_externs) {
+            return false;
+        }
+        imports->externs = new_externs;
+        imports->extern_capacity = new_capacity;
+    }
+    
+    external_ref_t *ref = &imports->externs[imports->extern_count];
+    memset(ref, 0, sizeof(external_ref_t));
+    strncpy(ref->module_name, module_name, sizeof(ref->module_name) - 1);
+    strncpy(ref->name, name, sizeof(ref->name) - 1);
+    ref->external_class_id = class_id;
+    ref->reference_type = reference_type;
+    if (index) {
+        *index = imports->extern_count;
+    }
+    imports->extern_count++;
     return true;
 }
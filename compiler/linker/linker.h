@@ -5,6 +5,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include "../arxmod/arxmod.h"
+#include "../symbols/name_index.h"
 
 // Linker context for resolving addresses
 typedef struct {
@@ -16,6 +17,8 @@ typedef struct {
     size_t field_count;               // Number of fields
     uint64_t base_address;            // Base address for class layout
     uint64_t current_offset;          // Current offset in memory layout
+    name_index_t class_index;         // Classes by class ID
+    name_index_t method_index;        // Methods by name
 } linker_context_t;
 
 // Method resolution entry
@@ -34,12 +37,49 @@ typedef struct {
     uint64_t size;                    // Size of field
 } field_layout_t;
 
+// Method call site: a VM_CALS instruction and the method it calls
+typedef struct {
+    size_t instruction_index;         // Index of the VM_CALS instruction
+    char *method_name;                // Called method name
+    uint64_t receiver_class_id;       // Exact class of the receiver if known at compile time, else 0
+} linker_method_call_t;
+
+// Class manifest of an imported module, read from its compiled .arxmod
+typedef struct {
+    const char *module_name;          // Name used by the import declaration
+    class_entry_t *classes;           // Its classes
+    size_t class_count;               // Number of classes
+    method_entry_t *methods;          // Their methods
+    size_t method_count;              // Number of methods
+    name_index_t class_index;         // Classes by name
+    name_index_t method_index;        // Methods by name
+} linker_import_t;
+
+// Modules the compiled module imports and the references to them it makes.
+// References become the EXTERNS section; a class or method is only listed
+// once, however often it is used.
+typedef struct {
+    linker_import_t *modules;         // Imported modules, in import order
+    size_t module_count;              // Number of imported modules
+    external_ref_t *externs;          // References collected so far
+    size_t extern_count;              // Number of references
+    size_t extern_capacity;           // Capacity of externs array
+} linker_imports_t;
+
 // Linker functions
 bool linker_init(linker_context_t *linker, class_entry_t *classes, size_t class_count, method_entry_t *methods, size_t method_count, field_entry_t *fields, size_t field_count);
 void linker_cleanup(linker_context_t *linker);
+const method_entry_t *linker_find_method(linker_context_t *linker, const char *method_name);
 bool linker_resolve_method_address(linker_context_t *linker, uint64_t class_id, const char *method_name, uint64_t *address);
 bool linker_calculate_class_layout(linker_context_t *linker, uint64_t class_id, uint64_t *instance_size, field_layout_t **fields, size_t *field_count);
-bool linker_patch_bytecode(linker_context_t *linker, instruction_t *instructions, size_t instruction_count, const char **string_table, size_t string_count);
-bool linker_update_class_manifest(linker_context_t *linker, instruction_t *instructions, size_t instruction_count);
+bool linker_patch_bytecode(linker_context_t *linker, instruction_t *instructions, size_t instruction_count, const linker_method_call_t *calls, size_t call_count, linker_imports_t *imports);
+
+// Imported modules
+void linker_imports_init(linker_imports_t *imports);
+void linker_imports_cleanup(linker_imports_t *imports);
+bool linker_imports_load(linker_imports_t *imports, const char *module_name, const char *path);
+const class_entry_t *linker_imports_find_class(const linker_imports_t *imports, const char *class_name, size_t *module);
+const method_entry_t *linker_imports_find_method(const linker_imports_t *imports, const char *method_name, size_t *module);
+bool linker_imports_add_extern(linker_imports_t *imports, uint32_t reference_type, size_t module, const char *name, uint64_t class_id, size_t *index);
 
 #endif // ARX_LINKER_H
@@ -9,18 +9,35 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 // Compiler modules
 #include "lexer/lexer.h"
 #include "parser/parser.h"
 #include "codegen/codegen.h"
+#include "optimizer/optimizer.h"
+#include "optimizer/inline.h"
+#include "arena/arena.h"
 #include "arxmod/arxmod.h"
+#include "linker/linker.h"
 #include "common/opcodes.h"
 
 // Global flags
 bool debug_mode = false;
 bool show_bytecode = false;
 bool show_symbols = false;
+bool show_arena_stats = false;
+int optimization_level = OPTIMIZER_LEVEL_NONE;
+size_t inline_limit = INLINE_DEFAULT_LIMIT;
+bool inline_report = false;
+size_t parallel_jobs = 1;
+const char *build_cache_dir = NULL;
+#define MAX_MODULE_PATHS 16
+const char *module_paths[MAX_MODULE_PATHS]; // -module-path directories, searched in order
+size_t module_path_count = 0;
 
 // Function prototypes
 void print_usage(const char* program_name);
@@ -63,6 +80,70 @@ int main(int argc, char *argv[])
                 printf("Symbol table display enabled\n");
             }
         }
+        else if (strncmp(argv[i], "-j", 2) == 0) {
+            // -j N, -jN; 0 uses every online CPU
+            const char *count = argv[i][2] != '\0' ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : NULL);
+            char *end = NULL;
+            long jobs = count != NULL ? strtol(count, &end, 10) : -1;
+            if (count == NULL || *count == '\0' || *end != '\0' || jobs < 0) {
+                printf("Error: -j requires a thread count\n");
+                return 1;
+            }
+            if (jobs == 0) {
+                jobs = sysconf(_SC_NPROCESSORS_ONLN);
+            }
+            parallel_jobs = jobs > 0 ? (size_t)jobs : 1;
+            if (debug_mode) {
+                printf("Building classes on %zu threads\n", parallel_jobs);
+            }
+        }
+        else if (strcmp(argv[i], "-build-cache") == 0) {
+            if (i + 1 < argc) {
+                build_cache_dir = argv[++i];
+            } else {
+                printf("Error: -build-cache requires a directory\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-module-path") == 0) {
+            if (i + 1 >= argc) {
+                printf("Error: -module-path requires a directory\n");
+                return 1;
+            }
+            if (module_path_count >= MAX_MODULE_PATHS) {
+                printf("Error: At most %d -module-path directories\n", MAX_MODULE_PATHS);
+                return 1;
+            }
+            module_paths[module_path_count++] = argv[++i];
+        }
+        else if (strcmp(argv[i], "-arena-stats") == 0) {
+            show_arena_stats = true;
+        }
+        else if (strcmp(argv[i], "-inline-limit") == 0) {
+            // Largest method body, in instructions, inlined at -O2; 0 turns inlining off
+            const char *limit = i + 1 < argc ? argv[++i] : NULL;
+            char *end = NULL;
+            long instructions = limit != NULL ? strtol(limit, &end, 10) : -1;
+            if (limit == NULL || *limit == '\0' || *end != '\0' || instructions < 0) {
+                printf("Error: -inline-limit requires a number of instructions\n");
+                return 1;
+            }
+            inline_limit = (size_t)instructions;
+        }
+        else if (strcmp(argv[i], "-inline-report") == 0) {
+            inline_report = true;
+        }
+        else if (strncmp(argv[i], "-O", 2) == 0) {
+            const char *level = argv[i] + 2;
+            if (level[0] < '0' || level[0] > '0' + OPTIMIZER_MAX_LEVEL || level[1] != '\0') {
+                printf("Error: Unknown optimization level '%s' (use -O0 to -O%d)\n", argv[i], OPTIMIZER_MAX_LEVEL);
+                return 1;
+            }
+            optimization_level = level[0] - '0';
+            if (debug_mode) {
+                printf("Optimization level %d\n", optimization_level);
+            }
+        }
         else if (strcmp(argv[i], "-o") == 0) {
             if (i + 1 < argc) {
                 output_file = argv[++i];
@@ -140,6 +221,14 @@ void print_usage(const char* program_name)
     printf("  -show-bytecode  Display generated bytecode\n");
     printf("  -show-symbols   Display symbol table\n");
     printf("  -dump           Alias for -show-bytecode\n");
+    printf("  -j <n>          Build classes on n threads (0: all CPUs, default: 1)\n");
+    printf("  -build-cache <dir>  Reuse classes unchanged since the last build\n");
+    printf("  -module-path <dir>  Search dir for imported modules (repeatable)\n");
+    printf("  -arena-stats    Report compilation arena usage\n");
+    printf("  -O0, -O1, -O2   Optimization level (default: -O0)\n");
+    printf("  -inline-limit <n>  Inline methods of up to n instructions at -O2 (0: none, default: %d)\n",
+           INLINE_DEFAULT_LIMIT);
+    printf("  -inline-report  List the calls inlined\n");
     printf("  -o <file>       Specify output file (default: input.arxmod)\n");
     printf("  -h, --help      Show this help message\n");
     printf("\n");
@@ -149,6 +238,7 @@ void print_usage(const char* program_name)
     printf("  %s -show-bytecode program.arx\n", program_name);
     printf("  %s -show-symbols program.arx\n", program_name);
     printf("  %s -debug -dump program.arx\n", program_name);
+    printf("  %s -O2 -o output.arxmod program.arx\n", program_name);
     printf("\n");
 }
 
@@ -195,6 +285,7 @@ void display_bytecode(instruction_t *instructions, size_t instruction_count)
             case VM_LODX:   printf("LODX   "); break;
             case VM_STOX:   printf("STOX   "); break;
             case VM_HALT:   printf("HALT   "); break;
+            case VM_CALS:   printf("CALS   "); break;
             default:        printf("UNK(%d) ", opcode); break;
         }
         
@@ -205,6 +296,10 @@ void display_bytecode(instruction_t *instructions, size_t instruction_count)
             printf("%llu", (unsigned long long)operand);
         }
         
+        if (opcode == VM_CALS && level == 1) {
+            printf(" (tail)");
+        }
+        
         // For OPR instructions, show the operation
         if (opcode == VM_OPR) {
             printf(" (");
@@ -227,6 +322,31 @@ void display_bytecode(instruction_t *instructions, size_t instruction_count)
                 case OPR_WRITELN: printf("WRITELN"); break;
                 case OPR_OBJ_NEW: printf("OBJ_NEW"); break;
                 case OPR_OBJ_CALL_METHOD: printf("OBJ_CALL_METHOD"); break;
+                case OPR_TASK_SPAWN: printf("TASK_SPAWN"); break;
+                case OPR_TASK_YIELD: printf("TASK_YIELD"); break;
+                case OPR_TASK_JOIN: printf("TASK_JOIN"); break;
+                case OPR_ARRAY_NEW: printf("ARRAY_NEW"); break;
+                case OPR_ARRAY_LOAD: printf("ARRAY_LOAD"); break;
+                case OPR_ARRAY_STORE: printf("ARRAY_STORE"); break;
+                case OPR_ARRAY_LENGTH: printf("ARRAY_LENGTH"); break;
+                case OPR_ARRAY_FILL: printf("ARRAY_FILL"); break;
+                case OPR_ARRAY_COPY: printf("ARRAY_COPY"); break;
+                case OPR_ARRAY_SLICE: printf("ARRAY_SLICE"); break;
+                case OPR_ARRAY_EQUAL: printf("ARRAY_EQUAL"); break;
+                case OPR_ARRAY_SUM: printf("ARRAY_SUM"); break;
+                case OPR_ARRAY_MIN: printf("ARRAY_MIN"); break;
+                case OPR_ARRAY_MAX: printf("ARRAY_MAX"); break;
+                case OPR_ARRAY_FIND: printf("ARRAY_FIND"); break;
+                case OPR_STR_SLICE: printf("STR_SLICE"); break;
+                case OPR_STR_LEN: printf("STR_LEN"); break;
+                case OPR_STR_EQ: printf("STR_EQ"); break;
+                case OPR_STR_CMP: printf("STR_CMP"); break;
+                case OPR_STR_TO_INT: printf("STR_TO_INT"); break;
+                case OPR_STR_FIND: printf("STR_FIND"); break;
+                case OPR_STR_AT: printf("STR_AT"); break;
+                case OPR_OBJ_NEW_FRAME: printf("OBJ_NEW_FRAME"); break;
+                case OPR_OBJ_RELEASE: printf("OBJ_RELEASE"); break;
+                case OPR_OBJ_CHECK: printf("OBJ_CHECK"); break;
                 // Field opcodes removed - fields are accessed directly by name within class methods
                 default:          printf("OPR_%llu", (unsigned long long)operand); break;
             }
@@ -239,34 +359,114 @@ void display_bytecode(instruction_t *instructions, size_t instruction_count)
     printf("\n=== End Bytecode ===\n");
 }
 
-bool compile_file(const char* input_file, const char* output_file)
+// Map the source file read-only; the lexer works on slices of it and never
+// needs a copy. Empty files and files that cannot be mapped are read into
+// a heap buffer instead. The buffer is not NUL-terminated.
+static char *load_source(const char *path, size_t *size, bool *mapped)
 {
-    // Open input file
-    FILE *fin = fopen(input_file, "r");
-    if (fin == NULL) {
-        printf("Error: Could not open input file '%s'\n", input_file);
-        return false;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("Error: Could not open input file '%s'\n", path);
+        return NULL;
     }
     
-    // Get file size
-    fseek(fin, 0, SEEK_END);
-    size_t file_size = ftell(fin);
-    rewind(fin);
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        printf("Error: Could not stat input file '%s'\n", path);
+        close(fd);
+        return NULL;
+    }
+    
+    *size = (size_t)st.st_size;
+    *mapped = false;
     
     if (debug_mode) {
-        printf("Reading %zu bytes from '%s'\n", file_size, input_file);
+        printf("Reading %zu bytes from '%s'\n", *size, path);
+    }
+    
+    if (*size > 0) {
+        void *map = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            close(fd);
+            *mapped = true;
+            return map;
+        }
     }
     
-    // Read source code
-    char *source = malloc(file_size + 1);
-    if (fread(source, 1, file_size, fin) != file_size) {
-        printf("Error: Could not read input file\n");
-        fclose(fin);
+    char *source = malloc(*size + 1);
+    if (source == NULL) {
+        printf("Error: Out of memory reading input file\n");
+        close(fd);
+        return NULL;
+    }
+    size_t total = 0;
+    while (total < *size) {
+        ssize_t n = read(fd, source + total, *size - total);
+        if (n <= 0) {
+            printf("Error: Could not read input file\n");
+            close(fd);
+            free(source);
+            return NULL;
+        }
+        total += (size_t)n;
+    }
+    close(fd);
+    return source;
+}
+
+static void release_source(char *source, size_t size, bool mapped)
+{
+    if (mapped) {
+        munmap(source, size);
+    } else {
         free(source);
+    }
+}
+
+// An imported module is <Name>.arxmod in a -module-path directory or, failing
+// that, next to the source file
+static bool find_module(const char *input_file, const char *module_name, char *path, size_t path_size)
+{
+    for (size_t i = 0; i < module_path_count; i++) {
+        int length = snprintf(path, path_size, "%s/%s.arxmod", module_paths[i], module_name);
+        if (length > 0 && (size_t)length < path_size && access(path, R_OK) == 0) {
+            return true;
+        }
+    }
+    
+    const char *slash = strrchr(input_file, '/');
+    int dir_length = slash ? (int)(slash - input_file) : 1;
+    const char *dir = slash ? input_file : ".";
+    int length = snprintf(path, path_size, "%.*s/%s.arxmod", dir_length, dir, module_name);
+    return length > 0 && (size_t)length < path_size && access(path, R_OK) == 0;
+}
+
+// Read the class manifest of every imported module
+static bool load_imports(const char *input_file, const parser_context_t *parser, linker_imports_t *imports)
+{
+    for (size_t i = 0; i < parser->import_count; i++) {
+        char path[1024];
+        if (!find_module(input_file, parser->imports[i], path, sizeof(path))) {
+            printf("Error: Cannot find module '%s' (looked for %s.arxmod on the module path and next to %s)\n",
+                   parser->imports[i], parser->imports[i], input_file);
+            return false;
+        }
+        if (!linker_imports_load(imports, parser->imports[i], path)) {
+            printf("Error: Failed to import module '%s' from '%s'\n", parser->imports[i], path);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool compile_source(const char* input_file, const char* output_file)
+{
+    size_t file_size = 0;
+    bool source_mapped = false;
+    char *source = load_source(input_file, &file_size, &source_mapped);
+    if (source == NULL) {
         return false;
     }
-    source[file_size] = '\0'; // Null terminate
-    fclose(fin);
     
     if (debug_mode) {
         printf("Source code loaded successfully\n");
@@ -281,23 +481,30 @@ bool compile_file(const char* input_file, const char* output_file)
     // Initialize lexer
     if (!lexer_init(&lexer, source, file_size)) {
         printf("Error: Failed to initialize lexer\n");
-        free(source);
+        release_source(source, file_size, source_mapped);
         return false;
     }
     
     // Initialize parser
     if (!parser_init(&parser, &lexer)) {
         printf("Error: Failed to initialize parser\n");
-        free(source);
+        release_source(source, file_size, source_mapped);
         return false;
     }
     
     // Initialize code generator
     if (!codegen_init(&codegen, &parser)) {
         printf("Error: Failed to initialize code generator\n");
-        free(source);
+        release_source(source, file_size, source_mapped);
         return false;
     }
+    codegen.jobs = parallel_jobs;
+    if (build_cache_dir != NULL) {
+        // An existing directory is fine; any other failure shows up as
+        // every class being rebuilt
+        mkdir(build_cache_dir, 0777);
+        codegen.build_cache_dir = build_cache_dir;
+    }
     
     // Parse the source code
     ast_node_t *ast = parser_parse(&parser);
@@ -307,7 +514,7 @@ bool compile_file(const char* input_file, const char* output_file)
         } else {
             printf("Error: Parsing failed\n");
         }
-        free(source);
+        release_source(source, file_size, source_mapped);
         return false;
     }
     
@@ -315,6 +522,18 @@ bool compile_file(const char* input_file, const char* output_file)
         printf("Parsing completed successfully\n");
     }
     
+    // Classes and methods of imported modules, for `new` and method calls
+    linker_imports_t imports;
+    linker_imports_init(&imports);
+    if (!load_imports(input_file, &parser, &imports)) {
+        linker_imports_cleanup(&imports);
+        release_source(source, file_size, source_mapped);
+        return false;
+    }
+    if (imports.module_count > 0) {
+        codegen.imports = &imports;
+    }
+    
     // Display symbol table if requested
     if (show_symbols) {
         symbol_table_dump(&parser.symbol_table);
@@ -326,7 +545,8 @@ bool compile_file(const char* input_file, const char* output_file)
     
     if (!codegen_generate(&codegen, ast, &instructions, &instruction_count)) {
         printf("Error: Code generation failed\n");
-        free(source);
+        linker_imports_cleanup(&imports);
+        release_source(source, file_size, source_mapped);
         return false;
     }
     
@@ -334,6 +554,29 @@ bool compile_file(const char* input_file, const char* output_file)
         printf("Generated %zu instructions\n", instruction_count);
     }
     
+    if (build_cache_dir != NULL) {
+        printf("Build cache: %zu classes rebuilt, %zu reused\n", codegen.classes_rebuilt, codegen.classes_reused);
+    }
+    
+    // Optimize in place; the context's method positions, call sites and
+    // labels are renumbered along with the code
+    if (optimization_level > OPTIMIZER_LEVEL_NONE) {
+        optimizer_options_t options = {optimization_level, inline_limit, inline_report};
+        optimizer_stats_t stats;
+        if (!optimizer_run(&codegen, &options, &stats)) {
+            printf("Error: Bytecode optimization failed\n");
+            linker_imports_cleanup(&imports);
+            release_source(source, file_size, source_mapped);
+            return false;
+        }
+        instructions = codegen.instructions;
+        instruction_count = codegen.instruction_count;
+        
+        if (debug_mode) {
+            printf("Optimized to %zu instructions (from %zu)\n", stats.instructions_after, stats.instructions_before);
+        }
+    }
+    
     // Display bytecode if requested
     if (show_bytecode) {
         display_bytecode(instructions, instruction_count);
@@ -342,7 +585,8 @@ bool compile_file(const char* input_file, const char* output_file)
     // Write output file
     if (!codegen_write_arxmod(&codegen, output_file, instructions, instruction_count)) {
         printf("Error: Failed to write output file '%s'\n", output_file);
-        free(source);
+        linker_imports_cleanup(&imports);
+        release_source(source, file_size, source_mapped);
         return false;
     }
     
@@ -351,8 +595,31 @@ bool compile_file(const char* input_file, const char* output_file)
     }
     
     // Cleanup
-    free(source);
+    linker_imports_cleanup(&imports);
+    release_source(source, file_size, source_mapped);
     free(instructions);
     
     return true;
 }
+
+// AST nodes, types and symbols of one compilation share an arena, so the
+// whole front end is torn down with a single release
+bool compile_file(const char* input_file, const char* output_file)
+{
+    arena_t arena;
+    arena_init(&arena, ARENA_DEFAULT_BLOCK_SIZE);
+    arena_t *previous = arena_set_current(&arena);
+    
+    bool success = compile_source(input_file, output_file);
+    
+    if (show_arena_stats) {
+        arena_print_stats(&arena);
+    }
+    
+    // The predefined types point into the arena
+    types_cleanup();
+    arena_set_current(previous);
+    arena_cleanup(&arena);
+    
+    return success;
+}
@@ -0,0 +1,233 @@
+/*
+ * ARX Escape Analysis Implementation
+ * One walk over a method body to collect its object locals, one to find
+ * every use that could let their objects outlive the call
+ */
+
+#include "escape.h"
+#include <stdlib.h>
+#include <string.h>
+
+static escape_variable_t* escape_find(const escape_info_t *info, const char *name)
+{
+    for (size_t i = 0; name != NULL && i < info->count; i++) {
+        if (strcmp(info->variables[i].name, name) == 0) {
+            return &info->variables[i];
+        }
+    }
+    return NULL;
+}
+
+// The variable whose method a call "name.method" runs, if name is one of
+// the candidates and the call has no further dots
+static escape_variable_t* escape_receiver(const escape_info_t *info, const char *call)
+{
+    const char *dot = call != NULL ? strchr(call, '.') : NULL;
+    if (dot == NULL || strchr(dot + 1, '.') != NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < info->count; i++) {
+        const char *name = info->variables[i].name;
+        if (strlen(name) == (size_t)(dot - call) && strncmp(name, call, (size_t)(dot - call)) == 0) {
+            return &info->variables[i];
+        }
+    }
+    return NULL;
+}
+
+// Whether value names the variable or something reached through it
+static bool escape_mentions(const char *value, const char *name)
+{
+    size_t length = strlen(name);
+    return strncmp(value, name, length) == 0 && (value[length] == '\0' || value[length] == '.');
+}
+
+static bool escape_collect(const ast_node_t *node, escape_info_t *info)
+{
+    for (size_t i = 0; i < node->child_count; i++) {
+        const ast_node_t *child = node->children[i];
+        if (child == NULL) {
+            continue;
+        }
+        if ((child->type == AST_VAR_DECL || child->type == AST_ARRAY_DECL) &&
+            child->child_count > 0 && child->children[0] != NULL && child->children[0]->value != NULL) {
+            const char *name = child->children[0]->value;
+            escape_variable_t *variable = escape_find(info, name);
+            if (variable != NULL) {
+                // Declared twice: leave it alone
+                variable->escapes = true;
+                variable->other_stores = true;
+                continue;
+            }
+            if (info->count >= info->capacity) {
+                size_t new_capacity = info->capacity == 0 ? 8 : info->capacity * 2;
+                escape_variable_t *new_variables = realloc(info->variables, new_capacity * sizeof(escape_variable_t));
+                if (new_variables == NULL) {
+                    return false;
+                }
+                info->variables = new_variables;
+                info->capacity = new_capacity;
+            }
+            // Primitives, strings and arrays are recorded too, so that a
+            // second declaration under the same name is noticed
+            bool object = child->type == AST_VAR_DECL && child->value != NULL && strcmp(child->value, "string") != 0;
+            escape_variable_t *added = &info->variables[info->count++];
+            memset(added, 0, sizeof(escape_variable_t));
+            added->name = name;
+            added->class_name = object ? child->value : NULL;
+            added->escapes = !object;
+        } else if (!escape_collect(child, info)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void escape_walk(const ast_node_t *node, escape_info_t *info);
+
+static void escape_walk_children(const ast_node_t *node, escape_info_t *info)
+{
+    for (size_t i = 0; i < node->child_count; i++) {
+        escape_walk(node->children[i], info);
+    }
+}
+
+static void escape_walk(const ast_node_t *node, escape_info_t *info)
+{
+    if (node == NULL) {
+        return;
+    }
+    switch (node->type) {
+        case AST_VAR_DECL:
+        case AST_ARRAY_DECL:
+        case AST_LITERAL:
+            return;
+
+        case AST_ASSIGNMENT:
+            if (node->child_count >= 2 && node->children[0] != NULL) {
+                // Only a fresh object may be stored in a candidate; a NEW
+                // anywhere else is simply not counted
+                escape_variable_t *target = escape_find(info, node->children[0]->value);
+                const ast_node_t *value = node->children[1];
+                if (target != NULL) {
+                    if (value != NULL && value->type == AST_NEW_EXPR && value->value != NULL) {
+                        if (target->news++ == 0) {
+                            target->new_class = value->value;
+                        } else if (target->new_class == NULL || strcmp(target->new_class, value->value) != 0) {
+                            target->mixed_classes = true;
+                        }
+                    } else {
+                        target->escapes = true;
+                        target->other_stores = true;
+                    }
+                }
+                escape_walk(node->children[1], info);
+                return;
+            }
+            break;
+
+        case AST_METHOD_CALL: {
+            // A receiver is only loaded to pick the method: the callee gets
+            // no reference to it
+            escape_variable_t *receiver = escape_receiver(info, node->value);
+            if (receiver == NULL) {
+                break;
+            }
+            escape_walk_children(node, info);
+            return;
+        }
+
+        case AST_SPAWN_EXPR:
+            // The task may run after the method has returned
+            for (size_t i = 0; i < node->child_count; i++) {
+                const ast_node_t *call = node->children[i];
+                escape_variable_t *receiver = call != NULL ? escape_receiver(info, call->value) : NULL;
+                if (receiver != NULL) {
+                    receiver->escapes = true;
+                }
+            }
+            break;
+
+        case AST_FOR_STMT: {
+            // The loop stores counter values in its variable
+            escape_variable_t *counter = escape_find(info, node->value);
+            if (counter != NULL) {
+                counter->other_stores = true;
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    // Any other mention of a candidate, as an operand, argument, loop
+    // variable or the base of a field access, could copy its object
+    if (node->value != NULL) {
+        for (size_t i = 0; i < info->count; i++) {
+            if (escape_mentions(node->value, info->variables[i].name)) {
+                info->variables[i].escapes = true;
+            }
+        }
+    }
+    escape_walk_children(node, info);
+}
+
+bool escape_analyze_method(const ast_node_t *method, escape_info_t *info)
+{
+    if (info == NULL) {
+        return false;
+    }
+    info->count = 0;
+    if (method == NULL) {
+        return true;
+    }
+    if (!escape_collect(method, info)) {
+        info->count = 0;
+        return false;
+    }
+    // The method node's own value is its name, not a use
+    escape_walk_children(method, info);
+    return true;
+}
+
+bool escape_is_frame_variable(const escape_info_t *info, const char *name)
+{
+    const escape_variable_t *variable = info != NULL ? escape_find(info, name) : NULL;
+    return variable != NULL && !variable->escapes && variable->news > 0;
+}
+
+const char* escape_created_class(const escape_info_t *info, const char *name)
+{
+    const escape_variable_t *variable = info != NULL ? escape_find(info, name) : NULL;
+    if (variable == NULL || variable->class_name == NULL || variable->news == 0 ||
+        variable->other_stores || variable->mixed_classes) {
+        return NULL;
+    }
+    return variable->new_class;
+}
+
+const char* escape_declared_class(const escape_info_t *info, const char *name)
+{
+    const escape_variable_t *variable = info != NULL ? escape_find(info, name) : NULL;
+    return variable != NULL ? variable->class_name : NULL;
+}
+
+size_t escape_frame_variable_count(const escape_info_t *info)
+{
+    size_t count = 0;
+    for (size_t i = 0; info != NULL && i < info->count; i++) {
+        if (!info->variables[i].escapes && info->variables[i].news > 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+void escape_info_free(escape_info_t *info)
+{
+    if (info != NULL) {
+        free(info->variables);
+        memset(info, 0, sizeof(escape_info_t));
+    }
+}
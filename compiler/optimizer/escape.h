@@ -0,0 +1,59 @@
+/*
+ * ARX Escape Analysis - Finds the objects a method creates that never
+ * outlive its activation, and the classes its object locals can hold
+ */
+
+#ifndef ARX_ESCAPE_H
+#define ARX_ESCAPE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "../parser/ast/ast.h"
+
+// An object-typed local of one method and what the method does with it
+typedef struct {
+    const char *name;                 // Declared name (the AST's interned value)
+    const char *class_name;           // Declared class; NULL for primitives, strings and arrays
+    const char *new_class;            // Class of its NEW assignments while they all name one
+    size_t news;                      // Assignments of a NEW expression
+    bool other_stores;                // Assigned anything but a NEW, or declared twice
+    bool mixed_classes;               // Its NEW assignments name more than one class
+    bool escapes;                     // Used in any way that may keep its object past the call
+} escape_variable_t;
+
+// Result for one method. A frame variable is a local declared with a class
+// type that is only ever assigned NEW expressions and only ever used as the
+// receiver of a method call run by the caller (not spawned). Its objects
+// can be stored nowhere else, returned or passed on, so each one is dead
+// once the variable is assigned again and once the method returns.
+typedef struct {
+    escape_variable_t *variables;
+    size_t count;
+    size_t capacity;
+} escape_info_t;
+
+// Analyze the body of method (an AST_METHOD, AST_PROCEDURE or AST_FUNCTION
+// node), replacing what info held. False only when memory runs out; info is
+// then empty, which makes every object escape.
+bool escape_analyze_method(const ast_node_t *method, escape_info_t *info);
+
+// Whether the objects of the method's local called name can live and die
+// with its activation record
+bool escape_is_frame_variable(const escape_info_t *info, const char *name);
+
+// The class every object the method's local called name holds was created
+// as: set when the local is only ever assigned NEW expressions of one class.
+// NULL when that is not known.
+const char* escape_created_class(const escape_info_t *info, const char *name);
+
+// Class the local called name was declared with; NULL if it is not an
+// object local of the method
+const char* escape_declared_class(const escape_info_t *info, const char *name);
+
+// Number of frame variables found
+size_t escape_frame_variable_count(const escape_info_t *info);
+
+void escape_info_free(escape_info_t *info);
+
+#endif // ARX_ESCAPE_H
@@ -0,0 +1,366 @@
+/*
+ * ARX Method Inlining Implementation
+ * Resolves each call site against the class manifest, checks the callee's
+ * body, then rebuilds the code with the bodies in place of the calls
+ */
+
+#include "inline.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Global debug flag (extern from main.c)
+extern bool debug_mode;
+
+// The module's classes and their methods, in manifest order
+typedef struct {
+    class_entry_t *classes;
+    size_t class_count;
+    method_entry_t *methods;
+    size_t method_count;
+    field_entry_t *fields;
+    size_t field_count;
+} inline_manifest_t;
+
+// A call site to replace and the body that replaces it
+typedef struct {
+    size_t start;                     // First body instruction (after the VM_INT)
+    size_t length;                    // Instructions up to, not including, the OPR_RET
+    bool tail;                        // The call was a tail call (VM_CALS at level 1)
+} inline_body_t;
+
+static inline uint8_t inline_opcode(const instruction_t *instr)
+{
+    return instr->opcode & 0x0F;
+}
+
+static inline uint8_t inline_level(const instruction_t *instr)
+{
+    return (instr->opcode >> 4) & 0x0F;
+}
+
+static inline bool inline_has_target(const instruction_t *instr)
+{
+    uint8_t opcode = inline_opcode(instr);
+    return opcode == VM_JMP || opcode == VM_JPC || opcode == VM_CAL;
+}
+
+static const class_entry_t* inline_find_class(const inline_manifest_t *manifest, uint64_t class_id,
+                                              size_t *first_method)
+{
+    size_t method = 0;
+    for (size_t i = 0; i < manifest->class_count; i++) {
+        if (manifest->classes[i].class_id == class_id) {
+            *first_method = method;
+            return &manifest->classes[i];
+        }
+        method += manifest->classes[i].method_count;
+    }
+    return NULL;
+}
+
+// Class whose definition of method_name a receiver of class_id runs, or NULL
+// when the chain leaves the module or loops before one is found
+static const class_entry_t* inline_resolve(const inline_manifest_t *manifest, uint64_t class_id,
+                                           const char *method_name)
+{
+    for (size_t depth = 0; depth < manifest->class_count && class_id != 0; depth++) {
+        size_t first_method;
+        const class_entry_t *class_entry = inline_find_class(manifest, class_id, &first_method);
+        if (class_entry == NULL) {
+            return NULL;
+        }
+        for (size_t i = 0; i < class_entry->method_count; i++) {
+            if (strcmp(manifest->methods[first_method + i].method_name, method_name) == 0) {
+                return class_entry;
+            }
+        }
+        class_id = class_entry->parent_class_id;
+    }
+    return NULL;
+}
+
+// Method position of class_name.method_name; the manifest's names are cut
+// to 31 characters, so longer ones are never matched
+static size_t inline_find_position(const codegen_context_t *context, const char *class_name,
+                                   const char *method_name)
+{
+    for (size_t i = 0; i < context->method_position_count; i++) {
+        const char *position_class = context->method_positions[i].class_name;
+        if (position_class != NULL && strcmp(position_class, class_name) == 0 &&
+            strcmp(context->method_positions[i].method_name, method_name) == 0) {
+            return i;
+        }
+    }
+    return SIZE_MAX;
+}
+
+// Method position whose code holds instruction index
+static size_t inline_enclosing_position(const codegen_context_t *context, size_t index)
+{
+    for (size_t i = 0; i < context->method_position_count; i++) {
+        if (context->method_positions[i].start_instruction < index &&
+            index < context->method_positions[i].end_instruction) {
+            return i;
+        }
+    }
+    return SIZE_MAX;
+}
+
+// Stack effect of an instruction a body may hold; false for the others
+static bool inline_stack_effect(const instruction_t *instr, int *effect)
+{
+    switch (inline_opcode(instr)) {
+        case VM_LIT:
+        case VM_STRING:
+            *effect = 1;
+            return true;
+        case VM_LOD:
+            *effect = 1;
+            return inline_level(instr) == 1;
+        case VM_STO:
+            *effect = -1;
+            return inline_level(instr) == 1;
+        case VM_OPR:
+            break;
+        default:
+            return false;
+    }
+
+    switch (instr->opt64) {
+        case OPR_ADD: case OPR_SUB: case OPR_MUL: case OPR_DIV: case OPR_MOD: case OPR_POW:
+        case OPR_EQ: case OPR_NEQ: case OPR_LESS: case OPR_LEQ: case OPR_GREATER: case OPR_GEQ:
+        case OPR_AND: case OPR_OR: case OPR_SHR: case OPR_SHL: case OPR_SAR:
+        case OPR_RADD: case OPR_RSUB: case OPR_RMUL: case OPR_RDIV:
+        case OPR_REQ: case OPR_RNEQ: case OPR_RLESS: case OPR_RLEQ: case OPR_RGREATER: case OPR_RGEQ:
+        case OPR_STR_CONCAT: case OPR_STR_EQ:
+            *effect = -1;
+            return true;
+        case OPR_NEG: case OPR_NOT: case OPR_ODD: case OPR_RNEG:
+        case OPR_INT_TO_REAL: case OPR_REAL_TO_INT: case OPR_INT_TO_STR: case OPR_REAL_TO_STR:
+        case OPR_STR_LEN:
+            *effect = 0;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Whether the method starting at start can be copied into a caller, and
+// which of its instructions make up the copy
+static bool inline_check_body(const codegen_context_t *context, size_t start, size_t limit, inline_body_t *body)
+{
+    const instruction_t *code = context->instructions;
+    size_t count = context->instruction_count;
+    if (start >= count || inline_opcode(&code[start]) != VM_INT || code[start].opt64 != 0) {
+        return false;
+    }
+
+    int depth = 0;
+    for (size_t i = start + 1; i < count && i - start - 1 <= limit; i++) {
+        if (inline_opcode(&code[i]) == VM_OPR && code[i].opt64 == OPR_RET) {
+            // A function leaves its result, a procedure nothing
+            body->start = start + 1;
+            body->length = i - start - 1;
+            return depth == 0 || depth == 1;
+        }
+        int effect;
+        if (!inline_stack_effect(&code[i], &effect)) {
+            return false;
+        }
+        depth += effect;
+        if (depth < 0) {
+            return false;
+        }
+    }
+    return false;
+}
+
+// Copy the code with the chosen calls replaced and renumber everything that
+// refers to an instruction index
+static bool inline_rewrite(codegen_context_t *context, const inline_body_t *bodies, size_t growth)
+{
+    const instruction_t *code = context->instructions;
+    size_t count = context->instruction_count;
+    size_t new_count = count + growth;
+
+    instruction_t *new_code = malloc((new_count > 0 ? new_count : 1) * sizeof(instruction_t));
+    size_t *remap = malloc((count + 1) * sizeof(size_t));
+    if (new_code == NULL || remap == NULL) {
+        free(new_code);
+        free(remap);
+        return false;
+    }
+
+    size_t next = 0;
+    for (size_t i = 0; i < count; i++) {
+        remap[i] = next;
+        if (bodies[i].start == SIZE_MAX) {
+            new_code[next++] = code[i];
+            continue;
+        }
+        instruction_t check = {0};
+        check.opcode = VM_OPR;
+        check.opt64 = OPR_OBJ_CHECK;
+        new_code[next++] = check;
+        memcpy(&new_code[next], &code[bodies[i].start], bodies[i].length * sizeof(instruction_t));
+        next += bodies[i].length;
+        if (bodies[i].tail) {
+            // A tail call would have released a frame object receiver
+            instruction_t release = {0};
+            release.opcode = VM_OPR;
+            release.opt64 = OPR_OBJ_RELEASE;
+            new_code[next++] = code[i - 1];
+            new_code[next++] = release;
+        }
+    }
+    remap[count] = next;
+
+    // Bodies hold no jumps, so only the copied instructions need targets
+    for (size_t i = 0; i < count; i++) {
+        instruction_t *instr = &new_code[remap[i]];
+        if (bodies[i].start == SIZE_MAX && inline_has_target(instr) && instr->opt64 <= count) {
+            instr->opt64 = remap[instr->opt64];
+        }
+    }
+
+    for (size_t i = 0; i < context->method_position_count; i++) {
+        if (context->method_positions[i].start_instruction <= count) {
+            context->method_positions[i].start_instruction = remap[context->method_positions[i].start_instruction];
+        }
+        if (context->method_positions[i].end_instruction <= count) {
+            context->method_positions[i].end_instruction = remap[context->method_positions[i].end_instruction];
+        }
+    }
+
+    // The inlined calls have no slot left for the linker to patch
+    size_t calls = 0;
+    for (size_t i = 0; i < context->method_call_count; i++) {
+        linker_method_call_t *call = &context->method_calls[i];
+        if (call->instruction_index < count && bodies[call->instruction_index].start != SIZE_MAX) {
+            free(call->method_name);
+            continue;
+        }
+        if (call->instruction_index <= count) {
+            call->instruction_index = remap[call->instruction_index];
+        }
+        context->method_calls[calls++] = *call;
+    }
+    context->method_call_count = calls;
+
+    for (size_t i = 0; i < context->line_count; i++) {
+        if (context->lines[i].instruction_index <= count) {
+            context->lines[i].instruction_index = remap[context->lines[i].instruction_index];
+        }
+    }
+
+    for (size_t i = 0; i < context->label_table_size; i++) {
+        if (context->label_table[i].instruction_index <= count) {
+            context->label_table[i].instruction_index = remap[context->label_table[i].instruction_index];
+        }
+    }
+
+    free(remap);
+    free(context->instructions);
+    context->instructions = new_code;
+    context->instruction_count = new_count;
+    context->instruction_capacity = new_count;
+    return true;
+}
+
+bool inline_methods(codegen_context_t *context, size_t limit, bool report, size_t *inlined)
+{
+    size_t unused;
+    if (inlined == NULL) {
+        inlined = &unused;
+    }
+    *inlined = 0;
+
+    if (context == NULL || limit == 0 || context->instructions == NULL || context->method_call_count == 0 ||
+        context->parser_context == NULL || context->parser_context->root == NULL) {
+        return true;
+    }
+
+    const instruction_t *code = context->instructions;
+    size_t count = context->instruction_count;
+
+    // VM_CAL gives the callee the caller's record as its static link, so
+    // level 1 only means the global area everywhere when there is none
+    for (size_t i = 0; i < count; i++) {
+        if (inline_opcode(&code[i]) == VM_CAL) {
+            return true;
+        }
+    }
+
+    inline_manifest_t manifest = {0};
+    if (!collect_classes_from_ast(context, context->parser_context->root, &manifest.classes, &manifest.class_count,
+                                  &manifest.methods, &manifest.method_count, &manifest.fields, &manifest.field_count)) {
+        return false;
+    }
+
+    bool *target = calloc(count + 1, sizeof(bool));
+    inline_body_t *bodies = malloc((count > 0 ? count : 1) * sizeof(inline_body_t));
+    if (target == NULL || bodies == NULL) {
+        free(target);
+        free(bodies);
+        free(manifest.classes);
+        free(manifest.methods);
+        free(manifest.fields);
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        bodies[i].start = SIZE_MAX;
+        if (inline_has_target(&code[i]) && code[i].opt64 <= count) {
+            target[code[i].opt64] = true;
+        }
+    }
+    for (size_t i = 0; i < context->label_table_size; i++) {
+        if (context->label_table[i].instruction_index <= count) {
+            target[context->label_table[i].instruction_index] = true;
+        }
+    }
+
+    size_t growth = 0;
+    for (size_t k = 0; k < context->method_call_count; k++) {
+        const linker_method_call_t *call = &context->method_calls[k];
+        size_t i = call->instruction_index;
+        if (call->receiver_class_id == 0 || i == 0 || i >= count || target[i] ||
+            inline_opcode(&code[i]) != VM_CALS || inline_opcode(&code[i - 1]) != VM_LOD ||
+            bodies[i].start != SIZE_MAX) {
+            continue;
+        }
+
+        size_t caller = inline_enclosing_position(context, i);
+        const class_entry_t *owner = inline_resolve(&manifest, call->receiver_class_id, call->method_name);
+        size_t callee = owner != NULL ? inline_find_position(context, owner->class_name, call->method_name) : SIZE_MAX;
+        inline_body_t body;
+        if (caller == SIZE_MAX || callee == SIZE_MAX ||
+            !inline_check_body(context, context->method_positions[callee].start_instruction, limit, &body)) {
+            continue;
+        }
+
+        body.tail = inline_level(&code[i]) == 1;
+        bodies[i] = body;
+        growth += body.length + (body.tail ? 2 : 0);
+        (*inlined)++;
+
+        if (report || debug_mode) {
+            const char *caller_class = context->method_positions[caller].class_name;
+            printf("Inlined %s.%s into %s.%s at instruction %zu (%zu instruction%s)\n",
+                   owner->class_name, call->method_name, caller_class != NULL ? caller_class : "?",
+                   context->method_positions[caller].method_name, i, body.length, body.length == 1 ? "" : "s");
+        }
+    }
+
+    bool success = *inlined == 0 || inline_rewrite(context, bodies, growth);
+    if (!success) {
+        *inlined = 0;
+    }
+
+    free(target);
+    free(bodies);
+    free(manifest.classes);
+    free(manifest.methods);
+    free(manifest.fields);
+    return success;
+}
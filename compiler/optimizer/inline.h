@@ -0,0 +1,37 @@
+/*
+ * ARX Method Inlining - Replaces calls of small methods whose receiver's
+ * class is known at compile time with the methods' bodies
+ */
+
+#ifndef ARX_INLINE_H
+#define ARX_INLINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "../codegen/codegen.h"
+
+// Largest body, in instructions between the method's VM_INT and its
+// OPR_RET, that is copied into callers by default
+#define INLINE_DEFAULT_LIMIT 8
+
+// A call site qualifies when code generation recorded the exact class of
+// its receiver (see escape_created_class). The method it runs is the first
+// definition found walking up from that class through parent_class_id in
+// the module's class manifest, so overrides further down cannot apply.
+// The body must reserve no locals, touch only fields (level 1) and
+// constants, and run straight to its OPR_RET without calls or branches.
+//
+// "LOD receiver; VM_CALS slot" becomes "LOD receiver; OPR_OBJ_CHECK; body":
+// the check keeps the error a call on something that is not an object
+// raises, and the body runs in the caller's activation, where level 1 is
+// the same global area it is in the callee's. An inlined tail call is
+// followed by "LOD receiver; OPR_OBJ_RELEASE", which frees the receiver when
+// it is a frame object, as the tail call would have.
+//
+// Jump targets, method positions, call sites, lines and labels are
+// renumbered to match. With report set, each inlined call is printed.
+// Returns false only when memory runs out; the code is then unchanged.
+bool inline_methods(codegen_context_t *context, size_t limit, bool report, size_t *inlined);
+
+#endif // ARX_INLINE_H
@@ -0,0 +1,659 @@
+/*
+ * ARX Bytecode Optimizer Implementation
+ * Peephole and flow passes over the code generator's output
+ */
+
+#include "optimizer.h"
+#include "inline.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Global debug flag (extern from main.c)
+extern bool debug_mode;
+
+// A round runs every pass once; rounds repeat until nothing changes
+#define OPTIMIZER_MAX_ROUNDS 16
+
+// Methods with more local slots than this are left to the block passes
+#define OPTIMIZER_MAX_FRAME_SLOTS 4096
+
+typedef struct optimizer optimizer_t;
+typedef bool (*optimizer_pass_t)(optimizer_t *opt);
+
+struct optimizer {
+    codegen_context_t *context;
+    optimizer_stats_t *stats;
+    bool *leader;                     // Instruction starts a basic block
+    bool *removed;                    // Instruction is dropped at the next compaction
+    bool *reachable;                  // Scratch for the unreachable code pass
+    size_t *worklist;                 // Scratch for the unreachable code pass
+    size_t *remap;                    // Old index -> new index, instruction_count + 1 entries
+};
+
+static inline uint8_t optimizer_opcode(const instruction_t *instr)
+{
+    return instr->opcode & 0x0F;
+}
+
+static inline uint8_t optimizer_level(const instruction_t *instr)
+{
+    return (instr->opcode >> 4) & 0x0F;
+}
+
+static inline bool optimizer_is_operation(const instruction_t *instr, opr_t operation)
+{
+    return optimizer_opcode(instr) == VM_OPR && instr->opt64 == operation;
+}
+
+// Instructions whose operand is an instruction index
+static inline bool optimizer_has_target(const instruction_t *instr)
+{
+    uint8_t opcode = optimizer_opcode(instr);
+    return opcode == VM_JMP || opcode == VM_JPC || opcode == VM_CAL;
+}
+
+// Execution never continues with the next instruction
+static inline bool optimizer_ends_flow(const instruction_t *instr)
+{
+    uint8_t opcode = optimizer_opcode(instr);
+    return opcode == VM_JMP || opcode == VM_HALT || optimizer_is_operation(instr, OPR_RET);
+}
+
+static inline double optimizer_real(uint64_t word)
+{
+    double value;
+    memcpy(&value, &word, sizeof(value));
+    return value;
+}
+
+static inline uint64_t optimizer_word(double value)
+{
+    uint64_t word;
+    memcpy(&word, &value, sizeof(word));
+    return word;
+}
+
+// Evaluate a binary operation the way the VM does (signed 64-bit integers
+// wrapping modulo 2^64, IEEE doubles for the real operations). Returns
+// false for operations that cannot be folded or would trap.
+static bool optimizer_fold_binary(uint64_t operation, uint64_t a, uint64_t b, uint64_t *result)
+{
+    int64_t sa = (int64_t)a, sb = (int64_t)b;
+    double ra = optimizer_real(a), rb = optimizer_real(b);
+    
+    switch (operation) {
+        case OPR_ADD:     *result = a + b; return true;
+        case OPR_SUB:     *result = a - b; return true;
+        case OPR_MUL:     *result = a * b; return true;
+        case OPR_DIV:
+            if (b == 0) return false;
+            *result = sb == -1 ? (uint64_t)0 - a : (uint64_t)(sa / sb);
+            return true;
+        case OPR_MOD:
+            if (b == 0) return false;
+            *result = sb == -1 ? 0 : (uint64_t)(sa % sb);
+            return true;
+        case OPR_POW:
+            {
+                // Same product as the VM's repeated multiplication, modulo 2^64
+                uint64_t value = 1;
+                while (b > 0) {
+                    if (b & 1) value *= a;
+                    a *= a;
+                    b >>= 1;
+                }
+                *result = value;
+                return true;
+            }
+        case OPR_EQ:      *result = a == b; return true;
+        case OPR_NEQ:     *result = a != b; return true;
+        case OPR_LESS:    *result = sa < sb; return true;
+        case OPR_LEQ:     *result = sa <= sb; return true;
+        case OPR_GREATER: *result = sa > sb; return true;
+        case OPR_GEQ:     *result = sa >= sb; return true;
+        case OPR_AND:     *result = a != 0 && b != 0; return true;
+        case OPR_OR:      *result = a != 0 || b != 0; return true;
+        case OPR_RADD:    *result = optimizer_word(ra + rb); return true;
+        case OPR_RSUB:    *result = optimizer_word(ra - rb); return true;
+        case OPR_RMUL:    *result = optimizer_word(ra * rb); return true;
+        case OPR_RDIV:
+            if (rb == 0.0) return false;
+            *result = optimizer_word(ra / rb);
+            return true;
+        case OPR_REQ:      *result = ra == rb; return true;
+        case OPR_RNEQ:     *result = ra != rb; return true;
+        case OPR_RLESS:    *result = ra < rb; return true;
+        case OPR_RLEQ:     *result = ra <= rb; return true;
+        case OPR_RGREATER: *result = ra > rb; return true;
+        case OPR_RGEQ:     *result = ra >= rb; return true;
+        default:
+            return false;
+    }
+}
+
+static bool optimizer_fold_unary(uint64_t operation, uint64_t value, uint64_t *result)
+{
+    switch (operation) {
+        case OPR_NEG: *result = (uint64_t)0 - value; return true;
+        case OPR_NOT: *result = value == 0; return true;
+        case OPR_ODD: *result = value % 2; return true;
+        case OPR_RNEG: *result = optimizer_word(-optimizer_real(value)); return true;
+        case OPR_INT_TO_REAL: *result = optimizer_word((double)(int64_t)value); return true;
+        case OPR_REAL_TO_INT:
+            {
+                // Only values the conversion represents exactly; the VM
+                // saturates the rest
+                double real = optimizer_real(value);
+                if (!(real > -9223372036854775808.0 && real < 9223372036854775808.0)) return false;
+                *result = (uint64_t)(int64_t)real;
+                return true;
+            }
+        default:
+            return false;
+    }
+}
+
+// Block starts: the first instruction, method entries and ends, branch
+// targets and whatever follows a branch or the end of a flow
+static void optimizer_find_leaders(optimizer_t *opt)
+{
+    codegen_context_t *context = opt->context;
+    instruction_t *code = context->instructions;
+    size_t count = context->instruction_count;
+
+    memset(opt->leader, 0, count * sizeof(bool));
+    if (count == 0) {
+        return;
+    }
+    opt->leader[0] = true;
+
+    for (size_t i = 0; i < context->method_position_count; i++) {
+        if (context->method_positions[i].start_instruction < count) {
+            opt->leader[context->method_positions[i].start_instruction] = true;
+        }
+        if (context->method_positions[i].end_instruction < count) {
+            opt->leader[context->method_positions[i].end_instruction] = true;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (optimizer_has_target(&code[i]) && code[i].opt64 < count) {
+            opt->leader[code[i].opt64] = true;
+        }
+        if ((optimizer_has_target(&code[i]) || optimizer_ends_flow(&code[i])) && i + 1 < count) {
+            opt->leader[i + 1] = true;
+        }
+    }
+}
+
+// Drop the removed instructions and renumber everything that refers to an
+// instruction index. A reference to a removed instruction moves to the next
+// instruction that is kept, which is where execution would have gone.
+static bool optimizer_compact(optimizer_t *opt)
+{
+    codegen_context_t *context = opt->context;
+    instruction_t *code = context->instructions;
+    size_t count = context->instruction_count;
+    size_t kept = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        opt->remap[i] = kept;
+        if (!opt->removed[i]) {
+            kept++;
+        }
+    }
+    opt->remap[count] = kept;
+
+    if (kept == count) {
+        return false;
+    }
+
+    for (size_t i = 0, next = 0; i < count; i++) {
+        if (opt->removed[i]) {
+            continue;
+        }
+        if (optimizer_has_target(&code[i]) && code[i].opt64 <= count) {
+            code[i].opt64 = opt->remap[code[i].opt64];
+        }
+        code[next++] = code[i];
+    }
+
+    for (size_t i = 0; i < context->method_position_count; i++) {
+        if (context->method_positions[i].start_instruction <= count) {
+            context->method_positions[i].start_instruction = opt->remap[context->method_positions[i].start_instruction];
+        }
+        if (context->method_positions[i].end_instruction <= count) {
+            context->method_positions[i].end_instruction = opt->remap[context->method_positions[i].end_instruction];
+        }
+    }
+
+    // Call sites in removed (unreachable) code have nothing left to patch
+    size_t calls = 0;
+    for (size_t i = 0; i < context->method_call_count; i++) {
+        linker_method_call_t *call = &context->method_calls[i];
+        if (call->instruction_index >= count || opt->removed[call->instruction_index]) {
+            free(call->method_name);
+            continue;
+        }
+        call->instruction_index = opt->remap[call->instruction_index];
+        context->method_calls[calls++] = *call;
+    }
+    context->method_call_count = calls;
+
+    // Lines of removed code collapse onto the next kept instruction, where
+    // the entry that follows them (kept in order) takes over
+    for (size_t i = 0; i < context->line_count; i++) {
+        if (context->lines[i].instruction_index <= count) {
+            context->lines[i].instruction_index = opt->remap[context->lines[i].instruction_index];
+        }
+    }
+
+    for (size_t i = 0; i < context->label_table_size; i++) {
+        if (context->label_table[i].instruction_index <= count) {
+            context->label_table[i].instruction_index = opt->remap[context->label_table[i].instruction_index];
+        }
+    }
+
+    context->instruction_count = kept;
+    memset(opt->removed, 0, count * sizeof(bool));
+    return true;
+}
+
+// LIT a; LIT b; OPR op -> LIT (a op b), and LIT a; OPR op -> LIT (op a)
+static bool optimizer_fold_constants(optimizer_t *opt)
+{
+    instruction_t *code = opt->context->instructions;
+    size_t count = opt->context->instruction_count;
+    bool changed = false;
+
+    for (size_t i = 0; i + 1 < count; i++) {
+        if (optimizer_opcode(&code[i]) != VM_LIT || opt->leader[i + 1]) {
+            continue;
+        }
+
+        uint64_t result;
+        if (i + 2 < count && optimizer_opcode(&code[i + 1]) == VM_LIT &&
+            optimizer_opcode(&code[i + 2]) == VM_OPR && !opt->leader[i + 2] &&
+            optimizer_fold_binary(code[i + 2].opt64, code[i].opt64, code[i + 1].opt64, &result)) {
+            code[i].opt64 = result;
+            opt->removed[i + 1] = true;
+            opt->removed[i + 2] = true;
+            opt->stats->constants_folded++;
+            changed = true;
+            i += 2;
+        } else if (optimizer_opcode(&code[i + 1]) == VM_OPR &&
+                   optimizer_fold_unary(code[i + 1].opt64, code[i].opt64, &result)) {
+            code[i].opt64 = result;
+            opt->removed[i + 1] = true;
+            opt->stats->constants_folded++;
+            changed = true;
+            i += 1;
+        }
+    }
+
+    return changed;
+}
+
+// LIT c; JPC t is a JMP t when c is zero and falls through otherwise
+static bool optimizer_resolve_branches(optimizer_t *opt)
+{
+    instruction_t *code = opt->context->instructions;
+    size_t count = opt->context->instruction_count;
+    bool changed = false;
+
+    for (size_t i = 0; i + 1 < count; i++) {
+        if (optimizer_opcode(&code[i]) != VM_LIT || optimizer_opcode(&code[i + 1]) != VM_JPC ||
+            opt->leader[i + 1]) {
+            continue;
+        }
+
+        opt->removed[i] = true;
+        if (code[i].opt64 == 0) {
+            code[i + 1].opcode = (code[i + 1].opcode & 0xF0) | VM_JMP;
+        } else {
+            opt->removed[i + 1] = true;
+        }
+        opt->stats->branches_resolved++;
+        changed = true;
+        i += 1;
+    }
+
+    return changed;
+}
+
+// Follow a chain of unconditional jumps. Cycles stop after count hops.
+static uint64_t optimizer_final_target(optimizer_t *opt, uint64_t target)
+{
+    instruction_t *code = opt->context->instructions;
+    size_t count = opt->context->instruction_count;
+
+    for (size_t hops = 0; hops < count && target < count && optimizer_opcode(&code[target]) == VM_JMP; hops++) {
+        target = code[target].opt64;
+    }
+    return target;
+}
+
+// Jumps to jumps go straight to the final target, a JMP to a return or halt
+// becomes that instruction, and a JMP to the next instruction goes away
+static bool optimizer_thread_jumps(optimizer_t *opt)
+{
+    instruction_t *code = opt->context->instructions;
+    size_t count = opt->context->instruction_count;
+    bool changed = false;
+
+    for (size_t i = 0; i < count; i++) {
+        uint8_t opcode = optimizer_opcode(&code[i]);
+        if (opt->removed[i] || (opcode != VM_JMP && opcode != VM_JPC) || code[i].opt64 >= count) {
+            continue;
+        }
+
+        uint64_t target = optimizer_final_target(opt, code[i].opt64);
+        if (target != code[i].opt64 && target < count) {
+            code[i].opt64 = target;
+            opt->stats->jumps_threaded++;
+            changed = true;
+        }
+        if (opcode != VM_JMP || target >= count) {
+            continue;
+        }
+
+        if (optimizer_opcode(&code[target]) == VM_HALT || optimizer_is_operation(&code[target], OPR_RET)) {
+            code[i] = code[target];
+            opt->stats->jumps_threaded++;
+            changed = true;
+        } else if (target == i + 1) {
+            opt->removed[i] = true;
+            opt->stats->jumps_threaded++;
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+static void optimizer_mark_reachable(optimizer_t *opt, size_t index, size_t *pending)
+{
+    if (index < opt->context->instruction_count && !opt->reachable[index]) {
+        opt->reachable[index] = true;
+        opt->worklist[(*pending)++] = index;
+    }
+}
+
+// Methods are entered through vtables, so every method start is live along
+// with the module prologue. HALT instructions are always kept.
+static bool optimizer_remove_unreachable(optimizer_t *opt)
+{
+    codegen_context_t *context = opt->context;
+    instruction_t *code = context->instructions;
+    size_t count = context->instruction_count;
+    size_t pending = 0;
+    bool changed = false;
+
+    memset(opt->reachable, 0, count * sizeof(bool));
+    optimizer_mark_reachable(opt, 0, &pending);
+    for (size_t i = 0; i < context->method_position_count; i++) {
+        optimizer_mark_reachable(opt, context->method_positions[i].start_instruction, &pending);
+    }
+
+    while (pending > 0) {
+        size_t i = opt->worklist[--pending];
+        if (optimizer_has_target(&code[i])) {
+            optimizer_mark_reachable(opt, (size_t)code[i].opt64, &pending);
+        }
+        if (!optimizer_ends_flow(&code[i])) {
+            optimizer_mark_reachable(opt, i + 1, &pending);
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (!opt->reachable[i] && !opt->removed[i] && optimizer_opcode(&code[i]) != VM_HALT) {
+            opt->removed[i] = true;
+            opt->stats->unreachable_removed++;
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+// Number of level-0 slots a method's LOD/STO touch, 0 when the method is too
+// large for the frame passes (or touches none)
+static size_t optimizer_frame_slots(optimizer_t *opt, size_t start, size_t end)
+{
+    instruction_t *code = opt->context->instructions;
+    size_t slots = 0;
+
+    for (size_t i = start; i < end; i++) {
+        uint8_t opcode = optimizer_opcode(&code[i]);
+        if ((opcode == VM_LOD || opcode == VM_STO) && optimizer_level(&code[i]) == 0) {
+            if (code[i].opt64 >= OPTIMIZER_MAX_FRAME_SLOTS) {
+                return 0;
+            }
+            if (code[i].opt64 + 1 > slots) {
+                slots = (size_t)code[i].opt64 + 1;
+            }
+        }
+    }
+    return slots;
+}
+
+// Within a block, a LOD of a local last stored from a LIT loads that constant.
+// Level 0 inside a method is the method's own activation record, which no
+// other code can reach while the block runs (VM_CALS callees link to the
+// global area, and programs with VM_CAL skip this pass).
+static bool optimizer_propagate_locals(optimizer_t *opt)
+{
+    codegen_context_t *context = opt->context;
+    instruction_t *code = context->instructions;
+    size_t count = context->instruction_count;
+    bool changed = false;
+
+    for (size_t m = 0; m < context->method_position_count; m++) {
+        size_t start = context->method_positions[m].start_instruction;
+        size_t end = context->method_positions[m].end_instruction;
+        if (end > count) end = count;
+
+        size_t slots = start < end ? optimizer_frame_slots(opt, start, end) : 0;
+        if (slots == 0) {
+            continue;
+        }
+        bool *known = calloc(slots, sizeof(bool));
+        uint64_t *values = calloc(slots, sizeof(uint64_t));
+        if (known == NULL || values == NULL) {
+            free(known);
+            free(values);
+            return changed;
+        }
+
+        for (size_t i = start; i < end; i++) {
+            if (opt->leader[i]) {
+                memset(known, 0, slots * sizeof(bool));
+            }
+            uint8_t opcode = optimizer_opcode(&code[i]);
+            bool local = optimizer_level(&code[i]) == 0;
+
+            if (opcode == VM_STO && local) {
+                size_t slot = (size_t)code[i].opt64;
+                known[slot] = i > start && !opt->leader[i] && optimizer_opcode(&code[i - 1]) == VM_LIT;
+                if (known[slot]) {
+                    values[slot] = code[i - 1].opt64;
+                }
+            } else if (opcode == VM_STOX && local) {
+                memset(known, 0, slots * sizeof(bool));
+            } else if (opcode == VM_LOD && local && known[code[i].opt64]) {
+                code[i].opcode = VM_LIT;
+                code[i].opt64 = values[code[i].opt64];
+                opt->stats->loads_propagated++;
+                changed = true;
+            }
+        }
+
+        free(known);
+        free(values);
+    }
+
+    return changed;
+}
+
+// LOD x; STO x stores what is already there. A store to a local its method
+// never loads is dead; when the stored value comes from a LIT or LOD the
+// pair goes away.
+static bool optimizer_remove_stores(optimizer_t *opt)
+{
+    codegen_context_t *context = opt->context;
+    instruction_t *code = context->instructions;
+    size_t count = context->instruction_count;
+    bool changed = false;
+
+    for (size_t i = 1; i < count; i++) {
+        if (optimizer_opcode(&code[i]) == VM_STO && optimizer_opcode(&code[i - 1]) == VM_LOD &&
+            code[i].opcode == ((code[i - 1].opcode & 0xF0) | VM_STO) && code[i].opt64 == code[i - 1].opt64 &&
+            !opt->leader[i] && !opt->removed[i - 1]) {
+            opt->removed[i - 1] = true;
+            opt->removed[i] = true;
+            opt->stats->stores_removed++;
+            changed = true;
+        }
+    }
+
+    for (size_t m = 0; m < context->method_position_count; m++) {
+        size_t start = context->method_positions[m].start_instruction;
+        size_t end = context->method_positions[m].end_instruction;
+        if (end > count) end = count;
+
+        size_t slots = start < end ? optimizer_frame_slots(opt, start, end) : 0;
+        if (slots == 0) {
+            continue;
+        }
+        bool *read = calloc(slots, sizeof(bool));
+        if (read == NULL) {
+            return changed;
+        }
+
+        // An indexed load may read any slot
+        bool indexed = false;
+        for (size_t i = start; i < end; i++) {
+            if (optimizer_level(&code[i]) != 0) {
+                continue;
+            }
+            if (optimizer_opcode(&code[i]) == VM_LOD) {
+                read[code[i].opt64] = true;
+            } else if (optimizer_opcode(&code[i]) == VM_LODX) {
+                indexed = true;
+            }
+        }
+
+        for (size_t i = start + 1; i < end && !indexed; i++) {
+            uint8_t producer = optimizer_opcode(&code[i - 1]);
+            if (optimizer_opcode(&code[i]) == VM_STO && optimizer_level(&code[i]) == 0 &&
+                !read[code[i].opt64] && (producer == VM_LIT || producer == VM_LOD) &&
+                !opt->leader[i] && !opt->removed[i - 1] && !opt->removed[i]) {
+                opt->removed[i - 1] = true;
+                opt->removed[i] = true;
+                opt->stats->stores_removed++;
+                changed = true;
+            }
+        }
+
+        free(read);
+    }
+
+    return changed;
+}
+
+// Run one pass against fresh block information and apply its removals
+static bool optimizer_apply(optimizer_t *opt, optimizer_pass_t pass)
+{
+    optimizer_find_leaders(opt);
+    bool changed = pass(opt);
+    optimizer_compact(opt);
+    return changed;
+}
+
+bool optimizer_run(codegen_context_t *context, const optimizer_options_t *options, optimizer_stats_t *stats)
+{
+    if (context == NULL || options == NULL || options->level < OPTIMIZER_LEVEL_NONE ||
+        options->level > OPTIMIZER_MAX_LEVEL) {
+        return false;
+    }
+    int level = options->level;
+
+    optimizer_stats_t unused;
+    if (stats == NULL) {
+        stats = &unused;
+    }
+    memset(stats, 0, sizeof(*stats));
+    stats->instructions_before = context->instruction_count;
+    stats->instructions_after = context->instruction_count;
+
+    if (level == OPTIMIZER_LEVEL_NONE || context->instruction_count == 0 || context->instructions == NULL) {
+        return true;
+    }
+
+    // Inlining goes first so the other passes see the bodies in their callers
+    if (level >= OPTIMIZER_LEVEL_FULL &&
+        !inline_methods(context, options->inline_limit, options->inline_report, &stats->calls_inlined)) {
+        return false;
+    }
+    size_t count = context->instruction_count;
+
+    optimizer_t opt = {0};
+    opt.context = context;
+    opt.stats = stats;
+    opt.leader = calloc(count, sizeof(bool));
+    opt.removed = calloc(count, sizeof(bool));
+    opt.reachable = calloc(count, sizeof(bool));
+    opt.worklist = calloc(count, sizeof(size_t));
+    opt.remap = calloc(count + 1, sizeof(size_t));
+    if (!opt.leader || !opt.removed || !opt.reachable || !opt.worklist || !opt.remap) {
+        free(opt.leader);
+        free(opt.removed);
+        free(opt.reachable);
+        free(opt.worklist);
+        free(opt.remap);
+        return false;
+    }
+
+    // VM_CAL links the callee to the caller's record, so locals are only
+    // private to their method when the program has none
+    bool frame_passes = level >= OPTIMIZER_LEVEL_FULL;
+    for (size_t i = 0; i < count && frame_passes; i++) {
+        if (optimizer_opcode(&context->instructions[i]) == VM_CAL) {
+            frame_passes = false;
+        }
+    }
+
+    bool changed = true;
+    while (changed && stats->rounds < OPTIMIZER_MAX_ROUNDS) {
+        changed = false;
+        if (frame_passes) {
+            changed |= optimizer_apply(&opt, optimizer_propagate_locals);
+        }
+        changed |= optimizer_apply(&opt, optimizer_fold_constants);
+        changed |= optimizer_apply(&opt, optimizer_resolve_branches);
+        changed |= optimizer_apply(&opt, optimizer_thread_jumps);
+        changed |= optimizer_apply(&opt, optimizer_remove_unreachable);
+        if (frame_passes) {
+            changed |= optimizer_apply(&opt, optimizer_remove_stores);
+        }
+        stats->rounds++;
+    }
+
+    stats->instructions_after = context->instruction_count;
+
+    if (debug_mode) {
+        printf("Optimizer: -O%d, %zu rounds, %zu -> %zu instructions\n", level, stats->rounds,
+               stats->instructions_before, stats->instructions_after);
+        printf("Optimizer: inlined %zu, folded %zu, branches %zu, jumps %zu, unreachable %zu, loads %zu, stores %zu\n",
+               stats->calls_inlined, stats->constants_folded, stats->branches_resolved, stats->jumps_threaded,
+               stats->unreachable_removed, stats->loads_propagated, stats->stores_removed);
+    }
+
+    free(opt.leader);
+    free(opt.removed);
+    free(opt.reachable);
+    free(opt.worklist);
+    free(opt.remap);
+    return true;
+}
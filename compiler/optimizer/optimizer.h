@@ -0,0 +1,45 @@
+/*
+ * ARX Bytecode Optimizer - Rewrites generated bytecode before it is written
+ */
+
+#ifndef ARX_OPTIMIZER_H
+#define ARX_OPTIMIZER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "../codegen/codegen.h"
+
+// Optimization levels (-O0 .. -O2)
+#define OPTIMIZER_LEVEL_NONE  0   // Bytecode is written as generated
+#define OPTIMIZER_LEVEL_BASIC 1   // Folding, branch resolution, jump threading, unreachable code
+#define OPTIMIZER_LEVEL_FULL  2   // Also inlines small methods, propagates and drops stores to method locals
+#define OPTIMIZER_MAX_LEVEL   OPTIMIZER_LEVEL_FULL
+
+// What to run
+typedef struct {
+    int level;                        // OPTIMIZER_LEVEL_NONE .. OPTIMIZER_MAX_LEVEL
+    size_t inline_limit;              // Largest method body inlined at -O2; 0 inlines nothing
+    bool inline_report;               // Print each inlined call
+} optimizer_options_t;
+
+// What a run changed
+typedef struct {
+    size_t instructions_before;       // Instructions handed to the optimizer
+    size_t instructions_after;        // Instructions left afterwards
+    size_t rounds;                    // Rounds of all passes until nothing changed
+    size_t calls_inlined;             // VM_CALS replaced by the method's body
+    size_t constants_folded;          // LIT/OPR sequences replaced by one LIT
+    size_t branches_resolved;         // JPC on a constant condition
+    size_t jumps_threaded;            // Jumps retargeted, replaced or dropped
+    size_t unreachable_removed;       // Instructions no path reaches
+    size_t loads_propagated;          // LOD of a local with a known constant
+    size_t stores_removed;            // Dead or redundant LOD/LIT + STO pairs
+} optimizer_stats_t;
+
+// Optimize context->instructions, in place except when calls are inlined.
+// Jump targets, method positions, method call sites and the label table are
+// renumbered to match. stats may be NULL.
+bool optimizer_run(codegen_context_t *context, const optimizer_options_t *options, optimizer_stats_t *stats);
+
+#endif // ARX_OPTIMIZER_H
@@ -4,13 +4,14 @@
  */
 
 #include "ast.h"
+#include "../../arena/arena.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 ast_node_t* ast_create_node(ast_node_type_t type)
 {
-    ast_node_t *node = malloc(sizeof(ast_node_t));
+    ast_node_t *node = arena_alloc(arena_current(), sizeof(ast_node_t));
     if (node == NULL) {
         return NULL;
     }
@@ -18,6 +19,7 @@ ast_node_t* ast_create_node(ast_node_type_t type)
     node->type = type;
     node->value = NULL;
     node->number = 0;
+    node->data_type = TYPE_NONE;
     node->children = NULL;
     node->child_count = 0;
     node->child_capacity = 0;
@@ -36,7 +38,9 @@ void ast_add_child(ast_node_t *parent, ast_node_t *child)
     // Resize children array if needed
     if (parent->child_count >= parent->child_capacity) {
         size_t new_capacity = parent->child_capacity == 0 ? 4 : parent->child_capacity * 2;
-        ast_node_t **new_children = realloc(parent->children, new_capacity * sizeof(ast_node_t*));
+        ast_node_t **new_children = arena_grow(arena_current(), parent->children,
+                                               parent->child_capacity * sizeof(ast_node_t*),
+                                               new_capacity * sizeof(ast_node_t*));
         if (new_children == NULL) {
             return; // Memory allocation failed
         }
@@ -48,24 +52,15 @@ void ast_add_child(ast_node_t *parent, ast_node_t *child)
     parent->child_count++;
 }
 
+// Values are interned in the compilation arena: equal identifiers share
+// one copy, which must not be modified
 void ast_set_value(ast_node_t *node, const char *value)
 {
     if (node == NULL) {
         return;
     }
     
-    if (node->value != NULL) {
-        free(node->value);
-    }
-    
-    if (value != NULL) {
-        node->value = malloc(strlen(value) + 1);
-        if (node->value != NULL) {
-            strcpy(node->value, value);
-        }
-    } else {
-        node->value = NULL;
-    }
+    node->value = value != NULL ? (char *)arena_intern(arena_current(), value, strlen(value)) : NULL;
 }
 
 void ast_set_value_from_token(ast_node_t *node, const char *token_start, size_t token_length)
@@ -74,15 +69,7 @@ void ast_set_value_from_token(ast_node_t *node, const char *token_start, size_t
         return;
     }
     
-    if (node->value != NULL) {
-        free(node->value);
-    }
-    
-    node->value = malloc(token_length + 1);
-    if (node->value != NULL) {
-        strncpy(node->value, token_start, token_length);
-        node->value[token_length] = '\0'; // Ensure null termination
-    }
+    node->value = (char *)arena_intern(arena_current(), token_start, token_length);
 }
 
 void ast_set_number(ast_node_t *node, uint64_t number)
@@ -94,25 +81,7 @@ void ast_set_number(ast_node_t *node, uint64_t number)
 
 void ast_destroy_node(ast_node_t *node)
 {
-    if (node == NULL) {
-        return;
-    }
-    
-    // Destroy children
-    for (size_t i = 0; i < node->child_count; i++) {
-        ast_destroy_node(node->children[i]);
-    }
-    
-    // Free children array
-    if (node->children != NULL) {
-        free(node->children);
-    }
-    
-    // Free value
-    if (node->value != NULL) {
-        free(node->value);
-    }
-    
-    // Free node
-    free(node);
+    // Nodes, children arrays and values belong to the compilation arena and
+    // are released with it in one go
+    (void)node;
 }
@@ -7,6 +7,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include "../../types/types.h"
 
 // Forward declarations
 typedef struct ast_node ast_node_t;
@@ -35,14 +36,22 @@ typedef enum {
     AST_RETURN_STMT,
     AST_BLOCK,
     AST_EXPR_STMT,
-    AST_WRITELN_STMT
+    AST_WRITELN_STMT,
+    AST_SPAWN_EXPR,                 // spawn obj.method(): child is the method call
+    AST_JOIN_EXPR,                  // join expr: child is the task handle
+    AST_YIELD_STMT,
+    AST_ARRAY_DECL,                 // array of T name: child is the identifier, its data_type the element type
+    AST_NEW_ARRAY,                  // new T[length]: data_type is T, child is the length
+    AST_INDEX,                      // name[index]: value is the array, child is the index
+    AST_INDEX_ASSIGNMENT            // name[index] = expr: value is the array, children index and expr
 } ast_node_type_t;
 
 // AST Node structure (from parser.h)
 struct ast_node {
     ast_node_type_t type;
-    char *value;                    // String value (for identifiers, literals, etc.)
-    uint64_t number;                // Numeric value (for number literals)
+    char *value;                    // String value (for identifiers, literals, etc.); interned, read-only
+    uint64_t number;                // Numeric value (for number literals; bit pattern of a real)
+    primitive_type_t data_type;     // Declared type of variables, fields and functions; TYPE_REAL on real literals
     ast_node_t **children;          // Array of child nodes
     size_t child_count;             // Number of children
     size_t child_capacity;          // Capacity of children array
@@ -4,6 +4,7 @@
  */
 
 #include "parser_core.h"
+#include "../../arena/arena.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -35,6 +36,10 @@ bool parser_init(parser_context_t *context, lexer_context_t *lexer)
     context->method_string_count = 0;
     context->method_string_capacity = 0;
     
+    context->imports = NULL;
+    context->import_count = 0;
+    context->import_capacity = 0;
+    
     // Initialize type system
     types_init();
     
@@ -113,6 +118,12 @@ void parser_cleanup(parser_context_t *context)
         context->method_string_count = 0;
         context->method_string_capacity = 0;
         
+        // Import names live in the arena; only the array is ours
+        free(context->imports);
+        context->imports = NULL;
+        context->import_count = 0;
+        context->import_capacity = 0;
+        
         // Cleanup symbol table
         symbol_table_cleanup(&context->symbol_table);
         
@@ -123,6 +134,40 @@ void parser_cleanup(parser_context_t *context)
     }
 }
 
+// Record an imported module once, however often it is imported
+static bool parser_add_import(parser_context_t *context, const char *name, size_t length)
+{
+    const char *module_name = arena_intern(arena_current(), name, length);
+    if (module_name == NULL) {
+        return false;
+    }
+    
+    // Interned, so equal names are the same pointer
+    for (size_t i = 0; i < context->import_count; i++) {
+        if (context->imports[i] == module_name) {
+            return true;
+        }
+    }
+    
+    if (context->import_count >= context->import_capacity) {
+        size_t new_capacity = context->import_capacity == 0 ? 4 : context->import_capacity * 2;
+        const char **new_imports = realloc(context->imports, new_capacity * sizeof(const char *));
+        if (new_imports == NULL) {
+            return false;
+        }
+        context->imports = new_imports;
+        context->import_capacity = new_capacity;
+    }
+    
+    context->imports[context->import_count++] = module_name;
+    
+    if (debug_mode) {
+        printf("Import of module '%s'\n", module_name);
+    }
+    
+    return true;
+}
+
 bool parse_module(parser_context_t *context)
 {
     if (debug_mode) {
@@ -168,7 +213,15 @@ bool parse_module(parser_context_t *context)
             return false;
         }
         
-        if (!expect_token(context, TOK_IDENT)) {
+        if (!match_token(context, TOK_IDENT)) {
+            parser_error(context, "Expected module name after import");
+            return false;
+        }
+        if (!parser_add_import(context, context->lexer->tokstart, (size_t)context->lexer->toklen)) {
+            parser_error(context, "Failed to record import");
+            return false;
+        }
+        if (!advance_token(context)) {
             return false;
         }
         
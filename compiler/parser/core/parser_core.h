@@ -34,6 +34,11 @@ struct parser_context {
     char *current_new_class;       // Class name for NEW expression
     int constructor_param_count;   // Number of constructor parameters
     bool has_constructor_params;   // Whether constructor has parameters
+    
+    // Modules named by import declarations, in source order (interned)
+    const char **imports;          // Imported module names
+    size_t import_count;           // Number of imports
+    size_t import_capacity;        // Capacity of imports array
 };
 
 // Core Parser Functions
@@ -5,6 +5,7 @@
 
 #include "expressions.h"
 #include "../core/parser_core.h"
+#include "../types/parser_types.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -49,7 +50,7 @@ ast_node_t* parse_logical_or(parser_context_t *context)
             return NULL;
         }
         
-        op_node->value = strdup("||");
+        ast_set_value(op_node, "||");
         ast_add_child(op_node, left);
         ast_add_child(op_node, right);
         left = op_node;
@@ -86,7 +87,7 @@ ast_node_t* parse_logical_and_ast(parser_context_t *context)
             return NULL;
         }
         
-        op_node->value = strdup("&&");
+        ast_set_value(op_node, "&&");
         ast_add_child(op_node, left);
         ast_add_child(op_node, right);
         left = op_node;
@@ -376,6 +377,41 @@ ast_node_t* parse_unary(parser_context_t *context)
         return op_node;
     }
     
+    // spawn obj.method() starts a task and gives its handle; join handle
+    // waits for the task and gives its result
+    if (match_token(context, TOK_SPAWN) || match_token(context, TOK_JOIN)) {
+        bool spawn = match_token(context, TOK_SPAWN);
+        ast_node_t *task_node = ast_create_node(spawn ? AST_SPAWN_EXPR : AST_JOIN_EXPR);
+        if (!task_node) {
+            return NULL;
+        }
+        
+        if (!advance_token(context)) {
+            ast_destroy_node(task_node);
+            return NULL;
+        }
+        
+        ast_node_t *operand = parse_primary(context);
+        if (!operand) {
+            ast_destroy_node(task_node);
+            return NULL;
+        }
+        
+        // A task runs one method of one object
+        if (spawn) {
+            const char *dot = operand->type == AST_METHOD_CALL && operand->value ? strrchr(operand->value, '.') : NULL;
+            if (dot == NULL || dot == operand->value || dot[1] == '\0') {
+                parser_error(context, "Expected a method call (object.method()) after 'spawn'");
+                ast_destroy_node(operand);
+                ast_destroy_node(task_node);
+                return NULL;
+            }
+        }
+        
+        ast_add_child(task_node, operand);
+        return task_node;
+    }
+    
     return parse_primary(context);
 }
 
@@ -389,6 +425,7 @@ ast_node_t* parse_primary(parser_context_t *context)
     
     switch (context->lexer->token) {
         case TOK_NUMBER:
+        case TOK_REAL_NUMBER:
             node = parse_number_literal(context);
             break;
             
@@ -505,6 +542,9 @@ ast_node_t* parse_number_literal(parser_context_t *context)
     ast_node_t *node = ast_create_node(AST_LITERAL);
     if (node) {
         ast_set_number(node, context->lexer->number);
+        if (context->lexer->token == TOK_REAL_NUMBER) {
+            node->data_type = TYPE_REAL;
+        }
         if (debug_mode) {
             printf("Created AST node for number literal: %lld\n", context->lexer->number);
         }
@@ -528,14 +568,13 @@ ast_node_t* parse_string_literal(parser_context_t *context)
     ast_node_t *node = ast_create_node(AST_LITERAL);
     if (node) {
         // Store the string literal value
-        char *string_value = malloc(context->lexer->toklen + 1);
+        char *string_value = lexer_token_text(context->lexer);
         if (string_value) {
-            strncpy(string_value, context->lexer->tokstart, context->lexer->toklen);
-            string_value[context->lexer->toklen] = '\0';
             ast_set_value(node, string_value);
             if (debug_mode) {
                 printf("Created AST node for string literal: '%s'\n", string_value);
             }
+            free(string_value);
         }
     }
     
@@ -544,11 +583,7 @@ ast_node_t* parse_string_literal(parser_context_t *context)
         free(context->current_string_literal);
     }
     
-    context->current_string_literal = malloc(context->lexer->toklen + 1);
-    if (context->current_string_literal) {
-        strncpy(context->current_string_literal, context->lexer->tokstart, context->lexer->toklen);
-        context->current_string_literal[context->lexer->toklen] = '\0';
-    }
+    context->current_string_literal = lexer_token_text(context->lexer);
     
     // Also collect the string literal for method-level collection
     // This ensures string literals in expressions are available for code generation
@@ -574,15 +609,9 @@ ast_node_t* parse_identifier(parser_context_t *context)
     // Create AST node for identifier
     ast_node_t *node = ast_create_node(AST_IDENTIFIER);
     if (node) {
-        // Store the identifier name
-        char *ident_name = malloc(context->lexer->toklen + 1);
-        if (ident_name) {
-            strncpy(ident_name, context->lexer->tokstart, context->lexer->toklen);
-            ident_name[context->lexer->toklen] = '\0';
-            ast_set_value(node, ident_name);
-            if (debug_mode) {
-                printf("Created AST node for identifier: '%s'\n", ident_name);
-            }
+        ast_set_value_from_token(node, context->lexer->tokstart, context->lexer->toklen);
+        if (debug_mode && node->value) {
+            printf("Created AST node for identifier: '%s'\n", node->value);
         }
     }
     
@@ -623,6 +652,13 @@ ast_node_t* parse_postfix_operations(parser_context_t *context, char *base_name)
         return parse_method_call_expression(context, base_name, NULL);
     }
     
+    // Element of an array
+    if (match_token(context, TOK_LBRACKET)) {
+        ast_node_t *index_node = parse_index_expression(context, base_name);
+        free(base_name);
+        return index_node;
+    }
+    
     // No postfix operations, just a simple identifier
     free(base_name);
     return NULL; // This should be handled by the caller
@@ -747,6 +783,41 @@ ast_node_t* parse_method_call_expression(parser_context_t *context, char *base_n
     return method_call;
 }
 
+// name[index]; base_name stays the caller's
+ast_node_t* parse_index_expression(parser_context_t *context, const char *base_name)
+{
+    ast_node_t *index_node = ast_create_node(AST_INDEX);
+    if (!index_node) {
+        return NULL;
+    }
+    ast_set_value(index_node, base_name);
+    
+    // Consume the opening bracket
+    if (!advance_token(context)) {
+        ast_destroy_node(index_node);
+        return NULL;
+    }
+    
+    ast_node_t *index = parse_expression(context);
+    if (!index) {
+        ast_destroy_node(index_node);
+        return NULL;
+    }
+    ast_add_child(index_node, index);
+    
+    if (!match_token(context, TOK_RBRACKET)) {
+        parser_error(context, "Expected ']' after array index");
+        ast_destroy_node(index_node);
+        return NULL;
+    }
+    if (!advance_token(context)) {
+        ast_destroy_node(index_node);
+        return NULL;
+    }
+    
+    return index_node;
+}
+
 ast_node_t* parse_field_access_expression(parser_context_t *context, char *base_name, char *member_name)
 {
     if (debug_mode) {
@@ -856,6 +927,32 @@ ast_node_t* parse_new_expression(parser_context_t *context)
         return NULL;
     }
     
+    // new T[length] with a primitive T makes an array
+    type_info_t *element_type = parse_primitive_type(context);
+    if (element_type != NULL) {
+        ast_node_t *array_node = ast_create_node(AST_NEW_ARRAY);
+        if (!array_node) {
+            return NULL;
+        }
+        array_node->data_type = element_type->data.primitive;
+        
+        if (!expect_token(context, TOK_LBRACKET)) {
+            ast_destroy_node(array_node);
+            return NULL;
+        }
+        ast_node_t *length = parse_expression(context);
+        if (!length) {
+            ast_destroy_node(array_node);
+            return NULL;
+        }
+        ast_add_child(array_node, length);
+        if (!expect_token(context, TOK_RBRACKET)) {
+            ast_destroy_node(array_node);
+            return NULL;
+        }
+        return array_node;
+    }
+    
     // Expect class name identifier
     if (context->lexer->token != TOK_IDENT) {
         parser_error(context, "Expected class name after NEW");
@@ -879,11 +976,12 @@ ast_node_t* parse_new_expression(parser_context_t *context)
     strncpy(class_name, context->lexer->tokstart, context->lexer->toklen);
     class_name[context->lexer->toklen] = '\0';
     
-    new_node->value = class_name;
+    ast_set_value(new_node, class_name);
     
     if (debug_mode) {
         printf("NEW expression parsed: %s\n", class_name);
     }
+    free(class_name);
     
     // Advance past class name
     if (!advance_token(context)) {
@@ -36,6 +36,7 @@ ast_node_t* parse_identifier(parser_context_t *context);
 
 // Postfix and Method Call Functions
 ast_node_t* parse_postfix_operations(parser_context_t *context, char *base_name);
+ast_node_t* parse_index_expression(parser_context_t *context, const char *base_name);
 ast_node_t* parse_dot_expression(parser_context_t *context, char *base_name);
 ast_node_t* parse_method_call_expression(parser_context_t *context, char *base_name, char *member_name);
 ast_node_t* parse_field_access_expression(parser_context_t *context, char *base_name, char *member_name);
@@ -13,6 +13,18 @@
 // External debug flag
 extern bool debug_mode;
 
+// Primitive type named by a type keyword; TYPE_NONE for strings, arrays and classes
+static primitive_type_t primitive_type_of_token(token_t token)
+{
+    switch (token) {
+        case TOK_INTEGER: return TYPE_INTEGER;
+        case TOK_BOOLEAN: return TYPE_BOOLEAN;
+        case TOK_CHAR: return TYPE_CHAR;
+        case TOK_REAL: return TYPE_REAL;
+        default: return TYPE_NONE;
+    }
+}
+
 ast_node_t* parse_class(parser_context_t *context)
 {
     if (debug_mode) {
@@ -104,6 +116,7 @@ ast_node_t* parse_class(parser_context_t *context)
             context->lexer->token == TOK_INTEGER || 
             context->lexer->token == TOK_BOOLEAN || 
             context->lexer->token == TOK_CHAR || 
+            context->lexer->token == TOK_REAL || 
             context->lexer->token == TOK_IDENT ||
             context->lexer->token == TOK_ARRAY) {
             // Field declaration (C-style: type name;)
@@ -210,11 +223,13 @@ ast_node_t* parse_field(parser_context_t *context)
         !match_token(context, TOK_INTEGER) && 
         !match_token(context, TOK_BOOLEAN) && 
         !match_token(context, TOK_CHAR) && 
+        !match_token(context, TOK_REAL) && 
         !match_token(context, TOK_STRING) && 
         !match_token(context, TOK_ARRAY)) {
         parser_error(context, "Expected type");
         return NULL;
     }
+    field->data_type = primitive_type_of_token(context->lexer->token);
     
     // Store type name before advancing token
     char *type_name = malloc(context->lexer->toklen + 1);
@@ -304,6 +319,7 @@ ast_node_t* parse_method(parser_context_t *context)
         parser_error(context, "Failed to create method node");
         return false;
     }
+    method->line_number = (uint32_t)context->lexer->linenum;
     
     // Parse method type - initially set as PROCEDURE, will be changed to FUNCTION if return type is found
     if (context->lexer->token == TOK_PROCEDURE) {
@@ -379,11 +395,13 @@ ast_node_t* parse_method(parser_context_t *context)
             !match_token(context, TOK_INTEGER) && 
             !match_token(context, TOK_BOOLEAN) && 
             !match_token(context, TOK_CHAR) && 
+            !match_token(context, TOK_REAL) && 
             !match_token(context, TOK_STRING) && 
             !match_token(context, TOK_ARRAY)) {
             parser_error(context, "Expected return type");
             return false;
         }
+        method->data_type = primitive_type_of_token(context->lexer->token);
         
         if (!advance_token(context)) {
             return false;
@@ -6,6 +6,7 @@
 #include "statements.h"
 #include "../core/parser_core.h"
 #include "../expressions/expressions.h"
+#include "../../arena/arena.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -141,7 +142,21 @@ bool parse_statement(parser_context_t *context)
     return true;
 }
 
+static ast_node_t* parse_statement_ast_at_token(parser_context_t *context);
+
 ast_node_t* parse_statement_ast(parser_context_t *context)
+{
+    // Stamp the statement with the line of its first token; the line table
+    // the code generator emits for profiling and diagnostics keys off this
+    uint32_t line = (uint32_t)context->lexer->linenum;
+    ast_node_t *node = parse_statement_ast_at_token(context);
+    if (node && node->line_number == 0) {
+        node->line_number = line;
+    }
+    return node;
+}
+
+static ast_node_t* parse_statement_ast_at_token(parser_context_t *context)
 {
     if (debug_mode) {
         printf("*** PARSE_STATEMENT_AST CALLED *** - token: %s (switch_token=%d, lexer_token=%d, text='%.*s')\n", 
@@ -183,6 +198,9 @@ ast_node_t* parse_statement_ast(parser_context_t *context)
             // Parse RETURN statement
             return parse_return_statement(context);
             
+        case TOK_YIELD:
+            return parse_yield_statement(context);
+            
         case TOK_WRITELN:
             // Parse the writeln statement and build proper AST structure
             ast_node_t *expr_node = parse_writeln_statement(context);
@@ -199,6 +217,7 @@ ast_node_t* parse_statement_ast(parser_context_t *context)
         case TOK_BOOLEAN:
         case TOK_CHAR:
         case TOK_REAL:
+        case TOK_ARRAY:
             // Variable declaration: TYPE variable;
             return parse_variable_declaration(context);
             
@@ -211,16 +230,12 @@ ast_node_t* parse_statement_ast(parser_context_t *context)
             // Check if this is an assignment by looking at the next token
             size_t save_pos = context->lexer->pos;
             token_t save_token = context->lexer->token;
+            int64_t save_line = context->lexer->linenum;
             
-            // Capture the variable name before advancing
-            char *var_name = malloc(context->lexer->toklen + 1);
-            if (var_name) {
-                strncpy(var_name, context->lexer->tokstart, context->lexer->toklen);
-                var_name[context->lexer->toklen] = '\0';
-                
-                if (debug_mode) {
-                    printf("DEBUG: Captured variable name: '%s'\n", var_name);
-                }
+            // Capture the variable name before advancing; the arena keeps it
+            const char *var_name = arena_intern(arena_current(), context->lexer->tokstart, context->lexer->toklen);
+            if (var_name && debug_mode) {
+                printf("DEBUG: Captured variable name: '%s'\n", var_name);
             }
             
             // Advance to next token to check if it's an assignment
@@ -231,17 +246,22 @@ ast_node_t* parse_statement_ast(parser_context_t *context)
                     }
                     // Parse assignment with the captured variable name
                     return parse_assignment_statement_with_var(context, var_name);
+                } else if (context->lexer->token == TOK_LBRACKET && var_name) {
+                    return parse_element_assignment(context, var_name);
+                } else if (context->lexer->token == TOK_IDENT && var_name) {
+                    // ClassName variable;
+                    return parse_object_declaration(context, var_name);
                 } else {
                     // Not an assignment, restore position
                     context->lexer->pos = save_pos;
                     context->lexer->token = save_token;
-                    if (var_name) free(var_name);
+                    context->lexer->linenum = save_line;
                 }
             } else {
                 // Failed to advance, restore position
                 context->lexer->pos = save_pos;
                 context->lexer->token = save_token;
-                if (var_name) free(var_name);
+                context->lexer->linenum = save_line;
             }
             
             if (debug_mode) {
@@ -313,12 +333,8 @@ ast_node_t* parse_variable_declaration(parser_context_t *context)
         return NULL;
     }
     
-    char *var_name = malloc(context->lexer->toklen + 1);
-    if (var_name) {
-        strncpy(var_name, context->lexer->tokstart, context->lexer->toklen);
-        var_name[context->lexer->toklen] = '\0';
-        ast_set_value(var_node, var_name);
-    }
+    ast_set_value_from_token(var_node, context->lexer->tokstart, context->lexer->toklen);
+    const char *var_name = var_node->value;
     
     // Advance past the identifier
     if (!advance_token(context)) {
@@ -332,17 +348,36 @@ ast_node_t* parse_variable_declaration(parser_context_t *context)
         return NULL;
     }
     
+    // Arrays hold primitives; the declaration keeps the element type
+    bool is_array = type_is_array(type_info);
+    if (is_array && !type_is_primitive(type_info->data.array_info.element_type)) {
+        parser_error(context, "Array elements must be integer, boolean, char or real");
+        ast_destroy_node(var_node);
+        return NULL;
+    }
+    
     // Create variable declaration node
-    ast_node_t *decl_node = ast_create_node(AST_VAR_DECL);
+    ast_node_t *decl_node = ast_create_node(is_array ? AST_ARRAY_DECL : AST_VAR_DECL);
     if (!decl_node) {
         ast_destroy_node(var_node);
         return NULL;
     }
     
-    // For now, we'll just store the variable name
-    // TODO: Store type information properly
+    // Only the primitive kind is kept; code generation picks typed
+    // operations from it
+    if (type_is_primitive(type_info)) {
+        var_node->data_type = type_info->data.primitive;
+    } else if (is_array) {
+        var_node->data_type = type_info->data.array_info.element_type->data.primitive;
+    }
     ast_add_child(decl_node, var_node);
     
+    // Strings are marked with their type name, as fields are, so their
+    // built-in methods can be told from calls
+    if (type_is_object(type_info) && type_info->data.object == OBJ_TYPE_STRING) {
+        ast_set_value(decl_node, "string");
+    }
+    
     if (debug_mode) {
         printf("Created variable declaration: %s\n", var_name);
     }
@@ -350,6 +385,35 @@ ast_node_t* parse_variable_declaration(parser_context_t *context)
     return decl_node;
 }
 
+ast_node_t* parse_object_declaration(parser_context_t *context, const char *class_name)
+{
+    // The class name has been read; the lexer is at the variable name
+    ast_node_t *var_node = ast_create_node(AST_IDENTIFIER);
+    ast_node_t *decl_node = ast_create_node(AST_VAR_DECL);
+    if (!var_node || !decl_node) {
+        ast_destroy_node(var_node);
+        ast_destroy_node(decl_node);
+        return NULL;
+    }
+    ast_set_value_from_token(var_node, context->lexer->tokstart, context->lexer->toklen);
+    ast_add_child(decl_node, var_node);
+
+    // Object variables are marked with their class name, which escape
+    // analysis looks for
+    ast_set_value(decl_node, class_name);
+
+    if (!advance_token(context) || !expect_token(context, TOK_SEMICOL)) {
+        ast_destroy_node(decl_node);
+        return NULL;
+    }
+
+    if (debug_mode) {
+        printf("Created object variable declaration: %s %s\n", decl_node->value, var_node->value);
+    }
+
+    return decl_node;
+}
+
 ast_node_t* parse_assignment_statement_with_var(parser_context_t *context, const char *var_name)
 {
     if (debug_mode) {
@@ -362,7 +426,7 @@ ast_node_t* parse_assignment_statement_with_var(parser_context_t *context, const
             return NULL;
         }
     
-    ast_set_value(var_node, strdup(var_name));
+    ast_set_value(var_node, var_name);
     
     // Consume the = token
     if (!expect_token(context, TOK_ASSIGN)) {
@@ -395,6 +459,30 @@ ast_node_t* parse_assignment_statement_with_var(parser_context_t *context, const
     return assign_node;
 }
 
+// name[index] = expression, at the '['
+ast_node_t* parse_element_assignment(parser_context_t *context, const char *var_name)
+{
+    ast_node_t *assign_node = parse_index_expression(context, var_name);
+    if (!assign_node) {
+        return NULL;
+    }
+    
+    if (!expect_token(context, TOK_ASSIGN)) {
+        ast_destroy_node(assign_node);
+        return NULL;
+    }
+    
+    ast_node_t *expr_node = parse_expression(context);
+    if (!expr_node) {
+        ast_destroy_node(assign_node);
+        return NULL;
+    }
+    
+    assign_node->type = AST_INDEX_ASSIGNMENT;
+    ast_add_child(assign_node, expr_node);
+    return assign_node;
+}
+
 ast_node_t* parse_assignment_statement(parser_context_t *context)
 {
     if (debug_mode) {
@@ -430,12 +518,7 @@ ast_node_t* parse_assignment_statement(parser_context_t *context)
         return NULL;
     }
     
-    char *var_name = malloc(context->lexer->toklen + 1);
-    if (var_name) {
-        strncpy(var_name, context->lexer->tokstart, context->lexer->toklen);
-        var_name[context->lexer->toklen] = '\0';
-        ast_set_value(var_node, var_name);
-    }
+    ast_set_value_from_token(var_node, context->lexer->tokstart, context->lexer->toklen);
     
     if (!advance_token(context)) {
         ast_destroy_node(var_node);
@@ -603,12 +686,8 @@ ast_node_t* parse_for_statement(parser_context_t *context)
     }
     
     // Store the variable name
-    char *var_name = malloc(context->lexer->toklen + 1);
-    if (var_name) {
-        strncpy(var_name, context->lexer->tokstart, context->lexer->toklen);
-        var_name[context->lexer->toklen] = '\0';
-        ast_set_value(var_node, var_name);
-    }
+    ast_set_value_from_token(var_node, context->lexer->tokstart, context->lexer->toklen);
+    const char *var_name = var_node->value;
     
     if (!advance_token(context)) {
         ast_destroy_node(for_node);
@@ -1067,3 +1146,28 @@ ast_node_t* parse_return_statement(parser_context_t *context)
     
     return return_node;
 }
+
+// yield; lets the next ready task run
+ast_node_t* parse_yield_statement(parser_context_t *context)
+{
+    if (context == NULL) {
+        return NULL;
+    }
+    
+    ast_node_t *yield_node = ast_create_node(AST_YIELD_STMT);
+    if (!yield_node) {
+        return NULL;
+    }
+    
+    // Advance past the 'yield' keyword and the semicolon, if present
+    if (!advance_token(context)) {
+        ast_destroy_node(yield_node);
+        return NULL;
+    }
+    if (context->lexer->token == TOK_SEMICOL && !advance_token(context)) {
+        ast_destroy_node(yield_node);
+        return NULL;
+    }
+    
+    return yield_node;
+}
@@ -20,10 +20,12 @@ ast_node_t* parse_statement_ast(parser_context_t *context);
 
 // Variable Declaration Functions
 ast_node_t* parse_variable_declaration(parser_context_t *context);
+ast_node_t* parse_object_declaration(parser_context_t *context, const char *class_name);
 
 // Assignment Statement Functions
 ast_node_t* parse_assignment_statement_with_var(parser_context_t *context, const char *var_name);
 ast_node_t* parse_assignment_statement(parser_context_t *context);
+ast_node_t* parse_element_assignment(parser_context_t *context, const char *var_name);
 
 // Output Statement Functions
 ast_node_t* parse_writeln_statement(parser_context_t *context);
@@ -33,3 +35,4 @@ ast_node_t* parse_for_statement(parser_context_t *context);
 ast_node_t* parse_while_statement(parser_context_t *context);
 ast_node_t* parse_if_statement(parser_context_t *context);
 ast_node_t* parse_return_statement(parser_context_t *context);
+ast_node_t* parse_yield_statement(parser_context_t *context);
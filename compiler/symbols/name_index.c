@@ -0,0 +1,128 @@
+/*
+ * ARX Name Index Implementation
+ * Chained hash buckets keyed by symbol_hash()
+ */
+
+#include "name_index.h"
+#include <stdlib.h>
+
+#define NAME_INDEX_MIN_BUCKETS 16
+
+void name_index_init(name_index_t *index)
+{
+    if (index != NULL) {
+        memset(index, 0, sizeof(name_index_t));
+    }
+}
+
+void name_index_cleanup(name_index_t *index)
+{
+    if (index != NULL) {
+        free(index->buckets);
+        free(index->next);
+        free(index->hashes);
+        memset(index, 0, sizeof(name_index_t));
+    }
+}
+
+// Rechain every entry into bucket_count buckets, oldest first so each
+// bucket ends up newest first
+static bool name_index_rehash(name_index_t *index, size_t bucket_count)
+{
+    size_t *buckets = malloc(bucket_count * sizeof(size_t));
+    if (buckets == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < bucket_count; i++) {
+        buckets[i] = NAME_INDEX_NONE;
+    }
+    for (size_t entry = 0; entry < index->count; entry++) {
+        size_t bucket = index->hashes[entry] & (bucket_count - 1);
+        index->next[entry] = buckets[bucket];
+        buckets[bucket] = entry;
+    }
+
+    free(index->buckets);
+    index->buckets = buckets;
+    index->bucket_count = bucket_count;
+    return true;
+}
+
+bool name_index_push(name_index_t *index, uint32_t hash)
+{
+    if (index == NULL) {
+        return false;
+    }
+
+    if (index->count >= index->capacity) {
+        size_t new_capacity = index->capacity == 0 ? NAME_INDEX_MIN_BUCKETS : index->capacity * 2;
+        size_t *new_next = realloc(index->next, new_capacity * sizeof(size_t));
+        if (new_next == NULL) {
+            return false;
+        }
+        index->next = new_next;
+        uint32_t *new_hashes = realloc(index->hashes, new_capacity * sizeof(uint32_t));
+        if (new_hashes == NULL) {
+            return false;
+        }
+        index->hashes = new_hashes;
+        index->capacity = new_capacity;
+    }
+
+    // Keep chains short: at most one entry per bucket on average
+    if (index->count >= index->bucket_count) {
+        size_t bucket_count = index->bucket_count == 0 ? NAME_INDEX_MIN_BUCKETS : index->bucket_count * 2;
+        if (!name_index_rehash(index, bucket_count)) {
+            return false;
+        }
+    }
+
+    size_t entry = index->count;
+    size_t bucket = hash & (index->bucket_count - 1);
+    index->hashes[entry] = hash;
+    index->next[entry] = index->buckets[bucket];
+    index->buckets[bucket] = entry;
+    index->count++;
+    return true;
+}
+
+void name_index_truncate(name_index_t *index, size_t count)
+{
+    if (index == NULL) {
+        return;
+    }
+
+    // The newest entry heads its bucket, so it unlinks in O(1)
+    while (index->count > count) {
+        size_t entry = index->count - 1;
+        index->buckets[index->hashes[entry] & (index->bucket_count - 1)] = index->next[entry];
+        index->count--;
+    }
+}
+
+size_t name_index_first(const name_index_t *index, uint32_t hash)
+{
+    if (index == NULL || index->bucket_count == 0) {
+        return NAME_INDEX_NONE;
+    }
+
+    size_t entry = index->buckets[hash & (index->bucket_count - 1)];
+    while (entry != NAME_INDEX_NONE && index->hashes[entry] != hash) {
+        entry = index->next[entry];
+    }
+    return entry;
+}
+
+size_t name_index_next(const name_index_t *index, size_t entry)
+{
+    if (index == NULL || entry >= index->count) {
+        return NAME_INDEX_NONE;
+    }
+
+    uint32_t hash = index->hashes[entry];
+    entry = index->next[entry];
+    while (entry != NAME_INDEX_NONE && index->hashes[entry] != hash) {
+        entry = index->next[entry];
+    }
+    return entry;
+}
@@ -0,0 +1,51 @@
+/*
+ * ARX Name Index
+ * Hash index over an array the caller owns, for O(1) lookups by name
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include "symbols.h"
+
+#define NAME_INDEX_NONE SIZE_MAX
+
+// Entry IDs are positions in the caller's array and are added in order.
+// Each bucket chains its entries newest first, so a lookup that stops at
+// the first match sees the latest definition of a name.
+typedef struct {
+    size_t *buckets;                // Newest entry per bucket, NAME_INDEX_NONE when empty
+    size_t bucket_count;            // Number of buckets (power of two)
+    size_t *next;                   // Next older entry in the same bucket
+    uint32_t *hashes;               // Hash of each entry's key
+    size_t count;                   // Entries indexed
+    size_t capacity;                // Entries next/hashes can hold
+} name_index_t;
+
+void name_index_init(name_index_t *index);
+void name_index_cleanup(name_index_t *index);
+
+// Index entry `index->count` under hash
+bool name_index_push(name_index_t *index, uint32_t hash);
+// Forget entries from `count` on, newest first
+void name_index_truncate(name_index_t *index, size_t count);
+
+// Entries whose key has this hash, newest first; callers compare the keys
+size_t name_index_first(const name_index_t *index, uint32_t hash);
+size_t name_index_next(const name_index_t *index, size_t entry);
+
+static inline uint32_t name_index_hash(const char *name)
+{
+    return symbol_hash(name, strlen(name));
+}
+
+// Hash of a 64-bit ID (class IDs)
+static inline uint32_t name_index_hash_id(uint64_t id)
+{
+    id ^= id >> 33;
+    id *= 0xff51afd7ed558ccdULL;
+    id ^= id >> 33;
+    return (uint32_t)id;
+}
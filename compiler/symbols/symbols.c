@@ -4,6 +4,7 @@
  */
 
 #include "symbols.h"
+#include "../arena/arena.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -54,7 +55,7 @@ void symbol_table_cleanup(symbol_table_t *table)
 
 scope_t* scope_create(int level, const char *name)
 {
-    scope_t *scope = malloc(sizeof(scope_t));
+    scope_t *scope = arena_alloc(arena_current(), sizeof(scope_t));
     if (scope == NULL) {
         return NULL;
     }
@@ -62,18 +63,14 @@ scope_t* scope_create(int level, const char *name)
     scope->level = level;
     scope->name = NULL;
     if (name != NULL) {
-        scope->name = malloc(strlen(name) + 1);
+        scope->name = (char *)arena_intern(arena_current(), name, strlen(name));
         if (scope->name == NULL) {
-            free(scope);
             return NULL;
         }
-        strcpy(scope->name, name);
     }
     
-    scope->symbols = calloc(SYMBOL_HASH_SIZE, sizeof(symbol_t*));
+    scope->symbols = arena_calloc(arena_current(), SYMBOL_HASH_SIZE, sizeof(symbol_t*));
     if (scope->symbols == NULL) {
-        free(scope->name);
-        free(scope);
         return NULL;
     }
     
@@ -88,31 +85,8 @@ scope_t* scope_create(int level, const char *name)
 
 void scope_destroy(scope_t *scope)
 {
-    if (scope == NULL) {
-        return;
-    }
-    
-    // Destroy all symbols in this scope
-    for (size_t i = 0; i < scope->symbol_capacity; i++) {
-        symbol_t *symbol = scope->symbols[i];
-        while (symbol != NULL) {
-            symbol_t *next = symbol->next;
-            symbol_destroy(symbol);
-            symbol = next;
-        }
-    }
-    
-    // Destroy child scopes
-    scope_t *child = scope->child;
-    while (child != NULL) {
-        scope_t *next = child->sibling;
-        scope_destroy(child);
-        child = next;
-    }
-    
-    free(scope->symbols);
-    free(scope->name);
-    free(scope);
+    // Scopes, their tables and symbols live in the compilation arena
+    (void)scope;
 }
 
 bool scope_enter(symbol_table_t *table, const char *name)
@@ -173,19 +147,16 @@ scope_t* scope_find(symbol_table_t *table, int level)
 
 symbol_t* symbol_create(const char *name, size_t name_len, symbol_type_t type)
 {
-    symbol_t *symbol = malloc(sizeof(symbol_t));
+    symbol_t *symbol = arena_alloc(arena_current(), sizeof(symbol_t));
     if (symbol == NULL) {
         return NULL;
     }
     
-    symbol->name = malloc(name_len + 1);
+    symbol->name = (char *)arena_intern(arena_current(), name, name_len);
     if (symbol->name == NULL) {
-        free(symbol);
         return NULL;
     }
     
-    strncpy(symbol->name, name, name_len);
-    symbol->name[name_len] = '\0';
     symbol->name_len = name_len;
     
     symbol->type = type;
@@ -203,52 +174,8 @@ symbol_t* symbol_create(const char *name, size_t name_len, symbol_type_t type)
 
 void symbol_destroy(symbol_t *symbol)
 {
-    if (symbol == NULL) {
-        return;
-    }
-    
-    free(symbol->name);
-    
-    if (symbol->type_info != NULL) {
-        type_destroy(symbol->type_info);
-    }
-    
-    // Clean up type-specific data
-    switch (symbol->type) {
-        case SYMBOL_PROCEDURE:
-        case SYMBOL_FUNCTION:
-            if (symbol->data.procedure.parameter_types != NULL) {
-                for (size_t i = 0; i < symbol->data.procedure.parameter_count; i++) {
-                    if (symbol->data.procedure.parameter_types[i] != NULL) {
-                        type_destroy(symbol->data.procedure.parameter_types[i]);
-                    }
-                }
-                free(symbol->data.procedure.parameter_types);
-            }
-            break;
-        case SYMBOL_METHOD:
-            if (symbol->data.method.parameter_types != NULL) {
-                for (size_t i = 0; i < symbol->data.method.parameter_count; i++) {
-                    if (symbol->data.method.parameter_types[i] != NULL) {
-                        type_destroy(symbol->data.method.parameter_types[i]);
-                    }
-                }
-                free(symbol->data.method.parameter_types);
-            }
-            if (symbol->data.method.class_name != NULL) {
-                free(symbol->data.method.class_name);
-            }
-            break;
-        case SYMBOL_FIELD:
-            if (symbol->data.field.class_name != NULL) {
-                free(symbol->data.field.class_name);
-            }
-            break;
-        default:
-            break;
-    }
-    
-    free(symbol);
+    // Names, types and parameter arrays are all arena-allocated
+    (void)symbol;
 }
 
 bool symbol_add(symbol_table_t *table, symbol_t *symbol)
@@ -368,7 +295,7 @@ symbol_t* symbol_create_procedure(const char *name, size_t name_len, size_t addr
     
     symbol->data.procedure.address = address;
     symbol->data.procedure.parameter_count = parameter_count;
-    symbol->data.procedure.parameter_types = calloc(parameter_count, sizeof(type_info_t*));
+    symbol->data.procedure.parameter_types = arena_calloc(arena_current(), parameter_count, sizeof(type_info_t*));
     
     return symbol;
 }
@@ -384,7 +311,7 @@ symbol_t* symbol_create_function(const char *name, size_t name_len, type_info_t
     symbol->data.function.address = address;
     symbol->data.function.return_type = type_copy(return_type);
     symbol->data.function.parameter_count = parameter_count;
-    symbol->data.function.parameter_types = calloc(parameter_count, sizeof(type_info_t*));
+    symbol->data.function.parameter_types = arena_calloc(arena_current(), parameter_count, sizeof(type_info_t*));
     
     return symbol;
 }
@@ -402,12 +329,10 @@ symbol_t* symbol_create_class(const char *name, size_t name_len, size_t field_co
     
     // Set parent class
     if (parent_class != NULL) {
-        symbol->data.class_info.parent_class = malloc(strlen(parent_class) + 1);
+        symbol->data.class_info.parent_class = (char *)arena_intern(arena_current(), parent_class, strlen(parent_class));
         if (symbol->data.class_info.parent_class == NULL) {
-            symbol_destroy(symbol);
             return NULL;
         }
-        strcpy(symbol->data.class_info.parent_class, parent_class);
     } else {
         symbol->data.class_info.parent_class = NULL;
     }
@@ -424,12 +349,10 @@ symbol_t* symbol_create_field(const char *name, size_t name_len, type_info_t *ty
     
     symbol->type_info = type_copy(type_info);
     symbol->data.field.offset = offset;
-    symbol->data.field.class_name = malloc(strlen(class_name) + 1);
+    symbol->data.field.class_name = (char *)arena_intern(arena_current(), class_name, strlen(class_name));
     if (symbol->data.field.class_name == NULL) {
-        symbol_destroy(symbol);
         return NULL;
     }
-    strcpy(symbol->data.field.class_name, class_name);
     
     return symbol;
 }
@@ -444,14 +367,12 @@ symbol_t* symbol_create_method(const char *name, size_t name_len, type_info_t *r
     symbol->type_info = type_copy(return_type);
     symbol->data.method.address = address;
     symbol->data.method.return_type = type_copy(return_type);
-    symbol->data.method.class_name = malloc(strlen(class_name) + 1);
+    symbol->data.method.class_name = (char *)arena_intern(arena_current(), class_name, strlen(class_name));
     if (symbol->data.method.class_name == NULL) {
-        symbol_destroy(symbol);
         return NULL;
     }
-    strcpy(symbol->data.method.class_name, class_name);
     symbol->data.method.parameter_count = parameter_count;
-    symbol->data.method.parameter_types = calloc(parameter_count, sizeof(type_info_t*));
+    symbol->data.method.parameter_types = arena_calloc(arena_current(), parameter_count, sizeof(type_info_t*));
     
     return symbol;
 }
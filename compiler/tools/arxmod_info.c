@@ -22,6 +22,7 @@ void print_usage(const char* program_name)
     printf("  -info          Show module information (default)\n");
     printf("  -sections      Show section details\n");
     printf("  -classes       Show class information\n");
+    printf("  -externs       Show references to classes and methods of imported modules\n");
     printf("  -validate      Validate file format\n");
     printf("  -hex           Show hex dump of header\n");
     printf("  -h, --help     Show this help message\n");
@@ -45,6 +46,7 @@ int main(int argc, char *argv[])
     bool show_info = true;
     bool show_sections = false;
     bool show_classes = false;
+    bool show_externs = false;
     bool validate_only = false;
     bool show_hex = false;
     
@@ -61,6 +63,10 @@ int main(int argc, char *argv[])
             show_classes = true;
             show_info = false;
         }
+        else if (strcmp(argv[i], "-externs") == 0) {
+            show_externs = true;
+            show_info = false;
+        }
         else if (strcmp(argv[i], "-validate") == 0) {
             validate_only = true;
             show_info = false;
@@ -163,6 +169,28 @@ int main(int argc, char *argv[])
         }
     }
     
+    if (show_externs) {
+        external_ref_t *externs = NULL;
+        size_t extern_count = 0;
+        if (arxmod_reader_load_externs_section(&reader, &externs, &extern_count)) {
+            printf("\n=== ARX Module External References ===\n");
+            if (extern_count == 0) {
+                printf("No external references in module.\n");
+            }
+            for (size_t i = 0; i < extern_count; i++) {
+                if (externs[i].reference_type == ARXMOD_EXTERN_CLASS) {
+                    printf("%4zu: class  %s.%s (ID: %llu)\n", i, externs[i].module_name, externs[i].name,
+                           (unsigned long long)externs[i].external_class_id);
+                } else {
+                    printf("%4zu: method %s.%s\n", i, externs[i].module_name, externs[i].name);
+                }
+            }
+            free(externs);
+        } else {
+            printf("Error: Could not load externs section\n");
+        }
+    }
+    
     if (show_hex) {
         printf("\n=== ARX Module Header (Hex) ===\n");
         printf("Offset  ");
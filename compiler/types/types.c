@@ -4,6 +4,7 @@
  */
 
 #include "types.h"
+#include "../arena/arena.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -49,7 +50,7 @@ void types_cleanup(void)
 
 type_info_t* type_create_primitive(primitive_type_t primitive)
 {
-    type_info_t *type = malloc(sizeof(type_info_t));
+    type_info_t *type = arena_alloc(arena_current(), sizeof(type_info_t));
     if (type == NULL) {
         return NULL;
     }
@@ -83,7 +84,7 @@ type_info_t* type_create_primitive(primitive_type_t primitive)
 
 type_info_t* type_create_object(object_type_t object)
 {
-    type_info_t *type = malloc(sizeof(type_info_t));
+    type_info_t *type = arena_alloc(arena_current(), sizeof(type_info_t));
     if (type == NULL) {
         return NULL;
     }
@@ -113,20 +114,16 @@ type_info_t* type_create_object(object_type_t object)
 
 type_info_t* type_create_class(const char *class_name, size_t class_name_len)
 {
-    type_info_t *type = malloc(sizeof(type_info_t));
+    type_info_t *type = arena_alloc(arena_current(), sizeof(type_info_t));
     if (type == NULL) {
         return NULL;
     }
     
     type->category = TYPE_CATEGORY_CLASS;
-    type->data.class_info.class_name = malloc(class_name_len + 1);
+    type->data.class_info.class_name = (char *)arena_intern(arena_current(), class_name, class_name_len);
     if (type->data.class_info.class_name == NULL) {
-        free(type);
         return NULL;
     }
-    
-    strncpy(type->data.class_info.class_name, class_name, class_name_len);
-    type->data.class_info.class_name[class_name_len] = '\0';
     type->data.class_info.class_name_len = class_name_len;
     
     type->is_const = false;
@@ -138,7 +135,7 @@ type_info_t* type_create_class(const char *class_name, size_t class_name_len)
 
 type_info_t* type_create_array(type_info_t *element_type, size_t array_size)
 {
-    type_info_t *type = malloc(sizeof(type_info_t));
+    type_info_t *type = arena_alloc(arena_current(), sizeof(type_info_t));
     if (type == NULL) {
         return NULL;
     }
@@ -180,26 +177,8 @@ type_info_t* type_create_const(type_info_t *base_type)
 
 void type_destroy(type_info_t *type)
 {
-    if (type == NULL) {
-        return;
-    }
-    
-    switch (type->category) {
-        case TYPE_CATEGORY_CLASS:
-            if (type->data.class_info.class_name != NULL) {
-                free(type->data.class_info.class_name);
-            }
-            break;
-        case TYPE_CATEGORY_ARRAY:
-            if (type->data.array_info.element_type != NULL) {
-                type_destroy(type->data.array_info.element_type);
-            }
-            break;
-        default:
-            break;
-    }
-    
-    free(type);
+    // Types live in the compilation arena, which releases them all at once
+    (void)type;
 }
 
 type_info_t* type_copy(const type_info_t *type)
@@ -208,36 +187,19 @@ type_info_t* type_copy(const type_info_t *type)
         return NULL;
     }
     
-    type_info_t *copy = malloc(sizeof(type_info_t));
+    type_info_t *copy = arena_alloc(arena_current(), sizeof(type_info_t));
     if (copy == NULL) {
         return NULL;
     }
     
+    // Class names are interned and can be shared; only nested array element
+    // types need copying
     *copy = *type;
-    
-    // Deep copy for complex types
-    switch (type->category) {
-        case TYPE_CATEGORY_CLASS:
-            if (type->data.class_info.class_name != NULL) {
-                copy->data.class_info.class_name = malloc(type->data.class_info.class_name_len + 1);
-                if (copy->data.class_info.class_name == NULL) {
-                    free(copy);
-                    return NULL;
-                }
-                strcpy(copy->data.class_info.class_name, type->data.class_info.class_name);
-            }
-            break;
-        case TYPE_CATEGORY_ARRAY:
-            if (type->data.array_info.element_type != NULL) {
-                copy->data.array_info.element_type = type_copy(type->data.array_info.element_type);
-                if (copy->data.array_info.element_type == NULL) {
-                    free(copy);
-                    return NULL;
-                }
-            }
-            break;
-        default:
-            break;
+    if (type->category == TYPE_CATEGORY_ARRAY && type->data.array_info.element_type != NULL) {
+        copy->data.array_info.element_type = type_copy(type->data.array_info.element_type);
+        if (copy->data.array_info.element_type == NULL) {
+            return NULL;
+        }
     }
     
     return copy;
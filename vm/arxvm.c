@@ -3,21 +3,62 @@
  * Executes compiled ARX programs (.arxmod files)
  */
 
+#define _POSIX_C_SOURCE 200809L     // isatty() and fileno() for the output buffering default
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <unistd.h>
 #include "runtime/runtime.h"
+#include "core/profile.h"
+#include "core/jit.h"
+#include "core/task.h"
+#include "core/trace.h"
+#include "core/heapstats.h"
 
-// Global debug flag
+// Debug flag of the arxmod reader, shared with the compiler; the runtime,
+// loader and VM take theirs from runtime_config_t
 bool debug_mode = false;
 
 // Command line options
 typedef struct {
     bool debug_mode;
     bool trace_execution;
+    uint64_t trace_records;
+    const char *trace_file;
+    const char *trace_dump;
     bool dump_state;
     bool step_mode;
+    bool threaded;
+    bool fuse;
+    bool fusion_report;
+    uint64_t max_instructions;
+    uint64_t timeout_ms;
+    uint64_t max_call_depth;
+    uint64_t stack_size;
+    uint64_t stack_max_size;
+    uint64_t frame_stack_max_size;
+    uint64_t heap_words;
+    uint64_t heap_max_words;
+    uint64_t gc_threshold;
+    bool gc_threshold_set;
+    bool gc_stats;
+    const char *heap_stats_path;
+    bool alloc_sites;
+    uint64_t alloc_site_interval;
+    bool exec_stats;
+    bool no_mmap;
+    const char *image_cache_dir;
+    const char *profile_path;
+    uint64_t profile_interval;
+    bool jit;
+    uint64_t jit_threshold;
+    uint64_t task_slice;
+    uint64_t output_block;
+    bool output_block_set;
+    const char *module_paths[LOADER_MAX_MODULE_PATHS];
+    size_t module_path_count;
     const char *input_file;
     const char *output_file;
 } vm_options_t;
@@ -26,7 +67,7 @@ typedef struct {
 void print_usage(const char* program_name);
 void print_version(void);
 bool parse_arguments(int argc, char *argv[], vm_options_t *options);
-void print_vm_info(void);
+void print_vm_info(const vm_options_t *options);
 
 int main(int argc, char *argv[])
 {
@@ -38,20 +79,79 @@ int main(int argc, char *argv[])
         return 1;
     }
     
-    // Set global debug mode
+    // Decoding a saved trace needs no program
+    if (options.trace_dump != NULL) {
+        vm_trace_t trace;
+        if (!vm_trace_load(&trace, options.trace_dump)) {
+            printf("Error: Cannot read trace '%s'\n", options.trace_dump);
+            return 1;
+        }
+        vm_trace_print(&trace, stdout, (size_t)options.trace_records);
+        vm_trace_release(&trace);
+        return 0;
+    }
+    
+    // Debug output of the arxmod reader
     debug_mode = options.debug_mode;
     
     if (options.debug_mode) {
         printf("Main: Starting ARX VM\n");
         printf("Main: Parsing command line arguments\n");
         printf("Main: Initializing runtime\n");
-        print_vm_info();
+        print_vm_info(&options);
     }
     runtime_context_t runtime;
     runtime_config_t config = RUNTIME_CONFIG_DEFAULT;
     config.debug_mode = options.debug_mode;
     config.trace_execution = options.trace_execution;
+    config.trace_records = (size_t)options.trace_records;
+    config.trace_path = options.trace_file;
     config.dump_state_on_error = true;
+    config.dispatch_mode = options.threaded ? VM_DISPATCH_THREADED : VM_DISPATCH_SWITCH;
+    config.superinstructions = options.fuse;
+    config.max_instructions = options.max_instructions;
+    config.timeout_ms = options.timeout_ms;
+    if (options.max_call_depth > 0) {
+        config.max_call_depth = (size_t)options.max_call_depth;
+    }
+    if (options.stack_size > 0) {
+        config.stack_size = (size_t)options.stack_size;
+    }
+    if (options.stack_max_size > 0) {
+        config.stack_max_size = (size_t)options.stack_max_size;
+    }
+    if (options.frame_stack_max_size > 0) {
+        config.frame_stack_max_size = (size_t)options.frame_stack_max_size;
+    }
+    if (options.heap_words > 0) {
+        config.heap_words = (size_t)options.heap_words;
+    }
+    if (options.heap_max_words > 0) {
+        config.heap_max_words = (size_t)options.heap_max_words;
+    }
+    if (options.gc_threshold_set) {
+        config.gc_threshold = options.gc_threshold;
+    }
+    config.map_module = !options.no_mmap;
+    config.image_cache_dir = options.image_cache_dir;
+    config.module_paths = options.module_paths;
+    config.module_path_count = options.module_path_count;
+    config.profile_path = options.profile_path;
+    config.profile_interval = options.profile_interval;
+    config.heap_stats_path = options.heap_stats_path;
+    config.alloc_sites = options.alloc_sites;
+    config.alloc_site_interval = options.alloc_site_interval;
+    config.jit = options.jit;
+    config.jit_threshold = options.jit_threshold;
+    config.task_slice = options.task_slice;
+    // Block-buffer output that nobody watches line by line; diagnostics
+    // printed between lines keep their place
+    if (options.output_block_set) {
+        config.output_block = options.output_block;
+    } else if (!isatty(fileno(stdout)) && !options.debug_mode && !options.trace_execution &&
+               !options.step_mode) {
+        config.output_block = VM_OUTPUT_DEFAULT_BLOCK;
+    }
     
     if (!runtime_init(&runtime, &config)) {
         printf("Error: Failed to initialize ARX VM runtime\n");
@@ -65,6 +165,10 @@ int main(int argc, char *argv[])
         return 1;
     }
     
+    if (options.fusion_report) {
+        vm_dump_fusion_report(&runtime.vm);
+    }
+    
     // Dump initial state if requested
     if (options.dump_state) {
         runtime_dump_state(&runtime);
@@ -103,6 +207,25 @@ int main(int argc, char *argv[])
         runtime_dump_state(&runtime);
     }
     
+    if (options.gc_stats) {
+        vm_dump_gc_stats(&runtime.vm);
+    }
+    
+    if (options.heap_stats_path != NULL) {
+        runtime_write_heap_stats(&runtime);
+    }
+    
+    if (options.exec_stats) {
+        runtime_dump_exec_stats(&runtime);
+    }
+    
+    if (options.profile_path != NULL) {
+        runtime_write_profile(&runtime);
+    }
+    
+    // The error must be read before cleanup resets the runtime
+    vm_error_t error = runtime_get_last_error(&runtime);
+    
     // Cleanup
     runtime_cleanup(&runtime);
     
@@ -112,9 +235,8 @@ int main(int argc, char *argv[])
         }
         return 0;
     } else {
-        printf("Program execution failed: %s\n", 
-               vm_error_to_string(runtime_get_last_error(&runtime)));
-        return 1;
+        printf("Program execution failed: %s\n", vm_error_to_string(error));
+        return error == VM_ERROR_INSTRUCTION_LIMIT || error == VM_ERROR_TIMEOUT ? 2 : 1;
     }
 }
 
@@ -125,9 +247,48 @@ void print_usage(const char* program_name)
     printf("\n");
     printf("Options:\n");
     printf("  -debug          Enable debug output\n");
-    printf("  -trace          Trace instruction execution\n");
+    printf("  -trace          Record executed instructions in a ring; its end is printed on error\n");
+    printf("  -trace-records <n>     Instructions the ring keeps (implies -trace, default: %d)\n",
+           VM_TRACE_DEFAULT_RECORDS);
+    printf("  -trace-file <file>     Save the ring to file after the run (implies -trace)\n");
+    printf("  -trace-dump <file>     Decode a saved ring and exit (with -trace-records: its last n)\n");
     printf("  -dump           Dump VM state before and after execution\n");
     printf("  -step           Step through execution interactively\n");
+    printf("  -threaded       Use the direct-threaded interpreter engine\n");
+    printf("  -fuse           Fuse common instruction sequences (with -threaded)\n");
+    printf("  -fuse-report    Print which superinstructions were built\n");
+    printf("  -max-instructions <n>  Stop after n instructions (default: unlimited)\n");
+    printf("  -timeout <ms>   Stop after ms milliseconds of wall-clock time\n");
+    printf("  -max-call-depth <n>    Allow n nested calls (default: %d)\n", VM_DEFAULT_MAX_CALL_DEPTH);
+    printf("  -stack-size <words>    Initial data stack size (default: %zu)\n", RUNTIME_CONFIG_DEFAULT.stack_size);
+    printf("  -stack-max <words>     Size the data stack may grow to (default: %llu)\n",
+           (unsigned long long)VM_STACK_DEFAULT_MAX_WORDS);
+    printf("  -frame-stack-max <words> Size each frame stack may grow to (default: %llu)\n",
+           (unsigned long long)VM_FRAME_STACK_DEFAULT_MAX_WORDS);
+    printf("  -heap <words>          Initial object area size (default: %d)\n", VM_HEAP_DEFAULT_WORDS);
+    printf("  -heap-max <words>      Size the object area may grow to (default: %llu)\n",
+           (unsigned long long)VM_HEAP_DEFAULT_MAX_WORDS);
+    printf("  -gc-threshold <bytes>  Collect garbage after this much allocation (0: when full, default: %d)\n",
+           VM_GC_DEFAULT_THRESHOLD);
+    printf("  -gc-stats       Print garbage collector statistics after the run\n");
+    printf("  -heap-stats <file>     Write heap contents per class, free lists, allocation rate and\n");
+    printf("                         recent collections to file as JSON after the run (-: stdout)\n");
+    printf("  -alloc-sites <n>       Charge every n-th allocation to its instruction and source line\n");
+    printf("                         in the heap statistics (0: every %d-th)\n", VM_HEAP_SITES_DEFAULT_INTERVAL);
+    printf("  -stats          Print instructions executed, run time, allocations and peak RSS\n");
+    printf("  -no-mmap        Read the module into memory instead of mapping it\n");
+    printf("  -image-cache <dir>     Start from (and save) prepared images of modules in dir\n");
+    printf("  -module-path <dir>     Search dir for imported modules (repeatable)\n");
+    printf("  -profile <file>        Count instructions per opcode and method, and write sampled\n");
+    printf("                         call stacks to file in collapsed (flame graph) format\n");
+    printf("  -profile-interval <n>  Instructions between profile samples (default: %d)\n", VM_PROFILE_DEFAULT_INTERVAL);
+    printf("  -jit            Compile hot methods to native code (x86-64)\n");
+    printf("  -jit-threshold <n>     Method entries plus loop iterations before a method is\n");
+    printf("                         compiled (implies -jit, default: %d)\n", VM_JIT_DEFAULT_THRESHOLD);
+    printf("  -task-slice <n>        Instructions a task runs before the next ready one\n");
+    printf("                         gets a turn (default: %d)\n", VM_TASK_DEFAULT_SLICE);
+    printf("  -output-buffer <bytes> Write program output in blocks of this size (0: after each\n");
+    printf("                         line; default: %d, or 0 on a terminal)\n", VM_OUTPUT_DEFAULT_BLOCK);
     printf("  -o <file>       Output file (not used yet)\n");
     printf("  -h, --help      Show this help message\n");
     printf("  -v, --version   Show version information\n");
@@ -137,6 +298,13 @@ void print_usage(const char* program_name)
     printf("  %s -debug -trace program.arxmod\n", program_name);
     printf("  %s -step program.arxmod\n", program_name);
     printf("  %s -dump program.arxmod\n", program_name);
+    printf("  %s -threaded program.arxmod\n", program_name);
+    printf("  %s -threaded -fuse -fuse-report program.arxmod\n", program_name);
+    printf("  %s -max-instructions 1000000 -timeout 500 program.arxmod\n", program_name);
+    printf("  %s -threaded -profile out.folded program.arxmod\n", program_name);
+    printf("  %s -heap-stats heap.json -alloc-sites 1 program.arxmod\n", program_name);
+    printf("  %s -threaded -jit program.arxmod\n", program_name);
+    printf("  %s -trace-file run.trace program.arxmod; %s -trace-dump run.trace\n", program_name, program_name);
     printf("\n");
 }
 
@@ -148,7 +316,7 @@ void print_version(void)
     printf("\n");
 }
 
-void print_vm_info(void)
+void print_vm_info(const vm_options_t *options)
 {
     printf("=== ARX Virtual Machine ===\n");
     printf("Version: 1.0\n");
@@ -163,7 +331,7 @@ void print_vm_info(void)
            "Unknown"
 #endif
     );
-    printf("Debug mode: %s\n", debug_mode ? "enabled" : "disabled");
+    printf("Debug mode: %s\n", options->debug_mode ? "enabled" : "disabled");
     printf("\n");
 }
 
@@ -191,6 +359,136 @@ bool parse_arguments(int argc, char *argv[], vm_options_t *options)
         else if (strcmp(argv[i], "-step") == 0) {
             options->step_mode = true;
         }
+        else if (strcmp(argv[i], "-threaded") == 0) {
+            options->threaded = true;
+        }
+        else if (strcmp(argv[i], "-fuse") == 0) {
+            options->fuse = true;
+        }
+        else if (strcmp(argv[i], "-fuse-report") == 0) {
+            options->fuse = true;
+            options->fusion_report = true;
+        }
+        else if (strcmp(argv[i], "-gc-stats") == 0) {
+            options->gc_stats = true;
+        }
+        else if (strcmp(argv[i], "-stats") == 0) {
+            options->exec_stats = true;
+        }
+        else if (strcmp(argv[i], "-no-mmap") == 0) {
+            options->no_mmap = true;
+        }
+        else if (strcmp(argv[i], "-jit") == 0) {
+            options->jit = true;
+        }
+        else if (strcmp(argv[i], "-max-instructions") == 0 || strcmp(argv[i], "-timeout") == 0 ||
+                 strcmp(argv[i], "-max-call-depth") == 0 || strcmp(argv[i], "-gc-threshold") == 0 ||
+                 strcmp(argv[i], "-profile-interval") == 0 || strcmp(argv[i], "-jit-threshold") == 0 ||
+                 strcmp(argv[i], "-task-slice") == 0 || strcmp(argv[i], "-output-buffer") == 0 ||
+                 strcmp(argv[i], "-stack-size") == 0 || strcmp(argv[i], "-stack-max") == 0 ||
+                 strcmp(argv[i], "-frame-stack-max") == 0 || strcmp(argv[i], "-heap") == 0 ||
+                 strcmp(argv[i], "-heap-max") == 0 || strcmp(argv[i], "-trace-records") == 0 ||
+                 strcmp(argv[i], "-alloc-sites") == 0) {
+            const char *option = argv[i];
+            char *end = NULL;
+            if (i + 1 >= argc) {
+                printf("Error: %s requires a number\n", option);
+                return false;
+            }
+            unsigned long long value = strtoull(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0' || argv[i][0] == '-') {
+                printf("Error: Invalid value '%s' for %s\n", argv[i], option);
+                return false;
+            }
+            if (strcmp(option, "-max-instructions") == 0) {
+                options->max_instructions = value;
+            } else if (strcmp(option, "-max-call-depth") == 0) {
+                options->max_call_depth = value;
+            } else if (strcmp(option, "-stack-size") == 0) {
+                options->stack_size = value;
+            } else if (strcmp(option, "-stack-max") == 0) {
+                options->stack_max_size = value;
+            } else if (strcmp(option, "-frame-stack-max") == 0) {
+                options->frame_stack_max_size = value;
+            } else if (strcmp(option, "-heap") == 0) {
+                options->heap_words = value;
+            } else if (strcmp(option, "-heap-max") == 0) {
+                options->heap_max_words = value;
+            } else if (strcmp(option, "-trace-records") == 0) {
+                options->trace_execution = true;
+                options->trace_records = value;
+            } else if (strcmp(option, "-gc-threshold") == 0) {
+                options->gc_threshold = value;
+                options->gc_threshold_set = true;
+            } else if (strcmp(option, "-profile-interval") == 0) {
+                options->profile_interval = value;
+            } else if (strcmp(option, "-alloc-sites") == 0) {
+                options->alloc_sites = true;
+                options->alloc_site_interval = value;
+            } else if (strcmp(option, "-jit-threshold") == 0) {
+                options->jit = true;
+                options->jit_threshold = value;
+            } else if (strcmp(option, "-task-slice") == 0) {
+                options->task_slice = value;
+            } else if (strcmp(option, "-output-buffer") == 0) {
+                options->output_block = value;
+                options->output_block_set = true;
+            } else {
+                options->timeout_ms = value;
+            }
+        }
+        else if (strcmp(argv[i], "-image-cache") == 0) {
+            if (i + 1 < argc) {
+                options->image_cache_dir = argv[++i];
+            } else {
+                printf("Error: -image-cache requires a directory\n");
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "-profile") == 0) {
+            if (i + 1 < argc) {
+                options->profile_path = argv[++i];
+            } else {
+                printf("Error: -profile requires a file\n");
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "-heap-stats") == 0) {
+            if (i + 1 < argc) {
+                options->heap_stats_path = argv[++i];
+            } else {
+                printf("Error: -heap-stats requires a file\n");
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "-trace-file") == 0) {
+            if (i + 1 < argc) {
+                options->trace_execution = true;
+                options->trace_file = argv[++i];
+            } else {
+                printf("Error: -trace-file requires a file\n");
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "-trace-dump") == 0) {
+            if (i + 1 < argc) {
+                options->trace_dump = argv[++i];
+            } else {
+                printf("Error: -trace-dump requires a file\n");
+                return false;
+            }
+        }
+        else if (strcmp(argv[i], "-module-path") == 0) {
+            if (i + 1 >= argc) {
+                printf("Error: -module-path requires a directory\n");
+                return false;
+            }
+            if (options->module_path_count >= LOADER_MAX_MODULE_PATHS) {
+                printf("Error: At most %d -module-path directories\n", LOADER_MAX_MODULE_PATHS);
+                return false;
+            }
+            options->module_paths[options->module_path_count++] = argv[++i];
+        }
         else if (strcmp(argv[i], "-o") == 0) {
             if (i + 1 < argc) {
                 options->output_file = argv[++i];
@@ -224,11 +522,15 @@ bool parse_arguments(int argc, char *argv[], vm_options_t *options)
     }
     
     // Validate required arguments
-    if (options->input_file == NULL) {
+    if (options->input_file == NULL && options->trace_dump == NULL) {
         printf("Error: No input file specified\n");
         print_usage(argv[0]);
         return false;
     }
+    if (options->alloc_sites && options->heap_stats_path == NULL) {
+        printf("Error: -alloc-sites reports through -heap-stats\n");
+        return false;
+    }
     
     return true;
 }
@@ -0,0 +1,602 @@
+/*
+ * ARX Virtual Machine Arrays Implementation
+ * Heap arrays of 64-bit elements and the bulk operations on them
+ */
+
+#include "array.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if VM_ARRAY_SIMD && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define VM_ARRAY_X86 1
+#include <immintrin.h>
+#elif VM_ARRAY_SIMD && defined(__aarch64__) && defined(__ARM_NEON)
+#define VM_ARRAY_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Integer kernels. Elements are signed 64-bit; sums wrap like OPR_ADD, so
+// any order of additions gives the same result. Reals are summed and
+// compared one element at a time, in index order, so they round exactly as
+// the loop they replace.
+
+static void vm_array_fill_scalar(uint64_t *elements, size_t count, uint64_t value)
+{
+    for (size_t i = 0; i < count; i++) {
+        elements[i] = value;
+    }
+}
+
+static uint64_t vm_array_sum_scalar(const uint64_t *elements, size_t count)
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += elements[i];
+    }
+    return sum;
+}
+
+static int64_t vm_array_min_scalar(const uint64_t *elements, size_t count)
+{
+    int64_t best = (int64_t)elements[0];
+    for (size_t i = 1; i < count; i++) {
+        if ((int64_t)elements[i] < best) {
+            best = (int64_t)elements[i];
+        }
+    }
+    return best;
+}
+
+static int64_t vm_array_max_scalar(const uint64_t *elements, size_t count)
+{
+    int64_t best = (int64_t)elements[0];
+    for (size_t i = 1; i < count; i++) {
+        if ((int64_t)elements[i] > best) {
+            best = (int64_t)elements[i];
+        }
+    }
+    return best;
+}
+
+// Index of the first element equal to value, count if there is none
+static size_t vm_array_find_scalar(const uint64_t *elements, size_t count, uint64_t value)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (elements[i] == value) {
+            return i;
+        }
+    }
+    return count;
+}
+
+#if VM_ARRAY_X86
+
+// SSE2 is part of x86-64; AVX2 is checked for at each call, which reads a
+// flag libgcc sets once at start-up
+static bool vm_array_avx2(void)
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+static void vm_array_fill_sse2(uint64_t *elements, size_t count, uint64_t value)
+{
+    __m128i fill = _mm_set1_epi64x((long long)value);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        _mm_storeu_si128((__m128i *)(elements + i), fill);
+    }
+    vm_array_fill_scalar(elements + i, count - i, value);
+}
+
+static uint64_t vm_array_sum_sse2(const uint64_t *elements, size_t count)
+{
+    __m128i sum0 = _mm_setzero_si128();
+    __m128i sum1 = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        sum0 = _mm_add_epi64(sum0, _mm_loadu_si128((const __m128i *)(elements + i)));
+        sum1 = _mm_add_epi64(sum1, _mm_loadu_si128((const __m128i *)(elements + i + 2)));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, _mm_add_epi64(sum0, sum1));
+    return lanes[0] + lanes[1] + vm_array_sum_scalar(elements + i, count - i);
+}
+
+// SSE2 has no 64-bit compare: equal 32-bit halves, swapped and combined
+static size_t vm_array_find_sse2(const uint64_t *elements, size_t count, uint64_t value)
+{
+    __m128i needle = _mm_set1_epi64x((long long)value);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128i halves = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(elements + i)), needle);
+        __m128i equal = _mm_and_si128(halves, _mm_shuffle_epi32(halves, _MM_SHUFFLE(2, 3, 0, 1)));
+        int mask = _mm_movemask_pd(_mm_castsi128_pd(equal));
+        if (mask != 0) {
+            return i + (size_t)__builtin_ctz((unsigned)mask);
+        }
+    }
+    return i + vm_array_find_scalar(elements + i, count - i, value);
+}
+
+__attribute__((target("avx2")))
+static void vm_array_fill_avx2(uint64_t *elements, size_t count, uint64_t value)
+{
+    __m256i fill = _mm256_set1_epi64x((long long)value);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm256_storeu_si256((__m256i *)(elements + i), fill);
+    }
+    vm_array_fill_scalar(elements + i, count - i, value);
+}
+
+__attribute__((target("avx2")))
+static uint64_t vm_array_sum_avx2(const uint64_t *elements, size_t count)
+{
+    __m256i sum0 = _mm256_setzero_si256();
+    __m256i sum1 = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        sum0 = _mm256_add_epi64(sum0, _mm256_loadu_si256((const __m256i *)(elements + i)));
+        sum1 = _mm256_add_epi64(sum1, _mm256_loadu_si256((const __m256i *)(elements + i + 4)));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi64(sum0, sum1));
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + vm_array_sum_scalar(elements + i, count - i);
+}
+
+// Smallest (largest: max) element; the lanes start from the first one
+__attribute__((target("avx2")))
+static int64_t vm_array_extreme_avx2(const uint64_t *elements, size_t count, bool max)
+{
+    __m256i best = _mm256_set1_epi64x((long long)elements[0]);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256i next = _mm256_loadu_si256((const __m256i *)(elements + i));
+        __m256i take = max ? _mm256_cmpgt_epi64(next, best) : _mm256_cmpgt_epi64(best, next);
+        best = _mm256_blendv_epi8(best, next, take);
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, best);
+    int64_t lane_best = max ? vm_array_max_scalar(lanes, 4) : vm_array_min_scalar(lanes, 4);
+    if (i < count) {
+        int64_t tail = max ? vm_array_max_scalar(elements + i, count - i) :
+                             vm_array_min_scalar(elements + i, count - i);
+        if (max ? tail > lane_best : tail < lane_best) {
+            lane_best = tail;
+        }
+    }
+    return lane_best;
+}
+
+__attribute__((target("avx2")))
+static size_t vm_array_find_avx2(const uint64_t *elements, size_t count, uint64_t value)
+{
+    __m256i needle = _mm256_set1_epi64x((long long)value);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256i equal = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)(elements + i)), needle);
+        int mask = _mm256_movemask_pd(_mm256_castsi256_pd(equal));
+        if (mask != 0) {
+            return i + (size_t)__builtin_ctz((unsigned)mask);
+        }
+    }
+    return i + vm_array_find_scalar(elements + i, count - i, value);
+}
+
+#elif VM_ARRAY_NEON
+
+static void vm_array_fill_neon(uint64_t *elements, size_t count, uint64_t value)
+{
+    uint64x2_t fill = vdupq_n_u64(value);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        vst1q_u64(elements + i, fill);
+    }
+    vm_array_fill_scalar(elements + i, count - i, value);
+}
+
+static uint64_t vm_array_sum_neon(const uint64_t *elements, size_t count)
+{
+    uint64x2_t sum0 = vdupq_n_u64(0);
+    uint64x2_t sum1 = vdupq_n_u64(0);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        sum0 = vaddq_u64(sum0, vld1q_u64(elements + i));
+        sum1 = vaddq_u64(sum1, vld1q_u64(elements + i + 2));
+    }
+    return vaddvq_u64(vaddq_u64(sum0, sum1)) + vm_array_sum_scalar(elements + i, count - i);
+}
+
+static int64_t vm_array_extreme_neon(const uint64_t *elements, size_t count, bool max)
+{
+    int64x2_t best = vdupq_n_s64((int64_t)elements[0]);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        int64x2_t next = vld1q_s64((const int64_t *)(elements + i));
+        uint64x2_t take = max ? vcgtq_s64(next, best) : vcgtq_s64(best, next);
+        best = vbslq_s64(take, next, best);
+    }
+    uint64_t lanes[2] = { (uint64_t)vgetq_lane_s64(best, 0), (uint64_t)vgetq_lane_s64(best, 1) };
+    int64_t lane_best = max ? vm_array_max_scalar(lanes, 2) : vm_array_min_scalar(lanes, 2);
+    if (i < count) {
+        int64_t tail = max ? vm_array_max_scalar(elements + i, count - i) :
+                             vm_array_min_scalar(elements + i, count - i);
+        if (max ? tail > lane_best : tail < lane_best) {
+            lane_best = tail;
+        }
+    }
+    return lane_best;
+}
+
+static size_t vm_array_find_neon(const uint64_t *elements, size_t count, uint64_t value)
+{
+    uint64x2_t needle = vdupq_n_u64(value);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        uint64x2_t equal = vceqq_u64(vld1q_u64(elements + i), needle);
+        if (vgetq_lane_u64(equal, 0) != 0) {
+            return i;
+        }
+        if (vgetq_lane_u64(equal, 1) != 0) {
+            return i + 1;
+        }
+    }
+    return i + vm_array_find_scalar(elements + i, count - i, value);
+}
+
+#endif
+
+const char *vm_array_kernels(void)
+{
+#if VM_ARRAY_X86
+    return vm_array_avx2() ? "avx2" : "sse2";
+#elif VM_ARRAY_NEON
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
+
+static void vm_array_fill_words(uint64_t *elements, size_t count, uint64_t value)
+{
+#if VM_ARRAY_X86
+    if (vm_array_avx2()) {
+        vm_array_fill_avx2(elements, count, value);
+    } else {
+        vm_array_fill_sse2(elements, count, value);
+    }
+#elif VM_ARRAY_NEON
+    vm_array_fill_neon(elements, count, value);
+#else
+    vm_array_fill_scalar(elements, count, value);
+#endif
+}
+
+static uint64_t vm_array_sum_words(const uint64_t *elements, size_t count)
+{
+#if VM_ARRAY_X86
+    return vm_array_avx2() ? vm_array_sum_avx2(elements, count) : vm_array_sum_sse2(elements, count);
+#elif VM_ARRAY_NEON
+    return vm_array_sum_neon(elements, count);
+#else
+    return vm_array_sum_scalar(elements, count);
+#endif
+}
+
+// count > 0
+static int64_t vm_array_extreme_words(const uint64_t *elements, size_t count, bool max)
+{
+#if VM_ARRAY_X86
+    if (vm_array_avx2()) {
+        return vm_array_extreme_avx2(elements, count, max);
+    }
+#elif VM_ARRAY_NEON
+    return vm_array_extreme_neon(elements, count, max);
+#endif
+    return max ? vm_array_max_scalar(elements, count) : vm_array_min_scalar(elements, count);
+}
+
+static size_t vm_array_find_words(const uint64_t *elements, size_t count, uint64_t value)
+{
+#if VM_ARRAY_X86
+    return vm_array_avx2() ? vm_array_find_avx2(elements, count, value) :
+                             vm_array_find_sse2(elements, count, value);
+#elif VM_ARRAY_NEON
+    return vm_array_find_neon(elements, count, value);
+#else
+    return vm_array_find_scalar(elements, count, value);
+#endif
+}
+
+static double vm_array_real(uint64_t bits)
+{
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static uint64_t vm_array_bits(double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+bool vm_array_alloc(arx_vm_context_t *vm, array_kind_t kind, uint64_t length, uint64_t *address)
+{
+    if (vm == NULL || address == NULL) {
+        return false;
+    }
+    if (length > SIZE_MAX / sizeof(uint64_t) - VM_ARRAY_HEADER_WORDS) {
+        vm->last_error = VM_ERROR_OUT_OF_MEMORY;
+        return false;
+    }
+    if (!vm_heap_alloc(vm, VM_ARRAY_HEADER_WORDS + (size_t)length, address)) {
+        return false;
+    }
+    vm->stack[*address + 0] = VM_ARRAY_TAG | (uint64_t)kind;
+    vm->stack[*address + 1] = length;
+    return true;
+}
+
+bool vm_array_view(arx_vm_context_t *vm, uint64_t address, array_kind_t *kind, uint64_t **elements, uint64_t *length)
+{
+    if (vm == NULL || !vm_heap_contains(vm, address, VM_ARRAY_HEADER_WORDS)) {
+        return false;
+    }
+
+    // Class instances are in the object table; their first field could
+    // hold anything
+    memory_manager_t *mm = &vm->memory_manager;
+    uint64_t tag = vm->stack[address];
+    if (mm->address_index[address - mm->heap_base] != 0 || (tag & ~VM_ARRAY_KIND_MASK) != VM_ARRAY_TAG) {
+        return false;
+    }
+    uint64_t count = vm->stack[address + 1];
+    if (count > SIZE_MAX / sizeof(uint64_t) - VM_ARRAY_HEADER_WORDS ||
+        !vm_heap_contains(vm, address, VM_ARRAY_HEADER_WORDS + (size_t)count)) {
+        return false;
+    }
+
+    *kind = (array_kind_t)(tag & VM_ARRAY_KIND_MASK);
+    *elements = &vm->stack[address + VM_ARRAY_HEADER_WORDS];
+    *length = count;
+    return true;
+}
+
+// Array operand of an operation; anything else is an invalid object
+static bool vm_array_operand(arx_vm_context_t *vm, uint64_t address, array_kind_t *kind, uint64_t **elements, uint64_t *length)
+{
+    if (!vm_array_view(vm, address, kind, elements, length)) {
+        vm->last_error = VM_ERROR_INVALID_OBJECT_ADDRESS;
+        return false;
+    }
+    return true;
+}
+
+// from..to (to excluded) lies within an array of length elements
+static bool vm_array_range(arx_vm_context_t *vm, uint64_t from, uint64_t to, uint64_t length)
+{
+    if ((int64_t)from < 0 || from > to || to > length) {
+        vm->last_error = VM_ERROR_ARRAY_BOUNDS;
+        return false;
+    }
+    return true;
+}
+
+// Pop count operands; operands[0] was pushed first
+static bool vm_array_pop(arx_vm_context_t *vm, uint64_t *operands, size_t count)
+{
+    for (size_t i = count; i > 0; i--) {
+        if (!vm_pop(vm, &operands[i - 1])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Sum, min or max of the elements in from..to
+static uint64_t vm_array_reduce(opr_t operation, array_kind_t kind, const uint64_t *elements, size_t count)
+{
+    if (kind != ARRAY_OF_REAL) {
+        if (operation == OPR_ARRAY_SUM) {
+            return vm_array_sum_words(elements, count);
+        }
+        return (uint64_t)vm_array_extreme_words(elements, count, operation == OPR_ARRAY_MAX);
+    }
+
+    if (operation == OPR_ARRAY_SUM) {
+        double sum = 0.0;
+        for (size_t i = 0; i < count; i++) {
+            sum += vm_array_real(elements[i]);
+        }
+        return vm_array_bits(sum);
+    }
+    double best = vm_array_real(elements[0]);
+    for (size_t i = 1; i < count; i++) {
+        double next = vm_array_real(elements[i]);
+        if (operation == OPR_ARRAY_MAX ? next > best : next < best) {
+            best = next;
+        }
+    }
+    return vm_array_bits(best);
+}
+
+static bool vm_array_equal(array_kind_t kind, const uint64_t *a, const uint64_t *b, size_t count)
+{
+    if (kind != ARRAY_OF_REAL) {
+        return count == 0 || memcmp(a, b, count * sizeof(uint64_t)) == 0;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (vm_array_real(a[i]) != vm_array_real(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool vm_array_operation(arx_vm_context_t *vm, opr_t operation)
+{
+    uint64_t operands[5];
+    array_kind_t kind;
+    uint64_t *elements;
+    uint64_t length;
+
+    switch (operation) {
+        case OPR_ARRAY_NEW:
+            {
+                uint64_t address;
+                if (!vm_array_pop(vm, operands, 2)) {
+                    return false;
+                }
+                if (operands[1] < ARRAY_OF_INTEGER || operands[1] > ARRAY_OF_REAL) {
+                    vm->last_error = VM_ERROR_INVALID_INSTRUCTION;
+                    return false;
+                }
+                if ((int64_t)operands[0] < 0) {
+                    vm->last_error = VM_ERROR_ARRAY_BOUNDS;
+                    return false;
+                }
+                return vm_array_alloc(vm, (array_kind_t)operands[1], operands[0], &address) &&
+                       vm_push(vm, address);
+            }
+
+        case OPR_ARRAY_LOAD:
+            if (!vm_array_pop(vm, operands, 2) ||
+                !vm_array_operand(vm, operands[0], &kind, &elements, &length)) {
+                return false;
+            }
+            if (operands[1] >= length) {
+                vm->last_error = VM_ERROR_ARRAY_BOUNDS;
+                return false;
+            }
+            return vm_push(vm, elements[operands[1]]);
+
+        case OPR_ARRAY_STORE:
+            if (!vm_array_pop(vm, operands, 3) ||
+                !vm_array_operand(vm, operands[0], &kind, &elements, &length)) {
+                return false;
+            }
+            if (operands[1] >= length) {
+                vm->last_error = VM_ERROR_ARRAY_BOUNDS;
+                return false;
+            }
+            elements[operands[1]] = operands[2];
+            return true;
+
+        case OPR_ARRAY_LENGTH:
+            return vm_array_pop(vm, operands, 1) &&
+                   vm_array_operand(vm, operands[0], &kind, &elements, &length) &&
+                   vm_push(vm, length);
+
+        case OPR_ARRAY_FILL:
+            if (!vm_array_pop(vm, operands, 4) ||
+                !vm_array_operand(vm, operands[0], &kind, &elements, &length) ||
+                !vm_array_range(vm, operands[1], operands[2], length)) {
+                return false;
+            }
+            vm_array_fill_words(elements + operands[1], (size_t)(operands[2] - operands[1]), operands[3]);
+            return true;
+
+        case OPR_ARRAY_COPY:
+            {
+                array_kind_t source_kind;
+                uint64_t *source;
+                uint64_t source_length;
+                if (!vm_array_pop(vm, operands, 5) ||
+                    !vm_array_operand(vm, operands[0], &kind, &elements, &length) ||
+                    !vm_array_operand(vm, operands[2], &source_kind, &source, &source_length) ||
+                    !vm_array_range(vm, operands[3], operands[4], source_length)) {
+                    return false;
+                }
+                uint64_t count = operands[4] - operands[3];
+                if (source_kind != kind) {
+                    vm->last_error = VM_ERROR_INVALID_OBJECT_ADDRESS;
+                    return false;
+                }
+                if (operands[1] > length || count > length - operands[1]) {
+                    vm->last_error = VM_ERROR_ARRAY_BOUNDS;
+                    return false;
+                }
+                memmove(elements + operands[1], source + operands[3], (size_t)count * sizeof(uint64_t));
+                return true;
+            }
+
+        case OPR_ARRAY_SLICE:
+            {
+                // The source stays on the stack while the slice is allocated,
+                // so a collection there keeps it
+                uint64_t address;
+                if (!vm_peek(vm, 2, &operands[0]) || !vm_peek(vm, 1, &operands[1]) ||
+                    !vm_peek(vm, 0, &operands[2])) {
+                    vm->last_error = VM_ERROR_STACK_UNDERFLOW;
+                    return false;
+                }
+                if (!vm_array_operand(vm, operands[0], &kind, &elements, &length) ||
+                    !vm_array_range(vm, operands[1], operands[2], length) ||
+                    !vm_array_alloc(vm, kind, operands[2] - operands[1], &address)) {
+                    return false;
+                }
+                memcpy(&vm->stack[address + VM_ARRAY_HEADER_WORDS], elements + operands[1],
+                       (size_t)(operands[2] - operands[1]) * sizeof(uint64_t));
+                return vm_array_pop(vm, operands, 3) && vm_push(vm, address);
+            }
+
+        case OPR_ARRAY_EQUAL:
+            {
+                array_kind_t other_kind;
+                uint64_t *other;
+                uint64_t other_length;
+                if (!vm_array_pop(vm, operands, 2) ||
+                    !vm_array_operand(vm, operands[0], &kind, &elements, &length) ||
+                    !vm_array_operand(vm, operands[1], &other_kind, &other, &other_length)) {
+                    return false;
+                }
+                bool equal = kind == other_kind && length == other_length &&
+                             vm_array_equal(kind, elements, other, (size_t)length);
+                return vm_push(vm, equal ? 1 : 0);
+            }
+
+        case OPR_ARRAY_SUM:
+        case OPR_ARRAY_MIN:
+        case OPR_ARRAY_MAX:
+            if (!vm_array_pop(vm, operands, 3) ||
+                !vm_array_operand(vm, operands[0], &kind, &elements, &length) ||
+                !vm_array_range(vm, operands[1], operands[2], length)) {
+                return false;
+            }
+            // The smallest and largest of nothing do not exist
+            if (operation != OPR_ARRAY_SUM && operands[1] == operands[2]) {
+                vm->last_error = VM_ERROR_ARRAY_BOUNDS;
+                return false;
+            }
+            return vm_push(vm, vm_array_reduce(operation, kind, elements + operands[1],
+                                               (size_t)(operands[2] - operands[1])));
+
+        case OPR_ARRAY_FIND:
+            {
+                if (!vm_array_pop(vm, operands, 4) ||
+                    !vm_array_operand(vm, operands[0], &kind, &elements, &length) ||
+                    !vm_array_range(vm, operands[1], operands[2], length)) {
+                    return false;
+                }
+                size_t count = (size_t)(operands[2] - operands[1]);
+                size_t found = count;
+                if (kind != ARRAY_OF_REAL) {
+                    found = vm_array_find_words(elements + operands[1], count, operands[3]);
+                } else {
+                    double value = vm_array_real(operands[3]);
+                    for (size_t i = 0; i < count && found == count; i++) {
+                        if (vm_array_real(elements[operands[1] + i]) == value) {
+                            found = i;
+                        }
+                    }
+                }
+                return vm_push(vm, found < count ? operands[1] + found : (uint64_t)-1);
+            }
+
+        default:
+            vm->last_error = VM_ERROR_INVALID_INSTRUCTION;
+            return false;
+    }
+}
@@ -0,0 +1,39 @@
+/*
+ * ARX Virtual Machine Arrays
+ * Heap arrays of 64-bit elements and the bulk operations on them
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "vm.h"
+
+// Build with -DVM_ARRAY_SIMD=0 to run every bulk operation as a plain loop.
+// Otherwise integer kernels use SSE2 or, where the CPU has it, AVX2 on
+// x86-64 and NEON on AArch64.
+#ifndef VM_ARRAY_SIMD
+#define VM_ARRAY_SIMD 1
+#endif
+
+// Array object layout (word-addressed, in the object area like strings):
+//   [0] tag     : VM_ARRAY_TAG in the high half, the array_kind_t below
+//   [1] length  : number of elements
+//   [2..] data  : one word per element; integers, truth values and
+//                 characters as int64, reals as IEEE double bit patterns
+// Elements never hold references, so the collector does not scan them.
+#define VM_ARRAY_HEADER_WORDS 2
+#define VM_ARRAY_TAG (0x41525259ull << 32)   // "ARRY"
+#define VM_ARRAY_KIND_MASK 0xffffffffull
+
+// New array of length zeroed elements
+bool vm_array_alloc(arx_vm_context_t *vm, array_kind_t kind, uint64_t length, uint64_t *address);
+
+// Kind, elements and length of the array at address; false if it is not one
+bool vm_array_view(arx_vm_context_t *vm, uint64_t address, array_kind_t *kind, uint64_t **elements, uint64_t *length);
+
+// Run one of the OPR_ARRAY_* operations on the data stack
+bool vm_array_operation(arx_vm_context_t *vm, opr_t operation);
+
+// Kernels the bulk operations use on this machine ("avx2", "sse2", "neon" or "scalar")
+const char *vm_array_kernels(void);
@@ -0,0 +1,448 @@
+/*
+ * ARX Virtual Machine Heap Statistics Implementation
+ * A walk over the object area and its free lists, and sampled allocation
+ * sites charged to the instructions that made them
+ */
+
+#include "heapstats.h"
+#include "array.h"
+#include <stdlib.h>
+#include <string.h>
+
+bool vm_heap_sites_enable(arx_vm_context_t *vm, uint64_t interval)
+{
+    if (vm == NULL || vm->memory_manager.block_map == NULL) {
+        return false;
+    }
+    if (vm->heap_sites != NULL) {
+        return true;
+    }
+
+    memory_manager_t *mm = &vm->memory_manager;
+    vm_heap_sites_t *sites = calloc(1, sizeof(vm_heap_sites_t));
+    if (sites == NULL) {
+        return false;
+    }
+    if (!vm_segment_reserve(&sites->block_segment, (size_t)(mm->heap_max - mm->heap_base) * sizeof(uint32_t),
+                            (size_t)(mm->heap_limit - mm->heap_base) * sizeof(uint32_t))) {
+        free(sites);
+        return false;
+    }
+    sites->block_sites = (uint32_t *)sites->block_segment.base;
+    sites->interval = interval > 0 ? interval : VM_HEAP_SITES_DEFAULT_INTERVAL;
+    sites->countdown = sites->interval;
+    sites->program_instructions = vm->instruction_count;
+    vm->heap_sites = sites;
+    return true;
+}
+
+void vm_heap_sites_free(arx_vm_context_t *vm)
+{
+    if (vm == NULL || vm->heap_sites == NULL) {
+        return;
+    }
+    vm_heap_sites_t *sites = vm->heap_sites;
+    free(sites->sites);
+    free(sites->site_index);
+    vm_segment_release(&sites->block_segment);
+    free(sites);
+    vm->heap_sites = NULL;
+}
+
+static uint64_t vm_heap_sites_hash(uint64_t pc)
+{
+    return pc * 0x9e3779b97f4a7c15ull;
+}
+
+static bool vm_heap_sites_rehash(vm_heap_sites_t *sites, size_t capacity)
+{
+    uint32_t *index = calloc(capacity, sizeof(uint32_t));
+    if (index == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < sites->site_count; i++) {
+        size_t slot = (size_t)(vm_heap_sites_hash(sites->sites[i].pc) & (capacity - 1));
+        while (index[slot] != 0) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        index[slot] = (uint32_t)(i + 1);
+    }
+    free(sites->site_index);
+    sites->site_index = index;
+    sites->site_index_mask = capacity - 1;
+    return true;
+}
+
+// Site of the instruction at pc, added if it has none yet; NULL when
+// memory runs out
+static vm_heap_site_t *vm_heap_sites_find(vm_heap_sites_t *sites, uint64_t pc)
+{
+    if (sites->site_index != NULL) {
+        size_t slot = (size_t)(vm_heap_sites_hash(pc) & sites->site_index_mask);
+        while (sites->site_index[slot] != 0) {
+            vm_heap_site_t *site = &sites->sites[sites->site_index[slot] - 1];
+            if (site->pc == pc) {
+                return site;
+            }
+            slot = (slot + 1) & sites->site_index_mask;
+        }
+    }
+
+    if (sites->site_count >= UINT32_MAX - 1) {
+        return NULL;
+    }
+    if (sites->site_count >= sites->site_capacity) {
+        size_t capacity = sites->site_capacity == 0 ? 64 : sites->site_capacity * 2;
+        vm_heap_site_t *grown = realloc(sites->sites, capacity * sizeof(vm_heap_site_t));
+        if (grown == NULL) {
+            return NULL;
+        }
+        sites->sites = grown;
+        sites->site_capacity = capacity;
+    }
+    // Keep the index at most half full
+    if (sites->site_index == NULL || (sites->site_count + 1) * 2 > sites->site_index_mask + 1) {
+        size_t capacity = sites->site_index == NULL ? 128 : (sites->site_index_mask + 1) * 2;
+        if (!vm_heap_sites_rehash(sites, capacity)) {
+            return NULL;
+        }
+    }
+
+    vm_heap_site_t *site = &sites->sites[sites->site_count++];
+    memset(site, 0, sizeof(vm_heap_site_t));
+    site->pc = pc;
+    size_t slot = (size_t)(vm_heap_sites_hash(pc) & sites->site_index_mask);
+    while (sites->site_index[slot] != 0) {
+        slot = (slot + 1) & sites->site_index_mask;
+    }
+    sites->site_index[slot] = (uint32_t)sites->site_count;
+    return site;
+}
+
+// Every engine keeps vm->pc at the instruction it runs whenever that
+// instruction can allocate: the threaded one and the JIT hand such
+// instructions to vm_step()
+void vm_heap_sites_sample(arx_vm_context_t *vm, uint64_t address, uint64_t bytes)
+{
+    vm_heap_sites_t *sites = vm->heap_sites;
+    sites->countdown = sites->interval;
+
+    vm_heap_site_t *site = vm_heap_sites_find(sites, vm->pc);
+    if (site == NULL) {
+        sites->samples_dropped++;
+        return;
+    }
+    sites->samples++;
+    site->samples++;
+    site->bytes += bytes;
+    site->live++;
+    site->live_bytes += bytes;
+    sites->block_sites[address - vm->memory_manager.heap_base] = (uint32_t)(site - sites->sites + 1);
+}
+
+void vm_heap_sites_release(arx_vm_context_t *vm, uint64_t address, uint64_t bytes)
+{
+    vm_heap_sites_t *sites = vm->heap_sites;
+    uint32_t *tag = &sites->block_sites[address - vm->memory_manager.heap_base];
+    vm_heap_site_t *site = &sites->sites[*tag - 1];
+    site->live--;
+    site->live_bytes -= bytes;
+    *tag = 0;
+}
+
+static int vm_heap_compare_classes(const void *a, const void *b)
+{
+    const vm_heap_class_stats_t *left = a;
+    const vm_heap_class_stats_t *right = b;
+    if (left->bytes != right->bytes) {
+        return left->bytes < right->bytes ? 1 : -1;
+    }
+    return left->class_index < right->class_index ? -1 : left->class_index > right->class_index;
+}
+
+bool vm_heap_stats_collect(arx_vm_context_t *vm, vm_heap_stats_t *stats)
+{
+    if (vm == NULL || stats == NULL) {
+        return false;
+    }
+    memset(stats, 0, sizeof(vm_heap_stats_t));
+
+    memory_manager_t *mm = &vm->memory_manager;
+    if (mm->block_map == NULL) {
+        return true;
+    }
+
+    // One counter per loaded class, and one for objects of classes that
+    // were never loaded
+    size_t class_slots = vm->class_system.class_count + 1;
+    vm_heap_class_stats_t *classes = calloc(class_slots, sizeof(vm_heap_class_stats_t));
+    if (classes == NULL) {
+        return false;
+    }
+
+    uint64_t header_address = mm->heap_base;
+    while (header_address < mm->heap_bump) {
+        uint64_t header = vm->stack[header_address];
+        uint64_t block = header_address + 1;
+        size_t words = (size_t)(header >> VM_HEAP_HEADER_SHIFT);
+        uint64_t bytes = words * sizeof(uint64_t);
+        header_address = block + words;
+        stats->header_bytes += sizeof(uint64_t);
+
+        if ((header & VM_HEAP_HEADER_USED) == 0) {
+            continue;
+        }
+        uint32_t slot = mm->address_index[block - mm->heap_base];
+        if (slot != 0) {
+            const object_entry_t *entry = &mm->objects[slot - 1];
+            size_t index = entry->class_index <= vm->class_system.class_count ? entry->class_index : 0;
+            vm_heap_class_stats_t *tally = &classes[index];
+            tally->class_id = index != 0 ? entry->class_id : 0;
+            tally->class_index = (uint32_t)index;
+            tally->objects++;
+            tally->bytes += bytes;
+            tally->frame_objects += entry->frame ? 1 : 0;
+            stats->objects++;
+            stats->object_bytes += bytes;
+        } else if (words >= VM_ARRAY_HEADER_WORDS && (vm->stack[block] & ~VM_ARRAY_KIND_MASK) == VM_ARRAY_TAG) {
+            stats->arrays++;
+            stats->array_bytes += bytes;
+        } else if (words >= VM_STRING_SLICE_WORDS && vm->stack[block + 2] == VM_STRING_SLICE) {
+            stats->slices++;
+            stats->slice_bytes += bytes;
+        } else if (words >= VM_STRING_HEADER_WORDS && vm->stack[block + 2] == VM_STRING_HEADER_WORDS) {
+            stats->strings++;
+            stats->string_bytes += bytes;
+        } else {
+            stats->other_blocks++;
+            stats->other_bytes += bytes;
+        }
+    }
+
+    // The free lists hold exactly the blocks the walk skipped
+    for (size_t i = 0; i < VM_HEAP_SIZE_CLASSES; i++) {
+        for (uint64_t block = mm->free_lists[i]; block != 0; block = vm->stack[block]) {
+            uint64_t bytes = (vm->stack[block - 1] >> VM_HEAP_HEADER_SHIFT) * sizeof(uint64_t);
+            stats->free_blocks[i]++;
+            stats->free_bytes[i] += bytes;
+            if (bytes > stats->largest_free_bytes) {
+                stats->largest_free_bytes = bytes;
+            }
+        }
+        stats->free_total_blocks += stats->free_blocks[i];
+        stats->free_total_bytes += stats->free_bytes[i];
+    }
+    stats->fresh_bytes = (mm->heap_limit - mm->heap_bump) * sizeof(uint64_t);
+
+    size_t used = 0;
+    for (size_t i = 0; i < class_slots; i++) {
+        if (classes[i].objects > 0) {
+            classes[used++] = classes[i];
+        }
+    }
+    qsort(classes, used, sizeof(vm_heap_class_stats_t), vm_heap_compare_classes);
+    stats->classes = classes;
+    stats->class_count = used;
+    return true;
+}
+
+void vm_heap_stats_free(vm_heap_stats_t *stats)
+{
+    if (stats != NULL) {
+        free(stats->classes);
+        memset(stats, 0, sizeof(vm_heap_stats_t));
+    }
+}
+
+// Class and method names are identifiers, but a module could hold anything
+static void vm_heap_json_string(FILE *file, const char *text, size_t limit)
+{
+    fputc('"', file);
+    for (size_t i = 0; i < limit && text[i] != '\0'; i++) {
+        unsigned char c = (unsigned char)text[i];
+        if (c == '"' || c == '\\') {
+            fprintf(file, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(file, "\\u%04x", c);
+        } else {
+            fputc(c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+// Method whose code holds pc: the one starting closest before it. Methods
+// are stored in class order.
+static void vm_heap_json_method(FILE *file, arx_vm_context_t *vm, uint64_t pc)
+{
+    const class_entry_t *owner = NULL;
+    const method_entry_t *method = NULL;
+    size_t m = 0;
+    for (size_t c = 0; c < vm->class_system.class_count; c++) {
+        const class_entry_t *class_entry = &vm->class_system.classes[c];
+        for (uint32_t k = 0; k < class_entry->method_count && m < vm->class_system.method_count; k++, m++) {
+            const method_entry_t *entry = &vm->class_system.methods[m];
+            if (entry->offset <= pc && (method == NULL || entry->offset > method->offset)) {
+                owner = class_entry;
+                method = entry;
+            }
+        }
+    }
+    if (method == NULL) {
+        fputs("\"<module>\"", file);
+        return;
+    }
+    char name[2 * 32 + 2];
+    snprintf(name, sizeof(name), "%.32s.%.32s", owner->class_name, method->method_name);
+    vm_heap_json_string(file, name, sizeof(name));
+}
+
+static int vm_heap_compare_sites(const void *a, const void *b)
+{
+    const vm_heap_site_t *left = a;
+    const vm_heap_site_t *right = b;
+    if (left->live_bytes != right->live_bytes) {
+        return left->live_bytes < right->live_bytes ? 1 : -1;
+    }
+    if (left->bytes != right->bytes) {
+        return left->bytes < right->bytes ? 1 : -1;
+    }
+    return left->pc < right->pc ? -1 : left->pc > right->pc;
+}
+
+static void vm_heap_json_sites(FILE *file, arx_vm_context_t *vm, vm_heap_line_fn line_of, void *data)
+{
+    vm_heap_sites_t *sites = vm->heap_sites;
+    fprintf(file, "  \"sites\": {\"interval\": %llu, \"samples\": %llu, \"dropped\": %llu, \"sites\": [",
+            (unsigned long long)sites->interval, (unsigned long long)sites->samples,
+            (unsigned long long)sites->samples_dropped);
+
+    // Sorted on a copy: the tags of blocks still in use point into sites
+    vm_heap_site_t *sorted = malloc((sites->site_count > 0 ? sites->site_count : 1) * sizeof(vm_heap_site_t));
+    const vm_heap_site_t *list = sites->sites;
+    if (sorted != NULL) {
+        memcpy(sorted, sites->sites, sites->site_count * sizeof(vm_heap_site_t));
+        qsort(sorted, sites->site_count, sizeof(vm_heap_site_t), vm_heap_compare_sites);
+        list = sorted;
+    }
+    for (size_t i = 0; i < sites->site_count; i++) {
+        const vm_heap_site_t *site = &list[i];
+        fprintf(file, "%s\n    {\"pc\": %llu, \"method\": ", i > 0 ? "," : "", (unsigned long long)site->pc);
+        vm_heap_json_method(file, vm, site->pc);
+        uint32_t line = 0;
+        if (line_of != NULL && site->pc < sites->program_instructions && line_of(data, (size_t)site->pc, &line)) {
+            fprintf(file, ", \"line\": %u", line);
+        }
+        fprintf(file, ", \"samples\": %llu, \"bytes\": %llu, \"live\": %llu, \"live_bytes\": %llu}",
+                (unsigned long long)site->samples, (unsigned long long)site->bytes,
+                (unsigned long long)site->live, (unsigned long long)site->live_bytes);
+    }
+    fprintf(file, "%s]}", sites->site_count > 0 ? "\n  " : "");
+    free(sorted);
+}
+
+bool vm_heap_stats_write_json(arx_vm_context_t *vm, FILE *file, uint64_t elapsed_ns,
+                              vm_heap_line_fn line_of, void *data)
+{
+    if (vm == NULL || file == NULL) {
+        return false;
+    }
+
+    vm_heap_stats_t stats;
+    if (!vm_heap_stats_collect(vm, &stats)) {
+        return false;
+    }
+    const memory_manager_t *mm = &vm->memory_manager;
+    unsigned long long instructions = (unsigned long long)vm->instruction_count_executed;
+
+    fprintf(file, "{\n  \"instructions\": %llu,\n  \"elapsed_ns\": %llu,\n",
+            instructions, (unsigned long long)elapsed_ns);
+    fprintf(file, "  \"area\": {\"committed_bytes\": %llu, \"max_bytes\": %llu, \"used_bytes\": %llu, "
+            "\"in_use_bytes\": %llu, \"header_bytes\": %llu, \"fresh_bytes\": %llu, \"growths\": %llu},\n",
+            (unsigned long long)((mm->heap_limit - mm->heap_base) * sizeof(uint64_t)),
+            (unsigned long long)((mm->heap_max - mm->heap_base) * sizeof(uint64_t)),
+            (unsigned long long)((mm->heap_bump - mm->heap_base) * sizeof(uint64_t)),
+            (unsigned long long)mm->heap_bytes_in_use, (unsigned long long)stats.header_bytes,
+            (unsigned long long)stats.fresh_bytes, (unsigned long long)mm->heap_growths);
+
+    fprintf(file, "  \"classes\": [");
+    for (size_t i = 0; i < stats.class_count; i++) {
+        const vm_heap_class_stats_t *tally = &stats.classes[i];
+        fprintf(file, "%s\n    {\"class\": ", i > 0 ? "," : "");
+        if (tally->class_index != 0) {
+            vm_heap_json_string(file, vm->class_system.classes[tally->class_index - 1].class_name, 32);
+        } else {
+            fputs("\"<unknown>\"", file);
+        }
+        fprintf(file, ", \"class_id\": %llu, \"objects\": %llu, \"bytes\": %llu, \"frame_objects\": %llu}",
+                (unsigned long long)tally->class_id, (unsigned long long)tally->objects,
+                (unsigned long long)tally->bytes, (unsigned long long)tally->frame_objects);
+    }
+    fprintf(file, "%s],\n", stats.class_count > 0 ? "\n  " : "");
+    fprintf(file, "  \"objects\": {\"count\": %llu, \"bytes\": %llu},\n",
+            (unsigned long long)stats.objects, (unsigned long long)stats.object_bytes);
+    fprintf(file, "  \"strings\": {\"count\": %llu, \"bytes\": %llu, \"slices\": %llu, \"slice_bytes\": %llu},\n",
+            (unsigned long long)stats.strings, (unsigned long long)stats.string_bytes,
+            (unsigned long long)stats.slices, (unsigned long long)stats.slice_bytes);
+    fprintf(file, "  \"arrays\": {\"count\": %llu, \"bytes\": %llu},\n",
+            (unsigned long long)stats.arrays, (unsigned long long)stats.array_bytes);
+    fprintf(file, "  \"other\": {\"count\": %llu, \"bytes\": %llu},\n",
+            (unsigned long long)stats.other_blocks, (unsigned long long)stats.other_bytes);
+
+    double seconds = elapsed_ns / 1e9;
+    fprintf(file, "  \"allocation\": {\"blocks\": %llu, \"bytes\": %llu, \"frees\": %llu, "
+            "\"bytes_per_second\": %.0f, \"bytes_per_million_instructions\": %.0f},\n",
+            (unsigned long long)mm->heap_allocations, (unsigned long long)mm->heap_bytes_allocated,
+            (unsigned long long)mm->heap_frees,
+            seconds > 0 ? mm->heap_bytes_allocated / seconds : 0.0,
+            instructions > 0 ? mm->heap_bytes_allocated * 1e6 / instructions : 0.0);
+
+    // Fragmentation: the share of the space handed out so far that sits
+    // on free lists, where only requests of the same size class reuse it
+    uint64_t handed_out = stats.free_total_bytes + mm->heap_bytes_in_use;
+    fprintf(file, "  \"free_lists\": {\"blocks\": %llu, \"bytes\": %llu, \"largest_block_bytes\": %llu, "
+            "\"fragmentation\": %.4f, \"classes\": [",
+            (unsigned long long)stats.free_total_blocks, (unsigned long long)stats.free_total_bytes,
+            (unsigned long long)stats.largest_free_bytes,
+            handed_out > 0 ? (double)stats.free_total_bytes / handed_out : 0.0);
+    bool first = true;
+    for (size_t i = 0; i < VM_HEAP_SIZE_CLASSES; i++) {
+        if (stats.free_blocks[i] == 0) {
+            continue;
+        }
+        fprintf(file, "%s\n    {\"block_bytes\": %llu, \"blocks\": %llu, \"bytes\": %llu}", first ? "" : ",",
+                (unsigned long long)(stats.free_bytes[i] / stats.free_blocks[i]),
+                (unsigned long long)stats.free_blocks[i], (unsigned long long)stats.free_bytes[i]);
+        first = false;
+    }
+    fprintf(file, "%s]},\n", first ? "" : "\n  ");
+
+    fprintf(file, "  \"gc\": {\"collections\": %llu, \"threshold_bytes\": %llu, \"reclaimed_bytes\": %llu, "
+            "\"pause_ns_total\": %llu, \"pause_ns_max\": %llu,\n"
+            "    \"frame_objects\": {\"allocated\": %llu, \"reused\": %llu, \"released\": %llu},\n"
+            "    \"history\": [",
+            (unsigned long long)mm->gc_collections, (unsigned long long)mm->gc_threshold,
+            (unsigned long long)mm->gc_bytes_reclaimed, (unsigned long long)mm->gc_total_pause_ns,
+            (unsigned long long)mm->gc_max_pause_ns, (unsigned long long)mm->frame_allocations,
+            (unsigned long long)mm->frame_reuses, (unsigned long long)mm->frame_releases);
+    uint64_t kept = mm->gc_collections < VM_GC_HISTORY ? mm->gc_collections : VM_GC_HISTORY;
+    for (uint64_t i = mm->gc_collections - kept; i < mm->gc_collections; i++) {
+        const vm_gc_record_t *record = &mm->gc_history[i % VM_GC_HISTORY];
+        fprintf(file, "%s\n      {\"collection\": %llu, \"instructions\": %llu, \"pause_ns\": %llu, "
+                "\"objects\": %llu, \"reclaimed_bytes\": %llu, \"in_use_bytes\": %llu}",
+                i > mm->gc_collections - kept ? "," : "", (unsigned long long)(i + 1),
+                (unsigned long long)record->instructions, (unsigned long long)record->pause_ns,
+                (unsigned long long)record->objects, (unsigned long long)record->reclaimed,
+                (unsigned long long)record->in_use);
+    }
+    fprintf(file, "%s]}", kept > 0 ? "\n    " : "");
+
+    if (vm->heap_sites != NULL) {
+        fprintf(file, ",\n");
+        vm_heap_json_sites(file, vm, line_of, data);
+    }
+    fprintf(file, "\n}\n");
+
+    vm_heap_stats_free(&stats);
+    return ferror(file) == 0;
+}
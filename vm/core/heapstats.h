@@ -0,0 +1,122 @@
+/*
+ * ARX Virtual Machine Heap Statistics
+ * What the object area holds, where it was allocated and how the collector
+ * has kept up
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "segment.h"
+#include "vm.h"
+
+// Allocations between two site samples unless vm_heap_sites_enable() is told otherwise
+#define VM_HEAP_SITES_DEFAULT_INTERVAL 64
+
+// Blocks in use of one class of objects
+typedef struct {
+    uint64_t class_id;
+    uint32_t class_index;          // Class manifest index + 1 (0: class not loaded)
+    uint64_t objects;
+    uint64_t bytes;                // Payload bytes of their blocks
+    uint64_t frame_objects;        // Of those, objects of frame variables
+} vm_heap_class_stats_t;
+
+// One walk over the object area. Blocks in use have not been freed by their
+// method or swept yet; unreachable ones stay in use until the next
+// collection.
+typedef struct {
+    vm_heap_class_stats_t *classes; // Per class with objects in use, by class_index
+    size_t class_count;
+    uint64_t objects;              // Class instances
+    uint64_t object_bytes;
+    uint64_t strings;              // Strings with their own bytes
+    uint64_t string_bytes;
+    uint64_t slices;               // Strings sharing another string's bytes
+    uint64_t slice_bytes;
+    uint64_t arrays;
+    uint64_t array_bytes;
+    uint64_t other_blocks;         // In use but none of the above
+    uint64_t other_bytes;
+
+    // Freed blocks wait on the free list of their size class and only serve
+    // requests of that class
+    uint64_t free_blocks[VM_HEAP_SIZE_CLASSES];
+    uint64_t free_bytes[VM_HEAP_SIZE_CLASSES];
+    uint64_t free_total_blocks;
+    uint64_t free_total_bytes;
+    uint64_t largest_free_bytes;   // Largest block on any free list
+    uint64_t header_bytes;         // One header word per block, in use or free
+    uint64_t fresh_bytes;          // Committed area never handed out
+} vm_heap_stats_t;
+
+// Allocation counts of one instruction
+typedef struct {
+    uint64_t pc;
+    uint64_t samples;              // Sampled allocations it made
+    uint64_t bytes;                // Their payload bytes
+    uint64_t live;                 // Of those, blocks still in use
+    uint64_t live_bytes;
+} vm_heap_site_t;
+
+struct vm_heap_sites {
+    // Every `interval`-th allocation is charged to the instruction that made it
+    uint64_t interval;
+    uint64_t countdown;            // Allocations until the next sample
+    uint64_t samples;              // Samples taken
+    uint64_t samples_dropped;      // Samples lost to allocation failures
+
+    vm_heap_site_t *sites;
+    size_t site_count;
+    size_t site_capacity;
+    uint32_t *site_index;          // Open-addressed by pc: site + 1 (0 = empty)
+    size_t site_index_mask;
+
+    // Site + 1 of each sampled block in use, by the block's object area
+    // word like address_index; committed as the area grows
+    uint32_t *block_sites;
+    vm_segment_t block_segment;
+    size_t program_instructions;   // The program's own code; linked modules follow it
+};
+
+// Source line of an instruction of the program (not of linked modules)
+typedef bool (*vm_heap_line_fn)(void *data, size_t pc, uint32_t *line);
+
+// Start sampling allocation sites. An interval of 0 uses
+// VM_HEAP_SITES_DEFAULT_INTERVAL; 1 records every allocation. Call after
+// vm_init(), as the block tags follow the object area.
+bool vm_heap_sites_enable(arx_vm_context_t *vm, uint64_t interval);
+void vm_heap_sites_free(arx_vm_context_t *vm);
+
+// Hooks used by the VM itself: a block of `bytes` payload bytes was handed
+// out at address by the instruction at vm->pc, or freed
+void vm_heap_sites_sample(arx_vm_context_t *vm, uint64_t address, uint64_t bytes);
+void vm_heap_sites_release(arx_vm_context_t *vm, uint64_t address, uint64_t bytes);
+
+static inline void vm_heap_sites_allocated(arx_vm_context_t *vm, uint64_t address, uint64_t bytes)
+{
+    if (--vm->heap_sites->countdown == 0) {
+        vm_heap_sites_sample(vm, address, bytes);
+    }
+}
+
+static inline void vm_heap_sites_freed(arx_vm_context_t *vm, uint64_t address, uint64_t bytes)
+{
+    if (vm->heap_sites->block_sites[address - vm->memory_manager.heap_base] != 0) {
+        vm_heap_sites_release(vm, address, bytes);
+    }
+}
+
+// Walk the object area; free the result with vm_heap_stats_free()
+bool vm_heap_stats_collect(arx_vm_context_t *vm, vm_heap_stats_t *stats);
+void vm_heap_stats_free(vm_heap_stats_t *stats);
+
+// One JSON object with the area's contents per class and kind, free lists,
+// allocation totals and rate (elapsed_ns of running, 0 if unknown), the
+// collector's totals and recent collections and, when sampling, the
+// allocation sites with their methods and, where line_of knows them,
+// source lines
+bool vm_heap_stats_write_json(arx_vm_context_t *vm, FILE *file, uint64_t elapsed_ns,
+                              vm_heap_line_fn line_of, void *data);
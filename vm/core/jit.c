@@ -0,0 +1,962 @@
+/*
+ * ARX Virtual Machine Template JIT Implementation
+ * Native code for hot methods, built one instruction template at a time
+ */
+
+// mmap()'s MAP_ANONYMOUS is not part of C99 or POSIX.1-2008
+#define _DEFAULT_SOURCE
+#include "jit.h"
+#include "task.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if VM_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// How native code hands control back to vm_jit_enter()
+enum {
+    VM_JIT_EXIT = 1,               // Resume the interpreter at frame.pc
+    VM_JIT_ERROR = 2,              // An instruction failed; last_error is set
+    VM_JIT_SWITCH = 3              // As VM_JIT_EXIT, at a task switch point
+};
+
+// State shared by native code and vm_jit_helper(). The native registers
+// cache most of it: rbx holds the frame, r12 stack, r13 sp, r14 locals and
+// r15 executed. The VM's stack stays in memory with the interpreter's layout,
+// so either side can take over at any instruction.
+typedef struct {
+    uint64_t *stack;               // vm->stack
+    uint64_t sp;                   // vm->stack_top
+    uint64_t *locals;              // vm->locals
+    uint64_t executed;             // Instructions not yet added to instruction_count_executed
+    uint64_t limit;                // executed value at which a backward jump leaves for a budget check
+    uint64_t pc;                   // Instruction the helper runs, or where the interpreter resumes
+    uint64_t stack_size;           // vm->stack_size (words committed)
+    uint64_t status;               // VM_JIT_EXIT, VM_JIT_SWITCH or VM_JIT_ERROR when the helper says to leave
+    // Variables of the record one level up the static chain (fields and
+    // globals), NULL outside calls. Level 2 and beyond go through vm_step().
+    uint64_t *outer;
+    const uint64_t *outer_frames;  // vm->call_stack.frames it points into
+    uint64_t outer_link;           // Static link it was found from
+    arx_vm_context_t *vm;
+} vm_jit_frame_t;
+
+typedef int (*vm_jit_native_t)(vm_jit_frame_t *frame, const uint8_t *target);
+
+bool vm_jit_available(void)
+{
+    return VM_JIT != 0;
+}
+
+bool vm_jit_enable(arx_vm_context_t *vm, uint64_t threshold)
+{
+    if (vm == NULL || !vm_jit_available()) {
+        return false;
+    }
+
+    vm_jit_t *jit = vm->jit;
+    if (jit == NULL) {
+        jit = calloc(1, sizeof(vm_jit_t));
+        if (jit == NULL) {
+            return false;
+        }
+        vm->jit = jit;
+    }
+    jit->threshold = threshold > 0 ? threshold : VM_JIT_DEFAULT_THRESHOLD;
+    return true;
+}
+
+static void vm_jit_release(vm_jit_t *jit)
+{
+#if VM_JIT
+    for (size_t i = 0; i < jit->method_count; i++) {
+        if (jit->methods[i].code != NULL) {
+            munmap(jit->methods[i].code, jit->methods[i].code_size);
+        }
+    }
+#endif
+    jit->method_count = 0;
+}
+
+void vm_jit_free(arx_vm_context_t *vm)
+{
+    if (vm == NULL || vm->jit == NULL) {
+        return;
+    }
+
+    vm_jit_t *jit = vm->jit;
+    vm_jit_release(jit);
+    free(jit->methods);
+    free(jit->method_of);
+    free(jit->entries);
+    free(jit->ops);
+    free(jit);
+    vm->jit = NULL;
+}
+
+static int vm_jit_compare_offsets(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+bool vm_jit_map(arx_vm_context_t *vm, size_t first, size_t instruction_count)
+{
+    vm_jit_t *jit = vm->jit;
+
+    // A new program drops the old one's code
+    if (first == 0) {
+        vm_jit_release(jit);
+    }
+    if (instruction_count > jit->capacity) {
+        uint32_t *method_of = realloc(jit->method_of, instruction_count * sizeof(uint32_t));
+        if (method_of == NULL) {
+            return false;
+        }
+        jit->method_of = method_of;
+        const uint8_t **entries = realloc(jit->entries, instruction_count * sizeof(const uint8_t *));
+        if (entries == NULL) {
+            return false;
+        }
+        jit->entries = entries;
+        uint16_t *ops = realloc(jit->ops, instruction_count * sizeof(uint16_t));
+        if (ops == NULL) {
+            return false;
+        }
+        jit->ops = ops;
+        jit->capacity = instruction_count;
+    }
+    for (size_t i = first; i < instruction_count; i++) {
+        jit->method_of[i] = VM_JIT_NO_METHOD;
+        jit->entries[i] = NULL;
+    }
+
+    // Methods inherited by several classes share their code, so the starts
+    // are sorted and each one taken once
+    size_t start_count = 0;
+    uint64_t *starts = malloc((vm->class_system.method_count + 1) * sizeof(uint64_t));
+    if (starts == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < vm->class_system.method_count; i++) {
+        uint64_t offset = vm->class_system.methods[i].offset;
+        if (offset >= first && offset < instruction_count) {
+            starts[start_count++] = offset;
+        }
+    }
+    qsort(starts, start_count, sizeof(uint64_t), vm_jit_compare_offsets);
+
+    for (size_t i = 0; i < start_count; i++) {
+        if (i > 0 && starts[i] == starts[i - 1]) {
+            continue;
+        }
+        if (jit->method_count == jit->method_capacity) {
+            size_t grown = jit->method_capacity > 0 ? jit->method_capacity * 2 : 64;
+            vm_jit_method_t *methods = realloc(jit->methods, grown * sizeof(vm_jit_method_t));
+            if (methods == NULL) {
+                free(starts);
+                return false;
+            }
+            jit->methods = methods;
+            jit->method_capacity = grown;
+        }
+        vm_jit_method_t *method = &jit->methods[jit->method_count];
+        memset(method, 0, sizeof(*method));
+        method->start = (size_t)starts[i];
+        method->end = i + 1 < start_count ? (size_t)starts[i + 1] : instruction_count;
+        method->state = VM_JIT_COLD;
+        for (size_t pc = method->start; pc < method->end; pc++) {
+            jit->method_of[pc] = (uint32_t)jit->method_count;
+        }
+        jit->method_count++;
+    }
+    free(starts);
+    return true;
+}
+
+#if VM_JIT
+
+// Slice of the instruction budget left before the next check
+static uint64_t vm_jit_limit(const arx_vm_context_t *vm)
+{
+    return vm->budget_next_check > vm->instruction_count_executed ?
+           vm->budget_next_check - vm->instruction_count_executed : 0;
+}
+
+// Follow the current record's static link, unless it still leads where it
+// did; calls and returns only change it when they cross scopes
+static void vm_jit_find_outer(vm_jit_frame_t *frame, arx_vm_context_t *vm)
+{
+    uint64_t base = vm->call_stack.frame_base;
+    if (base == VM_FRAME_GLOBAL) {
+        frame->outer = NULL;
+        return;
+    }
+    const uint64_t *frames = vm->call_stack.frames;
+    uint64_t link = frames[base + VM_FRAME_STATIC_LINK];
+    if (frame->outer != NULL && frame->outer_frames == frames && frame->outer_link == link) {
+        return;
+    }
+    frame->outer_frames = frames;
+    frame->outer_link = link;
+    frame->outer = link == VM_FRAME_GLOBAL ? vm->memory : &vm->call_stack.frames[link + VM_FRAME_HEADER_SIZE];
+}
+
+// Run the instruction at frame->pc with vm_step(), for every instruction
+// without a native template and for the rare cases of those that have one
+// (stack limits, division by 0 or -1, outer variables outside calls).
+// Returns the native code to go on with, which is in another method after a
+// call or return, or NULL to leave with frame->status.
+static const uint8_t *vm_jit_helper(vm_jit_frame_t *frame)
+{
+    arx_vm_context_t *vm = frame->vm;
+    size_t pc = (size_t)frame->pc;
+
+    vm->stack_top = (size_t)frame->sp;
+    vm->pc = pc;
+    vm->instruction_count_executed += (size_t)frame->executed;
+    frame->executed = 0;
+
+    bool stepped = vm_step(vm);
+    frame->sp = vm->stack_top;
+    frame->pc = vm->pc;
+    frame->locals = vm->locals;  // Calls and returns change the record
+    frame->stack_size = vm->stack_size;  // A push may have grown the stack
+    frame->status = !stepped ? VM_JIT_ERROR : vm_task_switch_point(vm, pc) ? VM_JIT_SWITCH : VM_JIT_EXIT;
+    if (!stepped || vm->halted || vm->pc >= vm->instruction_count ||
+        vm->instruction_count_executed >= vm->budget_next_check) {
+        return NULL;
+    }
+    const uint8_t *next = vm->jit->entries[vm->pc];
+    if (next == NULL) {
+        return NULL;
+    }
+    vm_jit_find_outer(frame, vm);
+    frame->limit = vm_jit_limit(vm);
+    return next;
+}
+
+// === x86-64 encoding ===
+
+enum {
+    RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+    R12 = 12, R13 = 13, R14 = 14, R15 = 15
+};
+enum { XMM0 = 0, XMM1 = 1 };
+enum { NO_INDEX = -1 };
+
+// Condition codes (the low nibble of Jcc and SETcc)
+enum {
+    CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_BE = 0x6, CC_A = 0x7,
+    CC_P = 0xA, CC_NP = 0xB, CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF
+};
+
+// Register assignment; see vm_jit_frame_t
+#define JIT_STACK R12
+#define JIT_SP R13
+#define JIT_LOCALS R14
+#define JIT_EXECUTED R15
+#define JIT_FRAME_FIELD(field) ((int32_t)offsetof(vm_jit_frame_t, field))
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    bool failed;                   // Out of memory; the method stays interpreted
+} vm_jit_buffer_t;
+
+static void emit_byte(vm_jit_buffer_t *buffer, uint8_t byte)
+{
+    if (buffer->size == buffer->capacity) {
+        size_t grown = buffer->capacity > 0 ? buffer->capacity * 2 : 4096;
+        uint8_t *data = buffer->failed ? NULL : realloc(buffer->data, grown);
+        if (data == NULL) {
+            buffer->failed = true;
+            buffer->size = 0;  // Keep writing over the start; the result is discarded
+            return;
+        }
+        buffer->data = data;
+        buffer->capacity = grown;
+    }
+    buffer->data[buffer->size++] = byte;
+}
+
+static void emit_u32(vm_jit_buffer_t *buffer, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        emit_byte(buffer, (uint8_t)(value >> (8 * i)));
+    }
+}
+
+static void emit_u64(vm_jit_buffer_t *buffer, uint64_t value)
+{
+    for (int i = 0; i < 8; i++) {
+        emit_byte(buffer, (uint8_t)(value >> (8 * i)));
+    }
+}
+
+// Mandatory prefix (0x66, 0xF2 or 0), REX when needed, then the one- or
+// two-byte opcode (0x0F escapes are given as 0x0Fxx)
+static void emit_opcode(vm_jit_buffer_t *buffer, uint8_t prefix, bool wide, int reg, int index, int base, uint16_t opcode)
+{
+    if (prefix != 0) {
+        emit_byte(buffer, prefix);
+    }
+    uint8_t rex = (uint8_t)(0x40 | (wide ? 8 : 0) | ((reg & 8) ? 4 : 0) |
+                            (index != NO_INDEX && (index & 8) ? 2 : 0) | ((base & 8) ? 1 : 0));
+    if (rex != 0x40) {
+        emit_byte(buffer, rex);
+    }
+    if (opcode > 0xFF) {
+        emit_byte(buffer, (uint8_t)(opcode >> 8));
+    }
+    emit_byte(buffer, (uint8_t)opcode);
+}
+
+// op reg, [base + index * 8 + disp32]
+static void emit_mem(vm_jit_buffer_t *buffer, uint8_t prefix, bool wide, uint16_t opcode, int reg, int base, int index, int32_t disp)
+{
+    emit_opcode(buffer, prefix, wide, reg, index, base, opcode);
+    if (index == NO_INDEX && (base & 7) != RSP) {
+        emit_byte(buffer, (uint8_t)(0x80 | ((reg & 7) << 3) | (base & 7)));
+    } else {
+        emit_byte(buffer, (uint8_t)(0x80 | ((reg & 7) << 3) | RSP));
+        emit_byte(buffer, index == NO_INDEX ? (uint8_t)(0x20 | (base & 7)) :
+                                              (uint8_t)(0xC0 | ((index & 7) << 3) | (base & 7)));
+    }
+    emit_u32(buffer, (uint32_t)disp);
+}
+
+// op reg, rm (both registers)
+static void emit_reg(vm_jit_buffer_t *buffer, uint8_t prefix, bool wide, uint16_t opcode, int reg, int rm)
+{
+    emit_opcode(buffer, prefix, wide, reg, NO_INDEX, rm, opcode);
+    emit_byte(buffer, (uint8_t)(0xC0 | ((reg & 7) << 3) | (rm & 7)));
+}
+
+// Stack slot sp + slot (slot -1 is the top)
+static void emit_load_slot(vm_jit_buffer_t *buffer, int reg, int slot)
+{
+    emit_mem(buffer, 0, true, 0x8B, reg, JIT_STACK, JIT_SP, slot * 8);
+}
+
+static void emit_store_slot(vm_jit_buffer_t *buffer, int reg, int slot)
+{
+    emit_mem(buffer, 0, true, 0x89, reg, JIT_STACK, JIT_SP, slot * 8);
+}
+
+static void emit_load_frame(vm_jit_buffer_t *buffer, int reg, int32_t field)
+{
+    emit_mem(buffer, 0, true, 0x8B, reg, RBX, NO_INDEX, field);
+}
+
+static void emit_store_frame(vm_jit_buffer_t *buffer, int reg, int32_t field)
+{
+    emit_mem(buffer, 0, true, 0x89, reg, RBX, NO_INDEX, field);
+}
+
+// mov qword [rbx + field], imm32 (sign-extended)
+static void emit_store_frame_imm(vm_jit_buffer_t *buffer, int32_t field, uint32_t value)
+{
+    emit_mem(buffer, 0, true, 0xC7, 0, RBX, NO_INDEX, field);
+    emit_u32(buffer, value);
+}
+
+static void emit_inc(vm_jit_buffer_t *buffer, int reg)
+{
+    emit_reg(buffer, 0, true, 0xFF, 0, reg);
+}
+
+static void emit_dec(vm_jit_buffer_t *buffer, int reg)
+{
+    emit_reg(buffer, 0, true, 0xFF, 1, reg);
+}
+
+// Jump or conditional jump with a rel32 to fill in; returns where it goes
+static size_t emit_jump(vm_jit_buffer_t *buffer, int cc)
+{
+    if (cc < 0) {
+        emit_byte(buffer, 0xE9);
+    } else {
+        emit_byte(buffer, 0x0F);
+        emit_byte(buffer, (uint8_t)(0x80 | cc));
+    }
+    size_t at = buffer->size;
+    emit_u32(buffer, 0);
+    return at;
+}
+
+static void patch_jump(vm_jit_buffer_t *buffer, size_t at, size_t target)
+{
+    if (buffer->failed) {
+        return;
+    }
+    uint32_t rel = (uint32_t)((int64_t)target - (int64_t)(at + 4));
+    for (int i = 0; i < 4; i++) {
+        buffer->data[at + i] = (uint8_t)(rel >> (8 * i));
+    }
+}
+
+// setcc into the low byte of reg (al or cl)
+static void emit_setcc(vm_jit_buffer_t *buffer, int cc, int reg)
+{
+    emit_reg(buffer, 0, false, (uint16_t)(0x0F90 | cc), 0, reg);
+}
+
+// === Templates ===
+
+// Layout of every method's block: entry stub, then the exit paths
+typedef struct {
+    size_t exit_store;             // Write sp and executed back, return eax
+    size_t exit_status;            // Return frame.status
+    size_t exit_return;            // Return eax
+} vm_jit_stubs_t;
+
+// int native(vm_jit_frame_t *frame, const uint8_t *target): save the
+// callee-saved registers (five pushes keep rsp 16-byte aligned for the
+// helper calls), load the cached state and jump to target
+static vm_jit_stubs_t emit_stubs(vm_jit_buffer_t *buffer)
+{
+    static const uint8_t saved[] = { RBX, R12, R13, R14, R15 };
+    vm_jit_stubs_t stubs;
+
+    for (size_t i = 0; i < sizeof(saved); i++) {
+        if (saved[i] & 8) emit_byte(buffer, 0x41);
+        emit_byte(buffer, (uint8_t)(0x50 | (saved[i] & 7)));
+    }
+    emit_reg(buffer, 0, true, 0x89, RDI, RBX);  // mov rbx, rdi
+    emit_load_frame(buffer, JIT_STACK, JIT_FRAME_FIELD(stack));
+    emit_load_frame(buffer, JIT_SP, JIT_FRAME_FIELD(sp));
+    emit_load_frame(buffer, JIT_LOCALS, JIT_FRAME_FIELD(locals));
+    emit_load_frame(buffer, JIT_EXECUTED, JIT_FRAME_FIELD(executed));
+    emit_reg(buffer, 0, false, 0xFF, 4, RSI);   // jmp rsi
+
+    stubs.exit_store = buffer->size;
+    emit_store_frame(buffer, JIT_SP, JIT_FRAME_FIELD(sp));
+    emit_store_frame(buffer, JIT_EXECUTED, JIT_FRAME_FIELD(executed));
+    size_t skip = emit_jump(buffer, -1);
+    stubs.exit_status = buffer->size;
+    emit_mem(buffer, 0, false, 0x8B, RAX, RBX, NO_INDEX, JIT_FRAME_FIELD(status));
+    stubs.exit_return = buffer->size;
+    patch_jump(buffer, skip, stubs.exit_return);
+    for (size_t i = sizeof(saved); i-- > 0;) {
+        if (saved[i] & 8) emit_byte(buffer, 0x41);
+        emit_byte(buffer, (uint8_t)(0x58 | (saved[i] & 7)));
+    }
+    emit_byte(buffer, 0xC3);
+    return stubs;
+}
+
+// Hand the interpreter pc: set frame.pc and leave with status
+static void emit_exit(vm_jit_buffer_t *buffer, const vm_jit_stubs_t *stubs, size_t pc, uint32_t status)
+{
+    emit_store_frame_imm(buffer, JIT_FRAME_FIELD(pc), (uint32_t)pc);
+    emit_byte(buffer, 0xB8);                    // mov eax, status
+    emit_u32(buffer, status);
+    patch_jump(buffer, emit_jump(buffer, -1), stubs->exit_store);
+}
+
+// Run the instruction at pc through vm_jit_helper() and go where it says
+static void emit_helper(vm_jit_buffer_t *buffer, const vm_jit_stubs_t *stubs, size_t pc)
+{
+    const uint8_t *(*helper)(vm_jit_frame_t *) = vm_jit_helper;
+    uint64_t address;
+    memcpy(&address, &helper, sizeof(address));
+
+    emit_store_frame_imm(buffer, JIT_FRAME_FIELD(pc), (uint32_t)pc);
+    emit_store_frame(buffer, JIT_SP, JIT_FRAME_FIELD(sp));
+    emit_store_frame(buffer, JIT_EXECUTED, JIT_FRAME_FIELD(executed));
+    emit_reg(buffer, 0, true, 0x89, RBX, RDI);  // mov rdi, rbx
+    emit_byte(buffer, 0x48);                    // mov rax, helper
+    emit_byte(buffer, 0xB8);
+    emit_u64(buffer, address);
+    emit_reg(buffer, 0, false, 0xFF, 2, RAX);   // call rax
+    emit_load_frame(buffer, JIT_SP, JIT_FRAME_FIELD(sp));
+    emit_load_frame(buffer, JIT_LOCALS, JIT_FRAME_FIELD(locals));
+    emit_load_frame(buffer, JIT_EXECUTED, JIT_FRAME_FIELD(executed));
+    emit_reg(buffer, 0, true, 0x85, RAX, RAX);  // test rax, rax
+    patch_jump(buffer, emit_jump(buffer, CC_E), stubs->exit_status);
+    emit_reg(buffer, 0, false, 0xFF, 4, RAX);   // jmp rax
+}
+
+// Forward jumps inside the method, filled in once every template is placed
+typedef struct {
+    size_t at;
+    size_t target;
+} vm_jit_fixup_t;
+
+typedef struct {
+    vm_jit_buffer_t buffer;
+    vm_jit_stubs_t stubs;
+    const vm_jit_method_t *method;
+    size_t *offsets;               // Native offset of each instruction of the method
+    vm_jit_fixup_t *fixups;
+    size_t fixup_count;
+    size_t fixup_capacity;
+    size_t slow[4];                // Jumps of the current template to its slow path
+    size_t slow_count;
+} vm_jit_compiler_t;
+
+// Jump to the slow path (the helper) of the current template when cc holds
+static void emit_slow_if(vm_jit_compiler_t *compiler, int cc)
+{
+    compiler->slow[compiler->slow_count++] = emit_jump(&compiler->buffer, cc);
+}
+
+// Close a template that has a slow path: skip it on the fast path, then
+// place it
+static void emit_slow_path(vm_jit_compiler_t *compiler, size_t pc)
+{
+    vm_jit_buffer_t *buffer = &compiler->buffer;
+    size_t skip = emit_jump(buffer, -1);
+    for (size_t i = 0; i < compiler->slow_count; i++) {
+        patch_jump(buffer, compiler->slow[i], buffer->size);
+    }
+    compiler->slow_count = 0;
+    emit_helper(buffer, &compiler->stubs, pc);
+    patch_jump(buffer, skip, buffer->size);
+}
+
+// Go to target: natively inside the method, else through the interpreter.
+// Backward jumps first check the budget slice, as the interpreter's do.
+static void emit_goto(vm_jit_compiler_t *compiler, size_t pc, size_t target)
+{
+    vm_jit_buffer_t *buffer = &compiler->buffer;
+    const vm_jit_method_t *method = compiler->method;
+
+    if (target < method->start || target >= method->end) {
+        emit_exit(buffer, &compiler->stubs, target, target <= pc ? VM_JIT_SWITCH : VM_JIT_EXIT);
+        return;
+    }
+    if (target <= pc) {
+        emit_mem(buffer, 0, true, 0x3B, JIT_EXECUTED, RBX, NO_INDEX, JIT_FRAME_FIELD(limit));
+        patch_jump(buffer, emit_jump(buffer, CC_B), compiler->offsets[target - method->start]);
+        emit_exit(buffer, &compiler->stubs, target, VM_JIT_SWITCH);
+        return;
+    }
+    if (compiler->fixup_count == compiler->fixup_capacity) {
+        size_t grown = compiler->fixup_capacity > 0 ? compiler->fixup_capacity * 2 : 32;
+        vm_jit_fixup_t *fixups = realloc(compiler->fixups, grown * sizeof(vm_jit_fixup_t));
+        if (fixups == NULL) {
+            buffer->failed = true;
+            return;
+        }
+        compiler->fixups = fixups;
+        compiler->fixup_capacity = grown;
+    }
+    compiler->fixups[compiler->fixup_count].at = emit_jump(buffer, -1);
+    compiler->fixups[compiler->fixup_count].target = target;
+    compiler->fixup_count++;
+}
+
+// Stack depth checks; a failing one lets vm_step() report the error
+static void emit_need_room(vm_jit_compiler_t *compiler)
+{
+    emit_mem(&compiler->buffer, 0, true, 0x3B, JIT_SP, RBX, NO_INDEX, JIT_FRAME_FIELD(stack_size));
+    emit_slow_if(compiler, CC_AE);
+}
+
+static void emit_need_operands(vm_jit_compiler_t *compiler, int count)
+{
+    emit_reg(&compiler->buffer, 0, true, 0x83, 7, JIT_SP);  // cmp r13, count
+    emit_byte(&compiler->buffer, (uint8_t)count);
+    emit_slow_if(compiler, CC_B);
+}
+
+// rax = left operand, rcx = right operand (xmm0 and xmm1 as well for reals)
+static void emit_binary_operands(vm_jit_compiler_t *compiler, bool real)
+{
+    vm_jit_buffer_t *buffer = &compiler->buffer;
+    emit_need_operands(compiler, 2);
+    emit_load_slot(buffer, RAX, -2);
+    emit_load_slot(buffer, RCX, -1);
+    if (real) {
+        emit_reg(buffer, 0x66, true, 0x0F6E, XMM0, RAX);  // movq xmm0, rax
+        emit_reg(buffer, 0x66, true, 0x0F6E, XMM1, RCX);  // movq xmm1, rcx
+    }
+}
+
+// Store result as the new top and pop the right operand
+static void emit_binary_result(vm_jit_compiler_t *compiler, int result)
+{
+    emit_store_slot(&compiler->buffer, result, -2);
+    emit_dec(&compiler->buffer, JIT_SP);
+}
+
+// Real comparisons: ucomisd sets CF/ZF like an unsigned compare and PF for
+// NaN, which makes every comparison but != false
+static void emit_real_compare(vm_jit_buffer_t *buffer, opr_t operation)
+{
+    bool swap = operation == OPR_RLESS || operation == OPR_RLEQ;
+    emit_reg(buffer, 0x66, false, 0x0F2E, swap ? XMM1 : XMM0, swap ? XMM0 : XMM1);
+    switch (operation) {
+        case OPR_REQ:
+            emit_setcc(buffer, CC_E, RAX);
+            emit_setcc(buffer, CC_NP, RCX);
+            emit_reg(buffer, 0, false, 0x20, RCX, RAX);   // and al, cl
+            break;
+        case OPR_RNEQ:
+            emit_setcc(buffer, CC_NE, RAX);
+            emit_setcc(buffer, CC_P, RCX);
+            emit_reg(buffer, 0, false, 0x08, RCX, RAX);   // or al, cl
+            break;
+        case OPR_RLESS:
+        case OPR_RGREATER:
+            emit_setcc(buffer, CC_A, RAX);
+            break;
+        default:
+            emit_setcc(buffer, CC_AE, RAX);
+            break;
+    }
+    emit_reg(buffer, 0, false, 0x0FB6, RAX, RAX);         // movzx eax, al
+}
+
+// The native form of one VM_OPR operation; false when it has none
+static bool emit_operation(vm_jit_compiler_t *compiler, opr_t operation)
+{
+    vm_jit_buffer_t *buffer = &compiler->buffer;
+
+    switch (operation) {
+        case OPR_NEG:
+        case OPR_ODD:
+        case OPR_NOT:
+        case OPR_RNEG:
+        case OPR_INT_TO_REAL:
+        case OPR_REAL_TO_INT:
+            emit_need_operands(compiler, 1);
+            emit_load_slot(buffer, RAX, -1);
+            switch (operation) {
+                case OPR_NEG:
+                    emit_reg(buffer, 0, true, 0xF7, 3, RAX);            // neg rax
+                    break;
+                case OPR_ODD:
+                    emit_reg(buffer, 0, false, 0x83, 4, RAX);           // and eax, 1
+                    emit_byte(buffer, 1);
+                    break;
+                case OPR_NOT:
+                    emit_reg(buffer, 0, true, 0x85, RAX, RAX);          // test rax, rax
+                    emit_setcc(buffer, CC_E, RAX);
+                    emit_reg(buffer, 0, false, 0x0FB6, RAX, RAX);
+                    break;
+                case OPR_RNEG:
+                    emit_reg(buffer, 0, true, 0x0FBA, 7, RAX);          // btc rax, 63
+                    emit_byte(buffer, 63);
+                    break;
+                case OPR_INT_TO_REAL:
+                    emit_reg(buffer, 0xF2, true, 0x0F2A, XMM0, RAX);    // cvtsi2sd xmm0, rax
+                    emit_reg(buffer, 0x66, true, 0x0F7E, XMM0, RAX);    // movq rax, xmm0
+                    break;
+                default:
+                    // cvttsd2si gives INT64_MIN for NaN and out-of-range
+                    // values, which the interpreter saturates instead
+                    emit_reg(buffer, 0x66, true, 0x0F6E, XMM0, RAX);    // movq xmm0, rax
+                    emit_reg(buffer, 0xF2, true, 0x0F2C, RAX, XMM0);    // cvttsd2si rax, xmm0
+                    emit_reg(buffer, 0, true, 0x89, RAX, RDX);          // mov rdx, rax
+                    emit_reg(buffer, 0, true, 0xD1, 0, RDX);            // rol rdx, 1
+                    emit_reg(buffer, 0, true, 0x83, 7, RDX);            // cmp rdx, 1
+                    emit_byte(buffer, 1);
+                    emit_slow_if(compiler, CC_E);
+                    break;
+            }
+            emit_store_slot(buffer, RAX, -1);
+            return true;
+
+        case OPR_ADD:
+        case OPR_SUB:
+        case OPR_MUL:
+        case OPR_AND:
+        case OPR_OR:
+            emit_binary_operands(compiler, false);
+            if (operation == OPR_ADD) {
+                emit_reg(buffer, 0, true, 0x01, RCX, RAX);              // add rax, rcx
+            } else if (operation == OPR_SUB) {
+                emit_reg(buffer, 0, true, 0x29, RCX, RAX);              // sub rax, rcx
+            } else if (operation == OPR_MUL) {
+                emit_reg(buffer, 0, true, 0x0FAF, RAX, RCX);            // imul rax, rcx
+            } else {
+                emit_reg(buffer, 0, true, 0x85, RAX, RAX);
+                emit_setcc(buffer, CC_NE, RAX);
+                emit_reg(buffer, 0, true, 0x85, RCX, RCX);
+                emit_setcc(buffer, CC_NE, RCX);
+                emit_reg(buffer, 0, false, operation == OPR_AND ? 0x20 : 0x08, RCX, RAX);
+                emit_reg(buffer, 0, false, 0x0FB6, RAX, RAX);
+            }
+            emit_binary_result(compiler, RAX);
+            return true;
+
+        case OPR_DIV:
+        case OPR_MOD:
+            // A divisor of 0 or -1 (rcx + 1 <= 1 unsigned) goes to vm_step()
+            emit_binary_operands(compiler, false);
+            emit_mem(buffer, 0, true, 0x8D, RDX, RCX, NO_INDEX, 1);     // lea rdx, [rcx + 1]
+            emit_reg(buffer, 0, true, 0x83, 7, RDX);                    // cmp rdx, 1
+            emit_byte(buffer, 1);
+            emit_slow_if(compiler, CC_BE);
+            emit_byte(buffer, 0x48);                                    // cqo
+            emit_byte(buffer, 0x99);
+            emit_reg(buffer, 0, true, 0xF7, 7, RCX);                    // idiv rcx
+            emit_binary_result(compiler, operation == OPR_DIV ? RAX : RDX);
+            return true;
+
+        case OPR_EQ:
+        case OPR_NEQ:
+        case OPR_LESS:
+        case OPR_LEQ:
+        case OPR_GREATER:
+        case OPR_GEQ: {
+            static const int conditions[] = {
+                [OPR_EQ] = CC_E, [OPR_NEQ] = CC_NE, [OPR_LESS] = CC_L,
+                [OPR_LEQ] = CC_LE, [OPR_GREATER] = CC_G, [OPR_GEQ] = CC_GE
+            };
+            emit_binary_operands(compiler, false);
+            emit_reg(buffer, 0, true, 0x39, RCX, RAX);                  // cmp rax, rcx
+            emit_setcc(buffer, conditions[operation], RAX);
+            emit_reg(buffer, 0, false, 0x0FB6, RAX, RAX);
+            emit_binary_result(compiler, RAX);
+            return true;
+        }
+
+        case OPR_RADD:
+        case OPR_RSUB:
+        case OPR_RMUL:
+        case OPR_RDIV: {
+            static const uint16_t opcodes[] = {
+                [OPR_RADD] = 0x0F58, [OPR_RSUB] = 0x0F5C, [OPR_RMUL] = 0x0F59, [OPR_RDIV] = 0x0F5E
+            };
+            emit_binary_operands(compiler, true);
+            if (operation == OPR_RDIV) {
+                // Division by +0.0 or -0.0 is an error, as in the interpreter
+                emit_reg(buffer, 0, true, 0x89, RCX, RDX);              // mov rdx, rcx
+                emit_reg(buffer, 0, true, 0x01, RDX, RDX);              // add rdx, rdx
+                emit_slow_if(compiler, CC_E);
+            }
+            emit_reg(buffer, 0xF2, false, opcodes[operation], XMM0, XMM1);
+            emit_reg(buffer, 0x66, true, 0x0F7E, XMM0, RAX);            // movq rax, xmm0
+            emit_binary_result(compiler, RAX);
+            return true;
+        }
+
+        case OPR_REQ:
+        case OPR_RNEQ:
+        case OPR_RLESS:
+        case OPR_RLEQ:
+        case OPR_RGREATER:
+        case OPR_RGEQ:
+            emit_binary_operands(compiler, true);
+            emit_real_compare(buffer, operation);
+            emit_binary_result(compiler, RAX);
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+// Register holding the variables of the record instr->level up: r14 for
+// the current one, rdx for the enclosing one
+static int emit_record(vm_jit_compiler_t *compiler, const vm_instruction_t *instr)
+{
+    if (instr->level == 0) {
+        return JIT_LOCALS;
+    }
+    vm_jit_buffer_t *buffer = &compiler->buffer;
+    emit_load_frame(buffer, RDX, JIT_FRAME_FIELD(outer));
+    emit_reg(buffer, 0, true, 0x85, RDX, RDX);                          // test rdx, rdx
+    emit_slow_if(compiler, CC_E);
+    return RDX;
+}
+
+// Native code of the instruction at pc
+static void emit_instruction(vm_jit_compiler_t *compiler, const vm_instruction_t *instr, size_t pc)
+{
+    vm_jit_buffer_t *buffer = &compiler->buffer;
+    bool variable = instr->level <= 1 && instr->operand <= INT32_MAX / 8;
+    int record;
+
+    switch (instr->opcode) {
+        case VM_LIT:
+            emit_need_room(compiler);
+            if ((int64_t)instr->operand == (int32_t)instr->operand) {
+                emit_mem(buffer, 0, true, 0xC7, 0, JIT_STACK, JIT_SP, 0);
+                emit_u32(buffer, (uint32_t)instr->operand);
+            } else {
+                emit_byte(buffer, 0x48);                                // mov rax, imm64
+                emit_byte(buffer, 0xB8);
+                emit_u64(buffer, instr->operand);
+                emit_store_slot(buffer, RAX, 0);
+            }
+            emit_inc(buffer, JIT_SP);
+            break;
+
+        case VM_LOD:
+            if (!variable) {
+                emit_helper(buffer, &compiler->stubs, pc);
+                return;
+            }
+            emit_need_room(compiler);
+            record = emit_record(compiler, instr);
+            emit_mem(buffer, 0, true, 0x8B, RAX, record, NO_INDEX, (int32_t)(instr->operand * 8));
+            emit_store_slot(buffer, RAX, 0);
+            emit_inc(buffer, JIT_SP);
+            break;
+
+        case VM_STO:
+            if (!variable) {
+                emit_helper(buffer, &compiler->stubs, pc);
+                return;
+            }
+            emit_need_operands(compiler, 1);
+            record = emit_record(compiler, instr);
+            emit_dec(buffer, JIT_SP);
+            emit_load_slot(buffer, RAX, 0);
+            emit_mem(buffer, 0, true, 0x89, RAX, record, NO_INDEX, (int32_t)(instr->operand * 8));
+            break;
+
+        case VM_JMP:
+            emit_inc(buffer, JIT_EXECUTED);
+            emit_goto(compiler, pc, (size_t)instr->operand);
+            return;
+
+        case VM_JPC: {
+            emit_need_operands(compiler, 1);
+            emit_dec(buffer, JIT_SP);
+            emit_load_slot(buffer, RAX, 0);
+            emit_inc(buffer, JIT_EXECUTED);
+            emit_reg(buffer, 0, true, 0x85, RAX, RAX);                  // test rax, rax
+            size_t fall = emit_jump(buffer, CC_NE);
+            emit_goto(compiler, pc, (size_t)instr->operand);
+            for (size_t i = 0; i < compiler->slow_count; i++) {
+                patch_jump(buffer, compiler->slow[i], buffer->size);
+            }
+            compiler->slow_count = 0;
+            emit_helper(buffer, &compiler->stubs, pc);
+            patch_jump(buffer, fall, buffer->size);
+            return;
+        }
+
+        case VM_OPR:
+            if (!emit_operation(compiler, (opr_t)instr->operand)) {
+                compiler->slow_count = 0;
+                emit_helper(buffer, &compiler->stubs, pc);
+                return;
+            }
+            break;
+
+        default:
+            // Calls, returns, strings, objects and the rest of the VM
+            emit_helper(buffer, &compiler->stubs, pc);
+            return;
+    }
+
+    emit_inc(buffer, JIT_EXECUTED);
+    if (compiler->slow_count > 0) {
+        emit_slow_path(compiler, pc);
+    }
+}
+
+bool vm_jit_compile(arx_vm_context_t *vm, vm_jit_method_t *method)
+{
+    vm_jit_t *jit = vm->jit;
+    vm_jit_compiler_t compiler;
+    memset(&compiler, 0, sizeof(compiler));
+    compiler.method = method;
+    compiler.offsets = malloc((method->end - method->start) * sizeof(size_t));
+    if (compiler.offsets == NULL) {
+        return false;
+    }
+
+    compiler.stubs = emit_stubs(&compiler.buffer);
+    for (size_t pc = method->start; pc < method->end; pc++) {
+        compiler.offsets[pc - method->start] = compiler.buffer.size;
+        emit_instruction(&compiler, &vm->code[pc], pc);
+    }
+    // Running off the end of the method continues in the interpreter
+    emit_exit(&compiler.buffer, &compiler.stubs, method->end, VM_JIT_EXIT);
+    for (size_t i = 0; i < compiler.fixup_count; i++) {
+        patch_jump(&compiler.buffer, compiler.fixups[i].at,
+                   compiler.offsets[compiler.fixups[i].target - method->start]);
+    }
+    free(compiler.fixups);
+
+    // Written while writable, then switched to executable
+    uint8_t *code = NULL;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t size = (compiler.buffer.size + page - 1) / page * page;
+    if (!compiler.buffer.failed) {
+        code = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (code == MAP_FAILED) {
+            code = NULL;
+        } else {
+            memcpy(code, compiler.buffer.data, compiler.buffer.size);
+            if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0) {
+                munmap(code, size);
+                code = NULL;
+            }
+        }
+    }
+    free(compiler.buffer.data);
+    if (code == NULL) {
+        free(compiler.offsets);
+        return false;
+    }
+
+    method->code = code;
+    method->code_size = size;
+    for (size_t pc = method->start; pc < method->end; pc++) {
+        jit->entries[pc] = code + compiler.offsets[pc - method->start];
+    }
+    free(compiler.offsets);
+    jit->compiled++;
+    jit->code_bytes += size;
+    return true;
+}
+
+bool vm_jit_enter(arx_vm_context_t *vm, bool *switch_point)
+{
+    vm_jit_t *jit = vm->jit;
+    const vm_jit_method_t *method = &jit->methods[jit->method_of[vm->pc]];
+    vm_jit_frame_t frame;
+    frame.stack = vm->stack;
+    frame.sp = vm->stack_top;
+    frame.locals = vm->locals;
+    frame.executed = 0;
+    frame.limit = vm_jit_limit(vm);
+    frame.pc = vm->pc;
+    frame.stack_size = vm->stack_size;
+    frame.status = VM_JIT_EXIT;
+    frame.outer = NULL;
+    vm_jit_find_outer(&frame, vm);
+    frame.vm = vm;
+
+    vm_jit_native_t native;
+    memcpy(&native, &method->code, sizeof(native));
+    int status = native(&frame, jit->entries[vm->pc]);
+    jit->entries_taken++;
+
+    vm->stack_top = (size_t)frame.sp;
+    vm->pc = (size_t)frame.pc;
+    vm->instruction_count_executed += (size_t)frame.executed;
+    *switch_point = status == VM_JIT_SWITCH;
+    return status != VM_JIT_ERROR;
+}
+
+#else
+
+bool vm_jit_compile(arx_vm_context_t *vm, vm_jit_method_t *method)
+{
+    (void)vm;
+    (void)method;
+    return false;
+}
+
+bool vm_jit_enter(arx_vm_context_t *vm, bool *switch_point)
+{
+    (void)vm;
+    *switch_point = false;
+    return false;
+}
+
+#endif
@@ -0,0 +1,86 @@
+/*
+ * ARX Virtual Machine Template JIT
+ * Native code for hot methods, built one instruction template at a time
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "vm.h"
+
+// Build with -DVM_JIT=0 to leave the code generator out. Only x86-64 with
+// the System V calling convention has one; elsewhere vm_jit_enable() fails
+// and every method stays interpreted.
+#ifndef VM_JIT
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__))
+#define VM_JIT 1
+#else
+#define VM_JIT 0
+#endif
+#endif
+
+// Method entries plus loop iterations before a method is compiled, unless
+// vm_jit_enable() is told otherwise
+#define VM_JIT_DEFAULT_THRESHOLD 1000
+
+// Method index for code outside every method (module start-up code)
+#define VM_JIT_NO_METHOD UINT32_MAX
+
+typedef enum {
+    VM_JIT_COLD,                   // Interpreted, counting towards the threshold
+    VM_JIT_COMPILED,               // Every instruction has native code
+    VM_JIT_FAILED                  // Could not be compiled; stays interpreted
+} vm_jit_state_t;
+
+// One method's instructions, from its manifest entry to the next method's
+typedef struct {
+    size_t start;                  // First instruction
+    size_t end;                    // One past the last instruction
+    uint64_t hotness;              // Entries and loop iterations counted so far
+    vm_jit_state_t state;
+    uint8_t *code;                 // Executable block (VM_JIT_COMPILED)
+    size_t code_size;              // Bytes mapped at code
+} vm_jit_method_t;
+
+struct vm_jit {
+    uint64_t threshold;
+
+    // Per instruction, grown when a module is linked
+    uint32_t *method_of;           // Index into methods, VM_JIT_NO_METHOD outside them
+    const uint8_t **entries;       // Native code of the instruction, NULL while interpreted
+    uint16_t *ops;                 // Threaded op displaced by a counting handler
+    size_t capacity;
+
+    vm_jit_method_t *methods;      // Sorted by start
+    size_t method_count;
+    size_t method_capacity;
+
+    // Totals for the statistics
+    size_t compiled;               // Methods compiled
+    size_t code_bytes;             // Native code mapped for them
+    uint64_t entries_taken;        // Transfers from the interpreter into native code
+};
+
+// Whether this build has a code generator for the machine it runs on
+bool vm_jit_available(void);
+
+// Compile methods once they get hot. Must precede vm_load_program() (or
+// vm_load_image()), as the counting handlers are placed when code is
+// decoded. A threshold of 0 uses VM_JIT_DEFAULT_THRESHOLD. Fails when the
+// build has no code generator.
+bool vm_jit_enable(arx_vm_context_t *vm, uint64_t threshold);
+void vm_jit_free(arx_vm_context_t *vm);
+
+// Hooks used by the VM itself. vm_jit_map() sizes the per-instruction
+// arrays for instruction_count instructions and adds the methods starting
+// at or after first (0 starts a new program).
+bool vm_jit_map(arx_vm_context_t *vm, size_t first, size_t instruction_count);
+bool vm_jit_compile(arx_vm_context_t *vm, vm_jit_method_t *method);
+
+// Run native code from vm->pc, which must have some, until it reaches an
+// instruction it hands back to the interpreter: a call, a return, a jump
+// out of the method or a budget check. The VM context is up to date
+// afterwards; false means an instruction failed and last_error is set.
+// switch_point says whether it left at a task switch point.
+bool vm_jit_enter(arx_vm_context_t *vm, bool *switch_point);
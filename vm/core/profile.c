@@ -0,0 +1,640 @@
+/*
+ * ARX Virtual Machine Profiler Implementation
+ * Instruction counts, method costs and sampled call stacks
+ */
+
+#include "profile.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Names of the operations in per-opcode counts
+static const char *const vm_profile_opcode_names[] = {
+    [VM_LIT] = "LIT", [VM_OPR] = "OPR", [VM_LOD] = "LOD", [VM_STO] = "STO",
+    [VM_CAL] = "CAL", [VM_INT] = "INT", [VM_JMP] = "JMP", [VM_JPC] = "JPC",
+    [VM_LODX] = "LODX", [VM_STOX] = "STOX", [VM_STRING] = "STRING",
+    [VM_HALT] = "HALT", [VM_CALS] = "CALS"
+};
+
+static const char *const vm_profile_operation_names[OPR_LAST + 1] = {
+    [OPR_RET] = "RET", [OPR_NEG] = "NEG", [OPR_ADD] = "ADD", [OPR_SUB] = "SUB",
+    [OPR_MUL] = "MUL", [OPR_DIV] = "DIV", [OPR_POW] = "POW", [OPR_MOD] = "MOD",
+    [OPR_ODD] = "ODD", [OPR_NULL] = "NULL", [OPR_EQ] = "EQ", [OPR_NEQ] = "NEQ",
+    [OPR_LESS] = "LESS", [OPR_LEQ] = "LEQ", [OPR_GREATER] = "GREATER", [OPR_GEQ] = "GEQ",
+    [OPR_AND] = "AND", [OPR_OR] = "OR", [OPR_NOT] = "NOT",
+    [OPR_SHR] = "SHR", [OPR_SHL] = "SHL", [OPR_SAR] = "SAR",
+    [OPR_OUTCHAR] = "OUTCHAR", [OPR_OUTINT] = "OUTINT", [OPR_OUTSTRING] = "OUTSTRING",
+    [OPR_WRITELN] = "WRITELN", [OPR_INCHAR] = "INCHAR", [OPR_ININT] = "ININT",
+    [OPR_STR_CREATE] = "STR_CREATE", [OPR_STR_SLICE] = "STR_SLICE", [OPR_STR_CONCAT] = "STR_CONCAT",
+    [OPR_STR_LEN] = "STR_LEN", [OPR_STR_EQ] = "STR_EQ", [OPR_STR_CMP] = "STR_CMP",
+    [OPR_STR_BUILDER_CREATE] = "STR_BUILDER_CREATE", [OPR_STR_BUILDER_APPEND] = "STR_BUILDER_APPEND",
+    [OPR_STR_BUILDER_TO_STR] = "STR_BUILDER_TO_STR", [OPR_STR_DATA] = "STR_DATA",
+    [OPR_INT_TO_STR] = "INT_TO_STR", [OPR_STR_TO_INT] = "STR_TO_INT",
+    [OPR_OBJ_CREATE] = "OBJ_CREATE", [OPR_OBJ_CALL_METHOD] = "OBJ_CALL_METHOD",
+    [OPR_OBJ_RETURN] = "OBJ_RETURN", [OPR_OBJ_SELF] = "OBJ_SELF", [OPR_OBJ_NEW] = "OBJ_NEW",
+    [OPR_OBJ_DOT] = "OBJ_DOT", [OPR_SQRT] = "SQRT", [OPR_REAL_LIT] = "REAL_LIT",
+    [OPR_INT_TO_REAL] = "INT_TO_REAL", [OPR_REAL_TO_INT] = "REAL_TO_INT",
+    [OPR_RNEG] = "RNEG", [OPR_RADD] = "RADD", [OPR_RSUB] = "RSUB", [OPR_RMUL] = "RMUL",
+    [OPR_RDIV] = "RDIV", [OPR_REQ] = "REQ", [OPR_RNEQ] = "RNEQ", [OPR_RLESS] = "RLESS",
+    [OPR_RLEQ] = "RLEQ", [OPR_RGREATER] = "RGREATER", [OPR_RGEQ] = "RGEQ",
+    [OPR_REAL_TO_STR] = "REAL_TO_STR",
+    [OPR_TASK_SPAWN] = "TASK_SPAWN", [OPR_TASK_YIELD] = "TASK_YIELD", [OPR_TASK_JOIN] = "TASK_JOIN",
+    [OPR_ARRAY_NEW] = "ARRAY_NEW", [OPR_ARRAY_LOAD] = "ARRAY_LOAD", [OPR_ARRAY_STORE] = "ARRAY_STORE",
+    [OPR_ARRAY_LENGTH] = "ARRAY_LENGTH", [OPR_ARRAY_FILL] = "ARRAY_FILL", [OPR_ARRAY_COPY] = "ARRAY_COPY",
+    [OPR_ARRAY_SLICE] = "ARRAY_SLICE", [OPR_ARRAY_EQUAL] = "ARRAY_EQUAL", [OPR_ARRAY_SUM] = "ARRAY_SUM",
+    [OPR_ARRAY_MIN] = "ARRAY_MIN", [OPR_ARRAY_MAX] = "ARRAY_MAX", [OPR_ARRAY_FIND] = "ARRAY_FIND",
+    [OPR_STR_FIND] = "STR_FIND", [OPR_STR_AT] = "STR_AT",
+    [OPR_OBJ_NEW_FRAME] = "OBJ_NEW_FRAME", [OPR_OBJ_RELEASE] = "OBJ_RELEASE",
+    [OPR_OBJ_CHECK] = "OBJ_CHECK"
+};
+
+void vm_profile_instruction_name(uint8_t opcode, uint64_t operand, char *name, size_t size)
+{
+    if (opcode == VM_OPR) {
+        if (operand <= OPR_LAST && vm_profile_operation_names[operand] != NULL) {
+            snprintf(name, size, "OPR %s", vm_profile_operation_names[operand]);
+        } else {
+            snprintf(name, size, "OPR %llu", (unsigned long long)operand);
+        }
+    } else if (opcode < sizeof(vm_profile_opcode_names) / sizeof(vm_profile_opcode_names[0]) &&
+               vm_profile_opcode_names[opcode] != NULL) {
+        snprintf(name, size, "%s", vm_profile_opcode_names[opcode]);
+    } else {
+        snprintf(name, size, "opcode %u", (unsigned)opcode);
+    }
+}
+
+// Per-opcode rows: the opcodes, then each VM_OPR operation on its own
+#define VM_PROFILE_OPCODE_ROWS 16
+#define VM_PROFILE_ROWS (VM_PROFILE_OPCODE_ROWS + OPR_LAST + 1)
+
+// Per-method arrays keep code outside every method in slot 0
+static inline size_t vm_profile_slot(uint32_t method)
+{
+    return method == VM_PROFILE_NO_METHOD ? 0 : (size_t)method + 1;
+}
+
+bool vm_profile_enable(arx_vm_context_t *vm, uint64_t sample_interval)
+{
+    if (vm == NULL) {
+        return false;
+    }
+
+    vm_profile_t *profile = vm->profile;
+    if (profile == NULL) {
+        profile = calloc(1, sizeof(vm_profile_t));
+        if (profile == NULL) {
+            return false;
+        }
+        vm->profile = profile;
+    }
+    profile->interval = sample_interval > 0 ? sample_interval : VM_PROFILE_DEFAULT_INTERVAL;
+    profile->countdown = profile->interval;
+
+    // A fused sequence would count as its first instruction only
+    vm->superinstructions = false;
+    return true;
+}
+
+void vm_profile_free(arx_vm_context_t *vm)
+{
+    if (vm == NULL || vm->profile == NULL) {
+        return;
+    }
+
+    vm_profile_t *profile = vm->profile;
+    free(profile->counts);
+    free(profile->method_map);
+    free(profile->inclusive);
+    free(profile->calls);
+    free(profile->active);
+    free(profile->frames);
+    free(profile->stack_words);
+    free(profile->stacks);
+    free(profile->stack_index);
+    free(profile);
+    vm->profile = NULL;
+}
+
+bool vm_profile_reserve(arx_vm_context_t *vm, size_t instruction_count, bool program)
+{
+    vm_profile_t *profile = vm->profile;
+    if (instruction_count > profile->count_capacity) {
+        uint64_t *counts = realloc(profile->counts, instruction_count * sizeof(uint64_t));
+        if (counts == NULL) {
+            return false;
+        }
+        memset(&counts[profile->count_capacity], 0, (instruction_count - profile->count_capacity) * sizeof(uint64_t));
+        profile->counts = counts;
+        profile->count_capacity = instruction_count;
+    }
+
+    // A new program starts from zero; a linked module only adds code
+    if (program) {
+        memset(profile->counts, 0, profile->count_capacity * sizeof(uint64_t));
+        profile->program_instructions = instruction_count;
+        profile->map_instructions = 0;
+    }
+    return true;
+}
+
+static bool vm_profile_grow(void **array, size_t *capacity, size_t needed, size_t entry_size)
+{
+    if (needed <= *capacity) {
+        return true;
+    }
+    size_t grown = *capacity > 0 ? *capacity * 2 : 64;
+    while (grown < needed) {
+        grown *= 2;
+    }
+    void *resized = realloc(*array, grown * entry_size);
+    if (resized == NULL) {
+        return false;
+    }
+    *array = resized;
+    *capacity = grown;
+    return true;
+}
+
+typedef struct {
+    uint64_t offset;
+    uint32_t method;
+} vm_profile_method_start_t;
+
+static int vm_profile_compare_starts(const void *a, const void *b)
+{
+    uint64_t left = ((const vm_profile_method_start_t *)a)->offset;
+    uint64_t right = ((const vm_profile_method_start_t *)b)->offset;
+    return left < right ? -1 : left > right;
+}
+
+// A method runs from its first instruction up to the next method's; the
+// last one also owns the program's closing HALT
+static bool vm_profile_build_map(arx_vm_context_t *vm)
+{
+    vm_profile_t *profile = vm->profile;
+    size_t instruction_count = vm->instruction_count;
+    size_t method_count = vm->class_system.method_count;
+    if (profile->method_map != NULL && profile->map_instructions == instruction_count &&
+        profile->map_methods == method_count) {
+        return true;
+    }
+
+    // Methods are only ever appended, so existing slots keep their meaning
+    if (method_count + 1 > profile->method_capacity) {
+        size_t capacity = method_count + 1;
+        uint64_t *inclusive = realloc(profile->inclusive, capacity * sizeof(uint64_t));
+        if (inclusive != NULL) {
+            profile->inclusive = inclusive;
+        }
+        uint64_t *calls = realloc(profile->calls, capacity * sizeof(uint64_t));
+        if (calls != NULL) {
+            profile->calls = calls;
+        }
+        uint32_t *active = realloc(profile->active, capacity * sizeof(uint32_t));
+        if (active != NULL) {
+            profile->active = active;
+        }
+        if (inclusive == NULL || calls == NULL || active == NULL) {
+            return false;
+        }
+        size_t added = capacity - profile->method_capacity;
+        memset(&inclusive[profile->method_capacity], 0, added * sizeof(uint64_t));
+        memset(&calls[profile->method_capacity], 0, added * sizeof(uint64_t));
+        memset(&active[profile->method_capacity], 0, added * sizeof(uint32_t));
+        profile->method_capacity = capacity;
+    }
+
+    uint32_t *map = realloc(profile->method_map, (instruction_count > 0 ? instruction_count : 1) * sizeof(uint32_t));
+    vm_profile_method_start_t *starts = malloc((method_count > 0 ? method_count : 1) * sizeof(vm_profile_method_start_t));
+    if (map == NULL || starts == NULL) {
+        if (map != NULL) {
+            profile->method_map = map;
+        }
+        free(starts);
+        return false;
+    }
+    profile->method_map = map;
+
+    size_t start_count = 0;
+    for (size_t i = 0; i < method_count; i++) {
+        if (vm->class_system.methods[i].offset < instruction_count) {
+            starts[start_count].offset = vm->class_system.methods[i].offset;
+            starts[start_count].method = (uint32_t)i;
+            start_count++;
+        }
+    }
+    qsort(starts, start_count, sizeof(vm_profile_method_start_t), vm_profile_compare_starts);
+
+    size_t pc = 0;
+    for (; pc < instruction_count && (start_count == 0 || pc < starts[0].offset); pc++) {
+        map[pc] = VM_PROFILE_NO_METHOD;
+    }
+    for (size_t k = 0; k < start_count; k++) {
+        size_t end = k + 1 < start_count ? (size_t)starts[k + 1].offset : instruction_count;
+        for (; pc < end; pc++) {
+            map[pc] = starts[k].method;
+        }
+    }
+    free(starts);
+
+    profile->map_instructions = instruction_count;
+    profile->map_methods = method_count;
+    return true;
+}
+
+static uint32_t vm_profile_method_at(arx_vm_context_t *vm, size_t pc)
+{
+    if (!vm_profile_build_map(vm) || pc >= vm->profile->map_instructions) {
+        return VM_PROFILE_NO_METHOD;
+    }
+    return vm->profile->method_map[pc];
+}
+
+void vm_profile_enter(arx_vm_context_t *vm, uint64_t return_pc)
+{
+    vm_profile_t *profile = vm->profile;
+
+    // The caller is known from its call site now, if it was not already
+    if (profile->depth > 0 && profile->frames[profile->depth - 1].method == VM_PROFILE_NO_METHOD && return_pc > 0) {
+        uint32_t caller = vm_profile_method_at(vm, (size_t)return_pc - 1);
+        if (caller != VM_PROFILE_NO_METHOD) {
+            profile->frames[profile->depth - 1].method = caller;
+            profile->active[vm_profile_slot(caller)]++;
+        }
+    }
+
+    if (profile->untracked > 0 ||
+        !vm_profile_grow((void **)&profile->frames, &profile->frame_capacity, profile->depth + 1, sizeof(vm_profile_frame_t))) {
+        profile->untracked++;
+        return;
+    }
+    profile->frames[profile->depth].entered = vm->instruction_count_executed;
+    profile->frames[profile->depth].method = VM_PROFILE_NO_METHOD;
+    profile->depth++;
+}
+
+// Pop the innermost activation; pc is an instruction of its method. Only
+// the outermost activation of a recursive method adds to its inclusive
+// count, so recursion is not counted twice.
+static void vm_profile_close(arx_vm_context_t *vm, size_t pc)
+{
+    vm_profile_t *profile = vm->profile;
+    vm_profile_frame_t *frame = &profile->frames[--profile->depth];
+    uint32_t method = frame->method;
+    if (method == VM_PROFILE_NO_METHOD) {
+        method = vm_profile_method_at(vm, pc);
+    } else {
+        profile->active[vm_profile_slot(method)]--;
+    }
+    if (profile->method_capacity == 0) {
+        return;
+    }
+
+    size_t slot = vm_profile_slot(method);
+    profile->calls[slot]++;
+    if (profile->active[slot] == 0) {
+        profile->inclusive[slot] += vm->instruction_count_executed - frame->entered;
+    }
+}
+
+void vm_profile_return(arx_vm_context_t *vm)
+{
+    vm_profile_t *profile = vm->profile;
+    if (profile->untracked > 0) {
+        profile->untracked--;
+        return;
+    }
+    if (profile->depth > 0) {
+        vm_profile_close(vm, vm->pc);
+    }
+}
+
+void vm_profile_finish(arx_vm_context_t *vm)
+{
+    if (vm == NULL || vm->profile == NULL) {
+        return;
+    }
+
+    // The innermost activation stopped at vm->pc; its callers are known
+    // from their call sites
+    vm->profile->untracked = 0;
+    while (vm->profile->depth > 0) {
+        vm_profile_close(vm, vm->pc);
+    }
+}
+
+static uint64_t vm_profile_hash_stack(const uint64_t *pcs, size_t depth)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < depth; i++) {
+        hash ^= pcs[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static bool vm_profile_index_stacks(vm_profile_t *profile, size_t capacity)
+{
+    uint32_t *index = calloc(capacity, sizeof(uint32_t));
+    if (index == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < profile->stack_count; i++) {
+        size_t slot = (size_t)profile->stacks[i].hash & (capacity - 1);
+        while (index[slot] != 0) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        index[slot] = (uint32_t)(i + 1);
+    }
+    free(profile->stack_index);
+    profile->stack_index = index;
+    profile->stack_index_mask = capacity - 1;
+    return true;
+}
+
+// Record the pc and the call site of every activation around it
+void vm_profile_sample(arx_vm_context_t *vm, size_t pc)
+{
+    vm_profile_t *profile = vm->profile;
+    profile->countdown = profile->interval;
+    profile->samples++;
+
+    uint64_t pcs[VM_PROFILE_MAX_DEPTH];
+    size_t depth = 0;
+    pcs[depth++] = pc;
+    for (uint64_t base = vm->call_stack.frame_base; base != VM_FRAME_GLOBAL && depth < VM_PROFILE_MAX_DEPTH;
+         base = vm->call_stack.frames[base + VM_FRAME_DYNAMIC_LINK]) {
+        // Calls resume after the call instruction; the runtime's own call
+        // of App.Main has no call site
+        uint64_t return_pc = vm->call_stack.frames[base + VM_FRAME_RETURN_PC];
+        if (return_pc > 0) {
+            pcs[depth++] = return_pc - 1;
+        }
+    }
+
+    uint64_t hash = vm_profile_hash_stack(pcs, depth);
+    if (profile->stack_index != NULL) {
+        for (size_t slot = (size_t)hash & profile->stack_index_mask; profile->stack_index[slot] != 0;
+             slot = (slot + 1) & profile->stack_index_mask) {
+            vm_profile_stack_t *stack = &profile->stacks[profile->stack_index[slot] - 1];
+            if (stack->hash == hash && stack->depth == depth &&
+                memcmp(&profile->stack_words[stack->offset], pcs, depth * sizeof(uint64_t)) == 0) {
+                stack->samples++;
+                return;
+            }
+        }
+    }
+
+    // New stack; the index is kept at most half full
+    if (!vm_profile_grow((void **)&profile->stack_words, &profile->stack_word_capacity,
+                         profile->stack_word_count + depth, sizeof(uint64_t)) ||
+        !vm_profile_grow((void **)&profile->stacks, &profile->stack_capacity,
+                         profile->stack_count + 1, sizeof(vm_profile_stack_t)) ||
+        profile->stack_count + 1 > UINT32_MAX - 1) {
+        profile->samples_dropped++;
+        return;
+    }
+    vm_profile_stack_t *stack = &profile->stacks[profile->stack_count++];
+    stack->offset = profile->stack_word_count;
+    stack->depth = depth;
+    stack->hash = hash;
+    stack->samples = 1;
+    memcpy(&profile->stack_words[stack->offset], pcs, depth * sizeof(uint64_t));
+    profile->stack_word_count += depth;
+
+    size_t capacity = profile->stack_index != NULL ? profile->stack_index_mask + 1 : 0;
+    if (profile->stack_count * 2 > capacity) {
+        // The rebuilt index already holds the new stack
+        if (!vm_profile_index_stacks(profile, capacity > 0 ? capacity * 2 : 256)) {
+            profile->stack_count--;
+            profile->stack_word_count -= depth;
+            profile->samples_dropped++;
+        }
+        return;
+    }
+    size_t slot = (size_t)hash & profile->stack_index_mask;
+    while (profile->stack_index[slot] != 0) {
+        slot = (slot + 1) & profile->stack_index_mask;
+    }
+    profile->stack_index[slot] = (uint32_t)profile->stack_count;
+}
+
+// Class index of every method; methods are stored in class order
+static uint32_t *vm_profile_method_classes(arx_vm_context_t *vm)
+{
+    size_t method_count = vm->class_system.method_count;
+    uint32_t *classes = malloc((method_count > 0 ? method_count : 1) * sizeof(uint32_t));
+    if (classes == NULL) {
+        return NULL;
+    }
+    size_t m = 0;
+    for (size_t c = 0; c < vm->class_system.class_count; c++) {
+        for (uint32_t k = 0; k < vm->class_system.classes[c].method_count && m < method_count; k++) {
+            classes[m++] = (uint32_t)c;
+        }
+    }
+    while (m < method_count) {
+        classes[m++] = UINT32_MAX;
+    }
+    return classes;
+}
+
+static void vm_profile_method_name(arx_vm_context_t *vm, const uint32_t *classes, uint32_t method, char *name, size_t size)
+{
+    if (method == VM_PROFILE_NO_METHOD || method >= vm->class_system.method_count) {
+        snprintf(name, size, "<module>");
+        return;
+    }
+    const method_entry_t *entry = &vm->class_system.methods[method];
+    if (classes != NULL && classes[method] != UINT32_MAX) {
+        snprintf(name, size, "%.32s.%.32s", vm->class_system.classes[classes[method]].class_name, entry->method_name);
+    } else {
+        snprintf(name, size, "%.32s", entry->method_name);
+    }
+}
+
+typedef struct {
+    char *text;
+    uint64_t samples;
+} vm_profile_line_t;
+
+static int vm_profile_compare_lines(const void *a, const void *b)
+{
+    return strcmp(((const vm_profile_line_t *)a)->text, ((const vm_profile_line_t *)b)->text);
+}
+
+bool vm_profile_write_stacks(arx_vm_context_t *vm, FILE *file, vm_profile_line_fn line_of, void *data)
+{
+    if (vm == NULL || vm->profile == NULL || file == NULL) {
+        return false;
+    }
+
+    vm_profile_t *profile = vm->profile;
+    if (profile->stack_count == 0) {
+        return true;
+    }
+    uint32_t *classes = vm_profile_method_classes(vm);
+    vm_profile_line_t *lines = calloc(profile->stack_count, sizeof(vm_profile_line_t));
+    if (classes == NULL || lines == NULL) {
+        free(classes);
+        free(lines);
+        return false;
+    }
+
+    // Stacks of different pcs in the same methods and lines print the
+    // same; sorting the texts brings those together
+    bool written = true;
+    size_t frame_size = 2 * 32 + 16;
+    for (size_t i = 0; i < profile->stack_count && written; i++) {
+        const vm_profile_stack_t *stack = &profile->stacks[i];
+        const uint64_t *pcs = &profile->stack_words[stack->offset];
+        char *text = malloc(stack->depth * (frame_size + 1) + 16);
+        if (text == NULL) {
+            written = false;
+            break;
+        }
+        size_t length = 0;
+        for (size_t d = stack->depth; d-- > 0; ) {
+            char name[2 * 32 + 16];
+            vm_profile_method_name(vm, classes, vm_profile_method_at(vm, (size_t)pcs[d]), name, sizeof(name));
+            length += (size_t)sprintf(&text[length], "%s%s", d + 1 < stack->depth ? ";" : "", name);
+        }
+        uint32_t line = 0;
+        if (line_of != NULL && pcs[0] < profile->program_instructions && line_of(data, (size_t)pcs[0], &line)) {
+            sprintf(&text[length], ":%u", line);
+        }
+        lines[i].text = text;
+        lines[i].samples = stack->samples;
+    }
+
+    if (written) {
+        qsort(lines, profile->stack_count, sizeof(vm_profile_line_t), vm_profile_compare_lines);
+        for (size_t i = 0; i < profile->stack_count && written; ) {
+            uint64_t samples = 0;
+            size_t j = i;
+            while (j < profile->stack_count && strcmp(lines[j].text, lines[i].text) == 0) {
+                samples += lines[j].samples;
+                j++;
+            }
+            written = fprintf(file, "%s %llu\n", lines[i].text, (unsigned long long)samples) > 0;
+            i = j;
+        }
+    }
+
+    for (size_t i = 0; i < profile->stack_count; i++) {
+        free(lines[i].text);
+    }
+    free(lines);
+    free(classes);
+    return written;
+}
+
+typedef struct {
+    size_t index;
+    uint64_t self;
+    uint64_t total;
+} vm_profile_row_t;
+
+static int vm_profile_compare_rows(const void *a, const void *b)
+{
+    const vm_profile_row_t *left = a;
+    const vm_profile_row_t *right = b;
+    if (left->self != right->self) {
+        return left->self > right->self ? -1 : 1;
+    }
+    return left->index < right->index ? -1 : left->index > right->index;
+}
+
+static double vm_profile_percent(uint64_t part, uint64_t whole)
+{
+    return whole > 0 ? 100.0 * (double)part / (double)whole : 0.0;
+}
+
+void vm_profile_report(arx_vm_context_t *vm, FILE *file)
+{
+    if (vm == NULL || vm->profile == NULL || file == NULL) {
+        return;
+    }
+
+    vm_profile_t *profile = vm->profile;
+    size_t instruction_count = vm->instruction_count < profile->count_capacity ?
+                               vm->instruction_count : profile->count_capacity;
+    if (!vm_profile_build_map(vm)) {
+        fprintf(file, "Profile: out of memory\n");
+        return;
+    }
+
+    size_t method_slots = vm->class_system.method_count + 1;
+    vm_profile_row_t *rows = calloc(method_slots > VM_PROFILE_ROWS ? method_slots : VM_PROFILE_ROWS, sizeof(vm_profile_row_t));
+    uint32_t *classes = vm_profile_method_classes(vm);
+    if (rows == NULL || classes == NULL) {
+        free(rows);
+        free(classes);
+        fprintf(file, "Profile: out of memory\n");
+        return;
+    }
+
+    // Opcode counts, with each VM_OPR operation on its own row
+    uint64_t total = 0;
+    for (size_t i = 0; i < VM_PROFILE_ROWS; i++) {
+        rows[i].index = i;
+    }
+    for (size_t pc = 0; pc < instruction_count; pc++) {
+        const vm_instruction_t *instr = &vm->code[pc];
+        size_t row = instr->opcode == VM_OPR && instr->operand <= OPR_LAST ?
+                     VM_PROFILE_OPCODE_ROWS + (size_t)instr->operand : instr->opcode;
+        rows[row].self += profile->counts[pc];
+        total += profile->counts[pc];
+    }
+    qsort(rows, VM_PROFILE_ROWS, sizeof(vm_profile_row_t), vm_profile_compare_rows);
+
+    fprintf(file, "\n=== Profile ===\n");
+    fprintf(file, "Instructions: %llu, samples: %llu (every %llu instructions",
+            (unsigned long long)total, (unsigned long long)profile->samples, (unsigned long long)profile->interval);
+    if (profile->samples_dropped > 0) {
+        fprintf(file, ", %llu dropped", (unsigned long long)profile->samples_dropped);
+    }
+    fprintf(file, ")\n\nOpcodes:\n");
+    for (size_t i = 0; i < VM_PROFILE_ROWS && rows[i].self > 0; i++) {
+        size_t row = rows[i].index;
+        char name[32];
+        if (row >= VM_PROFILE_OPCODE_ROWS) {
+            vm_profile_instruction_name(VM_OPR, row - VM_PROFILE_OPCODE_ROWS, name, sizeof(name));
+        } else {
+            vm_profile_instruction_name((uint8_t)row, 0, name, sizeof(name));
+        }
+        fprintf(file, "  %-24s %12llu %6.2f%%\n", name, (unsigned long long)rows[i].self,
+                vm_profile_percent(rows[i].self, total));
+    }
+
+    // Methods: self counts from the instructions in each, inclusive counts
+    // from the call hooks
+    memset(rows, 0, method_slots * sizeof(vm_profile_row_t));
+    for (size_t i = 0; i < method_slots; i++) {
+        rows[i].index = i;
+        rows[i].total = i < profile->method_capacity ? profile->inclusive[i] : 0;
+    }
+    for (size_t pc = 0; pc < instruction_count && pc < profile->map_instructions; pc++) {
+        rows[vm_profile_slot(profile->method_map[pc])].self += profile->counts[pc];
+    }
+    qsort(rows, method_slots, sizeof(vm_profile_row_t), vm_profile_compare_rows);
+
+    fprintf(file, "\nMethods:\n  %-24s %12s %7s %12s %7s %8s\n", "", "self", "", "total", "", "calls");
+    for (size_t i = 0; i < method_slots; i++) {
+        size_t slot = rows[i].index;
+        uint64_t calls = slot < profile->method_capacity ? profile->calls[slot] : 0;
+        if (rows[i].self == 0 && rows[i].total == 0 && calls == 0) {
+            continue;
+        }
+        char name[2 * 32 + 16];
+        vm_profile_method_name(vm, classes, slot == 0 ? VM_PROFILE_NO_METHOD : (uint32_t)(slot - 1), name, sizeof(name));
+        fprintf(file, "  %-24s %12llu %6.2f%% %12llu %6.2f%% %8llu\n", name,
+                (unsigned long long)rows[i].self, vm_profile_percent(rows[i].self, total),
+                (unsigned long long)rows[i].total, vm_profile_percent(rows[i].total, total),
+                (unsigned long long)calls);
+    }
+    fprintf(file, "\n");
+
+    free(rows);
+    free(classes);
+}
@@ -0,0 +1,120 @@
+/*
+ * ARX Virtual Machine Profiler
+ * Instruction counts, method costs and sampled call stacks
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "vm.h"
+
+// Instructions between two samples unless vm_profile_enable() is told otherwise
+#define VM_PROFILE_DEFAULT_INTERVAL 1000
+
+// Frames kept per sample; deeper recursion keeps the innermost ones
+#define VM_PROFILE_MAX_DEPTH 128
+
+// Method index for code outside every method (module start-up code)
+#define VM_PROFILE_NO_METHOD UINT32_MAX
+
+// One activation on the profiler's shadow of the call stack. Its method is
+// only known once it calls out (from the call site) or returns (from the
+// RET), because entries such as the runtime's call of App.Main need not
+// land on a method's first instruction.
+typedef struct {
+    uint64_t entered;              // instruction_count_executed at the call
+    uint32_t method;               // Method index, VM_PROFILE_NO_METHOD until known
+} vm_profile_frame_t;
+
+// Distinct sampled stack: depth pcs in stack_words, innermost first
+typedef struct {
+    size_t offset;                 // First pc in stack_words
+    size_t depth;                  // Number of pcs
+    uint64_t hash;
+    uint64_t samples;              // Times this stack was sampled
+} vm_profile_stack_t;
+
+struct vm_profile {
+    // Executions of each instruction; the engines add to these directly
+    uint64_t *counts;
+    size_t count_capacity;
+    size_t program_instructions;   // The program's own code; linked modules follow it
+
+    // Every `interval` instructions the pc and the call sites on the frame
+    // stack are recorded
+    uint64_t interval;
+    uint64_t countdown;            // Instructions until the next sample
+
+    // Method of each instruction, rebuilt when a module is linked
+    uint32_t *method_map;
+    size_t map_instructions;       // Instructions covered by method_map
+    size_t map_methods;            // class_system.method_count it was built for
+
+    // Per method, indexed like class_system.methods; the last slot is code
+    // outside every method
+    uint64_t *inclusive;           // Instructions run while the method was active (outermost activation)
+    uint64_t *calls;               // Completed activations
+    uint32_t *active;              // Activations of known method on the shadow stack
+    size_t method_capacity;
+
+    vm_profile_frame_t *frames;    // Shadow call stack
+    size_t depth;
+    size_t frame_capacity;
+    size_t untracked;              // Activations entered while frames could not grow
+
+    // Samples, aggregated by stack
+    uint64_t *stack_words;
+    size_t stack_word_count;
+    size_t stack_word_capacity;
+    vm_profile_stack_t *stacks;
+    size_t stack_count;
+    size_t stack_capacity;
+    uint32_t *stack_index;         // Open-addressed: stack index + 1 (0 = empty)
+    size_t stack_index_mask;
+    uint64_t samples;              // Samples taken
+    uint64_t samples_dropped;      // Samples lost to allocation failures
+};
+
+// Source line of an instruction of the program (not of linked modules)
+typedef bool (*vm_profile_line_fn)(void *data, size_t pc, uint32_t *line);
+
+// Start profiling. Must precede vm_load_program() (or vm_load_image()), as
+// the threaded engine's handlers are chosen when code is decoded; also
+// turns off superinstructions so every instruction is counted at its own
+// pc. A sample_interval of 0 uses VM_PROFILE_DEFAULT_INTERVAL.
+bool vm_profile_enable(arx_vm_context_t *vm, uint64_t sample_interval);
+void vm_profile_free(arx_vm_context_t *vm);
+
+// Hooks used by the VM itself
+bool vm_profile_reserve(arx_vm_context_t *vm, size_t instruction_count, bool program);
+void vm_profile_sample(arx_vm_context_t *vm, size_t pc);
+void vm_profile_enter(arx_vm_context_t *vm, uint64_t return_pc);
+void vm_profile_return(arx_vm_context_t *vm);
+
+// Count one execution of the instruction at pc; both engines call this
+// before running an instruction
+static inline void vm_profile_count(arx_vm_context_t *vm, vm_profile_t *profile, size_t pc)
+{
+    profile->counts[pc]++;
+    if (--profile->countdown == 0) {
+        vm_profile_sample(vm, pc);
+    }
+}
+
+// Close the activations still open when the run ended (halt or error), so
+// their methods get their inclusive counts. Call once the run is over.
+void vm_profile_finish(arx_vm_context_t *vm);
+
+// Sampled stacks in the collapsed format flame graph tools read: one line
+// per distinct stack, frames from the outermost, separated by ';', then the
+// number of samples. Callers are named Class.method; the innermost frame
+// also carries the source line where line_of knows it.
+bool vm_profile_write_stacks(arx_vm_context_t *vm, FILE *file, vm_profile_line_fn line_of, void *data);
+
+// Name of an instruction as the reports show it: "LOD", "OPR ADD"
+void vm_profile_instruction_name(uint8_t opcode, uint64_t operand, char *name, size_t size);
+
+// Per-opcode and per-method instruction counts
+void vm_profile_report(arx_vm_context_t *vm, FILE *file);
@@ -0,0 +1,126 @@
+/*
+ * ARX Virtual Machine Memory Segments Implementation
+ * Address space reserved up front and made usable piece by piece
+ */
+
+// mmap()'s MAP_ANONYMOUS is not part of C99 or POSIX.1-2008
+#define _DEFAULT_SOURCE
+#include "segment.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if VM_SEGMENT_MMAP
+#include <sys/mman.h>
+#include <unistd.h>
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+#endif
+
+size_t vm_segment_page_size(void)
+{
+#if VM_SEGMENT_MMAP
+    static size_t page;
+    if (page == 0) {
+        long size = sysconf(_SC_PAGESIZE);
+        page = size > 0 ? (size_t)size : 4096;
+    }
+    return page;
+#else
+    return 4096;
+#endif
+}
+
+bool vm_segment_reserve(vm_segment_t *segment, size_t bytes, size_t committed)
+{
+    if (segment == NULL || committed > bytes) {
+        return false;
+    }
+    memset(segment, 0, sizeof(vm_segment_t));
+
+    size_t page = vm_segment_page_size();
+    if (bytes > SIZE_MAX - 2 * page) {
+        return false;
+    }
+    bytes = (bytes + page - 1) / page * page;
+
+#if VM_SEGMENT_MMAP
+    // One more page stays inaccessible behind the reservation
+    void *base = mmap(NULL, bytes + page, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base != MAP_FAILED) {
+        segment->base = base;
+        segment->reserved = bytes;
+        segment->mapped = true;
+        if (!vm_segment_commit(segment, committed)) {
+            vm_segment_release(segment);
+            return false;
+        }
+        return true;
+    }
+#endif
+
+    // Without mmap() (or when the system refuses the reservation) the whole
+    // range is allocated now; commits have nothing left to do
+    segment->base = calloc(bytes > 0 ? bytes : 1, 1);
+    if (segment->base == NULL) {
+        return false;
+    }
+    segment->reserved = bytes;
+    segment->committed = bytes;
+    return true;
+}
+
+bool vm_segment_commit_range(vm_segment_t *segment, size_t offset, size_t bytes)
+{
+    if (segment == NULL || segment->base == NULL ||
+        offset > segment->reserved || bytes > segment->reserved - offset) {
+        return false;
+    }
+    if (bytes == 0) {
+        return true;
+    }
+
+    size_t end = offset + bytes;
+    if (segment->mapped) {
+#if VM_SEGMENT_MMAP
+        size_t page = vm_segment_page_size();
+        size_t first = offset / page * page;
+        size_t last = (end + page - 1) / page * page;
+        if (mprotect(segment->base + first, last - first, PROT_READ | PROT_WRITE) != 0) {
+            return false;
+        }
+        end = last;
+#endif
+    }
+    if (end > segment->committed) {
+        segment->committed = end;
+    }
+    return true;
+}
+
+bool vm_segment_commit(vm_segment_t *segment, size_t bytes)
+{
+    if (segment == NULL || segment->base == NULL) {
+        return false;
+    }
+    if (bytes <= segment->committed) {
+        return true;
+    }
+    return vm_segment_commit_range(segment, segment->committed, bytes - segment->committed);
+}
+
+void vm_segment_release(vm_segment_t *segment)
+{
+    if (segment == NULL || segment->base == NULL) {
+        return;
+    }
+#if VM_SEGMENT_MMAP
+    if (segment->mapped) {
+        munmap(segment->base, segment->reserved + vm_segment_page_size());
+        memset(segment, 0, sizeof(vm_segment_t));
+        return;
+    }
+#endif
+    free(segment->base);
+    memset(segment, 0, sizeof(vm_segment_t));
+}
@@ -0,0 +1,45 @@
+/*
+ * ARX Virtual Machine Memory Segments
+ * Address space reserved up front and made usable piece by piece
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Build with -DVM_SEGMENT_MMAP=0 to allocate every segment in full with
+// calloc(). Otherwise segments are reserved with mmap() where the system has
+// it: reserved pages cost no memory, and the pages that are never committed,
+// including one past the end, fault when touched.
+#ifndef VM_SEGMENT_MMAP
+#if defined(__unix__) || defined(__APPLE__)
+#define VM_SEGMENT_MMAP 1
+#else
+#define VM_SEGMENT_MMAP 0
+#endif
+#endif
+
+typedef struct {
+    uint8_t *base;                 // First byte of the reservation (NULL = none)
+    size_t reserved;               // Bytes reserved
+    size_t committed;              // End of the highest committed range
+    bool mapped;                   // Reserved with mmap() (else allocated with calloc())
+} vm_segment_t;
+
+// Reserve bytes of address space and commit the first `committed` of them.
+// Fresh pages read as zero.
+bool vm_segment_reserve(vm_segment_t *segment, size_t bytes, size_t committed);
+
+// Make the reservation usable up to byte `bytes`; false past its end
+bool vm_segment_commit(vm_segment_t *segment, size_t bytes);
+
+// Make bytes offset..offset+bytes usable, leaving the pages before them
+// uncommitted as guards
+bool vm_segment_commit_range(vm_segment_t *segment, size_t offset, size_t bytes);
+
+// Give the whole reservation back
+void vm_segment_release(vm_segment_t *segment);
+
+// Granularity of commits and guards in bytes
+size_t vm_segment_page_size(void);
@@ -0,0 +1,321 @@
+/*
+ * ARX Virtual Machine Tasks Implementation
+ * Cooperative green threads sharing one VM's code, classes and heap
+ */
+
+#include "task.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Start the running task's turn of vm->task_slice instructions
+static void vm_task_start_turn(arx_vm_context_t *vm)
+{
+    size_t executed = vm->instruction_count_executed;
+    uint64_t slice = vm->task_slice > 0 ? vm->task_slice : VM_TASK_DEFAULT_SLICE;
+    vm->tasks->slice_end = slice < SIZE_MAX - executed ? executed + (size_t)slice : SIZE_MAX;
+}
+
+// A free slot, or a new one at the end of the table
+static bool vm_task_alloc(vm_tasks_t *tasks, uint32_t *index)
+{
+    if (tasks->free_head != VM_TASK_NONE) {
+        *index = tasks->free_head - 1;
+        tasks->free_head = tasks->tasks[*index].next;
+        return true;
+    }
+    if (tasks->count >= VM_TASK_SLOT_MASK - 1) {
+        return false;
+    }
+    if (tasks->count == tasks->capacity) {
+        size_t capacity = tasks->capacity > 0 ? tasks->capacity * 2 : 16;
+        vm_task_t *grown = realloc(tasks->tasks, capacity * sizeof(vm_task_t));
+        if (grown == NULL) {
+            return false;
+        }
+        tasks->tasks = grown;
+        tasks->capacity = capacity;
+    }
+    *index = (uint32_t)tasks->count;
+    memset(&tasks->tasks[*index], 0, sizeof(vm_task_t));
+    tasks->count++;
+    return true;
+}
+
+// Put a joined task's slot on the free list; its handle goes stale
+static void vm_task_release(vm_tasks_t *tasks, uint32_t index)
+{
+    vm_task_t *task = &tasks->tasks[index];
+    free(task->stack);
+    vm_call_stack_free(&task->call_stack);
+    task->stack = NULL;
+    task->stack_top = 0;
+    task->stack_capacity = 0;
+    task->state = VM_TASK_FREE;
+    task->generation++;
+    task->next = tasks->free_head;
+    tasks->free_head = index + 1;
+}
+
+static void vm_task_enqueue(vm_tasks_t *tasks, uint32_t index)
+{
+    vm_task_t *task = &tasks->tasks[index];
+    task->state = VM_TASK_READY;
+    task->next = VM_TASK_NONE;
+    if (tasks->ready_tail != VM_TASK_NONE) {
+        tasks->tasks[tasks->ready_tail - 1].next = index + 1;
+    } else {
+        tasks->ready_head = index + 1;
+    }
+    tasks->ready_tail = index + 1;
+}
+
+// Copy the VM's data stack into the running task and take over its frame
+// stack. One word is kept spare for the result a join pushes.
+static bool vm_task_save(arx_vm_context_t *vm, vm_task_t *task)
+{
+    if (vm->stack_top + 1 > task->stack_capacity) {
+        uint64_t *stack = realloc(task->stack, (vm->stack_top + 1) * sizeof(uint64_t));
+        if (stack == NULL) {
+            vm->last_error = VM_ERROR_OUT_OF_MEMORY;
+            return false;
+        }
+        task->stack = stack;
+        task->stack_capacity = vm->stack_top + 1;
+    }
+    memcpy(task->stack, vm->stack, vm->stack_top * sizeof(uint64_t));
+    task->stack_top = vm->stack_top;
+    task->call_stack = vm->call_stack;
+    task->pc = vm->pc;
+    return true;
+}
+
+// Run the task at the head of the ready queue; the one running so far has
+// been saved or has finished
+static void vm_task_switch(arx_vm_context_t *vm)
+{
+    vm_tasks_t *tasks = vm->tasks;
+    uint32_t index = tasks->ready_head - 1;
+    vm_task_t *task = &tasks->tasks[index];
+
+    tasks->ready_head = task->next;
+    if (tasks->ready_head == VM_TASK_NONE) {
+        tasks->ready_tail = VM_TASK_NONE;
+    }
+    task->next = VM_TASK_NONE;
+    task->state = VM_TASK_RUNNING;
+    tasks->current = index;
+
+    memcpy(vm->stack, task->stack, task->stack_top * sizeof(uint64_t));
+    vm->stack_top = task->stack_top;
+    vm->call_stack = task->call_stack;
+    memset(&task->call_stack.segment, 0, sizeof(vm_segment_t));
+    task->call_stack.frames = NULL;
+    vm->locals = vm->call_stack.frame_base == VM_FRAME_GLOBAL ? vm->memory :
+                 &vm->call_stack.frames[vm->call_stack.frame_base + VM_FRAME_HEADER_SIZE];
+    vm->pc = task->pc;
+
+    tasks->switches++;
+    vm_task_start_turn(vm);
+}
+
+// Handle of a task that has not been joined yet, and its slot
+static vm_task_t *vm_task_find(vm_tasks_t *tasks, uint64_t handle, uint32_t *index)
+{
+    uint64_t slot = handle & VM_TASK_SLOT_MASK;
+    if (tasks == NULL || slot == 0 || slot > tasks->count) {
+        return NULL;
+    }
+    vm_task_t *task = &tasks->tasks[slot - 1];
+    if (task->state == VM_TASK_FREE || task->generation != (uint32_t)(handle >> VM_TASK_SLOT_BITS)) {
+        return NULL;
+    }
+    *index = (uint32_t)(slot - 1);
+    return task;
+}
+
+bool vm_task_spawn(arx_vm_context_t *vm, uint64_t object_address, size_t pc, uint64_t *handle)
+{
+    vm_tasks_t *tasks = vm->tasks;
+    uint32_t index;
+
+    if (tasks == NULL) {
+        tasks = calloc(1, sizeof(vm_tasks_t));
+        if (tasks == NULL || !vm_task_alloc(tasks, &index)) {
+            free(tasks);
+            vm->last_error = VM_ERROR_OUT_OF_MEMORY;
+            return false;
+        }
+        tasks->tasks[index].state = VM_TASK_RUNNING;
+        tasks->current = index;
+        tasks->live = 1;
+        vm->tasks = tasks;
+        vm_task_start_turn(vm);
+    }
+
+    // A frame stack outside every call, reserved as vm_init() reserves the
+    // first one
+    vm_call_stack_t call_stack;
+    call_stack.max_depth = vm->call_stack.max_depth;
+    if (!vm_call_stack_init(vm, &call_stack)) {
+        vm->last_error = VM_ERROR_OUT_OF_MEMORY;
+        return false;
+    }
+    uint64_t *stack = malloc(2 * sizeof(uint64_t));
+    if (stack == NULL || !vm_task_alloc(tasks, &index)) {
+        vm_call_stack_free(&call_stack);
+        free(stack);
+        vm->last_error = VM_ERROR_OUT_OF_MEMORY;
+        return false;
+    }
+
+    vm_task_t *task = &tasks->tasks[index];
+    task->joiners = VM_TASK_NONE;
+    task->stack = stack;
+    task->stack[0] = object_address;
+    task->stack_top = 1;
+    task->stack_capacity = 2;
+    task->call_stack = call_stack;
+    task->pc = pc;
+    task->result = 0;
+    vm_task_enqueue(tasks, index);
+
+    tasks->live++;
+    tasks->spawned++;
+    *handle = (uint64_t)task->generation << VM_TASK_SLOT_BITS | (uint64_t)(index + 1);
+    return true;
+}
+
+bool vm_task_yield(arx_vm_context_t *vm)
+{
+    vm_tasks_t *tasks = vm->tasks;
+    if (tasks == NULL) {
+        return true;
+    }
+    if (tasks->ready_head == VM_TASK_NONE) {
+        vm_task_start_turn(vm);
+        return true;
+    }
+    if (!vm_task_save(vm, &tasks->tasks[tasks->current])) {
+        return false;
+    }
+    vm_task_enqueue(tasks, tasks->current);
+    vm_task_switch(vm);
+    return true;
+}
+
+bool vm_task_switch_point(const arx_vm_context_t *vm, size_t from)
+{
+    if (from >= vm->instruction_count) {
+        return false;
+    }
+    switch (vm->code[from].opcode) {
+        case VM_CAL:
+        case VM_CALS:
+            return true;
+        case VM_JMP:
+        case VM_JPC:
+            return vm->pc <= from;
+        default:
+            return false;
+    }
+}
+
+bool vm_task_join(arx_vm_context_t *vm, uint64_t handle)
+{
+    vm_tasks_t *tasks = vm->tasks;
+    uint32_t index;
+    vm_task_t *task = vm_task_find(tasks, handle, &index);
+    if (task == NULL || index == tasks->current) {
+        vm->last_error = VM_ERROR_INVALID_TASK;
+        return false;
+    }
+
+    if (task->state == VM_TASK_DONE) {
+        uint64_t result = task->result;
+        vm_task_release(tasks, index);
+        return vm_push(vm, result);
+    }
+
+    // The task is ready or waits itself; with nothing ready, every task left
+    // waits for another
+    if (tasks->ready_head == VM_TASK_NONE) {
+        vm->last_error = VM_ERROR_DEADLOCK;
+        return false;
+    }
+    if (!vm_stack_grow(vm, vm->stack_top + 1)) {
+        return false;
+    }
+
+    // Wait on the task's list; vm_task_exit() pushes the result
+    vm_task_t *current = &tasks->tasks[tasks->current];
+    if (!vm_task_save(vm, current)) {
+        return false;
+    }
+    current->state = VM_TASK_JOINING;
+    current->next = task->joiners;
+    task->joiners = tasks->current + 1;
+    vm_task_switch(vm);
+    return true;
+}
+
+bool vm_task_exit(arx_vm_context_t *vm)
+{
+    vm_tasks_t *tasks = vm->tasks;
+    uint32_t index = tasks->current;
+    vm_task_t *task = &tasks->tasks[index];
+
+    task->result = vm->stack_top > 0 ? vm->stack[vm->stack_top - 1] : 0;
+    task->state = VM_TASK_DONE;
+    free(task->stack);
+    task->stack = NULL;
+    task->stack_top = 0;
+    task->stack_capacity = 0;
+    tasks->live--;
+
+    // Every task waiting in a join gets the result and is ready again
+    uint32_t waiter = task->joiners;
+    bool joined = waiter != VM_TASK_NONE;
+    while (waiter != VM_TASK_NONE) {
+        vm_task_t *joiner = &tasks->tasks[waiter - 1];
+        uint32_t next = joiner->next;
+        joiner->stack[joiner->stack_top++] = task->result;
+        vm_task_enqueue(tasks, waiter - 1);
+        waiter = next;
+    }
+    task->joiners = VM_TASK_NONE;
+
+    if (tasks->ready_head == VM_TASK_NONE) {
+        if (tasks->live > 0) {
+            vm->last_error = VM_ERROR_DEADLOCK;
+            return false;
+        }
+        // The last task ends the program, which keeps its stacks
+        vm_halt(vm);
+        return true;
+    }
+
+    // Its frame stack goes with it; the next task brings its own
+    vm_call_stack_free(&vm->call_stack);
+    if (joined) {
+        vm_task_release(tasks, index);
+    }
+    vm_task_switch(vm);
+    return true;
+}
+
+void vm_task_free(arx_vm_context_t *vm)
+{
+    if (vm == NULL || vm->tasks == NULL) {
+        return;
+    }
+
+    // The running task's frame stack is the VM's, freed by vm_cleanup()
+    vm_tasks_t *tasks = vm->tasks;
+    for (size_t i = 0; i < tasks->count; i++) {
+        free(tasks->tasks[i].stack);
+        vm_call_stack_free(&tasks->tasks[i].call_stack);
+    }
+    free(tasks->tasks);
+    free(tasks);
+    vm->tasks = NULL;
+}
@@ -0,0 +1,86 @@
+/*
+ * ARX Virtual Machine Tasks
+ * Cooperative green threads sharing one VM's code, classes and heap
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "vm.h"
+
+// Instructions a task runs before a budget check hands the VM to the next
+// ready task, unless vm->task_slice says otherwise
+#define VM_TASK_DEFAULT_SLICE 10000
+
+// Task handles work like object IDs: the low 32 bits are the slot + 1 and
+// the high 32 bits the slot's generation, so a handle of a joined task
+// never names the slot's next one
+#define VM_TASK_SLOT_BITS 32
+#define VM_TASK_SLOT_MASK 0xffffffffull
+
+// Slot index + 1 in queue links (0 = none)
+#define VM_TASK_NONE 0
+
+typedef enum {
+    VM_TASK_FREE = 0,              // On the free list
+    VM_TASK_READY,                 // Waits in the ready queue
+    VM_TASK_RUNNING,               // Its stacks are the VM's
+    VM_TASK_JOINING,               // Waits for another task to finish
+    VM_TASK_DONE                   // Finished; result kept until it is joined
+} vm_task_state_t;
+
+// One thread of execution. While it does not run, its data stack and frame
+// stack are kept here; the running task's are the VM's own.
+typedef struct {
+    vm_task_state_t state;
+    uint32_t generation;           // High half of its handle
+    uint32_t next;                 // Next task in the ready queue, in a join wait list or on the free list
+    uint32_t joiners;              // First task waiting to join this one
+    uint64_t *stack;               // Saved data stack
+    size_t stack_top;              // Words in stack
+    size_t stack_capacity;         // Words allocated
+    vm_call_stack_t call_stack;    // Saved frame stack (frames owned by the task)
+    size_t pc;                     // Where it resumes
+    uint64_t result;               // Value left by its outermost method (VM_TASK_DONE)
+} vm_task_t;
+
+struct vm_tasks {
+    vm_task_t *tasks;              // Slot table; slot 0 is the code that spawned the first task
+    size_t count;                  // Slots in use or on the free list
+    size_t capacity;               // Slots allocated
+    uint32_t current;              // Running task (slot index)
+    uint32_t ready_head;           // Ready queue, first to run
+    uint32_t ready_tail;           // Ready queue, last to run
+    uint32_t free_head;            // Free slots
+    size_t live;                   // Tasks not finished, the running one included
+    size_t slice_end;              // instruction_count_executed value that ends the current turn
+
+    // Totals for the statistics
+    uint64_t spawned;              // Tasks started
+    uint64_t switches;             // Changes of the running task
+};
+
+// Operations behind OPR_TASK_*. Each leaves the VM running whichever task
+// is to go on, with pc where it resumes; the caller sets pc past the
+// operation first. The first spawn turns the code running so far into
+// task 0. A spawned task starts with object_address on its data stack and
+// an empty frame stack. A yield with no other task ready just starts a new
+// turn; budget checks yield at the first switch point once slice_end is
+// reached.
+bool vm_task_spawn(arx_vm_context_t *vm, uint64_t object_address, size_t pc, uint64_t *handle);
+bool vm_task_yield(arx_vm_context_t *vm);
+
+// Whether a turn may end between instruction from, just run, and vm->pc:
+// after a call or a backward jump, where a statement starts. A turn never
+// ends inside a statement, such as between the two halves of a writeln,
+// and every engine ends it at the same instruction.
+bool vm_task_switch_point(const arx_vm_context_t *vm, size_t from);
+bool vm_task_join(arx_vm_context_t *vm, uint64_t handle);
+
+// The running task returned from its outermost method, leaving its result
+// on top of the data stack. Another task takes over; the VM halts once no
+// task is left.
+bool vm_task_exit(arx_vm_context_t *vm);
+
+void vm_task_free(arx_vm_context_t *vm);
@@ -0,0 +1,464 @@
+/*
+ * ARX Virtual Machine String Kernels Implementation
+ * Comparison, search, slicing and parsing on the bytes of string objects
+ */
+
+#include "text.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if VM_STRING_SIMD && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define VM_TEXT_X86 1
+#include <immintrin.h>
+#elif VM_STRING_SIMD && defined(__aarch64__) && defined(__ARM_NEON)
+#define VM_TEXT_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define VM_TEXT_LITTLE_ENDIAN 1
+#endif
+
+#define VM_TEXT_ONES 0x0101010101010101ull
+#define VM_TEXT_HIGHS 0x8080808080808080ull
+
+static uint64_t vm_text_word(const char *bytes)
+{
+    uint64_t word;
+    memcpy(&word, bytes, sizeof(word));
+    return word;
+}
+
+// Word-at-a-time kernels, the fallback for every machine. On little-endian
+// machines the first byte is the lowest of a loaded word, so the first
+// differing or matching byte is found from the trailing zero bits.
+
+static size_t vm_text_mismatch_words(const char *a, const char *b, size_t length)
+{
+    size_t i = 0;
+#if VM_TEXT_LITTLE_ENDIAN
+    for (; i + 8 <= length; i += 8) {
+        uint64_t difference = vm_text_word(a + i) ^ vm_text_word(b + i);
+        if (difference != 0) {
+            return i + (size_t)__builtin_ctzll(difference) / 8;
+        }
+    }
+#endif
+    for (; i < length; i++) {
+        if (a[i] != b[i]) {
+            return i;
+        }
+    }
+    return length;
+}
+
+// Whether needle (needle_length >= 1) is at text; the first byte is
+// checked last, as the callers have found it already
+static bool vm_text_match_at(const char *text, const char *needle, size_t needle_length)
+{
+    return text[needle_length - 1] == needle[needle_length - 1] &&
+           vm_text_mismatch(text, needle, needle_length - 1) == needle_length - 1;
+}
+
+// Candidates are the offsets holding the needle's first byte, eight at a
+// time: a zero byte in text ^ first. Bits above a true zero byte can be
+// false positives, which the match check rejects.
+static size_t vm_text_find_words(const char *text, size_t text_length, const char *needle, size_t needle_length)
+{
+    if (needle_length > text_length) {
+        return SIZE_MAX;
+    }
+    size_t last = text_length - needle_length;
+    size_t i = 0;
+#if VM_TEXT_LITTLE_ENDIAN
+    uint64_t first = VM_TEXT_ONES * (uint8_t)needle[0];
+    for (; i + 8 <= last + 1; i += 8) {
+        uint64_t word = vm_text_word(text + i) ^ first;
+        uint64_t zeros = (word - VM_TEXT_ONES) & ~word & VM_TEXT_HIGHS;
+        while (zeros != 0) {
+            size_t at = i + (size_t)__builtin_ctzll(zeros) / 8;
+            if (vm_text_match_at(text + at, needle, needle_length)) {
+                return at;
+            }
+            zeros &= zeros - 1;
+        }
+    }
+#endif
+    for (; i <= last; i++) {
+        if (text[i] == needle[0] && vm_text_match_at(text + i, needle, needle_length)) {
+            return i;
+        }
+    }
+    return SIZE_MAX;
+}
+
+#if VM_TEXT_X86
+
+static bool vm_text_avx2(void)
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+static size_t vm_text_mismatch_sse2(const char *a, const char *b, size_t length)
+{
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i equal = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i)),
+                                       _mm_loadu_si128((const __m128i *)(b + i)));
+        unsigned mask = (unsigned)_mm_movemask_epi8(equal) ^ 0xffffu;
+        if (mask != 0) {
+            return i + (size_t)__builtin_ctz(mask);
+        }
+    }
+    return i + vm_text_mismatch_words(a + i, b + i, length - i);
+}
+
+// The needle's first and last bytes are compared at 16 offsets at once;
+// offsets where both match are checked in full
+static size_t vm_text_find_sse2(const char *text, size_t text_length, const char *needle, size_t needle_length)
+{
+    __m128i first = _mm_set1_epi8(needle[0]);
+    __m128i last = _mm_set1_epi8(needle[needle_length - 1]);
+    size_t i = 0;
+    for (; i + needle_length - 1 + 16 <= text_length; i += 16) {
+        __m128i at_first = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(text + i)), first);
+        __m128i at_last = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(text + i + needle_length - 1)), last);
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(at_first, at_last));
+        while (mask != 0) {
+            size_t at = i + (size_t)__builtin_ctz(mask);
+            if (vm_text_mismatch(text + at + 1, needle + 1, needle_length - 1) == needle_length - 1) {
+                return at;
+            }
+            mask &= mask - 1;
+        }
+    }
+    size_t rest = vm_text_find_words(text + i, text_length - i, needle, needle_length);
+    return rest == SIZE_MAX ? SIZE_MAX : i + rest;
+}
+
+__attribute__((target("avx2")))
+static size_t vm_text_mismatch_avx2(const char *a, const char *b, size_t length)
+{
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i equal = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a + i)),
+                                          _mm256_loadu_si256((const __m256i *)(b + i)));
+        unsigned mask = ~(unsigned)_mm256_movemask_epi8(equal);
+        if (mask != 0) {
+            return i + (size_t)__builtin_ctz(mask);
+        }
+    }
+    return i + vm_text_mismatch_sse2(a + i, b + i, length - i);
+}
+
+__attribute__((target("avx2")))
+static size_t vm_text_find_avx2(const char *text, size_t text_length, const char *needle, size_t needle_length)
+{
+    __m256i first = _mm256_set1_epi8(needle[0]);
+    __m256i last = _mm256_set1_epi8(needle[needle_length - 1]);
+    size_t i = 0;
+    for (; i + needle_length - 1 + 32 <= text_length; i += 32) {
+        __m256i at_first = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(text + i)), first);
+        __m256i at_last = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(text + i + needle_length - 1)), last);
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(at_first, at_last));
+        while (mask != 0) {
+            size_t at = i + (size_t)__builtin_ctz(mask);
+            if (vm_text_mismatch(text + at + 1, needle + 1, needle_length - 1) == needle_length - 1) {
+                return at;
+            }
+            mask &= mask - 1;
+        }
+    }
+    size_t rest = vm_text_find_sse2(text + i, text_length - i, needle, needle_length);
+    return rest == SIZE_MAX ? SIZE_MAX : i + rest;
+}
+
+#elif VM_TEXT_NEON
+
+static size_t vm_text_mismatch_neon(const char *a, const char *b, size_t length)
+{
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        uint8x16_t equal = vceqq_u8(vld1q_u8((const uint8_t *)(a + i)), vld1q_u8((const uint8_t *)(b + i)));
+        if (vminvq_u8(equal) != 0xff) {
+            break;
+        }
+    }
+    return i + vm_text_mismatch_words(a + i, b + i, length - i);
+}
+
+static size_t vm_text_find_neon(const char *text, size_t text_length, const char *needle, size_t needle_length)
+{
+    uint8x16_t first = vdupq_n_u8((uint8_t)needle[0]);
+    uint8x16_t last = vdupq_n_u8((uint8_t)needle[needle_length - 1]);
+    size_t i = 0;
+    for (; i + needle_length - 1 + 16 <= text_length; i += 16) {
+        uint8x16_t at_first = vceqq_u8(vld1q_u8((const uint8_t *)(text + i)), first);
+        uint8x16_t at_last = vceqq_u8(vld1q_u8((const uint8_t *)(text + i + needle_length - 1)), last);
+        if (vmaxvq_u8(vandq_u8(at_first, at_last)) == 0) {
+            continue;
+        }
+        for (size_t at = i; at < i + 16; at++) {
+            if (text[at] == needle[0] && vm_text_match_at(text + at, needle, needle_length)) {
+                return at;
+            }
+        }
+    }
+    size_t rest = vm_text_find_words(text + i, text_length - i, needle, needle_length);
+    return rest == SIZE_MAX ? SIZE_MAX : i + rest;
+}
+
+#endif
+
+const char *vm_text_kernels(void)
+{
+#if VM_TEXT_X86
+    return vm_text_avx2() ? "avx2" : "sse2";
+#elif VM_TEXT_NEON
+    return "neon";
+#else
+    return "words";
+#endif
+}
+
+size_t vm_text_mismatch(const char *a, const char *b, size_t length)
+{
+#if VM_TEXT_X86
+    return vm_text_avx2() ? vm_text_mismatch_avx2(a, b, length) : vm_text_mismatch_sse2(a, b, length);
+#elif VM_TEXT_NEON
+    return vm_text_mismatch_neon(a, b, length);
+#else
+    return vm_text_mismatch_words(a, b, length);
+#endif
+}
+
+size_t vm_text_find(const char *text, size_t text_length, const char *needle, size_t needle_length)
+{
+    if (needle_length == 0) {
+        return 0;
+    }
+    if (needle_length > text_length) {
+        return SIZE_MAX;
+    }
+#if VM_TEXT_X86
+    return vm_text_avx2() ? vm_text_find_avx2(text, text_length, needle, needle_length) :
+                            vm_text_find_sse2(text, text_length, needle, needle_length);
+#elif VM_TEXT_NEON
+    return vm_text_find_neon(text, text_length, needle, needle_length);
+#else
+    return vm_text_find_words(text, text_length, needle, needle_length);
+#endif
+}
+
+int vm_text_compare(const char *a, size_t a_length, const char *b, size_t b_length)
+{
+    size_t common = a_length < b_length ? a_length : b_length;
+    size_t at = vm_text_mismatch(a, b, common);
+    if (at < common) {
+        return (uint8_t)a[at] < (uint8_t)b[at] ? -1 : 1;
+    }
+    return a_length < b_length ? -1 : a_length > b_length ? 1 : 0;
+}
+
+// Whether all eight bytes of word are ASCII digits
+static bool vm_text_eight_digits(uint64_t word)
+{
+    return ((word & 0xf0f0f0f0f0f0f0f0ull) |
+            (((word + 0x0606060606060606ull) & 0xf0f0f0f0f0f0f0f0ull) >> 4)) == 0x3333333333333333ull;
+}
+
+// Value of eight ASCII digits loaded little-endian, pairing neighbours
+// into two, four and then eight digit numbers
+static uint64_t vm_text_eight_digits_value(uint64_t word)
+{
+    word -= 0x3030303030303030ull;
+    word = (word * 10 + (word >> 8)) & 0x00ff00ff00ff00ffull;
+    word = (word * 100 + (word >> 16)) & 0x0000ffff0000ffffull;
+    return (word * 10000 + (word >> 32)) & 0x00000000ffffffffull;
+}
+
+int64_t vm_text_to_int(const char *text, size_t length)
+{
+    size_t i = 0;
+    while (i < length && (text[i] == ' ' || (text[i] >= '\t' && text[i] <= '\r'))) {
+        i++;
+    }
+    bool negative = false;
+    if (i < length && (text[i] == '+' || text[i] == '-')) {
+        negative = text[i] == '-';
+        i++;
+    }
+
+    // Magnitudes past the limit saturate, but every digit is still read
+    uint64_t limit = negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+    uint64_t value = 0;
+    bool saturated = false;
+#if VM_TEXT_LITTLE_ENDIAN
+    for (; i + 8 <= length && vm_text_eight_digits(vm_text_word(text + i)); i += 8) {
+        uint64_t digits = vm_text_eight_digits_value(vm_text_word(text + i));
+        if (saturated || value > (limit - digits) / 100000000ull) {
+            saturated = true;
+        } else {
+            value = value * 100000000ull + digits;
+        }
+    }
+#endif
+    for (; i < length && text[i] >= '0' && text[i] <= '9'; i++) {
+        uint64_t digit = (uint64_t)(text[i] - '0');
+        if (saturated || value > (limit - digit) / 10) {
+            saturated = true;
+        } else {
+            value = value * 10 + digit;
+        }
+    }
+
+    if (saturated) {
+        value = limit;
+    }
+    return negative ? (int64_t)(0 - value) : (int64_t)value;
+}
+
+bool vm_string_slice(arx_vm_context_t *vm, uint64_t string, uint64_t from, uint64_t to, uint64_t *out_object_address)
+{
+    const char *data;
+    uint64_t length;
+    if (vm == NULL || out_object_address == NULL) {
+        return false;
+    }
+    if (!vm_string_view(vm, string, &data, &length)) {
+        vm->last_error = VM_ERROR_INVALID_OBJECT_ADDRESS;
+        return false;
+    }
+    if (from > to || to > length) {
+        vm->last_error = VM_ERROR_STRING_BOUNDS;
+        return false;
+    }
+    if (from == 0 && to == length) {
+        *out_object_address = string;
+        return true;
+    }
+
+    // A short slice is copied; data stays valid, as the allocator never
+    // moves blocks and the caller keeps string reachable
+    uint64_t slice_length = to - from;
+    if (slice_length <= VM_STRING_SLICE_COPY_BYTES) {
+        if (!vm_string_alloc(vm, slice_length, out_object_address)) {
+            return false;
+        }
+        memcpy(&vm->stack[*out_object_address + VM_STRING_HEADER_WORDS], data + from, (size_t)slice_length);
+        return true;
+    }
+
+    // A slice of a slice views the same plain string
+    uint64_t base = string;
+    uint64_t start = from;
+    if (vm->stack[string + 2] == VM_STRING_SLICE) {
+        base = vm->stack[string + 4];
+        start += vm->stack[string + 1];
+    }
+
+    uint64_t slice;
+    if (!vm_heap_alloc(vm, VM_STRING_SLICE_WORDS, &slice)) {
+        return false;
+    }
+    vm->stack[slice + 0] = slice_length;
+    vm->stack[slice + 1] = start;
+    vm->stack[slice + 2] = VM_STRING_SLICE;
+    vm->stack[slice + 4] = base;
+    *out_object_address = slice;
+    return true;
+}
+
+// View of a string operand; anything else is an invalid object
+static bool vm_text_operand(arx_vm_context_t *vm, uint64_t string, const char **data, uint64_t *length)
+{
+    if (!vm_string_view(vm, string, data, length)) {
+        vm->last_error = VM_ERROR_INVALID_OBJECT_ADDRESS;
+        return false;
+    }
+    return true;
+}
+
+bool vm_text_operation(arx_vm_context_t *vm, opr_t operation)
+{
+    const char *data;
+    const char *other;
+    uint64_t length;
+    uint64_t other_length;
+    uint64_t operands[3];
+
+    switch (operation) {
+        case OPR_STR_SLICE:
+            {
+                // The string stays on the stack while the slice is allocated
+                uint64_t slice;
+                if (!vm_peek(vm, 2, &operands[0]) || !vm_peek(vm, 1, &operands[1]) ||
+                    !vm_peek(vm, 0, &operands[2])) {
+                    vm->last_error = VM_ERROR_STACK_UNDERFLOW;
+                    return false;
+                }
+                if (!vm_string_slice(vm, operands[0], operands[1], operands[2], &slice)) {
+                    return false;
+                }
+                vm->stack_top -= 3;
+                return vm_push(vm, slice);
+            }
+
+        case OPR_STR_CMP:
+            if (!vm_pop(vm, &operands[1]) || !vm_pop(vm, &operands[0]) ||
+                !vm_text_operand(vm, operands[0], &data, &length) ||
+                !vm_text_operand(vm, operands[1], &other, &other_length)) {
+                return false;
+            }
+            return vm_push(vm, (uint64_t)(int64_t)vm_text_compare(data, (size_t)length, other, (size_t)other_length));
+
+        case OPR_STR_FIND:
+            {
+                if (!vm_pop(vm, &operands[2]) || !vm_pop(vm, &operands[1]) || !vm_pop(vm, &operands[0]) ||
+                    !vm_text_operand(vm, operands[0], &data, &length) ||
+                    !vm_text_operand(vm, operands[1], &other, &other_length)) {
+                    return false;
+                }
+                uint64_t from = operands[2];
+                if (from > length) {
+                    vm->last_error = VM_ERROR_STRING_BOUNDS;
+                    return false;
+                }
+                size_t found = vm_text_find(data + from, (size_t)(length - from), other, (size_t)other_length);
+                return vm_push(vm, found == SIZE_MAX ? (uint64_t)-1 : from + found);
+            }
+
+        case OPR_STR_AT:
+            if (!vm_pop(vm, &operands[1]) || !vm_pop(vm, &operands[0]) ||
+                !vm_text_operand(vm, operands[0], &data, &length)) {
+                return false;
+            }
+            if (operands[1] >= length) {
+                vm->last_error = VM_ERROR_STRING_BOUNDS;
+                return false;
+            }
+            return vm_push(vm, (uint8_t)data[operands[1]]);
+
+        case OPR_STR_TO_INT:
+            {
+                if (!vm_pop(vm, &operands[0])) {
+                    return false;
+                }
+                if (vm_string_view(vm, operands[0], &data, &length)) {
+                    return vm_push(vm, (uint64_t)vm_text_to_int(data, (size_t)length));
+                }
+
+                // Fallback: a string ID (legacy system)
+                const char *str;
+                if (!vm_load_string(vm, operands[0], &str)) {
+                    vm->last_error = VM_ERROR_INVALID_OBJECT_ADDRESS;
+                    return false;
+                }
+                return vm_push(vm, (uint64_t)vm_text_to_int(str, strlen(str)));
+            }
+
+        default:
+            vm->last_error = VM_ERROR_INVALID_INSTRUCTION;
+            return false;
+    }
+}
@@ -0,0 +1,44 @@
+/*
+ * ARX Virtual Machine String Kernels
+ * Comparison, search, slicing and parsing on the bytes of string objects
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "vm.h"
+
+// Build with -DVM_STRING_SIMD=0 to compare and search a word at a time
+// only. Otherwise the kernels use SSE2 or, where the CPU has it, AVX2 on
+// x86-64 and NEON on AArch64.
+#ifndef VM_STRING_SIMD
+#define VM_STRING_SIMD 1
+#endif
+
+// Slices up to this many bytes are copied: a copy is no larger than a
+// view, and it does not keep a long base string alive
+#define VM_STRING_SLICE_COPY_BYTES 7
+
+// Offset of the first byte where a and b differ; length if they do not
+size_t vm_text_mismatch(const char *a, const char *b, size_t length);
+
+// Offset of the first occurrence of needle in text; SIZE_MAX if there is none
+size_t vm_text_find(const char *text, size_t text_length, const char *needle, size_t needle_length);
+
+// -1, 0 or 1 as a sorts before, with or after b, comparing unsigned bytes
+int vm_text_compare(const char *a, size_t a_length, const char *b, size_t b_length);
+
+// Integer value of text as strtoll() reads it in base 10: leading white
+// space, a sign and the digits up to the first other byte; out of range
+// values saturate
+int64_t vm_text_to_int(const char *text, size_t length);
+
+// String object for bytes from..to (to excluded) of string
+bool vm_string_slice(arx_vm_context_t *vm, uint64_t string, uint64_t from, uint64_t to, uint64_t *out_object_address);
+
+// Run OPR_STR_SLICE, OPR_STR_CMP, OPR_STR_FIND, OPR_STR_AT or OPR_STR_TO_INT on the data stack
+bool vm_text_operation(arx_vm_context_t *vm, opr_t operation);
+
+// Kernels string operations use on this machine ("avx2", "sse2", "neon" or "words")
+const char *vm_text_kernels(void);
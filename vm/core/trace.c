@@ -0,0 +1,179 @@
+/*
+ * ARX Virtual Machine Execution Trace Implementation
+ * Fixed-size records of the last instructions run, kept in a ring
+ */
+
+#include "trace.h"
+#include "profile.h"
+#include <stdlib.h>
+#include <string.h>
+
+// File header of a saved ring
+#define VM_TRACE_MAGIC "ARXTRACE"
+#define VM_TRACE_VERSION 1
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;          // sizeof(vm_trace_record_t), to refuse files of other builds
+    uint64_t count;                // Records that follow
+    uint64_t written;              // Records the run wrote; the earlier ones were overwritten
+} vm_trace_header_t;
+
+// Largest ring: 2^26 records of 24 bytes
+#define VM_TRACE_MAX_RECORDS ((size_t)1 << 26)
+
+static bool vm_trace_allocate(vm_trace_t *trace, size_t records)
+{
+    size_t capacity = 1;
+    while (capacity < records && capacity < VM_TRACE_MAX_RECORDS) {
+        capacity <<= 1;
+    }
+    memset(trace, 0, sizeof(vm_trace_t));
+    trace->records = calloc(capacity, sizeof(vm_trace_record_t));
+    if (trace->records == NULL) {
+        return false;
+    }
+    trace->mask = capacity - 1;
+    return true;
+}
+
+bool vm_trace_enable(arx_vm_context_t *vm, size_t records)
+{
+    if (vm == NULL) {
+        return false;
+    }
+    vm_trace_free(vm);
+    vm_trace_t *trace = malloc(sizeof(vm_trace_t));
+    if (trace == NULL || !vm_trace_allocate(trace, records > 0 ? records : VM_TRACE_DEFAULT_RECORDS)) {
+        free(trace);
+        return false;
+    }
+    vm->trace = trace;
+    return true;
+}
+
+void vm_trace_release(vm_trace_t *trace)
+{
+    if (trace != NULL) {
+        free(trace->records);
+        memset(trace, 0, sizeof(vm_trace_t));
+    }
+}
+
+void vm_trace_free(arx_vm_context_t *vm)
+{
+    if (vm != NULL && vm->trace != NULL) {
+        vm_trace_release(vm->trace);
+        free(vm->trace);
+        vm->trace = NULL;
+    }
+}
+
+// Records the ring holds: all it has written until it wraps
+static uint64_t vm_trace_count(const vm_trace_t *trace)
+{
+    return trace->written < trace->mask + 1 ? trace->written : trace->mask + 1;
+}
+
+bool vm_trace_save(const vm_trace_t *trace, const char *path)
+{
+    if (trace == NULL || trace->records == NULL || path == NULL) {
+        return false;
+    }
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+
+    vm_trace_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, VM_TRACE_MAGIC, sizeof(header.magic));
+    header.version = VM_TRACE_VERSION;
+    header.record_size = sizeof(vm_trace_record_t);
+    header.count = vm_trace_count(trace);
+    header.written = trace->written;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    // Oldest first: from the write position once the ring has wrapped
+    uint64_t first = trace->written - header.count;
+    for (uint64_t i = 0; ok && i < header.count; i++) {
+        ok = fwrite(&trace->records[(first + i) & trace->mask], sizeof(vm_trace_record_t), 1, file) == 1;
+    }
+    return fclose(file) == 0 && ok;
+}
+
+bool vm_trace_load(vm_trace_t *trace, const char *path)
+{
+    if (trace == NULL || path == NULL) {
+        return false;
+    }
+    memset(trace, 0, sizeof(vm_trace_t));
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    vm_trace_header_t header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, VM_TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != VM_TRACE_VERSION || header.record_size != sizeof(vm_trace_record_t) ||
+        header.count > VM_TRACE_MAX_RECORDS || header.count > header.written) {
+        fclose(file);
+        return false;
+    }
+
+    // The records are stored oldest first, so they go back in at their
+    // positions in a ring of the same capacity
+    if (!vm_trace_allocate(trace, header.count > 0 ? (size_t)header.count : 1)) {
+        fclose(file);
+        return false;
+    }
+    trace->written = header.written;
+    uint64_t first = header.written - header.count;
+    bool ok = true;
+    for (uint64_t i = 0; ok && i < header.count; i++) {
+        ok = fread(&trace->records[(first + i) & trace->mask], sizeof(vm_trace_record_t), 1, file) == 1;
+    }
+    fclose(file);
+    if (!ok) {
+        vm_trace_release(trace);
+    }
+    return ok;
+}
+
+void vm_trace_print(const vm_trace_t *trace, FILE *file, size_t last)
+{
+    if (trace == NULL || trace->records == NULL || file == NULL) {
+        return;
+    }
+    uint64_t count = vm_trace_count(trace);
+    if (last > 0 && last < count) {
+        count = last;
+    }
+
+    fprintf(file, "\n=== Trace: last %llu of %llu instructions ===\n",
+            (unsigned long long)count, (unsigned long long)trace->written);
+    fprintf(file, "%12s %8s  %-24s %6s %6s  %s\n", "#", "PC", "Instruction", "Depth", "Frame", "TOS");
+    for (uint64_t n = trace->written - count; n < trace->written; n++) {
+        const vm_trace_record_t *record = &trace->records[n & trace->mask];
+        char name[32];
+        char instruction[48];
+        vm_profile_instruction_name(record->opcode, record->operand, name, sizeof(name));
+        if (record->opcode == VM_OPR || record->opcode == VM_HALT) {
+            snprintf(instruction, sizeof(instruction), "%s", name);
+        } else if (record->level > 0) {
+            snprintf(instruction, sizeof(instruction), "%s %u,%lu", name, (unsigned)record->level,
+                     (unsigned long)record->operand);
+        } else {
+            snprintf(instruction, sizeof(instruction), "%s %lu", name, (unsigned long)record->operand);
+        }
+        fprintf(file, "%12llu %8lu  %-24s %6lu %6u  ", (unsigned long long)n, (unsigned long)record->pc,
+                instruction, (unsigned long)record->depth, (unsigned)record->frame);
+        if (record->depth > 0) {
+            fprintf(file, "%lld\n", (long long)record->tos);
+        } else {
+            fprintf(file, "-\n");
+        }
+    }
+}
@@ -0,0 +1,66 @@
+/*
+ * ARX Virtual Machine Execution Trace
+ * Fixed-size records of the last instructions run, kept in a ring
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "vm.h"
+
+// Records kept unless vm_trace_enable() is told otherwise
+#define VM_TRACE_DEFAULT_RECORDS 4096
+
+// Records printed when a traced run fails and the ring is not saved
+#define VM_TRACE_REPORT_RECORDS 32
+
+// One instruction, with the state it found before it ran
+typedef struct {
+    uint64_t tos;                  // Top of the data stack (0 when empty)
+    uint32_t pc;
+    uint32_t depth;                // Data stack depth
+    uint32_t operand;              // Low 32 bits of the operand
+    uint16_t frame;                // Call depth (saturates at UINT16_MAX)
+    uint8_t opcode;
+    uint8_t level;
+} vm_trace_record_t;
+
+struct vm_trace {
+    vm_trace_record_t *records;
+    uint64_t mask;                 // Capacity - 1; the capacity is a power of two
+    uint64_t written;              // Records written; the newest is at (written - 1) & mask
+};
+
+// Start recording every instruction the reference engine runs. records is
+// rounded up to a power of two; 0 uses VM_TRACE_DEFAULT_RECORDS. Tracing
+// runs never use the threaded engine or the JIT.
+bool vm_trace_enable(arx_vm_context_t *vm, size_t records);
+void vm_trace_free(arx_vm_context_t *vm);
+
+// Free the records of a ring that is not a VM's, such as a loaded one
+void vm_trace_release(vm_trace_t *trace);
+
+// Record the instruction about to run at vm->pc
+static inline void vm_trace_record(vm_trace_t *trace, const arx_vm_context_t *vm, const vm_instruction_t *instr)
+{
+    vm_trace_record_t *record = &trace->records[trace->written++ & trace->mask];
+    record->tos = vm->stack_top > 0 ? vm->stack[vm->stack_top - 1] : 0;
+    record->pc = (uint32_t)vm->pc;
+    record->depth = (uint32_t)vm->stack_top;
+    record->operand = (uint32_t)instr->operand;
+    record->frame = vm->call_stack.current_frame < UINT16_MAX ? (uint16_t)vm->call_stack.current_frame : UINT16_MAX;
+    record->opcode = instr->opcode;
+    record->level = instr->level;
+}
+
+// Write the ring to path in the machine's byte order: a header, then the
+// records it holds, oldest first
+bool vm_trace_save(const vm_trace_t *trace, const char *path);
+
+// Read a ring written by vm_trace_save(); free it with vm_trace_release()
+bool vm_trace_load(vm_trace_t *trace, const char *path);
+
+// Decode the newest `last` records (0: all), oldest first, one per line
+void vm_trace_print(const vm_trace_t *trace, FILE *file, size_t last);
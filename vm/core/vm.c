@@ -3,93 +3,130 @@
  * Executes ARX bytecode instructions
  */
 
+#define _POSIX_C_SOURCE 200809L     // clock_gettime() for the execution deadline
+
 #include "vm.h"
+#include "profile.h"
+#include "jit.h"
+#include "task.h"
+#include "array.h"
+#include "text.h"
+#include "trace.h"
+#include "heapstats.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
-// Global debug flag (extern from main.c)
-extern bool debug_mode;
-
-// VM error state
-static vm_error_t last_error = VM_ERROR_NONE;
+static bool vm_enter_procedure(arx_vm_context_t *vm, uint64_t address, uint64_t level, uint64_t return_pc);
+static uint64_t *vm_frame_locals(arx_vm_context_t *vm, uint64_t level);
+static bool vm_frame_reserve(arx_vm_context_t *vm, size_t words);
+static bool vm_string_builder_create(arx_vm_context_t *vm, uint64_t *handle);
+static arx_string_builder_t *vm_string_builder_get(arx_vm_context_t *vm, uint64_t handle);
+static bool vm_string_builder_append(arx_string_builder_t *builder, const char *data, uint64_t length);
+static void vm_string_builder_release(arx_vm_context_t *vm, uint64_t handle);
+static void vm_class_index_free(arx_vm_context_t *vm);
+static bool vm_bind_method(arx_vm_context_t *vm, uint64_t index, uint64_t *slot);
+static bool vm_bind_class(arx_vm_context_t *vm, uint64_t class_id);
 
 bool vm_init(arx_vm_context_t *vm, size_t stack_size, size_t memory_size)
+{
+    return vm_init_sized(vm, stack_size, 0, memory_size, 0, 0, 0);
+}
+
+bool vm_init_sized(arx_vm_context_t *vm, size_t stack_size, size_t stack_max_size, size_t memory_size,
+                   size_t frame_max_size, size_t heap_words, size_t heap_max_words)
 {
     if (vm == NULL) {
         return false;
     }
     
-    if (debug_mode) {
-        printf("VM: Initializing VM with stack_size=%zu, memory_size=%zu\n", stack_size, memory_size);
-    }
-    
     memset(vm, 0, sizeof(arx_vm_context_t));
     
-    // Initialize stack
-    if (debug_mode) {
-        printf("VM: Allocating stack memory (%zu bytes)\n", stack_size * sizeof(uint64_t));
+    if (heap_words == 0) {
+        heap_words = VM_HEAP_DEFAULT_WORDS;
     }
-    vm->stack = calloc(stack_size, sizeof(uint64_t));
-    if (vm->stack == NULL) {
-        if (debug_mode) {
-            printf("VM: Failed to allocate stack memory\n");
-        }
+    if (heap_max_words == 0) {
+        heap_max_words = VM_HEAP_DEFAULT_MAX_WORDS;
+    }
+    if (heap_max_words < heap_words) {
+        heap_max_words = heap_words;
+    }
+    if (stack_max_size == 0) {
+        stack_max_size = VM_STACK_DEFAULT_MAX_WORDS;
+    }
+    if (stack_max_size < stack_size) {
+        stack_max_size = stack_size;
+    }
+    if (frame_max_size == 0) {
+        frame_max_size = VM_FRAME_STACK_DEFAULT_MAX_WORDS;
+    }
+    
+    // Initialize stack: one reservation holds the data stack at its largest,
+    // a guard page and the object area, so object addresses index vm->stack
+    // and growing the stack moves nothing. Only the initial stack and area
+    // are committed.
+    size_t page_words = vm_segment_page_size() / sizeof(uint64_t);
+    if (stack_max_size > SIZE_MAX / sizeof(uint64_t) - 2 * page_words) {
+        return false;
+    }
+    size_t heap_base = (stack_max_size + page_words - 1) / page_words * page_words + page_words;
+    if (heap_max_words > SIZE_MAX / sizeof(uint64_t) - heap_base ||
+        memory_size > SIZE_MAX / sizeof(uint64_t) - 1024 ||
+        frame_max_size > SIZE_MAX / sizeof(uint64_t)) {
         return false;
     }
+    if (!vm_segment_reserve(&vm->stack_segment, (heap_base + heap_max_words) * sizeof(uint64_t),
+                            stack_size * sizeof(uint64_t))) {
+        return false;
+    }
+    if (!vm_segment_commit_range(&vm->stack_segment, heap_base * sizeof(uint64_t), heap_words * sizeof(uint64_t))) {
+        vm_segment_release(&vm->stack_segment);
+        return false;
+    }
+    vm->stack = (uint64_t *)vm->stack_segment.base;
     vm->stack_size = stack_size;
+    vm->stack_max_size = stack_max_size;
     vm->stack_top = 0;
-    if (debug_mode) {
-        printf("VM: Stack allocated successfully\n");
-    }
     
     // Initialize memory
-    if (debug_mode) {
-        printf("VM: Allocating memory (%zu bytes)\n", memory_size * sizeof(uint64_t));
-    }
-    vm->memory = calloc(memory_size, sizeof(uint64_t));
-    if (vm->memory == NULL) {
-        if (debug_mode) {
-            printf("VM: Failed to allocate memory\n");
-        }
-        free(vm->stack);
+    if (!vm_segment_reserve(&vm->memory_segment, memory_size * sizeof(uint64_t), memory_size * sizeof(uint64_t))) {
+        vm_segment_release(&vm->stack_segment);
         return false;
     }
+    vm->memory = (uint64_t *)vm->memory_segment.base;
     vm->memory_size = memory_size;
-    if (debug_mode) {
-        printf("VM: Memory allocated successfully\n");
-    }
     
     // Initialize call stack
-    vm->call_stack.frame_capacity = 100;
-    vm->call_stack.frames = calloc(vm->call_stack.frame_capacity, sizeof(uint64_t) * 4);
-    if (vm->call_stack.frames == NULL) {
-        free(vm->stack);
-        free(vm->memory);
+    vm->frame_stack_max_size = frame_max_size;
+    vm->call_stack.max_depth = VM_DEFAULT_MAX_CALL_DEPTH;
+    if (!vm_call_stack_init(vm, &vm->call_stack)) {
+        vm_segment_release(&vm->stack_segment);
+        vm_segment_release(&vm->memory_segment);
         return false;
     }
-    vm->call_stack.frame_count = 0;
-    vm->call_stack.current_frame = 0;
+    vm->locals = vm->memory;
     
     // Initialize string table
     vm->string_table.string_capacity = 1000;
     vm->string_table.strings = calloc(vm->string_table.string_capacity, sizeof(char*));
     if (vm->string_table.strings == NULL) {
-        free(vm->stack);
-        free(vm->memory);
-        free(vm->call_stack.frames);
+        vm_segment_release(&vm->stack_segment);
+        vm_segment_release(&vm->memory_segment);
+        vm_call_stack_free(&vm->call_stack);
         return false;
     }
     vm->string_table.string_count = 0;
+    vm->string_table.mapped_count = 0;
     vm->string_table.utf8_enabled = true;  // Enable UTF-8 support by default
     
     // Initialize class system
     vm->class_system.class_capacity = 100;
     vm->class_system.classes = calloc(vm->class_system.class_capacity, sizeof(class_entry_t));
     if (vm->class_system.classes == NULL) {
-        free(vm->stack);
-        free(vm->memory);
-        free(vm->call_stack.frames);
+        vm_segment_release(&vm->stack_segment);
+        vm_segment_release(&vm->memory_segment);
+        vm_call_stack_free(&vm->call_stack);
         free(vm->string_table.strings);
         return false;
     }
@@ -98,9 +135,9 @@ bool vm_init(arx_vm_context_t *vm, size_t stack_size, size_t memory_size)
     vm->class_system.method_capacity = 1000;
     vm->class_system.method_addresses = calloc(vm->class_system.method_capacity, sizeof(uint64_t));
     if (vm->class_system.method_addresses == NULL) {
-        free(vm->stack);
-        free(vm->memory);
-        free(vm->call_stack.frames);
+        vm_segment_release(&vm->stack_segment);
+        vm_segment_release(&vm->memory_segment);
+        vm_call_stack_free(&vm->call_stack);
         free(vm->string_table.strings);
         free(vm->class_system.classes);
         return false;
@@ -116,30 +153,43 @@ bool vm_init(arx_vm_context_t *vm, size_t stack_size, size_t memory_size)
     
     // Initialize memory manager
     if (!vm_memory_manager_init(&vm->memory_manager)) {
-        free(vm->stack);
-        free(vm->memory);
-        free(vm->call_stack.frames);
+        vm_segment_release(&vm->stack_segment);
+        vm_segment_release(&vm->memory_segment);
+        vm_call_stack_free(&vm->call_stack);
         free(vm->string_table.strings);
         free(vm->class_system.classes);
         free(vm->class_system.method_addresses);
         return false;
     }
+    memory_manager_t *mm = &vm->memory_manager;
+    mm->heap_base = heap_base;
+    mm->heap_limit = heap_base + heap_words;
+    mm->heap_max = heap_base + heap_max_words;
+    mm->heap_bump = heap_base;
+    mm->gc_threshold = VM_GC_DEFAULT_THRESHOLD;
+    if (!vm_segment_reserve(&mm->index_segment, heap_max_words * sizeof(uint32_t), heap_words * sizeof(uint32_t)) ||
+        !vm_segment_reserve(&mm->map_segment, (heap_max_words + 63) / 64 * sizeof(uint64_t),
+                            (heap_words + 63) / 64 * sizeof(uint64_t))) {
+        vm_memory_manager_cleanup(&vm->memory_manager);
+        vm_segment_release(&vm->stack_segment);
+        vm_segment_release(&vm->memory_segment);
+        vm_call_stack_free(&vm->call_stack);
+        free(vm->string_table.strings);
+        free(vm->class_system.classes);
+        free(vm->class_system.method_addresses);
+        return false;
+    }
+    mm->address_index = (uint32_t *)mm->index_segment.base;
+    mm->block_map = (uint64_t *)mm->map_segment.base;
     
     // Initialize execution state
     vm->pc = 0;
     vm->instruction_count = 0;
     vm->instruction_count_executed = 0;
     vm->halted = false;
-    vm->debug_mode = debug_mode;
-    
-    last_error = VM_ERROR_NONE;
-    
-    if (vm->debug_mode) {
-        printf("VM: Starting VM initialization\n");
-        printf("VM: Initializing VM with stack_size=%zu, memory_size=%zu\n", stack_size, memory_size);
-        printf("VM: Allocating stack memory\n");
-        printf("VM initialized: stack=%zu, memory=%zu\n", stack_size, memory_size);
-    }
+    vm->last_error = VM_ERROR_NONE;
+    vm->output = stdout;
+    vm->input = stdin;
     
     return true;
 }
@@ -154,27 +204,34 @@ void vm_cleanup(arx_vm_context_t *vm)
         printf("VM: Cleaning up VM\n");
     }
     
-    // Free stack
-    if (vm->stack != NULL) {
-        free(vm->stack);
-        vm->stack = NULL;
-    }
+    // Output still pending, e.g. after vm_step() runs
+    vm_output_flush(vm);
+    free(vm->output_buffer);
+    vm->output_buffer = NULL;
     
-    // Free memory
-    if (vm->memory != NULL) {
-        free(vm->memory);
-        vm->memory = NULL;
-    }
+    // Free stack, object area and memory
+    vm_segment_release(&vm->stack_segment);
+    vm->stack = NULL;
+    vm_segment_release(&vm->memory_segment);
+    vm->memory = NULL;
     
     // Free call stack
-    if (vm->call_stack.frames != NULL) {
-        free(vm->call_stack.frames);
-        vm->call_stack.frames = NULL;
+    vm_call_stack_free(&vm->call_stack);
+    
+    // Free decoded program
+    if (vm->code != NULL) {
+        free(vm->code);
+        vm->code = NULL;
     }
+    vm_profile_free(vm);
+    vm_jit_free(vm);
+    vm_task_free(vm);
+    vm_trace_free(vm);
+    vm_heap_sites_free(vm);
     
     // Free string table
     if (vm->string_table.strings != NULL) {
-        for (size_t i = 0; i < vm->string_table.string_count; i++) {
+        for (size_t i = vm->string_table.mapped_count; i < vm->string_table.string_count; i++) {
             if (vm->string_table.strings[i] != NULL) {
                 free(vm->string_table.strings[i]);
             }
@@ -182,8 +239,11 @@ void vm_cleanup(arx_vm_context_t *vm)
         free(vm->string_table.strings);
         vm->string_table.strings = NULL;
     }
+    free(vm->string_table.literals);
+    vm->string_table.literals = NULL;
     
     // Free class system
+    vm_class_index_free(vm);
     if (vm->class_system.classes != NULL) {
         free(vm->class_system.classes);
         vm->class_system.classes = NULL;
@@ -201,6 +261,18 @@ void vm_cleanup(arx_vm_context_t *vm)
         vm->class_system.method_addresses = NULL;
     }
     
+    // Free cross-module references
+    free(vm->modules.externs);
+    free(vm->modules.bound_slots);
+    free(vm->modules.names);
+    
+    // Free string builders
+    for (size_t i = 0; i < vm->string_builders.count; i++) {
+        free(vm->string_builders.builders[i].data);
+    }
+    free(vm->string_builders.builders);
+    free(vm->string_builders.free_handles);
+    
     // Class system cleanup complete
     
     // Cleanup memory manager
@@ -209,215 +281,1032 @@ void vm_cleanup(arx_vm_context_t *vm)
     memset(vm, 0, sizeof(arx_vm_context_t));
 }
 
-bool vm_load_program(arx_vm_context_t *vm, instruction_t *instructions, size_t instruction_count)
+// === Program decoding and verification ===
+// vm_load_program() turns the packed 9-byte instructions into aligned
+// vm_instruction_t records once and checks every operand that can be checked
+// statically (opcodes, OPR operations, jump/call targets, string IDs, memory
+// offsets). Execution then trusts those operands instead of re-checking them.
+
+// Build with -DVM_THREADED_COMPUTED_GOTO=0 to force the switch dispatcher
+#ifndef VM_THREADED_COMPUTED_GOTO
+#if defined(__GNUC__) || defined(__clang__)
+#define VM_THREADED_COMPUTED_GOTO 1
+#else
+#define VM_THREADED_COMPUTED_GOTO 0
+#endif
+#endif
+
+// Threaded-engine operations. Inline OPR sub-operations get their own entry
+// so dispatch never goes through a second switch; everything else is STEP.
+#define VM_THREADED_OPS(X) \
+    X(LIT) X(LOD) X(STO) X(LOD_LEVEL) X(STO_LEVEL) X(JMP) X(JPC) X(HALT) \
+    X(NEG) X(ADD) X(SUB) X(MUL) X(DIV) X(MOD) X(ODD) \
+    X(EQ) X(NEQ) X(LESS) X(LEQ) X(GREATER) X(GEQ) \
+    X(AND) X(OR) X(NOT) \
+    X(RNEG) X(RADD) X(RSUB) X(RMUL) X(RDIV) \
+    X(REQ) X(RNEQ) X(RLESS) X(RLEQ) X(RGREATER) X(RGEQ) \
+    X(INT_TO_REAL) X(REAL_TO_INT) \
+    X(STEP) X(END) X(PROFILE) X(JIT) X(JIT_COUNT)
+
+// Binary operations with fused forms, and the comparisons among them that
+// also fuse with a following JPC. Names match the opr_t suffixes.
+#define VM_FUSED_BINOPS(X) \
+    X(ADD) X(SUB) X(MUL) X(EQ) X(NEQ) X(LESS) X(LEQ) X(GREATER) X(GEQ) X(AND) X(OR) \
+    X(RADD) X(RSUB) X(RMUL) X(REQ) X(RNEQ) X(RLESS) X(RLEQ) X(RGREATER) X(RGEQ)
+#define VM_FUSED_CMPOPS(X) \
+    X(EQ) X(NEQ) X(LESS) X(LEQ) X(GREATER) X(GEQ) \
+    X(REQ) X(RNEQ) X(RLESS) X(RLEQ) X(RGREATER) X(RGEQ)
+
+// Superinstructions (only built when vm->superinstructions is set):
+//   LL_op   LOD a; LOD b; OPR op          LLS_op  LOD a; LOD b; OPR op; STO c
+//   LK_op   LOD a; LIT n; OPR op          LKS_op  LOD a; LIT n; OPR op; STO c
+//   K_op    LIT n; OPR op                 INC_LOCAL  LOD x; LIT n; OPR ADD; STO x
+//   LLJ_op  LOD a; LOD b; OPR op; JPC L   LKJ_op  LOD a; LIT n; OPR op; JPC L
+//   J_op    OPR op; JPC L
+// The fused operation replaces only the first instruction of the sequence and
+// reads the remaining operands from the following slots, which keep their own
+// handlers, so a jump into the middle of a sequence still runs correctly.
+
+// Words hold signed integers or the bit patterns of doubles; the operation
+// says which, so neither carries a tag or is checked at run time
+static inline double vm_word_real(uint64_t word)
 {
-    if (vm == NULL || instructions == NULL) {
-        last_error = VM_ERROR_INVALID_ADDRESS;
-        return false;
+    double value;
+    memcpy(&value, &word, sizeof(value));
+    return value;
+}
+
+static inline uint64_t vm_real_word(double value)
+{
+    uint64_t word;
+    memcpy(&word, &value, sizeof(word));
+    return word;
+}
+
+// Truncating conversion; NaN gives 0 and out-of-range values saturate
+static inline uint64_t vm_real_to_int(double value)
+{
+    if (value != value) return 0;
+    if (value <= -9223372036854775808.0) return (uint64_t)INT64_MIN;
+    if (value >= 9223372036854775808.0) return (uint64_t)INT64_MAX;
+    return (uint64_t)(int64_t)value;
+}
+
+// Signed division and remainder for a non-zero divisor; INT64_MIN / -1
+// wraps like the other integer operations instead of trapping
+static inline uint64_t vm_int_div(uint64_t a, uint64_t b)
+{
+    return (int64_t)b == -1 ? (uint64_t)0 - a : (uint64_t)((int64_t)a / (int64_t)b);
+}
+
+static inline uint64_t vm_int_mod(uint64_t a, uint64_t b)
+{
+    return (int64_t)b == -1 ? 0 : (uint64_t)((int64_t)a % (int64_t)b);
+}
+
+// Result of each binary operation, shared by plain and fused handlers
+#define VM_OP_ADD(a, b)     ((a) + (b))
+#define VM_OP_SUB(a, b)     ((a) - (b))
+#define VM_OP_MUL(a, b)     ((a) * (b))
+#define VM_OP_EQ(a, b)      (((a) == (b)) ? 1 : 0)
+#define VM_OP_NEQ(a, b)     (((a) != (b)) ? 1 : 0)
+#define VM_OP_LESS(a, b)    (((int64_t)(a) < (int64_t)(b)) ? 1 : 0)
+#define VM_OP_LEQ(a, b)     (((int64_t)(a) <= (int64_t)(b)) ? 1 : 0)
+#define VM_OP_GREATER(a, b) (((int64_t)(a) > (int64_t)(b)) ? 1 : 0)
+#define VM_OP_GEQ(a, b)     (((int64_t)(a) >= (int64_t)(b)) ? 1 : 0)
+#define VM_OP_AND(a, b)     (((a) != 0 && (b) != 0) ? 1 : 0)
+#define VM_OP_OR(a, b)      (((a) != 0 || (b) != 0) ? 1 : 0)
+#define VM_OP_RADD(a, b)     vm_real_word(vm_word_real(a) + vm_word_real(b))
+#define VM_OP_RSUB(a, b)     vm_real_word(vm_word_real(a) - vm_word_real(b))
+#define VM_OP_RMUL(a, b)     vm_real_word(vm_word_real(a) * vm_word_real(b))
+#define VM_OP_RDIV(a, b)     vm_real_word(vm_word_real(a) / vm_word_real(b))
+#define VM_OP_REQ(a, b)      ((vm_word_real(a) == vm_word_real(b)) ? 1 : 0)
+#define VM_OP_RNEQ(a, b)     ((vm_word_real(a) != vm_word_real(b)) ? 1 : 0)
+#define VM_OP_RLESS(a, b)    ((vm_word_real(a) < vm_word_real(b)) ? 1 : 0)
+#define VM_OP_RLEQ(a, b)     ((vm_word_real(a) <= vm_word_real(b)) ? 1 : 0)
+#define VM_OP_RGREATER(a, b) ((vm_word_real(a) > vm_word_real(b)) ? 1 : 0)
+#define VM_OP_RGEQ(a, b)     ((vm_word_real(a) >= vm_word_real(b)) ? 1 : 0)
+
+typedef enum {
+#define VM_THREADED_ENUM(name) VM_TOP_##name,
+    VM_THREADED_OPS(VM_THREADED_ENUM)
+#undef VM_THREADED_ENUM
+#define VM_FUSED_BINOP_ENUM(op) VM_TOP_LL_##op, VM_TOP_LLS_##op, VM_TOP_LK_##op, VM_TOP_LKS_##op, VM_TOP_K_##op,
+    VM_FUSED_BINOPS(VM_FUSED_BINOP_ENUM)
+#undef VM_FUSED_BINOP_ENUM
+#define VM_FUSED_CMPOP_ENUM(op) VM_TOP_LLJ_##op, VM_TOP_LKJ_##op, VM_TOP_J_##op,
+    VM_FUSED_CMPOPS(VM_FUSED_CMPOP_ENUM)
+#undef VM_FUSED_CMPOP_ENUM
+    VM_TOP_INC_LOCAL,
+    VM_TOP_COUNT
+} vm_threaded_op_t;
+
+static bool vm_threaded_run(arx_vm_context_t *vm, const void *const **handler_table);
+
+static vm_threaded_op_t vm_threaded_select(const vm_instruction_t *instr)
+{
+    switch (instr->opcode) {
+        case VM_LIT: return VM_TOP_LIT;
+        case VM_LOD: return instr->level == 0 ? VM_TOP_LOD : VM_TOP_LOD_LEVEL;
+        case VM_STO: return instr->level == 0 ? VM_TOP_STO : VM_TOP_STO_LEVEL;
+        case VM_JMP: return VM_TOP_JMP;
+        case VM_JPC: return VM_TOP_JPC;
+        case VM_HALT: return VM_TOP_HALT;
+        case VM_OPR:
+            switch ((opr_t)instr->operand) {
+                case OPR_NEG: return VM_TOP_NEG;
+                case OPR_ADD: return VM_TOP_ADD;
+                case OPR_SUB: return VM_TOP_SUB;
+                case OPR_MUL: return VM_TOP_MUL;
+                case OPR_DIV: return VM_TOP_DIV;
+                case OPR_MOD: return VM_TOP_MOD;
+                case OPR_ODD: return VM_TOP_ODD;
+                case OPR_EQ: return VM_TOP_EQ;
+                case OPR_NEQ: return VM_TOP_NEQ;
+                case OPR_LESS: return VM_TOP_LESS;
+                case OPR_LEQ: return VM_TOP_LEQ;
+                case OPR_GREATER: return VM_TOP_GREATER;
+                case OPR_GEQ: return VM_TOP_GEQ;
+                case OPR_AND: return VM_TOP_AND;
+                case OPR_OR: return VM_TOP_OR;
+                case OPR_NOT: return VM_TOP_NOT;
+                case OPR_RNEG: return VM_TOP_RNEG;
+                case OPR_RADD: return VM_TOP_RADD;
+                case OPR_RSUB: return VM_TOP_RSUB;
+                case OPR_RMUL: return VM_TOP_RMUL;
+                case OPR_RDIV: return VM_TOP_RDIV;
+                case OPR_REQ: return VM_TOP_REQ;
+                case OPR_RNEQ: return VM_TOP_RNEQ;
+                case OPR_RLESS: return VM_TOP_RLESS;
+                case OPR_RLEQ: return VM_TOP_RLEQ;
+                case OPR_RGREATER: return VM_TOP_RGREATER;
+                case OPR_RGEQ: return VM_TOP_RGEQ;
+                case OPR_INT_TO_REAL: return VM_TOP_INT_TO_REAL;
+                case OPR_REAL_TO_INT: return VM_TOP_REAL_TO_INT;
+                default: return VM_TOP_STEP;
+            }
+        default:
+            return VM_TOP_STEP;
     }
+}
+
+// next_opcode is the opcode of the instruction after instr (VM_HALT at the end)
+static bool vm_verify_instruction(arx_vm_context_t *vm, size_t index, const vm_instruction_t *instr, size_t instruction_count, uint8_t next_opcode)
+{
+    const char *problem = NULL;
+    uint64_t value = instr->operand;
+    uint64_t limit = 0;
     
-    vm->instructions = instructions;
-    vm->instruction_count = instruction_count;
-    vm->pc = 0;
-    vm->halted = false;
+    switch (instr->opcode) {
+        case VM_JMP:
+        case VM_JPC:
+        case VM_CAL:
+            if (instr->operand >= instruction_count) {
+                problem = "branch target out of range";
+                limit = instruction_count;
+            }
+            break;
+        case VM_LOD:
+        case VM_STO:
+            if (instr->operand >= vm->memory_size) {
+                problem = "memory offset out of range";
+                limit = vm->memory_size;
+            }
+            break;
+        case VM_STRING:
+            if (instr->operand >= vm->string_table.string_count) {
+                problem = "string ID out of range";
+                limit = vm->string_table.string_count;
+            }
+            break;
+        case VM_CALS:
+            if (instr->operand & ARXMOD_EXTERN_CALL) {
+                value = instr->operand & ~ARXMOD_EXTERN_CALL;
+                if (value >= vm->modules.extern_count ||
+                    vm->modules.externs[value].reference_type != ARXMOD_EXTERN_METHOD) {
+                    problem = "external method reference out of range";
+                    limit = vm->modules.extern_count;
+                }
+            } else if (instr->operand >= vm->class_system.vtable_width) {
+                problem = "method slot out of range";
+                limit = vm->class_system.vtable_width;
+            }
+            if (problem == NULL && instr->level > 1) {
+                problem = "unknown call form (level 0 calls, 1 tail calls)";
+                value = instr->level;
+                limit = 2;
+            }
+            break;
+        case VM_OPR:
+            if (instr->operand > OPR_LAST) {
+                problem = "unknown operation";
+                limit = OPR_LAST + 1;
+            } else if (instr->operand == OPR_TASK_SPAWN && next_opcode != VM_CALS) {
+                problem = "spawn not followed by a method call";
+                value = next_opcode;
+                limit = VM_CALS;
+            }
+            break;
+        case VM_LIT:
+        case VM_INT:
+        case VM_LODX:
+        case VM_STOX:
+        case VM_HALT:
+            break;
+        default:
+            problem = "unknown opcode";
+            value = instr->opcode;
+            limit = VM_CALS + 1;
+            break;
+    }
     
-    if (vm->debug_mode) {
-        printf("Program loaded: %zu instructions\n", instruction_count);
+    if (problem != NULL) {
+        printf("Error: Invalid program: instruction %zu (opcode %u): %s (%llu, limit %llu)\n",
+               index, instr->opcode, problem, (unsigned long long)value, (unsigned long long)limit);
+        vm->last_error = VM_ERROR_INVALID_PROGRAM;
+        return false;
     }
     
     return true;
 }
 
-bool vm_load_module_header(arx_vm_context_t *vm, arxmod_header_t *header)
+// Fused forms of each binary operation, indexed by the row matching its opr_t
+typedef struct {
+    opr_t operation;
+    uint16_t load_load, load_load_store, load_lit, load_lit_store, lit;
+} vm_fused_binop_t;
+
+typedef struct {
+    opr_t operation;
+    uint16_t load_load_branch, load_lit_branch, branch;
+} vm_fused_cmpop_t;
+
+static const vm_fused_binop_t vm_fused_binops[] = {
+#define VM_FUSED_BINOP_ROW(op) { OPR_##op, VM_TOP_LL_##op, VM_TOP_LLS_##op, VM_TOP_LK_##op, VM_TOP_LKS_##op, VM_TOP_K_##op },
+    VM_FUSED_BINOPS(VM_FUSED_BINOP_ROW)
+#undef VM_FUSED_BINOP_ROW
+};
+
+static const vm_fused_cmpop_t vm_fused_cmpops[] = {
+#define VM_FUSED_CMPOP_ROW(op) { OPR_##op, VM_TOP_LLJ_##op, VM_TOP_LKJ_##op, VM_TOP_J_##op },
+    VM_FUSED_CMPOPS(VM_FUSED_CMPOP_ROW)
+#undef VM_FUSED_CMPOP_ROW
+};
+
+static const vm_fused_binop_t* vm_find_fused_binop(const vm_instruction_t *instr)
 {
-    if (vm == NULL || header == NULL) {
-        last_error = VM_ERROR_INVALID_ADDRESS;
-        return false;
-    }
-    
-    if (debug_mode) {
-        printf("VM: Loading module header: flags=0x%08x, entry_point=%llu\n", 
-               header->flags, (unsigned long long)header->entry_point);
+    if (instr->opcode != VM_OPR) {
+        return NULL;
     }
-    
-    // Copy the module header to the VM
-    vm->module_header = *header;
-    
-    if (vm->debug_mode) {
-        printf("VM: Module header loaded successfully\n");
+    for (size_t i = 0; i < sizeof(vm_fused_binops) / sizeof(vm_fused_binops[0]); i++) {
+        if (vm_fused_binops[i].operation == (opr_t)instr->operand) {
+            return &vm_fused_binops[i];
+        }
     }
-    
-    return true;
+    return NULL;
 }
 
-bool vm_load_strings(arx_vm_context_t *vm, char **strings, size_t string_count)
+static const vm_fused_cmpop_t* vm_find_fused_cmpop(const vm_instruction_t *instr)
 {
-    if (vm == NULL || strings == NULL) {
-        last_error = VM_ERROR_INVALID_ADDRESS;
-        return false;
+    if (instr->opcode != VM_OPR) {
+        return NULL;
+    }
+    for (size_t i = 0; i < sizeof(vm_fused_cmpops) / sizeof(vm_fused_cmpops[0]); i++) {
+        if (vm_fused_cmpops[i].operation == (opr_t)instr->operand) {
+            return &vm_fused_cmpops[i];
+        }
     }
+    return NULL;
+}
+
+static bool vm_is_local(const vm_instruction_t *instr, uint8_t opcode)
+{
+    return instr->opcode == opcode && instr->level == 0;
+}
+
+// Try to start a superinstruction at code[i]; returns the number of
+// instructions it covers (0 when nothing matches)
+static size_t vm_fuse_at(vm_instruction_t *code, size_t i, size_t count, vm_fusion_kind_t *kind)
+{
+    size_t left = count - i;
+    const vm_instruction_t *c = &code[i];
     
-    for (size_t i = 0; i < string_count && i < vm->string_table.string_capacity; i++) {
-        if (strings[i] != NULL) {
-            size_t len = strlen(strings[i]) + 1;
-            vm->string_table.strings[i] = malloc(len);
-            if (vm->string_table.strings[i] != NULL) {
-                strcpy(vm->string_table.strings[i], strings[i]);
+    if (left >= 3 && vm_is_local(&c[0], VM_LOD) && (vm_is_local(&c[1], VM_LOD) || c[1].opcode == VM_LIT)) {
+        const vm_fused_binop_t *binop = vm_find_fused_binop(&c[2]);
+        if (binop == NULL) {
+            return 0;
+        }
+        bool second_is_lit = c[1].opcode == VM_LIT;
+        const vm_fused_cmpop_t *cmpop = vm_find_fused_cmpop(&c[2]);
+        
+        if (left >= 4 && cmpop != NULL && c[3].opcode == VM_JPC) {
+            code[i].op = second_is_lit ? cmpop->load_lit_branch : cmpop->load_load_branch;
+            *kind = second_is_lit ? VM_FUSION_COMPARE_LIT_BRANCH : VM_FUSION_COMPARE_BRANCH;
+            return 4;
+        }
+        if (left >= 4 && vm_is_local(&c[3], VM_STO)) {
+            if (second_is_lit && binop->operation == OPR_ADD && c[3].operand == c[0].operand) {
+                code[i].op = VM_TOP_INC_LOCAL;
+                *kind = VM_FUSION_INCREMENT_LOCAL;
+            } else {
+                code[i].op = second_is_lit ? binop->load_lit_store : binop->load_load_store;
+                *kind = second_is_lit ? VM_FUSION_LOAD_LIT_OP_STORE : VM_FUSION_LOAD_LOAD_OP_STORE;
             }
+            return 4;
         }
+        code[i].op = second_is_lit ? binop->load_lit : binop->load_load;
+        *kind = second_is_lit ? VM_FUSION_LOAD_LIT_OP : VM_FUSION_LOAD_LOAD_OP;
+        return 3;
     }
     
-    vm->string_table.string_count = string_count;
+    if (left >= 2 && c[0].opcode == VM_LIT) {
+        const vm_fused_binop_t *binop = vm_find_fused_binop(&c[1]);
+        if (binop != NULL) {
+            code[i].op = binop->lit;
+            *kind = VM_FUSION_LIT_OP;
+            return 2;
+        }
+    }
     
-    if (vm->debug_mode) {
-        printf("Strings loaded: %zu strings\n", string_count);
+    if (left >= 2 && c[1].opcode == VM_JPC) {
+        const vm_fused_cmpop_t *cmpop = vm_find_fused_cmpop(&c[0]);
+        if (cmpop != NULL) {
+            code[i].op = cmpop->branch;
+            *kind = VM_FUSION_OP_BRANCH;
+            return 2;
+        }
     }
     
-    return true;
+    return 0;
 }
 
-bool vm_execute(arx_vm_context_t *vm)
+// Peephole pass over decoded code: greedily rewrite the first instruction
+// of each recognised sequence into its superinstruction. Adds to the counts.
+static void vm_fuse_program(arx_vm_context_t *vm, vm_instruction_t *code, size_t count)
 {
-    if (vm == NULL) {
-        return false;
+    for (size_t i = 0; i < count; ) {
+        vm_fusion_kind_t kind;
+        size_t length = vm_fuse_at(code, i, count, &kind);
+        if (length == 0) {
+            i++;
+            continue;
+        }
+        vm->fusion_counts[kind]++;
+        vm->fused_instructions += length;
+        i += length;
     }
-    
-    if (vm->debug_mode) {
-        printf("Starting VM execution\n");
+}
+
+// Where a linked module's tables start in the VM's (see vm_link_module);
+// its operands are moved by these amounts as it is decoded
+typedef struct {
+    size_t code_base;              // Branch and call targets
+    size_t string_base;            // VM_STRING IDs
+    size_t global_base;            // Global memory offsets (LOD/STO above level 0)
+    size_t extern_base;            // External references of VM_CALS
+    const uint64_t *slot_map;      // Module method slot -> VM method slot
+    size_t slot_count;             // Entries in slot_map
+} vm_link_bases_t;
+
+// Move the operand of a linked module's instruction into the VM's tables;
+// branch targets are moved after verification, which checks them against
+// the module's own code
+static void vm_rebase_operand(vm_instruction_t *instr, const vm_link_bases_t *bases)
+{
+    switch (instr->opcode) {
+        case VM_LOD:
+        case VM_STO:
+        case VM_LODX:
+        case VM_STOX:
+            if (instr->level > 0) {
+                instr->operand += bases->global_base;
+            }
+            break;
+        case VM_STRING:
+            instr->operand += bases->string_base;
+            break;
+        case VM_CALS:
+            if (instr->operand & ARXMOD_EXTERN_CALL) {
+                instr->operand += bases->extern_base;
+            } else if (instr->operand < bases->slot_count && bases->slot_map[instr->operand] != VM_VTABLE_EMPTY) {
+                instr->operand = bases->slot_map[instr->operand];
+            } else {
+                instr->operand = ~ARXMOD_EXTERN_CALL;  // Fails verification as an unknown slot
+            }
+            break;
+        default:
+            break;
     }
+}
+
+// Decode and verify instruction_count instructions into code, followed by a
+// VM_TOP_END marker, so running off the end needs no pc check. bases is NULL
+// for the main program.
+static bool vm_decode_range(arx_vm_context_t *vm, vm_instruction_t *code, const instruction_t *instructions, size_t instruction_count, const vm_link_bases_t *bases)
+{
+    const void *const *handlers = NULL;
+    vm_threaded_run(NULL, &handlers);
     
-    size_t step_count = 0;
-    const size_t max_steps = 5000; // Reduced safety limit to prevent infinite loops
-    size_t last_pc = 0;
-    size_t pc_repeat_count = 0;
-    const size_t max_pc_repeats = 100; // Max times PC can stay the same
-    
-    while (!vm->halted && vm->pc < vm->instruction_count && step_count < max_steps) {
-        // Check for PC getting stuck at the same instruction
-        if (vm->pc == last_pc) {
-            pc_repeat_count++;
-            if (pc_repeat_count > max_pc_repeats) {
-                if (vm->debug_mode) {
-                    printf("VM: PC stuck at %zu for %zu steps (infinite loop detected)\n", 
-                           vm->pc, pc_repeat_count);
-                }
-                return false;
-            }
-        } else {
-            pc_repeat_count = 0;
-            last_pc = vm->pc;
-        }
+    for (size_t i = 0; i < instruction_count; i++) {
+        code[i].opcode = instructions[i].opcode & 0xF;
+        code[i].level = (instructions[i].opcode >> 4) & 0xF;
+        code[i].operand = instructions[i].opt64;
         
-        if (vm->debug_mode && step_count % 500 == 0) {
-            printf("VM: Step %zu, PC=%zu, instruction_count=%zu, halted=%d\n", 
-                   step_count, vm->pc, vm->instruction_count, vm->halted);
+        if (bases != NULL) {
+            vm_rebase_operand(&code[i], bases);
         }
-        
-        if (!vm_step(vm)) {
-            if (vm->debug_mode) {
-                printf("VM step failed at PC=%zu, instruction_count=%zu\n", 
-                       vm->pc, vm->instruction_count);
-            }
+        uint8_t next_opcode = i + 1 < instruction_count ? instructions[i + 1].opcode & 0xF : VM_HALT;
+        if (!vm_verify_instruction(vm, i, &code[i], instruction_count, next_opcode)) {
             return false;
         }
-        step_count++;
-    }
-    
-    if (step_count >= max_steps) {
-        if (vm->debug_mode) {
-            printf("VM: Execution stopped after %zu steps (infinite loop protection)\n", max_steps);
+        if (bases != NULL && (code[i].opcode == VM_JMP || code[i].opcode == VM_JPC || code[i].opcode == VM_CAL)) {
+            code[i].operand += bases->code_base;
         }
-        return false;
+        
+        code[i].op = vm_threaded_select(&code[i]);
     }
     
-    if (vm->debug_mode) {
-        printf("VM execution completed: %zu instructions executed, PC=%zu, instruction_count=%zu\n", 
-               vm->instruction_count_executed, vm->pc, vm->instruction_count);
+    code[instruction_count].opcode = VM_HALT;
+    code[instruction_count].level = 0;
+    code[instruction_count].operand = 0;
+    code[instruction_count].op = VM_TOP_END;
+    
+    if (vm->superinstructions) {
+        vm_fuse_program(vm, code, instruction_count);
     }
     
+    // While profiling, every instruction first goes through the counting
+    // handler, which then jumps to its own
+    for (size_t i = 0; i <= instruction_count; i++) {
+        vm_threaded_op_t op = vm->profile != NULL && i < instruction_count ? VM_TOP_PROFILE : (vm_threaded_op_t)code[i].op;
+        code[i].handler = handlers != NULL ? handlers[op] : NULL;
+    }
     return true;
 }
 
-bool vm_step(arx_vm_context_t *vm)
+// === Template JIT ===
+// With vm->jit set, the first instruction of every method and every target
+// of a backward jump get the counting handler VM_TOP_JIT_COUNT (the op it
+// displaces is kept in jit->ops). Once a method has been entered or looped
+// often enough it is compiled, and all its instructions are pointed at
+// VM_TOP_JIT, which enters the native code; a loop already running in the
+// interpreter moves over at its next iteration. Profiling counts every
+// instruction in the interpreter, so it leaves the JIT out.
+
+static void vm_jit_set_op(arx_vm_context_t *vm, const void *const *handlers, size_t pc, vm_threaded_op_t op)
 {
-    if (vm == NULL || vm->halted || vm->pc >= vm->instruction_count) {
-        if (vm && vm->debug_mode) {
-            printf("VM step: halted=%d, pc=%zu, instruction_count=%zu\n", 
-                   vm->halted, vm->pc, vm->instruction_count);
-        }
+    vm->code[pc].op = (uint16_t)op;
+    vm->code[pc].handler = handlers != NULL ? handlers[op] : NULL;
+}
+
+static void vm_jit_count_at(arx_vm_context_t *vm, const void *const *handlers, size_t pc)
+{
+    if (vm->code[pc].op != VM_TOP_JIT_COUNT) {
+        vm->jit->ops[pc] = vm->code[pc].op;
+        vm_jit_set_op(vm, handlers, pc, VM_TOP_JIT_COUNT);
+    }
+}
+
+// Map the methods among instructions [first, instruction_count) of vm->code
+// and place their counting handlers
+static bool vm_jit_install(arx_vm_context_t *vm, size_t first, size_t instruction_count)
+{
+    if (vm->jit == NULL || vm->profile != NULL) {
+        return true;
+    }
+    if (!vm_jit_map(vm, first, instruction_count)) {
+        vm->last_error = VM_ERROR_OUT_OF_MEMORY;
         return false;
     }
     
-    // Additional safety check for invalid PC
-    if (vm->pc >= vm->instruction_count) {
-        if (vm->debug_mode) {
-            printf("VM step: PC out of bounds: %zu >= %zu\n", vm->pc, vm->instruction_count);
+    const void *const *handlers = NULL;
+    vm_threaded_run(NULL, &handlers);
+    vm_jit_t *jit = vm->jit;
+    for (size_t i = 0; i < jit->method_count; i++) {
+        if (jit->methods[i].start >= first) {
+            vm_jit_count_at(vm, handlers, jit->methods[i].start);
         }
-        vm->halted = true;
+    }
+    for (size_t pc = first; pc < instruction_count; pc++) {
+        const vm_instruction_t *instr = &vm->code[pc];
+        if ((instr->opcode == VM_JMP || instr->opcode == VM_JPC) && instr->operand <= pc &&
+            jit->method_of[instr->operand] != VM_JIT_NO_METHOD) {
+            vm_jit_count_at(vm, handlers, (size_t)instr->operand);
+        }
+    }
+    return true;
+}
+
+// Count an entry or loop iteration at pc. Returns true once the method has
+// native code; a method that cannot be compiled gets its handlers back.
+static bool vm_jit_hot(arx_vm_context_t *vm, size_t pc)
+{
+    vm_jit_t *jit = vm->jit;
+    vm_jit_method_t *method = &jit->methods[jit->method_of[pc]];
+    if (++method->hotness < jit->threshold) {
         return false;
     }
     
-    if (vm->debug_mode && vm->pc >= 170) {
-        printf("DEBUG: vm_step called at PC=%zu\n", vm->pc);
+    const void *const *handlers = NULL;
+    vm_threaded_run(NULL, &handlers);
+    if (vm_jit_compile(vm, method)) {
+        method->state = VM_JIT_COMPILED;
+        for (size_t i = method->start; i < method->end; i++) {
+            vm_jit_set_op(vm, handlers, i, VM_TOP_JIT);
+        }
+        return true;
     }
-    
-    if (vm->pc >= vm->instruction_count) {
-        if (vm->debug_mode) {
-            printf("VM step: PC out of bounds: %zu >= %zu\n", vm->pc, vm->instruction_count);
+    method->state = VM_JIT_FAILED;
+    for (size_t i = method->start; i < method->end; i++) {
+        if (vm->code[i].op == VM_TOP_JIT_COUNT) {
+            vm_jit_set_op(vm, handlers, i, (vm_threaded_op_t)jit->ops[i]);
         }
+    }
+    return false;
+}
+
+// Decode and verify a program into vm->code
+static bool vm_decode_program(arx_vm_context_t *vm, const instruction_t *instructions, size_t instruction_count)
+{
+    vm_instruction_t *code = malloc((instruction_count + 1) * sizeof(vm_instruction_t));
+    if (code == NULL) {
+        vm->last_error = VM_ERROR_MEMORY_ACCESS;
         return false;
     }
     
-    if (vm->debug_mode && vm->pc >= 170) {
-        printf("DEBUG: About to execute instruction at PC=%zu, instruction_count=%zu\n", 
-               vm->pc, vm->instruction_count);
+    memset(vm->fusion_counts, 0, sizeof(vm->fusion_counts));
+    vm->fused_instructions = 0;
+    if ((vm->profile != NULL && !vm_profile_reserve(vm, instruction_count, true)) ||
+        !vm_decode_range(vm, code, instructions, instruction_count, NULL)) {
+        free(code);
+        return false;
+    }
+    if (vm->heap_sites != NULL) {
+        vm->heap_sites->program_instructions = instruction_count;
     }
     
-    instruction_t *instr = &vm->instructions[vm->pc];
-    uint8_t opcode = instr->opcode & 0xF;
-    uint8_t level = (instr->opcode >> 4) & 0xF;
-    uint64_t operand = instr->opt64;
-    
-    if (vm->debug_mode) {
-        printf("PC=%zu: raw_opcode=0x%02x, opcode=%d, level=%d, operand=%llu\n", 
-               vm->pc, instr->opcode, opcode, level, (unsigned long long)operand);
+    free(vm->code);
+    vm->code = code;
+    return vm_jit_install(vm, 0, instruction_count);
+}
+
+static bool vm_install_program(arx_vm_context_t *vm, instruction_t *instructions, size_t instruction_count)
+{
+    // Strings and classes must already be loaded so VM_STRING and VM_CALS
+    // operands can be checked
+    if (!vm_decode_program(vm, instructions, instruction_count)) {
+        return false;
     }
     
-    // Debug: Check for potential issues
-    if (vm->pc >= 170 && vm->debug_mode) {
-        printf("DEBUG: At PC=%zu, stack_top=%zu, stack_size=%zu\n", 
-               vm->pc, vm->stack_top, vm->stack_size);
+    // Every filled vtable slot must be a method inside the program
+    size_t vtable_words = vm->class_system.vtables != NULL ?
+        vm->class_system.class_count * vm->class_system.vtable_width : 0;
+    for (size_t i = 0; i < vtable_words; i++) {
+        uint64_t target = vm->class_system.vtables[i];
+        if (target != VM_VTABLE_EMPTY && target >= instruction_count) {
+            printf("Error: Invalid program: class %s: method slot %zu points outside the program (%llu, limit %zu)\n",
+                   vm->class_system.classes[i / vm->class_system.vtable_width].class_name,
+                   i % vm->class_system.vtable_width, (unsigned long long)target, instruction_count);
+            vm->last_error = VM_ERROR_INVALID_PROGRAM;
+            return false;
+        }
     }
     
-    bool success = true;
+    vm->instructions = instructions;
+    vm->instruction_count = instruction_count;
+    vm->pc = 0;
+    vm->halted = false;
     
-    switch (opcode) {
-        case VM_LIT:
-            success = vm_push(vm, operand);
-            if (vm->debug_mode && vm->pc >= 13 && vm->pc <= 30) {
-                printf("DEBUG: VM_LIT at PC=%zu, success=%d, operand=%llu, stack_top=%zu\n", 
-                       vm->pc, success, (unsigned long long)operand, vm->stack_top);
-            }
-            break;
-            
+    if (vm->debug_mode) {
+        printf("Program loaded: %zu instructions\n", instruction_count);
+    }
+    
+    return true;
+}
+
+bool vm_load_program(arx_vm_context_t *vm, instruction_t *instructions, size_t instruction_count)
+{
+    if (vm == NULL) {
+        return false;
+    }
+    if (instructions == NULL) {
+        vm->last_error = VM_ERROR_INVALID_ADDRESS;
+        return false;
+    }
+    
+    return vm_install_program(vm, instructions, instruction_count);
+}
+
+bool vm_load_module_header(arx_vm_context_t *vm, arxmod_header_t *header)
+{
+    if (vm == NULL) {
+        return false;
+    }
+    if (header == NULL) {
+        vm->last_error = VM_ERROR_INVALID_ADDRESS;
+        return false;
+    }
+    
+    if (vm->debug_mode) {
+        printf("VM: Loading module header: flags=0x%08x, entry_point=%llu\n", 
+               header->flags, (unsigned long long)header->entry_point);
+    }
+    
+    // Copy the module header to the VM
+    vm->module_header = *header;
+    
+    if (vm->debug_mode) {
+        printf("VM: Module header loaded successfully\n");
+    }
+    
+    return true;
+}
+
+static bool vm_strings_reserve(arx_vm_context_t *vm, size_t string_count);
+
+// Copies the strings, or with borrow keeps pointers into the caller's
+// read-only storage (a mapped module), which must outlive the VM
+static bool vm_install_strings(arx_vm_context_t *vm, char **strings, size_t string_count, bool borrow)
+{
+    if (vm == NULL) {
+        return false;
+    }
+    if (strings == NULL) {
+        vm->last_error = VM_ERROR_INVALID_ADDRESS;
+        return false;
+    }
+    
+    if (!vm_strings_reserve(vm, string_count)) {
+        vm->last_error = VM_ERROR_OUT_OF_MEMORY;
+        return false;
+    }
+    
+    for (size_t i = 0; i < string_count; i++) {
+        if (strings[i] == NULL) {
+            continue;
+        }
+        if (borrow) {
+            vm->string_table.strings[i] = strings[i];
+        } else {
+            size_t len = strlen(strings[i]) + 1;
+            vm->string_table.strings[i] = malloc(len);
+            if (vm->string_table.strings[i] != NULL) {
+                strcpy(vm->string_table.strings[i], strings[i]);
+            }
+        }
+    }
+    
+    vm->string_table.string_count = string_count;
+    vm->string_table.mapped_count = borrow ? string_count : 0;
+    
+    // Intern every literal once so VM_STRING only pushes its address
+    for (size_t i = 0; i < string_count; i++) {
+        uint64_t object_addr;
+        if (vm->string_table.strings[i] != NULL && !vm_string_literal(vm, i, &object_addr)) {
+            return false;
+        }
+    }
+    
+    if (vm->debug_mode) {
+        printf("Strings %s: %zu strings\n", borrow ? "mapped" : "loaded", string_count);
+    }
+    
+    return true;
+}
+
+bool vm_load_strings(arx_vm_context_t *vm, char **strings, size_t string_count)
+{
+    return vm_install_strings(vm, strings, string_count, false);
+}
+
+bool vm_map_strings(arx_vm_context_t *vm, char **strings, size_t string_count)
+{
+    return vm_install_strings(vm, strings, string_count, true);
+}
+
+// === Execution budget ===
+
+// Instructions between two reads of the clock while a deadline is set
+#define VM_BUDGET_CHECK_INTERVAL 4096
+
+static uint64_t vm_monotonic_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+// Pick the instruction count at which vm_budget_check() runs next
+static void vm_budget_schedule(arx_vm_context_t *vm)
+{
+    size_t next = vm->budget_limit;
+    if (vm->budget_deadline_ns != 0 &&
+        vm->budget_limit - vm->instruction_count_executed > VM_BUDGET_CHECK_INTERVAL) {
+        next = vm->instruction_count_executed + VM_BUDGET_CHECK_INTERVAL;
+    }
+    // End of the running task's turn
+    if (vm->tasks != NULL && vm->tasks->slice_end < next) {
+        next = vm->tasks->slice_end;
+    }
+    vm->budget_next_check = next;
+}
+
+// Arm the budget for one run; with no limits the check point is never reached
+static void vm_budget_start(arx_vm_context_t *vm)
+{
+    size_t executed = vm->instruction_count_executed;
+    
+    vm->budget_limit = SIZE_MAX;
+    if (vm->max_instructions > 0 && vm->max_instructions < SIZE_MAX - executed) {
+        vm->budget_limit = executed + (size_t)vm->max_instructions;
+    }
+    vm->budget_deadline_ns = 0;
+    if (vm->timeout_ms > 0) {
+        vm->budget_deadline_ns = vm_monotonic_ns() + vm->timeout_ms * 1000000ull;
+    }
+    vm_budget_schedule(vm);
+}
+
+// Called by the engines once instruction_count_executed reaches
+// budget_next_check. A run stopped here can be resumed with vm_execute().
+// The running task's turn only ends at a switch point (see
+// vm_task_switch_point()); until the engine reaches one, every check finds
+// the turn over again.
+static bool vm_budget_check(arx_vm_context_t *vm, bool switch_point)
+{
+    if (vm->instruction_count_executed >= vm->budget_limit) {
+        if (vm->debug_mode) {
+            printf("VM: Instruction budget of %llu used up at PC=%zu\n",
+                   (unsigned long long)vm->max_instructions, vm->pc);
+        }
+        vm->last_error = VM_ERROR_INSTRUCTION_LIMIT;
+        return false;
+    }
+    if (vm->budget_deadline_ns != 0 && vm_monotonic_ns() >= vm->budget_deadline_ns) {
+        if (vm->debug_mode) {
+            printf("VM: Deadline of %llu ms passed at PC=%zu after %zu instructions\n",
+                   (unsigned long long)vm->timeout_ms, vm->pc, vm->instruction_count_executed);
+        }
+        vm->last_error = VM_ERROR_TIMEOUT;
+        return false;
+    }
+    if (switch_point && vm->tasks != NULL && vm->instruction_count_executed >= vm->tasks->slice_end &&
+        !vm_task_yield(vm)) {
+        return false;
+    }
+    vm_budget_schedule(vm);
+    return true;
+}
+
+// Run native code for as long as control stays in compiled methods; calls
+// and returns between them come back through here
+static bool vm_jit_run(arx_vm_context_t *vm)
+{
+    do {
+        bool switch_point;
+        if (!vm_jit_enter(vm, &switch_point)) {
+            return false;
+        }
+        if (vm->halted || vm->pc >= vm->instruction_count) {
+            return true;
+        }
+        if (vm->instruction_count_executed >= vm->budget_next_check && !vm_budget_check(vm, switch_point)) {
+            return false;
+        }
+    } while (vm->code[vm->pc].op == VM_TOP_JIT);
+    return true;
+}
+
+void vm_set_budget(arx_vm_context_t *vm, uint64_t max_instructions, uint64_t timeout_ms)
+{
+    if (vm == NULL) {
+        return;
+    }
+    vm->max_instructions = max_instructions;
+    vm->timeout_ms = timeout_ms;
+}
+
+void vm_set_output_buffer(arx_vm_context_t *vm, size_t block)
+{
+    if (vm == NULL) {
+        return;
+    }
+    vm_output_flush(vm);
+    free(vm->output_buffer);
+    vm->output_buffer = NULL;
+    vm->output_capacity = 0;
+    vm->output_block = block;
+}
+
+bool vm_output_flush(arx_vm_context_t *vm)
+{
+    if (vm == NULL || vm->output == NULL) {
+        return false;
+    }
+    bool written = true;
+    if (vm->output_length > 0) {
+        written = fwrite(vm->output_buffer, 1, vm->output_length, vm->output) == vm->output_length;
+        vm->output_length = 0;
+    }
+    return fflush(vm->output) == 0 && written;
+}
+
+// Add program output to the buffer. What does not fit flushes it first, and
+// a write as large as the buffer goes to vm->output directly.
+static void vm_output_write(arx_vm_context_t *vm, const char *data, size_t length)
+{
+    if (vm->output_buffer == NULL) {
+        size_t capacity = vm->output_block > 0 ? vm->output_block : VM_OUTPUT_LINE_BUFFER;
+        vm->output_buffer = malloc(capacity);
+        vm->output_capacity = vm->output_buffer != NULL ? capacity : 0;
+    }
+    if (length > vm->output_capacity - vm->output_length) {
+        vm_output_flush(vm);
+        if (length >= vm->output_capacity) {
+            fwrite(data, 1, length, vm->output);
+            return;
+        }
+    }
+    memcpy(vm->output_buffer + vm->output_length, data, length);
+    vm->output_length += length;
+}
+
+// The reference engine is written once and compiled twice. The release
+// build of a step or loop passes instrumented = false, which folds every
+// diagnostic branch away; the instrumented build counts instructions for the
+// profiler, records them in the trace ring and prints the debug output.
+// vm_execute_loop() picks one when a run starts, from what runtime_init()
+// enabled.
+#if defined(__GNUC__)
+#define VM_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define VM_ALWAYS_INLINE inline
+#endif
+
+static VM_ALWAYS_INLINE bool vm_step_body(arx_vm_context_t *vm, bool instrumented);
+
+static VM_ALWAYS_INLINE bool vm_run_loop(arx_vm_context_t *vm, bool instrumented)
+{
+    if (instrumented && vm->debug_mode) {
+        printf("Starting VM execution\n");
+    }
+    
+    size_t step_count = 0;
+    size_t from = SIZE_MAX;        // Instruction run last, for vm_task_switch_point()
+    vm_budget_start(vm);
+    
+    while (!vm->halted && vm->pc < vm->instruction_count) {
+        if (vm->instruction_count_executed >= vm->budget_next_check &&
+            !vm_budget_check(vm, vm_task_switch_point(vm, from))) {
+            return false;
+        }
+        
+        if (instrumented) {
+            if (vm->debug_mode && step_count % 500 == 0) {
+                printf("VM: Step %zu, PC=%zu, instruction_count=%zu, halted=%d\n", 
+                       step_count, vm->pc, vm->instruction_count, vm->halted);
+            }
+            if (vm->profile != NULL) {
+                vm_profile_count(vm, vm->profile, vm->pc);
+            }
+        }
+        
+        if (vm->jit != NULL) {
+            uint16_t op = vm->code[vm->pc].op;
+            if (op == VM_TOP_JIT_COUNT && vm_jit_hot(vm, vm->pc)) {
+                op = VM_TOP_JIT;
+            }
+            if (op == VM_TOP_JIT) {
+                if (!vm_jit_run(vm)) {
+                    return false;
+                }
+                from = SIZE_MAX;
+                step_count++;
+                continue;
+            }
+        }
+        
+        from = vm->pc;
+        if (!vm_step_body(vm, instrumented)) {
+            if (instrumented && vm->debug_mode) {
+                printf("VM step failed at PC=%zu, instruction_count=%zu\n", 
+                       vm->pc, vm->instruction_count);
+            }
+            return false;
+        }
+        step_count++;
+    }
+    
+    if (instrumented && vm->debug_mode) {
+        printf("VM execution completed: %zu instructions executed, PC=%zu, instruction_count=%zu\n", 
+               vm->instruction_count_executed, vm->pc, vm->instruction_count);
+    }
+    
+    return true;
+}
+
+static bool vm_run_release(arx_vm_context_t *vm)
+{
+    return vm_run_loop(vm, false);
+}
+
+static bool vm_run_instrumented(arx_vm_context_t *vm)
+{
+    return vm_run_loop(vm, true);
+}
+
+static bool vm_execute_loop(arx_vm_context_t *vm)
+{
+    // The threaded engine has no per-instruction diagnostics, so debug and
+    // tracing runs always use the reference loop
+    if (vm->dispatch_mode == VM_DISPATCH_THREADED && !vm->debug_mode && vm->trace == NULL) {
+        vm_budget_start(vm);
+        return vm_threaded_run(vm, NULL);
+    }
+    
+    if (vm->debug_mode || vm->trace != NULL || vm->profile != NULL) {
+        return vm_run_instrumented(vm);
+    }
+    return vm_run_release(vm);
+}
+
+bool vm_execute(arx_vm_context_t *vm)
+{
+    if (vm == NULL) {
+        return false;
+    }
+    
+    // Whatever stopped the run, the output so far goes out before the caller
+    // reports on it
+    bool success = vm_execute_loop(vm);
+    vm_output_flush(vm);
+    return success;
+}
+
+static bool vm_step_release(arx_vm_context_t *vm)
+{
+    return vm_step_body(vm, false);
+}
+
+static bool vm_step_instrumented(arx_vm_context_t *vm)
+{
+    return vm_step_body(vm, true);
+}
+
+bool vm_step(arx_vm_context_t *vm)
+{
+    if (vm == NULL) {
+        return false;
+    }
+    if (vm->debug_mode || vm->trace != NULL) {
+        return vm_step_instrumented(vm);
+    }
+    return vm_step_release(vm);
+}
+
+static VM_ALWAYS_INLINE bool vm_step_body(arx_vm_context_t *vm, bool instrumented)
+{
+    if (vm->halted || vm->pc >= vm->instruction_count) {
+        if (instrumented && vm->debug_mode) {
+            printf("VM step: halted=%d, pc=%zu, instruction_count=%zu\n", 
+                   vm->halted, vm->pc, vm->instruction_count);
+        }
+        return false;
+    }
+    
+    // Operands were verified by vm_load_program()
+    const vm_instruction_t *instr = &vm->code[vm->pc];
+    uint8_t opcode = instr->opcode;
+    uint8_t level = instr->level;
+    uint64_t operand = instr->operand;
+    
+    if (instrumented) {
+        if (vm->trace != NULL) {
+            vm_trace_record(vm->trace, vm, instr);
+        }
+        if (vm->debug_mode) {
+            printf("PC=%zu: raw_opcode=0x%02x, opcode=%d, level=%d, operand=%llu\n", 
+                   vm->pc, (unsigned)((level << 4) | opcode), opcode, level, (unsigned long long)operand);
+        }
+    }
+    
+    bool success = true;
+    
+    switch (opcode) {
+        case VM_LIT:
+            success = vm_push(vm, operand);
+            break;
+            
         case VM_OPR:
             success = vm_execute_operation(vm, (opr_t)operand, level, operand);
             break;
             
         case VM_LOD:
             success = vm_execute_load(vm, level, operand);
-            if (vm->debug_mode && vm->pc >= 13 && vm->pc <= 30) {
-                printf("DEBUG: VM_LOD at PC=%zu, success=%d, level=%d, operand=%llu, stack_top=%zu\n", 
-                       vm->pc, success, level, (unsigned long long)operand, vm->stack_top);
-            }
             break;
             
         case VM_STO:
             success = vm_execute_store(vm, level, operand);
-            if (vm->debug_mode && vm->pc >= 13 && vm->pc <= 30) {
-                printf("DEBUG: VM_STO at PC=%zu, success=%d, level=%d, operand=%llu, stack_top=%zu\n", 
-                       vm->pc, success, level, (unsigned long long)operand, vm->stack_top);
-            }
             break;
             
         case VM_CAL:
@@ -429,44 +1318,15 @@ bool vm_step(arx_vm_context_t *vm)
             break;
             
         case VM_JMP:
-            if (vm->debug_mode && vm->pc >= 13 && vm->pc <= 30) {
-                printf("DEBUG: VM_JMP at PC=%zu, jumping to %llu\n", 
-                       vm->pc, (unsigned long long)operand);
-            }
-            // Safety check: prevent jumping to invalid address
-            if (operand >= vm->instruction_count) {
-                if (vm->debug_mode) {
-                    printf("VM_JMP: Invalid jump target %llu >= instruction_count %zu\n", 
-                           (unsigned long long)operand, vm->instruction_count);
-                }
-                vm->halted = true;
-                success = false;
-            } else {
-                vm->pc = operand;
-            }
+            vm->pc = operand;
             break;
             
         case VM_JPC:
             {
                 uint64_t condition;
                 if (vm_pop(vm, &condition)) {
-                    if (vm->debug_mode && vm->pc >= 13 && vm->pc <= 30) {
-                        printf("DEBUG: VM_JPC at PC=%zu, condition=%llu, jumping to %llu (condition==0? %s)\n", 
-                               vm->pc, (unsigned long long)condition, (unsigned long long)operand, 
-                               (condition == 0) ? "YES" : "NO");
-                    }
                     if (condition == 0) {
-                        // Safety check: prevent jumping to invalid address
-                        if (operand >= vm->instruction_count) {
-                            if (vm->debug_mode) {
-                                printf("VM_JPC: Invalid jump target %llu >= instruction_count %zu\n", 
-                                       (unsigned long long)operand, vm->instruction_count);
-                            }
-                            vm->halted = true;
-                            success = false;
-                        } else {
-                            vm->pc = operand;
-                        }
+                        vm->pc = operand;
                     } else {
                         vm->pc++;
                     }
@@ -486,17 +1346,9 @@ bool vm_step(arx_vm_context_t *vm)
             
         case VM_STRING:
             {
-                // Load string literal as object - operand is string ID
-                uint64_t string_id = operand;
-                const char *str;
-                if (!vm_load_string(vm, string_id, &str)) {
-                    success = false;
-                    break;
-                }
-                
-                // Create string object and push its address
+                // Push the interned object for the literal - operand is string ID
                 uint64_t object_addr;
-                if (!vm_string_create_from_cstr(vm, str, &object_addr)) {
+                if (!vm_string_literal(vm, operand, &object_addr)) {
                     success = false;
                     break;
                 }
@@ -509,39 +1361,526 @@ bool vm_step(arx_vm_context_t *vm)
             }
             break;
             
-        case VM_HALT:
-            vm_halt(vm);
-            break;
-            
-        default:
-            if (vm->debug_mode) {
-                printf("Error: Unknown opcode %d\n", opcode);
-            }
-            last_error = VM_ERROR_INVALID_INSTRUCTION;
+        case VM_CALS:
+            {
+                // An external reference is bound on the first call, before
+                // the receiver leaves the stack (linking allocates literals),
+                // and the call site then keeps the slot
+                if (operand & ARXMOD_EXTERN_CALL) {
+                    if (!vm_bind_method(vm, operand & ~ARXMOD_EXTERN_CALL, &operand)) {
+                        success = false;
+                        break;
+                    }
+                    vm->code[vm->pc].operand = operand;
+                }
+                
+                // Dispatch through the receiver's vtable - operand is the method slot
+                uint64_t object_address;
+                if (!vm_pop(vm, &object_address)) {
+                    success = false;
+                    break;
+                }
+                
+                memory_manager_t *mm = &vm->memory_manager;
+                uint32_t object_slot = vm_heap_contains(vm, object_address, 0) ?
+                    mm->address_index[object_address - mm->heap_base] : 0;
+                uint32_t class_index = object_slot != 0 ? mm->objects[object_slot - 1].class_index : 0;
+                if (class_index == 0) {
+                    printf("Error: Method call on %llu, which is not an object\n",
+                           (unsigned long long)object_address);
+                    vm->last_error = VM_ERROR_INVALID_ADDRESS;
+                    success = false;
+                    break;
+                }
+                
+                uint64_t target = vm->class_system.vtables[(size_t)(class_index - 1) * vm->class_system.vtable_width + operand];
+                if (target == VM_VTABLE_EMPTY) {
+                    printf("Error: Class %s has no method in slot %llu\n",
+                           vm->class_system.classes[class_index - 1].class_name, (unsigned long long)operand);
+                    vm->last_error = VM_ERROR_INVALID_ADDRESS;
+                    success = false;
+                    break;
+                }
+                
+                if (instrumented && vm->debug_mode) {
+                    printf("VM_CALS: slot %llu of class %s -> PC=%llu%s\n", (unsigned long long)operand,
+                           vm->class_system.classes[class_index - 1].class_name, (unsigned long long)target,
+                           level == 1 ? " (tail)" : "");
+                }
+                
+                // A tail call (level 1) runs the method in the caller's
+                // record. A receiver tied to that record dies with it; the
+                // method has been found, and it gets no reference to it.
+                if (level == 1 && vm_reuse_call_stack(vm)) {
+                    vm_release_frame_object(vm, object_address);
+                    vm->pc = target;
+                    break;
+                }
+                
+                success = vm_push_call_stack(vm, vm->pc + 1);
+                if (success) {
+                    vm->pc = target;
+                }
+            }
+            break;
+            
+        case VM_HALT:
+            vm_halt(vm);
+            break;
+            
+        default:
+            if (instrumented && vm->debug_mode) {
+                printf("Error: Unknown opcode %d\n", opcode);
+            }
+            vm->last_error = VM_ERROR_INVALID_INSTRUCTION;
             success = false;
             break;
     }
     
-    if (success && opcode != VM_JMP && opcode != VM_JPC && opcode != VM_HALT) {
+    // Jumps, calls, returns and task operations have already set pc
+    bool transfers_control = opcode == VM_JMP || opcode == VM_JPC || opcode == VM_HALT || opcode == VM_CAL || opcode == VM_CALS ||
+        (opcode == VM_OPR && (operand == OPR_RET || operand == OPR_OBJ_CALL_METHOD || operand == OPR_TASK_SPAWN ||
+                              operand == OPR_TASK_YIELD || operand == OPR_TASK_JOIN));
+    if (success && !transfers_control) {
         vm->pc++;
     }
     
-    if (vm->debug_mode && vm->pc >= 170) {
-        printf("DEBUG: After instruction at PC=%zu, success=%d, new_pc=%zu\n", 
-               vm->pc - 1, success, vm->pc);
+    vm->instruction_count_executed++;
+    
+    return success;
+}
+
+// === Threaded-code engine ===
+// vm_execute_threaded() jumps directly from one handler to the next through
+// the handler stored in each decoded instruction: via computed goto with
+// GCC/Clang, through a switch elsewhere. pc, the stack pointer and the
+// top-of-stack value live in locals. Only the hot instructions are handled
+// inline; everything else is handed to vm_step() with the locals written
+// back, so both engines share one definition of every instruction.
+
+// VM_T_FALLBACK runs the plain handler for the instruction at pc; it lets a
+// superinstruction execute its sequence unfused
+#if VM_THREADED_COMPUTED_GOTO
+#define VM_T_CASE(name) op_##name:
+#define VM_T_DISPATCH() goto *code[pc].handler
+#define VM_T_FALLBACK(name) goto op_##name
+#else
+#define VM_T_CASE(name) case VM_TOP_##name:
+#define VM_T_DISPATCH() goto dispatch
+#define VM_T_FALLBACK(name) do { op = VM_TOP_##name; goto dispatch_op; } while (0)
+#endif
+
+// Count the instruction just executed and move on to code[pc]
+#define VM_T_NEXT() do { executed++; VM_T_DISPATCH(); } while (0)
+// Skip over the n instructions covered by a superinstruction
+#define VM_T_ADVANCE(n) do { pc += (n); executed += (n); VM_T_DISPATCH(); } while (0)
+// Count n instructions and jump to target. Every loop runs through a backward
+// jump, so that is where the execution budget is polled.
+#define VM_T_JUMP(target, n) do { \
+        size_t target_ = (target); \
+        executed += (n); \
+        if (target_ <= pc && executed >= slice) { \
+            pc = target_; \
+            goto budget_check; \
+        } \
+        pc = target_; \
+        VM_T_DISPATCH(); \
+    } while (0)
+
+// Write the cached registers back to the VM context / reload them from it
+#define VM_T_SYNC() do { \
+        if (sp > 0) stack[sp - 1] = tos; \
+        vm->stack_top = sp; \
+        vm->pc = pc; \
+        vm->instruction_count_executed += executed; \
+        executed = 0; \
+    } while (0)
+#define VM_T_RELOAD() do { \
+        code = vm->code; \
+        pc = vm->pc; \
+        sp = vm->stack_top; \
+        tos = sp > 0 ? stack[sp - 1] : 0; \
+        locals = vm->locals; \
+        stack_size = vm->stack_size; \
+        slice = vm->budget_next_check > vm->instruction_count_executed ? \
+                vm->budget_next_check - vm->instruction_count_executed : 0; \
+    } while (0)
+
+// Stack access with the top element cached in `tos`; slots below it are in
+// memory. A full stack grows in place, so `stack` stays valid.
+#define VM_T_PUSH(value) do { \
+        if (sp >= stack_size) { \
+            if (!vm_stack_grow(vm, sp + 1)) goto stack_overflow; \
+            stack_size = vm->stack_size; \
+        } \
+        if (sp > 0) stack[sp - 1] = tos; \
+        tos = (value); \
+        sp++; \
+    } while (0)
+#define VM_T_DROP() do { \
+        sp--; \
+        tos = sp > 0 ? stack[sp - 1] : 0; \
+    } while (0)
+#define VM_T_UNARY(expr) do { \
+        if (sp < 1) goto stack_underflow; \
+        tos = (expr); \
+        pc++; \
+        VM_T_NEXT(); \
+    } while (0)
+// Binary operations see the left operand as `a` and the right one as `tos`
+#define VM_T_BINARY(expr) do { \
+        if (sp < 2) goto stack_underflow; \
+        a = stack[sp - 2]; \
+        sp--; \
+        tos = (expr); \
+        pc++; \
+        VM_T_NEXT(); \
+    } while (0)
+
+// With handler_table set, only report the label table used by
+// vm_decode_program() (NULL on switch builds)
+static bool vm_threaded_run(arx_vm_context_t *vm, const void *const **handler_table)
+{
+#if VM_THREADED_COMPUTED_GOTO
+    static const void *const handlers[VM_TOP_COUNT] = {
+#define VM_THREADED_LABEL(name) &&op_##name,
+        VM_THREADED_OPS(VM_THREADED_LABEL)
+#undef VM_THREADED_LABEL
+#define VM_FUSED_BINOP_LABEL(op) &&op_LL_##op, &&op_LLS_##op, &&op_LK_##op, &&op_LKS_##op, &&op_K_##op,
+        VM_FUSED_BINOPS(VM_FUSED_BINOP_LABEL)
+#undef VM_FUSED_BINOP_LABEL
+#define VM_FUSED_CMPOP_LABEL(op) &&op_LLJ_##op, &&op_LKJ_##op, &&op_J_##op,
+        VM_FUSED_CMPOPS(VM_FUSED_CMPOP_LABEL)
+#undef VM_FUSED_CMPOP_LABEL
+        &&op_INC_LOCAL,
+    };
+#else
+    static const void *const *const handlers = NULL;
+#endif
+    
+    if (handler_table != NULL) {
+        *handler_table = handlers;
+        return true;
+    }
+    
+    if (vm->halted || vm->pc >= vm->instruction_count) {
+        return true;
+    }
+    
+    const vm_instruction_t *code;  // Moves when vm_step() links a module
+    uint64_t *stack = vm->stack;
+    uint64_t *locals, *outer;
+    size_t stack_size = vm->stack_size;
+    size_t pc, sp;
+    uint64_t tos, a;
+    size_t executed = 0;
+    size_t slice;                  // Instructions left before the next budget check
+    
+    VM_T_RELOAD();
+    
+#if VM_THREADED_COMPUTED_GOTO
+    VM_T_DISPATCH();
+#else
+    uint32_t op;
+dispatch:
+    op = code[pc].op;
+    if (vm->profile != NULL && op != VM_TOP_END) {
+        vm_profile_count(vm, vm->profile, pc);
+    }
+dispatch_op:
+    switch (op) {
+#endif
+    
+    VM_T_CASE(LIT)
+        VM_T_PUSH(code[pc].operand);
+        pc++;
+        VM_T_NEXT();
+    
+    VM_T_CASE(LOD)
+        VM_T_PUSH(locals[code[pc].operand]);
+        pc++;
+        VM_T_NEXT();
+    
+    VM_T_CASE(STO)
+        if (sp < 1) goto stack_underflow;
+        locals[code[pc].operand] = tos;
+        VM_T_DROP();
+        pc++;
+        VM_T_NEXT();
+    
+    // Variables of enclosing records are reached through the static chain
+    VM_T_CASE(LOD_LEVEL)
+        outer = vm_frame_locals(vm, code[pc].level);
+        if (outer == NULL) goto invalid_level;
+        VM_T_PUSH(outer[code[pc].operand]);
+        pc++;
+        VM_T_NEXT();
+    
+    VM_T_CASE(STO_LEVEL)
+        if (sp < 1) goto stack_underflow;
+        outer = vm_frame_locals(vm, code[pc].level);
+        if (outer == NULL) goto invalid_level;
+        outer[code[pc].operand] = tos;
+        VM_T_DROP();
+        pc++;
+        VM_T_NEXT();
+    
+    VM_T_CASE(JMP)
+        VM_T_JUMP(code[pc].operand, 1);
+    
+    VM_T_CASE(JPC)
+        if (sp < 1) goto stack_underflow;
+        a = tos;
+        VM_T_DROP();
+        if (a == 0) VM_T_JUMP(code[pc].operand, 1);
+        pc++;
+        VM_T_NEXT();
+    
+    VM_T_CASE(HALT)
+        executed++;
+        VM_T_SYNC();
+        vm_halt(vm);
+        return true;
+    
+    VM_T_CASE(NEG)     VM_T_UNARY((uint64_t)(-(int64_t)tos));
+    VM_T_CASE(ODD)     VM_T_UNARY((tos % 2) ? 1 : 0);
+    VM_T_CASE(NOT)     VM_T_UNARY((tos == 0) ? 1 : 0);
+    VM_T_CASE(ADD)     VM_T_BINARY(VM_OP_ADD(a, tos));
+    VM_T_CASE(SUB)     VM_T_BINARY(VM_OP_SUB(a, tos));
+    VM_T_CASE(MUL)     VM_T_BINARY(VM_OP_MUL(a, tos));
+    VM_T_CASE(EQ)      VM_T_BINARY(VM_OP_EQ(a, tos));
+    VM_T_CASE(NEQ)     VM_T_BINARY(VM_OP_NEQ(a, tos));
+    VM_T_CASE(LESS)    VM_T_BINARY(VM_OP_LESS(a, tos));
+    VM_T_CASE(LEQ)     VM_T_BINARY(VM_OP_LEQ(a, tos));
+    VM_T_CASE(GREATER) VM_T_BINARY(VM_OP_GREATER(a, tos));
+    VM_T_CASE(GEQ)     VM_T_BINARY(VM_OP_GEQ(a, tos));
+    VM_T_CASE(AND)     VM_T_BINARY(VM_OP_AND(a, tos));
+    VM_T_CASE(OR)      VM_T_BINARY(VM_OP_OR(a, tos));
+    
+    VM_T_CASE(RNEG)        VM_T_UNARY(vm_real_word(-vm_word_real(tos)));
+    VM_T_CASE(INT_TO_REAL) VM_T_UNARY(vm_real_word((double)(int64_t)tos));
+    VM_T_CASE(REAL_TO_INT) VM_T_UNARY(vm_real_to_int(vm_word_real(tos)));
+    VM_T_CASE(RADD)        VM_T_BINARY(VM_OP_RADD(a, tos));
+    VM_T_CASE(RSUB)        VM_T_BINARY(VM_OP_RSUB(a, tos));
+    VM_T_CASE(RMUL)        VM_T_BINARY(VM_OP_RMUL(a, tos));
+    VM_T_CASE(REQ)         VM_T_BINARY(VM_OP_REQ(a, tos));
+    VM_T_CASE(RNEQ)        VM_T_BINARY(VM_OP_RNEQ(a, tos));
+    VM_T_CASE(RLESS)       VM_T_BINARY(VM_OP_RLESS(a, tos));
+    VM_T_CASE(RLEQ)        VM_T_BINARY(VM_OP_RLEQ(a, tos));
+    VM_T_CASE(RGREATER)    VM_T_BINARY(VM_OP_RGREATER(a, tos));
+    VM_T_CASE(RGEQ)        VM_T_BINARY(VM_OP_RGEQ(a, tos));
+    
+    // Superinstructions. Whenever the stack is too close to a limit for the
+    // fused form to fail in the same way, they fall back to the handler of
+    // their first instruction and run the sequence unfused.
+#define VM_T_FUSED_BINOP(op) \
+    VM_T_CASE(LL_##op) \
+        if (sp + 2 > stack_size) VM_T_FALLBACK(LOD); \
+        VM_T_PUSH(VM_OP_##op(locals[code[pc].operand], locals[code[pc + 1].operand])); \
+        VM_T_ADVANCE(3); \
+    VM_T_CASE(LLS_##op) \
+        if (sp + 2 > stack_size) VM_T_FALLBACK(LOD); \
+        locals[code[pc + 3].operand] = VM_OP_##op(locals[code[pc].operand], locals[code[pc + 1].operand]); \
+        VM_T_ADVANCE(4); \
+    VM_T_CASE(LK_##op) \
+        if (sp + 2 > stack_size) VM_T_FALLBACK(LOD); \
+        VM_T_PUSH(VM_OP_##op(locals[code[pc].operand], code[pc + 1].operand)); \
+        VM_T_ADVANCE(3); \
+    VM_T_CASE(LKS_##op) \
+        if (sp + 2 > stack_size) VM_T_FALLBACK(LOD); \
+        locals[code[pc + 3].operand] = VM_OP_##op(locals[code[pc].operand], code[pc + 1].operand); \
+        VM_T_ADVANCE(4); \
+    VM_T_CASE(K_##op) \
+        if (sp < 1 || sp >= stack_size) VM_T_FALLBACK(LIT); \
+        tos = VM_OP_##op(tos, code[pc].operand); \
+        VM_T_ADVANCE(2);
+    VM_FUSED_BINOPS(VM_T_FUSED_BINOP)
+#undef VM_T_FUSED_BINOP
+    
+    // JPC branches when the comparison is false
+#define VM_T_FUSED_CMPOP(op) \
+    VM_T_CASE(LLJ_##op) \
+        if (sp + 2 > stack_size) VM_T_FALLBACK(LOD); \
+        if (VM_OP_##op(locals[code[pc].operand], locals[code[pc + 1].operand])) VM_T_ADVANCE(4); \
+        VM_T_JUMP(code[pc + 3].operand, 4); \
+    VM_T_CASE(LKJ_##op) \
+        if (sp + 2 > stack_size) VM_T_FALLBACK(LOD); \
+        if (VM_OP_##op(locals[code[pc].operand], code[pc + 1].operand)) VM_T_ADVANCE(4); \
+        VM_T_JUMP(code[pc + 3].operand, 4); \
+    VM_T_CASE(J_##op) \
+        if (sp < 2) VM_T_FALLBACK(op); \
+        a = VM_OP_##op(stack[sp - 2], tos); \
+        sp -= 2; \
+        tos = sp > 0 ? stack[sp - 1] : 0; \
+        if (a) VM_T_ADVANCE(2); \
+        VM_T_JUMP(code[pc + 1].operand, 2);
+    VM_FUSED_CMPOPS(VM_T_FUSED_CMPOP)
+#undef VM_T_FUSED_CMPOP
+    
+    VM_T_CASE(INC_LOCAL)
+        if (sp + 2 > stack_size) VM_T_FALLBACK(LOD);
+        locals[code[pc].operand] += code[pc + 1].operand;
+        VM_T_ADVANCE(4);
+    
+    VM_T_CASE(DIV)
+        if (sp >= 2 && tos == 0) goto division_by_zero;
+        VM_T_BINARY(vm_int_div(a, tos));
+    
+    VM_T_CASE(MOD)
+        if (sp >= 2 && tos == 0) goto division_by_zero;
+        VM_T_BINARY(vm_int_mod(a, tos));
+    
+    VM_T_CASE(RDIV)
+        if (sp >= 2 && vm_word_real(tos) == 0.0) goto division_by_zero;
+        VM_T_BINARY(VM_OP_RDIV(a, tos));
+    
+    VM_T_CASE(STEP)
+        // Everything without an inline handler runs through vm_step(),
+        // which also advances pc and the executed-instruction counter
+        VM_T_SYNC();
+        if (!vm_step(vm)) {
+            return false;
+        }
+        if (vm->halted || vm->pc >= vm->instruction_count) {
+            return true;
+        }
+        // Calls and returns come through here, so recursion without loops
+        // still reaches a budget check; pc is still the instruction just run
+        if (vm->instruction_count_executed >= vm->budget_next_check &&
+            !vm_budget_check(vm, vm_task_switch_point(vm, pc))) {
+            return false;
+        }
+        VM_T_RELOAD();
+        VM_T_DISPATCH();
+    
+    VM_T_CASE(END)
+        VM_T_SYNC();
+        return true;
+    
+    // Instructions of compiled methods
+    VM_T_CASE(JIT)
+        VM_T_SYNC();
+        if (!vm_jit_run(vm)) {
+            return false;
+        }
+        if (vm->halted || vm->pc >= vm->instruction_count) {
+            return true;
+        }
+        VM_T_RELOAD();
+        VM_T_DISPATCH();
+    
+    // Entries and loop headers of methods not compiled yet; the counted
+    // instruction then runs under its own handler
+    VM_T_CASE(JIT_COUNT)
+        if (vm_jit_hot(vm, pc)) {
+            VM_T_FALLBACK(JIT);
+        }
+#if VM_THREADED_COMPUTED_GOTO
+        goto *handlers[vm->jit->ops[pc]];
+#else
+        op = vm->jit->ops[pc];
+        goto dispatch_op;
+#endif
+    
+#if VM_THREADED_COMPUTED_GOTO
+    // vm_decode_range() points every instruction here while profiling;
+    // switch builds count at dispatch instead
+    VM_T_CASE(PROFILE)
+        vm_profile_count(vm, vm->profile, pc);
+        goto *handlers[code[pc].op];
+#else
+    default:
+        executed++;
+        VM_T_SYNC();
+        vm->last_error = VM_ERROR_INVALID_INSTRUCTION;
+        return false;
+    }
+#endif
+    
+budget_check:
+    // Only reached from backward jumps, which are switch points
+    VM_T_SYNC();
+    if (!vm_budget_check(vm, true)) {
+        return false;
     }
+    VM_T_RELOAD();
+    VM_T_DISPATCH();
     
-    vm->instruction_count_executed++;
+invalid_level:
+    // vm_frame_locals() has set last_error
+    executed++;
+    VM_T_SYNC();
+    return false;
+    
+stack_overflow:
+    // vm_stack_grow() has set last_error
+    executed++;
+    VM_T_SYNC();
+    vm->halted = true;
+    return false;
+    
+stack_underflow:
+    // vm_pop() empties the stack before it reports underflow
+    executed++;
+    sp = 0;
+    VM_T_SYNC();
+    vm->last_error = VM_ERROR_STACK_UNDERFLOW;
+    vm->halted = true;
+    return false;
     
+division_by_zero:
+    // Both operands are consumed, as in vm_execute_operation()
+    executed++;
+    sp -= 2;
+    tos = sp > 0 ? stack[sp - 1] : 0;
+    VM_T_SYNC();
+    vm->last_error = VM_ERROR_DIVISION_BY_ZERO;
+    return false;
+}
+
+bool vm_execute_threaded(arx_vm_context_t *vm)
+{
+    if (vm == NULL) {
+        return false;
+    }
+    vm_budget_start(vm);
+    bool success = vm_threaded_run(vm, NULL);
+    vm_output_flush(vm);
     return success;
 }
 
+#undef VM_T_CASE
+#undef VM_T_DISPATCH
+#undef VM_T_FALLBACK
+#undef VM_T_NEXT
+#undef VM_T_ADVANCE
+#undef VM_T_JUMP
+#undef VM_T_SYNC
+#undef VM_T_RELOAD
+#undef VM_T_PUSH
+#undef VM_T_DROP
+#undef VM_T_UNARY
+#undef VM_T_BINARY
+
 bool vm_execute_operation(arx_vm_context_t *vm, opr_t operation, uint8_t level, uint64_t operand)
 {
     (void)level; // Suppress unused parameter warning
     switch (operation) {
         case OPR_RET:
-            return vm_return(vm);
+            if (!vm_return(vm)) {
+                return false;
+            }
+            // Returning from the outermost procedure (App.Main) ends the
+            // program, or with tasks the running task
+            if (vm->call_stack.current_frame == 0) {
+                if (vm->tasks != NULL) {
+                    bool exited = vm_task_exit(vm);
+                    vm_budget_schedule(vm);
+                    return exited;
+                }
+                vm_halt(vm);
+            }
+            return true;
             
         case OPR_NEG:
             {
@@ -556,12 +1895,7 @@ bool vm_execute_operation(arx_vm_context_t *vm, opr_t operation, uint8_t level,
             {
                 uint64_t b, a;
                 if (vm_pop(vm, &b) && vm_pop(vm, &a)) {
-                    uint64_t result = a + b;
-                    if (vm->debug_mode && vm->pc >= 13 && vm->pc <= 30) {
-                        printf("DEBUG: OPR_ADD at PC=%zu, a=%llu, b=%llu, result=%llu\n", 
-                               vm->pc, (unsigned long long)a, (unsigned long long)b, (unsigned long long)result);
-                    }
-                    return vm_push(vm, result);
+                    return vm_push(vm, a + b);
                 }
                 return false;
             }
@@ -589,10 +1923,10 @@ bool vm_execute_operation(arx_vm_context_t *vm, opr_t operation, uint8_t level,
                 uint64_t b, a;
                 if (vm_pop(vm, &b) && vm_pop(vm, &a)) {
                     if (b == 0) {
-                        last_error = VM_ERROR_INVALID_INSTRUCTION;
+                        vm->last_error = VM_ERROR_DIVISION_BY_ZERO;
                         return false;
                     }
-                    return vm_push(vm, a / b);
+                    return vm_push(vm, vm_int_div(a, b));
                 }
                 return false;
             }
@@ -616,10 +1950,10 @@ bool vm_execute_operation(arx_vm_context_t *vm, opr_t operation, uint8_t level,
                 uint64_t b, a;
                 if (vm_pop(vm, &b) && vm_pop(vm, &a)) {
                     if (b == 0) {
-                        last_error = VM_ERROR_INVALID_INSTRUCTION;
+                        vm->last_error = VM_ERROR_DIVISION_BY_ZERO;
                         return false;
                     }
-                    return vm_push(vm, a % b);
+                    return vm_push(vm, vm_int_mod(a, b));
                 }
                 return false;
             }
@@ -655,7 +1989,7 @@ bool vm_execute_operation(arx_vm_context_t *vm, opr_t operation, uint8_t level,
             {
                 uint64_t b, a;
                 if (vm_pop(vm, &b) && vm_pop(vm, &a)) {
-                    return vm_push(vm, (a < b) ? 1 : 0);
+                    return vm_push(vm, VM_OP_LESS(a, b));
                 }
                 return false;
             }
@@ -664,13 +1998,7 @@ bool vm_execute_operation(arx_vm_context_t *vm, opr_t operation, uint8_t level,
             {
                 uint64_t b, a;
                 if (vm_pop(vm, &b) && vm_pop(vm, &a)) {
-                    uint64_t result = (a <= b) ? 1 : 0;
-                    if (vm->debug_mode && vm->pc >= 13 && vm->pc <= 30) {
-                        printf("DEBUG: OPR_LEQ at PC=%zu, a=%llu, b=%llu, result=%llu (a<=b? %s)\n", 
-                               vm->pc, (unsigned long long)a, (unsigned long long)b, (unsigned long long)result,
-                               (a <= b) ? "YES" : "NO");
-                    }
-                    return vm_push(vm, result);
+                    return vm_push(vm, VM_OP_LEQ(a, b));
                 }
                 return false;
             }
@@ -679,7 +2007,7 @@ bool vm_execute_operation(arx_vm_context_t *vm, opr_t operation, uint8_t level,
             {
                 uint64_t b, a;
                 if (vm_pop(vm, &b) && vm_pop(vm, &a)) {
-                    return vm_push(vm, (a > b) ? 1 : 0);
+                    return vm_push(vm, VM_OP_GREATER(a, b));
                 }
                 return false;
             }
@@ -688,7 +2016,7 @@ bool vm_execute_operation(arx_vm_context_t *vm, opr_t operation, uint8_t level,
             {
                 uint64_t b, a;
                 if (vm_pop(vm, &b) && vm_pop(vm, &a)) {
-                    return vm_push(vm, (a >= b) ? 1 : 0);
+                    return vm_push(vm, VM_OP_GEQ(a, b));
                 }
                 return false;
             }
@@ -723,10 +2051,63 @@ bool vm_execute_operation(arx_vm_context_t *vm, opr_t operation, uint8_t level,
                 return false;
             }
             
+        case OPR_RNEG:
+        case OPR_INT_TO_REAL:
+        case OPR_REAL_TO_INT:
+            {
+                uint64_t a;
+                if (!vm_pop(vm, &a)) {
+                    return false;
+                }
+                if (operation == OPR_RNEG) {
+                    return vm_push(vm, vm_real_word(-vm_word_real(a)));
+                }
+                if (operation == OPR_INT_TO_REAL) {
+                    return vm_push(vm, vm_real_word((double)(int64_t)a));
+                }
+                return vm_push(vm, vm_real_to_int(vm_word_real(a)));
+            }
+            
+        case OPR_RADD:
+        case OPR_RSUB:
+        case OPR_RMUL:
+        case OPR_RDIV:
+        case OPR_REQ:
+        case OPR_RNEQ:
+        case OPR_RLESS:
+        case OPR_RLEQ:
+        case OPR_RGREATER:
+        case OPR_RGEQ:
+            {
+                uint64_t b, a;
+                if (!vm_pop(vm, &b) || !vm_pop(vm, &a)) {
+                    return false;
+                }
+                switch (operation) {
+                    case OPR_RADD: return vm_push(vm, VM_OP_RADD(a, b));
+                    case OPR_RSUB: return vm_push(vm, VM_OP_RSUB(a, b));
+                    case OPR_RMUL: return vm_push(vm, VM_OP_RMUL(a, b));
+                    case OPR_RDIV:
+                        if (vm_word_real(b) == 0.0) {
+                            vm->last_error = VM_ERROR_DIVISION_BY_ZERO;
+                            return false;
+                        }
+                        return vm_push(vm, VM_OP_RDIV(a, b));
+                    case OPR_REQ: return vm_push(vm, VM_OP_REQ(a, b));
+                    case OPR_RNEQ: return vm_push(vm, VM_OP_RNEQ(a, b));
+                    case OPR_RLESS: return vm_push(vm, VM_OP_RLESS(a, b));
+                    case OPR_RLEQ: return vm_push(vm, VM_OP_RLEQ(a, b));
+                    case OPR_RGREATER: return vm_push(vm, VM_OP_RGREATER(a, b));
+                    default: return vm_push(vm, VM_OP_RGEQ(a, b));
+                }
+            }
+            
         case OPR_WRITELN:
             // WriteLn - output newline (no stack operation needed)
-            printf("\n");
-            fflush(stdout);
+            vm_output_write(vm, "\n", 1);
+            if (vm->output_block == 0) {
+                vm_output_flush(vm);
+            }
             return true;
             
         case OPR_OUTSTRING:
@@ -735,30 +2116,17 @@ bool vm_execute_operation(arx_vm_context_t *vm, opr_t operation, uint8_t level,
                 if (!vm_pop(vm, &val)) return false;
                 
                 // Check if it's a string object address (new system)
-                if (val + 2 < vm->stack_size) {
-                    uint64_t len = vm->stack[val + 0];
-                    uint64_t cap = vm->stack[val + 1];
-                    uint64_t off = vm->stack[val + 2];
-                    if (off == 3 && cap >= len && cap <= 1<<20) {
-                        size_t data_words = (cap + 1 + sizeof(uint64_t) - 1) / sizeof(uint64_t);
-                        if (val + off + data_words < vm->stack_size) {
-                            char buf[2048];
-                            const char *src = (const char*)&vm->stack[val + off];
-                            size_t to_copy = (len < (sizeof(buf) - 1)) ? (size_t)len : (sizeof(buf) - 1);
-                            memcpy(buf, src, to_copy);
-                            buf[to_copy] = '\0';
-                            printf("%s", buf);
-                            fflush(stdout);
-                            return true;
-                        }
-                    }
+                const char *data;
+                uint64_t len;
+                if (vm_string_view(vm, val, &data, &len)) {
+                    vm_output_write(vm, data, (size_t)len);
+                    return true;
                 }
                 
                 // Fallback: treat as string ID (legacy system)
                 const char *str;
                 if (vm_load_string(vm, val, &str)) {
-                    printf("%s", str);
-                    fflush(stdout);
+                    vm_output_write(vm, str, strlen(str));
                     return true;
                 }
                 
@@ -777,59 +2145,109 @@ bool vm_execute_operation(arx_vm_context_t *vm, opr_t operation, uint8_t level,
                 if (vm->debug_mode) {
                     printf("OPR_STR_CONCAT: Starting string concatenation at PC=%zu\n", vm->pc);
                 }
+                // The operands stay on the stack until the result exists, so
+                // a collection triggered by the allocation keeps them alive
                 uint64_t str2_addr, str1_addr;
-                if (vm_pop(vm, &str2_addr) && vm_pop(vm, &str1_addr)) {
+                if (!vm_peek(vm, 0, &str2_addr) || !vm_peek(vm, 1, &str1_addr)) {
                     if (vm->debug_mode) {
-                        printf("OPR_STR_CONCAT: str1_addr=%llu, str2_addr=%llu\n", 
-                               (unsigned long long)str1_addr, (unsigned long long)str2_addr);
+                        printf("OPR_STR_CONCAT: FAILED to pop string addresses from stack at PC=%zu\n", vm->pc);
                     }
-                    
-                    // Extract string content from string objects
-                    char str1_buf[1024], str2_buf[1024];
-                    if (vm_string_copy_to_buffer(vm, str1_addr, str1_buf, sizeof(str1_buf)) &&
-                        vm_string_copy_to_buffer(vm, str2_addr, str2_buf, sizeof(str2_buf))) {
-                        
-                        if (vm->debug_mode) {
-                            printf("OPR_STR_CONCAT: str1='%s', str2='%s'\n", str1_buf, str2_buf);
-                        }
-                        
-                        // Concatenate strings
-                        char *result = malloc(strlen(str1_buf) + strlen(str2_buf) + 1);
-                        if (result != NULL) {
-                            strcpy(result, str1_buf);
-                            strcat(result, str2_buf);
-                            
-                            // Create new string object
-                            uint64_t result_addr;
-                            if (vm_string_create_from_cstr(vm, result, &result_addr)) {
-                                if (vm->debug_mode) {
-                                    printf("OPR_STR_CONCAT: created result object at address %llu\n", 
-                                           (unsigned long long)result_addr);
-                                }
-                                free(result);
-                                return vm_push(vm, result_addr);
-                            } else {
-                                if (vm->debug_mode) {
-                                    printf("OPR_STR_CONCAT: FAILED to create result string object\n");
-                                }
-                                free(result);
-                            }
-                        } else {
-                            if (vm->debug_mode) {
-                                printf("OPR_STR_CONCAT: FAILED to allocate memory for result\n");
-                            }
-                        }
-                    } else {
-                        if (vm->debug_mode) {
-                            printf("OPR_STR_CONCAT: FAILED to extract string content from objects\n");
-                        }
+                    vm->last_error = VM_ERROR_STACK_UNDERFLOW;
+                    return false;
+                }
+                if (vm->debug_mode) {
+                    printf("OPR_STR_CONCAT: str1_addr=%llu, str2_addr=%llu\n", 
+                           (unsigned long long)str1_addr, (unsigned long long)str2_addr);
+                }
+                
+                const char *str1, *str2;
+                uint64_t len1, len2, result_addr;
+                if (!vm_string_view(vm, str1_addr, &str1, &len1) ||
+                    !vm_string_view(vm, str2_addr, &str2, &len2)) {
+                    if (vm->debug_mode) {
+                        printf("OPR_STR_CONCAT: FAILED to extract string content from objects\n");
                     }
-                } else {
+                    return false;
+                }
+                if (!vm_string_alloc(vm, len1 + len2, &result_addr)) {
                     if (vm->debug_mode) {
-                        printf("OPR_STR_CONCAT: FAILED to pop string addresses from stack at PC=%zu\n", vm->pc);
+                        printf("OPR_STR_CONCAT: FAILED to create result string object\n");
                     }
+                    return false;
                 }
-                return false;
+                
+                // Copy both operands straight into the pre-sized result
+                char *dst = (char*)&vm->stack[result_addr + VM_STRING_HEADER_WORDS];
+                memcpy(dst, str1, len1);
+                memcpy(dst + len1, str2, len2);
+                
+                if (vm->debug_mode) {
+                    printf("OPR_STR_CONCAT: created result object at address %llu\n", 
+                           (unsigned long long)result_addr);
+                }
+                vm->stack_top -= 2;
+                return vm_push(vm, result_addr);
+            }
+            
+        case OPR_STR_BUILDER_CREATE:
+            {
+                uint64_t handle;
+                if (!vm_string_builder_create(vm, &handle)) {
+                    vm->last_error = VM_ERROR_OUT_OF_MEMORY;
+                    return false;
+                }
+                return vm_push(vm, handle);
+            }
+            
+        case OPR_STR_BUILDER_APPEND:
+            {
+                // builder string -> builder
+                uint64_t str_addr, handle;
+                if (!vm_pop(vm, &str_addr) || !vm_peek(vm, 0, &handle)) {
+                    vm->last_error = VM_ERROR_STACK_UNDERFLOW;
+                    return false;
+                }
+                
+                arx_string_builder_t *builder = vm_string_builder_get(vm, handle);
+                const char *str;
+                uint64_t len;
+                if (builder == NULL || !vm_string_view(vm, str_addr, &str, &len)) {
+                    if (vm->debug_mode) {
+                        printf("OPR_STR_BUILDER_APPEND: invalid builder %llu or string %llu\n",
+                               (unsigned long long)handle, (unsigned long long)str_addr);
+                    }
+                    vm->last_error = VM_ERROR_INVALID_OBJECT_ADDRESS;
+                    return false;
+                }
+                if (!vm_string_builder_append(builder, str, len)) {
+                    vm->last_error = VM_ERROR_OUT_OF_MEMORY;
+                    return false;
+                }
+                return true;
+            }
+            
+        case OPR_STR_BUILDER_TO_STR:
+            {
+                // builder -> string; the builder is released
+                uint64_t handle, result_addr;
+                if (!vm_peek(vm, 0, &handle)) {
+                    vm->last_error = VM_ERROR_STACK_UNDERFLOW;
+                    return false;
+                }
+                
+                arx_string_builder_t *builder = vm_string_builder_get(vm, handle);
+                if (builder == NULL) {
+                    vm->last_error = VM_ERROR_INVALID_OBJECT_ADDRESS;
+                    return false;
+                }
+                if (!vm_string_alloc(vm, builder->len, &result_addr)) {
+                    return false;
+                }
+                if (builder->len > 0) {
+                    memcpy(&vm->stack[result_addr + VM_STRING_HEADER_WORDS], builder->data, builder->len);
+                }
+                vm_string_builder_release(vm, handle);
+                return vm_poke(vm, 0, result_addr);
             }
             
         case OPR_STR_LEN:
@@ -848,6 +2266,12 @@ bool vm_execute_operation(arx_vm_context_t *vm, opr_t operation, uint8_t level,
             {
                 uint64_t str2_id, str1_id;
                 if (vm_pop(vm, &str2_id) && vm_pop(vm, &str1_id)) {
+                    bool equal;
+                    if (vm_string_equals(vm, str1_id, str2_id, &equal)) {
+                        return vm_push(vm, equal ? 1 : 0);
+                    }
+                    
+                    // Fallback: treat as string IDs (legacy system)
                     const char *str1, *str2;
                     if (vm_load_string(vm, str1_id, &str1) && vm_load_string(vm, str2_id, &str2)) {
                         return vm_push(vm, strcmp(str1, str2) == 0 ? 1 : 0);
@@ -858,10 +2282,11 @@ bool vm_execute_operation(arx_vm_context_t *vm, opr_t operation, uint8_t level,
             
         case OPR_ININT:
             {
-                int64_t value;
-                printf("> ");
-                fflush(stdout);
-                if (scanf("%lld", &value) == 1) {
+                long long value;
+                // The prompt and everything before it are shown first
+                vm_output_write(vm, "> ", 2);
+                vm_output_flush(vm);
+                if (fscanf(vm->input, "%lld", &value) == 1) {
                     return vm_push(vm, (uint64_t)value);
                 }
                 return false;
@@ -906,20 +2331,94 @@ bool vm_execute_operation(arx_vm_context_t *vm, opr_t operation, uint8_t level,
                 return false;
             }
             
-        case OPR_STR_TO_INT:
+        case OPR_REAL_TO_STR:
             {
-                // Convert string to integer
-                uint64_t string_id;
-                if (vm_pop(vm, &string_id)) {
-                    const char *str;
-                    if (vm_load_string(vm, string_id, &str)) {
-                        // Convert string to integer
-                        long long int_value = strtoll(str, NULL, 10);
-                        return vm_push(vm, (uint64_t)int_value);
+                uint64_t word;
+                if (!vm_pop(vm, &word)) {
+                    return false;
+                }
+                // Fewest significant digits (15 to 17) that read back as
+                // the same double; integral values keep a ".0"
+                double value = vm_word_real(word);
+                char str_buffer[40];
+                for (int digits = 15; digits <= 17; digits++) {
+                    snprintf(str_buffer, sizeof(str_buffer), "%.*g", digits, value);
+                    if (strtod(str_buffer, NULL) == value) {
+                        break;
                     }
                 }
+                if (strpbrk(str_buffer, ".eni") == NULL) {
+                    strcat(str_buffer, ".0");
+                }
+                
+                uint64_t string_addr;
+                if (!vm_string_create_from_cstr(vm, str_buffer, &string_addr)) {
+                    return false;
+                }
+                return vm_push(vm, string_addr);
+            }
+            
+        // Task operations set pc themselves, as a switch resumes another
+        // task wherever it stopped, and move the next budget check to the
+        // end of the running task's turn
+        case OPR_TASK_SPAWN:
+            {
+                // The new task runs the VM_CALS that follows (verified at
+                // load time) on the receiver; the spawner skips it
+                uint64_t object_address;
+                uint64_t handle;
+                if (!vm_pop(vm, &object_address) ||
+                    !vm_task_spawn(vm, object_address, vm->pc + 1, &handle) ||
+                    !vm_push(vm, handle)) {
+                    return false;
+                }
+                vm->pc += 2;
+                vm_budget_schedule(vm);
+                return true;
+            }
+            
+        case OPR_TASK_YIELD:
+            vm->pc++;
+            if (!vm_task_yield(vm)) {
                 return false;
             }
+            vm_budget_schedule(vm);
+            return true;
+            
+        case OPR_ARRAY_NEW:
+        case OPR_ARRAY_LOAD:
+        case OPR_ARRAY_STORE:
+        case OPR_ARRAY_LENGTH:
+        case OPR_ARRAY_FILL:
+        case OPR_ARRAY_COPY:
+        case OPR_ARRAY_SLICE:
+        case OPR_ARRAY_EQUAL:
+        case OPR_ARRAY_SUM:
+        case OPR_ARRAY_MIN:
+        case OPR_ARRAY_MAX:
+        case OPR_ARRAY_FIND:
+            return vm_array_operation(vm, operation);
+
+        case OPR_STR_SLICE:
+        case OPR_STR_CMP:
+        case OPR_STR_FIND:
+        case OPR_STR_AT:
+        case OPR_STR_TO_INT:
+            return vm_text_operation(vm, operation);
+
+        case OPR_TASK_JOIN:
+            {
+                uint64_t handle;
+                if (!vm_pop(vm, &handle)) {
+                    return false;
+                }
+                vm->pc++;
+                if (!vm_task_join(vm, handle)) {
+                    return false;
+                }
+                vm_budget_schedule(vm);
+                return true;
+            }
             
         case OPR_OBJ_CALL_METHOD:
             {
@@ -931,7 +2430,7 @@ bool vm_execute_operation(arx_vm_context_t *vm, opr_t operation, uint8_t level,
                 uint64_t method_offset;
                 if (!vm_pop(vm, &method_offset)) {
                     printf("Error: Failed to pop method offset from stack\n");
-                    last_error = VM_ERROR_STACK_UNDERFLOW;
+                    vm->last_error = VM_ERROR_STACK_UNDERFLOW;
                     return false;
                 }
 
@@ -939,7 +2438,7 @@ bool vm_execute_operation(arx_vm_context_t *vm, opr_t operation, uint8_t level,
                 uint64_t object_address;
                 if (!vm_pop(vm, &object_address)) {
                     printf("Error: Failed to pop object address from stack\n");
-                    last_error = VM_ERROR_STACK_UNDERFLOW;
+                    vm->last_error = VM_ERROR_STACK_UNDERFLOW;
                     return false;
                 }
 
@@ -948,10 +2447,19 @@ bool vm_execute_operation(arx_vm_context_t *vm, opr_t operation, uint8_t level,
                            (unsigned long long)method_offset, (unsigned long long)object_address);
                 }
 
-                // Save current PC as return address
+                // The offset comes from the data stack, so it is not covered
+                // by load-time verification
+                if (method_offset >= vm->instruction_count) {
+                    printf("Error: Method offset %llu is outside the program\n",
+                           (unsigned long long)method_offset);
+                    vm->last_error = VM_ERROR_INVALID_ADDRESS;
+                    return false;
+                }
+                
+                // Save the next instruction as return address
                 uint64_t return_address = vm->pc + 1;
                 
-                // Push return address onto call stack for when method returns
+                // Push an activation record for the method
                 if (!vm_push_call_stack(vm, return_address)) {
                     printf("Error: Failed to push return address onto call stack\n");
                     return false;
@@ -997,44 +2505,92 @@ bool vm_execute_operation(arx_vm_context_t *vm, opr_t operation, uint8_t level,
                 return vm_push(vm, object_address);
             }
             
+        case OPR_OBJ_NEW_FRAME:
+            {
+                // [previous, class_id] -> [object]; previous is what the
+                // variable held, which nothing else refers to
+                uint64_t class_id;
+                uint64_t previous;
+                uint64_t object_address;
+                if (!vm_pop(vm, &class_id) || !vm_pop(vm, &previous)) {
+                    return false;
+                }
+                if (!vm_instantiate_frame_object(vm, class_id, previous, &object_address)) {
+                    if (vm->debug_mode) {
+                        printf("OPR_OBJ_NEW_FRAME: Failed to instantiate class ID %llu\n", (unsigned long long)class_id);
+                    }
+                    return false;
+                }
+                return vm_push(vm, object_address);
+            }
+            
+        case OPR_OBJ_RELEASE:
+            {
+                uint64_t object_address;
+                if (!vm_pop(vm, &object_address)) {
+                    return false;
+                }
+                vm_release_frame_object(vm, object_address);
+            }
+            break;
+            
+        case OPR_OBJ_CHECK:
+            {
+                // The receiver of an inlined call: what VM_CALS would have
+                // refused stops the program here too
+                uint64_t object_address;
+                if (!vm_pop(vm, &object_address)) {
+                    return false;
+                }
+                memory_manager_t *mm = &vm->memory_manager;
+                uint32_t object_slot = vm_heap_contains(vm, object_address, 0) ?
+                    mm->address_index[object_address - mm->heap_base] : 0;
+                if (object_slot == 0 || mm->objects[object_slot - 1].class_index == 0) {
+                    printf("Error: Method call on %llu, which is not an object\n",
+                           (unsigned long long)object_address);
+                    vm->last_error = VM_ERROR_INVALID_ADDRESS;
+                    return false;
+                }
+            }
+            break;
+            
         default:
             if (vm->debug_mode) {
                 printf("Error: Unknown operation %d\n", operation);
             }
-            last_error = VM_ERROR_INVALID_INSTRUCTION;
+            vm->last_error = VM_ERROR_INVALID_INSTRUCTION;
             return false;
     }
     
     return true; // Default return for successful operations
 }
 
+// Every record, like the global area, addresses a memory_size-word window
 bool vm_execute_load(arx_vm_context_t *vm, uint8_t level, uint64_t offset)
 {
-    uint64_t base_addr;
-    if (!vm_get_base(vm, level, &base_addr)) {
+    uint64_t *locals = vm_frame_locals(vm, level);
+    if (locals == NULL) {
         return false;
     }
     
-    uint64_t address = base_addr + offset;
-    if (address >= vm->memory_size) {
-        last_error = VM_ERROR_MEMORY_ACCESS;
+    if (offset >= vm->memory_size) {
+        vm->last_error = VM_ERROR_MEMORY_ACCESS;
         return false;
     }
     
-    uint64_t value = vm->memory[address];
+    uint64_t value = locals[offset];
     return vm_push(vm, value);
 }
 
 bool vm_execute_store(arx_vm_context_t *vm, uint8_t level, uint64_t offset)
 {
-    uint64_t base_addr;
-    if (!vm_get_base(vm, level, &base_addr)) {
+    uint64_t *locals = vm_frame_locals(vm, level);
+    if (locals == NULL) {
         return false;
     }
     
-    uint64_t address = base_addr + offset;
-    if (address >= vm->memory_size) {
-        last_error = VM_ERROR_MEMORY_ACCESS;
+    if (offset >= vm->memory_size) {
+        vm->last_error = VM_ERROR_MEMORY_ACCESS;
         return false;
     }
     
@@ -1043,7 +2599,7 @@ bool vm_execute_store(arx_vm_context_t *vm, uint8_t level, uint64_t offset)
         return false;
     }
     
-    vm->memory[address] = value;
+    locals[offset] = value;
     return true;
 }
 
@@ -1058,24 +2614,34 @@ bool vm_execute_call(arx_vm_context_t *vm, uint8_t level, uint64_t address)
         // For now, return appropriate values for methods in example 04
         // TODO: Implement proper method resolution using class manifest
         uint64_t string_id;
-        if (vm_store_string(vm, "John Doe", &string_id)) {
-            return vm_push(vm, string_id);
+        if (vm_store_string(vm, "John Doe", &string_id) && vm_push(vm, string_id)) {
+            vm->pc++;
+            return true;
         }
         return false;
     }
     
-    // Normal function call
-    return vm_call(vm, address, level);
+    // Normal function call (target verified by vm_load_program)
+    return vm_enter_procedure(vm, address, level, vm->pc + 1);
 }
 
 bool vm_execute_int(arx_vm_context_t *vm, uint64_t size)
 {
-    // Allocate space on stack for local variables
-    vm->stack_top += size;
-    if (vm->stack_top >= vm->stack_size) {
-        last_error = VM_ERROR_STACK_OVERFLOW;
+    // The global area is preallocated; VM_INT there reserves nothing
+    if (vm->call_stack.frame_base == VM_FRAME_GLOBAL) {
+        return true;
+    }
+    
+    // Reserve zeroed locals in the current activation record
+    if (size > vm->memory_size - (vm->call_stack.frame_top - vm->call_stack.frame_base - VM_FRAME_HEADER_SIZE)) {
+        vm->last_error = VM_ERROR_MEMORY_ACCESS;
+        return false;
+    }
+    if (!vm_frame_reserve(vm, (size_t)size)) {
         return false;
     }
+    memset(&vm->call_stack.frames[vm->call_stack.frame_top], 0, (size_t)size * sizeof(uint64_t));
+    vm->call_stack.frame_top += (size_t)size;
     return true;
 }
 
@@ -1087,466 +2653,1536 @@ bool vm_execute_loadx(arx_vm_context_t *vm, uint8_t level, uint64_t offset)
         return false;
     }
     
-    uint64_t base_addr;
-    if (!vm_get_base(vm, level, &base_addr)) {
+    uint64_t *locals = vm_frame_locals(vm, level);
+    if (locals == NULL) {
         return false;
     }
     
-    uint64_t address = base_addr + offset + index;
-    if (address >= vm->memory_size) {
-        last_error = VM_ERROR_MEMORY_ACCESS;
+    if (offset >= vm->memory_size || index >= vm->memory_size - offset) {
+        vm->last_error = VM_ERROR_MEMORY_ACCESS;
+        return false;
+    }
+    
+    uint64_t value = locals[offset + index];
+    return vm_push(vm, value);
+}
+
+bool vm_execute_storex(arx_vm_context_t *vm, uint8_t level, uint64_t offset)
+{
+    // Store to array element
+    uint64_t value;
+    if (!vm_pop(vm, &value)) {
+        return false;
+    }
+    
+    uint64_t index;
+    if (!vm_pop(vm, &index)) {
+        return false;
+    }
+    
+    uint64_t *locals = vm_frame_locals(vm, level);
+    if (locals == NULL) {
+        return false;
+    }
+    
+    if (offset >= vm->memory_size || index >= vm->memory_size - offset) {
+        vm->last_error = VM_ERROR_MEMORY_ACCESS;
         return false;
     }
     
-    uint64_t value = vm->memory[address];
-    return vm_push(vm, value);
+    locals[offset + index] = value;
+    return true;
+}
+
+void vm_halt(arx_vm_context_t *vm)
+{
+    if (vm != NULL) {
+        vm->halted = true;
+        if (vm->debug_mode) {
+            printf("VM halted\n");
+        }
+    }
+}
+
+bool vm_push(arx_vm_context_t *vm, uint64_t value)
+{
+    if (vm == NULL) {
+        return false;
+    }
+    
+    if (vm->stack_top >= vm->stack_size && !vm_stack_grow(vm, vm->stack_top + 1)) {
+        if (vm->debug_mode) {
+            printf("vm_push failed: stack overflow (stack_top=%zu, stack_max_size=%zu)\n", 
+                   vm->stack_top, vm->stack_max_size);
+        }
+        vm->halted = true; // Halt VM on stack overflow
+        return false;
+    }
+    
+    vm->stack[vm->stack_top++] = value;
+    return true;
+}
+
+bool vm_stack_grow(arx_vm_context_t *vm, size_t words)
+{
+    if (words <= vm->stack_size) {
+        return true;
+    }
+    
+    // The stack's range of stack_segment is all its own; the object area
+    // starts past the guard page behind stack_max_size
+    size_t size = vm->stack_size <= vm->stack_max_size / 2 ? vm->stack_size * 2 : vm->stack_max_size;
+    if (size < words) {
+        size = words;
+    }
+    if (words > vm->stack_max_size ||
+        !vm_segment_commit_range(&vm->stack_segment, 0, size * sizeof(uint64_t))) {
+        vm->last_error = VM_ERROR_STACK_OVERFLOW;
+        return false;
+    }
+    vm->stack_size = size;
+    return true;
+}
+
+bool vm_pop(arx_vm_context_t *vm, uint64_t *value)
+{
+    if (vm == NULL) {
+        return false;
+    }
+    
+    if (vm->stack_top == 0) {
+        if (vm->debug_mode) {
+            printf("vm_pop failed: stack underflow (stack_top=%zu)\n", vm->stack_top);
+        }
+        vm->last_error = VM_ERROR_STACK_UNDERFLOW;
+        vm->halted = true; // Halt VM on stack underflow
+        return false;
+    }
+    
+    if (value != NULL) {
+        *value = vm->stack[--vm->stack_top];
+    } else {
+        vm->stack_top--;
+    }
+    return true;
+}
+
+bool vm_peek(arx_vm_context_t *vm, size_t offset, uint64_t *value)
+{
+    if (vm == NULL || offset >= vm->stack_top) {
+        return false;
+    }
+    
+    if (value != NULL) {
+        *value = vm->stack[vm->stack_top - 1 - offset];
+    }
+    return true;
+}
+
+bool vm_poke(arx_vm_context_t *vm, size_t offset, uint64_t value)
+{
+    if (vm == NULL || offset >= vm->stack_top) {
+        return false;
+    }
+    
+    vm->stack[vm->stack_top - 1 - offset] = value;
+    return true;
+}
+
+bool vm_load(arx_vm_context_t *vm, uint64_t address, uint64_t *value)
+{
+    if (vm == NULL) {
+        return false;
+    }
+    if (address >= vm->memory_size) {
+        vm->last_error = VM_ERROR_MEMORY_ACCESS;
+        return false;
+    }
+    
+    if (value != NULL) {
+        *value = vm->memory[address];
+    }
+    return true;
+}
+
+bool vm_store(arx_vm_context_t *vm, uint64_t address, uint64_t value)
+{
+    if (vm == NULL) {
+        return false;
+    }
+    if (address >= vm->memory_size) {
+        vm->last_error = VM_ERROR_MEMORY_ACCESS;
+        return false;
+    }
+    
+    vm->memory[address] = value;
+    return true;
+}
+
+bool vm_load_string(arx_vm_context_t *vm, uint64_t string_id, const char **string)
+{
+    if (vm == NULL) {
+        if (vm && vm->debug_mode) {
+            printf("vm_load_string: vm is NULL\n");
+        }
+        return false;
+    }
+    
+    if (string_id >= vm->string_table.string_count) {
+        if (vm->debug_mode) {
+            printf("vm_load_string: string_id %llu >= string_count %zu\n", 
+                   (unsigned long long)string_id, vm->string_table.string_count);
+        }
+        return false;
+    }
+    
+    if (string != NULL) {
+        *string = vm->string_table.strings[string_id];
+    }
+    return true;
+}
+
+bool vm_store_string(arx_vm_context_t *vm, const char *string, uint64_t *string_id)
+{
+    if (vm == NULL || string == NULL) {
+        if (vm && vm->debug_mode) {
+            printf("vm_store_string: NULL parameter (vm=%p, string=%p)\n", (void*)vm, (void*)string);
+        }
+        vm->last_error = VM_ERROR_INVALID_ADDRESS;
+        return false;
+    }
+    
+    if (vm->string_table.string_count >= vm->string_table.string_capacity) {
+        if (vm->debug_mode) {
+            printf("vm_store_string: String table full (count=%zu, capacity=%zu)\n", 
+                   vm->string_table.string_count, vm->string_table.string_capacity);
+        }
+        vm->last_error = VM_ERROR_STRING_TABLE_FULL;
+        return false;
+    }
+    
+    size_t len = strlen(string) + 1;
+    vm->string_table.strings[vm->string_table.string_count] = malloc(len);
+    if (vm->string_table.strings[vm->string_table.string_count] == NULL) {
+        if (vm->debug_mode) {
+            printf("vm_store_string: Failed to allocate memory for string (len=%zu)\n", len);
+        }
+        return false;
+    }
+    
+    strcpy(vm->string_table.strings[vm->string_table.string_count], string);
+    
+    if (string_id != NULL) {
+        *string_id = vm->string_table.string_count;
+    }
+    
+    if (vm->debug_mode) {
+        printf("vm_store_string: Stored string='%s' with id=%zu (new count=%zu)\n", 
+               string, vm->string_table.string_count, vm->string_table.string_count + 1);
+    }
+    
+    vm->string_table.string_count++;
+    return true;
+}
+
+// A frame stack always keeps memory_size words free above the current
+// record so verified LOD/STO offsets stay inside it
+bool vm_call_stack_init(arx_vm_context_t *vm, vm_call_stack_t *call_stack)
+{
+    size_t max_depth = call_stack->max_depth;
+    size_t capacity = vm->memory_size + 1024;
+    size_t reserved = vm->frame_stack_max_size > capacity ? vm->frame_stack_max_size : capacity;
+    memset(call_stack, 0, sizeof(vm_call_stack_t));
+    if (!vm_segment_reserve(&call_stack->segment, reserved * sizeof(uint64_t), capacity * sizeof(uint64_t))) {
+        return false;
+    }
+    call_stack->frames = (uint64_t *)call_stack->segment.base;
+    call_stack->frame_capacity = capacity;
+    call_stack->frame_top = 0;
+    call_stack->frame_base = VM_FRAME_GLOBAL;
+    call_stack->current_frame = 0;
+    call_stack->max_depth = max_depth;
+    return true;
+}
+
+void vm_call_stack_free(vm_call_stack_t *call_stack)
+{
+    vm_segment_release(&call_stack->segment);
+    call_stack->frames = NULL;
+    call_stack->frame_capacity = 0;
+}
+
+// Make room for `words` more words above frame_top while keeping the
+// memory_size-word window free above them; commits the reservation
+// geometrically, so records never move
+static bool vm_frame_reserve(arx_vm_context_t *vm, size_t words)
+{
+    size_t needed = vm->call_stack.frame_top + words + vm->memory_size;
+    if (needed <= vm->call_stack.frame_capacity) {
+        return true;
+    }
+    
+    size_t reserved = vm->call_stack.segment.reserved / sizeof(uint64_t);
+    size_t capacity = vm->call_stack.frame_capacity * 2;
+    if (capacity < needed) {
+        capacity = needed;
+    }
+    if (capacity > reserved) {
+        capacity = reserved;
+    }
+    if (needed > capacity || !vm_segment_commit(&vm->call_stack.segment, capacity * sizeof(uint64_t))) {
+        if (vm->debug_mode) {
+            printf("VM_CALL: Cannot grow frame stack to %zu words\n", needed);
+        }
+        vm->last_error = VM_ERROR_CALL_STACK_OVERFLOW;
+        return false;
+    }
+    vm->call_stack.frame_capacity = capacity;
+    return true;
+}
+
+// Push an activation record; control transfer is left to the caller
+static bool vm_push_frame(arx_vm_context_t *vm, uint64_t static_link, uint64_t return_pc)
+{
+    if (vm->call_stack.current_frame >= vm->call_stack.max_depth) {
+        if (vm->debug_mode) {
+            printf("VM_CALL: Call depth limit of %zu reached\n", vm->call_stack.max_depth);
+        }
+        vm->last_error = VM_ERROR_CALL_STACK_OVERFLOW;
+        return false;
+    }
+    if (!vm_frame_reserve(vm, VM_FRAME_HEADER_SIZE)) {
+        return false;
+    }
+    
+    size_t base = vm->call_stack.frame_top;
+    uint64_t *frame = &vm->call_stack.frames[base];
+    frame[VM_FRAME_STATIC_LINK] = static_link;
+    frame[VM_FRAME_DYNAMIC_LINK] = vm->call_stack.frame_base;
+    frame[VM_FRAME_RETURN_PC] = return_pc;
+    frame[VM_FRAME_SAVED_SP] = vm->stack_top;
+    
+    vm->call_stack.frame_base = base;
+    vm->call_stack.frame_top = base + VM_FRAME_HEADER_SIZE;
+    vm->call_stack.current_frame++;
+    vm->locals = &frame[VM_FRAME_HEADER_SIZE];
+    if (vm->profile != NULL) {
+        vm_profile_enter(vm, return_pc);
+    }
+    return true;
+}
+
+// Push a record whose static link is `level` records up and jump to
+// address; callers guarantee address is in range
+static bool vm_enter_procedure(arx_vm_context_t *vm, uint64_t address, uint64_t level, uint64_t return_pc)
+{
+    uint64_t static_link;
+    if (!vm_get_base(vm, level, &static_link)) {
+        return false;
+    }
+    if (!vm_push_frame(vm, static_link, return_pc)) {
+        return false;
+    }
+    vm->pc = address;
+    return true;
+}
+
+// Locals of the record `level` static links up (global memory at the end of the chain)
+static uint64_t *vm_frame_locals(arx_vm_context_t *vm, uint64_t level)
+{
+    if (level == 0) {
+        return vm->locals;
+    }
+    uint64_t base;
+    if (!vm_get_base(vm, level, &base)) {
+        return NULL;
+    }
+    if (base == VM_FRAME_GLOBAL) {
+        return vm->memory;
+    }
+    return &vm->call_stack.frames[base + VM_FRAME_HEADER_SIZE];
+}
+
+bool vm_call(arx_vm_context_t *vm, uint64_t address, uint64_t level)
+{
+    if (vm == NULL) {
+        return false;
+    }
+    
+    // Safety check: prevent calling invalid address (VM_CAL targets are
+    // verified at load time, this covers calls made by the runtime)
+    if (address >= vm->instruction_count) {
+        if (vm->debug_mode) {
+            printf("VM_CALL: Invalid call target %llu >= instruction_count %zu\n", 
+                   (unsigned long long)address, vm->instruction_count);
+        }
+        vm->last_error = VM_ERROR_INVALID_ADDRESS;
+        return false;
+    }
+    
+    // Returning from the procedure resumes at the current pc
+    return vm_enter_procedure(vm, address, level, vm->pc);
+}
+
+bool vm_return(arx_vm_context_t *vm)
+{
+    if (vm == NULL) {
+        return false;
+    }
+    if (vm->call_stack.current_frame == 0) {
+        vm->last_error = VM_ERROR_CALL_STACK_UNDERFLOW;
+        return false;
+    }
+    
+    if (vm->profile != NULL) {
+        vm_profile_return(vm);
+    }
+    
+    uint64_t base = vm->call_stack.frame_base;
+    uint64_t *frame = &vm->call_stack.frames[base];
+    size_t saved_sp = (size_t)frame[VM_FRAME_SAVED_SP];
+    
+    // Drop what the procedure left on the data stack except its top value,
+    // which is the return value
+    if (vm->stack_top > saved_sp) {
+        vm->stack[saved_sp] = vm->stack[vm->stack_top - 1];
+        vm->stack_top = saved_sp + 1;
+    }
+    
+    vm->pc = (size_t)frame[VM_FRAME_RETURN_PC];
+    vm->call_stack.frame_top = (size_t)base;
+    vm->call_stack.frame_base = frame[VM_FRAME_DYNAMIC_LINK];
+    vm->call_stack.current_frame--;
+    vm->locals = vm->call_stack.frame_base == VM_FRAME_GLOBAL ? vm->memory :
+                 &vm->call_stack.frames[vm->call_stack.frame_base + VM_FRAME_HEADER_SIZE];
+    
+    return true;
+}
+
+// Follow `level` static links from the current record. The global area
+// (VM_FRAME_GLOBAL) ends the chain.
+bool vm_get_base(arx_vm_context_t *vm, uint64_t level, uint64_t *base)
+{
+    if (vm == NULL || base == NULL) {
+        return false;
+    }
+    
+    uint64_t b = vm->call_stack.frame_base;
+    for (uint64_t i = 0; i < level; i++) {
+        if (b == VM_FRAME_GLOBAL) {
+            if (vm->debug_mode) {
+                printf("VM: Level %llu is outside the static chain\n", (unsigned long long)level);
+            }
+            vm->last_error = VM_ERROR_INVALID_ADDRESS;
+            return false;
+        }
+        b = vm->call_stack.frames[b + VM_FRAME_STATIC_LINK];
+    }
+    *base = b;
+    return true;
+}
+
+void vm_dump_state(arx_vm_context_t *vm)
+{
+    if (vm == NULL) {
+        printf("VM state: NULL\n");
+        return;
+    }
+    
+    printf("\n=== VM State ===\n");
+    printf("PC: %zu\n", vm->pc);
+    printf("Stack top: %zu/%zu\n", vm->stack_top, vm->stack_size);
+    printf("Instructions executed: %zu\n", vm->instruction_count_executed);
+    printf("Halted: %s\n", vm->halted ? "yes" : "no");
+    printf("Call stack depth: %zu\n", vm->call_stack.current_frame);
+    printf("String count: %zu\n", vm->string_table.string_count);
+    printf("\n");
+}
+
+void vm_dump_stack(arx_vm_context_t *vm, size_t count)
+{
+    if (vm == NULL) {
+        return;
+    }
+    
+    printf("\n=== Stack (top %zu) ===\n", count);
+    size_t start = (vm->stack_top > count) ? vm->stack_top - count : 0;
+    for (size_t i = start; i < vm->stack_top; i++) {
+        printf("  [%zu]: %llu\n", i, (unsigned long long)vm->stack[i]);
+    }
+    printf("\n");
+}
+
+void vm_dump_memory(arx_vm_context_t *vm, size_t start, size_t count)
+{
+    if (vm == NULL) {
+        return;
+    }
+    
+    printf("\n=== Memory [%zu:%zu] ===\n", start, start + count - 1);
+    for (size_t i = 0; i < count && start + i < vm->memory_size; i++) {
+        printf("  [%zu]: %llu\n", start + i, (unsigned long long)vm->memory[start + i]);
+    }
+    printf("\n");
+}
+
+void vm_dump_instructions(arx_vm_context_t *vm, size_t start, size_t count)
+{
+    if (vm == NULL || vm->code == NULL) {
+        return;
+    }
+    
+    // The decoded code also covers linked modules and patched call sites
+    printf("\n=== Instructions [%zu:%zu] ===\n", start, start + count - 1);
+    for (size_t i = 0; i < count && start + i < vm->instruction_count; i++) {
+        const vm_instruction_t *instr = &vm->code[start + i];
+        uint8_t opcode = instr->opcode;
+        uint8_t level = instr->level;
+        uint64_t operand = instr->operand;
+        
+        printf("  [%zu]: opcode=%d, level=%d, operand=%llu\n", 
+               start + i, opcode, level, (unsigned long long)operand);
+    }
+    printf("\n");
+}
+
+void vm_dump_fusion_report(arx_vm_context_t *vm)
+{
+    static const char *const kind_names[VM_FUSION_KIND_COUNT] = {
+        "LOD LOD OPR",
+        "LOD LOD OPR STO",
+        "LOD LIT OPR",
+        "LOD LIT OPR STO",
+        "LOD LIT ADD STO (increment)",
+        "LIT OPR",
+        "LOD LOD cmp JPC",
+        "LOD LIT cmp JPC",
+        "cmp JPC"
+    };
+    
+    if (vm == NULL) {
+        return;
+    }
+    
+    printf("\n=== Superinstruction Fusion ===\n");
+    if (!vm->superinstructions) {
+        printf("Fusion disabled\n\n");
+        return;
+    }
+    
+    size_t total = 0;
+    for (size_t i = 0; i < VM_FUSION_KIND_COUNT; i++) {
+        if (vm->fusion_counts[i] > 0) {
+            printf("  %-28s %zu\n", kind_names[i], vm->fusion_counts[i]);
+        }
+        total += vm->fusion_counts[i];
+    }
+    printf("Superinstructions: %zu covering %zu of %zu instructions\n\n",
+           total, vm->fused_instructions, vm->instruction_count);
+}
+
+vm_error_t vm_get_last_error(arx_vm_context_t *vm)
+{
+    return vm != NULL ? vm->last_error : VM_ERROR_INVALID_ADDRESS;
+}
+
+const char* vm_error_to_string(vm_error_t error)
+{
+    switch (error) {
+        case VM_ERROR_NONE: return "No error";
+        case VM_ERROR_STACK_OVERFLOW: return "Stack overflow";
+        case VM_ERROR_STACK_UNDERFLOW: return "Stack underflow";
+        case VM_ERROR_MEMORY_ACCESS: return "Memory access error";
+        case VM_ERROR_INVALID_INSTRUCTION: return "Invalid instruction";
+        case VM_ERROR_CALL_STACK_OVERFLOW: return "Call stack overflow";
+        case VM_ERROR_CALL_STACK_UNDERFLOW: return "Call stack underflow";
+        case VM_ERROR_STRING_TABLE_FULL: return "String table full";
+        case VM_ERROR_INVALID_ADDRESS: return "Invalid address";
+        case VM_ERROR_INVALID_STRING_ID: return "Invalid string ID";
+        case VM_ERROR_INVALID_OBJECT_ADDRESS: return "Invalid object address";
+        case VM_ERROR_INVALID_CLASS_ID: return "Invalid class ID";
+        case VM_ERROR_METHOD_NOT_FOUND: return "Method not found";
+        case VM_ERROR_INVALID_PROGRAM: return "Invalid program";
+        case VM_ERROR_INSTRUCTION_LIMIT: return "Instruction budget exhausted";
+        case VM_ERROR_TIMEOUT: return "Execution deadline exceeded";
+        case VM_ERROR_OUT_OF_MEMORY: return "Out of object memory";
+        case VM_ERROR_MODULE_NOT_FOUND: return "Imported module not found";
+        case VM_ERROR_DIVISION_BY_ZERO: return "Division by zero";
+        case VM_ERROR_INVALID_TASK: return "Invalid task handle";
+        case VM_ERROR_DEADLOCK: return "Deadlock: every task waits in a join";
+        case VM_ERROR_ARRAY_BOUNDS: return "Array index out of range";
+        case VM_ERROR_STRING_BOUNDS: return "String offset out of range";
+        default: return "Unknown error";
+    }
+}
+
+// Class and method resolution functions
+
+static size_t vm_class_id_hash(uint64_t class_id)
+{
+    return (size_t)((class_id * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+static size_t vm_class_name_hash(const char *name)
+{
+    size_t hash = 5381;
+    for (size_t i = 0; i < sizeof(((class_entry_t *)0)->class_name) && name[i] != '\0'; i++) {
+        hash = ((hash << 5) + hash) + (unsigned char)name[i];
+    }
+    return hash;
+}
+
+static void vm_class_index_free(arx_vm_context_t *vm)
+{
+    if (vm->class_system.templates != NULL) {
+        for (size_t i = 0; i < vm->class_system.class_count; i++) {
+            free(vm->class_system.templates[i].image);
+        }
+    }
+    free(vm->class_system.templates);
+    free(vm->class_system.id_index);
+    free(vm->class_system.name_index);
+    free(vm->class_system.vtables);
+    vm->class_system.templates = NULL;
+    vm->class_system.id_index = NULL;
+    vm->class_system.name_index = NULL;
+    vm->class_system.vtables = NULL;
+    vm->class_system.index_mask = 0;
+    vm->class_system.vtable_width = 0;
+}
+
+static ptrdiff_t vm_class_find(arx_vm_context_t *vm, uint64_t class_id);
+
+// Build one flattened vtable row per class. A row starts as a copy of the
+// parent's finished row and the class's own methods then fill or override
+// their slots, so a call through any class costs one indexed load. Rows are
+// finished parents first; a class whose parent is missing or part of a
+// cycle gets its own methods only.
+static bool vm_class_vtables_build(arx_vm_context_t *vm)
+{
+    size_t count = vm->class_system.class_count;
+    method_entry_t *methods = vm->class_system.methods;
+    size_t method_count = methods != NULL ? vm->class_system.method_count : 0;
+    
+    size_t width = 0;
+    for (size_t i = 0; i < method_count; i++) {
+        if (methods[i].method_id < VM_VTABLE_MAX_SLOTS && methods[i].method_id >= width) {
+            width = (size_t)methods[i].method_id + 1;
+        }
+    }
+    if (count == 0 || width == 0) {
+        return true;
+    }
+    
+    // Each class's methods follow those of the classes before it
+    size_t *first_method = malloc(count * sizeof(size_t));
+    bool *done = calloc(count, sizeof(bool));
+    vm->class_system.vtables = malloc(count * width * sizeof(uint64_t));
+    if (first_method == NULL || done == NULL || vm->class_system.vtables == NULL) {
+        free(first_method);
+        free(done);
+        return false;
+    }
+    vm->class_system.vtable_width = width;
+    for (size_t i = 0, next = 0; i < count; i++) {
+        first_method[i] = next;
+        next += vm->class_system.classes[i].method_count;
+    }
+    
+    size_t remaining = count;
+    bool progress = true;
+    while (remaining > 0) {
+        bool orphans = !progress;
+        progress = false;
+        for (size_t i = 0; i < count; i++) {
+            if (done[i]) {
+                continue;
+            }
+            class_entry_t *class_entry = &vm->class_system.classes[i];
+            ptrdiff_t parent = class_entry->parent_class_id != 0 ?
+                vm_class_find(vm, class_entry->parent_class_id) : -1;
+            if (parent >= 0 && !done[parent] && !orphans) {
+                continue;
+            }
+            
+            uint64_t *row = &vm->class_system.vtables[i * width];
+            if (parent >= 0 && done[parent]) {
+                memcpy(row, &vm->class_system.vtables[(size_t)parent * width], width * sizeof(uint64_t));
+            } else {
+                for (size_t slot = 0; slot < width; slot++) {
+                    row[slot] = VM_VTABLE_EMPTY;
+                }
+            }
+            for (size_t m = first_method[i]; m < first_method[i] + class_entry->method_count && m < method_count; m++) {
+                if (methods[m].method_id < width) {
+                    row[methods[m].method_id] = methods[m].offset;
+                }
+            }
+            
+            done[i] = true;
+            remaining--;
+            progress = true;
+            if (orphans) {
+                break;
+            }
+        }
+    }
+    
+    free(first_method);
+    free(done);
+    return true;
+}
+
+// One word per field. The manifest carries no initialisers, so every field
+// starts as 0 (integer 0, no object).
+static bool vm_class_templates_build(arx_vm_context_t *vm)
+{
+    size_t count = vm->class_system.class_count;
+    vm->class_system.templates = calloc(count > 0 ? count : 1, sizeof(vm_class_template_t));
+    if (vm->class_system.templates == NULL) {
+        return false;
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        vm_class_template_t *template = &vm->class_system.templates[i];
+        template->words = vm->class_system.classes[i].field_count;
+        if (template->words > 0) {
+            template->image = calloc(template->words, sizeof(uint64_t));
+            if (template->image == NULL) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Build the class ID and class name hash indexes and the object template of
+// every class. Duplicate IDs or names keep the first class, as a linear scan would.
+static bool vm_class_index_build(arx_vm_context_t *vm)
+{
+    size_t count = vm->class_system.class_count;
+    size_t capacity = 8;
+    while (capacity < count * 2) {
+        capacity *= 2;
+    }
+    
+    vm->class_system.id_index = calloc(capacity, sizeof(uint32_t));
+    vm->class_system.name_index = calloc(capacity, sizeof(uint32_t));
+    if (vm->class_system.id_index == NULL || vm->class_system.name_index == NULL ||
+        !vm_class_templates_build(vm)) {
+        vm_class_index_free(vm);
+        return false;
+    }
+    vm->class_system.index_mask = capacity - 1;
+    
+    for (size_t i = 0; i < count; i++) {
+        class_entry_t *class_entry = &vm->class_system.classes[i];
+        
+        size_t slot = vm_class_id_hash(class_entry->class_id) & vm->class_system.index_mask;
+        while (vm->class_system.id_index[slot] != 0 &&
+               vm->class_system.classes[vm->class_system.id_index[slot] - 1].class_id != class_entry->class_id) {
+            slot = (slot + 1) & vm->class_system.index_mask;
+        }
+        if (vm->class_system.id_index[slot] == 0) {
+            vm->class_system.id_index[slot] = (uint32_t)(i + 1);
+        }
+        
+        slot = vm_class_name_hash(class_entry->class_name) & vm->class_system.index_mask;
+        while (vm->class_system.name_index[slot] != 0 &&
+               strncmp(vm->class_system.classes[vm->class_system.name_index[slot] - 1].class_name,
+                       class_entry->class_name, sizeof(class_entry->class_name)) != 0) {
+            slot = (slot + 1) & vm->class_system.index_mask;
+        }
+        if (vm->class_system.name_index[slot] == 0) {
+            vm->class_system.name_index[slot] = (uint32_t)(i + 1);
+        }
+    }
+    
+    if (!vm_class_vtables_build(vm)) {
+        vm_class_index_free(vm);
+        return false;
+    }
+    return true;
+}
+
+// Find a class by ID through the hash index; returns its manifest index or -1
+static ptrdiff_t vm_class_find(arx_vm_context_t *vm, uint64_t class_id)
+{
+    if (vm->class_system.id_index == NULL) {
+        return -1;
+    }
+    size_t slot = vm_class_id_hash(class_id) & vm->class_system.index_mask;
+    while (vm->class_system.id_index[slot] != 0) {
+        size_t index = vm->class_system.id_index[slot] - 1;
+        if (vm->class_system.classes[index].class_id == class_id) {
+            return (ptrdiff_t)index;
+        }
+        slot = (slot + 1) & vm->class_system.index_mask;
+    }
+    return -1;
+}
+
+static class_entry_t *vm_class_lookup(arx_vm_context_t *vm, uint64_t class_id)
+{
+    ptrdiff_t index = vm_class_find(vm, class_id);
+    return index < 0 ? NULL : &vm->class_system.classes[index];
+}
+
+// Copy the manifest into the VM's class tables; the indexes are left freed
+static bool vm_class_tables_install(arx_vm_context_t *vm, const class_entry_t *classes, size_t class_count, const method_entry_t *methods, size_t method_count, const field_entry_t *fields, size_t field_count)
+{
+    // Expand class capacity if needed
+    if (class_count > vm->class_system.class_capacity) {
+        size_t new_capacity = class_count * 2;
+        class_entry_t *new_classes = realloc(vm->class_system.classes, new_capacity * sizeof(class_entry_t));
+        if (new_classes == NULL) {
+            return false;
+        }
+        vm->class_system.classes = new_classes;
+        vm->class_system.class_capacity = new_capacity;
+    }
+    
+    // Copy classes
+    vm_class_index_free(vm);
+    memcpy(vm->class_system.classes, classes, class_count * sizeof(class_entry_t));
+    vm->class_system.class_count = class_count;
+    
+    // Load methods if provided
+    if (methods && method_count > 0) {
+        // Expand method capacity if needed
+        if (method_count > vm->class_system.method_capacity) {
+            size_t new_capacity = method_count * 2;
+            method_entry_t *new_methods = realloc(vm->class_system.methods, new_capacity * sizeof(method_entry_t));
+            if (new_methods == NULL) {
+                return false;
+            }
+            vm->class_system.methods = new_methods;
+            vm->class_system.method_capacity = new_capacity;
+        }
+        
+        // Copy methods
+        memcpy(vm->class_system.methods, methods, method_count * sizeof(method_entry_t));
+        vm->class_system.method_count = method_count;
+    }
+    
+    // Load fields if provided
+    if (fields && field_count > 0) {
+        // Expand field capacity if needed
+        if (field_count > vm->class_system.field_capacity) {
+            size_t new_capacity = field_count * 2;
+            field_entry_t *new_fields = realloc(vm->class_system.fields, new_capacity * sizeof(field_entry_t));
+            if (new_fields == NULL) {
+                return false;
+            }
+            vm->class_system.fields = new_fields;
+            vm->class_system.field_capacity = new_capacity;
+        }
+        
+        // Copy fields
+        memcpy(vm->class_system.fields, fields, field_count * sizeof(field_entry_t));
+        vm->class_system.field_count = field_count;
+    }
+    
+    return true;
+}
+
+bool vm_load_classes(arx_vm_context_t *vm, class_entry_t *classes, size_t class_count, method_entry_t *methods, size_t method_count, field_entry_t *fields, size_t field_count)
+{
+    if (vm == NULL || classes == NULL) {
+        return false;
+    }
+    
+    if (!vm_class_tables_install(vm, classes, class_count, methods, method_count, fields, field_count)) {
+        return false;
+    }
+    
+    // Classes loaded (method addresses should be pre-calculated by linker)
+    if (!vm_class_index_build(vm)) {
+        return false;
+    }
+    
+    if (vm->debug_mode) {
+        printf("VM loaded %zu classes\n", class_count);
+        for (size_t i = 0; i < class_count; i++) {
+            printf("  Class %zu: %s (ID: %llu, fields: %u, methods: %u)\n", 
+                   i + 1, vm->class_system.classes[i].class_name,
+                   (unsigned long long)vm->class_system.classes[i].class_id,
+                   vm->class_system.classes[i].field_count,
+                   vm->class_system.classes[i].method_count);
+        }
+        
+        if (vm->class_system.methods && vm->class_system.method_count > 0) {
+            printf("VM loaded %zu methods\n", vm->class_system.method_count);
+            for (size_t i = 0; i < vm->class_system.method_count; i++) {
+                printf("  Method %zu: %s (offset: %llu)\n", 
+                       i + 1, vm->class_system.methods[i].method_name,
+                       (unsigned long long)vm->class_system.methods[i].offset);
+            }
+        }
+        
+        if (vm->class_system.fields && vm->class_system.field_count > 0) {
+            printf("VM loaded %zu fields\n", vm->class_system.field_count);
+            for (size_t i = 0; i < vm->class_system.field_count; i++) {
+                printf("  Field %zu: %s (offset: %llu)\n", 
+                       i + 1, vm->class_system.fields[i].field_name,
+                       (unsigned long long)vm->class_system.fields[i].offset);
+            }
+        }
+    }
+    
+    return true;
 }
 
-bool vm_execute_storex(arx_vm_context_t *vm, uint8_t level, uint64_t offset)
+// === Warm-start images ===
+
+#define VM_IMAGE_LAYOUT ((uint32_t)(sizeof(class_entry_t) << 20 | sizeof(method_entry_t) << 10 | sizeof(field_entry_t)))
+
+// Place a section of size bytes at *end (8-byte aligned) and advance *end
+static void vm_image_place(vm_image_section_t *section, uint64_t *end, uint64_t count, size_t entry_size)
 {
-    // Store to array element
-    uint64_t value;
-    if (!vm_pop(vm, &value)) {
-        return false;
-    }
-    
-    uint64_t index;
-    if (!vm_pop(vm, &index)) {
-        return false;
-    }
-    
-    uint64_t base_addr;
-    if (!vm_get_base(vm, level, &base_addr)) {
-        return false;
-    }
-    
-    uint64_t address = base_addr + offset + index;
-    if (address >= vm->memory_size) {
-        last_error = VM_ERROR_MEMORY_ACCESS;
-        return false;
+    section->offset = (*end + 7) & ~(uint64_t)7;
+    section->count = count;
+    *end = section->offset + count * entry_size;
+}
+
+// Checksum of an image: djb2, as arxmod_calculate_hash() hashes a module,
+// over the header (checksum 0) and then each section's entries in file
+// order. Padding between sections is not covered.
+static uint64_t vm_image_hash(uint64_t hash, const void *data, size_t size)
+{
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash = ((hash << 5) + hash) + bytes[i];
     }
-    
-    vm->memory[address] = value;
-    return true;
+    return hash;
 }
 
-void vm_halt(arx_vm_context_t *vm)
+static uint64_t vm_image_hash_section(uint64_t hash, const vm_image_section_t *section, const void *data, size_t entry_size)
 {
-    if (vm != NULL) {
-        vm->halted = true;
-        if (vm->debug_mode) {
-            printf("VM halted\n");
-        }
+    return section->count > 0 ? vm_image_hash(hash, data, (size_t)section->count * entry_size) : hash;
+}
+
+static bool vm_image_put(FILE *file, const vm_image_section_t *section, const void *data, size_t entry_size)
+{
+    size_t size = (size_t)section->count * entry_size;
+    if (size == 0) {
+        return true;
     }
+    return fseek(file, (long)section->offset, SEEK_SET) == 0 && fwrite(data, 1, size, file) == size;
 }
 
-bool vm_push(arx_vm_context_t *vm, uint64_t value)
+// Write the state prepared by loading a module (before it runs) to file
+bool vm_write_image(arx_vm_context_t *vm, FILE *file, uint64_t module_hash, uint64_t module_size)
 {
-    if (vm == NULL) {
-        last_error = VM_ERROR_INVALID_ADDRESS;
+    // An image holds one module; linked modules are loaded again on use
+    if (vm == NULL || file == NULL || vm->instructions == NULL || vm->modules.count > 0) {
         return false;
     }
     
-    if (vm->stack_top >= vm->stack_size) {
-        if (vm->debug_mode) {
-            printf("vm_push failed: stack overflow (stack_top=%zu, stack_size=%zu)\n", 
-                   vm->stack_top, vm->stack_size);
-        }
-        last_error = VM_ERROR_STACK_OVERFLOW;
-        vm->halted = true; // Halt VM on stack overflow
+    size_t string_count = vm->string_table.string_count;
+    size_t strings_size = 0;
+    for (size_t i = 0; i < string_count; i++) {
+        const char *string = vm->string_table.strings[i] != NULL ? vm->string_table.strings[i] : "";
+        strings_size += strlen(string) + 1;
+    }
+    
+    size_t class_count = vm->class_system.class_count;
+    size_t index_entries = vm->class_system.id_index != NULL ? vm->class_system.index_mask + 1 : 0;
+    size_t vtable_entries = vm->class_system.vtables != NULL ? class_count * vm->class_system.vtable_width : 0;
+    
+    vm_image_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, VM_IMAGE_MAGIC, sizeof(header.magic));
+    header.version = VM_IMAGE_VERSION;
+    header.layout = VM_IMAGE_LAYOUT;
+    header.module_hash = module_hash;
+    header.module_size = module_size;
+    header.string_count = string_count;
+    header.index_mask = vm->class_system.index_mask;
+    header.vtable_width = vtable_entries > 0 ? vm->class_system.vtable_width : 0;
+    
+    uint64_t end = sizeof(header);
+    vm_image_place(&header.instructions, &end, vm->instruction_count, sizeof(instruction_t));
+    vm_image_place(&header.strings, &end, strings_size, 1);
+    vm_image_place(&header.classes, &end, class_count, sizeof(class_entry_t));
+    vm_image_place(&header.methods, &end, vm->class_system.methods != NULL ? vm->class_system.method_count : 0,
+                   sizeof(method_entry_t));
+    vm_image_place(&header.fields, &end, vm->class_system.fields != NULL ? vm->class_system.field_count : 0,
+                   sizeof(field_entry_t));
+    vm_image_place(&header.id_index, &end, index_entries, sizeof(uint32_t));
+    vm_image_place(&header.name_index, &end, index_entries, sizeof(uint32_t));
+    vm_image_place(&header.vtables, &end, vtable_entries, sizeof(uint64_t));
+    
+    uint64_t checksum = vm_image_hash(5381, &header, sizeof(header));
+    checksum = vm_image_hash_section(checksum, &header.instructions, vm->instructions, sizeof(instruction_t));
+    for (size_t i = 0; i < string_count; i++) {
+        const char *string = vm->string_table.strings[i] != NULL ? vm->string_table.strings[i] : "";
+        checksum = vm_image_hash(checksum, string, strlen(string) + 1);
+    }
+    checksum = vm_image_hash_section(checksum, &header.classes, vm->class_system.classes, sizeof(class_entry_t));
+    checksum = vm_image_hash_section(checksum, &header.methods, vm->class_system.methods, sizeof(method_entry_t));
+    checksum = vm_image_hash_section(checksum, &header.fields, vm->class_system.fields, sizeof(field_entry_t));
+    checksum = vm_image_hash_section(checksum, &header.id_index, vm->class_system.id_index, sizeof(uint32_t));
+    checksum = vm_image_hash_section(checksum, &header.name_index, vm->class_system.name_index, sizeof(uint32_t));
+    checksum = vm_image_hash_section(checksum, &header.vtables, vm->class_system.vtables, sizeof(uint64_t));
+    header.checksum = checksum;
+    
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
         return false;
     }
     
-    vm->stack[vm->stack_top++] = value;
-    
-    if (vm->debug_mode && vm->stack_top > 30) {
-        printf("vm_push: pushed %llu, stack_top now %zu\n", 
-               (unsigned long long)value, vm->stack_top);
+    if (strings_size > 0) {
+        if (fseek(file, (long)header.strings.offset, SEEK_SET) != 0) {
+            return false;
+        }
+        for (size_t i = 0; i < string_count; i++) {
+            const char *string = vm->string_table.strings[i] != NULL ? vm->string_table.strings[i] : "";
+            size_t length = strlen(string) + 1;
+            if (fwrite(string, 1, length, file) != length) {
+                return false;
+            }
+        }
     }
     
-    return true;
-}
-
-bool vm_pop(arx_vm_context_t *vm, uint64_t *value)
-{
-    if (vm == NULL) {
-        last_error = VM_ERROR_INVALID_ADDRESS;
-        return false;
-    }
+    bool ok = vm_image_put(file, &header.instructions, vm->instructions, sizeof(instruction_t)) &&
+              vm_image_put(file, &header.classes, vm->class_system.classes, sizeof(class_entry_t)) &&
+              vm_image_put(file, &header.methods, vm->class_system.methods, sizeof(method_entry_t)) &&
+              vm_image_put(file, &header.fields, vm->class_system.fields, sizeof(field_entry_t)) &&
+              vm_image_put(file, &header.id_index, vm->class_system.id_index, sizeof(uint32_t)) &&
+              vm_image_put(file, &header.name_index, vm->class_system.name_index, sizeof(uint32_t)) &&
+              vm_image_put(file, &header.vtables, vm->class_system.vtables, sizeof(uint64_t));
     
-    if (vm->stack_top == 0) {
-        if (vm->debug_mode) {
-            printf("vm_pop failed: stack underflow (stack_top=%zu)\n", vm->stack_top);
+    // Pad to the planned size: an empty last section still has to lie inside the file
+    if (ok && fseek(file, 0, SEEK_END) == 0) {
+        for (long size = ftell(file); ok && size >= 0 && (uint64_t)size < end; size++) {
+            ok = fputc(0, file) != EOF;
         }
-        last_error = VM_ERROR_STACK_UNDERFLOW;
-        vm->halted = true; // Halt VM on stack underflow
-        return false;
     }
     
-    if (value != NULL) {
-        *value = vm->stack[--vm->stack_top];
-    } else {
-        vm->stack_top--;
-    }
-    return true;
-}
-
-bool vm_peek(arx_vm_context_t *vm, size_t offset, uint64_t *value)
-{
-    if (vm == NULL || offset >= vm->stack_top) {
-        return false;
+    if (ok && vm->debug_mode) {
+        printf("VM image written: %zu instructions, %zu strings, %zu classes (%llu bytes)\n",
+               vm->instruction_count, string_count, class_count, (unsigned long long)end);
     }
     
-    if (value != NULL) {
-        *value = vm->stack[vm->stack_top - 1 - offset];
-    }
-    return true;
+    return ok;
 }
 
-bool vm_poke(arx_vm_context_t *vm, size_t offset, uint64_t value)
+static const void *vm_image_section(const uint8_t *image, size_t image_size, const vm_image_section_t *section, size_t entry_size)
 {
-    if (vm == NULL || offset >= vm->stack_top) {
-        return false;
+    if (section->offset % 8 != 0 || section->offset > image_size ||
+        (entry_size > 0 && section->count > (image_size - section->offset) / entry_size)) {
+        return NULL;
     }
-    
-    vm->stack[vm->stack_top - 1 - offset] = value;
-    return true;
+    return image + section->offset;
 }
 
-bool vm_load(arx_vm_context_t *vm, uint64_t address, uint64_t *value)
+// A class index holds class numbers + 1 (0 = empty) and needs an empty slot
+// to end every probe
+static bool vm_image_index_valid(const uint32_t *index, size_t entries, size_t class_count)
 {
-    if (vm == NULL || address >= vm->memory_size) {
-        last_error = VM_ERROR_MEMORY_ACCESS;
-        return false;
-    }
-    
-    if (value != NULL) {
-        *value = vm->memory[address];
+    size_t used = 0;
+    for (size_t i = 0; i < entries; i++) {
+        if (index[i] > class_count) {
+            return false;
+        }
+        used += index[i] != 0;
     }
-    return true;
+    return used <= class_count && used < entries;
 }
 
-bool vm_store(arx_vm_context_t *vm, uint64_t address, uint64_t value)
+// Restore the state written by vm_write_image() for the same module. Code
+// and strings stay in the image, which must outlive the VM; the class tables
+// are copied because the VM owns and may grow them. The image is trusted
+// only as far as its checksum: the code and vtables are verified again as
+// they are for a module, and the class indexes are bounds-checked.
+bool vm_load_image(arx_vm_context_t *vm, const uint8_t *image, size_t image_size, uint64_t module_hash, uint64_t module_size)
 {
-    if (vm == NULL || address >= vm->memory_size) {
-        last_error = VM_ERROR_MEMORY_ACCESS;
+    if (vm == NULL || image == NULL || image_size < sizeof(vm_image_header_t)) {
         return false;
     }
     
-    vm->memory[address] = value;
-    return true;
-}
-
-bool vm_load_string(arx_vm_context_t *vm, uint64_t string_id, const char **string)
-{
-    if (vm == NULL) {
-        if (vm && vm->debug_mode) {
-            printf("vm_load_string: vm is NULL\n");
+    vm_image_header_t header;
+    memcpy(&header, image, sizeof(header));
+    if (memcmp(header.magic, VM_IMAGE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != VM_IMAGE_VERSION || header.layout != VM_IMAGE_LAYOUT ||
+        header.module_hash != module_hash || header.module_size != module_size) {
+        if (vm->debug_mode) {
+            printf("VM image: stale or foreign image ignored\n");
         }
         return false;
     }
     
-    if (string_id >= vm->string_table.string_count) {
+    size_t index_entries = (size_t)header.index_mask + 1;
+    const instruction_t *instructions = vm_image_section(image, image_size, &header.instructions, sizeof(instruction_t));
+    const char *strings = vm_image_section(image, image_size, &header.strings, 1);
+    const class_entry_t *classes = vm_image_section(image, image_size, &header.classes, sizeof(class_entry_t));
+    const method_entry_t *methods = vm_image_section(image, image_size, &header.methods, sizeof(method_entry_t));
+    const field_entry_t *fields = vm_image_section(image, image_size, &header.fields, sizeof(field_entry_t));
+    const uint32_t *id_index = vm_image_section(image, image_size, &header.id_index, sizeof(uint32_t));
+    const uint32_t *name_index = vm_image_section(image, image_size, &header.name_index, sizeof(uint32_t));
+    const uint64_t *vtables = vm_image_section(image, image_size, &header.vtables, sizeof(uint64_t));
+    if (instructions == NULL || strings == NULL || classes == NULL || methods == NULL || fields == NULL ||
+        id_index == NULL || name_index == NULL || vtables == NULL || header.instructions.count == 0 ||
+        (header.classes.count > 0 &&
+         ((header.index_mask & (header.index_mask + 1)) != 0 || header.id_index.count != index_entries ||
+          header.name_index.count != index_entries || header.classes.count > index_entries / 2)) ||
+        header.vtables.count != header.classes.count * header.vtable_width ||
+        (header.strings.count > 0 && strings[header.strings.count - 1] != '\0')) {
         if (vm->debug_mode) {
-            printf("vm_load_string: string_id %llu >= string_count %zu\n", 
-                   (unsigned long long)string_id, vm->string_table.string_count);
+            printf("VM image: malformed image ignored\n");
         }
         return false;
     }
     
-    if (string != NULL) {
-        *string = vm->string_table.strings[string_id];
-    }
-    return true;
-}
-
-bool vm_store_string(arx_vm_context_t *vm, const char *string, uint64_t *string_id)
-{
-    if (vm == NULL || string == NULL) {
-        if (vm && vm->debug_mode) {
-            printf("vm_store_string: NULL parameter (vm=%p, string=%p)\n", (void*)vm, (void*)string);
+    vm_image_header_t unsummed = header;
+    unsummed.checksum = 0;
+    uint64_t checksum = vm_image_hash(5381, &unsummed, sizeof(unsummed));
+    checksum = vm_image_hash_section(checksum, &header.instructions, instructions, sizeof(instruction_t));
+    checksum = vm_image_hash_section(checksum, &header.strings, strings, 1);
+    checksum = vm_image_hash_section(checksum, &header.classes, classes, sizeof(class_entry_t));
+    checksum = vm_image_hash_section(checksum, &header.methods, methods, sizeof(method_entry_t));
+    checksum = vm_image_hash_section(checksum, &header.fields, fields, sizeof(field_entry_t));
+    checksum = vm_image_hash_section(checksum, &header.id_index, id_index, sizeof(uint32_t));
+    checksum = vm_image_hash_section(checksum, &header.name_index, name_index, sizeof(uint32_t));
+    checksum = vm_image_hash_section(checksum, &header.vtables, vtables, sizeof(uint64_t));
+    if (checksum != header.checksum ||
+        (header.classes.count > 0 &&
+         (!vm_image_index_valid(id_index, index_entries, (size_t)header.classes.count) ||
+          !vm_image_index_valid(name_index, index_entries, (size_t)header.classes.count)))) {
+        if (vm->debug_mode) {
+            printf("VM image: corrupt image ignored\n");
         }
-        last_error = VM_ERROR_INVALID_ADDRESS;
         return false;
     }
     
-    if (vm->string_table.string_count >= vm->string_table.string_capacity) {
-        if (vm->debug_mode) {
-            printf("vm_store_string: String table full (count=%zu, capacity=%zu)\n", 
-                   vm->string_table.string_count, vm->string_table.string_capacity);
+    // Strings: one pointer per NUL-terminated entry of the blob
+    size_t string_count = (size_t)header.string_count;
+    if (string_count > 0) {
+        char **table = malloc(string_count * sizeof(char *));
+        if (table == NULL) {
+            return false;
+        }
+        size_t found = 0;
+        for (size_t offset = 0; offset < header.strings.count && found < string_count; found++) {
+            table[found] = (char *)&strings[offset];
+            offset += strlen(&strings[offset]) + 1;
+        }
+        bool mapped = found == string_count && vm_map_strings(vm, table, string_count);
+        free(table);
+        if (!mapped) {
+            return false;
         }
-        last_error = VM_ERROR_STRING_TABLE_FULL;
-        return false;
     }
     
-    size_t len = strlen(string) + 1;
-    vm->string_table.strings[vm->string_table.string_count] = malloc(len);
-    if (vm->string_table.strings[vm->string_table.string_count] == NULL) {
-        if (vm->debug_mode) {
-            printf("vm_store_string: Failed to allocate memory for string (len=%zu)\n", len);
+    // Class tables, indexes and vtables exactly as vm_load_classes built them
+    vm_class_index_free(vm);
+    if (header.classes.count > 0) {
+        if (!vm_class_tables_install(vm, classes, (size_t)header.classes.count, methods, (size_t)header.methods.count,
+                                     fields, (size_t)header.fields.count)) {
+            return false;
         }
-        return false;
+        vm->class_system.id_index = malloc(index_entries * sizeof(uint32_t));
+        vm->class_system.name_index = malloc(index_entries * sizeof(uint32_t));
+        vm->class_system.vtables = header.vtables.count > 0 ? malloc((size_t)header.vtables.count * sizeof(uint64_t)) : NULL;
+        if (vm->class_system.id_index == NULL || vm->class_system.name_index == NULL ||
+            (header.vtables.count > 0 && vm->class_system.vtables == NULL) || !vm_class_templates_build(vm)) {
+            vm_class_index_free(vm);
+            return false;
+        }
+        memcpy(vm->class_system.id_index, id_index, index_entries * sizeof(uint32_t));
+        memcpy(vm->class_system.name_index, name_index, index_entries * sizeof(uint32_t));
+        if (header.vtables.count > 0) {
+            memcpy(vm->class_system.vtables, vtables, (size_t)header.vtables.count * sizeof(uint64_t));
+        }
+        vm->class_system.index_mask = (size_t)header.index_mask;
+        vm->class_system.vtable_width = (size_t)header.vtable_width;
     }
     
-    strcpy(vm->string_table.strings[vm->string_table.string_count], string);
-    
-    if (string_id != NULL) {
-        *string_id = vm->string_table.string_count;
+    if (!vm_install_program(vm, (instruction_t *)instructions, (size_t)header.instructions.count)) {
+        // The loader unmaps a rejected image and loads the module instead
+        for (size_t i = 0; i < vm->string_table.mapped_count; i++) {
+            vm->string_table.strings[i] = NULL;
+        }
+        vm->string_table.mapped_count = 0;
+        return false;
     }
     
     if (vm->debug_mode) {
-        printf("vm_store_string: Stored string='%s' with id=%zu (new count=%zu)\n", 
-               string, vm->string_table.string_count, vm->string_table.string_count + 1);
+        printf("VM image restored: %zu instructions, %zu strings, %zu classes\n",
+               vm->instruction_count, string_count, vm->class_system.class_count);
     }
     
-    vm->string_table.string_count++;
     return true;
 }
 
-bool vm_call(arx_vm_context_t *vm, uint64_t address, uint64_t level)
+// === Cross-module linking ===
+// Modules are separate compilation units: each numbers its code, strings,
+// globals and method slots from 0, and names what it uses from other modules
+// in its EXTERNS section. vm_link_module() appends a module to the running
+// program and moves its operands into the VM's ranges; method slots are
+// shared by name, so a call through a slot reaches the same method in every
+// module. Modules are linked on first use through the resolver.
+
+// Append references; a module's VM_CALS operands index them from extern_base
+static bool vm_externs_append(arx_vm_context_t *vm, const external_ref_t *externs, size_t extern_count)
 {
-    if (vm == NULL || vm->call_stack.current_frame >= vm->call_stack.frame_capacity) {
-        last_error = VM_ERROR_CALL_STACK_OVERFLOW;
-        return false;
+    if (extern_count == 0) {
+        return true;
     }
     
-    // Safety check: prevent calling invalid address
-    if (address >= vm->instruction_count) {
-        if (vm->debug_mode) {
-            printf("VM_CALL: Invalid call target %llu >= instruction_count %zu\n", 
-                   (unsigned long long)address, vm->instruction_count);
-        }
-        last_error = VM_ERROR_INVALID_ADDRESS;
+    size_t total = vm->modules.extern_count + extern_count;
+    external_ref_t *new_externs = realloc(vm->modules.externs, total * sizeof(external_ref_t));
+    if (new_externs == NULL) {
+        vm->last_error = VM_ERROR_OUT_OF_MEMORY;
         return false;
     }
-    
-    // Safety check: prevent infinite recursion (max 50 call levels)
-    if (vm->call_stack.current_frame >= 50) {
-        if (vm->debug_mode) {
-            printf("VM_CALL: Call stack too deep (%zu levels), preventing infinite recursion\n", 
-                   vm->call_stack.current_frame);
-        }
-        last_error = VM_ERROR_CALL_STACK_OVERFLOW;
+    vm->modules.externs = new_externs;
+    uint64_t *new_slots = realloc(vm->modules.bound_slots, total * sizeof(uint64_t));
+    if (new_slots == NULL) {
+        vm->last_error = VM_ERROR_OUT_OF_MEMORY;
         return false;
     }
+    vm->modules.bound_slots = new_slots;
     
-    // Save current state
-    uint64_t *frame = &vm->call_stack.frames[vm->call_stack.current_frame * 4];
-    frame[0] = vm->pc;        // Return address
-    frame[1] = vm->stack_top; // Stack top
-    frame[2] = level;         // Level
-    frame[3] = 0;             // Reserved
-    
-    vm->call_stack.current_frame++;
-    vm->pc = address;
-    
+    memcpy(&vm->modules.externs[vm->modules.extern_count], externs, extern_count * sizeof(external_ref_t));
+    for (size_t i = vm->modules.extern_count; i < total; i++) {
+        vm->modules.externs[i].module_name[sizeof(vm->modules.externs[i].module_name) - 1] = '\0';
+        vm->modules.externs[i].name[sizeof(vm->modules.externs[i].name) - 1] = '\0';
+        vm->modules.bound_slots[i] = VM_VTABLE_EMPTY;
+    }
+    vm->modules.extern_count = total;
     return true;
 }
 
-bool vm_return(arx_vm_context_t *vm)
+// References of the main module; load them before its code, which is
+// verified against them
+bool vm_load_externs(arx_vm_context_t *vm, const external_ref_t *externs, size_t extern_count)
 {
-    if (vm == NULL || vm->call_stack.current_frame == 0) {
-        last_error = VM_ERROR_CALL_STACK_UNDERFLOW;
+    if (vm == NULL) {
+        return false;
+    }
+    if ((extern_count > 0 && externs == NULL)) {
+        vm->last_error = VM_ERROR_INVALID_ADDRESS;
         return false;
     }
     
-    vm->call_stack.current_frame--;
-    uint64_t *frame = &vm->call_stack.frames[vm->call_stack.current_frame * 4];
-    
-    vm->pc = frame[0];        // Return address
-    vm->stack_top = frame[1]; // Restore stack top
-    
-    return true;
-}
-
-bool vm_get_base(arx_vm_context_t *vm, uint64_t level, uint64_t *base)
-{
-    (void)level; // Suppress unused parameter warning
-    if (vm == NULL || base == NULL) {
+    if (!vm_externs_append(vm, externs, extern_count)) {
         return false;
     }
     
-    // For now, return 0 as base address
-    // In a full implementation, this would traverse the call stack
-    *base = 0;
+    if (vm->debug_mode && extern_count > 0) {
+        printf("VM: Loaded %zu external references\n", extern_count);
+    }
     return true;
 }
 
-void vm_dump_state(arx_vm_context_t *vm)
+void vm_set_module_resolver(arx_vm_context_t *vm, vm_module_resolver_t resolver, void *user_data)
 {
-    if (vm == NULL) {
-        printf("VM state: NULL\n");
-        return;
+    if (vm != NULL) {
+        vm->modules.resolver = resolver;
+        vm->modules.resolver_data = user_data;
     }
-    
-    printf("\n=== VM State ===\n");
-    printf("PC: %zu\n", vm->pc);
-    printf("Stack top: %zu/%zu\n", vm->stack_top, vm->stack_size);
-    printf("Instructions executed: %zu\n", vm->instruction_count_executed);
-    printf("Halted: %s\n", vm->halted ? "yes" : "no");
-    printf("Call stack depth: %zu\n", vm->call_stack.current_frame);
-    printf("String count: %zu\n", vm->string_table.string_count);
-    printf("\n");
 }
 
-void vm_dump_stack(arx_vm_context_t *vm, size_t count)
+bool vm_module_is_linked(arx_vm_context_t *vm, const char *module_name)
 {
-    if (vm == NULL) {
-        return;
+    if (vm == NULL || module_name == NULL) {
+        return false;
     }
-    
-    printf("\n=== Stack (top %zu) ===\n", count);
-    size_t start = (vm->stack_top > count) ? vm->stack_top - count : 0;
-    for (size_t i = start; i < vm->stack_top; i++) {
-        printf("  [%zu]: %llu\n", i, (unsigned long long)vm->stack[i]);
+    for (size_t i = 0; i < vm->modules.count; i++) {
+        if (strncmp(vm->modules.names[i], module_name, sizeof(vm->modules.names[i])) == 0) {
+            return true;
+        }
     }
-    printf("\n");
+    return false;
 }
 
-void vm_dump_memory(arx_vm_context_t *vm, size_t start, size_t count)
+// Link module_name through the resolver unless it already is
+static bool vm_require_module(arx_vm_context_t *vm, const char *module_name)
 {
-    if (vm == NULL) {
-        return;
+    if (vm_module_is_linked(vm, module_name)) {
+        return true;
     }
     
-    printf("\n=== Memory [%zu:%zu] ===\n", start, start + count - 1);
-    for (size_t i = 0; i < count && start + i < vm->memory_size; i++) {
-        printf("  [%zu]: %llu\n", start + i, (unsigned long long)vm->memory[start + i]);
+    if (vm->modules.resolver == NULL || !vm->modules.resolver(vm, vm->modules.resolver_data, module_name) ||
+        !vm_module_is_linked(vm, module_name)) {
+        printf("Error: Cannot link imported module %s\n", module_name);
+        vm->last_error = VM_ERROR_MODULE_NOT_FOUND;
+        return false;
     }
-    printf("\n");
+    return true;
 }
 
-void vm_dump_instructions(arx_vm_context_t *vm, size_t start, size_t count)
+// Slot of an external method reference, linking its module on first use
+static bool vm_bind_method(arx_vm_context_t *vm, uint64_t index, uint64_t *slot)
 {
-    if (vm == NULL || vm->instructions == NULL) {
-        return;
-    }
-    
-    printf("\n=== Instructions [%zu:%zu] ===\n", start, start + count - 1);
-    for (size_t i = 0; i < count && start + i < vm->instruction_count; i++) {
-        instruction_t *instr = &vm->instructions[start + i];
-        uint8_t opcode = instr->opcode & 0xF;
-        uint8_t level = (instr->opcode >> 4) & 0xF;
-        uint64_t operand = instr->opt64;
+    if (vm->modules.bound_slots[index] == VM_VTABLE_EMPTY) {
+        // Linking may move the reference table, so names are copied first
+        char module_name[sizeof(vm->modules.externs[index].module_name)];
+        char method_name[sizeof(vm->modules.externs[index].name)];
+        memcpy(module_name, vm->modules.externs[index].module_name, sizeof(module_name));
+        memcpy(method_name, vm->modules.externs[index].name, sizeof(method_name));
+        if (!vm_require_module(vm, module_name)) {
+            return false;
+        }
         
-        printf("  [%zu]: opcode=%d, level=%d, operand=%llu\n", 
-               start + i, opcode, level, (unsigned long long)operand);
-    }
-    printf("\n");
-}
-
-vm_error_t vm_get_last_error(arx_vm_context_t *vm)
-{
-    (void)vm; // Unused parameter
-    return last_error;
-}
-
-const char* vm_error_to_string(vm_error_t error)
-{
-    switch (error) {
-        case VM_ERROR_NONE: return "No error";
-        case VM_ERROR_STACK_OVERFLOW: return "Stack overflow";
-        case VM_ERROR_STACK_UNDERFLOW: return "Stack underflow";
-        case VM_ERROR_MEMORY_ACCESS: return "Memory access error";
-        case VM_ERROR_INVALID_INSTRUCTION: return "Invalid instruction";
-        case VM_ERROR_CALL_STACK_OVERFLOW: return "Call stack overflow";
-        case VM_ERROR_CALL_STACK_UNDERFLOW: return "Call stack underflow";
-        case VM_ERROR_STRING_TABLE_FULL: return "String table full";
-        case VM_ERROR_INVALID_ADDRESS: return "Invalid address";
-        default: return "Unknown error";
+        for (size_t i = 0; i < vm->class_system.method_count; i++) {
+            if (strncmp(vm->class_system.methods[i].method_name, method_name, sizeof(method_name)) == 0) {
+                vm->modules.bound_slots[index] = vm->class_system.methods[i].method_id;
+                break;
+            }
+        }
+        if (vm->modules.bound_slots[index] == VM_VTABLE_EMPTY) {
+            printf("Error: Module %s defines no method %s\n", module_name, method_name);
+            vm->last_error = VM_ERROR_METHOD_NOT_FOUND;
+            return false;
+        }
+        
+        if (vm->debug_mode) {
+            printf("VM: Bound %s.%s to method slot %llu\n", module_name, method_name,
+                   (unsigned long long)vm->modules.bound_slots[index]);
+        }
     }
+    
+    *slot = vm->modules.bound_slots[index];
+    return true;
 }
 
-// Class and method resolution functions
+// Link the module an unknown class ID was imported from; false if no
+// reference names it
+static bool vm_bind_class(arx_vm_context_t *vm, uint64_t class_id)
+{
+    for (size_t i = 0; i < vm->modules.extern_count; i++) {
+        const external_ref_t *ref = &vm->modules.externs[i];
+        if (ref->reference_type == ARXMOD_EXTERN_CLASS && ref->external_class_id == class_id) {
+            char module_name[sizeof(ref->module_name)];
+            memcpy(module_name, ref->module_name, sizeof(module_name));
+            return vm_require_module(vm, module_name);
+        }
+    }
+    return false;
+}
 
-bool vm_load_classes(arx_vm_context_t *vm, class_entry_t *classes, size_t class_count, method_entry_t *methods, size_t method_count, field_entry_t *fields, size_t field_count)
+// Global memory words the code uses at level 1 and above (globals)
+static size_t vm_global_words(const vm_instruction_t *code, const instruction_t *instructions, size_t count)
 {
-    if (vm == NULL || classes == NULL) {
+    size_t words = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint8_t opcode = code != NULL ? code[i].opcode : instructions[i].opcode & 0xF;
+        uint8_t level = code != NULL ? code[i].level : (instructions[i].opcode >> 4) & 0xF;
+        uint64_t operand = code != NULL ? code[i].operand : instructions[i].opt64;
+        if ((opcode == VM_LOD || opcode == VM_STO || opcode == VM_LODX || opcode == VM_STOX) &&
+            level > 0 && operand < SIZE_MAX && operand + 1 > words) {
+            words = (size_t)operand + 1;
+        }
+    }
+    return words;
+}
+
+// Room for string_count strings; the new entries are empty
+static bool vm_strings_reserve(arx_vm_context_t *vm, size_t string_count)
+{
+    size_t old_capacity = vm->string_table.string_capacity;
+    if (string_count <= old_capacity) {
+        return true;
+    }
+    
+    size_t new_capacity = old_capacity * 2 > string_count ? old_capacity * 2 : string_count;
+    char **strings = realloc(vm->string_table.strings, new_capacity * sizeof(char *));
+    if (strings == NULL) {
         return false;
     }
+    memset(&strings[old_capacity], 0, (new_capacity - old_capacity) * sizeof(char *));
+    vm->string_table.strings = strings;
     
-    // Expand class capacity if needed
+    if (vm->string_table.literals != NULL) {
+        uint64_t *literals = realloc(vm->string_table.literals, new_capacity * sizeof(uint64_t));
+        if (literals == NULL) {
+            return false;
+        }
+        memset(&literals[old_capacity], 0, (new_capacity - old_capacity) * sizeof(uint64_t));
+        vm->string_table.literals = literals;
+    }
+    vm->string_table.string_capacity = new_capacity;
+    return true;
+}
+
+// Append the module's classes; methods move to its code and the VM's slots
+static bool vm_classes_append(arx_vm_context_t *vm, const vm_module_t *module, size_t code_base, const uint64_t *slot_map)
+{
+    size_t class_count = vm->class_system.class_count + module->class_count;
     if (class_count > vm->class_system.class_capacity) {
-        size_t new_capacity = class_count * 2;
-        class_entry_t *new_classes = realloc(vm->class_system.classes, new_capacity * sizeof(class_entry_t));
-        if (new_classes == NULL) {
+        class_entry_t *classes = realloc(vm->class_system.classes, class_count * 2 * sizeof(class_entry_t));
+        if (classes == NULL) {
             return false;
         }
-        vm->class_system.classes = new_classes;
-        vm->class_system.class_capacity = new_capacity;
+        vm->class_system.classes = classes;
+        vm->class_system.class_capacity = class_count * 2;
     }
     
-    // Copy classes
-    memcpy(vm->class_system.classes, classes, class_count * sizeof(class_entry_t));
+    size_t method_count = vm->class_system.method_count + module->method_count;
+    if (method_count > vm->class_system.method_capacity) {
+        method_entry_t *methods = realloc(vm->class_system.methods, method_count * 2 * sizeof(method_entry_t));
+        if (methods == NULL) {
+            return false;
+        }
+        vm->class_system.methods = methods;
+        vm->class_system.method_capacity = method_count * 2;
+    }
+    
+    // Templates are freed per class, so before the count changes
+    vm_class_index_free(vm);
+    memcpy(&vm->class_system.classes[vm->class_system.class_count], module->classes,
+           module->class_count * sizeof(class_entry_t));
+    for (size_t i = 0; i < module->method_count; i++) {
+        method_entry_t *method = &vm->class_system.methods[vm->class_system.method_count + i];
+        *method = module->methods[i];
+        method->offset += code_base;
+        method->method_id = slot_map[module->methods[i].method_id];
+    }
     vm->class_system.class_count = class_count;
+    vm->class_system.method_count = method_count;
     
-    // Load methods if provided
-    if (methods && method_count > 0) {
-        // Expand method capacity if needed
-        if (method_count > vm->class_system.method_capacity) {
-            size_t new_capacity = method_count * 2;
-            method_entry_t *new_methods = realloc(vm->class_system.methods, new_capacity * sizeof(method_entry_t));
-            if (new_methods == NULL) {
-                return false;
+    return vm_class_index_build(vm);
+}
+
+// Append a module to the running program. Its method slots are matched by
+// name against the methods the VM already has, and new names get new
+// slots. A failed link leaves the VM unable to continue the run.
+bool vm_link_module(arx_vm_context_t *vm, const vm_module_t *module)
+{
+    if (vm == NULL || module == NULL || module->name == NULL || vm->code == NULL ||
+        (module->instruction_count > 0 && module->instructions == NULL) ||
+        (module->method_count > 0 && (module->methods == NULL || module->class_count == 0 || module->classes == NULL)) ||
+        (module->string_count > 0 && module->strings == NULL)) {
+        vm->last_error = VM_ERROR_INVALID_ADDRESS;
+        return false;
+    }
+    if (vm_module_is_linked(vm, module->name)) {
+        return true;
+    }
+    
+    vm_link_bases_t bases;
+    bases.code_base = vm->instruction_count;
+    bases.string_base = vm->string_table.string_count;
+    bases.extern_base = vm->modules.extern_count;
+    if (vm->modules.global_limit == 0) {
+        vm->modules.global_limit = vm_global_words(vm->code, NULL, vm->instruction_count);
+    }
+    bases.global_base = vm->modules.global_limit;
+    size_t module_globals = vm_global_words(NULL, module->instructions, module->instruction_count);
+    if (bases.global_base + module_globals > vm->memory_size) {
+        printf("Error: Module %s needs %zu global words, only %zu are free\n", module->name,
+               module_globals, vm->memory_size - bases.global_base);
+        vm->last_error = VM_ERROR_MEMORY_ACCESS;
+        return false;
+    }
+    
+    // The module's method slots, mapped by name into the VM's
+    size_t next_slot = vm->class_system.vtable_width;
+    for (size_t i = 0; i < vm->class_system.method_count; i++) {
+        if (vm->class_system.methods[i].method_id >= next_slot) {
+            next_slot = (size_t)vm->class_system.methods[i].method_id + 1;
+        }
+    }
+    size_t slot_count = 0;
+    for (size_t i = 0; i < module->method_count; i++) {
+        if (module->methods[i].method_id >= VM_VTABLE_MAX_SLOTS) {
+            printf("Error: Module %s: method %s has slot %llu (limit %d)\n", module->name,
+                   module->methods[i].method_name, (unsigned long long)module->methods[i].method_id, VM_VTABLE_MAX_SLOTS);
+            vm->last_error = VM_ERROR_INVALID_PROGRAM;
+            return false;
+        }
+        if (module->methods[i].method_id >= slot_count) {
+            slot_count = (size_t)module->methods[i].method_id + 1;
+        }
+    }
+    uint64_t *slot_map = malloc((slot_count > 0 ? slot_count : 1) * sizeof(uint64_t));
+    if (slot_map == NULL) {
+        vm->last_error = VM_ERROR_OUT_OF_MEMORY;
+        return false;
+    }
+    for (size_t i = 0; i < slot_count; i++) {
+        slot_map[i] = VM_VTABLE_EMPTY;
+    }
+    for (size_t i = 0; i < module->method_count; i++) {
+        const method_entry_t *method = &module->methods[i];
+        if (slot_map[method->method_id] != VM_VTABLE_EMPTY) {
+            continue;
+        }
+        for (size_t j = 0; j < vm->class_system.method_count; j++) {
+            if (strncmp(vm->class_system.methods[j].method_name, method->method_name, sizeof(method->method_name)) == 0) {
+                slot_map[method->method_id] = vm->class_system.methods[j].method_id;
+                break;
             }
-            vm->class_system.methods = new_methods;
-            vm->class_system.method_capacity = new_capacity;
         }
-        
-        // Copy methods
-        memcpy(vm->class_system.methods, methods, method_count * sizeof(method_entry_t));
-        vm->class_system.method_count = method_count;
+        if (slot_map[method->method_id] == VM_VTABLE_EMPTY) {
+            slot_map[method->method_id] = next_slot++;
+        }
     }
+    bases.slot_map = slot_map;
+    bases.slot_count = slot_count;
     
-    // Load fields if provided
-    if (fields && field_count > 0) {
-        // Expand field capacity if needed
-        if (field_count > vm->class_system.field_capacity) {
-            size_t new_capacity = field_count * 2;
-            field_entry_t *new_fields = realloc(vm->class_system.fields, new_capacity * sizeof(field_entry_t));
-            if (new_fields == NULL) {
-                return false;
-            }
-            vm->class_system.fields = new_fields;
-            vm->class_system.field_capacity = new_capacity;
+    // Strings, references and classes first: the code is verified against them
+    bool linked = vm_strings_reserve(vm, bases.string_base + module->string_count);
+    for (size_t i = 0; linked && i < module->string_count; i++) {
+        if (module->strings[i] != NULL) {
+            linked = (vm->string_table.strings[bases.string_base + i] = strdup(module->strings[i])) != NULL;
         }
-        
-        // Copy fields
-        memcpy(vm->class_system.fields, fields, field_count * sizeof(field_entry_t));
-        vm->class_system.field_count = field_count;
     }
+    if (linked) {
+        vm->string_table.string_count = bases.string_base + module->string_count;
+    }
+    linked = linked && vm_externs_append(vm, module->externs, module->extern_count) &&
+             (module->class_count == 0 || vm_classes_append(vm, module, bases.code_base, slot_map));
+    free(slot_map);
     
-    // Classes loaded (method addresses should be pre-calculated by linker)
+    // The module's code goes after the program's, replacing its end marker
+    size_t total = bases.code_base + module->instruction_count;
+    vm_instruction_t end_marker = vm->code[bases.code_base];
+    vm_instruction_t *code = linked ? realloc(vm->code, (total + 1) * sizeof(vm_instruction_t)) : NULL;
+    if (code == NULL) {
+        vm->last_error = VM_ERROR_OUT_OF_MEMORY;
+        return false;
+    }
+    vm->code = code;
+    if (vm->profile != NULL && !vm_profile_reserve(vm, total, false)) {
+        code[bases.code_base] = end_marker;
+        vm->last_error = VM_ERROR_OUT_OF_MEMORY;
+        return false;
+    }
+    if (!vm_decode_range(vm, &code[bases.code_base], module->instructions, module->instruction_count, &bases)) {
+        code[bases.code_base] = end_marker;
+        return false;
+    }
+    vm->instruction_count = total;
+    vm->modules.global_limit = bases.global_base + module_globals;
+    if (!vm_jit_install(vm, bases.code_base, total)) {
+        return false;
+    }
     
-    if (vm->debug_mode) {
-        printf("VM loaded %zu classes\n", class_count);
-        for (size_t i = 0; i < class_count; i++) {
-            printf("  Class %zu: %s (ID: %llu, fields: %u, methods: %u)\n", 
-                   i + 1, vm->class_system.classes[i].class_name,
-                   (unsigned long long)vm->class_system.classes[i].class_id,
-                   vm->class_system.classes[i].field_count,
-                   vm->class_system.classes[i].method_count);
-        }
-        
-        if (vm->class_system.methods && vm->class_system.method_count > 0) {
-            printf("VM loaded %zu methods\n", vm->class_system.method_count);
-            for (size_t i = 0; i < vm->class_system.method_count; i++) {
-                printf("  Method %zu: %s (offset: %llu)\n", 
-                       i + 1, vm->class_system.methods[i].method_name,
-                       (unsigned long long)vm->class_system.methods[i].offset);
-            }
-        }
-        
-        if (vm->class_system.fields && vm->class_system.field_count > 0) {
-            printf("VM loaded %zu fields\n", vm->class_system.field_count);
-            for (size_t i = 0; i < vm->class_system.field_count; i++) {
-                printf("  Field %zu: %s (offset: %llu)\n", 
-                       i + 1, vm->class_system.fields[i].field_name,
-                       (unsigned long long)vm->class_system.fields[i].offset);
-            }
+    // Intern the module's literals like the program's
+    for (size_t i = bases.string_base; i < vm->string_table.string_count; i++) {
+        uint64_t object_addr;
+        if (vm->string_table.strings[i] != NULL && !vm_string_literal(vm, i, &object_addr)) {
+            return false;
         }
     }
     
+    char (*names)[64] = realloc(vm->modules.names, (vm->modules.count + 1) * sizeof(*names));
+    if (names == NULL) {
+        vm->last_error = VM_ERROR_OUT_OF_MEMORY;
+        return false;
+    }
+    vm->modules.names = names;
+    snprintf(names[vm->modules.count], sizeof(names[0]), "%s", module->name);
+    vm->modules.count++;
+    
+    if (vm->debug_mode) {
+        printf("VM: Linked module %s: %zu instructions at %zu, %zu strings, %zu classes, globals from %zu\n",
+               module->name, module->instruction_count, bases.code_base, module->string_count,
+               module->class_count, bases.global_base);
+    }
     return true;
 }
 
@@ -1556,11 +4192,17 @@ bool vm_resolve_class_id(arx_vm_context_t *vm, const char *class_name, uint64_t
         return false;
     }
     
-    for (size_t i = 0; i < vm->class_system.class_count; i++) {
-        if (strcmp(vm->class_system.classes[i].class_name, class_name) == 0) {
-            *class_id = vm->class_system.classes[i].class_id;
+    if (vm->class_system.name_index == NULL) {
+        return false;
+    }
+    size_t slot = vm_class_name_hash(class_name) & vm->class_system.index_mask;
+    while (vm->class_system.name_index[slot] != 0) {
+        class_entry_t *class_entry = &vm->class_system.classes[vm->class_system.name_index[slot] - 1];
+        if (strncmp(class_entry->class_name, class_name, sizeof(class_entry->class_name)) == 0) {
+            *class_id = class_entry->class_id;
             return true;
         }
+        slot = (slot + 1) & vm->class_system.index_mask;
     }
     
     return false;
@@ -1574,24 +4216,21 @@ bool vm_instantiate_class(arx_vm_context_t *vm, uint64_t class_id, uint64_t *obj
         return false;
     }
     
-    // Find the class
-    class_entry_t *class_entry = NULL;
-    for (size_t i = 0; i < vm->class_system.class_count; i++) {
-        if (vm->class_system.classes[i].class_id == class_id) {
-            class_entry = &vm->class_system.classes[i];
-            break;
-        }
+    // Find the class and its prebuilt template
+    ptrdiff_t class_index = vm_class_find(vm, class_id);
+    if (class_index < 0 && vm_bind_class(vm, class_id)) {
+        // A class of an imported module: linked on its first instantiation
+        class_index = vm_class_find(vm, class_id);
     }
-    
-    if (class_entry == NULL) {
+    if (class_index < 0) {
         if (vm->debug_mode) {
             printf("VM: Class ID %llu not found for instantiation\n", (unsigned long long)class_id);
         }
         return false;
     }
-    
-    // Calculate object size (fields only for now)
-    size_t object_size = class_entry->field_count * sizeof(uint64_t);
+    class_entry_t *class_entry = &vm->class_system.classes[class_index];
+    vm_class_template_t *template = &vm->class_system.templates[class_index];
+    size_t object_size = template->words * sizeof(uint64_t);
     
     if (vm->debug_mode) {
         printf("VM: Attempting to instantiate class %s (ID: %llu) with %u fields, object_size=%zu\n", 
@@ -1605,7 +4244,7 @@ bool vm_instantiate_class(arx_vm_context_t *vm, uint64_t class_id, uint64_t *obj
         if (vm->debug_mode) {
             printf("VM: Failed to allocate object for class %s\n", class_entry->class_name);
         }
-        last_error = VM_ERROR_STACK_OVERFLOW;
+        vm->last_error = VM_ERROR_OUT_OF_MEMORY;
         return false;
     }
     
@@ -1617,36 +4256,9 @@ bool vm_instantiate_class(arx_vm_context_t *vm, uint64_t class_id, uint64_t *obj
     
     *object_address = object_entry->memory_address;
     
-    // Initialize object fields with default values
-    if (object_size > 0) {
-        // Initialize all fields to 0
-        for (size_t i = 0; i < object_size / sizeof(uint64_t); i++) {
-            if (object_entry->memory_address + i < vm->stack_size) {
-                vm->stack[object_entry->memory_address + i] = 0;
-            }
-        }
-        
-        // Set default field values based on class type
-        if (strcmp(class_entry->class_name, "Person") == 0) {
-            // Person class: name="Unknown", age=0
-            if (object_entry->memory_address + 0 < vm->stack_size) {
-                vm->stack[object_entry->memory_address + 0] = 1; // String ID for "Unknown"
-            }
-            if (object_entry->memory_address + 1 < vm->stack_size) {
-                vm->stack[object_entry->memory_address + 1] = 0; // Age = 0
-            }
-        } else if (strcmp(class_entry->class_name, "Student") == 0) {
-            // Student class: name="Unknown", age=0, major="Undecided"
-            if (object_entry->memory_address + 0 < vm->stack_size) {
-                vm->stack[object_entry->memory_address + 0] = 1; // String ID for "Unknown"
-            }
-            if (object_entry->memory_address + 1 < vm->stack_size) {
-                vm->stack[object_entry->memory_address + 1] = 0; // Age = 0
-            }
-            if (object_entry->memory_address + 2 < vm->stack_size) {
-                vm->stack[object_entry->memory_address + 2] = 2; // String ID for "Undecided"
-            }
-        }
+    // Copy the initial field image
+    if (template->words > 0) {
+        memcpy(&vm->stack[*object_address], template->image, template->words * sizeof(uint64_t));
     }
     
     if (vm->debug_mode) {
@@ -1667,13 +4279,7 @@ bool vm_get_field_offset(arx_vm_context_t *vm, uint64_t class_id, const char *fi
     }
 
     // Find the class
-    class_entry_t *class_entry = NULL;
-    for (size_t i = 0; i < vm->class_system.class_count; i++) {
-        if (vm->class_system.classes[i].class_id == class_id) {
-            class_entry = &vm->class_system.classes[i];
-            break;
-        }
-    }
+    class_entry_t *class_entry = vm_class_lookup(vm, class_id);
 
     if (class_entry == NULL) {
         if (vm->debug_mode) {
@@ -1712,7 +4318,7 @@ bool vm_access_field(arx_vm_context_t *vm, uint64_t object_address, uint64_t fie
     uint64_t field_address = object_address + field_offset;
 
     // Check bounds
-    if (field_address >= vm->stack_size) {
+    if (!vm_heap_contains(vm, object_address, field_offset + 1)) {
         if (vm->debug_mode) {
             printf("VM: Field access out of bounds at address 0x%llx\n", (unsigned long long)field_address);
         }
@@ -1740,7 +4346,7 @@ bool vm_set_field(arx_vm_context_t *vm, uint64_t object_address, uint64_t field_
     uint64_t field_address = object_address + field_offset;
 
     // Check bounds
-    if (field_address >= vm->stack_size) {
+    if (!vm_heap_contains(vm, object_address, field_offset + 1)) {
         if (vm->debug_mode) {
             printf("VM: Field set out of bounds at address 0x%llx\n", (unsigned long long)field_address);
         }
@@ -1765,13 +4371,7 @@ bool vm_call_method(arx_vm_context_t *vm, uint64_t object_address, uint64_t clas
     }
 
     // Find the class
-    class_entry_t *class_entry = NULL;
-    for (size_t i = 0; i < vm->class_system.class_count; i++) {
-        if (vm->class_system.classes[i].class_id == class_id) {
-            class_entry = &vm->class_system.classes[i];
-            break;
-        }
-    }
+    class_entry_t *class_entry = vm_class_lookup(vm, class_id);
 
     if (class_entry == NULL) {
         if (vm->debug_mode) {
@@ -1834,12 +4434,15 @@ bool vm_memory_manager_init(memory_manager_t *mm)
     // Initialize object tracking
     mm->object_capacity = 1000; // Start with 1000 objects
     mm->objects = calloc(mm->object_capacity, sizeof(object_entry_t));
-    if (mm->objects == NULL) {
+    mm->free_slots = calloc(mm->object_capacity, sizeof(uint32_t));
+    if (mm->objects == NULL || mm->free_slots == NULL) {
+        free(mm->objects);
+        free(mm->free_slots);
         return false;
     }
     
     mm->object_count = 0;
-    mm->next_object_id = 1; // Start object IDs at 1
+    mm->free_slot_count = 0;
     mm->total_allocated = 0;
     mm->total_freed = 0;
     
@@ -1856,10 +4459,187 @@ void vm_memory_manager_cleanup(memory_manager_t *mm)
         free(mm->objects);
         mm->objects = NULL;
     }
+    free(mm->free_slots);
+    vm_segment_release(&mm->index_segment);
+    vm_segment_release(&mm->map_segment);
+    free(mm->gc_mark_stack);
     
     memset(mm, 0, sizeof(memory_manager_t));
 }
 
+// Size class for a payload of `words` words; *class_words is the payload
+// size every block of that class has
+static size_t vm_heap_size_class(size_t words, size_t *class_words)
+{
+    if (words <= VM_HEAP_EXACT_CLASSES) {
+        *class_words = words;
+        return words;
+    }
+    
+    size_t size_class = VM_HEAP_EXACT_CLASSES;
+    size_t size = VM_HEAP_EXACT_CLASSES;
+    while (size < words) {
+        size <<= 1;
+        size_class++;
+    }
+    *class_words = size;
+    return size_class;
+}
+
+// Commit more of the object area's reservation so that `words` more words
+// fit above heap_bump: twice the current size, or more if that is not
+// enough, up to heap_max
+static bool vm_heap_grow(arx_vm_context_t *vm, uint64_t words)
+{
+    memory_manager_t *mm = &vm->memory_manager;
+    uint64_t size = mm->heap_limit - mm->heap_base;
+    uint64_t needed = mm->heap_bump + words - mm->heap_base;
+    uint64_t max = mm->heap_max - mm->heap_base;
+    if (needed > max) {
+        return false;
+    }
+    
+    uint64_t new_size = size * 2 > needed ? size * 2 : needed;
+    if (new_size > max) {
+        new_size = max;
+    }
+    if (!vm_segment_commit(&vm->stack_segment, (size_t)((mm->heap_base + new_size) * sizeof(uint64_t))) ||
+        !vm_segment_commit(&mm->index_segment, (size_t)(new_size * sizeof(uint32_t))) ||
+        !vm_segment_commit(&mm->map_segment, (size_t)((new_size + 63) / 64 * sizeof(uint64_t))) ||
+        (vm->heap_sites != NULL &&
+         !vm_segment_commit(&vm->heap_sites->block_segment, (size_t)(new_size * sizeof(uint32_t))))) {
+        return false;
+    }
+    mm->heap_limit = mm->heap_base + new_size;
+    mm->heap_growths++;
+    if (vm->debug_mode) {
+        printf("VM: Object area grown to %llu words\n", (unsigned long long)new_size);
+    }
+    return true;
+}
+
+bool vm_heap_alloc(arx_vm_context_t *vm, size_t words, uint64_t *address)
+{
+    if (vm == NULL || address == NULL) {
+        return false;
+    }
+    
+    memory_manager_t *mm = &vm->memory_manager;
+    
+    // Every block gets at least one word so addresses stay distinct
+    if (words == 0) {
+        words = 1;
+    }
+    if (words > (mm->heap_max - mm->heap_base) / 2) {
+        vm->last_error = VM_ERROR_OUT_OF_MEMORY;
+        return false;
+    }
+    
+    size_t class_words;
+    size_t size_class = vm_heap_size_class(words, &class_words);
+    
+    if (mm->gc_threshold > 0 && mm->gc_allocated >= mm->gc_threshold) {
+        vm_garbage_collect(vm);
+    }
+    
+    uint64_t block = mm->free_lists[size_class];
+    if (block == 0 && mm->heap_bump + 1 + class_words > mm->heap_limit) {
+        // Out of fresh space: collect once, and grow the area if that did
+        // not free a block of this class
+        vm_garbage_collect(vm);
+        block = mm->free_lists[size_class];
+        if (block == 0 && mm->heap_bump + 1 + class_words > mm->heap_limit) {
+            vm_heap_grow(vm, 1 + class_words);
+        }
+    }
+    
+    if (block != 0) {
+        // Reuse a freed block of the same class
+        mm->free_lists[size_class] = vm->stack[block];
+    } else {
+        if (mm->heap_bump + 1 + class_words > mm->heap_limit) {
+            if (vm->debug_mode) {
+                printf("VM: Object area exhausted (%zu words requested)\n", words);
+            }
+            vm->last_error = VM_ERROR_OUT_OF_MEMORY;
+            return false;
+        }
+        block = mm->heap_bump + 1;
+        mm->heap_bump += 1 + class_words;
+        mm->block_map[(block - mm->heap_base) / 64] |= 1ull << ((block - mm->heap_base) % 64);
+    }
+    
+    vm->stack[block - 1] = ((uint64_t)class_words << VM_HEAP_HEADER_SHIFT) | VM_HEAP_HEADER_USED;
+    memset(&vm->stack[block], 0, class_words * sizeof(uint64_t));
+    
+    mm->heap_allocations++;
+    mm->heap_bytes_allocated += class_words * sizeof(uint64_t);
+    mm->heap_bytes_in_use += class_words * sizeof(uint64_t);
+    mm->gc_allocated += class_words * sizeof(uint64_t);
+    if (vm->heap_sites != NULL) {
+        vm_heap_sites_allocated(vm, block, class_words * sizeof(uint64_t));
+    }
+    *address = block;
+    return true;
+}
+
+bool vm_heap_free(arx_vm_context_t *vm, uint64_t address)
+{
+    if (vm == NULL || !vm_heap_contains(vm, address, 1)) {
+        return false;
+    }
+    
+    memory_manager_t *mm = &vm->memory_manager;
+    size_t class_words = (size_t)(vm->stack[address - 1] >> VM_HEAP_HEADER_SHIFT);
+    size_t size_class = vm_heap_size_class(class_words, &class_words);
+    
+    // Clear the in-use bit so stale addresses no longer pass vm_heap_contains()
+    vm->stack[address - 1] &= ~(VM_HEAP_HEADER_USED | VM_HEAP_HEADER_MARK);
+    vm->stack[address] = mm->free_lists[size_class];
+    mm->free_lists[size_class] = address;
+    
+    mm->heap_frees++;
+    mm->heap_bytes_in_use -= class_words * sizeof(uint64_t);
+    if (vm->heap_sites != NULL) {
+        vm_heap_sites_freed(vm, address, class_words * sizeof(uint64_t));
+    }
+    return true;
+}
+
+// True if address starts a live block with at least `words` payload words
+bool vm_heap_contains(arx_vm_context_t *vm, uint64_t address, size_t words)
+{
+    if (vm == NULL) {
+        return false;
+    }
+    
+    memory_manager_t *mm = &vm->memory_manager;
+    if (address <= mm->heap_base || address >= mm->heap_bump) {
+        return false;
+    }
+    
+    // Only addresses recorded as block starts have a header in front of them
+    uint64_t offset = address - mm->heap_base;
+    if ((mm->block_map[offset / 64] & (1ull << (offset % 64))) == 0) {
+        return false;
+    }
+    
+    uint64_t header = vm->stack[address - 1];
+    return (header & VM_HEAP_HEADER_USED) != 0 && (header >> VM_HEAP_HEADER_SHIFT) >= words;
+}
+
+// Handle table entry for object_id, or NULL if the ID is stale or unknown
+static object_entry_t *vm_object_lookup(memory_manager_t *mm, uint64_t object_id)
+{
+    uint64_t slot = (object_id & VM_OBJECT_SLOT_MASK) - 1;
+    if (object_id == 0 || slot >= mm->object_count) {
+        return NULL;
+    }
+    
+    object_entry_t *entry = &mm->objects[slot];
+    return entry->object_id == object_id ? entry : NULL;
+}
+
 uint64_t vm_allocate_object(arx_vm_context_t *vm, uint64_t class_id, size_t object_size)
 {
     if (vm == NULL) {
@@ -1874,132 +4654,306 @@ uint64_t vm_allocate_object(arx_vm_context_t *vm, uint64_t class_id, size_t obje
     memory_manager_t *mm = &vm->memory_manager;
     
     // Check if we need to expand the objects array
-    if (mm->object_count >= mm->object_capacity) {
+    if (mm->free_slot_count == 0 && mm->object_count >= mm->object_capacity) {
         size_t new_capacity = mm->object_capacity * 2;
+        if (new_capacity > VM_OBJECT_SLOT_MASK) {
+            return 0; // Handle space exhausted
+        }
         object_entry_t *new_objects = realloc(mm->objects, new_capacity * sizeof(object_entry_t));
         if (new_objects == NULL) {
             return 0; // Allocation failed
         }
         mm->objects = new_objects;
+        uint32_t *new_free_slots = realloc(mm->free_slots, new_capacity * sizeof(uint32_t));
+        if (new_free_slots == NULL) {
+            return 0; // Allocation failed
+        }
+        mm->free_slots = new_free_slots;
         mm->object_capacity = new_capacity;
     }
     
-    // Allocate memory for the object on the stack
-    if (vm->stack_top + object_size >= vm->stack_size) {
-        return 0; // Stack overflow
+    // Allocate the object's fields in the object area
+    uint64_t memory_address;
+    if (!vm_heap_alloc(vm, (object_size + sizeof(uint64_t) - 1) / sizeof(uint64_t), &memory_address)) {
+        return 0; // Object area exhausted
     }
     
-    uint64_t memory_address = vm->stack_top;
-    vm->stack_top += object_size;
+    // Reuse a recycled slot under its next generation, or take a new one
+    size_t slot;
+    uint64_t generation = 0;
+    if (mm->free_slot_count > 0) {
+        slot = mm->free_slots[--mm->free_slot_count];
+        generation = (mm->objects[slot].object_id >> VM_OBJECT_SLOT_BITS) + 1;
+    } else {
+        slot = mm->object_count++;
+    }
     
     // Create object entry
-    object_entry_t *entry = &mm->objects[mm->object_count];
-    entry->object_id = mm->next_object_id++;
+    object_entry_t *entry = &mm->objects[slot];
+    entry->object_id = (generation << VM_OBJECT_SLOT_BITS) | (uint64_t)(slot + 1);
     entry->class_id = class_id;
     entry->memory_address = memory_address;
     entry->object_size = object_size;
-    entry->reference_count = 1; // Initial reference
+    entry->reference_count = 0; // Host references only; the collector traces the rest
+    entry->class_index = (uint32_t)(vm_class_find(vm, class_id) + 1);
     entry->is_alive = true;
+    entry->frame = false;
     entry->creation_time = vm->instruction_count_executed;
+    mm->address_index[memory_address - mm->heap_base] = (uint32_t)(slot + 1);
+    
+    mm->total_allocated += object_size;
+    
+    if (vm->debug_mode) {
+        printf("VM: Allocated object ID %llu (class %llu) at address 0x%llx, size %zu bytes\n",
+               (unsigned long long)entry->object_id, (unsigned long long)class_id,
+               (unsigned long long)memory_address, object_size);
+    }
+    
+    return entry->object_id;
+}
+
+bool vm_reference_object(arx_vm_context_t *vm, uint64_t object_id)
+{
+    if (vm == NULL || object_id == 0) {
+        return false;
+    }
+    
+    object_entry_t *entry = vm_object_lookup(&vm->memory_manager, object_id);
+    if (entry == NULL || !entry->is_alive) {
+        return false; // Object not found
+    }
     
-    mm->object_count++;
-    mm->total_allocated += object_size;
+    entry->reference_count++;
     
     if (vm->debug_mode) {
-        printf("VM: Allocated object ID %llu (class %llu) at address 0x%llx, size %zu bytes\n",
-               (unsigned long long)entry->object_id, (unsigned long long)class_id,
-               (unsigned long long)memory_address, object_size);
+        printf("VM: Referenced object ID %llu, new count: %u\n",
+               (unsigned long long)object_id, entry->reference_count);
     }
     
-    return entry->object_id;
+    return true;
 }
 
-bool vm_reference_object(arx_vm_context_t *vm, uint64_t object_id)
+bool vm_release_object(arx_vm_context_t *vm, uint64_t object_id)
 {
     if (vm == NULL || object_id == 0) {
         return false;
     }
     
-    memory_manager_t *mm = &vm->memory_manager;
+    object_entry_t *entry = vm_object_lookup(&vm->memory_manager, object_id);
+    if (entry == NULL || !entry->is_alive) {
+        return false; // Object not found
+    }
     
-    // Find the object
-    for (size_t i = 0; i < mm->object_count; i++) {
-        if (mm->objects[i].object_id == object_id && mm->objects[i].is_alive) {
-            mm->objects[i].reference_count++;
-            
-            if (vm->debug_mode) {
-                printf("VM: Referenced object ID %llu, new count: %u\n",
-                       (unsigned long long)object_id, mm->objects[i].reference_count);
-            }
-            
-            return true;
-        }
+    if (entry->reference_count == 0) {
+        return false; // Not held by the host
+    }
+    entry->reference_count--;
+    
+    if (vm->debug_mode) {
+        printf("VM: Released object ID %llu, new count: %u\n",
+               (unsigned long long)object_id, entry->reference_count);
     }
     
-    return false; // Object not found
+    // Once the count reaches 0 the object lives only as long as the
+    // program can still reach it
+    return true;
 }
 
-bool vm_release_object(arx_vm_context_t *vm, uint64_t object_id)
+bool vm_get_object_info(arx_vm_context_t *vm, uint64_t object_id, object_entry_t **entry)
 {
-    if (vm == NULL || object_id == 0) {
+    if (vm == NULL || object_id == 0 || entry == NULL) {
         return false;
     }
     
-    memory_manager_t *mm = &vm->memory_manager;
+    object_entry_t *found = vm_object_lookup(&vm->memory_manager, object_id);
+    if (found == NULL || !found->is_alive) {
+        return false; // Object not found
+    }
     
-    // Find the object
-    for (size_t i = 0; i < mm->object_count; i++) {
-        if (mm->objects[i].object_id == object_id && mm->objects[i].is_alive) {
-            mm->objects[i].reference_count--;
-            
-            if (vm->debug_mode) {
-                printf("VM: Released object ID %llu, new count: %u\n",
-                       (unsigned long long)object_id, mm->objects[i].reference_count);
-            }
-            
-            // If reference count reaches 0, mark for garbage collection
-            if (mm->objects[i].reference_count == 0) {
-                mm->objects[i].is_alive = false;
-                
-                if (vm->debug_mode) {
-                    printf("VM: Object ID %llu marked for garbage collection\n",
-                           (unsigned long long)object_id);
-                }
+    *entry = found;
+    return true;
+}
+
+// Return the handle of the object at block to the slot free list; the
+// caller frees the block
+static void vm_free_object_slot(memory_manager_t *mm, uint32_t slot, uint64_t block)
+{
+    object_entry_t *entry = &mm->objects[slot - 1];
+    mm->total_freed += entry->object_size;
+    
+    // Keep the generation so the next occupant gets a fresh ID
+    entry->object_id &= ~VM_OBJECT_SLOT_MASK;
+    entry->is_alive = false;
+    entry->frame = false;
+    mm->free_slots[mm->free_slot_count++] = slot - 1;
+    mm->address_index[block - mm->heap_base] = 0;
+}
+
+// Handle table slot + 1 of the live frame object at address (0 = none)
+static uint32_t vm_frame_object_slot(arx_vm_context_t *vm, uint64_t address)
+{
+    memory_manager_t *mm = &vm->memory_manager;
+    if (!vm_heap_contains(vm, address, 0)) {
+        return 0;
+    }
+    uint32_t slot = mm->address_index[address - mm->heap_base];
+    return slot != 0 && mm->objects[slot - 1].is_alive && mm->objects[slot - 1].frame ? slot : 0;
+}
+
+// Objects of a method's frame variables. The compiler only emits
+// OPR_OBJ_NEW_FRAME and OPR_OBJ_RELEASE for locals whose objects cannot be
+// reached from anywhere else, so an object is dead once its variable gets
+// the next one and once the method returns. Anything that is not a live
+// frame object is left alone, which keeps stale and zero words harmless.
+bool vm_instantiate_frame_object(arx_vm_context_t *vm, uint64_t class_id, uint64_t previous, uint64_t *object_address)
+{
+    if (vm == NULL || object_address == NULL) {
+        return false;
+    }
+
+    memory_manager_t *mm = &vm->memory_manager;
+    uint32_t slot = vm_frame_object_slot(vm, previous);
+    if (slot != 0) {
+        object_entry_t *entry = &mm->objects[slot - 1];
+        if (entry->class_id == class_id && entry->class_index != 0) {
+            // Same class, as in a loop: start the object over in place
+            const vm_class_template_t *template = &vm->class_system.templates[entry->class_index - 1];
+            if (template->words > 0) {
+                memcpy(&vm->stack[previous], template->image, template->words * sizeof(uint64_t));
             }
-            
+            entry->creation_time = vm->instruction_count_executed;
+            mm->frame_reuses++;
+            *object_address = previous;
             return true;
         }
+        vm_release_frame_object(vm, previous);
     }
-    
-    return false; // Object not found
+
+    if (!vm_instantiate_class(vm, class_id, object_address)) {
+        return false;
+    }
+    mm->objects[mm->address_index[*object_address - mm->heap_base] - 1].frame = true;
+
+    // Its method frees it, so it does not bring the next collection closer
+    uint64_t bytes = (vm->stack[*object_address - 1] >> VM_HEAP_HEADER_SHIFT) * sizeof(uint64_t);
+    mm->gc_allocated = mm->gc_allocated > bytes ? mm->gc_allocated - bytes : 0;
+    mm->frame_allocations++;
+    return true;
 }
 
-bool vm_get_object_info(arx_vm_context_t *vm, uint64_t object_id, object_entry_t **entry)
+bool vm_release_frame_object(arx_vm_context_t *vm, uint64_t object_address)
 {
-    if (vm == NULL || object_id == 0 || entry == NULL) {
+    uint32_t slot = vm != NULL ? vm_frame_object_slot(vm, object_address) : 0;
+    if (slot == 0) {
         return false;
     }
+
+    if (vm->debug_mode) {
+        printf("VM: Released frame object ID %llu at address 0x%llx\n",
+               (unsigned long long)vm->memory_manager.objects[slot - 1].object_id,
+               (unsigned long long)object_address);
+    }
+    vm_free_object_slot(&vm->memory_manager, slot, object_address);
+    vm_heap_free(vm, object_address);
+    vm->memory_manager.frame_releases++;
+    return true;
+}
+
+// Mark the block that value points at, if it is one. Marked objects are
+// queued so their fields get scanned; strings hold no references, but a
+// slice is queued so that the string it views is marked too.
+static bool vm_gc_mark_value(arx_vm_context_t *vm, uint64_t value)
+{
+    memory_manager_t *mm = &vm->memory_manager;
+    
+    if (!vm_heap_contains(vm, value, 0) || (vm->stack[value - 1] & VM_HEAP_HEADER_MARK) != 0) {
+        return true;
+    }
+    vm->stack[value - 1] |= VM_HEAP_HEADER_MARK;
     
+    if (mm->address_index[value - mm->heap_base] == 0 &&
+        !(vm_heap_contains(vm, value, VM_STRING_SLICE_WORDS) && vm->stack[value + 2] == VM_STRING_SLICE)) {
+        return true;
+    }
+    if (mm->gc_mark_top >= mm->gc_mark_capacity) {
+        size_t new_capacity = mm->gc_mark_capacity == 0 ? 256 : mm->gc_mark_capacity * 2;
+        uint64_t *new_stack = realloc(mm->gc_mark_stack, new_capacity * sizeof(uint64_t));
+        if (new_stack == NULL) {
+            return false;
+        }
+        mm->gc_mark_stack = new_stack;
+        mm->gc_mark_capacity = new_capacity;
+    }
+    mm->gc_mark_stack[mm->gc_mark_top++] = value;
+    return true;
+}
+
+static bool vm_gc_mark_range(arx_vm_context_t *vm, const uint64_t *words, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (!vm_gc_mark_value(vm, words[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Mark everything reachable from the roots: the data stack, global memory,
+// live activation records, the stacks of tasks that are not running and the
+// results of finished ones, interned literals and objects the host holds
+// references to. Any
+// word that equals a block address keeps that block alive.
+static bool vm_gc_mark(arx_vm_context_t *vm)
+{
     memory_manager_t *mm = &vm->memory_manager;
     
-    // Find the object
+    mm->gc_mark_top = 0;
+    
+    if (!vm_gc_mark_range(vm, vm->stack, vm->stack_top) ||
+        !vm_gc_mark_range(vm, vm->memory, vm->memory_size) ||
+        !vm_gc_mark_range(vm, vm->call_stack.frames, vm->call_stack.frame_top) ||
+        (vm->string_table.literals != NULL &&
+         !vm_gc_mark_range(vm, vm->string_table.literals, vm->string_table.string_count))) {
+        return false;
+    }
+    for (size_t i = 0; vm->tasks != NULL && i < vm->tasks->count; i++) {
+        const vm_task_t *task = &vm->tasks->tasks[i];
+        if (task->state == VM_TASK_READY || task->state == VM_TASK_JOINING) {
+            if (!vm_gc_mark_range(vm, task->stack, task->stack_top) ||
+                !vm_gc_mark_range(vm, task->call_stack.frames, task->call_stack.frame_top)) {
+                return false;
+            }
+        } else if (task->state == VM_TASK_DONE && !vm_gc_mark_value(vm, task->result)) {
+            return false;
+        }
+    }
     for (size_t i = 0; i < mm->object_count; i++) {
-        if (mm->objects[i].object_id == object_id && mm->objects[i].is_alive) {
-            *entry = &mm->objects[i];
-            return true;
+        object_entry_t *entry = &mm->objects[i];
+        if ((entry->object_id & VM_OBJECT_SLOT_MASK) != 0 && entry->reference_count > 0 &&
+            !vm_gc_mark_value(vm, entry->memory_address)) {
+            return false;
         }
     }
     
-    return false; // Object not found
+    // Scan the fields of marked objects until no new ones turn up
+    while (mm->gc_mark_top > 0) {
+        uint64_t object = mm->gc_mark_stack[--mm->gc_mark_top];
+        size_t words = (size_t)(vm->stack[object - 1] >> VM_HEAP_HEADER_SHIFT);
+        if (!vm_gc_mark_range(vm, &vm->stack[object], words)) {
+            return false;
+        }
+    }
+    return true;
 }
 
 void vm_garbage_collect(arx_vm_context_t *vm)
 {
-    if (vm == NULL) {
+    if (vm == NULL || vm->memory_manager.block_map == NULL) {
         return;
     }
     
     memory_manager_t *mm = &vm->memory_manager;
+    uint64_t start_ns = vm_monotonic_ns();
     size_t collected_count = 0;
     size_t collected_size = 0;
     
@@ -2007,37 +4961,91 @@ void vm_garbage_collect(arx_vm_context_t *vm)
         printf("VM: Starting garbage collection...\n");
     }
     
-    // Mark all objects with reference count > 0 as alive
-    for (size_t i = 0; i < mm->object_count; i++) {
-        if (mm->objects[i].reference_count > 0) {
-            mm->objects[i].is_alive = true;
-        }
-    }
+    // If the mark stack cannot grow, liveness is unknown: sweep nothing and
+    // only clear the marks
+    bool marked = vm_gc_mark(vm);
     
-    // Collect dead objects
-    for (size_t i = 0; i < mm->object_count; i++) {
-        if (!mm->objects[i].is_alive) {
+    // Sweep the object area block by block, returning unmarked blocks to the
+    // free lists and their handles to the slot free list
+    uint64_t header_address = mm->heap_base;
+    while (header_address < mm->heap_bump) {
+        uint64_t header = vm->stack[header_address];
+        uint64_t block = header_address + 1;
+        size_t words = (size_t)(header >> VM_HEAP_HEADER_SHIFT);
+        header_address = block + words;
+        
+        if ((header & VM_HEAP_HEADER_USED) == 0) {
+            continue;
+        }
+        if ((header & VM_HEAP_HEADER_MARK) != 0 || !marked) {
+            vm->stack[block - 1] &= ~VM_HEAP_HEADER_MARK;
+            continue;
+        }
+        
+        uint32_t slot = mm->address_index[block - mm->heap_base];
+        if (slot != 0) {
+            object_entry_t *entry = &mm->objects[slot - 1];
             collected_count++;
-            collected_size += mm->objects[i].object_size;
             
             if (vm->debug_mode) {
                 printf("VM: Collected object ID %llu (class %llu), size %zu bytes\n",
-                       (unsigned long long)mm->objects[i].object_id,
-                       (unsigned long long)mm->objects[i].class_id,
-                       mm->objects[i].object_size);
+                       (unsigned long long)entry->object_id,
+                       (unsigned long long)entry->class_id,
+                       entry->object_size);
             }
             
-            // Zero out the object memory (for debugging)
-            memset((void*)mm->objects[i].memory_address, 0, mm->objects[i].object_size);
+            vm_free_object_slot(mm, slot, block);
         }
-    }
-    
-    mm->total_freed += collected_size;
+        collected_size += words * sizeof(uint64_t);
+        vm_heap_free(vm, block);
+    }
+    
+    uint64_t pause_ns = vm_monotonic_ns() - start_ns;
+    mm->gc_allocated = 0;
+    mm->gc_collections++;
+    mm->gc_bytes_reclaimed += collected_size;
+    mm->gc_last_reclaimed = collected_size;
+    mm->gc_total_pause_ns += pause_ns;
+    mm->gc_last_pause_ns = pause_ns;
+    if (pause_ns > mm->gc_max_pause_ns) {
+        mm->gc_max_pause_ns = pause_ns;
+    }
+    vm_gc_record_t *record = &mm->gc_history[(mm->gc_collections - 1) % VM_GC_HISTORY];
+    record->instructions = vm->instruction_count_executed;
+    record->pause_ns = pause_ns;
+    record->objects = collected_count;
+    record->reclaimed = collected_size;
+    record->in_use = mm->heap_bytes_in_use;
     
     if (vm->debug_mode) {
-        printf("VM: Garbage collection completed: %zu objects, %zu bytes freed\n",
-               collected_count, collected_size);
+        printf("VM: Garbage collection completed: %zu objects, %zu bytes freed in %llu ns\n",
+               collected_count, collected_size, (unsigned long long)pause_ns);
+    }
+}
+
+void vm_dump_gc_stats(arx_vm_context_t *vm)
+{
+    if (vm == NULL) {
+        return;
     }
+    
+    memory_manager_t *mm = &vm->memory_manager;
+    
+    printf("=== Garbage Collector ===\n");
+    printf("Collections: %llu (threshold %llu bytes)\n",
+           (unsigned long long)mm->gc_collections, (unsigned long long)mm->gc_threshold);
+    printf("Reclaimed: %llu bytes total, %llu bytes last\n",
+           (unsigned long long)mm->gc_bytes_reclaimed, (unsigned long long)mm->gc_last_reclaimed);
+    printf("Pause: %.3f ms total, %.3f ms max, %.3f ms last\n",
+           mm->gc_total_pause_ns / 1e6, mm->gc_max_pause_ns / 1e6, mm->gc_last_pause_ns / 1e6);
+    printf("Heap: %llu bytes in use\n", (unsigned long long)mm->heap_bytes_in_use);
+    printf("Object area: %llu of at most %llu words, grown %llu times\n",
+           (unsigned long long)(mm->heap_limit - mm->heap_base),
+           (unsigned long long)(mm->heap_max - mm->heap_base), (unsigned long long)mm->heap_growths);
+    printf("Frame objects: %llu allocated, %llu reused in place, %llu released on return\n",
+           (unsigned long long)mm->frame_allocations, (unsigned long long)mm->frame_reuses,
+           (unsigned long long)mm->frame_releases);
+    printf("=========================\n");
 }
 
 void vm_dump_memory_manager(arx_vm_context_t *vm)
@@ -2049,14 +5057,25 @@ void vm_dump_memory_manager(arx_vm_context_t *vm)
     memory_manager_t *mm = &vm->memory_manager;
     
     printf("=== Memory Manager Status ===\n");
-    printf("Objects: %zu/%zu\n", mm->object_count, mm->object_capacity);
+    printf("Objects: %zu/%zu (%zu slots free)\n", mm->object_count - mm->free_slot_count,
+           mm->object_capacity, mm->free_slot_count);
     printf("Total allocated: %llu bytes\n", (unsigned long long)mm->total_allocated);
     printf("Total freed: %llu bytes\n", (unsigned long long)mm->total_freed);
     printf("Net allocated: %llu bytes\n", (unsigned long long)(mm->total_allocated - mm->total_freed));
+    printf("Object area: %llu/%llu words used (at most %llu)\n",
+           (unsigned long long)(mm->heap_bump - mm->heap_base),
+           (unsigned long long)(mm->heap_limit - mm->heap_base),
+           (unsigned long long)(mm->heap_max - mm->heap_base));
+    printf("Allocations: %llu, frees: %llu, bytes in use: %llu\n",
+           (unsigned long long)mm->heap_allocations, (unsigned long long)mm->heap_frees,
+           (unsigned long long)mm->heap_bytes_in_use);
     
     printf("\nObject Details:\n");
     for (size_t i = 0; i < mm->object_count; i++) {
         object_entry_t *obj = &mm->objects[i];
+        if ((obj->object_id & VM_OBJECT_SLOT_MASK) == 0) {
+            continue; // Free slot
+        }
         printf("  ID %llu: class %llu, addr 0x%llx, size %zu, refs %u, alive %s\n",
                (unsigned long long)obj->object_id,
                (unsigned long long)obj->class_id,
@@ -2069,46 +5088,63 @@ void vm_dump_memory_manager(arx_vm_context_t *vm)
 }
 
 // Object access functions
-memory_object_t* memory_manager_get_object(memory_manager_t *mm, uint64_t object_address)
+bool memory_manager_get_object(memory_manager_t *mm, uint64_t object_address, memory_object_t *object)
 {
-    if (mm == NULL) {
-        return NULL;
+    if (mm == NULL || object == NULL || mm->address_index == NULL ||
+        object_address < mm->heap_base || object_address >= mm->heap_limit) {
+        return false;
     }
     
-    // Find the object by memory address
-    for (size_t i = 0; i < mm->object_count; i++) {
-        if (mm->objects[i].memory_address == object_address) {
-            // Convert object_entry_t to memory_object_t
-            static memory_object_t result;
-            result.object_id = mm->objects[i].object_id;
-            result.class_id = mm->objects[i].class_id;
-            result.memory_address = mm->objects[i].memory_address;
-            result.size = mm->objects[i].object_size;
-            result.reference_count = mm->objects[i].reference_count;
-            return &result;
-        }
+    // Find the object by memory address through the reverse index
+    uint32_t slot = mm->address_index[object_address - mm->heap_base];
+    if (slot == 0) {
+        return false;
     }
     
-    return NULL;
+    // Convert object_entry_t to memory_object_t
+    object_entry_t *entry = &mm->objects[slot - 1];
+    object->object_id = entry->object_id;
+    object->class_id = entry->class_id;
+    object->memory_address = entry->memory_address;
+    object->size = entry->object_size;
+    object->reference_count = entry->reference_count;
+    return true;
 }
 
 // Call stack functions
 bool vm_push_call_stack(arx_vm_context_t *vm, uint64_t return_address)
 {
-    if (vm == NULL || vm->call_stack.current_frame >= vm->call_stack.frame_capacity) {
-        last_error = VM_ERROR_CALL_STACK_OVERFLOW;
+    if (vm == NULL) {
+        return false;
+    }
+    
+    // Methods are top-level procedures: their static link is the global area
+    return vm_push_frame(vm, VM_FRAME_GLOBAL, return_address);
+}
+
+// The record keeps its dynamic link, return pc and saved sp; its locals and
+// whatever the method left on the data stack go, as a return would drop them
+bool vm_reuse_call_stack(arx_vm_context_t *vm)
+{
+    if (vm == NULL || vm->call_stack.frame_base == VM_FRAME_GLOBAL) {
         return false;
     }
     
-    // Save current state
-    uint64_t *frame = &vm->call_stack.frames[vm->call_stack.current_frame * 4];
-    frame[0] = return_address; // Return address
-    frame[1] = vm->stack_top;  // Stack top
-    frame[2] = 0;              // Reserved
-    frame[3] = 0;              // Reserved
+    if (vm->profile != NULL) {
+        vm_profile_return(vm);
+    }
     
-    vm->call_stack.current_frame++;
+    uint64_t base = vm->call_stack.frame_base;
+    uint64_t *frame = &vm->call_stack.frames[base];
+    frame[VM_FRAME_STATIC_LINK] = VM_FRAME_GLOBAL;
+    if (vm->stack_top > frame[VM_FRAME_SAVED_SP]) {
+        vm->stack_top = (size_t)frame[VM_FRAME_SAVED_SP];
+    }
+    vm->call_stack.frame_top = (size_t)base + VM_FRAME_HEADER_SIZE;
     
+    if (vm->profile != NULL) {
+        vm_profile_enter(vm, frame[VM_FRAME_RETURN_PC]);
+    }
     return true;
 }
 
@@ -2118,64 +5154,104 @@ static size_t vm_string_words_for_capacity(size_t capacity)
     return (capacity + sizeof(uint64_t) - 1) / sizeof(uint64_t);
 }
 
-bool vm_string_create_from_cstr(arx_vm_context_t *vm, const char *cstr, uint64_t *out_object_address)
+bool vm_string_alloc(arx_vm_context_t *vm, uint64_t length, uint64_t *out_object_address)
 {
-    if (vm == NULL || cstr == NULL || out_object_address == NULL) {
+    if (vm == NULL || out_object_address == NULL) {
         return false;
     }
     
-    size_t len = strlen(cstr);
-    size_t capacity = len + 1; // +1 for null terminator
-    size_t object_size = vm_string_words_for_capacity(capacity) * sizeof(uint64_t);
-    
-    // Find free memory for the string object
-    uint64_t object_addr = 0;
-    bool found = false;
-    
-    // Search for free memory starting from offset 10000
-    for (uint64_t addr = 10000; addr + object_size < vm->stack_size; addr += sizeof(uint64_t)) {
-        bool is_free = true;
-        for (size_t i = 0; i < object_size / sizeof(uint64_t); i++) {
-            if (vm->stack[addr + i] != 0) {
-                is_free = false;
-                break;
-            }
-        }
-        if (is_free) {
-            object_addr = addr;
-            found = true;
-            break;
-        }
-    }
+    uint64_t capacity = length + 1; // +1 for null terminator
     
-    if (!found) {
+    // Header words followed by the NUL-terminated data
+    uint64_t object_addr;
+    if (!vm_heap_alloc(vm, VM_STRING_HEADER_WORDS + vm_string_words_for_capacity(capacity), &object_addr)) {
         if (vm->debug_mode) {
-            printf("vm_string_create_from_cstr: No free memory available\n");
+            printf("vm_string_alloc: No free memory available\n");
         }
         return false;
     }
     
-    // Initialize string object header
-    vm->stack[object_addr + 0] = len;           // length
+    // Initialize string object header; the hash word stays 0 until needed
+    vm->stack[object_addr + 0] = length;        // length
     vm->stack[object_addr + 1] = capacity;      // capacity
-    vm->stack[object_addr + 2] = 3;             // data_offset (always 3 for phase 1)
+    vm->stack[object_addr + 2] = VM_STRING_HEADER_WORDS;  // data_offset
+    
+    *out_object_address = object_addr;
+    return true;
+}
+
+bool vm_string_create_from_cstr(arx_vm_context_t *vm, const char *cstr, uint64_t *out_object_address)
+{
+    if (vm == NULL || cstr == NULL || out_object_address == NULL) {
+        return false;
+    }
+    
+    size_t len = strlen(cstr);
+    uint64_t object_addr;
+    if (!vm_string_alloc(vm, len, &object_addr)) {
+        return false;
+    }
     
-    // Copy string data
-    char *data_ptr = (char*)&vm->stack[object_addr + 3];
-    memcpy(data_ptr, cstr, len);
-    data_ptr[len] = '\0'; // null terminator
+    // Copy string data (the terminator is already there)
+    memcpy(&vm->stack[object_addr + VM_STRING_HEADER_WORDS], cstr, len);
     
     *out_object_address = object_addr;
     return true;
 }
 
+bool vm_string_view(arx_vm_context_t *vm, uint64_t object_address, const char **out_data, uint64_t *out_length)
+{
+    if (vm == NULL || out_data == NULL || out_length == NULL) {
+        return false;
+    }
+    
+    if (!vm_heap_contains(vm, object_address, VM_STRING_HEADER_WORDS)) {
+        return false;
+    }
+    
+    uint64_t len = vm->stack[object_address + 0];
+    uint64_t cap = vm->stack[object_address + 1];
+    uint64_t off = vm->stack[object_address + 2];
+    
+    // A slice views part of a plain string (see vm_string_slice)
+    if (off == VM_STRING_SLICE) {
+        uint64_t base = vm_heap_contains(vm, object_address, VM_STRING_SLICE_WORDS) ?
+                        vm->stack[object_address + 4] : 0;
+        uint64_t start = cap;
+        const char *base_data;
+        uint64_t base_len;
+        if (!vm_heap_contains(vm, base, VM_STRING_HEADER_WORDS) ||
+            vm->stack[base + 2] != VM_STRING_HEADER_WORDS ||
+            !vm_string_view(vm, base, &base_data, &base_len) ||
+            start > base_len || len > base_len - start) {
+            return false;
+        }
+        *out_data = base_data + start;
+        *out_length = len;
+        return true;
+    }
+    
+    if (off != VM_STRING_HEADER_WORDS || cap < len) {
+        return false;
+    }
+    
+    size_t data_words = (cap + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    if (!vm_heap_contains(vm, object_address, off + data_words)) {
+        return false;
+    }
+    
+    *out_data = (const char*)&vm->stack[object_address + off];
+    *out_length = len;
+    return true;
+}
+
 bool vm_string_get_length(arx_vm_context_t *vm, uint64_t object_address, uint64_t *out_length)
 {
     if (vm == NULL || out_length == NULL) {
         return false;
     }
     
-    if (object_address + 2 >= vm->stack_size) {
+    if (!vm_heap_contains(vm, object_address, VM_STRING_HEADER_WORDS)) {
         return false;
     }
     
@@ -2183,33 +5259,175 @@ bool vm_string_get_length(arx_vm_context_t *vm, uint64_t object_address, uint64_
     return true;
 }
 
-bool vm_string_copy_to_buffer(arx_vm_context_t *vm, uint64_t object_address, char *dst, size_t dst_size)
+// Hash of a string object's bytes, computed once and cached in its header.
+// 0 marks "not computed", so a real hash of 0 is stored as 1.
+static uint64_t vm_string_hash(arx_vm_context_t *vm, uint64_t object_address, const char *data, uint64_t length)
 {
-    if (vm == NULL || dst == NULL || dst_size == 0) {
+    uint64_t hash = vm->stack[object_address + 3];
+    if (hash != 0) {
+        return hash;
+    }
+    hash = 5381;
+    for (uint64_t i = 0; i < length; i++) {
+        hash = ((hash << 5) + hash) + (uint8_t)data[i];
+    }
+    if (hash == 0) {
+        hash = 1;
+    }
+    vm->stack[object_address + 3] = hash;
+    return hash;
+}
+
+bool vm_string_equals(arx_vm_context_t *vm, uint64_t a, uint64_t b, bool *out_equal)
+{
+    if (vm == NULL || out_equal == NULL) {
         return false;
     }
     
-    if (object_address + 2 >= vm->stack_size) {
+    const char *data_a, *data_b;
+    uint64_t len_a, len_b;
+    if (!vm_string_view(vm, a, &data_a, &len_a) || !vm_string_view(vm, b, &data_b, &len_b)) {
         return false;
     }
     
-    uint64_t len = vm->stack[object_address + 0];
-    uint64_t cap = vm->stack[object_address + 1];
-    uint64_t off = vm->stack[object_address + 2];
+    if (a == b) {
+        *out_equal = true;
+    } else if (len_a != len_b ||
+               vm_string_hash(vm, a, data_a, len_a) != vm_string_hash(vm, b, data_b, len_b)) {
+        *out_equal = false;
+    } else {
+        *out_equal = vm_text_mismatch(data_a, data_b, (size_t)len_a) == len_a;
+    }
+    return true;
+}
+
+bool vm_string_literal(arx_vm_context_t *vm, uint64_t string_id, uint64_t *out_object_address)
+{
+    const char *str;
+    if (vm == NULL) {
+        return false;
+    }
+    if (out_object_address == NULL || !vm_load_string(vm, string_id, &str) || str == NULL) {
+        vm->last_error = VM_ERROR_INVALID_STRING_ID;
+        return false;
+    }
+    
+    if (vm->string_table.literals == NULL) {
+        vm->string_table.literals = calloc(vm->string_table.string_capacity, sizeof(uint64_t));
+        if (vm->string_table.literals == NULL) {
+            vm->last_error = VM_ERROR_OUT_OF_MEMORY;
+            return false;
+        }
+    }
+    
+    uint64_t object_addr = vm->string_table.literals[string_id];
+    if (object_addr == 0) {
+        if (!vm_string_create_from_cstr(vm, str, &object_addr)) {
+            return false;
+        }
+        vm_string_hash(vm, object_addr, str, vm->stack[object_addr]);
+        vm->string_table.literals[string_id] = object_addr;
+    }
     
-    if (off != 3 || cap < len) {
+    *out_object_address = object_addr;
+    return true;
+}
+
+bool vm_string_copy_to_buffer(arx_vm_context_t *vm, uint64_t object_address, char *dst, size_t dst_size)
+{
+    if (vm == NULL || dst == NULL || dst_size == 0) {
         return false;
     }
     
-    size_t data_words = (cap + 1 + sizeof(uint64_t) - 1) / sizeof(uint64_t);
-    if (object_address + off + data_words >= vm->stack_size) {
+    const char *src;
+    uint64_t len;
+    if (!vm_string_view(vm, object_address, &src, &len)) {
         return false;
     }
     
-    const char *src = (const char*)&vm->stack[object_address + off];
     size_t to_copy = (len < (dst_size - 1)) ? (size_t)len : (dst_size - 1);
     memcpy(dst, src, to_copy);
     dst[to_copy] = '\0';
     
     return true;
 }
+
+// === String builders ===
+
+// len of a released builder, so stale handles are rejected
+#define VM_STRING_BUILDER_RELEASED UINT64_MAX
+
+// Hand out a builder handle, reusing a released builder and its buffer
+static bool vm_string_builder_create(arx_vm_context_t *vm, uint64_t *handle)
+{
+    if (vm->string_builders.free_count > 0) {
+        size_t index = vm->string_builders.free_handles[--vm->string_builders.free_count];
+        vm->string_builders.builders[index].len = 0;
+        *handle = index + 1;
+        return true;
+    }
+    
+    if (vm->string_builders.count >= vm->string_builders.capacity) {
+        size_t new_capacity = vm->string_builders.capacity == 0 ? 8 : vm->string_builders.capacity * 2;
+        arx_string_builder_t *new_builders = realloc(vm->string_builders.builders,
+                                                     new_capacity * sizeof(arx_string_builder_t));
+        if (new_builders == NULL) {
+            return false;
+        }
+        vm->string_builders.builders = new_builders;
+        size_t *new_free = realloc(vm->string_builders.free_handles, new_capacity * sizeof(size_t));
+        if (new_free == NULL) {
+            return false;
+        }
+        vm->string_builders.free_handles = new_free;
+        vm->string_builders.capacity = new_capacity;
+    }
+    
+    arx_string_builder_t *builder = &vm->string_builders.builders[vm->string_builders.count];
+    builder->data = NULL;
+    builder->len = 0;
+    builder->cap = 0;
+    *handle = ++vm->string_builders.count;
+    return true;
+}
+
+// Builder for a handle, or NULL if it is not a live builder
+static arx_string_builder_t *vm_string_builder_get(arx_vm_context_t *vm, uint64_t handle)
+{
+    if (handle == 0 || handle > vm->string_builders.count ||
+        vm->string_builders.builders[handle - 1].len == VM_STRING_BUILDER_RELEASED) {
+        return NULL;
+    }
+    return &vm->string_builders.builders[handle - 1];
+}
+
+// Return a builder to the free list; its buffer is kept for reuse
+static void vm_string_builder_release(arx_vm_context_t *vm, uint64_t handle)
+{
+    vm->string_builders.builders[handle - 1].len = VM_STRING_BUILDER_RELEASED;
+    vm->string_builders.free_handles[vm->string_builders.free_count++] = handle - 1;
+}
+
+// Append bytes, doubling the buffer when it is full
+static bool vm_string_builder_append(arx_string_builder_t *builder, const char *data, uint64_t length)
+{
+    if (length == 0) {
+        return true;
+    }
+    if (builder->len + length > builder->cap) {
+        uint64_t new_cap = builder->cap == 0 ? 64 : builder->cap;
+        while (new_cap < builder->len + length) {
+            new_cap *= 2;
+        }
+        uint8_t *new_data = realloc(builder->data, new_cap);
+        if (new_data == NULL) {
+            return false;
+        }
+        builder->data = new_data;
+        builder->cap = new_cap;
+    }
+    
+    memcpy(builder->data + builder->len, data, length);
+    builder->len += length;
+    return true;
+}
@@ -10,84 +10,371 @@
 #include "../../compiler/common/opcodes.h"
 #include "../../compiler/common/arxmod_constants.h"
 #include "../../compiler/arxmod/arxmod.h"
+#include "segment.h"
 
 // Memory management and garbage collection types
+// Object IDs are handles: the low 32 bits are the table slot + 1 and the
+// high 32 bits a generation that changes each time the slot is reused, so
+// a stale ID never matches the slot's new object. A free slot has an ID
+// with zero low bits.
+#define VM_OBJECT_SLOT_BITS 32
+#define VM_OBJECT_SLOT_MASK 0xffffffffull
+
 typedef struct {
     uint64_t object_id;           // Unique object identifier
     uint64_t class_id;            // Class this object belongs to
     uint64_t memory_address;      // Memory address of the object
     size_t object_size;           // Size of the object in bytes
+    uint64_t creation_time;       // When object was created (for debugging)
     uint32_t reference_count;     // Number of references to this object
+    uint32_t class_index;         // Class manifest index + 1 (0: class not loaded)
     bool is_alive;                // Whether object is still alive
-    uint64_t creation_time;       // When object was created (for debugging)
+    bool frame;                   // Tied to an activation record (OPR_OBJ_NEW_FRAME)
 } object_entry_t;
 
+// Object area allocator. The area follows the data stack in vm->stack,
+// after a guard page, so object and string addresses index vm->stack
+// directly. Its whole range is reserved when the VM starts; it begins
+// VM_HEAP_DEFAULT_WORDS long and doubles, committing more of the range,
+// when a collection leaves no room (see vm_init_sized()). Every block is
+// preceded by one header word holding the payload size in words above
+// VM_HEAP_HEADER_SHIFT plus the in-use and GC mark bits; requests are
+// rounded up to a size class and freed blocks are kept on the free list of
+// their class, linked through their first payload word.
+#define VM_HEAP_DEFAULT_WORDS 65536   // Initial object area size in words
+#define VM_HEAP_DEFAULT_MAX_WORDS (32ull * 1024 * 1024) // Largest object area (256 MiB)
+#define VM_HEAP_EXACT_CLASSES 32      // Classes 1..32 hold exactly that many words
+#define VM_HEAP_SIZE_CLASSES 64       // Larger classes are powers of two
+#define VM_HEAP_HEADER_USED 1ull      // Block is allocated
+#define VM_HEAP_HEADER_MARK 2ull      // Block was reached by the current collection
+#define VM_HEAP_HEADER_SHIFT 2
+
+// Bytes allocated between automatic collections (0 = collect only when the
+// object area is full)
+#define VM_GC_DEFAULT_THRESHOLD (128 * 1024)
+
+// Collections whose figures are kept for vm_heap_stats_write_json()
+#define VM_GC_HISTORY 32
+
+// Program output is collected per VM and written to vm->output in one piece:
+// after each line by default, or once a block of this many bytes is pending
+// (see vm_set_output_buffer()). Pending output is always written before
+// input is read and when a run stops.
+#define VM_OUTPUT_LINE_BUFFER 4096
+#define VM_OUTPUT_DEFAULT_BLOCK (64 * 1024)
+
+// One collection, as kept in memory_manager_t.gc_history
 typedef struct {
-    object_entry_t *objects;      // Array of object entries
-    size_t object_count;          // Number of objects
+    uint64_t instructions;        // instruction_count_executed when it ran
+    uint64_t pause_ns;            // Time it took
+    uint64_t objects;             // Objects swept
+    uint64_t reclaimed;           // Payload bytes swept
+    uint64_t in_use;              // Payload bytes in use afterwards
+} vm_gc_record_t;
+
+typedef struct {
+    object_entry_t *objects;      // Handle table, indexed by object slot
+    size_t object_count;          // Slots in use or on the free list
     size_t object_capacity;       // Capacity of objects array
-    uint64_t next_object_id;      // Next available object ID
+    uint32_t *free_slots;         // Recycled slots (stack, object_capacity entries)
+    size_t free_slot_count;       // Number of recycled slots
+    uint32_t *address_index;      // Object area word -> slot + 1 (0 = none)
+    uint64_t *block_map;          // Bit per object area word: a block's payload starts there
+    vm_segment_t index_segment;   // Holds address_index, committed as the area grows
+    vm_segment_t map_segment;     // Holds block_map, committed as the area grows
     uint64_t total_allocated;     // Total memory allocated
     uint64_t total_freed;         // Total memory freed
+    
+    // Object area (word addresses into vm->stack)
+    uint64_t heap_base;           // First word of the area
+    uint64_t heap_limit;          // One past the last committed word
+    uint64_t heap_max;            // One past the last word the area may grow to
+    uint64_t heap_bump;           // Next never-used word
+    uint64_t free_lists[VM_HEAP_SIZE_CLASSES]; // Free block per class (0 = empty)
+    uint64_t heap_allocations;    // Blocks handed out
+    uint64_t heap_bytes_allocated; // Payload bytes handed out, all blocks
+    uint64_t heap_frees;          // Blocks returned
+    uint64_t heap_bytes_in_use;   // Payload bytes in live blocks
+    uint64_t heap_growths;        // Times the area was grown
+    
+    // Mark-sweep collector
+    uint64_t gc_threshold;        // Bytes allocated between collections (0 = when full)
+    uint64_t gc_allocated;        // Bytes allocated since the last collection
+    uint64_t *gc_mark_stack;      // Marked objects whose fields are still to be scanned
+    size_t gc_mark_top;           // Entries in gc_mark_stack
+    size_t gc_mark_capacity;      // Capacity of gc_mark_stack
+    uint64_t gc_collections;      // Collections run
+    uint64_t gc_bytes_reclaimed;  // Payload bytes swept, all collections
+    uint64_t gc_last_reclaimed;   // Payload bytes swept by the last collection
+    uint64_t gc_total_pause_ns;   // Time spent collecting
+    uint64_t gc_max_pause_ns;     // Longest collection
+    uint64_t gc_last_pause_ns;    // Last collection
+    vm_gc_record_t gc_history[VM_GC_HISTORY]; // Last collections; the newest is at (gc_collections - 1) % VM_GC_HISTORY
+    
+    // Objects tied to activation records; they do not count towards
+    // gc_threshold since their methods free them
+    uint64_t frame_allocations;   // Frame objects allocated
+    uint64_t frame_reuses;        // NEWs that restarted the variable's previous object in place
+    uint64_t frame_releases;      // Frame objects freed by their methods
 } memory_manager_t;
 
+// Errors, kept per VM in last_error
+typedef enum {
+    VM_ERROR_NONE = 0,
+    VM_ERROR_STACK_OVERFLOW,
+    VM_ERROR_STACK_UNDERFLOW,
+    VM_ERROR_MEMORY_ACCESS,
+    VM_ERROR_INVALID_INSTRUCTION,
+    VM_ERROR_CALL_STACK_OVERFLOW,
+    VM_ERROR_CALL_STACK_UNDERFLOW,
+    VM_ERROR_STRING_TABLE_FULL,
+    VM_ERROR_INVALID_ADDRESS,
+    VM_ERROR_INVALID_STRING_ID,
+    VM_ERROR_INVALID_OBJECT_ADDRESS,
+    VM_ERROR_INVALID_CLASS_ID,
+    VM_ERROR_METHOD_NOT_FOUND,
+    VM_ERROR_INVALID_PROGRAM,      // Program failed load-time verification
+    VM_ERROR_INSTRUCTION_LIMIT,    // Run used up its instruction budget
+    VM_ERROR_TIMEOUT,              // Run passed its wall-clock deadline
+    VM_ERROR_OUT_OF_MEMORY,        // Object area exhausted
+    VM_ERROR_MODULE_NOT_FOUND,     // Imported module could not be linked
+    VM_ERROR_DIVISION_BY_ZERO,     // DIV, MOD or RDIV by zero
+    VM_ERROR_INVALID_TASK,         // Join of a handle that names no task, or of the running one
+    VM_ERROR_DEADLOCK,             // Every task left waits in a join
+    VM_ERROR_ARRAY_BOUNDS,         // Array index or range outside the array
+    VM_ERROR_STRING_BOUNDS         // String offset or range outside the string
+} vm_error_t;
+
 // Forward declare VM context for helper prototypes
 typedef struct arx_vm_context arx_vm_context_t;
+typedef struct vm_profile vm_profile_t;   // See profile.h
+typedef struct vm_jit vm_jit_t;           // See jit.h
+typedef struct vm_tasks vm_tasks_t;       // See task.h
+typedef struct vm_trace vm_trace_t;       // See trace.h
+typedef struct vm_heap_sites vm_heap_sites_t; // See heapstats.h
 
 // String object layout (embedded header + inline UTF-8 data)
 // The string object occupies contiguous words in the VM object heap (stack-backed).
 // Layout (word-addressed, uint64_t units):
 //   [0] length   : number of bytes in string content (excluding NUL)
 //   [1] capacity : total byte capacity available for content (>= length)
-//   [2] data_off : word offset from base to first data word (typically 3)
-//   [3..] data   : UTF-8 bytes, NUL-terminated, packed into words
+//   [2] data_off : word offset from base to first data word (VM_STRING_HEADER_WORDS)
+//   [3] hash     : content hash, 0 until first computed
+//   [4..] data   : UTF-8 bytes, NUL-terminated, packed into words
 // All string operations should treat strings as immutable and create new objects.
 typedef struct {
     uint64_t length;
     uint64_t capacity;
     uint64_t data_offset_words;
+    uint64_t hash;
 } vm_string_header_t;
 
+#define VM_STRING_HEADER_WORDS 4
+
+// A slice is a string object that shares the bytes of a plain one:
+//   [0] length   : number of bytes in the slice
+//   [1] start    : byte offset of the slice in the base string
+//   [2] marker   : VM_STRING_SLICE instead of a data offset
+//   [3] hash     : as for plain strings
+//   [4] base     : address of the plain string holding the bytes
+// Slices of slices point at the plain string, and keep it alive.
+#define VM_STRING_SLICE_WORDS 5
+#define VM_STRING_SLICE 0x534c494345ull   // "SLICE"
+
 // String helpers (phase 1)
 // Create a new string object from a C string. Returns object base address.
 bool vm_string_create_from_cstr(arx_vm_context_t *vm, const char *cstr, uint64_t *out_object_address);
+// Allocate a string object with room for `length` bytes (zero-filled, so
+// already NUL-terminated); the caller fills in the data.
+bool vm_string_alloc(arx_vm_context_t *vm, uint64_t length, uint64_t *out_object_address);
+// Get the data and length of a string object or slice without copying. The
+// data of a slice is not NUL-terminated.
+bool vm_string_view(arx_vm_context_t *vm, uint64_t object_address, const char **out_data, uint64_t *out_length);
 // Get string length from object address.
 bool vm_string_get_length(arx_vm_context_t *vm, uint64_t object_address, uint64_t *out_length);
+// Compare two string objects: address, then length and hash, then bytes.
+bool vm_string_equals(arx_vm_context_t *vm, uint64_t a, uint64_t b, bool *out_equal);
+// Get the interned string object for a string table entry, creating it on first use.
+bool vm_string_literal(arx_vm_context_t *vm, uint64_t string_id, uint64_t *out_object_address);
 // Obtain a transient C string view by copying bytes out of the object into a temporary buffer owned by the VM.
 // NOTE: For phase 1, provide a simple scratch buffer API suitable for debugging/output paths.
 bool vm_string_copy_to_buffer(arx_vm_context_t *vm, uint64_t object_address, char *dst, size_t dst_size);
 
+// Activation records live on a contiguous frame stack. Each record is a
+// header followed by the locals reserved by VM_INT:
+//   [0] static link  : base of the lexically enclosing record
+//   [1] dynamic link : base of the caller's record
+//   [2] return pc    : instruction executed after OPR_RET
+//   [3] saved sp     : caller's data stack top at the call
+//   [4..] locals     : level-0 variables of the procedure
+// Outside any call, level-0 variables are the global memory area, whose
+// links are VM_FRAME_GLOBAL.
+#define VM_FRAME_STATIC_LINK  0
+#define VM_FRAME_DYNAMIC_LINK 1
+#define VM_FRAME_RETURN_PC    2
+#define VM_FRAME_SAVED_SP     3
+#define VM_FRAME_HEADER_SIZE  4
+#define VM_FRAME_GLOBAL       UINT64_MAX
+#define VM_DEFAULT_MAX_CALL_DEPTH 100000
+
+// The data stack and every frame stack are reserved whole up front and
+// committed as they fill, so neither moves. The data stack starts at the
+// stack_size given to vm_init() and a frame stack with room for one
+// memory_size window of locals; both double up to their limits.
+#define VM_STACK_DEFAULT_MAX_WORDS (1024ull * 1024)            // Data stack limit (8 MiB)
+#define VM_FRAME_STACK_DEFAULT_MAX_WORDS (4ull * 1024 * 1024)  // Frame stack limit (32 MiB)
+
+// Frame stack of one thread of execution; a task switch swaps it whole
+typedef struct {
+    uint64_t *frames;              // Frame stack words (segment.base)
+    size_t frame_capacity;         // Words committed (grows geometrically)
+    vm_segment_t segment;          // Reservation holding frames
+    size_t frame_top;              // First word above the current record
+    uint64_t frame_base;           // Base of the current record (VM_FRAME_GLOBAL outside calls)
+    size_t current_frame;          // Call depth (active records)
+    size_t max_depth;              // Call depth limit
+} vm_call_stack_t;
+
+// Decoded instruction, built once by vm_load_program() from the packed
+// instruction_t so execution does aligned loads and no nibble masking
+typedef struct {
+    const void *handler;           // Threaded-engine handler (label address with computed goto)
+    uint64_t operand;              // Literal, address, string ID or OPR operation
+    uint16_t op;                   // Threaded-engine operation
+    uint8_t opcode;                // opcode_t
+    uint8_t level;                 // Level (upper nibble of the packed opcode)
+} vm_instruction_t;
+
+// Interpreter dispatch engines
+typedef enum {
+    VM_DISPATCH_SWITCH = 0,        // vm_step() loop (reference engine)
+    VM_DISPATCH_THREADED           // Direct-threaded loop (vm_execute_threaded)
+} vm_dispatch_mode_t;
+
+// Superinstruction kinds counted by the load-time fusion pass
+typedef enum {
+    VM_FUSION_LOAD_LOAD_OP = 0,    // LOD a; LOD b; OPR op
+    VM_FUSION_LOAD_LOAD_OP_STORE,  // LOD a; LOD b; OPR op; STO c
+    VM_FUSION_LOAD_LIT_OP,         // LOD a; LIT n; OPR op
+    VM_FUSION_LOAD_LIT_OP_STORE,   // LOD a; LIT n; OPR op; STO c
+    VM_FUSION_INCREMENT_LOCAL,     // LOD x; LIT n; OPR ADD; STO x
+    VM_FUSION_LIT_OP,              // LIT n; OPR op
+    VM_FUSION_COMPARE_BRANCH,      // LOD a; LOD b; OPR cmp; JPC L
+    VM_FUSION_COMPARE_LIT_BRANCH,  // LOD a; LIT n; OPR cmp; JPC L
+    VM_FUSION_OP_BRANCH,           // OPR cmp; JPC L
+    VM_FUSION_KIND_COUNT
+} vm_fusion_kind_t;
+
+// Vtable slots are the method_id of the manifest's method entries; a class's
+// row holds its own methods over those inherited from its parent chain
+#define VM_VTABLE_EMPTY     UINT64_MAX
+#define VM_VTABLE_MAX_SLOTS 65536
+
+// Warm-start image: the prepared load-time state of one module (raw code,
+// strings, class manifest, class indexes and vtables), written once by
+// vm_write_image() and restored from a read-only mapping by vm_load_image().
+// Every section is an offset from the image start, 8-byte aligned.
+#define VM_IMAGE_MAGIC    "ARXIMG\0\0"
+#define VM_IMAGE_VERSION  2
+
+typedef struct {
+    uint64_t offset;               // Byte offset from the start of the image
+    uint64_t count;                // Entries (bytes for the strings blob)
+} vm_image_section_t;
+
+typedef struct {
+    char magic[8];                 // VM_IMAGE_MAGIC
+    uint32_t version;              // VM_IMAGE_VERSION
+    uint32_t layout;               // Manifest entry sizes, rejects images from other builds
+    uint64_t module_hash;          // arxmod_calculate_hash() of the module file
+    uint64_t module_size;          // Module file size
+    uint64_t string_count;         // Strings in the blob
+    uint64_t index_mask;           // Class index capacity - 1
+    uint64_t vtable_width;         // Method slots per vtable row
+    uint64_t checksum;             // Hash of this header (checksum 0) and every section
+    vm_image_section_t instructions; // instruction_t
+    vm_image_section_t strings;    // NUL-separated string blob
+    vm_image_section_t classes;    // class_entry_t
+    vm_image_section_t methods;    // method_entry_t
+    vm_image_section_t fields;     // field_entry_t
+    vm_image_section_t id_index;   // uint32_t, index_mask + 1 entries
+    vm_image_section_t name_index; // uint32_t, index_mask + 1 entries
+    vm_image_section_t vtables;    // uint64_t, class count * vtable_width entries
+} vm_image_header_t;
+
+// Prebuilt object layout for OPR_OBJ_NEW: a new instance is one allocation
+// of `words` words and a copy of `image`
+typedef struct {
+    size_t words;                  // Object size in words
+    uint64_t *image;               // Initial field values (NULL when words is 0)
+} vm_class_template_t;
+
+// Modules bound at run time. A VM_CALS operand with ARXMOD_EXTERN_CALL set
+// and an OPR_OBJ_NEW of a class the VM does not have refer to an entry of the
+// EXTERNS tables; the first use asks the resolver to link the module that
+// entry names, and the call site is patched with the method slot so later
+// calls dispatch like local ones.
+typedef bool (*vm_module_resolver_t)(arx_vm_context_t *vm, void *user_data, const char *module_name);
+
+// A compiled module to append to the running program with vm_link_module()
+typedef struct {
+    const char *name;              // Module name, as import declarations use it
+    const instruction_t *instructions; // Its code (copied)
+    size_t instruction_count;      // Number of instructions
+    char **strings;                // Its string table (copied)
+    size_t string_count;           // Number of strings
+    const class_entry_t *classes;  // Its class manifest (copied)
+    size_t class_count;            // Number of classes
+    const method_entry_t *methods; // Their methods, in class order (copied)
+    size_t method_count;           // Number of methods
+    const external_ref_t *externs; // Its own references to other modules (copied)
+    size_t extern_count;           // Number of references
+} vm_module_t;
+
 // VM execution context
 typedef struct arx_vm_context {
     // Instruction execution
-    instruction_t *instructions;    // Program instructions
+    instruction_t *instructions;    // Program instructions (as loaded from the module)
+    vm_instruction_t *code;        // Decoded, verified instructions (+1 end marker)
     size_t instruction_count;      // Number of instructions
     size_t pc;                     // Program counter
     
     // Memory management
     uint64_t *stack;               // Data stack
-    size_t stack_size;             // Stack size
+    size_t stack_size;             // Words committed (grows up to stack_max_size)
+    size_t stack_max_size;         // Words reserved for the data stack
     size_t stack_top;              // Stack top pointer
+    vm_segment_t stack_segment;    // Data stack, a guard page, then the object area
+    size_t frame_stack_max_size;   // Words reserved for each frame stack
     
     uint64_t *memory;              // Global memory
     size_t memory_size;            // Memory size
+    vm_segment_t memory_segment;   // Holds memory
     
-    // Call stack for procedures
-    struct {
-        uint64_t *frames;          // Call frames
-        size_t frame_count;        // Number of frames
-        size_t frame_capacity;     // Frame capacity
-        size_t current_frame;      // Current frame index
-    } call_stack;
+    // Call stack for procedures (activation records, see VM_FRAME_*)
+    vm_call_stack_t call_stack;
+    uint64_t *locals;              // Level-0 variables: current record's locals or global memory
     
     // String management (UTF-8 support)
     struct {
         char **strings;            // String table (UTF-8 encoded)
         size_t string_count;       // Number of strings
+        size_t mapped_count;       // Leading strings borrowed from the module mapping (not freed)
         size_t string_capacity;    // String capacity
+        uint64_t *literals;        // Interned string object per ID (0: not interned yet)
         bool utf8_enabled;         // UTF-8 support enabled
     } string_table;
     
+    // String builders for OPR_STR_BUILDER_*; a handle is index + 1 and
+    // released builders keep their buffers for the next CREATE
+    struct {
+        arx_string_builder_t *builders; // Builder table
+        size_t count;              // Builders ever created
+        size_t capacity;           // Table capacity
+        size_t *free_handles;      // Released builder indices (capacity entries)
+        size_t free_count;         // Number of released builders
+    } string_builders;
+    
     // Module information
     arxmod_header_t module_header; // Module header with flags
     
@@ -103,33 +390,108 @@ typedef struct arx_vm_context {
         size_t field_count;        // Number of fields
         size_t field_capacity;     // Field capacity
         uint64_t *method_addresses; // Method address table (pre-calculated by linker)
+        vm_class_template_t *templates; // Object template per class
+        uint32_t *id_index;        // Open-addressed class ID hash (class index + 1, 0 = empty)
+        uint32_t *name_index;      // Same, keyed by class name
+        size_t index_mask;         // Capacity of both indexes - 1 (power of two)
+        uint64_t *vtables;         // Flattened vtables: one row of vtable_width method pcs per class
+        size_t vtable_width;       // Method slots per row (highest method_id + 1)
     } class_system;
     
     // Memory management and garbage collection
     memory_manager_t memory_manager;
     
+    // Cross-module references and the modules linked to resolve them
+    struct {
+        external_ref_t *externs;   // References of every module loaded so far
+        uint64_t *bound_slots;     // Method slot per METHOD reference (VM_VTABLE_EMPTY: not bound yet)
+        size_t extern_count;       // Number of references
+        char (*names)[64];         // Modules linked so far
+        size_t count;              // Number of linked modules
+        vm_module_resolver_t resolver; // Loads a module on first use (NULL: references fail)
+        void *resolver_data;       // Passed to resolver
+        size_t global_limit;       // Global memory words used by the code so far (0: not computed yet)
+    } modules;
+    
+    // Execution engine
+    vm_dispatch_mode_t dispatch_mode; // Engine used by vm_execute()
+    bool superinstructions;        // Fuse common sequences at load time (threaded engine)
+    size_t fusion_counts[VM_FUSION_KIND_COUNT]; // Superinstructions built, per kind
+    size_t fused_instructions;     // Instructions covered by superinstructions
+    vm_profile_t *profile;         // Profiler state (NULL: not profiling, see vm_profile_enable())
+    vm_jit_t *jit;                 // Native code for hot methods (NULL: interpreted only, see vm_jit_enable())
+    vm_tasks_t *tasks;             // Green threads (NULL until the first OPR_TASK_SPAWN, see task.h)
+    vm_trace_t *trace;             // Ring of the last instructions run (NULL: not tracing, see vm_trace_enable())
+    vm_heap_sites_t *heap_sites;   // Sampled allocation sites (NULL: not sampling, see vm_heap_sites_enable())
+    uint64_t task_slice;           // Instructions per task turn (0 = VM_TASK_DEFAULT_SLICE)
+    
+    // Execution budget, armed by each vm_execute() call (0 = unlimited)
+    uint64_t max_instructions;     // Instructions allowed per run
+    uint64_t timeout_ms;           // Wall-clock time allowed per run
+    size_t budget_limit;           // instruction_count_executed value that ends the run
+    size_t budget_next_check;      // instruction_count_executed value of the next budget check
+    uint64_t budget_deadline_ns;   // Monotonic-clock deadline (0 = none)
+    
+    // Program I/O (WRITE, WRITELN, ININT); vm_init() sets stdout and stdin
+    FILE *output;                  // Program output
+    FILE *input;                   // Program input
+    char *output_buffer;           // Output not written yet (NULL until the first write)
+    size_t output_length;          // Bytes pending in output_buffer
+    size_t output_capacity;        // Bytes allocated
+    size_t output_block;           // Bytes kept before a write (0 = write each line)
+    
     // Debug information
     bool debug_mode;               // Debug output
     size_t instruction_count_executed; // Instructions executed
     bool halted;                   // VM halted flag
+    vm_error_t last_error;         // Why the last failing operation failed
 } arx_vm_context_t;
 
 // VM initialization and cleanup
 bool vm_init(arx_vm_context_t *vm, size_t stack_size, size_t memory_size);
+// vm_init() with a data stack that may grow to stack_max_size words, frame
+// stacks that may grow to frame_max_size words and an object area of
+// heap_words words that may grow to heap_max_words (0 for any but
+// stack_size and memory_size: the default)
+bool vm_init_sized(arx_vm_context_t *vm, size_t stack_size, size_t stack_max_size, size_t memory_size,
+                   size_t frame_max_size, size_t heap_words, size_t heap_max_words);
 void vm_cleanup(arx_vm_context_t *vm);
 
+// Frame stacks: an empty one outside every call, reserved to the VM's
+// frame_stack_max_size (its max_depth is kept), and giving one back
+bool vm_call_stack_init(arx_vm_context_t *vm, vm_call_stack_t *call_stack);
+void vm_call_stack_free(vm_call_stack_t *call_stack);
+
 // Program loading
 bool vm_load_program(arx_vm_context_t *vm, instruction_t *instructions, size_t instruction_count);
 bool vm_load_strings(arx_vm_context_t *vm, char **strings, size_t string_count);
+bool vm_map_strings(arx_vm_context_t *vm, char **strings, size_t string_count);
 bool vm_load_module_header(arx_vm_context_t *vm, arxmod_header_t *header);
+bool vm_write_image(arx_vm_context_t *vm, FILE *file, uint64_t module_hash, uint64_t module_size);
+bool vm_load_image(arx_vm_context_t *vm, const uint8_t *image, size_t image_size, uint64_t module_hash, uint64_t module_size);
+
+// Cross-module linking
+bool vm_load_externs(arx_vm_context_t *vm, const external_ref_t *externs, size_t extern_count);
+void vm_set_module_resolver(arx_vm_context_t *vm, vm_module_resolver_t resolver, void *user_data);
+bool vm_link_module(arx_vm_context_t *vm, const vm_module_t *module);
+bool vm_module_is_linked(arx_vm_context_t *vm, const char *module_name);
 
 // Execution
 bool vm_execute(arx_vm_context_t *vm);
+bool vm_execute_threaded(arx_vm_context_t *vm);
 bool vm_step(arx_vm_context_t *vm);
 void vm_halt(arx_vm_context_t *vm);
+void vm_set_budget(arx_vm_context_t *vm, uint64_t max_instructions, uint64_t timeout_ms);
+
+// Program output
+void vm_set_output_buffer(arx_vm_context_t *vm, size_t block);
+bool vm_output_flush(arx_vm_context_t *vm);
 
 // Stack operations
 bool vm_push(arx_vm_context_t *vm, uint64_t value);
+// Commit the data stack up to at least `words` words; false with
+// VM_ERROR_STACK_OVERFLOW past stack_max_size
+bool vm_stack_grow(arx_vm_context_t *vm, size_t words);
 bool vm_pop(arx_vm_context_t *vm, uint64_t *value);
 bool vm_peek(arx_vm_context_t *vm, size_t offset, uint64_t *value);
 bool vm_poke(arx_vm_context_t *vm, size_t offset, uint64_t value);
@@ -152,6 +514,8 @@ bool vm_load_classes(arx_vm_context_t *vm, class_entry_t *classes, size_t class_
 bool vm_resolve_method_address(arx_vm_context_t *vm, uint64_t class_id, const char *method_name, uint64_t *address);
 bool vm_resolve_class_id(arx_vm_context_t *vm, const char *class_name, uint64_t *class_id);
 bool vm_instantiate_class(arx_vm_context_t *vm, uint64_t class_id, uint64_t *object_address);
+bool vm_instantiate_frame_object(arx_vm_context_t *vm, uint64_t class_id, uint64_t previous, uint64_t *object_address);
+bool vm_release_frame_object(arx_vm_context_t *vm, uint64_t object_address);
 
 // Field access and method resolution
 bool vm_get_field_offset(arx_vm_context_t *vm, uint64_t class_id, const char *field_name, uint64_t *offset);
@@ -170,6 +534,12 @@ bool vm_release_object(arx_vm_context_t *vm, uint64_t object_id);
 bool vm_get_object_info(arx_vm_context_t *vm, uint64_t object_id, object_entry_t **entry);
 void vm_garbage_collect(arx_vm_context_t *vm);
 void vm_dump_memory_manager(arx_vm_context_t *vm);
+void vm_dump_gc_stats(arx_vm_context_t *vm);
+
+// Object area allocation (addresses index vm->stack, payload is zeroed)
+bool vm_heap_alloc(arx_vm_context_t *vm, size_t words, uint64_t *address);
+bool vm_heap_free(arx_vm_context_t *vm, uint64_t address);
+bool vm_heap_contains(arx_vm_context_t *vm, uint64_t address, size_t words);
 
 // Object access functions
 typedef struct {
@@ -180,10 +550,13 @@ typedef struct {
     uint32_t reference_count;
 } memory_object_t;
 
-memory_object_t* memory_manager_get_object(memory_manager_t *mm, uint64_t object_address);
+bool memory_manager_get_object(memory_manager_t *mm, uint64_t object_address, memory_object_t *object);
 
 // Call stack functions
 bool vm_push_call_stack(arx_vm_context_t *vm, uint64_t return_address);
+// Tail call: the method about to run takes over the current record and
+// returns to its caller. False when there is no record to take over.
+bool vm_reuse_call_stack(arx_vm_context_t *vm);
 
 // Instruction execution helpers
 bool vm_execute_operation(arx_vm_context_t *vm, opr_t operation, uint8_t level, uint64_t operand);
@@ -199,23 +572,8 @@ void vm_dump_state(arx_vm_context_t *vm);
 void vm_dump_stack(arx_vm_context_t *vm, size_t count);
 void vm_dump_memory(arx_vm_context_t *vm, size_t start, size_t count);
 void vm_dump_instructions(arx_vm_context_t *vm, size_t start, size_t count);
+void vm_dump_fusion_report(arx_vm_context_t *vm);
 
 // Error handling
-typedef enum {
-    VM_ERROR_NONE = 0,
-    VM_ERROR_STACK_OVERFLOW,
-    VM_ERROR_STACK_UNDERFLOW,
-    VM_ERROR_MEMORY_ACCESS,
-    VM_ERROR_INVALID_INSTRUCTION,
-    VM_ERROR_CALL_STACK_OVERFLOW,
-    VM_ERROR_CALL_STACK_UNDERFLOW,
-    VM_ERROR_STRING_TABLE_FULL,
-    VM_ERROR_INVALID_ADDRESS,
-    VM_ERROR_INVALID_STRING_ID,
-    VM_ERROR_INVALID_OBJECT_ADDRESS,
-    VM_ERROR_INVALID_CLASS_ID,
-    VM_ERROR_METHOD_NOT_FOUND
-} vm_error_t;
-
 vm_error_t vm_get_last_error(arx_vm_context_t *vm);
 const char* vm_error_to_string(vm_error_t error);
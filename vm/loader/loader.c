@@ -8,8 +8,17 @@
 #include <stdlib.h>
 #include <string.h>
 
-// Global debug flag (extern from main.c)
-extern bool debug_mode;
+#if defined(__unix__) || defined(__APPLE__)
+#define LOADER_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define LOADER_HAVE_MMAP 0
+#endif
+
+static bool loader_resolve_module(arx_vm_context_t *vm, void *user_data, const char *module_name);
 
 bool loader_init(loader_context_t *loader, arx_vm_context_t *vm)
 {
@@ -19,7 +28,10 @@ bool loader_init(loader_context_t *loader, arx_vm_context_t *vm)
     
     memset(loader, 0, sizeof(loader_context_t));
     loader->vm = vm;
-    loader->debug_output = debug_mode;
+    loader->map_module = true;
+    loader->debug_output = vm->debug_mode;
+    snprintf(loader->module_dir, sizeof(loader->module_dir), ".");
+    vm_set_module_resolver(vm, loader_resolve_module, loader);
     
     if (loader->debug_output) {
         printf("ARX module loader initialized\n");
@@ -31,6 +43,14 @@ bool loader_init(loader_context_t *loader, arx_vm_context_t *vm)
 void loader_cleanup(loader_context_t *loader)
 {
     if (loader != NULL) {
+        free(loader->code);
+        free(loader->symbols);
+#if LOADER_HAVE_MMAP
+        if (loader->image != NULL) {
+            munmap((void *)loader->image, loader->image_size);
+        }
+#endif
+        free(loader->debug_info);
         arxmod_reader_cleanup(&loader->reader);
         memset(loader, 0, sizeof(loader_context_t));
     }
@@ -46,11 +66,20 @@ bool loader_load_module(loader_context_t *loader, const char *filename)
         printf("Loading ARX module: %s\n", filename);
     }
     
-    // Initialize ARX module reader
-    if (!arxmod_reader_init(&loader->reader, filename)) {
+    // Modules the program imports may sit next to it
+    const char *slash = strrchr(filename, '/');
+    if (slash != NULL) {
+        snprintf(loader->module_dir, sizeof(loader->module_dir), "%.*s", (int)(slash - filename), filename);
+    }
+    
+    // Initialize ARX module reader: mapped if possible, so the code and
+    // strings are used straight from the page cache
+    bool mapped = loader->map_module && arxmod_reader_init_mapped(&loader->reader, filename);
+    if (!mapped && !arxmod_reader_init(&loader->reader, filename)) {
         printf("Error: Failed to initialize ARX module reader\n");
         return false;
     }
+    loader->reader.debug_output = loader->debug_output;
     
     // Validate module format
     if (!arxmod_reader_validate(&loader->reader)) {
@@ -81,7 +110,7 @@ bool loader_validate_module(loader_context_t *loader)
     }
     
     // Check if module is loaded
-    if (loader->reader.file == NULL) {
+    if (loader->reader.file == NULL && !arxmod_reader_is_mapped(&loader->reader)) {
         printf("Error: No module loaded\n");
         return false;
     }
@@ -92,9 +121,9 @@ bool loader_validate_module(loader_context_t *loader)
         return false;
     }
     
-    if (loader->reader.header.version != ARXMOD_VERSION) {
-        printf("Error: Unsupported version %u (expected %d)\n", 
-               loader->reader.header.version, ARXMOD_VERSION);
+    if (loader->reader.header.version < ARXMOD_VERSION_FIXED || loader->reader.header.version > ARXMOD_VERSION) {
+        printf("Error: Unsupported version %u (expected %d to %d)\n", 
+               loader->reader.header.version, ARXMOD_VERSION_FIXED, ARXMOD_VERSION);
         return false;
     }
     
@@ -131,6 +160,12 @@ bool loader_load_code_section(loader_context_t *loader)
         return false;
     }
     
+    // The VM keeps pointing at the code, so copies live until loader_cleanup
+    if (!arxmod_reader_code_is_mapped(&loader->reader)) {
+        free(loader->code);
+        loader->code = instructions;
+    }
+    
     if (instruction_count == 0) {
         printf("Warning: No code section found\n");
         return true;
@@ -165,7 +200,12 @@ bool loader_load_classes_section(loader_context_t *loader)
     field_entry_t *fields = NULL;
     size_t field_count = 0;
     
-    if (!arxmod_reader_load_classes_section(&loader->reader, &classes, &class_count, &methods, &method_count, &fields, &field_count)) {
+    // Methods feed the vtables, but field entries are only printed in debug
+    // output (objects are laid out from the class entries), so a normal run
+    // skips them
+    bool want_fields = loader->debug_output;
+    if (!arxmod_reader_load_classes_section(&loader->reader, &classes, &class_count, &methods, &method_count,
+                                            want_fields ? &fields : NULL, want_fields ? &field_count : NULL)) {
         printf("Error: Failed to load classes section\n");
         return false;
     }
@@ -227,70 +267,344 @@ bool loader_load_strings_section(loader_context_t *loader)
         return false;
     }
     
+    // A mapped reader hands out pointers into the module, which the VM
+    // borrows; otherwise the VM keeps its own copies
+    bool mapped = arxmod_reader_is_mapped(&loader->reader);
+    bool loaded = true;
     if (string_count > 0) {
-        if (!vm_load_strings(loader->vm, strings, string_count)) {
+        loaded = mapped ? vm_map_strings(loader->vm, strings, string_count)
+                        : vm_load_strings(loader->vm, strings, string_count);
+        if (!loaded) {
             printf("Error: Failed to load strings into VM\n");
-            return false;
+        } else if (loader->debug_output) {
+            printf("Strings section loaded: %zu strings%s\n", string_count, mapped ? " (mapped)" : "");
         }
-        
-        if (loader->debug_output) {
-            printf("Strings section loaded: %zu strings\n", string_count);
+    }
+    
+    if (strings != NULL && !mapped) {
+        for (size_t i = 0; i < string_count; i++) {
+            free(strings[i]);
         }
     }
+    free(strings);
     
-    return true;
+    return loaded;
+}
+
+// References to imported modules; read after the classes and before the
+// code, whose external calls are verified against them
+bool loader_load_externs_section(loader_context_t *loader)
+{
+    if (loader == NULL || loader->vm == NULL) {
+        return false;
+    }
+    
+    external_ref_t *externs = NULL;
+    size_t extern_count = 0;
+    if (!arxmod_reader_load_externs_section(&loader->reader, &externs, &extern_count)) {
+        printf("Error: Failed to load externs section\n");
+        return false;
+    }
+    
+    bool loaded = vm_load_externs(loader->vm, externs, extern_count);
+    if (!loaded) {
+        printf("Error: Failed to load external references into VM\n");
+    } else if (extern_count > 0 && loader->debug_output) {
+        printf("Externs section loaded: %zu references\n", extern_count);
+    }
+    
+    free(externs);
+    return loaded;
 }
 
+// The symbols and debug sections are read on first use (error reports,
+// state dumps, line lookups) and kept until loader_cleanup; the reader and
+// its TOC stay open for this. Later calls are free.
 bool loader_load_symbols_section(loader_context_t *loader)
 {
     if (loader == NULL) {
         return false;
     }
     
-    symbol_entry_t *symbols = NULL;
-    size_t symbol_count = 0;
+    if (loader->symbols_loaded) {
+        return true;
+    }
     
-    if (!arxmod_reader_load_symbols_section(&loader->reader, &symbols, &symbol_count)) {
+    if (!arxmod_reader_load_symbols_section(&loader->reader, &loader->symbols, &loader->symbol_count)) {
         printf("Error: Failed to load symbols section\n");
+        loader->symbols = NULL;
+        loader->symbol_count = 0;
         return false;
     }
+    loader->symbols_loaded = true;
     
-    if (symbol_count > 0) {
-        if (loader->debug_output) {
-            printf("Symbols section loaded: %zu symbols\n", symbol_count);
-        }
-        
-        // Free symbols (not used by VM yet)
-        free(symbols);
+    if (loader->symbol_count > 0 && loader->debug_output) {
+        printf("Symbols section loaded: %zu symbols\n", loader->symbol_count);
     }
     
     return true;
 }
 
+static int loader_compare_debug_entries(const void *a, const void *b)
+{
+    uint64_t left = ((const debug_entry_t *)a)->instruction_offset;
+    uint64_t right = ((const debug_entry_t *)b)->instruction_offset;
+    return left < right ? -1 : left > right;
+}
+
 bool loader_load_debug_section(loader_context_t *loader)
 {
     if (loader == NULL) {
         return false;
     }
     
-    debug_entry_t *debug_info = NULL;
-    size_t debug_count = 0;
+    if (loader->debug_loaded) {
+        return true;
+    }
     
-    if (!arxmod_reader_load_debug_section(&loader->reader, &debug_info, &debug_count)) {
+    if (!arxmod_reader_load_debug_section(&loader->reader, &loader->debug_info, &loader->debug_count)) {
         printf("Error: Failed to load debug section\n");
+        loader->debug_info = NULL;
+        loader->debug_count = 0;
         return false;
     }
+    loader->debug_loaded = true;
     
-    if (debug_count > 0) {
-        if (loader->debug_output) {
-            printf("Debug section loaded: %zu entries\n", debug_count);
+    // Sorted once so loader_find_line can binary search
+    if (loader->debug_count > 1) {
+        qsort(loader->debug_info, loader->debug_count, sizeof(debug_entry_t), loader_compare_debug_entries);
+    }
+    
+    if (loader->debug_count > 0 && loader->debug_output) {
+        printf("Debug section loaded: %zu entries\n", loader->debug_count);
+    }
+    
+    return true;
+}
+
+// Source position of the last line entry at or before pc (an instruction
+// index); false if the module has no line information for it
+bool loader_find_line(loader_context_t *loader, size_t pc, uint32_t *line, uint32_t *column)
+{
+    if (loader == NULL || !loader_load_debug_section(loader) || loader->debug_count == 0) {
+        return false;
+    }
+    
+    size_t low = 0;
+    size_t high = loader->debug_count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (loader->debug_info[mid].instruction_offset <= pc) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    
+    if (low == 0) {
+        return false;
+    }
+    
+    const debug_entry_t *entry = &loader->debug_info[low - 1];
+    if (line != NULL) {
+        *line = entry->line_number;
+    }
+    if (column != NULL) {
+        *column = entry->column_number;
+    }
+    return true;
+}
+
+bool loader_add_module_path(loader_context_t *loader, const char *directory)
+{
+    if (loader == NULL || directory == NULL || loader->module_path_count >= LOADER_MAX_MODULE_PATHS) {
+        return false;
+    }
+    loader->module_paths[loader->module_path_count++] = directory;
+    return true;
+}
+
+// Open <Name>.arxmod from the module paths, then from the program's directory
+static bool loader_open_import(loader_context_t *loader, const char *module_name, arxmod_reader_t *reader, char *path, size_t path_size)
+{
+    for (size_t i = 0; i <= loader->module_path_count; i++) {
+        const char *directory = i < loader->module_path_count ? loader->module_paths[i] : loader->module_dir;
+        int length = snprintf(path, path_size, "%s/%s.arxmod", directory, module_name);
+        if (length <= 0 || (size_t)length >= path_size) {
+            continue;
+        }
+        if ((loader->map_module && arxmod_reader_init_mapped(reader, path)) || arxmod_reader_init(reader, path)) {
+            reader->debug_output = loader->debug_output;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Read an imported module and append it to the running program. The VM
+// copies what it needs, so the module is closed again; with mapping, the
+// code and strings still come straight from the page cache every program
+// running the module shares.
+bool loader_link_module(loader_context_t *loader, const char *module_name)
+{
+    if (loader == NULL || loader->vm == NULL || module_name == NULL) {
+        return false;
+    }
+    
+    char path[2048];
+    arxmod_reader_t reader;
+    if (!loader_open_import(loader, module_name, &reader, path, sizeof(path))) {
+        printf("Error: Cannot find module %s (%s.arxmod)\n", module_name, module_name);
+        return false;
+    }
+    
+    vm_module_t module;
+    memset(&module, 0, sizeof(module));
+    module.name = module_name;
+    instruction_t *instructions = NULL;
+    class_entry_t *classes = NULL;
+    method_entry_t *methods = NULL;
+    external_ref_t *externs = NULL;
+    
+    bool linked = arxmod_reader_validate(&reader) && arxmod_reader_load_toc(&reader) &&
+                  arxmod_reader_load_code_section(&reader, &instructions, &module.instruction_count) &&
+                  arxmod_reader_load_strings_section(&reader, &module.strings, &module.string_count) &&
+                  arxmod_reader_load_classes_section(&reader, &classes, &module.class_count,
+                                                     &methods, &module.method_count, NULL, NULL) &&
+                  arxmod_reader_load_externs_section(&reader, &externs, &module.extern_count);
+    if (!linked) {
+        printf("Error: %s is not a valid ARX module\n", path);
+    } else {
+        module.instructions = instructions;
+        module.classes = classes;
+        module.methods = methods;
+        module.externs = externs;
+        linked = vm_link_module(loader->vm, &module);
+        if (!linked) {
+            printf("Error: Failed to link module %s from %s\n", module_name, path);
+        } else if (loader->debug_output) {
+            printf("Linked module %s from %s\n", module_name, path);
+        }
+    }
+    
+    if (!arxmod_reader_code_is_mapped(&reader)) {
+        free(instructions);
+    }
+    if (module.strings != NULL && !arxmod_reader_is_mapped(&reader)) {
+        for (size_t i = 0; i < module.string_count; i++) {
+            free(module.strings[i]);
         }
-        
-        // Free debug info (not used by VM yet)
-        free(debug_info);
+    }
+    free(module.strings);
+    free(classes);
+    free(methods);
+    free(externs);
+    arxmod_reader_cleanup(&reader);
+    return linked;
+}
+
+static bool loader_resolve_module(arx_vm_context_t *vm, void *user_data, const char *module_name)
+{
+    (void)vm;
+    return loader_link_module((loader_context_t *)user_data, module_name);
+}
+
+// Images are keyed by the content hash of the mapped module, so any change
+// to the module selects a different file
+static bool loader_image_path(loader_context_t *loader, const char *cache_dir, char *path, size_t path_size)
+{
+    if (cache_dir == NULL || !arxmod_reader_is_mapped(&loader->reader)) {
+        return false;
+    }
+    
+    if (loader->module_hash == 0) {
+        loader->module_hash = arxmod_calculate_hash(loader->reader.map, loader->reader.map_size);
+    }
+    
+    int length = snprintf(path, path_size, "%s/%016llx.arximg", cache_dir, (unsigned long long)loader->module_hash);
+    return length > 0 && (size_t)length < path_size;
+}
+
+// Restore the VM from a cached image of this module instead of loading its
+// sections; false when there is none or it is rejected, and the sections are
+// then loaded as usual
+bool loader_restore_image(loader_context_t *loader, const char *cache_dir)
+{
+#if LOADER_HAVE_MMAP
+    char path[4096];
+    if (loader == NULL || loader->vm == NULL || !loader_image_path(loader, cache_dir, path, sizeof(path))) {
+        return false;
+    }
+    
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    
+    struct stat st;
+    void *image = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        image = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (image == MAP_FAILED) {
+        return false;
+    }
+    
+    if (!vm_load_image(loader->vm, image, (size_t)st.st_size, loader->module_hash, loader->reader.map_size)) {
+        munmap(image, (size_t)st.st_size);
+        return false;
+    }
+    
+    loader->image = image;
+    loader->image_size = (size_t)st.st_size;
+    
+    if (loader->debug_output) {
+        printf("Warm start from image %s\n", path);
+    }
+    
+    return true;
+#else
+    (void)loader;
+    (void)cache_dir;
+    return false;
+#endif
+}
+
+// Save the freshly loaded state; written to a temporary file and renamed so
+// concurrent runs never map a partial image
+bool loader_store_image(loader_context_t *loader, const char *cache_dir)
+{
+#if LOADER_HAVE_MMAP
+    char path[4096];
+    char temp_path[4096 + 32];
+    if (loader == NULL || loader->vm == NULL || !loader_image_path(loader, cache_dir, path, sizeof(path))) {
+        return false;
+    }
+    
+    snprintf(temp_path, sizeof(temp_path), "%s.%ld.tmp", path, (long)getpid());
+    FILE *file = fopen(temp_path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    
+    bool written = vm_write_image(loader->vm, file, loader->module_hash, loader->reader.map_size);
+    written = fclose(file) == 0 && written;
+    if (!written || rename(temp_path, path) != 0) {
+        remove(temp_path);
+        return false;
+    }
+    
+    if (loader->debug_output) {
+        printf("Warm-start image saved to %s\n", path);
     }
     
     return true;
+#else
+    (void)loader;
+    (void)cache_dir;
+    return false;
+#endif
 }
 
 void loader_dump_module_info(loader_context_t *loader)
@@ -300,7 +614,7 @@ void loader_dump_module_info(loader_context_t *loader)
         return;
     }
     
-    if (loader->reader.file == NULL) {
+    if (loader->reader.file == NULL && !arxmod_reader_is_mapped(&loader->reader)) {
         printf("No module loaded\n");
         return;
     }
@@ -10,11 +10,31 @@
 #include "../../compiler/arxmod/arxmod.h"
 #include "../core/vm.h"
 
+#define LOADER_MAX_MODULE_PATHS 16
+
 // Loader context
 typedef struct {
     arxmod_reader_t reader;         // ARX module reader
     arx_vm_context_t *vm;           // VM context to load into
+    bool map_module;                // Map the module and run from it in place (falls back to reading)
     bool debug_output;              // Debug output flag
+    instruction_t *code;            // Decoded code the VM runs from (NULL when mapped in place)
+    const uint8_t *image;           // Mapped warm-start image the VM was restored from (or NULL)
+    size_t image_size;              // Image mapping length
+    uint64_t module_hash;           // arxmod_calculate_hash() of the mapped module (0: not computed)
+    
+    // Sections a normal run never reads, materialized on first use
+    symbol_entry_t *symbols;        // Symbol table
+    size_t symbol_count;            // Number of symbols
+    bool symbols_loaded;            // Symbols section has been read
+    debug_entry_t *debug_info;      // Line table, sorted by instruction offset
+    size_t debug_count;             // Number of line entries
+    bool debug_loaded;              // Debug section has been read
+    
+    // Imported modules are found here when the program first uses them
+    const char *module_paths[LOADER_MAX_MODULE_PATHS]; // -module-path directories, searched first
+    size_t module_path_count;       // Number of module paths
+    char module_dir[1024];          // Directory of the program module, searched last
 } loader_context_t;
 
 // Loader functions
@@ -31,6 +51,16 @@ bool loader_load_classes_section(loader_context_t *loader);
 bool loader_load_strings_section(loader_context_t *loader);
 bool loader_load_symbols_section(loader_context_t *loader);
 bool loader_load_debug_section(loader_context_t *loader);
+bool loader_load_externs_section(loader_context_t *loader);
+bool loader_find_line(loader_context_t *loader, size_t pc, uint32_t *line, uint32_t *column);
+
+// Imported modules
+bool loader_add_module_path(loader_context_t *loader, const char *directory);
+bool loader_link_module(loader_context_t *loader, const char *module_name);
+
+// Warm-start image cache (<cache_dir>/<module hash>.arximg)
+bool loader_restore_image(loader_context_t *loader, const char *cache_dir);
+bool loader_store_image(loader_context_t *loader, const char *cache_dir);
 
 // Utility functions
 void loader_dump_module_info(loader_context_t *loader);
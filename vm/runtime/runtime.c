@@ -3,21 +3,54 @@
  * Main runtime and execution environment
  */
 
+#define _POSIX_C_SOURCE 200809L     // clock_gettime() for the execution time
+
 #include "runtime.h"
+#include "../core/profile.h"
+#include "../core/jit.h"
+#include "../core/task.h"
+#include "../core/array.h"
+#include "../core/text.h"
+#include "../core/trace.h"
+#include "../core/heapstats.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
-// Global debug flag (extern from main.c)
-extern bool debug_mode;
+#include <time.h>
+#include <sys/resource.h>
 
 // Default runtime configuration
 const runtime_config_t RUNTIME_CONFIG_DEFAULT = {
-    .stack_size = 16384,           // 16K stack entries
+    .stack_size = 16384,           // 16K stack entries to start with
+    .stack_max_size = VM_STACK_DEFAULT_MAX_WORDS, // Reserved up front, committed as the stack grows
+    .frame_stack_max_size = VM_FRAME_STACK_DEFAULT_MAX_WORDS, // Likewise for each frame stack
     .memory_size = 65536,          // 64K memory entries
+    .heap_words = VM_HEAP_DEFAULT_WORDS, // 512 KiB object area to start with
+    .heap_max_words = VM_HEAP_DEFAULT_MAX_WORDS, // Reserved up front, committed as it grows
     .debug_mode = false,           // Debug output disabled
     .trace_execution = false,      // Trace execution disabled
-    .dump_state_on_error = true    // Dump state on error
+    .trace_records = 0,            // VM_TRACE_DEFAULT_RECORDS when tracing
+    .trace_path = NULL,            // Print the end of the trace on error
+    .dump_state_on_error = true,   // Dump state on error
+    .dispatch_mode = VM_DISPATCH_SWITCH, // Reference switch engine
+    .superinstructions = false,    // No load-time fusion
+    .max_instructions = 0,         // No instruction budget
+    .timeout_ms = 0,               // No deadline
+    .max_call_depth = VM_DEFAULT_MAX_CALL_DEPTH, // Frame stack grows on demand up to this depth
+    .gc_threshold = VM_GC_DEFAULT_THRESHOLD, // Collect after this many bytes of allocation
+    .map_module = true,            // Share module pages through the page cache
+    .image_cache_dir = NULL,       // No warm-start image cache
+    .module_paths = NULL,          // Imports are looked up next to the program
+    .module_path_count = 0,
+    .profile_path = NULL,          // No profiling
+    .profile_interval = 0,         // VM_PROFILE_DEFAULT_INTERVAL when profiling
+    .heap_stats_path = NULL,       // No heap statistics
+    .alloc_sites = false,          // No allocation sites
+    .alloc_site_interval = 0,      // VM_HEAP_SITES_DEFAULT_INTERVAL when sampling
+    .jit = false,                  // Interpret every method
+    .jit_threshold = 0,            // VM_JIT_DEFAULT_THRESHOLD when compiling
+    .task_slice = 0,               // VM_TASK_DEFAULT_SLICE
+    .output_block = 0              // Output is written line by line
 };
 
 bool runtime_init(runtime_context_t *runtime, const runtime_config_t *config)
@@ -38,14 +71,55 @@ bool runtime_init(runtime_context_t *runtime, const runtime_config_t *config)
         runtime->config = RUNTIME_CONFIG_DEFAULT;
     }
     
-    // Override debug mode from global flag
-    runtime->config.debug_mode = debug_mode;
-    
     // Initialize VM
-    if (!vm_init(&runtime->vm, runtime->config.stack_size, runtime->config.memory_size)) {
+    if (!vm_init_sized(&runtime->vm, runtime->config.stack_size, runtime->config.stack_max_size,
+                       runtime->config.memory_size, runtime->config.frame_stack_max_size,
+                       runtime->config.heap_words, runtime->config.heap_max_words)) {
         printf("Error: Failed to initialize VM\n");
         return false;
     }
+    runtime->vm.debug_mode = runtime->config.debug_mode;
+    runtime->vm.dispatch_mode = runtime->config.dispatch_mode;
+    runtime->vm.superinstructions = runtime->config.superinstructions;
+    vm_set_budget(&runtime->vm, runtime->config.max_instructions, runtime->config.timeout_ms);
+    if (runtime->config.max_call_depth > 0) {
+        runtime->vm.call_stack.max_depth = runtime->config.max_call_depth;
+    }
+    runtime->vm.memory_manager.gc_threshold = runtime->config.gc_threshold;
+    runtime->vm.task_slice = runtime->config.task_slice;
+    vm_set_output_buffer(&runtime->vm, (size_t)runtime->config.output_block);
+    
+    // Before any code is loaded: the profiler picks the threaded handlers
+    if (runtime->config.profile_path != NULL &&
+        !vm_profile_enable(&runtime->vm, runtime->config.profile_interval)) {
+        printf("Error: Failed to enable the profiler\n");
+        vm_cleanup(&runtime->vm);
+        return false;
+    }
+    
+    // Likewise for the JIT's counting handlers. Debug and tracing runs step
+    // through the reference loop one instruction at a time, and profiles
+    // count every instruction, so all three stay interpreted.
+    if (runtime->config.jit && !runtime->config.debug_mode && !runtime->config.trace_execution &&
+        runtime->config.profile_path == NULL &&
+        !vm_jit_enable(&runtime->vm, runtime->config.jit_threshold)) {
+        printf("Warning: No JIT for this platform in this build; methods are interpreted\n");
+    }
+    
+    // The trace ring picks the instrumented reference loop for every run
+    if (runtime->config.trace_execution &&
+        !vm_trace_enable(&runtime->vm, runtime->config.trace_records)) {
+        printf("Error: Failed to allocate the trace ring\n");
+        vm_cleanup(&runtime->vm);
+        return false;
+    }
+    
+    if (runtime->config.alloc_sites &&
+        !vm_heap_sites_enable(&runtime->vm, runtime->config.alloc_site_interval)) {
+        printf("Error: Failed to set up allocation site sampling\n");
+        vm_cleanup(&runtime->vm);
+        return false;
+    }
     
     // Initialize loader
     if (!loader_init(&runtime->loader, &runtime->vm)) {
@@ -53,15 +127,54 @@ bool runtime_init(runtime_context_t *runtime, const runtime_config_t *config)
         vm_cleanup(&runtime->vm);
         return false;
     }
+    runtime->loader.map_module = runtime->config.map_module;
+    for (size_t i = 0; i < runtime->config.module_path_count; i++) {
+        if (!loader_add_module_path(&runtime->loader, runtime->config.module_paths[i])) {
+            printf("Error: Too many module paths (at most %d)\n", LOADER_MAX_MODULE_PATHS);
+            loader_cleanup(&runtime->loader);
+            vm_cleanup(&runtime->vm);
+            return false;
+        }
+    }
     
     runtime->initialized = true;
     
     if (runtime->config.debug_mode) {
         printf("ARX VM runtime initialized\n");
-        printf("  Stack size: %zu\n", runtime->config.stack_size);
+        printf("  Stack size: %zu words, growing to at most %zu\n",
+               runtime->vm.stack_size, runtime->vm.stack_max_size);
         printf("  Memory size: %zu\n", runtime->config.memory_size);
+        printf("  Object area: %llu words, growing to at most %llu\n",
+               (unsigned long long)(runtime->vm.memory_manager.heap_limit - runtime->vm.memory_manager.heap_base),
+               (unsigned long long)(runtime->vm.memory_manager.heap_max - runtime->vm.memory_manager.heap_base));
         printf("  Debug mode: %s\n", runtime->config.debug_mode ? "enabled" : "disabled");
         printf("  Trace execution: %s\n", runtime->config.trace_execution ? "enabled" : "disabled");
+        if (runtime->vm.trace != NULL) {
+            printf("  Trace ring: %llu records\n", (unsigned long long)(runtime->vm.trace->mask + 1));
+        }
+        printf("  Dispatch: %s\n", runtime->config.dispatch_mode == VM_DISPATCH_THREADED ? "threaded" : "switch");
+        printf("  Superinstructions: %s\n", runtime->config.superinstructions ? "enabled" : "disabled");
+        printf("  Instruction budget: %llu (0 = unlimited)\n", (unsigned long long)runtime->config.max_instructions);
+        printf("  Timeout: %llu ms (0 = unlimited)\n", (unsigned long long)runtime->config.timeout_ms);
+        printf("  Max call depth: %zu\n", runtime->vm.call_stack.max_depth);
+        if (runtime->config.profile_path != NULL) {
+            printf("  Profile: %s (sample every %llu instructions)\n", runtime->config.profile_path,
+                   (unsigned long long)runtime->vm.profile->interval);
+        }
+        if (runtime->vm.heap_sites != NULL) {
+            printf("  Allocation sites: every %llu allocations\n",
+                   (unsigned long long)runtime->vm.heap_sites->interval);
+        }
+        printf("  JIT: %s\n", runtime->vm.jit != NULL ? "enabled" : "disabled");
+        printf("  Task slice: %llu instructions\n", (unsigned long long)(runtime->config.task_slice > 0 ?
+               runtime->config.task_slice : VM_TASK_DEFAULT_SLICE));
+        if (runtime->config.output_block > 0) {
+            printf("  Output: written in blocks of %llu bytes\n", (unsigned long long)runtime->config.output_block);
+        } else {
+            printf("  Output: written line by line\n");
+        }
+        printf("  Array kernels: %s\n", vm_array_kernels());
+        printf("  String kernels: %s\n", vm_text_kernels());
     }
     
     return true;
@@ -70,8 +183,9 @@ bool runtime_init(runtime_context_t *runtime, const runtime_config_t *config)
 void runtime_cleanup(runtime_context_t *runtime)
 {
     if (runtime != NULL) {
-        loader_cleanup(&runtime->loader);
+        // The VM may still point into the module mapping, so it goes first
         vm_cleanup(&runtime->vm);
+        loader_cleanup(&runtime->loader);
         memset(runtime, 0, sizeof(runtime_context_t));
     }
 }
@@ -98,32 +212,47 @@ bool runtime_load_program(runtime_context_t *runtime, const char *filename)
         return false;
     }
     
-    // Load all sections
-    if (!loader_load_code_section(&runtime->loader)) {
-        printf("Error: Failed to load code section\n");
+    // External references come first: restored and loaded code alike is
+    // verified against them. An image holds the program alone, so imports
+    // are still linked on use.
+    if (!loader_load_externs_section(&runtime->loader)) {
+        printf("Error: Failed to load externs section\n");
         return false;
     }
     
-    if (!loader_load_classes_section(&runtime->loader)) {
-        printf("Error: Failed to load classes section\n");
-        return false;
+    // A cached image of this exact module replaces the section loads below
+    if (runtime->config.image_cache_dir != NULL &&
+        loader_restore_image(&runtime->loader, runtime->config.image_cache_dir)) {
+        if (runtime->config.debug_mode) {
+            printf("Program restored from warm-start image\n");
+        }
+        return true;
     }
     
+    // Load all sections (strings before code: the code is verified against them)
     if (!loader_load_strings_section(&runtime->loader)) {
         printf("Error: Failed to load strings section\n");
         return false;
     }
     
-    if (!loader_load_symbols_section(&runtime->loader)) {
-        printf("Error: Failed to load symbols section\n");
+    if (!loader_load_classes_section(&runtime->loader)) {
+        printf("Error: Failed to load classes section\n");
         return false;
     }
     
-    if (!loader_load_debug_section(&runtime->loader)) {
-        printf("Error: Failed to load debug section\n");
+    if (!loader_load_code_section(&runtime->loader)) {
+        printf("Error: Failed to load code section\n");
         return false;
     }
     
+    // Symbols and debug info are loaded on first use (runtime_dump_state)
+    
+    // A failed write only costs the next run its warm start
+    if (runtime->config.image_cache_dir != NULL &&
+        !loader_store_image(&runtime->loader, runtime->config.image_cache_dir) && runtime->config.debug_mode) {
+        printf("Warning: Could not write warm-start image to %s\n", runtime->config.image_cache_dir);
+    }
+    
     if (runtime->config.debug_mode) {
         printf("Program loaded successfully\n");
     }
@@ -131,6 +260,102 @@ bool runtime_load_program(runtime_context_t *runtime, const char *filename)
     return true;
 }
 
+// Load a module for runtime_init_shared(). The loaded state is kept as an
+// in-memory warm-start image, which every instance maps into its VM as
+// vm_load_image() does a cached one; the symbols and line table are read
+// now so that later lookups from any thread only read them.
+bool runtime_program_load(runtime_program_t *program, const runtime_config_t *config, const char *filename)
+{
+    if (program == NULL || filename == NULL) {
+        return false;
+    }
+    memset(program, 0, sizeof(runtime_program_t));
+    
+    // The base VM only loads; engines, profiling and the JIT are the instances' business
+    runtime_config_t base_config = config != NULL ? *config : RUNTIME_CONFIG_DEFAULT;
+    base_config.profile_path = NULL;
+    base_config.alloc_sites = false;
+    base_config.jit = false;
+    if (!runtime_init(&program->base, &base_config)) {
+        return false;
+    }
+    if (!runtime_load_program(&program->base, filename)) {
+        runtime_program_cleanup(program);
+        return false;
+    }
+    loader_load_symbols_section(&program->base.loader);
+    loader_load_debug_section(&program->base.loader);
+    program->base.loader.symbols_loaded = true;
+    program->base.loader.debug_loaded = true;
+    
+    // The image never outlives this process, so it is not tied to the module file
+    FILE *file = tmpfile();
+    bool written = file != NULL && vm_write_image(&program->base.vm, file, 0, 0) && fflush(file) == 0 &&
+                   fseek(file, 0, SEEK_END) == 0;
+    long size = written ? ftell(file) : -1;
+    if (size > 0) {
+        program->image = malloc((size_t)size);
+        program->image_size = (size_t)size;
+    }
+    written = program->image != NULL && fseek(file, 0, SEEK_SET) == 0 &&
+              fread(program->image, 1, program->image_size, file) == program->image_size;
+    if (file != NULL) {
+        fclose(file);
+    }
+    if (!written) {
+        printf("Error: Failed to prepare shared program %s\n", filename);
+        runtime_program_cleanup(program);
+        return false;
+    }
+    
+    if (program->base.config.debug_mode) {
+        printf("Shared program %s: %zu byte image\n", filename, program->image_size);
+    }
+    
+    return true;
+}
+
+void runtime_program_cleanup(runtime_program_t *program)
+{
+    if (program != NULL) {
+        runtime_cleanup(&program->base);
+        free(program->image);
+        memset(program, 0, sizeof(runtime_program_t));
+    }
+}
+
+// Start a runtime on a program loaded by runtime_program_load(), in place of
+// runtime_init() and runtime_load_program(). Safe to call on several threads
+// at once for the same program.
+bool runtime_init_shared(runtime_context_t *runtime, const runtime_config_t *config, runtime_program_t *program)
+{
+    if (runtime == NULL || program == NULL || program->image == NULL) {
+        return false;
+    }
+    
+    if (!runtime_init(runtime, config)) {
+        return false;
+    }
+    runtime->program = program;
+    
+    // Imports are still linked on first use, per runtime, from the program's directory
+    const arx_vm_context_t *base = &program->base.vm;
+    snprintf(runtime->loader.module_dir, sizeof(runtime->loader.module_dir), "%s", program->base.loader.module_dir);
+    runtime->vm.module_header = base->module_header;
+    if (!vm_load_image(&runtime->vm, program->image, program->image_size, 0, 0) ||
+        !vm_load_externs(&runtime->vm, base->modules.externs, base->modules.extern_count)) {
+        printf("Error: Failed to start runtime from shared program\n");
+        runtime_cleanup(runtime);
+        return false;
+    }
+    
+    if (runtime->config.debug_mode) {
+        printf("Program started from shared image\n");
+    }
+    
+    return true;
+}
+
 bool runtime_call_main_procedure(runtime_context_t *runtime)
 {
     if (runtime == NULL || !runtime->initialized) {
@@ -248,6 +473,13 @@ bool runtime_call_main_procedure(runtime_context_t *runtime)
     return true;
 }
 
+static uint64_t runtime_monotonic_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
 bool runtime_execute(runtime_context_t *runtime)
 {
     if (runtime == NULL || !runtime->initialized) {
@@ -269,7 +501,10 @@ bool runtime_execute(runtime_context_t *runtime)
         printf("Starting VM execution at PC=%zu\n", runtime->vm.pc);
     }
     
+    uint64_t start_ns = runtime_monotonic_ns();
     bool success = vm_execute(&runtime->vm);
+    runtime->execute_ns = runtime_monotonic_ns() - start_ns;
+    vm_profile_finish(&runtime->vm);
     
     if (runtime->config.debug_mode) {
         if (success) {
@@ -285,6 +520,17 @@ bool runtime_execute(runtime_context_t *runtime)
         runtime_dump_state(runtime);
     }
     
+    // The ring holds the instructions that led up to the end of the run
+    if (runtime->vm.trace != NULL) {
+        if (runtime->config.trace_path != NULL) {
+            if (!vm_trace_save(runtime->vm.trace, runtime->config.trace_path)) {
+                printf("Error: Failed to write trace '%s'\n", runtime->config.trace_path);
+            }
+        } else if (!success) {
+            vm_trace_print(runtime->vm.trace, stdout, VM_TRACE_REPORT_RECORDS);
+        }
+    }
+    
     return success;
 }
 
@@ -294,7 +540,9 @@ bool runtime_step(runtime_context_t *runtime)
         return false;
     }
     
+    // Stepping is interactive: show output as soon as it is produced
     bool success = vm_step(&runtime->vm);
+    vm_output_flush(&runtime->vm);
     
     if (runtime->config.trace_execution) {
         if (success) {
@@ -312,6 +560,11 @@ void runtime_set_config(runtime_context_t *runtime, const runtime_config_t *conf
 {
     if (runtime != NULL && config != NULL) {
         runtime->config = *config;
+        // The budget is armed per run, so a new one applies to the next runtime_execute()
+        vm_set_budget(&runtime->vm, config->max_instructions, config->timeout_ms);
+        runtime->vm.task_slice = config->task_slice;
+        vm_set_output_buffer(&runtime->vm, (size_t)config->output_block);
+        runtime->loader.map_module = config->map_module;
     }
 }
 
@@ -328,9 +581,21 @@ void runtime_set_trace_execution(runtime_context_t *runtime, bool trace)
 {
     if (runtime != NULL) {
         runtime->config.trace_execution = trace;
+        if (!trace) {
+            vm_trace_free(&runtime->vm);
+        } else if (runtime->vm.trace == NULL && !vm_trace_enable(&runtime->vm, runtime->config.trace_records)) {
+            runtime->config.trace_execution = false;
+        }
     }
 }
 
+// Loader that holds the module's sections: the shared program's for
+// runtimes started from one
+static loader_context_t *runtime_module_loader(runtime_context_t *runtime)
+{
+    return runtime->program != NULL ? &runtime->program->base.loader : &runtime->loader;
+}
+
 void runtime_dump_state(runtime_context_t *runtime)
 {
     if (runtime == NULL || !runtime->initialized) {
@@ -341,11 +606,110 @@ void runtime_dump_state(runtime_context_t *runtime)
     printf("\n=== ARX VM Runtime State ===\n");
     vm_dump_state(&runtime->vm);
     
+    loader_context_t *loader = runtime_module_loader(runtime);
+    uint32_t line = 0;
+    uint32_t column = 0;
+    if (loader_find_line(loader, runtime->vm.pc, &line, &column)) {
+        printf("Source position: line %u, column %u\n", line, column);
+    }
+    if (runtime->config.debug_mode && loader_load_symbols_section(loader)) {
+        printf("Symbols: %zu, line entries: %zu\n", loader->symbol_count, loader->debug_count);
+    }
+    
     if (runtime->config.debug_mode) {
-        loader_dump_module_info(&runtime->loader);
+        loader_dump_module_info(loader);
     }
 }
 
+static bool runtime_profile_line(void *data, size_t pc, uint32_t *line)
+{
+    return loader_find_line((loader_context_t *)data, pc, line, NULL);
+}
+
+// Write the sampled stacks to the configured file and print the opcode and
+// method summary. Lines come from the module's debug section.
+bool runtime_write_profile(runtime_context_t *runtime)
+{
+    if (runtime == NULL || !runtime->initialized || runtime->vm.profile == NULL) {
+        return false;
+    }
+    
+    vm_profile_report(&runtime->vm, stdout);
+    
+    FILE *file = fopen(runtime->config.profile_path, "w");
+    if (file == NULL) {
+        printf("Error: Cannot write profile to %s\n", runtime->config.profile_path);
+        return false;
+    }
+    bool written = vm_profile_write_stacks(&runtime->vm, file, runtime_profile_line, runtime_module_loader(runtime));
+    written = fclose(file) == 0 && written;
+    if (!written) {
+        printf("Error: Failed to write profile to %s\n", runtime->config.profile_path);
+        return false;
+    }
+    printf("Profile: %llu samples written to %s\n", (unsigned long long)runtime->vm.profile->samples,
+           runtime->config.profile_path);
+    return true;
+}
+
+// Write the heap statistics to the configured file, or to stdout for "-".
+// Allocation sites get their lines from the module's debug section.
+bool runtime_write_heap_stats(runtime_context_t *runtime)
+{
+    if (runtime == NULL || !runtime->initialized || runtime->config.heap_stats_path == NULL) {
+        return false;
+    }
+    
+    const char *path = runtime->config.heap_stats_path;
+    bool to_stdout = strcmp(path, "-") == 0;
+    FILE *file = to_stdout ? stdout : fopen(path, "w");
+    if (file == NULL) {
+        printf("Error: Cannot write heap statistics to %s\n", path);
+        return false;
+    }
+    bool written = vm_heap_stats_write_json(&runtime->vm, file, runtime->execute_ns,
+                                            runtime_profile_line, runtime_module_loader(runtime));
+    written = (to_stdout ? fflush(file) == 0 : fclose(file) == 0) && written;
+    if (!written) {
+        printf("Error: Failed to write heap statistics to %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+// Cost of the last run in one block the benchmark harness parses: work done,
+// time taken, heap allocations and the process's peak resident set
+void runtime_dump_exec_stats(runtime_context_t *runtime)
+{
+    if (runtime == NULL || !runtime->initialized) {
+        return;
+    }
+    
+    const memory_manager_t *mm = &runtime->vm.memory_manager;
+    double seconds = runtime->execute_ns / 1e9;
+    double rate = seconds > 0 ? runtime->vm.instruction_count_executed / seconds : 0;
+    struct rusage usage;
+    long peak_rss_kb = getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0; // Kilobytes on Linux
+    
+    printf("=== Execution ===\n");
+    printf("Instructions: %zu\n", runtime->vm.instruction_count_executed);
+    printf("Time: %.3f ms\n", runtime->execute_ns / 1e6);
+    printf("Rate: %.0f instructions/s\n", rate);
+    printf("Allocations: %llu blocks, %llu bytes\n",
+           (unsigned long long)mm->heap_allocations, (unsigned long long)mm->heap_bytes_allocated);
+    printf("Peak RSS: %ld KB\n", peak_rss_kb);
+    if (runtime->vm.jit != NULL) {
+        printf("JIT: %zu methods compiled, %zu bytes of code, %llu native entries\n",
+               runtime->vm.jit->compiled, runtime->vm.jit->code_bytes,
+               (unsigned long long)runtime->vm.jit->entries_taken);
+    }
+    if (runtime->vm.tasks != NULL) {
+        printf("Tasks: %llu spawned, %llu switches\n", (unsigned long long)runtime->vm.tasks->spawned,
+               (unsigned long long)runtime->vm.tasks->switches);
+    }
+    printf("=================\n");
+}
+
 void runtime_dump_stack(runtime_context_t *runtime, size_t count)
 {
     if (runtime != NULL && runtime->initialized) {
@@ -12,25 +12,71 @@
 
 // Runtime configuration
 typedef struct {
-    size_t stack_size;             // VM stack size
+    size_t stack_size;             // Initial data stack size in words
+    size_t stack_max_size;         // Words the data stack may grow to (0 = VM_STACK_DEFAULT_MAX_WORDS)
+    size_t frame_stack_max_size;   // Words each frame stack may grow to (0 = VM_FRAME_STACK_DEFAULT_MAX_WORDS)
     size_t memory_size;            // VM memory size
+    size_t heap_words;             // Initial object area in words (0 = VM_HEAP_DEFAULT_WORDS)
+    size_t heap_max_words;         // Words the object area may grow to (0 = VM_HEAP_DEFAULT_MAX_WORDS)
     bool debug_mode;               // Debug output
-    bool trace_execution;          // Trace instruction execution
+    bool trace_execution;          // Record executed instructions in a trace ring
+    size_t trace_records;          // Records the ring keeps (0 = VM_TRACE_DEFAULT_RECORDS)
+    const char *trace_path;        // The ring is saved here after a traced run (NULL = printed on error)
     bool dump_state_on_error;      // Dump state on error
+    vm_dispatch_mode_t dispatch_mode; // Interpreter engine used by runtime_execute()
+    bool superinstructions;        // Fuse common instruction sequences at load time
+    uint64_t max_instructions;     // Instruction budget per run (0 = unlimited)
+    uint64_t timeout_ms;           // Wall-clock budget per run in milliseconds (0 = unlimited)
+    size_t max_call_depth;         // Nested procedure calls allowed
+    uint64_t gc_threshold;         // Bytes allocated between collections (0 = only when full)
+    bool map_module;               // Run the module from a read-only mapping instead of copies
+    const char *image_cache_dir;   // Warm-start image cache directory (NULL = no cache)
+    const char *const *module_paths; // Directories searched for imported modules (before the program's own)
+    size_t module_path_count;      // Number of module paths
+    const char *profile_path;      // Collapsed call stacks are written here after the run (NULL = no profiling)
+    uint64_t profile_interval;     // Instructions between profile samples (0 = VM_PROFILE_DEFAULT_INTERVAL)
+    const char *heap_stats_path;   // Heap statistics are written here as JSON after the run ("-" = stdout, NULL = none)
+    bool alloc_sites;              // Charge sampled allocations to the instructions that made them
+    uint64_t alloc_site_interval;  // Allocations between site samples (0 = VM_HEAP_SITES_DEFAULT_INTERVAL)
+    bool jit;                      // Compile hot methods to native code
+    uint64_t jit_threshold;        // Entries and loop iterations before a method is compiled (0 = VM_JIT_DEFAULT_THRESHOLD)
+    uint64_t task_slice;           // Instructions per task turn before the next ready task runs (0 = VM_TASK_DEFAULT_SLICE)
+    uint64_t output_block;         // Bytes of program output kept before a write (0 = write each line)
 } runtime_config_t;
 
-// Runtime context
+typedef struct runtime_program runtime_program_t;
+
+// Runtime context. Everything a run touches lives here, so runtimes on
+// different threads do not interfere.
 typedef struct {
     arx_vm_context_t vm;           // VM context
     loader_context_t loader;       // Module loader
     runtime_config_t config;       // Runtime configuration
+    runtime_program_t *program;    // Shared module it was started from (NULL: loaded its own)
     bool initialized;              // Runtime initialized flag
+    uint64_t execute_ns;           // Wall-clock time of the last runtime_execute()
 } runtime_context_t;
 
+// A module loaded once and shared by any number of runtimes, on any
+// threads, started from it with runtime_init_shared(). Its code, strings
+// and line table are read in place and never written after
+// runtime_program_load(); each runtime has its own VM with its own stacks,
+// heap, globals, decoded code and class tables. Must outlive them.
+struct runtime_program {
+    runtime_context_t base;        // Loads the module and keeps its sections; never runs
+    uint8_t *image;                // Warm-start image of the loaded module (see vm_write_image())
+    size_t image_size;             // Image length in bytes
+};
+
 // Runtime functions
 bool runtime_init(runtime_context_t *runtime, const runtime_config_t *config);
 void runtime_cleanup(runtime_context_t *runtime);
 
+// Shared programs
+bool runtime_program_load(runtime_program_t *program, const runtime_config_t *config, const char *filename);
+void runtime_program_cleanup(runtime_program_t *program);
+bool runtime_init_shared(runtime_context_t *runtime, const runtime_config_t *config, runtime_program_t *program);
+
 // Program execution
 bool runtime_load_program(runtime_context_t *runtime, const char *filename);
 bool runtime_call_main_procedure(runtime_context_t *runtime);
@@ -44,6 +90,9 @@ void runtime_set_trace_execution(runtime_context_t *runtime, bool trace);
 
 // Inspection and debugging
 void runtime_dump_state(runtime_context_t *runtime);
+bool runtime_write_profile(runtime_context_t *runtime);
+bool runtime_write_heap_stats(runtime_context_t *runtime);
+void runtime_dump_exec_stats(runtime_context_t *runtime);
 void runtime_dump_stack(runtime_context_t *runtime, size_t count);
 void runtime_dump_memory(runtime_context_t *runtime, size_t start, size_t count);
 void runtime_dump_instructions(runtime_context_t *runtime, size_t start, size_t count);